@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/arena_bench.dir/ArenaBench.cpp.o"
+  "CMakeFiles/arena_bench.dir/ArenaBench.cpp.o.d"
+  "arena_bench"
+  "arena_bench.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/arena_bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/parser_bench.dir/ParserBench.cpp.o"
+  "CMakeFiles/parser_bench.dir/ParserBench.cpp.o.d"
+  "CMakeFiles/parser_bench.dir/root/repo/src/pbrt_scene_editor/PBRTTokenizer.cpp.o"
+  "CMakeFiles/parser_bench.dir/root/repo/src/pbrt_scene_editor/PBRTTokenizer.cpp.o.d"
+  "parser_bench"
+  "parser_bench.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/parser_bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
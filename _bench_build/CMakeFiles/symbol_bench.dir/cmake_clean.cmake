@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/symbol_bench.dir/SymbolBench.cpp.o"
+  "CMakeFiles/symbol_bench.dir/SymbolBench.cpp.o.d"
+  "symbol_bench"
+  "symbol_bench.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/symbol_bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/chunked_arena_test.dir/ChunkedArenaTest.cpp.o"
+  "CMakeFiles/chunked_arena_test.dir/ChunkedArenaTest.cpp.o.d"
+  "chunked_arena_test"
+  "chunked_arena_test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/chunked_arena_test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/frame_graph_scheduling_test.dir/FrameGraphSchedulingTest.cpp.o"
+  "CMakeFiles/frame_graph_scheduling_test.dir/FrameGraphSchedulingTest.cpp.o.d"
+  "frame_graph_scheduling_test"
+  "frame_graph_scheduling_test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/frame_graph_scheduling_test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/include_scheduler_test.dir/IncludeSchedulerTest.cpp.o"
+  "CMakeFiles/include_scheduler_test.dir/IncludeSchedulerTest.cpp.o.d"
+  "CMakeFiles/include_scheduler_test.dir/root/repo/src/pbrt_scene_editor/PBRTParser.cpp.o"
+  "CMakeFiles/include_scheduler_test.dir/root/repo/src/pbrt_scene_editor/PBRTParser.cpp.o.d"
+  "CMakeFiles/include_scheduler_test.dir/root/repo/src/pbrt_scene_editor/PBRTTokenizer.cpp.o"
+  "CMakeFiles/include_scheduler_test.dir/root/repo/src/pbrt_scene_editor/PBRTTokenizer.cpp.o.d"
+  "include_scheduler_test"
+  "include_scheduler_test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/include_scheduler_test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
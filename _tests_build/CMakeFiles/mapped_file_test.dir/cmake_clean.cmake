@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/mapped_file_test.dir/MappedFileTest.cpp.o"
+  "CMakeFiles/mapped_file_test.dir/MappedFileTest.cpp.o.d"
+  "CMakeFiles/mapped_file_test.dir/root/repo/src/pbrt_scene_editor/PBRTParser.cpp.o"
+  "CMakeFiles/mapped_file_test.dir/root/repo/src/pbrt_scene_editor/PBRTParser.cpp.o.d"
+  "CMakeFiles/mapped_file_test.dir/root/repo/src/pbrt_scene_editor/PBRTTokenizer.cpp.o"
+  "CMakeFiles/mapped_file_test.dir/root/repo/src/pbrt_scene_editor/PBRTTokenizer.cpp.o.d"
+  "mapped_file_test"
+  "mapped_file_test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/mapped_file_test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/symbol_test.dir/SymbolTest.cpp.o"
+  "CMakeFiles/symbol_test.dir/SymbolTest.cpp.o.d"
+  "symbol_test"
+  "symbol_test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/symbol_test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/tokenizer_equivalence_scalar.dir/TokenizerEquivalenceTest.cpp.o"
+  "CMakeFiles/tokenizer_equivalence_scalar.dir/TokenizerEquivalenceTest.cpp.o.d"
+  "CMakeFiles/tokenizer_equivalence_scalar.dir/root/repo/src/pbrt_scene_editor/PBRTTokenizer.cpp.o"
+  "CMakeFiles/tokenizer_equivalence_scalar.dir/root/repo/src/pbrt_scene_editor/PBRTTokenizer.cpp.o.d"
+  "tokenizer_equivalence_scalar"
+  "tokenizer_equivalence_scalar.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/tokenizer_equivalence_scalar.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
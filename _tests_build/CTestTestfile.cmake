@@ -0,0 +1,24 @@
+# CMake generated Testfile for 
+# Source directory: /root/repo/tests
+# Build directory: /root/repo/_tests_build
+# 
+# This file includes the relevant testing commands required for 
+# testing this directory and lists subdirectories to be tested as well.
+add_test([=[mapped_file_test]=] "/root/repo/_tests_build/mapped_file_test")
+set_tests_properties([=[mapped_file_test]=] PROPERTIES  SKIP_RETURN_CODE "77" _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;27;add_test;/root/repo/tests/CMakeLists.txt;32;editor_add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test([=[tokenizer_equivalence_scalar]=] "/root/repo/_tests_build/tokenizer_equivalence_scalar")
+set_tests_properties([=[tokenizer_equivalence_scalar]=] PROPERTIES  SKIP_RETURN_CODE "77" _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;27;add_test;/root/repo/tests/CMakeLists.txt;37;editor_add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test([=[tokenizer_equivalence_sse2]=] "/root/repo/_tests_build/tokenizer_equivalence_sse2")
+set_tests_properties([=[tokenizer_equivalence_sse2]=] PROPERTIES  SKIP_RETURN_CODE "77" _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;27;add_test;/root/repo/tests/CMakeLists.txt;39;editor_add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test([=[tokenizer_equivalence_avx2]=] "/root/repo/_tests_build/tokenizer_equivalence_avx2")
+set_tests_properties([=[tokenizer_equivalence_avx2]=] PROPERTIES  SKIP_RETURN_CODE "77" _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;27;add_test;/root/repo/tests/CMakeLists.txt;48;editor_add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test([=[thread_pool_test]=] "/root/repo/_tests_build/thread_pool_test")
+set_tests_properties([=[thread_pool_test]=] PROPERTIES  SKIP_RETURN_CODE "77" _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;27;add_test;/root/repo/tests/CMakeLists.txt;52;editor_add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test([=[chunked_arena_test]=] "/root/repo/_tests_build/chunked_arena_test")
+set_tests_properties([=[chunked_arena_test]=] PROPERTIES  SKIP_RETURN_CODE "77" _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;27;add_test;/root/repo/tests/CMakeLists.txt;53;editor_add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test([=[symbol_test]=] "/root/repo/_tests_build/symbol_test")
+set_tests_properties([=[symbol_test]=] PROPERTIES  SKIP_RETURN_CODE "77" _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;27;add_test;/root/repo/tests/CMakeLists.txt;54;editor_add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test([=[frame_graph_scheduling_test]=] "/root/repo/_tests_build/frame_graph_scheduling_test")
+set_tests_properties([=[frame_graph_scheduling_test]=] PROPERTIES  SKIP_RETURN_CODE "77" _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;27;add_test;/root/repo/tests/CMakeLists.txt;55;editor_add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test([=[include_scheduler_test]=] "/root/repo/_tests_build/include_scheduler_test")
+set_tests_properties([=[include_scheduler_test]=] PROPERTIES  SKIP_RETURN_CODE "77" _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;27;add_test;/root/repo/tests/CMakeLists.txt;57;editor_add_test;/root/repo/tests/CMakeLists.txt;0;")
@@ -0,0 +1,157 @@
+#include "BenchCommon.hpp"
+
+#include "ChunkedArena.hpp"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+/*
+*  Building, walking and freeing a scene-sized tree, nodes allocated one by one with new and linked by
+*  vectors of child pointers (the scene graph before ChunkedArena) against nodes in a ChunkedArena with
+*  their children as ranges of a shared handle pool.
+*/
+namespace
+{
+    constexpr int BRANCHING = 8;
+
+    struct PointerNode
+    {
+        glm::mat4 transform{ 1.0f };
+        std::string name;
+        PointerNode* parent = nullptr;
+        std::vector<PointerNode*> children;
+    };
+
+    struct ArenaNode
+    {
+        glm::mat4 transform{ 1.0f };
+        std::string name;
+        ArenaHandle<ArenaNode> parent;
+        PoolRange children;
+    };
+
+    struct ArenaTree
+    {
+        ChunkedArena<ArenaNode> nodes;
+        std::vector<ArenaHandle<ArenaNode>> childPool;
+        ArenaHandle<ArenaNode> root;
+    };
+
+    // children are appended level by level, like the builder closing its open nodes
+    PointerNode* buildPointerTree(size_t count)
+    {
+        auto* root = new PointerNode;
+        std::vector<PointerNode*> level{ root };
+        size_t created = 1;
+        while (created < count)
+        {
+            std::vector<PointerNode*> next;
+            for (auto* parent : level)
+            {
+                for (int c = 0; c < BRANCHING && created < count; c++, created++)
+                {
+                    auto* child = new PointerNode;
+                    child->name = "node";
+                    child->parent = parent;
+                    parent->children.push_back(child);
+                    next.push_back(child);
+                }
+            }
+            level.swap(next);
+        }
+        return root;
+    }
+
+    void freePointerTree(PointerNode* node)
+    {
+        for (auto* child : node->children)
+            freePointerTree(child);
+        delete node;
+    }
+
+    void buildArenaTree(ArenaTree& tree, size_t count)
+    {
+        tree.root = tree.nodes.create();
+        std::vector<ArenaHandle<ArenaNode>> level{ tree.root };
+        std::vector<ArenaHandle<ArenaNode>> children;
+        size_t created = 1;
+        while (created < count)
+        {
+            std::vector<ArenaHandle<ArenaNode>> next;
+            for (auto parent : level)
+            {
+                children.clear();
+                for (int c = 0; c < BRANCHING && created < count; c++, created++)
+                {
+                    auto child = tree.nodes.create();
+                    auto* node = tree.nodes.get(child);
+                    node->name = "node";
+                    node->parent = parent;
+                    children.push_back(child);
+                }
+                tree.nodes.get(parent)->children = appendToPool(tree.childPool, children);
+                next.insert(next.end(), children.begin(), children.end());
+            }
+            level.swap(next);
+        }
+    }
+
+    float walk(const PointerNode* node, const glm::mat4& parent)
+    {
+        glm::mat4 world = parent * node->transform;
+        float sum = world[3][0];
+        for (auto* child : node->children)
+            sum += walk(child, world);
+        return sum;
+    }
+
+    float walk(const ArenaTree& tree, ArenaHandle<ArenaNode> handle, const glm::mat4& parent)
+    {
+        const auto* node = tree.nodes.get(handle);
+        glm::mat4 world = parent * node->transform;
+        float sum = world[3][0];
+        for (auto child : spanOf<const ArenaHandle<ArenaNode>>(tree.childPool, node->children))
+            sum += walk(tree, child, world);
+        return sum;
+    }
+}
+
+int main()
+{
+    for (size_t count : { size_t(10000), size_t(100000), size_t(1000000) })
+    {
+        std::string name = "arena_bench/" + std::to_string(count) + " nodes";
+
+        double pointerBuild = 0, pointerWalk = 0, pointerFree = 0;
+        double arenaBuild = 0, arenaWalk = 0, arenaFree = 0;
+        const int runs = 3;
+        for (int run = 0; run < runs; run++)
+        {
+            PointerNode* root = nullptr;
+            double t = editor_bench::bestSeconds(1, [&] { root = buildPointerTree(count); });
+            pointerBuild = run == 0 ? t : std::min(pointerBuild, t);
+            t = editor_bench::bestSeconds(1, [&] { editor_bench::consume(walk(root, glm::mat4(1.0f))); });
+            pointerWalk = run == 0 ? t : std::min(pointerWalk, t);
+            t = editor_bench::bestSeconds(1, [&] { freePointerTree(root); });
+            pointerFree = run == 0 ? t : std::min(pointerFree, t);
+
+            auto tree = std::make_unique<ArenaTree>();
+            t = editor_bench::bestSeconds(1, [&] { buildArenaTree(*tree, count); });
+            arenaBuild = run == 0 ? t : std::min(arenaBuild, t);
+            t = editor_bench::bestSeconds(1, [&] { editor_bench::consume(walk(*tree, tree->root, glm::mat4(1.0f))); });
+            arenaWalk = run == 0 ? t : std::min(arenaWalk, t);
+            t = editor_bench::bestSeconds(1, [&] { tree.reset(); });
+            arenaFree = run == 0 ? t : std::min(arenaFree, t);
+        }
+
+        editor_bench::report(name.c_str(), "build new/delete", pointerBuild * 1e3, "ms");
+        editor_bench::report(name.c_str(), "build arena", arenaBuild * 1e3, "ms");
+        editor_bench::report(name.c_str(), "walk new/delete", pointerWalk * 1e3, "ms");
+        editor_bench::report(name.c_str(), "walk arena", arenaWalk * 1e3, "ms");
+        editor_bench::report(name.c_str(), "free new/delete", pointerFree * 1e3, "ms");
+        editor_bench::report(name.c_str(), "free arena", arenaFree * 1e3, "ms");
+    }
+    return 0;
+}
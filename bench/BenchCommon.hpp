@@ -0,0 +1,43 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+/*
+*  Timing helpers shared by the benchmarks. Every measurement is the best of a few runs, which is
+*  the most stable number on a machine doing other work.
+*/
+namespace editor_bench
+{
+    template<class Fn>
+    double bestSeconds(int runs, Fn&& fn)
+    {
+        double best = 1e30;
+        for (int i = 0; i < runs; i++) {
+            auto start = std::chrono::steady_clock::now();
+            fn();
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+        return best;
+    }
+
+    // keeps the optimizer from dropping a computation whose result is otherwise unused
+    template<class T>
+    void consume(const T& value)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        // taking the address alone doesn't make the compiler produce the value
+        asm volatile("" : : "r,m"(value) : "memory");
+#else
+        static volatile char sink;
+        sink = *reinterpret_cast<const volatile char*>(&value);
+#endif
+    }
+
+    inline void report(const char* name, const char* what, double value, const char* unit)
+    {
+        std::printf("%-40s %-28s %12.3f %s\n", name, what, value, unit);
+    }
+}
@@ -0,0 +1,163 @@
+#include "BenchCommon.hpp"
+
+#include "scene.h"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+*  Building 1M Materials and 1M Shapes from their directive parameters: the creator picks the subclass by name and
+*  parse() binds the fields. The GenericCreator registry and the PBRTParamTable of each class are measured against
+*  the string compare path they replaced, the creator comparing the name with each subclass in turn and every
+*  field scanning the whole parameter list.
+*/
+namespace
+{
+    constexpr size_t OBJECT_COUNT = 1000000;
+
+    // The creator before the registry: the type names compared case insensitively in declaration order
+    template<class Creator>
+    struct LinearCreator;
+
+    template<class Base, class... Derived>
+    struct LinearCreator<GenericCreator<Base, Derived...>>
+    {
+        static std::unique_ptr<Base> make(const std::string& type_str)
+        {
+            std::unique_ptr<Base> made;
+            ((compareUpper(Derived::Type(), type_str) ? (made = std::make_unique<Derived>(), true) : false) || ...);
+            return made;
+        }
+    };
+
+    // The parse section before the tables, each field looks for its name among all the parameters
+#define SCAN_FOR(field) for (auto& param : para_lists) { \
+                            if (param.name == #field) { \
+                                if (param.holds<decltype(self.field)>()) self.field = param.get<decltype(self.field)>(); \
+                                break; } }
+#define SCAN_FOR_VARIANT(field) for (auto& param : para_lists) { \
+                                    if (param.name == #field) { assignVariant(self.field, param); break; } }
+#define SCAN_FOR_VECTOR(field) for (auto& param : para_lists) { \
+                                   if (param.name == #field) { \
+                                       if (param.holds<typename decltype(self.field)::value_type>()) param.getAll(self.field); \
+                                       break; } }
+
+    void scanParse(CoatedDiffuseMaterial& self, const std::vector<PBRTParam>& para_lists)
+    {
+        SCAN_FOR(name)
+        SCAN_FOR_VARIANT(displacement)
+        SCAN_FOR(normalmap)
+        SCAN_FOR_VARIANT(albedo)
+        SCAN_FOR_VARIANT(g)
+        SCAN_FOR(maxdepth)
+        SCAN_FOR(nsamples)
+        SCAN_FOR(thickness)
+        SCAN_FOR_VARIANT(roughness)
+        SCAN_FOR_VARIANT(uroughness)
+        SCAN_FOR_VARIANT(vroughness)
+        SCAN_FOR(remaproughness)
+        SCAN_FOR_VARIANT(reflectance)
+    }
+
+    void scanParse(TriangleMeshShape& self, const std::vector<PBRTParam>& para_lists)
+    {
+        SCAN_FOR(alpha_constant)
+        SCAN_FOR(alpha_tex)
+        SCAN_FOR_VECTOR(indices)
+        SCAN_FOR_VECTOR(P)
+        SCAN_FOR_VECTOR(N)
+        SCAN_FOR_VECTOR(S)
+        SCAN_FOR_VECTOR(uv)
+        SCAN_FOR_VECTOR(faceIndices)
+    }
+
+    void scanParse(PLYMeshShape& self, const std::vector<PBRTParam>& para_lists)
+    {
+        SCAN_FOR(alpha_constant)
+        SCAN_FOR(alpha_tex)
+        SCAN_FOR(filename)
+        SCAN_FOR(edgelength)
+    }
+
+#undef SCAN_FOR
+#undef SCAN_FOR_VARIANT
+#undef SCAN_FOR_VECTOR
+
+    // Values the parameters view, like the PBRTParamArena of a directive
+    struct Values
+    {
+        std::vector<int> ints{ 0, 1, 2, 2, 1, 3, 1 };
+        std::vector<float> floats{ 0.8f, 0.5f, 0.2f, 0.05f, 0.02f, 0, 0, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0 };
+        std::vector<std::string_view> strings{ "coated", "meshes/bunny.ply" };
+    };
+
+    PBRTParam param(std::string_view name, PBRTParamType type, size_t count, const float* floats, const int* ints = nullptr,
+                    const std::string_view* strings = nullptr)
+    {
+        PBRTParam p{};
+        p.name = name;
+        p.type = type;
+        p.count = count;
+        p.floats = floats;
+        p.ints = ints;
+        p.strings = strings;
+        return p;
+    }
+
+    template<class Creator, class Concrete>
+    void run(const char* label, const std::string& type, const std::vector<PBRTParam>& params)
+    {
+        double table = editor_bench::bestSeconds(3, [&] {
+            for (size_t i = 0; i < OBJECT_COUNT; i++) {
+                auto object = Creator::make(type);
+                object->parse(params);
+                editor_bench::consume(object.get());
+            }
+        });
+        double scan = editor_bench::bestSeconds(3, [&] {
+            for (size_t i = 0; i < OBJECT_COUNT; i++) {
+                auto object = LinearCreator<Creator>::make(type);
+                scanParse(static_cast<Concrete&>(*object), params);
+                editor_bench::consume(object.get());
+            }
+        });
+        editor_bench::report(label, "registry + PBRTParamTable", OBJECT_COUNT / table * 1e-6, "Mobjects/s");
+        editor_bench::report(label, "string compare", OBJECT_COUNT / scan * 1e-6, "Mobjects/s");
+        editor_bench::report(label, "speedup", scan / table, "x");
+    }
+}
+
+int main()
+{
+    Values v;
+
+    // Material "coateddiffuse" "rgb reflectance" [.8 .5 .2] "float roughness" .05 "float thickness" .02
+    //                          "integer maxdepth" 1 "string name" "coated"
+    std::vector<PBRTParam> material{
+        param("reflectance", PBRTParamType::Rgb, 3, v.floats.data()),
+        param("roughness", PBRTParamType::Float, 1, v.floats.data() + 3),
+        param("thickness", PBRTParamType::Float, 1, v.floats.data() + 4),
+        param("maxdepth", PBRTParamType::Integer, 1, nullptr, v.ints.data() + 1),
+        param("name", PBRTParamType::String, 1, nullptr, nullptr, v.strings.data()),
+    };
+    // the first subclass the linear creator tries, the shapes below are the last ones
+    run<MaterialCreator, CoatedDiffuseMaterial>("material_shape_bench/coateddiffuse", "coateddiffuse", material);
+
+    // Shape "trianglemesh" "integer indices" [0 1 2 2 1 3] "point3 P" [...] "normal N" [...]
+    std::vector<PBRTParam> triangles{
+        param("indices", PBRTParamType::Integer, 6, nullptr, v.ints.data()),
+        param("P", PBRTParamType::Point3, 12, v.floats.data() + 5),
+        param("uv", PBRTParamType::Point2, 4, v.floats.data() + 5),
+    };
+    run<ShapeCreator, TriangleMeshShape>("material_shape_bench/trianglemesh", "trianglemesh", triangles);
+
+    // Shape "plymesh" "string filename" "meshes/bunny.ply" "float alpha_constant" 1
+    std::vector<PBRTParam> ply{
+        param("filename", PBRTParamType::String, 1, nullptr, nullptr, v.strings.data() + 1),
+        param("alpha_constant", PBRTParamType::Float, 1, v.floats.data() + 8),
+    };
+    run<ShapeCreator, PLYMeshShape>("material_shape_bench/plymesh", "plymesh", ply);
+    return 0;
+}
@@ -0,0 +1,150 @@
+#include "BenchCommon.hpp"
+
+#include "AssetManager.hpp"
+#include "PLYReader.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+*  AssetManager::optimizeMesh() on the meshes it gets: the post transform cache (ACMR, vertices transformed per
+*  triangle, and ATVR, per vertex, for a 16 entry cache), the overfetch and the vertex memory before and after, with
+*  the float and the quantized vertex formats. Scanned and exported meshes often list their triangles in no useful
+*  order, the generated ones are shuffled to stand for them.
+*  mesh_optimization_bench [mesh.ply ...] : without arguments a grid and a sphere with normals and uvs are generated.
+*/
+namespace
+{
+    using MeshFactory = std::function<MeshHostObject()>;
+
+    // Triangles from the (x, y, z, nx, ny, nz, u, v) vertices, their order and the vertex order are shuffled
+    MeshHostObject makeMesh(const std::vector<std::array<float, 8>>& vertices, std::vector<unsigned int> indices, uint32_t seed)
+    {
+        std::mt19937 rng(seed);
+        std::vector<unsigned int> remap(vertices.size());
+        std::iota(remap.begin(), remap.end(), 0u);
+        std::shuffle(remap.begin(), remap.end(), rng);
+        std::vector<size_t> triangles(indices.size() / 3);
+        std::iota(triangles.begin(), triangles.end(), size_t(0));
+        std::shuffle(triangles.begin(), triangles.end(), rng);
+
+        MeshHostObject mesh;
+        mesh.vertex_count = static_cast<unsigned int>(vertices.size());
+        mesh.index_count = static_cast<unsigned int>(indices.size());
+        mesh.position.reset(new float[vertices.size() * 3]);
+        mesh.normal.reset(new float[vertices.size() * 3]);
+        mesh.uv.reset(new float[vertices.size() * 2]);
+        mesh.aabb[0] = mesh.aabb[1] = mesh.aabb[2] = std::numeric_limits<float>::infinity();
+        mesh.aabb[3] = mesh.aabb[4] = mesh.aabb[5] = -std::numeric_limits<float>::infinity();
+        for (size_t i = 0; i < vertices.size(); i++) {
+            const auto& vertex = vertices[i];
+            size_t to = remap[i];
+            for (int k = 0; k < 3; k++) {
+                mesh.position[to * 3 + k] = vertex[k];
+                mesh.normal[to * 3 + k] = vertex[3 + k];
+                mesh.aabb[k] = std::min(mesh.aabb[k], vertex[k]);
+                mesh.aabb[k + 3] = std::max(mesh.aabb[k + 3], vertex[k]);
+            }
+            mesh.uv[to * 2 + 0] = vertex[6];
+            mesh.uv[to * 2 + 1] = vertex[7];
+        }
+        mesh.indices.reset(new unsigned int[indices.size()]);
+        for (size_t t = 0; t < triangles.size(); t++)
+            for (int k = 0; k < 3; k++)
+                mesh.indices[t * 3 + k] = remap[indices[triangles[t] * 3 + k]];
+        return mesh;
+    }
+
+    MeshHostObject makeGrid(size_t side)
+    {
+        std::vector<std::array<float, 8>> vertices;
+        std::vector<unsigned int> indices;
+        for (size_t j = 0; j < side; j++)
+            for (size_t i = 0; i < side; i++)
+                vertices.push_back({ float(i), float(j), 0.1f * float((i * 7 + j * 3) % 5), 0.0f, 0.0f, 1.0f, float(i) / side, float(j) / side });
+        for (size_t j = 0; j + 1 < side; j++) {
+            for (size_t i = 0; i + 1 < side; i++) {
+                auto v = static_cast<unsigned int>(j * side + i);
+                auto row = static_cast<unsigned int>(side);
+                indices.insert(indices.end(), { v, v + 1, v + row, v + 1, v + row + 1, v + row });
+            }
+        }
+        return makeMesh(vertices, std::move(indices), 1);
+    }
+
+    MeshHostObject makeSphere(size_t rings, size_t segments)
+    {
+        std::vector<std::array<float, 8>> vertices;
+        std::vector<unsigned int> indices;
+        for (size_t r = 0; r <= rings; r++) {
+            float theta = 3.14159265f * float(r) / rings;
+            for (size_t s = 0; s <= segments; s++) {
+                float phi = 6.2831853f * float(s) / segments;
+                float x = std::sin(theta) * std::cos(phi), y = std::cos(theta), z = std::sin(theta) * std::sin(phi);
+                vertices.push_back({ x, y, z, x, y, z, float(s) / segments, float(r) / rings });
+            }
+        }
+        auto row = static_cast<unsigned int>(segments + 1);
+        for (unsigned int r = 0; r < rings; r++) {
+            for (unsigned int s = 0; s < segments; s++) {
+                unsigned int v = r * row + s;
+                indices.insert(indices.end(), { v, v + row, v + 1, v + 1, v + row, v + row + 1 });
+            }
+        }
+        return makeMesh(vertices, std::move(indices), 2);
+    }
+
+    void run(const std::string& label, const MeshFactory& factory)
+    {
+        // the LOD chain is part of what a load pays for
+        const std::vector<float> lodErrorTargets{ 0.01f, 0.02f, 0.05f, 0.1f, 0.2f };
+
+        MeshOptimizationStatistics statistics;
+        double best = 1e30;
+        for (int i = 0; i < 3; i++) {
+            auto mesh = factory();
+            best = std::min(best, editor_bench::bestSeconds(1, [&] { statistics = AssetManager::optimizeMesh(mesh, lodErrorTargets); }));
+        }
+
+        auto mesh = factory();
+        size_t triangles = mesh.index_count / 3;
+        statistics = AssetManager::optimizeMesh(mesh, lodErrorTargets);
+        // the build only quantizes with EDITOR_QUANTIZE_VERTICES, the quantized size is shown either way
+        mesh.quantizeInterleavingAttributes();
+        size_t quantizedBytes = size_t(mesh.vertex_count) * mesh.getInterleavingAttributes().second.VertexStride;
+
+        editor_bench::report(label.c_str(), "ACMR before", statistics.cacheBefore.acmr, "vertices/triangle");
+        editor_bench::report(label.c_str(), "ACMR after", statistics.cacheAfter.acmr, "vertices/triangle");
+        editor_bench::report(label.c_str(), "ATVR before", statistics.cacheBefore.atvr, "transforms/vertex");
+        editor_bench::report(label.c_str(), "ATVR after", statistics.cacheAfter.atvr, "transforms/vertex");
+        editor_bench::report(label.c_str(), "overfetch before", statistics.fetchBefore.overfetch, "x");
+        editor_bench::report(label.c_str(), "overfetch after", statistics.fetchAfter.overfetch, "x");
+        editor_bench::report(label.c_str(), "vertex memory before", statistics.vertexBytesBefore / 1024.0, "KB");
+        editor_bench::report(label.c_str(), "vertex memory after", statistics.vertexBytesAfter / 1024.0, "KB");
+        editor_bench::report(label.c_str(), "vertex memory quantized", quantizedBytes / 1024.0, "KB");
+        editor_bench::report(label.c_str(), "optimizeMesh", triangles / best * 1e-6, "Mtriangles/s");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            std::string path = argv[i];
+            run("mesh_optimization_bench/" + std::filesystem::path(path).filename().string(), [&path] { return PLYReader::load(path); });
+        }
+        return 0;
+    }
+    // about 500k triangles each
+    run("mesh_optimization_bench/grid 500x500", [] { return makeGrid(500); });
+    run("mesh_optimization_bench/sphere 500x500", [] { return makeSphere(500, 500); });
+    return 0;
+}
@@ -0,0 +1,174 @@
+#include "BenchCommon.hpp"
+
+#include "PLYReader.hpp"
+#include "AssetManager.hpp"
+
+#include "ext/happly.h"
+
+#include <zlib.h>
+
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+/*
+*  PLYReader::load against the happly path it replaced: happly::PLYData, the per property copy of the
+*  old parseHapply and the interleaving copy done later by getInterleavingAttributes().
+*  ply_reader_bench [mesh.ply ...] : without arguments a corpus of generated grids is used, in binary
+*  little and big endian and gzip'd, with normals and uvs.
+*/
+namespace
+{
+    MeshHostObject loadWithHapply(const std::string& fileName)
+    {
+        happly::PLYData ply(fileName);
+        MeshHostObject mesh;
+        auto& vertexElement = ply.getElement("vertex");
+        mesh.vertex_count = vertexElement.count;
+        auto x = vertexElement.getProperty<float>("x");
+        auto y = vertexElement.getProperty<float>("y");
+        auto z = vertexElement.getProperty<float>("z");
+        mesh.position.reset(new float[mesh.vertex_count * 3]);
+        for (size_t i = 0; i < mesh.vertex_count; i++) {
+            mesh.position[i * 3 + 0] = x[i];
+            mesh.position[i * 3 + 1] = y[i];
+            mesh.position[i * 3 + 2] = z[i];
+        }
+        if (vertexElement.hasProperty("nx")) {
+            auto nx = vertexElement.getProperty<float>("nx");
+            auto ny = vertexElement.getProperty<float>("ny");
+            auto nz = vertexElement.getProperty<float>("nz");
+            mesh.normal.reset(new float[mesh.vertex_count * 3]);
+            for (size_t i = 0; i < mesh.vertex_count; i++) {
+                mesh.normal[i * 3 + 0] = nx[i];
+                mesh.normal[i * 3 + 1] = ny[i];
+                mesh.normal[i * 3 + 2] = nz[i];
+            }
+        }
+        if (vertexElement.hasProperty("u")) {
+            auto u = vertexElement.getProperty<float>("u");
+            auto v = vertexElement.getProperty<float>("v");
+            mesh.uv.reset(new float[mesh.vertex_count * 2]);
+            for (size_t i = 0; i < mesh.vertex_count; i++) {
+                mesh.uv[i * 2 + 0] = u[i];
+                mesh.uv[i * 2 + 1] = v[i];
+            }
+        }
+        auto faces = ply.getFaceIndices();
+        mesh.index_count = faces.size() * 3;
+        mesh.indices.reset(new unsigned int[mesh.index_count]);
+        for (size_t i = 0; i < faces.size(); i++)
+            for (int k = 0; k < 3; k++)
+                mesh.indices[i * 3 + k] = faces[i][k];
+        mesh.getInterleavingAttributes();
+        return mesh;
+    }
+
+    void writeGrid(const std::filesystem::path& path, size_t side, happly::DataFormat format)
+    {
+        happly::PLYData ply;
+        std::vector<std::array<double, 3>> positions, normals;
+        std::vector<float> u, v;
+        std::vector<std::vector<size_t>> faces;
+        positions.reserve(side * side);
+        for (size_t j = 0; j < side; j++) {
+            for (size_t i = 0; i < side; i++) {
+                positions.push_back({ double(i), double(j), double((i * 7 + j * 3) % 5) * 0.1 });
+                normals.push_back({ 0.0, 0.0, 1.0 });
+                u.push_back(float(i) / side);
+                v.push_back(float(j) / side);
+            }
+        }
+        for (size_t j = 0; j + 1 < side; j++) {
+            for (size_t i = 0; i + 1 < side; i++) {
+                size_t a = j * side + i;
+                faces.push_back({ a, a + 1, a + side });
+                faces.push_back({ a + 1, a + side + 1, a + side });
+            }
+        }
+        ply.addVertexPositions(positions);
+        auto& vertex = ply.getElement("vertex");
+        std::vector<float> nx(normals.size()), ny(normals.size()), nz(normals.size());
+        for (size_t i = 0; i < normals.size(); i++) {
+            nx[i] = float(normals[i][0]);
+            ny[i] = float(normals[i][1]);
+            nz[i] = float(normals[i][2]);
+        }
+        vertex.addProperty<float>("nx", nx);
+        vertex.addProperty<float>("ny", ny);
+        vertex.addProperty<float>("nz", nz);
+        vertex.addProperty<float>("u", u);
+        vertex.addProperty<float>("v", v);
+        ply.addFaceIndices(faces);
+        ply.write(path.string(), format);
+    }
+
+    // happly writes positions as doubles, the editor's meshes are floats, so convert them on the way
+    void writeFloatGrid(const std::filesystem::path& path, size_t side, happly::DataFormat format)
+    {
+        auto tmp = path;
+        tmp += ".double";
+        writeGrid(tmp, side, format);
+        happly::PLYData ply(tmp.string());
+        auto& vertex = ply.getElement("vertex");
+        for (const char* axis : { "x", "y", "z" }) {
+            auto values = vertex.getProperty<double>(axis);
+            vertex.addProperty<float>(axis, std::vector<float>(values.begin(), values.end()));
+        }
+        ply.write(path.string(), format);
+        std::filesystem::remove(tmp);
+    }
+
+    void gzipFile(const std::filesystem::path& from, const std::filesystem::path& to)
+    {
+        std::ifstream in(from, std::ios::binary);
+        std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        gzFile out = gzopen(to.string().c_str(), "wb1");
+        gzwrite(out, data.data(), (unsigned)data.size());
+        gzclose(out);
+    }
+
+    void run(const std::filesystem::path& path)
+    {
+        double mb = double(std::filesystem::file_size(path)) / (1 << 20);
+        auto name = path.filename().string();
+        size_t readerIndices = 0;
+        double readerSeconds = editor_bench::bestSeconds(3, [&] {
+            auto mesh = PLYReader::load(path);
+            readerIndices = mesh.index_count;
+        });
+        editor_bench::report(name.c_str(), "PLYReader", mb / readerSeconds, "MB/s");
+        if (path.extension() == ".gz")
+            return;
+        size_t happlyIndices = 0;
+        double happlySeconds = editor_bench::bestSeconds(3, [&] {
+            auto mesh = loadWithHapply(path.string());
+            happlyIndices = mesh.index_count;
+        });
+        if (happlyIndices != readerIndices)
+            std::printf("warning: %s decoded to %zu indices by PLYReader and %zu by happly\n", name.c_str(), readerIndices, happlyIndices);
+        editor_bench::report(name.c_str(), "happly + interleave", mb / happlySeconds, "MB/s");
+        editor_bench::report(name.c_str(), "speedup", happlySeconds / readerSeconds, "x");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++)
+            run(argv[i]);
+        return 0;
+    }
+    auto dir = std::filesystem::temp_directory_path() / "pbrt_editor_ply_bench";
+    std::filesystem::create_directories(dir);
+    writeFloatGrid(dir / "grid_le.ply", 1024, happly::DataFormat::Binary);
+    writeFloatGrid(dir / "grid_be.ply", 1024, happly::DataFormat::BinaryBigEndian);
+    writeFloatGrid(dir / "grid_ascii.ply", 256, happly::DataFormat::ASCII);
+    gzipFile(dir / "grid_le.ply", dir / "grid_le.ply.gz");
+    for (const char* name : { "grid_le.ply", "grid_be.ply", "grid_ascii.ply", "grid_le.ply.gz" })
+        run(dir / name);
+    std::filesystem::remove_all(dir);
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include "BenchCommon.hpp"
+#include "ReferenceTokenizer.hpp"
+
+#include "PBRTParser.h"
+#include "MappedFile.hpp"
+
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+*  Tokenizer throughput of the old char-by-char nextToken against the block tokenizer, on a synthetic
+*  scene shaped like a pbrt-v4 export (long numeric arrays, quoted parameter names, comments) and on
+*  every scene file given on the command line.
+*/
+namespace
+{
+    const char* tokenizerPath()
+    {
+#if defined(__AVX2__)
+        return "avx2";
+#elif defined(__SSE2__) || defined(_M_X64)
+        return "sse2";
+#else
+        return "scalar";
+#endif
+    }
+
+    std::string syntheticScene(size_t targetBytes)
+    {
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<float> coord(-100.f, 100.f);
+        std::string text = "# synthetic pbrt-v4 scene\nLookAt 0 0 5  0 0 0  0 1 0\nCamera \"perspective\" \"float fov\" [ 45 ]\nWorldBegin\n";
+        char number[32];
+        int shape = 0;
+        while (text.size() < targetBytes) {
+            text += "AttributeBegin\n  # shape " + std::to_string(shape++) + "\n";
+            text += "  Material \"diffuse\" \"rgb reflectance\" [ 0.5 0.5 0.5 ]\n";
+            text += "  Translate 1 2 3\n  Shape \"trianglemesh\"\n    \"point3 P\" [";
+            for (int i = 0; i < 300; i++) {
+                snprintf(number, sizeof(number), " %.5f", coord(rng));
+                text += number;
+            }
+            text += " ]\n    \"integer indices\" [";
+            for (int i = 0; i < 300; i++) {
+                text += ' ';
+                text += std::to_string(i % 100);
+            }
+            text += " ]\nAttributeEnd\n";
+        }
+        return text;
+    }
+
+    size_t referenceTokens(const char* text, size_t size)
+    {
+        // the old tokenizer works on int offsets
+        size_t count = 0;
+        for (size_t base = 0; base < size; ) {
+            size_t chunk = std::min<size_t>(size - base, size_t(1) << 30);
+            int seek = 0;
+            while (seek < (int)chunk) {
+                int tok_loc = 0;
+                int tok_len = 0;
+                reference::nextToken(text + base, (int)chunk, &seek, &tok_loc, &tok_len);
+                count += tok_len != 0;
+            }
+            base += chunk;
+        }
+        return count;
+    }
+
+    size_t blockTokens(const char* text, size_t size)
+    {
+        std::vector<Token> batch(1024);
+        size_t count = 0;
+        size_t seek = 0;
+        while (seek < size)
+            count += PBRTParser::nextTokens(text, size, &seek, batch.data(), batch.size());
+        return count;
+    }
+
+    void run(const std::string& name, const char* text, size_t size)
+    {
+        const int runs = size > (size_t(1) << 30) ? 1 : 3;
+        double gb = double(size) / 1e9;
+        size_t oldCount = 0, newCount = 0;
+        double oldSeconds = editor_bench::bestSeconds(runs, [&] { oldCount = referenceTokens(text, size); });
+        double newSeconds = editor_bench::bestSeconds(runs, [&] { newCount = blockTokens(text, size); });
+        editor_bench::report(name.c_str(), "nextToken (char by char)", gb / oldSeconds, "GB/s");
+        editor_bench::report(name.c_str(), (std::string("nextTokens (") + tokenizerPath() + ")").c_str(), gb / newSeconds, "GB/s");
+        editor_bench::report(name.c_str(), "speedup", oldSeconds / newSeconds, "x");
+        if (newCount != oldCount && newCount != oldCount + 1)
+            std::printf("warning: token counts differ, %zu vs %zu\n", newCount, oldCount);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    auto synthetic = syntheticScene(size_t(64) << 20);
+    run("synthetic (" + std::to_string(synthetic.size() >> 20) + " MB)", synthetic.data(), synthetic.size());
+    for (int i = 1; i < argc; i++) {
+        MappedFile f(argv[i]);
+        run(argv[i], f.raw(), f.size());
+    }
+    return 0;
+}
@@ -0,0 +1,206 @@
+#include "BenchCommon.hpp"
+
+#include "HeadlessDevice.hpp"
+
+#include "GPUFrame.hpp"
+#include "ShaderManager.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+*  GPUFrame::recordSecondaryCommands on one thread and on N: 100k draws split the way GPURasterizedPass::recordChunked
+*  splits its action contexts, one secondary per recording worker. Each draw pushes its transform like the G-buffer
+*  draws do, the pipeline is rebound every 64 draws. Only the recording is timed, the last frame is submitted once
+*  so the validation layer sees it executed.
+*  recording_bench [draws] : runs on whatever Vulkan driver is installed, lavapipe without a GPU.
+*/
+namespace
+{
+    constexpr uint32_t targetSize = 16;
+    constexpr size_t drawsPerPipeline = 64;
+
+    struct DrawTarget
+    {
+        explicit DrawTarget(DeviceExtended* device) : device(device)
+        {
+            vk::AttachmentDescription color{};
+            color.setFormat(vk::Format::eR8G8B8A8Unorm);
+            color.setSamples(vk::SampleCountFlagBits::e1);
+            color.setLoadOp(vk::AttachmentLoadOp::eClear);
+            color.setStoreOp(vk::AttachmentStoreOp::eStore);
+            color.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare);
+            color.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare);
+            color.setInitialLayout(vk::ImageLayout::eUndefined);
+            color.setFinalLayout(vk::ImageLayout::eColorAttachmentOptimal);
+            vk::AttachmentReference colorRef{ 0, vk::ImageLayout::eColorAttachmentOptimal };
+            vk::SubpassDescription subpass{};
+            subpass.setPipelineBindPoint(vk::PipelineBindPoint::eGraphics);
+            subpass.setColorAttachments(colorRef);
+            vk::RenderPassCreateInfo renderPassInfo{};
+            renderPassInfo.setAttachments(color);
+            renderPassInfo.setSubpasses(subpass);
+            renderPass = device->createRenderPass(renderPassInfo);
+
+            auto allocated = device->allocateVMAImageForColorAttachment(VK_FORMAT_R8G8B8A8_UNORM, targetSize, targetSize);
+            if (!allocated)
+                throw std::runtime_error("Failed to allocate the recording bench target");
+            image = allocated.value();
+            vk::ImageViewCreateInfo viewInfo{};
+            viewInfo.setImage(image.image);
+            viewInfo.setViewType(vk::ImageViewType::e2D);
+            viewInfo.setFormat(vk::Format::eR8G8B8A8Unorm);
+            viewInfo.setSubresourceRange({ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 });
+            view = device->createImageView(viewInfo);
+
+            vk::FramebufferCreateInfo framebufferInfo{};
+            framebufferInfo.setRenderPass(renderPass);
+            framebufferInfo.setAttachments(view);
+            framebufferInfo.setWidth(targetSize);
+            framebufferInfo.setHeight(targetSize);
+            framebufferInfo.setLayers(1);
+            framebuffer = device->createFramebuffer(framebufferInfo);
+
+            vk::PushConstantRange pushConstant{ vk::ShaderStageFlagBits::eVertex, 0, sizeof(glm::mat4) };
+            vk::PipelineLayoutCreateInfo layoutInfo{};
+            layoutInfo.setPushConstantRanges(pushConstant);
+            pipelineLayout = device->createPipelineLayout(layoutInfo);
+
+            auto* vs = ShaderManager::getInstance().createVertexShader(device, "fullScreenQuad.vert");
+            auto* fs = ShaderManager::getInstance().createFragmentShader(device, "constantColor.frag");
+            VulkanGraphicsPipelineBuilder builder(device->device, vs, fs, vk::PipelineVertexInputStateCreateInfo{}, renderPass, pipelineLayout);
+            pipeline = builder.build().getPipeline();
+        }
+
+        ~DrawTarget()
+        {
+            device->destroyPipeline(pipeline);
+            device->destroyPipelineLayout(pipelineLayout);
+            device->destroyFramebuffer(framebuffer);
+            device->destroyImageView(view);
+            device->deAllocateImage(image.image, image.allocation);
+            device->destroyRenderPass(renderPass);
+        }
+
+        DrawTarget(const DrawTarget&) = delete;
+        DrawTarget& operator=(const DrawTarget&) = delete;
+
+        DeviceExtended* device;
+        vk::RenderPass renderPass;
+        VMAImage image{};
+        vk::ImageView view;
+        vk::Framebuffer framebuffer;
+        vk::PipelineLayout pipelineLayout;
+        vk::Pipeline pipeline;
+    };
+
+    // GPUFrame leaves its objects to the device teardown of the editor, the bench makes several
+    void releaseFrame(DeviceExtended* device, GPUFrame& frame)
+    {
+        for (auto& allocator : frame.perThreadMainCommandAllocators)
+            device->destroyCommandPool(allocator._pool._cmdPool);
+        device->destroyFence(frame.executingFence);
+        device->destroySemaphore(frame.imageAvailableSemaphore);
+        device->destroySemaphore(frame.renderFinishSemaphore);
+        device->deAllocateBuffer(frame._frameGlobalDataBuffer.buffer, frame._frameGlobalDataBuffer.allocation);
+    }
+
+    vk::CommandBuffer recordFrame(GPUFrame& frame, const DrawTarget& target, size_t drawCount)
+    {
+        for (auto& allocator : frame.perThreadMainCommandAllocators)
+            allocator.reset();
+
+        auto cmd = frame.perThreadMainCommandAllocators[0].getOrAllocateNextPrimary();
+        cmd.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+
+        // as GPURasterizedPass::recordChunked, a secondary per recording worker
+        size_t chunkCount = std::max(frame.workThreadsNum - 1, 1);
+        vk::CommandBufferInheritanceInfo inheritance{};
+        inheritance.setRenderPass(target.renderPass);
+        inheritance.setSubpass(0);
+        inheritance.setFramebuffer(target.framebuffer);
+        auto secondaries = frame.recordSecondaryCommands(chunkCount, inheritance, [&](vk::CommandBuffer secondary, size_t chunk) {
+            secondary.setViewport(0, vk::Viewport{ 0.0f, 0.0f, float(targetSize), float(targetSize), 0.0f, 1.0f });
+            secondary.setScissor(0, vk::Rect2D{ { 0, 0 }, { targetSize, targetSize } });
+            size_t first = drawCount * chunk / chunkCount;
+            size_t last = drawCount * (chunk + 1) / chunkCount;
+            for (size_t draw = first; draw < last; draw++)
+            {
+                if (draw == first || draw % drawsPerPipeline == 0)
+                    secondary.bindPipeline(vk::PipelineBindPoint::eGraphics, target.pipeline);
+                glm::mat4 transform(1.0f);
+                transform[3] = glm::vec4(float(draw % 7) * 1e-3f, float(draw % 11) * 1e-3f, 0.0f, 1.0f);
+                secondary.pushConstants(target.pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(transform), &transform);
+                secondary.draw(3, 1, 0, 0);
+            }
+        });
+
+        vk::ClearValue clear{ vk::ClearColorValue{ std::array<float, 4>{ 0.0f, 0.0f, 0.0f, 1.0f } } };
+        vk::RenderPassBeginInfo beginInfo{};
+        beginInfo.setRenderPass(target.renderPass);
+        beginInfo.setFramebuffer(target.framebuffer);
+        beginInfo.setRenderArea(vk::Rect2D{ { 0, 0 }, { targetSize, targetSize } });
+        beginInfo.setClearValues(clear);
+        cmd.beginRenderPass(beginInfo, vk::SubpassContents::eSecondaryCommandBuffers);
+        cmd.executeCommands(secondaries);
+        cmd.endRenderPass();
+        cmd.end();
+        return cmd;
+    }
+
+    double run(editor_test::HeadlessDevice& device, const DrawTarget& target, int threads, size_t drawCount)
+    {
+        auto& coordinator = FrameCoordinator::getInstance();
+        coordinator.recordingWorkers.reset();
+        if (threads > 1)
+            coordinator.recordingWorkers = std::make_unique<ThreadPool>(threads - 1);
+
+        GPUFrame frame(threads, device.device.get(), &coordinator);
+        vk::CommandBuffer cmd;
+        double seconds = editor_bench::bestSeconds(5, [&] { cmd = recordFrame(frame, target, drawCount); });
+
+        vk::SubmitInfo submitInfo{};
+        submitInfo.setCommandBuffers(cmd);
+        vk::Queue(device->get_queue(vkb::QueueType::graphics).value()).submit(submitInfo);
+        device->waitIdle();
+
+        coordinator.recordingWorkers.reset();
+        releaseFrame(device.device.get(), frame);
+        return seconds;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t drawCount = argc > 1 ? std::stoul(argv[1]) : 100000;
+    try
+    {
+        editor_test::HeadlessDevice device;
+        DrawTarget target(device.device.get());
+
+        char label[64];
+        std::snprintf(label, sizeof(label), "recording_bench/%zu draws", drawCount);
+        double single = run(device, target, 1, drawCount);
+        editor_bench::report(label, "1 thread", single * 1e3, "ms");
+        for (int threads : { 2, 4, 8 })
+        {
+            double seconds = run(device, target, threads, drawCount);
+            char what[32];
+            std::snprintf(what, sizeof(what), "%d threads", threads);
+            editor_bench::report(label, what, seconds * 1e3, "ms");
+            std::snprintf(what, sizeof(what), "%d threads speedup", threads);
+            editor_bench::report(label, what, single / seconds, "x");
+        }
+    }
+    catch (const editor_test::Skip& skip)
+    {
+        std::printf("recording_bench skipped: %s\n", skip.reason.c_str());
+    }
+    return editor_test::failures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,94 @@
+#include "BenchCommon.hpp"
+
+#include "PBRTParser.h"
+#include "SceneBuilder.hpp"
+#include "SceneCache.hpp"
+#include "sceneGraphEditor.hpp"
+#include "AssetManager.hpp"
+#include "scene.h"
+
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+
+/*
+*  Cold parse (PBRTParser + PBRTSceneBuilder) against SceneCache::load of the same scene.
+*  scene_cache_bench [scene.pbrt] : without an argument a synthetic scene of analytic shapes, triangle
+*  meshes and materials is generated, so no mesh or image is loaded from disk.
+*/
+namespace
+{
+    std::filesystem::path writeSyntheticScene(const std::filesystem::path& dir, int blocks)
+    {
+        std::mt19937 rng(3);
+        std::uniform_real_distribution<float> unit(0.f, 1.f);
+        std::string text = "LookAt 0 0 5  0 0 0  0 1 0\nCamera \"perspective\" \"float fov\" [ 45 ]\nWorldBegin\n";
+        for (int i = 0; i < blocks; i++) {
+            text += "AttributeBegin\n  Translate " + std::to_string(unit(rng)) + " " + std::to_string(unit(rng)) + " 0\n";
+            text += "  Material \"diffuse\" \"rgb reflectance\" [ " + std::to_string(unit(rng)) + " 0.5 0.5 ]\n";
+            if (i % 4 == 0) {
+                text += "  Shape \"trianglemesh\" \"point3 P\" [";
+                for (int v = 0; v < 64 * 3; v++)
+                    text += " " + std::to_string(unit(rng));
+                text += " ] \"integer indices\" [";
+                for (int t = 0; t < 62; t++)
+                    text += " 0 " + std::to_string(t + 1) + " " + std::to_string(t + 2);
+                text += " ]\n";
+            } else {
+                text += "  Shape \"sphere\" \"float radius\" [ 0.5 ]\n";
+            }
+            text += "AttributeEnd\n";
+        }
+        auto path = dir / "synthetic.pbrt";
+        std::ofstream(path, std::ios::binary) << text;
+        return path;
+    }
+
+    void run(const std::filesystem::path& path)
+    {
+        AssetManager assets;
+        assets.setWorkDir(path.parent_path());
+        auto cachePath = SceneCache::cachePathFor(path);
+        std::error_code ec;
+        std::filesystem::remove(cachePath, ec);
+
+        std::unique_ptr<SceneGraph> parsed;
+        double parseSeconds = editor_bench::bestSeconds(3, [&] {
+            PBRTParser parser;
+            PBRTSceneBuilder builder;
+            parser.parse(builder, path, assets);
+            builder.finish();
+            parsed.reset(builder.sceneGraph);
+            if (!std::filesystem::exists(cachePath))
+                SceneCache::save(cachePath, parser.parsedFiles, *parsed, builder);
+        });
+
+        std::unique_ptr<SceneGraph> cached;
+        double loadSeconds = editor_bench::bestSeconds(3, [&] {
+            cached.reset(SceneCache::load(cachePath, assets));
+        });
+        if (cached == nullptr) {
+            std::printf("%s : cache was not written or rejected\n", path.string().c_str());
+            return;
+        }
+        auto name = path.filename().string();
+        editor_bench::report(name.c_str(), "cold parse", parseSeconds * 1e3, "ms");
+        editor_bench::report(name.c_str(), "cache load", loadSeconds * 1e3, "ms");
+        editor_bench::report(name.c_str(), "speedup", parseSeconds / loadSeconds, "x");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++)
+            run(argv[i]);
+        return 0;
+    }
+    auto dir = std::filesystem::temp_directory_path() / "pbrt_editor_scene_cache_bench";
+    std::filesystem::create_directories(dir);
+    run(writeSyntheticScene(dir, 40000));
+    std::filesystem::remove_all(dir);
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include "BenchCommon.hpp"
+
+#include "Symbol.hpp"
+
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+*  Looking up named materials in scenes of 1k to 1M names: the linear scan over a vector of names the scene
+*  graph used before, an unordered_map keyed by the string, and SymbolMap keyed by the interned symbol, with and
+*  without the intern of the looked up name (the parser interns once, the lookups afterwards reuse the symbol).
+*/
+namespace
+{
+    struct NamedMaterial
+    {
+        std::string name;
+        int id;
+    };
+
+    const NamedMaterial* linearFind(const std::vector<NamedMaterial>& materials, const std::string& name)
+    {
+        for (auto& material : materials)
+        {
+            if (material.name == name)
+                return &material;
+        }
+        return nullptr;
+    }
+}
+
+int main()
+{
+    constexpr size_t LOOKUPS = 100000;
+    // the linear scan is quadratic in the scene size, it gets fewer lookups and stops at 100k names
+    constexpr size_t LINEAR_LOOKUPS = 1000;
+    constexpr size_t LINEAR_MAX_NAMES = 100000;
+
+    for (size_t count : { size_t(1000), size_t(10000), size_t(100000), size_t(1000000) })
+    {
+        std::string label = "symbol_bench/" + std::to_string(count) + " names";
+
+        std::vector<NamedMaterial> materials;
+        std::unordered_map<std::string, int> byString;
+        SymbolMap<int> bySymbol;
+        for (size_t i = 0; i < count; i++)
+        {
+            std::string name = "Material_" + std::to_string(count) + "_" + std::to_string(i);
+            materials.push_back({ name, int(i) });
+            byString.emplace(name, int(i));
+            bySymbol.emplace(intern(name), int(i));
+        }
+
+        std::mt19937 rng(1);
+        std::vector<std::string> queries;
+        std::vector<Symbol> querySymbols;
+        for (size_t i = 0; i < LOOKUPS; i++)
+        {
+            queries.push_back(materials[rng() % count].name);
+            querySymbols.push_back(SymbolTable::getInstance().find(queries.back()));
+        }
+
+        if (count <= LINEAR_MAX_NAMES)
+        {
+            double linear = editor_bench::bestSeconds(3, [&] {
+                long sum = 0;
+                for (size_t i = 0; i < LINEAR_LOOKUPS; i++)
+                    sum += linearFind(materials, queries[i])->id;
+                editor_bench::consume(sum);
+            });
+            editor_bench::report(label.c_str(), "linear scan", linear / LINEAR_LOOKUPS * 1e9, "ns/lookup");
+        }
+
+        double hashed = editor_bench::bestSeconds(3, [&] {
+            long sum = 0;
+            for (auto& query : queries)
+                sum += byString.find(query)->second;
+            editor_bench::consume(sum);
+        });
+        editor_bench::report(label.c_str(), "unordered_map<string>", hashed / LOOKUPS * 1e9, "ns/lookup");
+
+        double symbolWithFind = editor_bench::bestSeconds(3, [&] {
+            long sum = 0;
+            for (auto& query : queries)
+                sum += *bySymbol.find(SymbolTable::getInstance().find(query));
+            editor_bench::consume(sum);
+        });
+        editor_bench::report(label.c_str(), "SymbolMap + table find", symbolWithFind / LOOKUPS * 1e9, "ns/lookup");
+
+        double symbol = editor_bench::bestSeconds(3, [&] {
+            long sum = 0;
+            for (auto query : querySymbols)
+                sum += *bySymbol.find(query);
+            editor_bench::consume(sum);
+        });
+        editor_bench::report(label.c_str(), "SymbolMap", symbol / LOOKUPS * 1e9, "ns/lookup");
+    }
+    return 0;
+}
@@ -0,0 +1,119 @@
+#include "BenchCommon.hpp"
+
+#include "sceneGraphEditor.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <string>
+#include <vector>
+
+/*
+*  Dragging a node of a 1M node scene graph, one frame being an edit of its self transform followed by
+*  SceneGraph::updateTransforms(). Measured for a node near the leaves, a node one level below the root and
+*  the root itself, against a recursive walk of the same subtree through the child ranges, which is how the
+*  final transforms were propagated before TransformHierarchy.
+*/
+namespace
+{
+    constexpr int BRANCHING = 8;
+
+    // level by level like the builder, so every node's children are one range of the pool
+    std::vector<std::vector<SceneGraphNodeHandle>> buildGraph(SceneGraph& graph, size_t count)
+    {
+        graph.root = graph.createNode();
+        std::vector<std::vector<SceneGraphNodeHandle>> levels{ { graph.root } };
+        std::vector<SceneGraphNodeHandle> children;
+        size_t created = 1;
+        while (created < count)
+        {
+            std::vector<SceneGraphNodeHandle> next;
+            for (auto parent : levels.back())
+            {
+                children.clear();
+                for (int c = 0; c < BRANCHING && created < count; c++, created++)
+                {
+                    auto child = graph.createNode();
+                    graph.node(child)->parent = parent;
+                    graph.node(child)->selfTransform() = glm::translate(glm::mat4(1.0f), glm::vec3(float(c), 0, 0));
+                    children.push_back(child);
+                }
+                graph.node(parent)->childRange = appendToPool(graph.childPool, children);
+                next.insert(next.end(), children.begin(), children.end());
+            }
+            levels.push_back(std::move(next));
+        }
+        return levels;
+    }
+
+    void recursiveUpdate(SceneGraph& graph, SceneGraphNode* node, const glm::mat4& parentFinal, std::vector<SceneGraphNodeHandle>& changed)
+    {
+        node->finalTransform() = node->selfTransform() * parentFinal;
+        changed.push_back(node->handle);
+        for (auto child : node->children())
+            recursiveUpdate(graph, graph.node(child), node->finalTransform(), changed);
+    }
+}
+
+int main()
+{
+    constexpr size_t NODES = 1000000;
+    constexpr int FRAMES = 20;
+
+    SceneGraph graph;
+    auto levels = buildGraph(graph, NODES);
+    double rebuild = editor_bench::bestSeconds(3, [&] { graph.buildTransformHierarchy(); });
+    editor_bench::report("transform_bench/1M nodes", "rebuild", rebuild * 1e3, "ms");
+    // a first sweep of the whole graph so the finals are consistent
+    graph.node(graph.root)->updateFinalTransform();
+    graph.updateTransforms();
+
+    size_t changedCount = 0;
+    graph.nodeFinalTransformChangeSignal.connect([&](const std::vector<SceneGraphNodeHandle>& changed) {
+        changedCount += changed.size();
+    });
+
+    struct Target
+    {
+        const char* name;
+        SceneGraphNodeHandle handle;
+    };
+    Target targets[] = {
+        { "drag near leaves", levels[levels.size() - 2].front() },
+        { "drag level 1", levels[1].front() },
+        { "drag root", graph.root },
+    };
+
+    std::vector<SceneGraphNodeHandle> recursiveChanged;
+    for (auto& target : targets)
+    {
+        std::string name = std::string("transform_bench/1M nodes/") + target.name;
+        auto* node = graph.node(target.handle);
+
+        changedCount = 0;
+        double hierarchy = editor_bench::bestSeconds(3, [&] {
+            for (int frame = 0; frame < FRAMES; frame++)
+            {
+                node->selfTransform() = glm::translate(node->selfTransform(), glm::vec3(0.01f, 0, 0));
+                node->updateSelfTransform();
+                graph.updateTransforms();
+            }
+        });
+        size_t subtree = changedCount / (3 * FRAMES);
+
+        double recursive = editor_bench::bestSeconds(3, [&] {
+            for (int frame = 0; frame < FRAMES; frame++)
+            {
+                node->selfTransform() = glm::translate(node->selfTransform(), glm::vec3(0.01f, 0, 0));
+                auto* parent = node->parentNode();
+                recursiveChanged.clear();
+                recursiveUpdate(graph, node, parent != nullptr ? parent->finalTransform() : glm::mat4(1.0f), recursiveChanged);
+                editor_bench::consume(recursiveChanged.size());
+            }
+        });
+
+        editor_bench::report(name.c_str(), "subtree nodes", double(subtree), "");
+        editor_bench::report(name.c_str(), "hierarchy update/frame", hierarchy / FRAMES * 1e3, "ms");
+        editor_bench::report(name.c_str(), "recursive walk/frame", recursive / FRAMES * 1e3, "ms");
+    }
+    return 0;
+}
@@ -0,0 +1,38 @@
+#ifndef BUILT_IN_BINDLESS_GLSL
+#define BUILT_IN_BINDLESS_GLSL
+
+// The set of BindlessHeap. The including shader enables GL_EXT_nonuniform_qualifier for the unsized texture array.
+
+#define INVALID_BINDLESS_INDEX 0xffffffffu
+
+// BindlessMaterialType
+#define MATERIAL_TYPE_UNKNOWN 0u
+#define MATERIAL_TYPE_COATED_DIFFUSE 1u
+#define MATERIAL_TYPE_COATED_CONDUCTOR 2u
+#define MATERIAL_TYPE_CONDUCTOR 3u
+#define MATERIAL_TYPE_DIELECTRIC 4u
+#define MATERIAL_TYPE_DIFFUSE 5u
+#define MATERIAL_TYPE_DIFFUSE_TRANSMISSION 6u
+#define MATERIAL_TYPE_MIX 7u
+
+// BindlessMaterialRecord
+struct MaterialRecord
+{
+    vec4 reflectance;
+    uint type;
+    uint reflectanceTexture;
+    float roughness;
+    float eta;
+};
+
+#define USE_BINDLESS_HEAP(setIdx) \
+    layout(set = setIdx, binding = 0) uniform sampler2D bindlessTextures[]; \
+    layout(std430, set = setIdx, binding = 1) readonly buffer BindlessMaterials { MaterialRecord records[]; } bindlessMaterials
+
+// A draw uses one material, the indices are dynamically uniform and need no nonuniformEXT
+#define BINDLESS_MATERIAL(materialIdx) bindlessMaterials.records[materialIdx]
+
+#define BINDLESS_REFLECTANCE(material, uv) \
+    ((material).reflectanceTexture != INVALID_BINDLESS_INDEX ? texture(bindlessTextures[(material).reflectanceTexture], uv) : (material).reflectance)
+
+#endif
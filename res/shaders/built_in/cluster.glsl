@@ -0,0 +1,61 @@
+#ifndef BUILT_IN_CLUSTER_GLSL
+#define BUILT_IN_CLUSTER_GLSL
+
+// Meshlet in Meshlet.hpp
+struct Meshlet
+{
+    vec4 sphere;
+    vec4 coneApex;
+    vec4 coneAxisCutoff;
+    uint firstIndex;
+    uint vertexOffset;
+    uint vertexCount;
+    uint triangleCount;
+};
+
+// frustumPlanes() in ClusterCulling.hpp, the columns of the transpose are the rows of viewProj
+void frustumPlanes(mat4 viewProj, out vec4 planes[6])
+{
+    mat4 rows = transpose(viewProj);
+    planes[0] = rows[3] + rows[0];
+    planes[1] = rows[3] - rows[0];
+    planes[2] = rows[3] + rows[1];
+    planes[3] = rows[3] - rows[1];
+    planes[4] = rows[2];
+    planes[5] = rows[3] - rows[2];
+    for (int i = 0; i < 6; i++)
+    {
+        planes[i] /= length(planes[i].xyz);
+    }
+}
+
+// isClusterVisible() in ClusterCulling.hpp
+bool isClusterVisible(vec4 planes[6], mat4 model, vec3 eye, Meshlet meshlet, bool coneCulling)
+{
+    vec3 scale = vec3(length(model[0].xyz), length(model[1].xyz), length(model[2].xyz));
+    float maxScale = max(scale.x, max(scale.y, scale.z));
+    float minScale = min(scale.x, min(scale.y, scale.z));
+    vec3 center = (model * vec4(meshlet.sphere.xyz, 1.0)).xyz;
+    float radius = meshlet.sphere.w * maxScale;
+    for (int i = 0; i < 6; i++)
+    {
+        if (dot(planes[i].xyz, center) + planes[i].w < -radius)
+        {
+            return false;
+        }
+    }
+
+    if (coneCulling && meshlet.coneAxisCutoff.w < 1.0 && maxScale - minScale <= 1e-3 * maxScale)
+    {
+        vec3 apex = (model * vec4(meshlet.coneApex.xyz, 1.0)).xyz;
+        float handedness = determinant(mat3(model)) < 0.0 ? -1.0 : 1.0;
+        vec3 axis = handedness * normalize(mat3(model) * meshlet.coneAxisCutoff.xyz);
+        if (dot(normalize(apex - eye), axis) >= meshlet.coneAxisCutoff.w)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif
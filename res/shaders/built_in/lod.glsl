@@ -0,0 +1,12 @@
+#ifndef BUILT_IN_LOD_GLSL
+#define BUILT_IN_LOD_GLSL
+
+// Debug colour of a level of detail, level 0 is green and the coarser levels go towards red
+vec3 lodColor(uint lod)
+{
+    const vec3 colors[8] = vec3[8](vec3(0.1, 0.8, 0.1), vec3(0.5, 0.9, 0.1), vec3(0.9, 0.9, 0.1), vec3(1.0, 0.7, 0.1),
+                                   vec3(1.0, 0.5, 0.1), vec3(1.0, 0.3, 0.1), vec3(0.9, 0.1, 0.1), vec3(0.7, 0.1, 0.5));
+    return colors[min(lod, 7u)];
+}
+
+#endif
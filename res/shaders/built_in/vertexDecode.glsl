@@ -0,0 +1,25 @@
+#ifndef BUILT_IN_VERTEX_DECODE_GLSL
+#define BUILT_IN_VERTEX_DECODE_GLSL
+
+// Decoding of MeshHostObject::quantizeInterleavingAttributes(), float meshes have an identity dequantization
+
+// offset and scale of the positions, binding 2 of the per instance set
+#define MESH_DEQUANTIZATION_BLOCK_LAYOUT MeshDequantization { vec4 positionOffset; vec4 positionScale; }
+
+vec3 dequantizePosition(vec3 stored, vec4 positionOffset, vec4 positionScale)
+{
+    return positionOffset.xyz + stored * positionScale.xyz;
+}
+
+// reverses octEncode() in AssetManager.cpp
+vec3 octDecode(vec2 encoded)
+{
+    vec3 v = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if (v.z < 0.0)
+    {
+        v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(v);
+}
+
+#endif
@@ -0,0 +1,41 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+
+// Drawn by the GBuffer pass while the pipeline of a mesh is still compiling, paired with positionOnly.vert
+
+#include "built_in/lod.glsl"
+
+layout(location = 0) out vec4 outFlat;
+layout(location = 1) out vec4 outMeshID;
+layout(location = 2) out vec4 outFragPosition;
+layout(location = 3) out vec4 outFragNormal;
+layout(location = 4) out vec4 outFragUV;
+layout(location = 5) out vec4 outFragAlbedo;
+layout(location = 6) out vec4 outEncodedMeshID;
+layout(location = 7) out vec4 outEncodedInstanceID;
+
+layout( push_constant ) uniform constants
+{
+    uvec4 ID;
+} pushConstant;
+
+vec3 encodeUint(uint val)
+{
+    uint x = (val & 0x00FF0000u) >> 16u;
+    uint y = (val & 0x0000FF00u) >> 8u;
+    uint z = (val & 0x000000FFu);
+    return vec3(float(x) / 255.0, float(y) / 255.0, float(z) / 255.0);
+}
+
+void main() {
+    // GBufferPass::getMeshIdx(), ID.z is the level of detail and ID.w turns its colour on
+    outFlat = vec4(pushConstant.ID.w != 0u ? lodColor(pushConstant.ID.z) : vec3(0.5),1.0);
+    outMeshID = vec4(vec3(0.5),1.0);
+    outFragPosition = vec4(0.0,0.0,0.0,1.0);
+    outFragNormal = vec4(0.0,0.0,0.0,1.0);
+    outFragUV = vec4(0.0,0.0,1.0,1.0);
+    outFragAlbedo = vec4(vec3(0.5),1.0);
+    // the instance isn't known without the instance index attribute, picking selects the first one
+    outEncodedMeshID = vec4(encodeUint(pushConstant.ID.x),1.0);
+    outEncodedInstanceID = vec4(encodeUint(0u),1.0);
+}
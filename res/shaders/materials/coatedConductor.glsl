@@ -1,7 +1,8 @@
-#version 450
-#extension GL_GOOGLE_include_directive : enable
+#ifndef MATERIALS_COATED_CONDUCTOR_GLSL
+#define MATERIALS_COATED_CONDUCTOR_GLSL
 
 #include "shadingCommon.glsl"
+#include "../built_in/bindless.glsl"
 
 struct CoatedConductorData
 {
@@ -16,4 +17,15 @@ struct CoatedConductorData
 vec4 evaluateCoatedConductor(in CoatedConductorData data)
 {
     return data.albedo;
-}
\ No newline at end of file
+}
+
+// The record of the material in the bindless heap, the including shader declares it with USE_BINDLESS_HEAP
+CoatedConductorData getCoatedConductorData(uint materialIdx, vec2 uv)
+{
+    MaterialRecord material = BINDLESS_MATERIAL(materialIdx);
+    CoatedConductorData data;
+    data.albedo = BINDLESS_REFLECTANCE(material, uv);
+    return data;
+}
+
+#endif
@@ -1,7 +1,8 @@
-#version 450
-#extension GL_GOOGLE_include_directive : enable
+#ifndef MATERIALS_COATED_DIFFUSE_GLSL
+#define MATERIALS_COATED_DIFFUSE_GLSL
 
 #include "shadingCommon.glsl"
+#include "../built_in/bindless.glsl"
 
 struct CoatedDiffuseData
 {
@@ -23,37 +24,14 @@ vec4 evaluateCoatedDiffuse(in CoatedDiffuseData data)
     return data.albedo;
 }
 
-layout(set = 1, binding = 0) uniform CoatedDiffuseDataUniformBuffer{
-    float roughness;
-    float uroughness;
-    float vroughness;
-    bool remaproughness;
-    vec4 albedo;
-    bool useAledoMap;
-    float g;
-    bool useGMap;
-    int maxdepth;
-    int nsamples;
-    float thickenss;
-}coatedDiffuseData;
-
-layout(set = 1, binding = 0) uniform coatedDiffuseNormalMap;
-layout(set = 1, binding = 1) uniform coatedDiffuseAlbedoMap;
-layout(set = 1, binding = 2) uniform coatedDiffuseGMap;
-layout(set = 1, binding = 3) uniform sampler2D roughness;
-layout(set = 1, binding = 4) uniform sampler2D uroughness;
-layout(set = 1, binding = 5) uniform sampler2D vroughness;
-
-CoatedDiffuseData getCoatedDiffuseData(vec2 uv)
+// The record of the material in the bindless heap, the including shader declares it with USE_BINDLESS_HEAP
+CoatedDiffuseData getCoatedDiffuseData(uint materialIdx, vec2 uv)
 {
+    MaterialRecord material = BINDLESS_MATERIAL(materialIdx);
     CoatedDiffuseData data;
+    data.roughness = material.roughness;
+    data.albedo = BINDLESS_REFLECTANCE(material, uv);
     return data;
 }
 
-
-
-
-
-
-
-
+#endif
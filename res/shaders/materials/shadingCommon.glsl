@@ -1,4 +1,5 @@
-#version 450
+#ifndef MATERIALS_SHADING_COMMON_GLSL
+#define MATERIALS_SHADING_COMMON_GLSL
 
 struct ShadingGeoData
 {
@@ -6,3 +7,5 @@ struct ShadingGeoData
     vec3 wNormal;
     float dispacement;
 };
+
+#endif
@@ -8,6 +8,7 @@ layout(location = 1) in uint inInstDataIdx;
 
 #include "built_in/frameGlobalData.glsl"
 #include "built_in/camera.glsl"
+#include "built_in/vertexDecode.glsl"
 
 USE_FRAME_GLOBAL_DATA;
 
@@ -19,9 +20,11 @@ layout(std140,set = 2, binding = 0) readonly buffer PerInstanceData
     mat4 transform[];
 } instData;
 
+layout(std430, set = 2, binding = 2) readonly buffer MESH_DEQUANTIZATION_BLOCK_LAYOUT meshDequantization;
+
 void main() {
     mat4 model = instData.transform[inInstDataIdx];
-    vec3 position = vec3(inVertexPosition.x,inVertexPosition.y,inVertexPosition.z);
+    vec3 position = dequantizePosition(inVertexPosition, meshDequantization.positionOffset, meshDequantization.positionScale);
     vec4 worldPosition = model * vec4(position, 1.0);
     gl_Position = camera.proj * camera.view * worldPosition;
 }
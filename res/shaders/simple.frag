@@ -1,4 +1,9 @@
 #version 450
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_nonuniform_qualifier : require
+
+#include "built_in/lod.glsl"
+#include "built_in/bindless.glsl"
 
 layout(location = 0) in vec3 inFragPosition;
 
@@ -26,7 +31,8 @@ layout(location = 5) out vec4 outFragAlbedo;
 layout(location = 6) out vec4 outEncodedMeshID;
 layout(location = 7) out vec4 outEncodedInstanceID;
 
-layout(set = 2, binding = 1) uniform sampler2D reflectanceMap;
+// bound once per pass, the material comes with the push constants
+USE_BINDLESS_HEAP(3);
 
 #if HAS_NORMALMAP
 
@@ -35,6 +41,8 @@ layout(set = 2, binding = 1) uniform sampler2D reflectanceMap;
 layout( push_constant ) uniform constants
 {
     uvec4 ID;
+    // x is the record of the material of the batch in the bindless heap
+    uvec4 material;
 } pushConstant;
 
 //layout(set = 3, binding = 0, std430) coherent buffer AtomicBuffer {
@@ -83,7 +91,8 @@ void main() {
     //outFragColor = vec4(inFragNormal,1.0);
 //    atomicExchange(atomicBuffer.meshID,pushConstant.ID.x);
 //    atomicExchange(atomicBuffer.instanceID,instanceID);
-    outFlat = vec4(vec3(0.5),1.0);
+    // GBufferPass::getMeshIdx(), ID.z is the level of detail and ID.w turns its colour on
+    outFlat = vec4(pushConstant.ID.w != 0u ? lodColor(pushConstant.ID.z) : vec3(0.5),1.0);
     outMeshID = vec4(uintToColor(pushConstant.ID.x,pushConstant.ID.y),1.0);
     outEncodedMeshID = vec4(encodeUint(pushConstant.ID.x),1.0);
     outEncodedInstanceID = vec4(encodeUint(instanceID),1.0);
@@ -91,12 +100,13 @@ void main() {
     #if HAS_VERTEX_NORMAL
     outFragNormal = vec4(inFragNormal,1.0);
     #endif
+    MaterialRecord material = BINDLESS_MATERIAL(pushConstant.material.x);
     #if HAS_VERTEX_UV
     outFragUV = vec4(inFragUV,0.0,1.0);
-    vec4 reflectance = texture(reflectanceMap,inFragUV);
+    vec4 reflectance = BINDLESS_REFLECTANCE(material,inFragUV);
     #else
     outFragUV = vec4(0.0,0.0,1.0,1.0);
-    vec4 reflectance = texture(reflectanceMap,vec2(0.0));
+    vec4 reflectance = BINDLESS_REFLECTANCE(material,vec2(0.0));
     #endif
     outFragAlbedo = vec4(reflectance.rgb,1.0);
 }
\ No newline at end of file
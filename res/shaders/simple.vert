@@ -3,13 +3,20 @@
 
 layout(location = 0) in vec3 inVertexPosition;
 
+// quantized normals and tangents are octahedral
+#if QUANTIZED_VERTEX_ATTRIBUTES
+#define VERTEX_DIRECTION vec2
+#else
+#define VERTEX_DIRECTION vec3
+#endif
+
 #if HAS_VERTEX_NORMAL
-layout(location = 1) in vec3 inVertexNormal;
+layout(location = 1) in VERTEX_DIRECTION inVertexNormal;
 #endif
 
 #if HAS_VERTEX_TANGENT_AND_BITANGENT
-layout(location = 2) in vec3 inVertexTangent;
-layout(location = 3) in vec3 inVertexBiTangent;
+layout(location = 2) in VERTEX_DIRECTION inVertexTangent;
+layout(location = 3) in VERTEX_DIRECTION inVertexBiTangent;
 #endif
 
 #if HAS_VERTEX_UV
@@ -37,6 +44,7 @@ layout(location = 4) out vec2 outVertexUV;
 layout(location = 5) flat out uint outInstanceID;
 #include "built_in/frameGlobalData.glsl"
 #include "built_in/camera.glsl"
+#include "built_in/vertexDecode.glsl"
 
 USE_FRAME_GLOBAL_DATA;
 
@@ -48,14 +56,25 @@ layout(std140,set = 2, binding = 0) readonly buffer PerInstanceData
     mat4 transform[];
 } instData;
 
+layout(std430, set = 2, binding = 2) readonly buffer MESH_DEQUANTIZATION_BLOCK_LAYOUT meshDequantization;
+
+vec3 decodeDirection(VERTEX_DIRECTION stored)
+{
+#if QUANTIZED_VERTEX_ATTRIBUTES
+    return octDecode(stored);
+#else
+    return stored;
+#endif
+}
+
 void main() {
     outInstanceID = inInstDataIdx;
     mat4 model = instData.transform[inInstDataIdx];
-    vec3 position = vec3(inVertexPosition.x,inVertexPosition.y,inVertexPosition.z);
+    vec3 position = dequantizePosition(inVertexPosition, meshDequantization.positionOffset, meshDequantization.positionScale);
     vec4 worldPosition = model * vec4(position, 1.0);
     gl_Position = camera.proj * camera.view * worldPosition;
     outVertexPosition = worldPosition.xyz;
-    outVertexNormal = normalize(mat3(transpose(inverse(model))) * inVertexNormal);
+    outVertexNormal = normalize(mat3(transpose(inverse(model))) * decodeDirection(inVertexNormal));
     #if HAS_VERTEX_UV
     outVertexUV = inVertexUV;
     #endif
@@ -3,8 +3,9 @@
 #include "assimp/scene.h"
 #include "assimp/postprocess.h"
 #include <cassert>
-#include <meshoptimizer.h>
-#include "happly.h"
+#include <array>
+#include <limits>
+#include "PLYReader.hpp"
 
 void AssetManager::setWorkDir(const fs::path &path) {
     _currentWorkDir = path;
@@ -19,7 +20,8 @@ TextureHostObject AssetManager::loadImg(const std::string &relative_path) {
     int x,y,channels;
     stbi_info(fileName.c_str(),&x,&y,&channels);
     int desired_channels = (channels == 3 || channels == 2 )? 4 : channels;
-    stbi_set_flip_vertically_on_load(true);
+    //images are loaded on several workers, keep the flag per thread
+    stbi_set_flip_vertically_on_load_thread(true);
     auto img_mem = stbi_load(fileName.c_str(),&x,&y,&channels,desired_channels);
     if(img_mem != nullptr){
         TextureHostObject textureHostObj{};
@@ -37,51 +39,22 @@ TextureHostObject AssetManager::loadImg(const std::string &relative_path) {
 }
 
 TextureHostObject* AssetManager::getOrLoadImg(const std::string &relative_path) {
-    for(auto & req : imgLoadRequests)
-    {
-        if(req.first == relative_path)
-        {
-            return req.second.get();
-        }
-    }
-    return getOrLoadImgAsync(relative_path)->get();
+    return getOrLoadImgAsync(relative_path).get();
 }
 
 /*
- * For now getOrLoadImg/Async must use in single thread environment
+ * Safe to call from any thread. The first request of an image schedules its load,
+ * later ones share the same future, so each image is loaded once.
  * */
-std::future<TextureHostObject*>* AssetManager::getOrLoadImgAsync(const std::string &relative_path) {
-    for(auto & req : imgLoadRequests)
-    {
-        if(req.first == relative_path)
-        {
-            return &req.second;
-        }
-    }
-    auto req = workerPool.enqueue([this,relative_path](int id)->TextureHostObject* {
-        auto fileName = fs::absolute(_currentWorkDir / relative_path).make_preferred().string();
-        {
-            std::lock_guard<std::mutex> lg(imgCacheLock);
-            auto it = loadedImgCache.find(fileName);
-            if ( it != loadedImgCache.end()) {
-                return &it->second;
-            }
-        }
-
-        auto textureHostObj = loadImg(relative_path);
-
-        // Cache loaded texture obj.
-        std::lock_guard<std::mutex> lg(imgCacheLock);
-        auto it = loadedImgCache.find(fileName);
-        if ( it != loadedImgCache.end()) {
-            return &it->second;
-        }
-        loadedImgCache.emplace(fileName,std::move(textureHostObj));
-        return &loadedImgCache[fileName];
-    });
-
-    imgLoadRequests.emplace_back(relative_path,std::move(req));
-    return &imgLoadRequests.back().second;
+std::shared_future<TextureHostObject*> AssetManager::getOrLoadImgAsync(const std::string &relative_path) {
+    auto fileName = fs::absolute(_currentWorkDir / relative_path).make_preferred().string();
+    return *imgLoadRequests.findOrEmplace(fileName,[&]{
+        return workerPool.enqueue([this,relative_path,fileName](int id)->TextureHostObject* {
+            auto textureHostObj = loadImg(relative_path);
+            // Cache loaded texture obj.
+            return loadedImgCache.emplace(fileName,std::move(textureHostObj)).first;
+        }).share();
+    }).first;
 }
 
 TextureDeviceHandle AssetManager::getOrLoadImgDevice(const std::string &relative_path,
@@ -90,14 +63,10 @@ TextureDeviceHandle AssetManager::getOrLoadImgDevice(const std::string &relative
                                                      float maxAnisotropy,
                                                      bool genMipmap) {
     TextureDeviceHandle handle;
-    for(int i = 0; i < device_textures.size(); i++)
+    if(auto* idx = device_texture_lookup.find(SymbolTable::getInstance().find(relative_path)))
     {
-        if(device_textures[i].first == relative_path)
-        {
-            handle.manager = this;
-            handle.idx = i;
-            break;
-        }
+        handle.manager = this;
+        handle.idx = *idx;
     }
 
     if(handle.manager == nullptr)
@@ -168,7 +137,7 @@ TextureDeviceHandle AssetManager::getOrLoadImgDevice(const std::string &relative
         textureDevice.image = img.value();
         backendDevice->setObjectDebugName(static_cast<vk::Image>(textureDevice.image.image),relative_path.c_str());
 
-        backendDevice->oneTimeUploadSync(textureHost->data.get(),textureDevice.image.image,textureHost->channels,textureDevice.imgInfo);
+        textureDevice.uploadTicket = UploadScheduler::getInstance().uploadImage(textureHost->data.get(),textureDevice.image.image,textureHost->channels,textureDevice.imgInfo);
 
         textureDevice.imgViewInfo.setViewType(vk::ImageViewType::e2D);
         textureDevice.imgViewInfo.setImage(textureDevice.image.image);
@@ -230,6 +199,7 @@ TextureDeviceHandle AssetManager::getOrLoadImgDevice(const std::string &relative
         } while (0);
         textureDevice.sampler = backendDevice->createSampler(samplerInfo);
         device_textures.emplace_back(relative_path,textureDevice);
+        device_texture_lookup.emplace(intern(relative_path), static_cast<uint32_t>(device_textures.size() - 1));
         handle.manager = this;
         handle.idx = device_textures.size() - 1;
     }
@@ -240,14 +210,10 @@ TextureDeviceHandle AssetManager::getOrLoadImgDevice(const std::string &relative
 TextureDeviceHandle AssetManager::create1x1ImgDevice(const std::string& identifier, float r, float g, float b, float a)
 {
     TextureDeviceHandle handle;
-    for (int i = 0; i < device_textures.size(); i++)
+    if (auto* idx = device_texture_lookup.find(SymbolTable::getInstance().find(identifier)))
     {
-        if (device_textures[i].first == identifier)
-        {
-            handle.manager = this;
-            handle.idx = i;
-            break;
-        }
+        handle.manager = this;
+        handle.idx = *idx;
     }
 
     if (handle.manager == nullptr)
@@ -280,7 +246,7 @@ TextureDeviceHandle AssetManager::create1x1ImgDevice(const std::string& identifi
         color[1] = static_cast<char>(static_cast<int>(g * 255));
         color[2] = static_cast<char>(static_cast<int>(b * 255));
         color[3] = static_cast<char>(255);
-        backendDevice->oneTimeUploadSync(color, textureDevice.image.image,4, textureDevice.imgInfo);
+        textureDevice.uploadTicket = UploadScheduler::getInstance().uploadImage(color, textureDevice.image.image,4, textureDevice.imgInfo);
 
         textureDevice.imgViewInfo.setViewType(vk::ImageViewType::e2D);
         textureDevice.imgViewInfo.setImage(textureDevice.image.image);
@@ -316,6 +282,7 @@ TextureDeviceHandle AssetManager::create1x1ImgDevice(const std::string& identifi
         samplerInfo.setAddressModeW(vk::SamplerAddressMode::eRepeat);
         textureDevice.sampler = backendDevice->createSampler(samplerInfo);
         device_textures.emplace_back(identifier, textureDevice);
+        device_texture_lookup.emplace(intern(identifier), static_cast<uint32_t>(device_textures.size() - 1));
         handle.manager = this;
         handle.idx = device_textures.size() - 1;
     }
@@ -451,118 +418,284 @@ MeshHostObject parseAssimpMesh(aiMesh* mesh)
     return meshHostObj;
 }
 
-MeshHostObject parseHapply(happly::PLYData & ply)
+/*
+ * Split large meshes into meshlets with their bounding sphere and normal cone, so that the clusters outside of the
+ * frustum or facing away can be skipped. Smaller meshes are drawn as a whole.
+ */
+static void buildMeshlets(MeshHostObject& mesh)
 {
-    MeshHostObject meshHostObj;
-    meshHostObj.aabb[0] = meshHostObj.aabb[1] = meshHostObj.aabb[2] = std::numeric_limits<float>::infinity();
-    meshHostObj.aabb[3] = meshHostObj.aabb[4] = meshHostObj.aabb[5] = -std::numeric_limits<float>::infinity();
+    if(mesh.index_count / 3 < MeshletData::MIN_TRIANGLES)
+    {
+        return;
+    }
+    // positions are the first attribute of the interleaved vertices, whichever way the loader stored them
+    auto [vertices, layout] = mesh.getInterleavingAttributes();
+    const auto* positions = reinterpret_cast<const float*>(vertices);
+    const float coneWeight = 0.25f;
+
+    auto maxMeshlets = meshopt_buildMeshletsBound(mesh.index_count, MeshletData::MAX_VERTICES, MeshletData::MAX_TRIANGLES);
+    std::vector<meshopt_Meshlet> meshlets(maxMeshlets);
+    std::vector<unsigned int> meshletVertices(maxMeshlets * MeshletData::MAX_VERTICES);
+    std::vector<unsigned char> meshletTriangles(maxMeshlets * MeshletData::MAX_TRIANGLES * 3);
+    meshlets.resize(meshopt_buildMeshlets(meshlets.data(), meshletVertices.data(), meshletTriangles.data(),
+                                          mesh.indices.get(), mesh.index_count, positions, mesh.vertex_count, layout.VertexStride,
+                                          MeshletData::MAX_VERTICES, MeshletData::MAX_TRIANGLES, coneWeight));
+
+    auto& data = mesh.meshletData;
+    data.meshlets.reserve(meshlets.size());
+    data.indices.reserve(mesh.index_count);
+    data.triangles.reserve(mesh.index_count / 3);
+    for(const auto& meshlet : meshlets)
+    {
+        const auto* localVertices = &meshletVertices[meshlet.vertex_offset];
+        const auto* localTriangles = &meshletTriangles[meshlet.triangle_offset];
+        auto bounds = meshopt_computeMeshletBounds(localVertices, localTriangles, meshlet.triangle_count,
+                                                   positions, mesh.vertex_count, layout.VertexStride);
+        Meshlet desc{};
+        desc.sphere = { bounds.center[0], bounds.center[1], bounds.center[2], bounds.radius };
+        desc.coneApex = { bounds.cone_apex[0], bounds.cone_apex[1], bounds.cone_apex[2], 1.0f };
+        desc.coneAxisCutoff = { bounds.cone_axis[0], bounds.cone_axis[1], bounds.cone_axis[2], bounds.cone_cutoff };
+        desc.firstIndex = static_cast<uint32_t>(data.indices.size());
+        desc.vertexOffset = static_cast<uint32_t>(data.vertices.size());
+        desc.vertexCount = meshlet.vertex_count;
+        desc.triangleCount = meshlet.triangle_count;
+        for(uint32_t i = 0; i < meshlet.triangle_count; i++)
+        {
+            const auto* triangle = localTriangles + i * 3;
+            data.indices.push_back(localVertices[triangle[0]]);
+            data.indices.push_back(localVertices[triangle[1]]);
+            data.indices.push_back(localVertices[triangle[2]]);
+            data.triangles.push_back(triangle[0] | (triangle[1] << 8) | (triangle[2] << 16));
+        }
+        data.vertices.insert(data.vertices.end(), localVertices, localVertices + meshlet.vertex_count);
+        data.meshlets.push_back(desc);
+    }
+}
 
-    // Get mesh-style data from the object
-    assert(ply.hasElement("vertex") && ply.hasElement("face"));
-    auto & vertexElement = ply.getElement("vertex");
-    meshHostObj.vertex_count = vertexElement.count;
-    assert(vertexElement.hasProperty("x") && vertexElement.hasProperty("y") && vertexElement.hasProperty("z"));
-    try
+// Octahedral mapping of a unit vector to [-1, 1]^2, octDecode() in vertexDecode.glsl reverses it
+static std::array<float,2> octEncode(const float* v)
+{
+    float length = std::abs(v[0]) + std::abs(v[1]) + std::abs(v[2]);
+    if(length == 0.0f)
     {
-        auto pos_x = vertexElement.getProperty<float>("x");
-        auto pos_y = vertexElement.getProperty<float>("y");
-        auto pos_z = vertexElement.getProperty<float>("z");
+        return {0.0f, 0.0f};
+    }
+    float x = v[0] / length;
+    float y = v[1] / length;
+    if(v[2] < 0.0f)
+    {
+        float wrappedX = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float wrappedY = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = wrappedX;
+        y = wrappedY;
+    }
+    return {x, y};
+}
 
-        auto* position = new float[meshHostObj.vertex_count * 3];
+void MeshHostObject::quantizeInterleavingAttributes()
+{
+    auto [sourceVertices, sourceLayout] = getInterleavingAttributes();
+    if(sourceLayout.quantized)
+    {
+        return;
+    }
+    // the float vertices stay alive until the quantized ones are written
+    auto source = std::move(interleavingAttributes);
+    auto layout = makeQuantizedAttributeLayout(sourceLayout.normalOffset != -1, sourceLayout.tangentOffset != -1,
+                                               sourceLayout.biTangentOffset != -1, sourceLayout.uvOffset != -1);
+    for(int k = 0; k < 3; k++)
+    {
+        layout.positionOffset[k] = aabb[k];
+        layout.positionScale[k] = aabb[k + 3] - aabb[k];
+    }
+    auto* destination = allocateInterleavingAttributes(layout);
+
+    auto readFloats = [](const unsigned char* src, float* dst, int count) { memcpy(dst, src, count * sizeof(float)); };
+    auto writeDirection = [](unsigned char* dst, const float* direction) {
+        auto encoded = octEncode(direction);
+        int16_t packed[2] = { static_cast<int16_t>(meshopt_quantizeSnorm(encoded[0], 16)),
+                              static_cast<int16_t>(meshopt_quantizeSnorm(encoded[1], 16)) };
+        memcpy(dst, packed, sizeof(packed));
+    };
+    for(size_t i = 0; i < vertex_count; i++)
+    {
+        const auto* src = sourceVertices + i * sourceLayout.VertexStride;
+        auto* dst = destination + i * layout.VertexStride;
+        float position[3];
+        readFloats(src, position, 3);
+        uint16_t packedPosition[4]{};
+        for(int k = 0; k < 3; k++)
+        {
+            float extent = layout.positionScale[k];
+            float normalized = extent > 0.0f ? (position[k] - layout.positionOffset[k]) / extent : 0.0f;
+            packedPosition[k] = static_cast<uint16_t>(meshopt_quantizeUnorm(normalized, 16));
+        }
+        memcpy(dst, packedPosition, sizeof(packedPosition));
 
-        for (int i = 0; i < meshHostObj.vertex_count; i++)
+        float attribute[3];
+        if(layout.normalOffset != -1)
         {
-            position[i * 3] = pos_x[i];
-            position[i * 3 + 1] = pos_y[i];
-            position[i * 3 + 2] = pos_z[i];
-            meshHostObj.aabb[0] = std::min(meshHostObj.aabb[0],pos_x[i]);
-            meshHostObj.aabb[1] = std::min(meshHostObj.aabb[1],pos_y[i]);
-            meshHostObj.aabb[2] = std::min(meshHostObj.aabb[2],pos_z[i]);
-            meshHostObj.aabb[3] = std::max(meshHostObj.aabb[3],pos_x[i]);
-            meshHostObj.aabb[4] = std::max(meshHostObj.aabb[4],pos_y[i]);
-            meshHostObj.aabb[5] = std::max(meshHostObj.aabb[5],pos_z[i]);
+            readFloats(src + sourceLayout.normalOffset, attribute, 3);
+            writeDirection(dst + layout.normalOffset, attribute);
         }
-        meshHostObj.position.reset(position);
-        //normal, tangent and uv is optional
-        bool hasNormal = vertexElement.hasProperty("nx") && vertexElement.hasProperty("ny") && vertexElement.hasProperty("nz");
-        if(hasNormal)
+        if(layout.tangentOffset != -1)
         {
-            auto normal_x = vertexElement.getProperty<float>("nx");
-            auto normal_y = vertexElement.getProperty<float>("ny");
-            auto normal_z = vertexElement.getProperty<float>("nz");
-
-            auto * normal = new float[meshHostObj.vertex_count * 3];
-
-            for(int i = 0; i < meshHostObj.vertex_count; i++)
-            {
-                normal[i * 3] = normal_x[i];
-                normal[i * 3 + 1] = normal_y[i];
-                normal[i * 3 + 2] = normal_z[i];
-            }
-            meshHostObj.normal.reset(normal);
+            readFloats(src + sourceLayout.tangentOffset, attribute, 3);
+            writeDirection(dst + layout.tangentOffset, attribute);
         }
-
-        bool hasTextureCoords = vertexElement.hasProperty("u") && vertexElement.hasProperty("v");
-        if(hasTextureCoords)
+        if(layout.biTangentOffset != -1)
         {
-            auto u = vertexElement.getProperty<float>("u");
-            auto v = vertexElement.getProperty<float>("v");
-
-            auto * uv = new float[meshHostObj.vertex_count * 2];
-
-            for(int i = 0; i < meshHostObj.vertex_count; i++)
-            {
-                uv[i * 2 + 0] = u[i];
-                uv[i * 2 + 1] = v[i];
-            }
-            meshHostObj.uv.reset(uv);
+            readFloats(src + sourceLayout.biTangentOffset, attribute, 3);
+            writeDirection(dst + layout.biTangentOffset, attribute);
         }
-
-        //we only handle triangle for now
-        auto faces = ply.getFaceIndices();
-        meshHostObj.index_count = faces.size() * 3;
-        auto* indices = new unsigned int[meshHostObj.index_count];
-
-        for(int i = 0; i < faces.size(); i ++)
+        if(layout.uvOffset != -1)
         {
-            auto & face = faces[i];
-            assert(face.size() == 3);
-            indices[i * 3 + 0] = face[0];
-            indices[i * 3 + 1] = face[1];
-            indices[i * 3 + 2] = face[2];
+            readFloats(src + sourceLayout.uvOffset, attribute, 2);
+            uint16_t packedUV[2] = { meshopt_quantizeHalf(attribute[0]), meshopt_quantizeHalf(attribute[1]) };
+            memcpy(dst + layout.uvOffset, packedUV, sizeof(packedUV));
         }
+    }
+}
 
-        meshHostObj.indices.reset(indices);
+/*
+ * meshoptimizer reorders whole triangles without rotating their vertices, so the pbrt face of a triangle is found
+ * again by its vertex indices. Duplicated triangles may swap their faces.
+ */
+static void remapFaceIndices(const std::vector<unsigned int>& originalIndices, const MeshHostObject& mesh, int* faceIndices)
+{
+    using Triangle = std::array<unsigned int,3>;
+    size_t triangleCount = mesh.index_count / 3;
+    std::vector<std::pair<Triangle,int>> faces(triangleCount);
+    for(size_t i = 0; i < triangleCount; i++)
+    {
+        faces[i] = { { originalIndices[i * 3], originalIndices[i * 3 + 1], originalIndices[i * 3 + 2] }, faceIndices[i] };
+    }
+    std::sort(faces.begin(), faces.end());
+    const auto* indices = mesh.indices.get();
+    for(size_t i = 0; i < triangleCount; i++)
+    {
+        Triangle triangle{ indices[i * 3], indices[i * 3 + 1], indices[i * 3 + 2] };
+        auto found = std::lower_bound(faces.begin(), faces.end(), std::make_pair(triangle, std::numeric_limits<int>::min()));
+        faceIndices[i] = found->second;
+    }
+}
 
-    }catch (std::bad_alloc& e)
+/*
+ * Reorder the triangles for the post transform cache then for less overdraw, and the vertices in the order the triangles
+ * first use them. Runs on the loading worker, the per attribute arrays are dropped for the interleaved vertices.
+ */
+static void optimizeVertexOrder(MeshHostObject& mesh, MeshOptimizationStatistics& statistics)
+{
+    // the cache size of the analysis, meshoptimizer's own default
+    const unsigned int cacheSize = 16;
+    // triangles may be reordered as long as the overdraw order isn't more than 5% worse for the cache
+    const float overdrawThreshold = 1.05f;
+
+    auto [vertices, layout] = mesh.getInterleavingAttributes();
+    mesh.position.reset();
+    mesh.normal.reset();
+    mesh.tangent.reset();
+    mesh.bitangent.reset();
+    mesh.uv.reset();
+
+    auto* indices = mesh.indices.get();
+    statistics.cacheBefore = meshopt_analyzeVertexCache(indices, mesh.index_count, mesh.vertex_count, cacheSize, 0, 0);
+    statistics.fetchBefore = meshopt_analyzeVertexFetch(indices, mesh.index_count, mesh.vertex_count, layout.VertexStride);
+    statistics.vertexBytesBefore = size_t(mesh.vertex_count) * layout.VertexStride;
+
+    std::vector<unsigned int> originalIndices;
+    if(mesh.faceIndices != nullptr)
     {
-        std::cout << e.what() << std::endl;
-        throw std::runtime_error(e.what());
+        originalIndices.assign(indices, indices + mesh.index_count);
+    }
+    const auto* positions = reinterpret_cast<const float*>(vertices);
+    meshopt_optimizeVertexCache(indices, indices, mesh.index_count, mesh.vertex_count);
+    meshopt_optimizeOverdraw(indices, indices, mesh.index_count, positions, mesh.vertex_count, layout.VertexStride, overdrawThreshold);
+    if(mesh.faceIndices != nullptr)
+    {
+        remapFaceIndices(originalIndices, mesh, mesh.faceIndices.get());
     }
+    // vertices no triangle uses are dropped
+    mesh.vertex_count = static_cast<unsigned int>(meshopt_optimizeVertexFetch(vertices, indices, mesh.index_count, vertices,
+                                                                              mesh.vertex_count, layout.VertexStride));
 
-    return meshHostObj;
+    statistics.cacheAfter = meshopt_analyzeVertexCache(indices, mesh.index_count, mesh.vertex_count, cacheSize, 0, 0);
+}
+
+/*
+ * Chain of simplified levels over the optimized vertices, each one from the previous with half of its triangles as
+ * the target and the next error target as the budget. Errors add up along the chain, the recorded error of a level is
+ * that upper bound in mesh space. Simplification stops at borders and attribute seams, then the sloppy variant which
+ * ignores the topology is tried. The chain ends when neither gets far enough.
+ */
+static void buildLods(MeshHostObject& mesh, const std::vector<float>& errorTargets)
+{
+    auto& chain = mesh.lodChain;
+    chain.lods.push_back({ 0, mesh.index_count, 0.0f });
+    if(mesh.index_count / 3 < MeshLodChain::MIN_TRIANGLES)
+    {
+        return;
+    }
+    auto [vertices, layout] = mesh.getInterleavingAttributes();
+    const auto* positions = reinterpret_cast<const float*>(vertices);
+    // the errors of meshoptimizer are relative to the extents of the mesh
+    const float errorScale = meshopt_simplifyScale(positions, mesh.vertex_count, layout.VertexStride);
+    // a level with more than this share of the previous one's indices isn't worth a draw
+    const float minReduction = 0.75f;
+
+    std::vector<unsigned int> source(mesh.indices.get(), mesh.indices.get() + mesh.index_count);
+    std::vector<unsigned int> lod;
+    float chainError = 0.0f;
+    for(float target : errorTargets)
+    {
+        if(chain.lods.size() == MeshLodChain::MAX_LODS || target <= chainError)
+        {
+            break;
+        }
+        size_t targetIndexCount = source.size() / 6 * 3;
+        float lodError = 0.0f;
+        lod.resize(source.size());
+        lod.resize(meshopt_simplify(lod.data(), source.data(), source.size(), positions, mesh.vertex_count, layout.VertexStride,
+                                    targetIndexCount, target - chainError, 0, &lodError));
+        if(lod.size() > source.size() * minReduction)
+        {
+            lod.resize(source.size());
+            lod.resize(meshopt_simplifySloppy(lod.data(), source.data(), source.size(), positions, mesh.vertex_count, layout.VertexStride,
+                                              targetIndexCount, target - chainError, &lodError));
+        }
+        if(lod.empty() || lod.size() > source.size() * minReduction)
+        {
+            break;
+        }
+        meshopt_optimizeVertexCache(lod.data(), lod.data(), lod.size(), mesh.vertex_count);
+
+        chainError += lodError;
+        auto firstIndex = static_cast<uint32_t>(mesh.index_count + chain.indices.size());
+        chain.lods.push_back({ firstIndex, static_cast<uint32_t>(lod.size()), chainError * errorScale });
+        chain.indices.insert(chain.indices.end(), lod.begin(), lod.end());
+        source.swap(lod);
+    }
 }
-MeshHostObject optimize(MeshHostObject&& rawMesh)
+
+MeshOptimizationStatistics AssetManager::optimizeMesh(MeshHostObject& rawMesh, const std::vector<float>& lodErrorTargets)
 {
-    //Simplification
-    /*float threshold = 0.1f;
-    auto target_index_count = static_cast<size_t>(rawMesh.index_count * threshold);
-    if(target_index_count > 3)
+    MeshOptimizationStatistics statistics;
+    optimizeVertexOrder(rawMesh, statistics);
+
+    // simplification measures the errors on the float positions too
+    buildLods(rawMesh, lodErrorTargets);
+
+    // meshlet bounds come from the float positions, quantization comes last
+    buildMeshlets(rawMesh);
+
+    if(MeshHostObject::quantizeVertexAttributes)
     {
-        float target_error = 1e-1f;
-
-        std::vector<unsigned int> lod(rawMesh.index_count);
-        float lod_error;
-        lod.resize(meshopt_simplifySloppy(lod.data(), rawMesh.indices.get(), rawMesh.index_count,
-                                          rawMesh.position.get(), rawMesh.vertex_count, sizeof(float) * 3,
-                                          target_index_count, target_error, &lod_error));
-        assert(!lod.empty());
-        rawMesh.index_count = lod.size();
-        rawMesh.indices.reset(new unsigned int[lod.size()]);
-        std::copy(lod.begin(), lod.end(), rawMesh.indices.get());
-    }*/
-
-    return std::move(rawMesh);
+        rawMesh.quantizeInterleavingAttributes();
+    }
+    auto vertexStride = rawMesh.getInterleavingAttributes().second.VertexStride;
+    statistics.vertexBytesAfter = size_t(rawMesh.vertex_count) * vertexStride;
+    statistics.fetchAfter = meshopt_analyzeVertexFetch(rawMesh.indices.get(), rawMesh.index_count, rawMesh.vertex_count, vertexStride);
+    return statistics;
 }
 
 MeshHostObject AssetManager::loadMeshPBRTPLY(const std::string &relative_path,int importerID) {
@@ -577,11 +710,21 @@ MeshHostObject AssetManager::loadMeshPBRTPLY(const std::string &relative_path,in
     }
     assert(scene->mNumMeshes == 1);
     auto meshHostObject = optimize(parseAssimpMesh(scene->mMeshes[0]));*/
-    happly::PLYData ply(fileName);
-    auto meshHostObject = optimize(parseHapply(ply));
+    auto meshHostObject = PLYReader::load(fileName);
+    auto statistics = optimizeMesh(meshHostObject, lodErrorTargets);
     //importer.FreeScene();
     //logging
-    GlobalLogger::getInstance().info("Loaded Mesh " + relative_path);
+    std::string meshletInfo;
+    if(!meshHostObject.meshletData.empty())
+    {
+        meshletInfo = "\t + [ " + std::to_string(meshHostObject.meshletData.meshlets.size()) + " meshlets ]";
+    }
+    const auto& lods = meshHostObject.lodChain.lods;
+    if(lods.size() > 1)
+    {
+        meshletInfo += "\t + [ " + std::to_string(lods.size()) + " LODs, " + std::to_string(lods.back().indexCount / 3) + " triangles at the last ]";
+    }
+    GlobalLogger::getInstance().info("Loaded Mesh " + relative_path + statistics.toString() + meshletInfo);
     return meshHostObject;
 }
 
@@ -589,46 +732,24 @@ MeshHostObject* AssetManager::getOrLoadPBRTPLY(const std::string &relative_path)
     return getOrLoadMeshAsync(relative_path).get();
 }
 
-std::future<MeshHostObject*> AssetManager::getOrLoadMeshAsync(const std::string &relative_path) {
-    return workerPool.enqueue([this,relative_path](int id)->MeshHostObject* {
-        auto fileName = fs::absolute(_currentWorkDir / relative_path).make_preferred().string();
-        std::mutex *  loadLock;
-        {
-            std::lock_guard<std::mutex> lg(meshLoadLockMapLock);
-            auto it = meshLoadLockMap.find(fileName);
-            if( it != meshLoadLockMap.end())
-            {
-                loadLock = it->second.get();
-            }else{
-                loadLock = new std::mutex;
-                meshLoadLockMap.emplace(fileName,loadLock);
-            }
-        }
-        {
-            std::lock_guard<std::mutex> lg(*loadLock);
-            auto it = loadedMeshCache.find(fileName);
-            if ( it != loadedMeshCache.end()) {
-                return &it->second;
-            }
+std::shared_future<MeshHostObject*> AssetManager::getOrLoadMeshAsync(const std::string &relative_path) {
+    auto fileName = fs::absolute(_currentWorkDir / relative_path).make_preferred().string();
+    return *meshLoadRequests.findOrEmplace(fileName,[&]{
+        return workerPool.enqueue([this,relative_path,fileName](int id)->MeshHostObject* {
             auto meshHostObj = loadMeshPBRTPLY(relative_path,id);
-            loadedMeshCache.emplace(fileName,std::move(meshHostObj));
-            return &loadedMeshCache[fileName];
-        }
-    });
+            return loadedMeshCache.emplace(fileName,std::move(meshHostObj)).first;
+        }).share();
+    }).first;
 }
 
 MeshRigidHandle AssetManager::getOrLoadPLYMeshDevice(const std::string &relative_path) {
     MeshRigidHandle handle;
     handle.hostObject = getOrLoadPBRTPLY(relative_path);
 
-    for(int i = 0; i < device_meshes.size(); i ++)
+    if(auto* idx = device_mesh_lookup.find(SymbolTable::getInstance().find(relative_path)))
     {
-        if(device_meshes[i].first == relative_path)
-        {
-            handle.manager = this;
-            handle.idx = i;
-            break;
-        }
+        handle.manager = this;
+        handle.idx = *idx;
     }
 
     if(handle.manager == nullptr)
@@ -637,11 +758,21 @@ MeshRigidHandle AssetManager::getOrLoadPLYMeshDevice(const std::string &relative
         auto interleaveAttribute = handle.hostObject->getInterleavingAttributes();
 
         unsigned int * indicies = handle.hostObject->indices.get();
-        auto indexBufferSize = handle.hostObject->index_count * sizeof(indicies[0]);
+        const auto& lodChain = handle.hostObject->lodChain;
+        // the simplified levels follow level 0 in the same index buffer
+        auto lod0IndexBufferSize = handle.hostObject->index_count * sizeof(indicies[0]);
+        auto indexBufferSize = lod0IndexBufferSize + lodChain.indices.size() * sizeof(uint32_t);
         auto vertexBufferSize = handle.hostObject->vertex_count * interleaveAttribute.second.VertexStride;
         auto interleavingBufferAttribute = interleaveAttribute.second;
 
-        auto vertexBuffer = backendDevice->allocateBuffer(vertexBufferSize,(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT),VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+        const auto& meshletData = handle.hostObject->meshletData;
+        // the mesh shading path fetches the vertices of a meshlet itself
+        VkBufferUsageFlags vertexBufferUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+        if(!meshletData.empty())
+        {
+            vertexBufferUsage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        }
+        auto vertexBuffer = backendDevice->allocateBuffer(vertexBufferSize,vertexBufferUsage,VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
         auto indexBuffer = backendDevice->allocateBuffer(indexBufferSize,(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT),VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
 
         auto vertexBufferDebugName = relative_path + "VertexBuffer";
@@ -666,6 +797,7 @@ MeshRigidHandle AssetManager::getOrLoadPLYMeshDevice(const std::string &relative
         vertexAttribute.tangentOffset = interleavingBufferAttribute.tangentOffset;
         vertexAttribute.biTangentOffset = interleavingBufferAttribute.biTangentOffset;
         vertexAttribute.uvOffset = interleavingBufferAttribute.uvOffset;
+        vertexAttribute.quantized = interleavingBufferAttribute.quantized;
 
         MeshRigidDevice meshRigid{vertexAttribute,static_cast<uint32_t>(device_meshes.size())};
 
@@ -673,11 +805,59 @@ MeshRigidHandle AssetManager::getOrLoadPLYMeshDevice(const std::string &relative
         meshRigid.indexBuffer = indexBuffer.value();
         meshRigid.vertexCount = handle.hostObject->vertex_count;
         meshRigid.indexCount = handle.hostObject->index_count;
+        meshRigid.lods = lodChain.lods;
 
-        backendDevice->oneTimeUploadSync(handle.hostObject->indices.get(),indexBufferSize,meshRigid.indexBuffer.buffer);
-        backendDevice->oneTimeUploadSync(interleaveAttribute.first,vertexBufferSize,meshRigid.vertexBuffer.buffer);
+        // tickets are ordered, the later one covers both buffers
+        auto& uploads = UploadScheduler::getInstance();
+        meshRigid.uploadTicket = uploads.uploadBuffer(handle.hostObject->indices.get(),lod0IndexBufferSize,meshRigid.indexBuffer.buffer);
+        if(!lodChain.indices.empty())
+        {
+            auto lodTicket = uploads.uploadBuffer(lodChain.indices.data(),indexBufferSize - lod0IndexBufferSize,meshRigid.indexBuffer.buffer,lod0IndexBufferSize);
+            meshRigid.uploadTicket.value = std::max(meshRigid.uploadTicket.value, lodTicket.value);
+        }
+        auto vertexTicket = uploads.uploadBuffer(interleaveAttribute.first,vertexBufferSize,meshRigid.vertexBuffer.buffer);
+        meshRigid.uploadTicket.value = std::max(meshRigid.uploadTicket.value, vertexTicket.value);
+
+        // MeshDequantization in vertexDecode.glsl, offset then scale
+        float dequantization[8] = { interleavingBufferAttribute.positionOffset[0], interleavingBufferAttribute.positionOffset[1],
+                                    interleavingBufferAttribute.positionOffset[2], 0.0f,
+                                    interleavingBufferAttribute.positionScale[0], interleavingBufferAttribute.positionScale[1],
+                                    interleavingBufferAttribute.positionScale[2], 0.0f };
+        auto dequantizationBuffer = backendDevice->allocateBuffer(sizeof(dequantization),(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT),VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+        if(!dequantizationBuffer)
+        {
+            throw std::runtime_error("Failed to allocate dequantization buffer");
+        }
+        meshRigid.dequantizationBuffer = dequantizationBuffer.value();
+        auto dequantizationTicket = uploads.uploadBuffer(dequantization,sizeof(dequantization),meshRigid.dequantizationBuffer.buffer);
+        meshRigid.uploadTicket.value = std::max(meshRigid.uploadTicket.value, dequantizationTicket.value);
+
+        if(!meshletData.empty())
+        {
+            auto uploadMeshletBuffer = [&](const void* data, vk::DeviceSize size, VkBufferUsageFlags usage, const std::string& name) {
+                auto buffer = backendDevice->allocateBuffer(size,(VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage),VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+                if(!buffer)
+                {
+                    throw std::runtime_error("Failed to allocate " + name);
+                }
+                backendDevice->setObjectDebugName(static_cast<vk::Buffer>(buffer->buffer),(relative_path + name).c_str());
+                auto ticket = uploads.uploadBuffer(data,size,buffer->buffer);
+                meshRigid.uploadTicket.value = std::max(meshRigid.uploadTicket.value, ticket.value);
+                return buffer.value();
+            };
+            meshRigid.meshletBuffer = uploadMeshletBuffer(meshletData.meshlets.data(), meshletData.meshlets.size() * sizeof(Meshlet),
+                                                          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, "MeshletBuffer");
+            meshRigid.meshletIndexBuffer = uploadMeshletBuffer(meshletData.indices.data(), meshletData.indices.size() * sizeof(uint32_t),
+                                                               VK_BUFFER_USAGE_INDEX_BUFFER_BIT, "MeshletIndexBuffer");
+            meshRigid.meshletVertexBuffer = uploadMeshletBuffer(meshletData.vertices.data(), meshletData.vertices.size() * sizeof(uint32_t),
+                                                                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, "MeshletVertexBuffer");
+            meshRigid.meshletTriangleBuffer = uploadMeshletBuffer(meshletData.triangles.data(), meshletData.triangles.size() * sizeof(uint32_t),
+                                                                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, "MeshletTriangleBuffer");
+            meshRigid.meshletCount = static_cast<uint32_t>(meshletData.meshlets.size());
+        }
 
         device_meshes.emplace_back(relative_path,meshRigid);
+        device_mesh_lookup.emplace(intern(relative_path), static_cast<uint32_t>(device_meshes.size() - 1));
 
         handle.manager= this;
         handle.idx = device_meshes.size() - 1;
@@ -8,12 +8,25 @@
 #include <variant>
 #include "assimp/Importer.hpp"
 #include "ThreadPool.h"
+#include "ConcurrentHashMap.hpp"
+#include "Symbol.hpp"
 #include "stb_image.h"
 #include "VulkanExtension.h"
+#include "UploadScheduler.hpp"
+#include "Meshlet.hpp"
+#include "MeshLod.hpp"
+#include <meshoptimizer.h>
+#include <cstdio>
 #include <cstdlib>
+#include <algorithm>
 
 struct AssetManager;
 
+// Set by the EDITOR_QUANTIZE_VERTICES CMake option, every mesh of a build shares the same vertex formats
+#ifndef EDITOR_QUANTIZE_VERTICES
+#define EDITOR_QUANTIZE_VERTICES 0
+#endif
+
 struct TextureHostObject
 {
     unsigned int channels = 0;
@@ -39,6 +52,11 @@ struct MeshHostObject
     std::unique_ptr<float[]> tangent = nullptr;
     std::unique_ptr<float[]> bitangent = nullptr;
     std::unique_ptr<float[]> uv = nullptr;
+    std::unique_ptr<int[]> faceIndices = nullptr; // pbrt-v4 face_indices, one per triangle
+    // empty for meshes below MeshletData::MIN_TRIANGLES
+    MeshletData meshletData;
+    // at least level 0, more for meshes above MeshLodChain::MIN_TRIANGLES
+    MeshLodChain lodChain;
 
     struct AttributeLayout
     {
@@ -47,8 +65,17 @@ struct MeshHostObject
         int tangentOffset = -1;
         int biTangentOffset = -1;
         int uvOffset = -1;
+        /*
+         * Quantized vertices store the position as 16 bit unorm within the bounds of the mesh, normal and tangents
+         * as 16 bit snorm octahedral vectors and the uv as half floats. position = offset + stored * scale.
+         */
+        bool quantized = false;
+        float positionOffset[3]{ 0.0f, 0.0f, 0.0f };
+        float positionScale[3]{ 1.0f, 1.0f, 1.0f };
     };
 
+    static constexpr bool quantizeVertexAttributes = EDITOR_QUANTIZE_VERTICES != 0;
+
     MeshHostObject() = default;
 
     MeshHostObject(MeshHostObject&& other) noexcept = default;
@@ -56,47 +83,100 @@ struct MeshHostObject
     MeshHostObject& operator=(MeshHostObject&& other) noexcept = default;
 
 public:
-    std::pair<unsigned char*,AttributeLayout> getInterleavingAttributes()
+    static AttributeLayout makeAttributeLayout(bool hasNormal, bool hasTangent, bool hasBitangent, bool hasUV)
     {
-        if(interleavingAttributes == nullptr)
+        AttributeLayout layout;
+        int current_offset = 16; // Position aligned with 16
+        int current_size = 16;
+
+        if(hasNormal)
+        {
+            layout.normalOffset = current_offset;
+            current_size += 16;
+            current_offset += 16;
+        }
+        if(hasTangent)
+        {
+            layout.tangentOffset = current_offset;
+            current_size += 16;
+            current_offset += 16;
+        }
+        if(hasBitangent)
+        {
+            layout.biTangentOffset = current_offset;
+            current_size += 16;
+            current_offset += 16;
+        }
+        if(hasUV)
         {
-            int current_offset = 16; // Position aligned with 16
-            int current_size = 16;
+            layout.uvOffset = current_offset;
+            current_size += 8;
+        }
+        //don't forget position must aligned with 16, so some padding might be necessary.
+        if(current_size % 16 != 0)
+            current_size += (16 - (current_size % 16));
+        layout.VertexStride = current_size;
+        return layout;
+    }
 
-            if(normal!= nullptr)
-            {
-                attributeLayout.normalOffset = current_offset;
-                current_size += 16;
-                current_offset += 16;
-            }
-            if(tangent!= nullptr)
-            {
-                attributeLayout.tangentOffset = current_offset;
-                current_size += 16;
-                current_offset += 16;
-            }
-            if(bitangent!= nullptr)
-            {
-                attributeLayout.biTangentOffset = current_offset;
-                current_size += 16;
-                current_offset += 16;
-            }
-            if(uv!= nullptr)
-            {
-                attributeLayout.uvOffset = current_offset;
-                current_size += 8;
-            }
-            //don't forget position must aligned with 16, so some padding might be necessary.
-            if(current_size % 16 != 0)
-                current_size += (16 - (current_size % 16));
-            attributeLayout.VertexStride = current_size;
+    // Same attributes in 4 byte aligned slots, see AttributeLayout::quantized
+    static AttributeLayout makeQuantizedAttributeLayout(bool hasNormal, bool hasTangent, bool hasBitangent, bool hasUV)
+    {
+        AttributeLayout layout;
+        layout.quantized = true;
+        int current_offset = 8; // 4 x 16 bit position, w unused
+
+        if(hasNormal)
+        {
+            layout.normalOffset = current_offset;
+            current_offset += 4;
+        }
+        if(hasTangent)
+        {
+            layout.tangentOffset = current_offset;
+            current_offset += 4;
+        }
+        if(hasBitangent)
+        {
+            layout.biTangentOffset = current_offset;
+            current_offset += 4;
+        }
+        if(hasUV)
+        {
+            layout.uvOffset = current_offset;
+            current_offset += 4;
+        }
+        layout.VertexStride = current_offset;
+        return layout;
+    }
+
+    // Re-encode the interleaved float vertices with makeQuantizedAttributeLayout, positions to the aabb of the mesh
+    void quantizeInterleavingAttributes();
 
-            static_assert(sizeof(unsigned char ) == 1);
+    /*
+     * Loaders which decode vertices straight into the interleaved layout allocate it here,
+     * the per attribute arrays above are left empty in that case.
+     */
+    unsigned char* allocateInterleavingAttributes(const AttributeLayout& layout)
+    {
+        static_assert(sizeof(unsigned char ) == 1);
+        attributeLayout = layout;
+        size_t size = std::max<size_t>(size_t(vertex_count) * layout.VertexStride, 16);
 #if WIN32
-            interleavingAttributes.reset((unsigned char*)_aligned_malloc(vertex_count * current_size, 16));
+        interleavingAttributes.reset((unsigned char*)_aligned_malloc(size, 16));
 #else
-            interleavingAttributes.reset((unsigned char*)std::aligned_alloc(16, vertex_count * current_size));
+        interleavingAttributes.reset((unsigned char*)std::aligned_alloc(16, size));
 #endif // WIN32
+        if(interleavingAttributes == nullptr)
+            throw std::bad_alloc();
+        return interleavingAttributes.get();
+    }
+
+    std::pair<unsigned char*,AttributeLayout> getInterleavingAttributes()
+    {
+        if(interleavingAttributes == nullptr)
+        {
+            allocateInterleavingAttributes(makeAttributeLayout(normal != nullptr, tangent != nullptr, bitangent != nullptr, uv != nullptr));
             auto* interleavingAttributes_raw = interleavingAttributes.get();
             const float * position_raw = position.get();
             //assert(position != nullptr);
@@ -161,6 +241,19 @@ struct MeshRigidDevice{
     uint32_t vertexCount{};
     uint32_t indexCount{};
     uint32_t _uuid;
+    // Vertex and index buffers may still be in flight on the transfer queue
+    UploadTicket uploadTicket{};
+
+    // Only for meshes split into meshlets, see MeshletData. The vertex buffer is then a storage buffer as well.
+    VMABuffer meshletBuffer{};
+    VMABuffer meshletIndexBuffer{};
+    VMABuffer meshletVertexBuffer{};
+    VMABuffer meshletTriangleBuffer{};
+    uint32_t meshletCount{};
+    // Levels of MeshLodChain, indexCount is the one of level 0
+    std::vector<MeshLod> lods;
+    // MeshDequantization of the vertex shaders, identity for float positions
+    VMABuffer dequantizationBuffer{};
 
     struct VertexAttribute
     {
@@ -169,8 +262,16 @@ struct MeshRigidDevice{
         int tangentOffset = -1;
         int biTangentOffset = -1;
         int uvOffset = -1;
+        // see MeshHostObject::AttributeLayout::quantized
+        bool quantized = false;
     };
 
+    // Position only pipelines are shared by all meshes, which works because a build quantizes all of them or none
+    static constexpr vk::Format positionFormat()
+    {
+        return MeshHostObject::quantizeVertexAttributes ? vk::Format::eR16G16B16A16Unorm : vk::Format::eR32G32B32Sfloat;
+    }
+
     const VertexAttribute vertexAttribute;
     const vk::VertexInputBindingDescription bindingDescription{};
     const std::vector<vk::VertexInputAttributeDescription> attributeDescriptions{};
@@ -188,22 +289,26 @@ struct MeshRigidDevice{
     {
         std::vector<vk::VertexInputAttributeDescription> attributeDesc;
         // todo if we can modify the shader variant, then explicitly specific location may be unnecessary
-        attributeDesc.emplace_back(0,0,vk::Format::eR32G32B32Sfloat,0);
+        // quantized normals and tangents are octahedral, decoded by the shader variant
+        auto positionFormat = vertexAttribute.quantized ? vk::Format::eR16G16B16A16Unorm : vk::Format::eR32G32B32Sfloat;
+        auto directionFormat = vertexAttribute.quantized ? vk::Format::eR16G16Snorm : vk::Format::eR32G32B32Sfloat;
+        auto uvFormat = vertexAttribute.quantized ? vk::Format::eR16G16Sfloat : vk::Format::eR32G32Sfloat;
+        attributeDesc.emplace_back(0,0,positionFormat,0);
         if(vertexAttribute.normalOffset != -1)
         {
-            attributeDesc.emplace_back(1,0,vk::Format::eR32G32B32Sfloat,vertexAttribute.normalOffset);
+            attributeDesc.emplace_back(1,0,directionFormat,vertexAttribute.normalOffset);
         }
         if(vertexAttribute.tangentOffset != -1)
         {
-            attributeDesc.emplace_back(2,0,vk::Format::eR32G32B32Sfloat,vertexAttribute.tangentOffset);
+            attributeDesc.emplace_back(2,0,directionFormat,vertexAttribute.tangentOffset);
         }
         if(vertexAttribute.biTangentOffset != -1)
         {
-            attributeDesc.emplace_back(3,0,vk::Format::eR32G32B32Sfloat,vertexAttribute.biTangentOffset);
+            attributeDesc.emplace_back(3,0,directionFormat,vertexAttribute.biTangentOffset);
         }
         if(vertexAttribute.uvOffset != -1)
         {
-            attributeDesc.emplace_back(4,0,vk::Format::eR32G32Sfloat,vertexAttribute.uvOffset);
+            attributeDesc.emplace_back(4,0,uvFormat,vertexAttribute.uvOffset);
         }
 
         return attributeDesc;
@@ -234,15 +339,33 @@ struct MeshRigidDevice{
      * Only bind per vertex data input
      */
     void bind(vk::CommandBuffer cmd) {
+        UploadScheduler::getInstance().use(uploadTicket);
         cmd.bindVertexBuffers(0, {vertexBuffer.buffer}, {0});
         cmd.bindIndexBuffer(indexBuffer.buffer, 0, vk::IndexType::eUint32);
     }
 
     void bindPosOnly(vk::CommandBuffer cmd,vk::DispatchLoaderDynamic loader) {
+        UploadScheduler::getInstance().use(uploadTicket);
         vk::DeviceSize vertexStride = vertexAttribute.stride;
         cmd.bindVertexBuffers2EXT(0, { vertexBuffer.buffer }, { 0 }, nullptr, { vertexStride },loader);
         cmd.bindIndexBuffer(indexBuffer.buffer, 0, vk::IndexType::eUint32);
     }
+
+    /*
+     * Same vertices, the indices are ordered meshlet after meshlet so that a cluster is a range of them
+     */
+    void bindClusters(vk::CommandBuffer cmd) {
+        UploadScheduler::getInstance().use(uploadTicket);
+        cmd.bindVertexBuffers(0, {vertexBuffer.buffer}, {0});
+        cmd.bindIndexBuffer(meshletIndexBuffer.buffer, 0, vk::IndexType::eUint32);
+    }
+
+    void bindClustersPosOnly(vk::CommandBuffer cmd,vk::DispatchLoaderDynamic loader) {
+        UploadScheduler::getInstance().use(uploadTicket);
+        vk::DeviceSize vertexStride = vertexAttribute.stride;
+        cmd.bindVertexBuffers2EXT(0, { vertexBuffer.buffer }, { 0 }, nullptr, { vertexStride },loader);
+        cmd.bindIndexBuffer(meshletIndexBuffer.buffer, 0, vk::IndexType::eUint32);
+    }
 };
 
 struct MeshRigidHandle
@@ -269,6 +392,7 @@ struct TextureDeviceObject
     vk::Sampler sampler;
     VkImageCreateInfo imgInfo{};
     vk::ImageViewCreateInfo imgViewInfo{};
+    UploadTicket uploadTicket{};
 };
 
 struct TextureDeviceHandle
@@ -287,10 +411,34 @@ private:
     uint32_t idx = -1;
 };
 
+// Vertex cache and fetch efficiency of a mesh around AssetManager::optimizeMesh(), logged with every loaded mesh
+struct MeshOptimizationStatistics
+{
+    meshopt_VertexCacheStatistics cacheBefore{};
+    meshopt_VertexCacheStatistics cacheAfter{};
+    meshopt_VertexFetchStatistics fetchBefore{};
+    meshopt_VertexFetchStatistics fetchAfter{};
+    size_t vertexBytesBefore = 0;
+    size_t vertexBytesAfter = 0;
+
+    std::string toString() const
+    {
+        auto format = [](float value) {
+            char text[16];
+            snprintf(text, sizeof(text), "%.3f", value);
+            return std::string(text);
+        };
+        return "\t + [ ACMR " + format(cacheBefore.acmr) + " -> " + format(cacheAfter.acmr) +
+               ", ATVR " + format(cacheBefore.atvr) + " -> " + format(cacheAfter.atvr) +
+               ", overfetch " + format(fetchBefore.overfetch) + " -> " + format(fetchAfter.overfetch) +
+               ", vertices " + std::to_string(vertexBytesBefore / 1024) + "KB -> " + std::to_string(vertexBytesAfter / 1024) + "KB ]";
+    }
+};
+
 namespace fs = std::filesystem;
 
 template<typename T>
-using AssetCacheT = std::unordered_map<std::string,T>;
+using AssetCacheT = ConcurrentHashMap<std::string,T>;
 
 /*
  * Asset manager will load all the resource : texture image,
@@ -302,7 +450,7 @@ struct AssetManager
 {
     TextureHostObject* getOrLoadImg(const std::string & relative_path);
 
-    std::future<TextureHostObject*>* getOrLoadImgAsync(const std::string & relative_path);
+    std::shared_future<TextureHostObject*> getOrLoadImgAsync(const std::string & relative_path);
 
     TextureDeviceHandle getOrLoadImgDevice(const std::string & relative_path,
                                            const std::string & encoding,
@@ -316,7 +464,13 @@ struct AssetManager
     */
     MeshHostObject* getOrLoadPBRTPLY(const std::string & relative_path);
 
-    std::future<MeshHostObject*> getOrLoadMeshAsync(const std::string & relative_path);
+    /*
+     * What every loaded mesh goes through on the loading worker: vertex cache, overdraw and vertex fetch order,
+     * the LOD chain, the meshlets and, with EDITOR_QUANTIZE_VERTICES, the quantized vertices.
+     */
+    static MeshOptimizationStatistics optimizeMesh(MeshHostObject& rawMesh, const std::vector<float>& lodErrorTargets);
+
+    std::shared_future<MeshHostObject*> getOrLoadMeshAsync(const std::string & relative_path);
 
     MeshRigidHandle getOrLoadPLYMeshDevice(const std::string & relative_path);
 
@@ -328,6 +482,15 @@ struct AssetManager
     }
     void unloadAllImg();
 
+    /*
+     * Error of each simplified level relative to the extents of the mesh, level after level.
+     * Read by the loading workers, so it has to be set before meshes are loaded.
+     */
+    void setLodErrorTargets(std::vector<float> targets)
+    {
+        lodErrorTargets = std::move(targets);
+    }
+
 private:
 
     TextureHostObject loadImg(const std::string & relative_path);
@@ -339,21 +502,28 @@ private:
     AssetCacheT<TextureHostObject> loadedImgCache;
     AssetCacheT<MeshHostObject> loadedMeshCache;
 
-    std::vector<std::pair<std::string,std::future<TextureHostObject*>>> imgLoadRequests;
-    std::vector<std::pair<std::string,std::unique_ptr<std::future<MeshHostObject*>>>> meshLoadRequests;
+    //in flight and finished loads, keyed like the caches
+    AssetCacheT<std::shared_future<TextureHostObject*>> imgLoadRequests;
+    AssetCacheT<std::shared_future<MeshHostObject*>> meshLoadRequests;
 
     std::atomic<float> _totalImgSizeKB;
-    std::mutex imgCacheLock;
-    std::mutex meshCacheLock;
 
-    std::unordered_map<std::string,std::unique_ptr<std::mutex>> meshLoadLockMap;
-    std::mutex meshLoadLockMapLock;
+    std::vector<float> lodErrorTargets{ 0.01f, 0.02f, 0.05f, 0.1f, 0.2f };
+
+    static size_t workerCount()
+    {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
 
-    std::vector<Assimp::Importer> perThreadImporter{1};
-    ThreadPool workerPool{ 1 };
+    std::vector<Assimp::Importer> perThreadImporter{ workerCount() };
+    //declared after the caches, so that workers are joined before the caches they fill are destroyed
+    ThreadPool workerPool{ workerCount() };
 
     std::vector<std::pair<std::string,MeshRigidDevice>> device_meshes;
     std::vector<std::pair<std::string,TextureDeviceObject>> device_textures;
+    //index into device_meshes/device_textures by the interned path or identifier
+    SymbolMap<uint32_t> device_mesh_lookup;
+    SymbolMap<uint32_t> device_texture_lookup;
 
     friend MeshRigidHandle;
     friend TextureDeviceHandle;
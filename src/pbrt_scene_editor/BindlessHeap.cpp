@@ -0,0 +1,156 @@
+#include "BindlessHeap.hpp"
+
+#include <array>
+#include <stdexcept>
+#include <string>
+
+#include "UploadScheduler.hpp"
+
+uint32_t BindlessHeap::IndexAllocator::allocate()
+{
+    if (!freeIndices.empty())
+    {
+        auto index = freeIndices.back();
+        freeIndices.pop_back();
+        return index;
+    }
+    if (next == capacity)
+    {
+        return INVALID_INDEX;
+    }
+    return next++;
+}
+
+void BindlessHeap::IndexAllocator::release(uint32_t index, uint64_t frame)
+{
+    retired.emplace_back(index, frame);
+}
+
+void BindlessHeap::IndexAllocator::recycle(uint64_t frame)
+{
+    while (!retired.empty() && retired.front().second < frame)
+    {
+        freeIndices.push_back(retired.front().first);
+        retired.pop_front();
+    }
+}
+
+void BindlessHeap::init(DeviceExtended* device, uint32_t framesInFlight)
+{
+    backendDevice = device;
+    this->framesInFlight = framesInFlight;
+    textures.capacity = MAX_TEXTURES;
+    materials.capacity = MAX_MATERIALS;
+
+    std::vector<vk::DescriptorSetLayoutBinding> bindings(2);
+    bindings[0].setBinding(0);
+    bindings[0].setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+    bindings[0].setDescriptorCount(MAX_TEXTURES);
+    bindings[0].setStageFlags(vk::ShaderStageFlagBits::eFragment);
+    bindings[1].setBinding(1);
+    bindings[1].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+    bindings[1].setDescriptorCount(1);
+    bindings[1].setStageFlags(vk::ShaderStageFlagBits::eFragment);
+
+    // textures are added while earlier frames still read the set, only the slots they don't use are written
+    std::vector<vk::DescriptorBindingFlags> bindingFlags{
+        vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind | vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending,
+        {} };
+    vk::DescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+    bindingFlagsInfo.setBindingFlags(bindingFlags);
+    vk::DescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.setFlags(vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool);
+    layoutInfo.setBindings(bindings);
+    layoutInfo.setPNext(&bindingFlagsInfo);
+    setLayout = backendDevice->createDescriptorSetLayout(layoutInfo);
+
+    std::array<vk::DescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].setType(vk::DescriptorType::eCombinedImageSampler);
+    poolSizes[0].setDescriptorCount(MAX_TEXTURES);
+    poolSizes[1].setType(vk::DescriptorType::eStorageBuffer);
+    poolSizes[1].setDescriptorCount(1);
+    vk::DescriptorPoolCreateInfo poolInfo{};
+    poolInfo.setFlags(vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind);
+    poolInfo.setPoolSizes(poolSizes);
+    poolInfo.setMaxSets(1);
+    pool = backendDevice->createDescriptorPool(poolInfo);
+    descriptorSet = backendDevice->allocateSingleDescriptorSet(pool, setLayout);
+    backendDevice->setObjectDebugName(descriptorSet, "BindlessHeapDescriptorSet");
+
+    auto bufferRes = backendDevice->allocateBuffer(sizeof(BindlessMaterialRecord) * MAX_MATERIALS,
+                                                   (VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT),
+                                                   VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+    if (!bufferRes.has_value())
+    {
+        throw std::runtime_error("Failed to allocate material record buffer");
+    }
+    materialBuffer = bufferRes.value();
+    backendDevice->updateDescriptorSetStorageBuffer(descriptorSet, 1, materialBuffer.buffer);
+}
+
+void BindlessHeap::destroy()
+{
+    if (backendDevice == nullptr) return;
+    backendDevice->deAllocateBuffer(materialBuffer.buffer, materialBuffer.allocation);
+    backendDevice->destroyDescriptorPool(pool);
+    backendDevice->destroyDescriptorSetLayout(setLayout);
+    backendDevice = nullptr;
+}
+
+void BindlessHeap::beginFrame()
+{
+    frameNumber++;
+    // the frames up to frameNumber - framesInFlight have finished, the slot of the last one was just waited for
+    if (frameNumber < framesInFlight) return;
+    textures.recycle(frameNumber - framesInFlight + 1);
+    materials.recycle(frameNumber - framesInFlight + 1);
+}
+
+uint32_t BindlessHeap::addTexture(vk::ImageView imageView, vk::Sampler sampler)
+{
+    auto index = textures.allocate();
+    if (index == INVALID_INDEX)
+    {
+        throw std::runtime_error("bindless heap is out of texture slots, " + std::to_string(MAX_TEXTURES) + " are in use");
+    }
+    vk::DescriptorImageInfo imgInfo{};
+    imgInfo.setImageView(imageView);
+    imgInfo.setSampler(sampler);
+    imgInfo.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+    vk::WriteDescriptorSet write{};
+    write.setDstSet(descriptorSet);
+    write.setDstBinding(0);
+    write.setDstArrayElement(index);
+    write.setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+    write.setImageInfo(imgInfo);
+    backendDevice->updateDescriptorSets(write, {});
+    return index;
+}
+
+void BindlessHeap::releaseTexture(uint32_t index)
+{
+    if (index == INVALID_INDEX) return;
+    textures.release(index, frameNumber);
+}
+
+uint32_t BindlessHeap::addMaterial(const BindlessMaterialRecord& record)
+{
+    auto index = materials.allocate();
+    if (index == INVALID_INDEX)
+    {
+        throw std::runtime_error("bindless heap is out of material slots, " + std::to_string(MAX_MATERIALS) + " are in use");
+    }
+    updateMaterial(index, record);
+    return index;
+}
+
+void BindlessHeap::updateMaterial(uint32_t index, const BindlessMaterialRecord& record)
+{
+    UploadScheduler::getInstance().stageGraphicsCopy(&record, sizeof(record), materialBuffer.buffer, sizeof(BindlessMaterialRecord) * index);
+}
+
+void BindlessHeap::releaseMaterial(uint32_t index)
+{
+    if (index == INVALID_INDEX) return;
+    materials.release(index, frameNumber);
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "VulkanExtension.h"
+#include "Singleton.h"
+
+// The Material subclasses of scene.h, MATERIAL_TYPE_* in res/shaders/built_in/bindless.glsl
+enum class BindlessMaterialType : uint32_t
+{
+    Unknown,
+    CoatedDiffuse,
+    CoatedConductor,
+    Conductor,
+    Dielectric,
+    Diffuse,
+    DiffuseTransmission,
+    Mix
+};
+
+// What the rasterizer shades with, packed from a material of the scene. MaterialRecord in bindless.glsl, std430.
+struct BindlessMaterialRecord
+{
+    // used when reflectanceTexture is INVALID_INDEX
+    glm::vec4 reflectance{ 0.5f, 0.5f, 0.5f, 1.0f };
+    BindlessMaterialType type = BindlessMaterialType::Unknown;
+    uint32_t reflectanceTexture = ~0u;
+    float roughness = 0.0f;
+    float eta = 1.5f;
+};
+static_assert(sizeof(BindlessMaterialRecord) == 32, "BindlessMaterialRecord must match MaterialRecord in bindless.glsl");
+
+/*
+ * One descriptor set holding every texture and material of the scene, bound once per pipeline layout instead of
+ * one set per batch.
+ *
+ * Binding 0 is a partially bound, update after bind array of combined image samplers, binding 1 the storage buffer
+ * of material records. Both are indexed through free lists. A released index may still be read by the frames in
+ * flight, it's only handed out again framesInFlight frames later, so its descriptor and record are never rewritten
+ * under the GPU. Only the main thread touches the heap.
+ */
+struct BindlessHeap : Singleton<BindlessHeap>
+{
+    static constexpr uint32_t MAX_TEXTURES = 4096;
+    static constexpr uint32_t MAX_MATERIALS = 4096;
+    static constexpr uint32_t INVALID_INDEX = ~0u;
+
+    void init(DeviceExtended* device, uint32_t framesInFlight);
+
+    // Device must be idle
+    void destroy();
+
+    // Call once per frame, after waiting for the frame slot about to be recorded
+    void beginFrame();
+
+    uint32_t addTexture(vk::ImageView imageView, vk::Sampler sampler);
+    void releaseTexture(uint32_t index);
+
+    // The record reaches the GPU through a staged copy executed before the next frame
+    uint32_t addMaterial(const BindlessMaterialRecord& record);
+    void updateMaterial(uint32_t index, const BindlessMaterialRecord& record);
+    void releaseMaterial(uint32_t index);
+
+    vk::DescriptorSetLayout getSetLayout() const
+    {
+        return setLayout;
+    }
+
+    vk::DescriptorSet getDescriptorSet() const
+    {
+        return descriptorSet;
+    }
+
+private:
+    struct IndexAllocator
+    {
+        uint32_t capacity = 0;
+        uint32_t next = 0;
+        std::vector<uint32_t> freeIndices;
+        // index and the frame it was released in
+        std::deque<std::pair<uint32_t, uint64_t>> retired;
+
+        uint32_t allocate();
+        void release(uint32_t index, uint64_t frame);
+        // hand the indices released before frame out again
+        void recycle(uint64_t frame);
+    };
+
+    DeviceExtended* backendDevice = nullptr;
+    uint32_t framesInFlight = 1;
+    uint64_t frameNumber = 0;
+
+    vk::DescriptorSetLayout setLayout = VK_NULL_HANDLE;
+    vk::DescriptorPool pool = VK_NULL_HANDLE;
+    vk::DescriptorSet descriptorSet = VK_NULL_HANDLE;
+    VMABuffer materialBuffer{};
+
+    IndexAllocator textures;
+    IndexAllocator materials;
+};
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+*  32 bit handle into a ChunkedArena, 24 bits of slot index and 8 bits of generation.
+*  The generation of a slot is bumped when its object is destroyed, so a stale handle resolves to nullptr
+*  instead of to the object that reused the slot. A slot is reused at most 255 times, see ChunkedArena::destroy().
+*/
+template<class T>
+struct ArenaHandle
+{
+	static constexpr uint32_t INDEX_BITS = 24;
+	static constexpr uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+	static constexpr uint32_t INVALID = ~0u;
+
+	uint32_t value = INVALID;
+
+	ArenaHandle() = default;
+	ArenaHandle(uint32_t index, uint8_t generation) : value(index | (static_cast<uint32_t>(generation) << INDEX_BITS)) {}
+
+	uint32_t index() const { return value & INDEX_MASK; }
+	uint8_t generation() const { return static_cast<uint8_t>(value >> INDEX_BITS); }
+
+	explicit operator bool() const { return value != INVALID; }
+	bool operator==(const ArenaHandle& other) const { return value == other.value; }
+	bool operator!=(const ArenaHandle& other) const { return value != other.value; }
+};
+
+template<class T>
+struct ArenaHandleHash
+{
+	size_t operator()(const ArenaHandle<T>& handle) const { return std::hash<uint32_t>{}(handle.value); }
+};
+
+// Offset and length of a contiguous run in a pool vector
+struct PoolRange
+{
+	uint32_t offset = 0;
+	uint32_t count = 0;
+};
+
+// Non-owning view of a PoolRange, invalidated when the pool grows
+template<class T>
+struct PoolSpan
+{
+	T* first = nullptr;
+	size_t count = 0;
+
+	T* begin() const { return first; }
+	T* end() const { return first + count; }
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	T& operator[](size_t i) const { return first[i]; }
+};
+
+template<class T, class Pool>
+PoolSpan<T> spanOf(Pool& pool, PoolRange range)
+{
+	return { pool.data() + range.offset, range.count };
+}
+
+// Append items to pool as one contiguous range
+template<class T>
+PoolRange appendToPool(std::vector<T>& pool, const std::vector<T>& items)
+{
+	PoolRange range{ static_cast<uint32_t>(pool.size()), static_cast<uint32_t>(items.size()) };
+	pool.insert(pool.end(), items.begin(), items.end());
+	return range;
+}
+
+/*
+*  Objects stored in fixed size chunks, addressed by ArenaHandle.
+*  Objects never move, pointers stay valid until the object is destroyed. Freed slots are reused.
+*  clear() frees the storage one chunk at a time, but it still runs the destructor of every live object
+*  unless T is trivially destructible.
+*/
+template<class T, uint32_t ChunkShift = 12>
+class ChunkedArena
+{
+public:
+	using Handle = ArenaHandle<T>;
+	static constexpr uint32_t CHUNK_SIZE = 1u << ChunkShift;
+
+	ChunkedArena() = default;
+	ChunkedArena(const ChunkedArena&) = delete;
+	ChunkedArena& operator=(const ChunkedArena&) = delete;
+
+	~ChunkedArena()
+	{
+		clear();
+	}
+
+	// A throwing constructor leaves the arena as it was, the slot is only taken once the object exists
+	template<class... Args>
+	Handle create(Args&&... args)
+	{
+		uint32_t index;
+		if (!freeSlots.empty())
+		{
+			index = freeSlots.back();
+			new (storageAt(index)) T(std::forward<Args>(args)...);
+			freeSlots.pop_back();
+		}
+		else
+		{
+			index = static_cast<uint32_t>(generations.size());
+			// the last index is kept out so that no live handle can equal INVALID
+			if (index >= Handle::INDEX_MASK)
+				throw std::runtime_error("arena is full");
+			// a chunk left empty by a throwing constructor is used by the next create()
+			if ((index >> ChunkShift) == chunks.size())
+				chunks.emplace_back(new Slot[CHUNK_SIZE]);
+			new (storageAt(index)) T(std::forward<Args>(args)...);
+			try
+			{
+				generations.push_back(0);
+				alive.push_back(false);
+			}
+			catch (...)
+			{
+				slotAt(index)->~T();
+				generations.resize(index);
+				throw;
+			}
+		}
+		alive[index] = true;
+		liveCount++;
+		return Handle(index, generations[index]);
+	}
+
+	void destroy(Handle handle)
+	{
+		T* object = get(handle);
+		if (object == nullptr)
+			return;
+		object->~T();
+		auto index = handle.index();
+		alive[index] = false;
+		// a slot whose generation wrapped is retired, otherwise a handle 256 reuses old would resolve again
+		if (++generations[index] != 0)
+			freeSlots.push_back(index);
+		liveCount--;
+	}
+
+	// nullptr for invalid, destroyed or reused handles
+	T* get(Handle handle) const
+	{
+		auto index = handle.index();
+		if (!handle || index >= generations.size() || !alive[index] || generations[index] != handle.generation())
+			return nullptr;
+		return slotAt(index);
+	}
+
+	size_t size() const
+	{
+		return liveCount;
+	}
+
+	template<class F>
+	void forEach(F&& f) const
+	{
+		for (uint32_t index = 0; index < generations.size(); index++)
+		{
+			if (alive[index])
+				f(Handle(index, generations[index]), *slotAt(index));
+		}
+	}
+
+	// Handles taken before clear() must not be used afterwards, generations start over
+	void clear()
+	{
+		if constexpr (!std::is_trivially_destructible_v<T>)
+		{
+			for (uint32_t index = 0; index < generations.size(); index++)
+			{
+				if (alive[index])
+					slotAt(index)->~T();
+			}
+		}
+		chunks.clear();
+		generations.clear();
+		alive.clear();
+		freeSlots.clear();
+		liveCount = 0;
+	}
+
+private:
+	struct alignas(T) Slot
+	{
+		std::byte storage[sizeof(T)];
+	};
+
+	void* storageAt(uint32_t index) const
+	{
+		return chunks[index >> ChunkShift][index & (CHUNK_SIZE - 1)].storage;
+	}
+
+	T* slotAt(uint32_t index) const
+	{
+		return std::launder(reinterpret_cast<T*>(storageAt(index)));
+	}
+
+	std::vector<std::unique_ptr<Slot[]>> chunks;
+	std::vector<uint8_t> generations;
+	std::vector<bool> alive;
+	std::vector<uint32_t> freeSlots;
+	size_t liveCount = 0;
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "Meshlet.hpp"
+
+/*
+*  Data shared by the cluster culling of ClusterCullPass and of the mesh shading path of GBufferPass, and their shaders.
+*  Clusters are only tested for the instances InstanceCullPass kept in the visible list.
+*/
+namespace renderScene {
+
+    // A batch only takes the cluster path while all its instance and meshlet pairs fit, otherwise it's drawn per instance
+    static constexpr uint32_t MAX_CLUSTER_DRAWS = 1u << 18;
+
+    // Written by clusterCull.comp, the commands follow the count and are drawn with drawIndexedIndirectCount
+    struct ClusterDrawCommands
+    {
+        uint32_t drawCount;
+        uint32_t padding[3];
+
+        static constexpr vk::DeviceSize countOffset() { return 0; }
+        static constexpr vk::DeviceSize commandsOffset() { return 16; }
+        static constexpr vk::DeviceSize size(uint32_t capacity) { return commandsOffset() + capacity * sizeof(VkDrawIndexedIndirectCommand); }
+    };
+
+    struct ClusterCullPushConstants
+    {
+        uint32_t meshletCount;
+        uint32_t drawCapacity;
+        // non zero when back facing clusters are dropped, only valid for single sided geometry
+        uint32_t coneCulling;
+        uint32_t padding;
+    };
+
+    // Task and mesh stages of the mesh shading path, after the two uvec4 GBufferPass pushes to the fragment stage
+    struct ClusterMeshPushConstants
+    {
+        uint32_t meshletCount;
+        uint32_t coneCulling;
+        // in 4 byte words, -1 for missing attributes
+        uint32_t vertexStride;
+        int32_t normalOffset;
+        int32_t tangentOffset;
+        int32_t biTangentOffset;
+        int32_t uvOffset;
+        uint32_t padding;
+
+        static constexpr uint32_t offset() { return 32; }
+    };
+
+    // Left, right, bottom, top, near and far, normalized, pointing inside. Clip z is kept in [0, w] like the rasterizer does.
+    inline std::array<glm::vec4, 6> frustumPlanes(const glm::mat4& viewProj)
+    {
+        auto row = [&viewProj](int i) { return glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]); };
+        std::array<glm::vec4, 6> planes{ row(3) + row(0), row(3) - row(0), row(3) + row(1), row(3) - row(1), row(2), row(3) - row(2) };
+        for (auto& plane : planes)
+        {
+            plane /= glm::length(glm::vec3(plane));
+        }
+        return planes;
+    }
+
+    /*
+     * Reference of the cluster test of clusterCull.comp and clusterCull.task, all must implement the same test.
+     * The sphere is scaled by the largest axis of model. The cone is skipped for non uniformly scaled instances,
+     * mirroring transforms flip it.
+     */
+    inline bool isClusterVisible(const std::array<glm::vec4, 6>& planes, const glm::mat4& model, const glm::vec3& eye,
+                                 const Meshlet& meshlet, bool coneCulling)
+    {
+        glm::vec3 scale{ glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])) };
+        float maxScale = std::max(scale.x, std::max(scale.y, scale.z));
+        float minScale = std::min(scale.x, std::min(scale.y, scale.z));
+        glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(meshlet.sphere), 1.0f));
+        float radius = meshlet.sphere.w * maxScale;
+        for (const auto& plane : planes)
+        {
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+                return false;
+        }
+
+        if (coneCulling && meshlet.coneAxisCutoff.w < 1.0f && maxScale - minScale <= 1e-3f * maxScale)
+        {
+            glm::vec3 apex = glm::vec3(model * glm::vec4(glm::vec3(meshlet.coneApex), 1.0f));
+            float handedness = glm::determinant(glm::mat3(model)) < 0.0f ? -1.0f : 1.0f;
+            glm::vec3 axis = handedness * glm::normalize(glm::mat3(model) * glm::vec3(meshlet.coneAxisCutoff));
+            if (glm::dot(glm::normalize(apex - eye), axis) >= meshlet.coneAxisCutoff.w)
+                return false;
+        }
+        return true;
+    }
+
+    // (instance, meshlet) pairs kept for the visible instances in ascending order, the GPU writes the same set in any order
+    template<class PerInstDataT>
+    std::vector<std::pair<uint32_t, uint32_t>> cullClustersCPU(const glm::mat4& viewProj, const glm::vec3& eye,
+                                                              const std::vector<PerInstDataT>& perInstanceData,
+                                                              const std::vector<uint32_t>& visibleInstances,
+                                                              const std::vector<Meshlet>& meshlets, bool coneCulling)
+    {
+        auto planes = frustumPlanes(viewProj);
+        std::vector<std::pair<uint32_t, uint32_t>> visible;
+        for (auto instance : visibleInstances)
+        {
+            for (uint32_t i = 0; i < meshlets.size(); i++)
+            {
+                if (isClusterVisible(planes, perInstanceData[instance]._wTransform, eye, meshlets[i], coneCulling))
+                    visible.emplace_back(instance, i);
+            }
+        }
+        std::sort(visible.begin(), visible.end());
+        return visible;
+    }
+}
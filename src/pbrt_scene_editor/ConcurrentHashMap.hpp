@@ -0,0 +1,100 @@
+#pragma once
+
+#include <array>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+/*
+*  Hash map split in independently locked shards, so threads working on different keys rarely contend.
+*  Values are never moved once inserted, pointers to them stay valid until clear().
+*/
+template<class Key, class Value, class Hash = std::hash<Key>, size_t ShardCount = 32>
+class ConcurrentHashMap
+{
+public:
+	Value* find(const Key& key)
+	{
+		auto& shard = shardOf(key);
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		auto it = shard.map.find(key);
+		return it == shard.map.end() ? nullptr : &it->second;
+	}
+
+	// Insert value unless key is present. Returns the stored value and whether it was inserted.
+	template<class V>
+	std::pair<Value*, bool> emplace(const Key& key, V&& value)
+	{
+		auto& shard = shardOf(key);
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		auto [it, inserted] = shard.map.emplace(key, std::forward<V>(value));
+		return { &it->second, inserted };
+	}
+
+	/*
+	*  Return the value of key, creating it with make() when absent.
+	*  make() runs under the shard lock, so it is called exactly once per key and must be cheap.
+	*/
+	template<class F>
+	std::pair<Value*, bool> findOrEmplace(const Key& key, F&& make)
+	{
+		auto& shard = shardOf(key);
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		auto it = shard.map.find(key);
+		if (it != shard.map.end())
+			return { &it->second, false };
+		it = shard.map.emplace(key, make()).first;
+		return { &it->second, true };
+	}
+
+	size_t size()
+	{
+		size_t total = 0;
+		for (auto& shard : shards)
+		{
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			total += shard.map.size();
+		}
+		return total;
+	}
+
+	// fn(key, value) for every entry, shard by shard under its lock
+	template<class F>
+	void forEach(F&& fn)
+	{
+		for (auto& shard : shards)
+		{
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			for (auto& [key, value] : shard.map)
+				fn(key, value);
+		}
+	}
+
+	void clear()
+	{
+		for (auto& shard : shards)
+		{
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			shard.map.clear();
+		}
+	}
+
+private:
+	struct alignas(64) Shard
+	{
+		std::mutex mutex;
+		std::unordered_map<Key, Value, Hash> map;
+	};
+
+	Shard& shardOf(const Key& key)
+	{
+		// mix the hash, std::hash of integers is the identity
+		size_t h = Hash{}(key);
+		h ^= h >> 17;
+		h *= static_cast<size_t>(0x9E3779B97F4A7C15ull);
+		return shards[(h >> (sizeof(size_t) * 4)) % ShardCount];
+	}
+
+	std::array<Shard, ShardCount> shards;
+};
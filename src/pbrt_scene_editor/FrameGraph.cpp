@@ -1,20 +1,64 @@
 #include "FrameGraph.hpp"
 #include "GPUPass.h"
 #include "GPUFrame.hpp"
+#include "GlobalLogger.h"
 
-void FrameGraphTextureDescription::resolveBarriers(GPUFrame* frame)
+static bool isWriteAccess(const FrameGraphResourceAccess::Access& accessType)
 {
-    std::vector<FrameGraphResourceAccessInfo> activeAccessList;
-    activeAccessList.reserve(accessList.size());
-    for (const auto& access : accessList)
+    return !std::holds_alternative<FrameGraphResourceAccess::Read>(accessType) && !std::holds_alternative<FrameGraphResourceAccess::Sample>(accessType);
+}
+
+static constexpr vk::AccessFlags2 writeAccessMask = vk::AccessFlagBits2::eShaderWrite | vk::AccessFlagBits2::eShaderStorageWrite |
+    vk::AccessFlagBits2::eColorAttachmentWrite | vk::AccessFlagBits2::eDepthStencilAttachmentWrite |
+    vk::AccessFlagBits2::eTransferWrite | vk::AccessFlagBits2::eHostWrite | vk::AccessFlagBits2::eMemoryWrite;
+
+/*
+ * What a resource went through since it was last written, along the active accesses of a frame. A write or a layout
+ * transition waits for the last write and every read since, a read waits for the last write unless a barrier already
+ * made it visible to its stage.
+ */
+struct ResourceHazardState
+{
+    vk::PipelineStageFlags2 writeStage = vk::PipelineStageFlagBits2::eNone;
+    vk::AccessFlags2 writeAccess = vk::AccessFlagBits2::eNone;
+    vk::PipelineStageFlags2 readStages = vk::PipelineStageFlagBits2::eNone;
+    vk::PipelineStageFlags2 visibleStages = vk::PipelineStageFlagBits2::eNone;
+
+    // Fills the source of the barrier the access needs, false when it needs none
+    bool access(vk::PipelineStageFlags2 stage, vk::AccessFlags2 access, bool writes, bool transitions,
+        vk::PipelineStageFlags2& srcStage, vk::AccessFlags2& srcAccess)
     {
-        if (access.pass->is_enabled())
+        if (writes || transitions)
         {
-            activeAccessList.push_back(access);
+            srcStage = writeStage | readStages;
+            srcAccess = writeAccess;
+            // a layout transition writes the image too, what comes after waits for the stage of this access
+            writeStage = stage;
+            writeAccess = writes ? access & writeAccessMask : vk::AccessFlagBits2::eNone;
+            readStages = writes ? vk::PipelineStageFlagBits2::eNone : stage;
+            visibleStages = writes ? vk::PipelineStageFlagBits2::eNone : stage;
+            return true;
         }
+        readStages |= stage;
+        if (writeStage != vk::PipelineStageFlagBits2::eNone && (stage & ~visibleStages))
+        {
+            srcStage = writeStage;
+            srcAccess = writeAccess;
+            visibleStages |= stage;
+            return true;
+        }
+        return false;
+    }
+};
+
+void FrameGraphTextureDescription::planBarriers(GPUFrame* frame, FrameGraphBarrierPlanBuilder& builder)
+{
+    auto firstActive = std::find_if(accessList.begin(), accessList.end(), [](const auto& access) { return access.pass->is_active(); });
+    if (firstActive == accessList.end())
+    {
+        return;
     }
 
-    // For the pass who firstly touches an image, we don't need sync but we may need to transition the layout
     auto * trackedImage = frame->getBackingTrackedImage(name);
     vk::ImageMemoryBarrier2 imb{};
     imb.setImage(trackedImage->image);
@@ -33,83 +77,51 @@ void FrameGraphTextureDescription::resolveBarriers(GPUFrame* frame)
     imb.setSubresourceRange(subresourceRange);
     imb.setSrcQueueFamilyIndex(vk::QueueFamilyIgnored);
     imb.setDstQueueFamilyIndex(vk::QueueFamilyIgnored);
-    imb.setSrcAccessMask(trackedImage->lastAccess);
-    imb.setSrcStageMask(trackedImage->lastStage);
-    imb.setOldLayout(trackedImage->lastLayout);
-    activeAccessList[0].pass->fillImgBarrierInfo(activeAccessList[0].accessType, this, imb.dstStageMask, imb.dstAccessMask, imb.newLayout);
-    if (allow_process_in_flight)
-    {
-        // todo : Assumption : for in_flight_image, we don't need to add execution barrier
-        imb.setSrcAccessMask(vk::AccessFlagBits2::eNone);
-        imb.setSrcStageMask(vk::PipelineStageFlagBits2::eNone);
-    }
-    activeAccessList[0].pass->transientImageMemoryBarriers.emplace_back(imb);
-
-    for (int i = 1; i < activeAccessList.size(); i++)
-    {
-        auto preAccessType = activeAccessList[i - 1].accessType;
-        auto postAccessType = activeAccessList[i].accessType;
-
-        bool has_hazard = false;
-
-        has_hazard |= (std::holds_alternative<FrameGraphResourceAccess::Read>(preAccessType) && std::holds_alternative<FrameGraphResourceAccess::Write>(postAccessType));
-        has_hazard |= (std::holds_alternative<FrameGraphResourceAccess::Read>(preAccessType) && std::holds_alternative<FrameGraphResourceAccess::RenderTarget>(postAccessType));
-        has_hazard |= (std::holds_alternative<FrameGraphResourceAccess::Read>(preAccessType) && std::holds_alternative<FrameGraphResourceAccess::Sample>(postAccessType)); // layout transition need
 
-        has_hazard |= (std::holds_alternative<FrameGraphResourceAccess::Sample>(preAccessType) && std::holds_alternative<FrameGraphResourceAccess::Write>(postAccessType));
-        has_hazard |= (std::holds_alternative<FrameGraphResourceAccess::Sample>(preAccessType) && std::holds_alternative<FrameGraphResourceAccess::RenderTarget>(postAccessType));
-        has_hazard |= (std::holds_alternative<FrameGraphResourceAccess::Sample>(preAccessType) && std::holds_alternative<FrameGraphResourceAccess::Read>(postAccessType)); // layout transition need
+    // For the pass who firstly touches an image, the source is what the previous frames left, patched by FrameGraph::buildBarriers
+    ResourceHazardState state;
+    firstActive->pass->fillImgBarrierInfo(firstActive->accessType, this, imb.dstStageMask, imb.dstAccessMask, imb.newLayout);
+    state.access(imb.dstStageMask, imb.dstAccessMask, isWriteAccess(firstActive->accessType), true, imb.srcStageMask, imb.srcAccessMask);
+    builder.addFirstImageBarrier(firstActive->pass->passIdx, imb, this, trackedImage);
 
-        has_hazard |= (std::holds_alternative<FrameGraphResourceAccess::Write>(preAccessType) && std::holds_alternative<FrameGraphResourceAccess::Write>(postAccessType));
-        has_hazard |= (std::holds_alternative<FrameGraphResourceAccess::Write>(preAccessType) && std::holds_alternative<FrameGraphResourceAccess::RenderTarget>(postAccessType));
-        has_hazard |= (std::holds_alternative<FrameGraphResourceAccess::Write>(preAccessType) && std::holds_alternative<FrameGraphResourceAccess::Read>(postAccessType));
-        has_hazard |= (std::holds_alternative<FrameGraphResourceAccess::Write>(preAccessType) && std::holds_alternative<FrameGraphResourceAccess::Sample>(postAccessType));
-
-        has_hazard |= (std::holds_alternative<FrameGraphResourceAccess::RenderTarget>(preAccessType) && std::holds_alternative<FrameGraphResourceAccess::Write>(postAccessType));
-        has_hazard |= (std::holds_alternative<FrameGraphResourceAccess::RenderTarget>(preAccessType) && std::holds_alternative<FrameGraphResourceAccess::RenderTarget>(postAccessType));
-        has_hazard |= (std::holds_alternative<FrameGraphResourceAccess::RenderTarget>(preAccessType) && std::holds_alternative<FrameGraphResourceAccess::Read>(postAccessType));
-        has_hazard |= (std::holds_alternative<FrameGraphResourceAccess::RenderTarget>(preAccessType) && std::holds_alternative<FrameGraphResourceAccess::Sample>(postAccessType));
-
-        if (has_hazard)
+    auto layout = imb.newLayout;
+    for (auto it = firstActive + 1; it != accessList.end(); ++it)
+    {
+        if (!it->pass->is_active())
+        {
+            continue;
+        }
+        it->pass->fillImgBarrierInfo(it->accessType, this, imb.dstStageMask, imb.dstAccessMask, imb.newLayout);
+        if (state.access(imb.dstStageMask, imb.dstAccessMask, isWriteAccess(it->accessType), imb.newLayout != layout, imb.srcStageMask, imb.srcAccessMask))
         {
-            activeAccessList[i - 1].pass->fillImgBarrierInfo(preAccessType, this, imb.srcStageMask, imb.srcAccessMask, imb.oldLayout);
-            activeAccessList[i].pass->fillImgBarrierInfo(postAccessType, this, imb.dstStageMask, imb.dstAccessMask, imb.newLayout);
-            activeAccessList[i].pass->transientImageMemoryBarriers.emplace_back(imb);
+            imb.setOldLayout(layout);
+            builder.addImageBarrier(it->pass->passIdx, imb);
         }
+        layout = imb.newLayout;
     }
-    // update the last access information for texture
-    activeAccessList.back().pass->fillImgBarrierInfo(activeAccessList.back().accessType, this, imb.dstStageMask, imb.dstAccessMask, imb.newLayout);
-    trackedImage->lastAccess = imb.dstAccessMask;
-    trackedImage->lastStage = imb.dstStageMask;
-    trackedImage->lastLayout = imb.newLayout;
+    // the last access information for texture, where the next frame starts from
+    builder.setFinalAccess(trackedImage, state.writeAccess, state.writeStage | state.readStages, layout);
 }
 
-void FrameGraphBufferDescription::resolveBarriers(GPUFrame* frame)
+void FrameGraphBufferDescription::planBarriers(GPUFrame* frame, FrameGraphBarrierPlanBuilder& builder)
 {
-    std::vector<FrameGraphResourceAccessInfo> activeAccessList;
-    activeAccessList.reserve(accessList.size());
+    ResourceHazardState state;
     for (const auto& access : accessList)
     {
-        if (access.pass->is_enabled())
+        if (!access.pass->is_active())
         {
-            activeAccessList.push_back(access);
+            continue;
         }
-    }
-    for (int i = 1; i < activeAccessList.size(); i++)
-    {
-        auto preAccessType = activeAccessList[i - 1].accessType;
-        auto postAccessType = activeAccessList[i].accessType;
-
-        bool has_hazard = false;
-
-        has_hazard |= (std::holds_alternative<FrameGraphResourceAccess::Read>(preAccessType) && std::holds_alternative<FrameGraphResourceAccess::Write>(postAccessType));
-
-        has_hazard |= (std::holds_alternative<FrameGraphResourceAccess::Write>(preAccessType) && std::holds_alternative<FrameGraphResourceAccess::Write>(postAccessType));
-        has_hazard |= (std::holds_alternative<FrameGraphResourceAccess::Write>(preAccessType) && std::holds_alternative<FrameGraphResourceAccess::Read>(postAccessType));
-
-        if (has_hazard)
+        vk::MemoryBarrier2 barrier{};
+        if (!access.pass->fillMemBarrierInfo(access.accessType, this, barrier))
         {
-
+            continue;
+        }
+        bool needsBarrier = state.access(barrier.dstStageMask, barrier.dstAccessMask, isWriteAccess(access.accessType), false, barrier.srcStageMask, barrier.srcAccessMask);
+        // nothing before the first access of the frame
+        if (needsBarrier && barrier.srcStageMask != vk::PipelineStageFlagBits2::eNone)
+        {
+            builder.addMemoryBarrier(access.pass->passIdx, barrier);
         }
     }
 }
@@ -169,12 +181,14 @@ void FrameGraph::enablePass(const std::string& passName)
 
 void FrameGraph::executePass(std::unique_ptr<GPUPass>&& pass)
 {
+    pass->passIdx = static_cast<int>(_allPasses.size());
     _allPasses.emplace_back(std::move(pass));
 }
 
 void FrameGraph::executeWhen(const std::function<bool(void)>& cond, std::unique_ptr<GPUPass>&& pass)
 {
     pass->enableCond = cond;
+    pass->passIdx = static_cast<int>(_allPasses.size());
     _allPasses.emplace_back(std::move(pass));
 }
 
@@ -196,6 +210,21 @@ FrameGraphTextureDescription* FrameGraph::createOrGetPersistentTexture(const std
     return tex_ptr;
 }
 
+FrameGraphBufferDescription* FrameGraph::createOrGetBuffer(const std::string& name)
+{
+    for (auto& buffer : bufferDescriptions)
+    {
+        if (buffer->name == name)
+        {
+            return buffer.get();
+        }
+    }
+    auto buf = std::make_unique<FrameGraphBuffer>(name);
+    auto* buf_ptr = buf.get();
+    bufferDescriptions.emplace_back(std::move(buf));
+    return buf_ptr;
+}
+
 FrameGraphConditionalVariable::BoolVariabel FrameGraph::createOrGetBoolVariable(const std::string& name, bool intial_state)
 {
     FrameGraphConditionalVariable::BoolVariabel bv;
@@ -212,13 +241,95 @@ FrameGraphConditionalVariable::SwitchVariable FrameGraph::createOrGetSwitchVaria
     return switchVariables[name];
 }
 
+std::vector<FrameGraphResourceDescriptionBase*> FrameGraph::getAllResources() const
+{
+    std::vector<FrameGraphResourceDescriptionBase*> resources;
+    resources.reserve(textureDescriptions.size() + 1 + bufferDescriptions.size());
+    for (const auto& texture : textureDescriptions)
+    {
+        resources.push_back(texture.get());
+    }
+    resources.push_back(presentTextureDesc.get());
+    for (const auto& buffer : bufferDescriptions)
+    {
+        resources.push_back(buffer.get());
+    }
+    return resources;
+}
+
 void FrameGraph::compileAOT(FrameCoordinator* coordinator)
 {
-    sortedIndices.reserve(_allPasses.size());
-    for (int i = 0; i < _allPasses.size(); i++)
+    // the barrier plans are keyed by the set of active passes
+    if (_allPasses.size() > 64)
+    {
+        throw std::runtime_error("frame graph supports at most 64 passes, " + std::to_string(_allPasses.size()) + " were registered");
+    }
+
+    auto resources = getAllResources();
+    schedulingResources.clear();
+    schedulingResources.reserve(resources.size());
+    for (auto* resource : resources)
+    {
+        FrameGraphScheduling::Resource schedulingResource;
+        schedulingResource.keepsContent = resource->is_persistent;
+        schedulingResource.isOutput = resource == presentTextureDesc.get();
+        for (const auto& access : resource->accessList)
+        {
+            FrameGraphScheduling::ResourceUse use{ access.pass->passIdx, false, false, false };
+            std::visit([&](auto&& accessType) {
+                using T = std::decay_t<decltype(accessType)>;
+                if constexpr (std::is_same_v<T, FrameGraphResourceAccess::Init>) {
+                    use.writes = true;
+                    use.overwrites = true;
+                }
+                else if constexpr (std::is_same_v<T, FrameGraphResourceAccess::Write>) {
+                    use.writes = true;
+                }
+                else if constexpr (std::is_same_v<T, FrameGraphResourceAccess::RenderTarget>) {
+                    use.writes = true;
+                    use.reads = accessType.loadOp == vk::AttachmentLoadOp::eLoad;
+                    use.overwrites = !use.reads;
+                }
+                else {
+                    use.reads = true;
+                }
+                }, access.accessType);
+            schedulingResource.uses.push_back(use);
+        }
+        // the accesses are declared per pass, the passes registered in order
+        std::stable_sort(schedulingResource.uses.begin(), schedulingResource.uses.end(), [](const auto& a, const auto& b) { return a.pass < b.pass; });
+        schedulingResources.push_back(std::move(schedulingResource));
+    }
+
+    sortedIndices = FrameGraphScheduling::topologicalOrder(_allPasses.size(), schedulingResources);
+
+    // the barriers are resolved along the access lists, they have to follow the execution order
+    std::vector<int> positions(_allPasses.size());
+    for (int position = 0; position < sortedIndices.size(); position++)
+    {
+        positions[sortedIndices[position]] = position;
+    }
+    for (auto* resource : resources)
+    {
+        std::stable_sort(resource->accessList.begin(), resource->accessList.end(), [&](const auto& a, const auto& b) {
+            return positions[a.pass->passIdx] < positions[b.pass->passIdx];
+        });
+    }
+
+    // Lifetimes cover every pass whatever its condition, so the textures sharing memory never meet at run time
+    auto lifetimes = FrameGraphScheduling::lifetimes(sortedIndices, schedulingResources);
+    std::vector<FrameGraphTextureDescription*> transientTextures;
+    std::vector<FrameGraphScheduling::Lifetime> transientLifetimes;
+    for (int i = 0; i < textureDescriptions.size(); i++)
     {
-        sortedIndices.push_back(i);
+        auto* texture = textureDescriptions[i].get();
+        if (!texture->is_persistent && !texture->allow_process_in_flight && lifetimes[i].first >= 0)
+        {
+            transientTextures.push_back(texture);
+            transientLifetimes.push_back(lifetimes[i]);
+        }
     }
+    coordinator->createTransientBackingImages(std::move(transientTextures), std::move(transientLifetimes));
 
     // allocate resource ahead of time
     for (const auto& texture : textureDescriptions)
@@ -260,21 +371,152 @@ void FrameGraph::compileAOT(FrameCoordinator* coordinator)
     }
 
     coordinator->prepareDescriptorSetsAOT();
+
+    compileBarrierPlans(coordinator);
 }
 
-void FrameGraph::buildBarriers(GPUFrame* frame)
+void FrameGraph::cullPasses()
 {
-    for (auto& texture : textureDescriptions)
+    std::vector<bool> enabled(_allPasses.size());
+    for (int i = 0; i < _allPasses.size(); i++)
     {
-        texture->resolveBarriers(frame);
+        _allPasses[i]->is_culled = false;
+        enabled[i] = _allPasses[i]->is_enabled();
     }
+    auto live = FrameGraphScheduling::livePasses(sortedIndices, enabled, schedulingResources);
+    for (int i = 0; i < _allPasses.size(); i++)
+    {
+        _allPasses[i]->is_culled = enabled[i] && !live[i];
+    }
+}
 
-    for (auto& buffer : bufferDescriptions)
+FrameGraphBarrierPlan& FrameGraph::getOrBuildBarrierPlan(GPUFrame* frame)
+{
+    uint64_t activePasses = 0;
+    for (int i = 0; i < _allPasses.size(); i++)
     {
-        buffer->resolveBarriers(frame);
+        if (_allPasses[i]->is_active())
+        {
+            activePasses |= uint64_t(1) << i;
+        }
+    }
+    auto plan = frame->barrierPlans.find(activePasses);
+    if (plan != frame->barrierPlans.end())
+    {
+        return plan->second;
+    }
+
+    FrameGraphBarrierPlanBuilder builder(_allPasses.size());
+    for (auto* resource : getAllResources())
+    {
+        resource->planBarriers(frame, builder);
+    }
+    return frame->barrierPlans.emplace(activePasses, builder.build()).first->second;
+}
+
+void FrameGraph::compileBarrierPlans(FrameCoordinator* coordinator)
+{
+    for (auto frame : coordinator->inFlightframes)
+    {
+        frame->barrierPlans.clear();
+        frame->currentBarrierPlan = nullptr;
     }
 
-    presentTextureDesc->resolveBarriers(frame);
+    // a switch may also hold a case no condition tests, "" stands for all of them
+    std::vector<bool*> bools;
+    std::vector<std::pair<std::string*, std::vector<std::string>>> switches;
+    size_t combinations = 1;
+    for (auto& [name, variable] : boolVariables)
+    {
+        bools.push_back(variable.val);
+        combinations *= 2;
+    }
+    for (auto& [name, variable] : switchVariables)
+    {
+        auto cases = *variable.cases;
+        cases.emplace_back();
+        combinations *= cases.size();
+        switches.emplace_back(variable.val, std::move(cases));
+    }
+    if (combinations > maxPrecompiledBarrierPlans)
+    {
+        GlobalLogger::getInstance().warn("frame graph has " + std::to_string(combinations) + " condition combinations, barrier plans are built when first used");
+        return;
+    }
+
+    std::vector<bool> boolValues;
+    for (auto* val : bools)
+    {
+        boolValues.push_back(*val);
+    }
+    std::vector<std::string> switchValues;
+    for (const auto& [val, cases] : switches)
+    {
+        switchValues.push_back(*val);
+    }
+
+    for (size_t combination = 0; combination < combinations; combination++)
+    {
+        size_t digits = combination;
+        for (auto* val : bools)
+        {
+            *val = digits % 2 == 1;
+            digits /= 2;
+        }
+        for (auto& [val, cases] : switches)
+        {
+            *val = cases[digits % cases.size()];
+            digits /= cases.size();
+        }
+        cullPasses();
+        for (auto frame : coordinator->inFlightframes)
+        {
+            getOrBuildBarrierPlan(frame);
+        }
+    }
+
+    for (int i = 0; i < bools.size(); i++)
+    {
+        *bools[i] = boolValues[i];
+    }
+    for (int i = 0; i < switches.size(); i++)
+    {
+        *switches[i].first = switchValues[i];
+    }
+}
+
+void FrameGraph::buildBarriers(GPUFrame* frame)
+{
+    cullPasses();
+
+    auto& plan = getOrBuildBarrierPlan(frame);
+    for (const auto& first : plan.firstAccesses)
+    {
+        auto& imb = plan.imageBarriers[first.imageBarrier];
+        imb.setSrcAccessMask(first.trackedImage->lastAccess);
+        imb.setSrcStageMask(first.trackedImage->lastStage);
+        imb.setOldLayout(first.trackedImage->lastLayout);
+        if (first.texture->allow_process_in_flight)
+        {
+            // todo : Assumption : for in_flight_image, we don't need to add execution barrier
+            imb.setSrcAccessMask(vk::AccessFlagBits2::eNone);
+            imb.setSrcStageMask(vk::PipelineStageFlagBits2::eNone);
+        }
+        if (first.texture->is_aliased)
+        {
+            // the memory was last used by another texture, whatever touched it has to be done and the content is lost
+            imb.setSrcAccessMask(vk::AccessFlagBits2::eMemoryWrite);
+            imb.setSrcStageMask(vk::PipelineStageFlagBits2::eAllCommands);
+            imb.setOldLayout(vk::ImageLayout::eUndefined);
+        }
+    }
+    for (const auto& last : plan.finalAccesses)
+    {
+        last.trackedImage->lastAccess = last.access;
+        last.trackedImage->lastStage = last.stage;
+        last.trackedImage->lastLayout = last.layout;
+    }
+    frame->currentBarrierPlan = &plan;
 }
 
 void FrameGraph::managePassInputDescriptorSetAOT(FrameCoordinator* coordinator, GPUPass* pass)
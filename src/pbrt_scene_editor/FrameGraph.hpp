@@ -6,9 +6,11 @@
 #include <functional>
 #include <unordered_map>
 #include <variant>
+#include <stdexcept>
 #include "VulkanExtension.h"
 
 #include "FrameGraphResourceDef.hpp"
+#include "FrameGraphScheduling.hpp"
 
 struct GPUPass;
 struct GPUFrame;
@@ -45,6 +47,9 @@ struct FrameGraph
       For persistent texture, the inital content is guaranteed to be the final content from previous frame  */
     FrameGraphTextureDescription* createOrGetPersistentTexture(const std::string& name, vk::Format format, FrameGraphTextureExtentType extentType = FrameGraphTextureExtent::SwapchainRelative{});
 
+    // Buffers the passes bind themselves, declared so that the graph orders the passes and places the barriers
+    FrameGraphBufferDescription* createOrGetBuffer(const std::string& name);
+
     FrameGraphConditionalVariable::BoolVariabel createOrGetBoolVariable(const std::string& name, bool intial_state = true);
 
     FrameGraphConditionalVariable::SwitchVariable createOrGetSwitchVariable(const std::string& name, std::string intial_case = "");
@@ -54,15 +59,38 @@ struct FrameGraph
         return presentTextureDesc.get();
     }
 
+    /*
+     * Orders the passes by the dependencies their accesses declare, then gives the textures no one keeps across frames
+     * memory shared with the textures living at other times of the frame.
+     */
     void compileAOT(FrameCoordinator* coordinator);
 
+    // Marks the enabled passes nothing needs this frame, before the barriers are resolved
+    void cullPasses();
+
+    /*
+     * Builds the barrier plans of every frame for every combination of the condition values, beyond
+     * maxPrecompiledBarrierPlans combinations or for passes disabled by hand they are built when first used.
+     * Called again when the backing images are recreated.
+     */
+    void compileBarrierPlans(FrameCoordinator* coordinator);
+
+    // Culls the passes then picks the barrier plan of the passes active this frame and patches it from the tracked images
     void buildBarriers(GPUFrame* frame);
 
+    FrameGraphBarrierPlan& getOrBuildBarrierPlan(GPUFrame* frame);
+
+    static constexpr size_t maxPrecompiledBarrierPlans = 256;
+
     void managePassInputDescriptorSetAOT(FrameCoordinator* coordinator, GPUPass* pass);
 
     std::vector<int> sortedIndices;
     std::vector<std::unique_ptr<GPUPass>> _allPasses;
 
+    // textures, present texture then buffers, in the order of schedulingResources
+    std::vector<FrameGraphResourceDescriptionBase*> getAllResources() const;
+    std::vector<FrameGraphScheduling::Resource> schedulingResources;
+
     std::unordered_map<std::string, FrameGraphConditionalVariable::BoolVariabel> boolVariables;
     std::unordered_map<std::string, FrameGraphConditionalVariable::SwitchVariable> switchVariables;
 
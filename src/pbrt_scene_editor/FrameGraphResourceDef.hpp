@@ -1,10 +1,14 @@
 #pragma once
 
+#include <algorithm>
 #include <variant>
 #include "VulkanExtension.h"
 
 struct GPUPass;
 struct GPUFrame;
+struct AccessTrackedImage;
+struct FrameGraphTextureDescription;
+struct FrameGraphBarrierPlanBuilder;
 
 enum class FrameGraphResourceType
 {
@@ -69,7 +73,8 @@ struct FrameGraphResourceDescriptionBase
 
     virtual ~FrameGraphResourceDescriptionBase() = default;
 
-    virtual void resolveBarriers(GPUFrame*) = 0;
+    // Adds the barriers between the active passes touching the resource, in the order they run
+    virtual void planBarriers(GPUFrame*, FrameGraphBarrierPlanBuilder& builder) = 0;
 
     std::vector<FrameGraphResourceAccessInfo> accessList;
 };
@@ -111,6 +116,8 @@ struct FrameGraphTextureDescription : FrameGraphResourceDescriptionBase
     int width = 0;
     int height = 0;
     FrameGraphTextureExtentType extent;
+    // shares its memory with textures living at other times of the frame, its content doesn't survive between uses
+    bool is_aliased = false;
 
     FrameGraphTextureDescription(const std::string& name, vk::Format format, int width, int height) : FrameGraphResourceDescriptionBase(name)
     {
@@ -197,7 +204,7 @@ struct FrameGraphTextureDescription : FrameGraphResourceDescriptionBase
         return false;
     }
 
-    void resolveBarriers(GPUFrame* frame) override;
+    void planBarriers(GPUFrame* frame, FrameGraphBarrierPlanBuilder& builder) override;
 };
 
 /* This type represents a storage buffer that we can write to or read from. As with
@@ -205,7 +212,147 @@ struct FrameGraphTextureDescription : FrameGraphResourceDescriptionBase
  * completed before accessing the buffer data in another pass.*/
 struct FrameGraphBufferDescription : FrameGraphResourceDescriptionBase
 {
-    void resolveBarriers(GPUFrame* frame) override;
+    explicit FrameGraphBufferDescription(const std::string& name) : FrameGraphResourceDescriptionBase(name)
+    {
+
+    }
+
+    FrameGraphResourceType getType() const override
+    {
+        return FrameGraphResourceType::Buffer;
+    }
+
+    /* The passes bind the buffer themselves, only the hazards between them are tracked. The first access of a frame
+       has no barrier, a buffer used by several frames is synchronized by its owner like the buffers of RenderScene.*/
+    void planBarriers(GPUFrame* frame, FrameGraphBarrierPlanBuilder& builder) override;
+};
+
+/*
+ * The barriers of every pass for one set of active passes, built once and issued with one pipeline barrier per pass.
+ * Only the first barrier of every texture depends on the frames before, FrameGraph::buildBarriers patches it from
+ * the tracked image and leaves the tracked image in the final state of the plan.
+ */
+struct FrameGraphBarrierPlan
+{
+    struct PassBarriers
+    {
+        uint32_t firstMemoryBarrier = 0;
+        uint32_t memoryBarrierCount = 0;
+        uint32_t firstImageBarrier = 0;
+        uint32_t imageBarrierCount = 0;
+    };
+
+    struct FirstAccess
+    {
+        uint32_t imageBarrier;
+        FrameGraphTextureDescription* texture;
+        AccessTrackedImage* trackedImage;
+    };
+
+    struct FinalAccess
+    {
+        AccessTrackedImage* trackedImage;
+        vk::AccessFlags2 access;
+        vk::PipelineStageFlags2 stage;
+        vk::ImageLayout layout;
+    };
+
+    // indexed like FrameGraph::_allPasses
+    std::vector<PassBarriers> passes;
+    std::vector<vk::MemoryBarrier2> memoryBarriers;
+    std::vector<vk::ImageMemoryBarrier2> imageBarriers;
+    std::vector<FirstAccess> firstAccesses;
+    std::vector<FinalAccess> finalAccesses;
+
+    void insertPipelineBarrier(vk::CommandBuffer cmd, int passIdx
+#if __APPLE__
+                               ,const vk::DispatchLoaderDynamic& d
+#endif
+                               ) const
+    {
+        const auto& pass = passes[passIdx];
+        if (pass.memoryBarrierCount == 0 && pass.imageBarrierCount == 0)
+        {
+            return;
+        }
+        vk::DependencyInfo info{};
+        info.setMemoryBarrierCount(pass.memoryBarrierCount);
+        info.setPMemoryBarriers(memoryBarriers.data() + pass.firstMemoryBarrier);
+        info.setImageMemoryBarrierCount(pass.imageBarrierCount);
+        info.setPImageMemoryBarriers(imageBarriers.data() + pass.firstImageBarrier);
+#if __APPLE__
+        cmd.pipelineBarrier2KHR(info,d);
+#else
+        cmd.pipelineBarrier2(info);
+#endif
+    }
+};
+
+// Collects the barriers per pass while the resources are walked one after the other
+struct FrameGraphBarrierPlanBuilder
+{
+    explicit FrameGraphBarrierPlanBuilder(size_t passCount) : memoryBarriers(passCount), imageBarriers(passCount)
+    {
+
+    }
+
+    void addMemoryBarrier(int passIdx, const vk::MemoryBarrier2& barrier)
+    {
+        memoryBarriers[passIdx].push_back(barrier);
+    }
+
+    void addImageBarrier(int passIdx, const vk::ImageMemoryBarrier2& barrier)
+    {
+        imageBarriers[passIdx].push_back(barrier);
+    }
+
+    // the source of the barrier is the frames before, patched every frame
+    void addFirstImageBarrier(int passIdx, const vk::ImageMemoryBarrier2& barrier, FrameGraphTextureDescription* texture, AccessTrackedImage* trackedImage)
+    {
+        firstAccesses.push_back({ passIdx, static_cast<uint32_t>(imageBarriers[passIdx].size()), texture, trackedImage });
+        imageBarriers[passIdx].push_back(barrier);
+    }
+
+    void setFinalAccess(AccessTrackedImage* trackedImage, vk::AccessFlags2 access, vk::PipelineStageFlags2 stage, vk::ImageLayout layout)
+    {
+        finalAccesses.push_back({ trackedImage, access, stage, layout });
+    }
+
+    FrameGraphBarrierPlan build() const
+    {
+        FrameGraphBarrierPlan plan;
+        plan.passes.resize(imageBarriers.size());
+        for (int i = 0; i < imageBarriers.size(); i++)
+        {
+            auto& pass = plan.passes[i];
+            pass.firstMemoryBarrier = static_cast<uint32_t>(plan.memoryBarriers.size());
+            pass.memoryBarrierCount = static_cast<uint32_t>(memoryBarriers[i].size());
+            plan.memoryBarriers.insert(plan.memoryBarriers.end(), memoryBarriers[i].begin(), memoryBarriers[i].end());
+            pass.firstImageBarrier = static_cast<uint32_t>(plan.imageBarriers.size());
+            pass.imageBarrierCount = static_cast<uint32_t>(imageBarriers[i].size());
+            plan.imageBarriers.insert(plan.imageBarriers.end(), imageBarriers[i].begin(), imageBarriers[i].end());
+        }
+        for (const auto& first : firstAccesses)
+        {
+            plan.firstAccesses.push_back({ plan.passes[first.passIdx].firstImageBarrier + first.barrierInPass, first.texture, first.trackedImage });
+        }
+        plan.finalAccesses = finalAccesses;
+        return plan;
+    }
+
+private:
+    struct PendingFirstAccess
+    {
+        int passIdx;
+        uint32_t barrierInPass;
+        FrameGraphTextureDescription* texture;
+        AccessTrackedImage* trackedImage;
+    };
+
+    std::vector<std::vector<vk::MemoryBarrier2>> memoryBarriers;
+    std::vector<std::vector<vk::ImageMemoryBarrier2>> imageBarriers;
+    std::vector<PendingFirstAccess> firstAccesses;
+    std::vector<FrameGraphBarrierPlan::FinalAccess> finalAccesses;
 };
 
 using FrameGraphTexture = FrameGraphTextureDescription;
@@ -231,14 +378,21 @@ namespace FrameGraphConditionalVariable
     struct SwitchVariable
     {
         std::string* val;
+        // every case a condition tests, FrameGraph::compileBarrierPlans goes through them
+        std::vector<std::string>* cases;
 
         SwitchVariable()
         {
             val = new std::string();
+            cases = new std::vector<std::string>();
         }
 
         auto is(const std::string& _case)
         {
+            if (std::find(cases->begin(), cases->end(), _case) == cases->end())
+            {
+                cases->push_back(_case);
+            }
             return [=, val = this->val] {return _case == *val; };
         }
     };
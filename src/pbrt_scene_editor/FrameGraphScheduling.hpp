@@ -0,0 +1,299 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+*  Graph work of FrameGraph::compileAOT and of the culling done every frame, kept apart from Vulkan so that it only
+*  deals with indices. Passes are indices into FrameGraph::_allPasses, positions are indices into the execution order.
+*/
+namespace FrameGraphScheduling {
+
+    // One pass touching one resource
+    struct ResourceUse
+    {
+        int pass;
+        bool reads;
+        bool writes;
+        // what the resource held before the pass doesn't matter, a render target cleared or loaded with don't care
+        bool overwrites;
+    };
+
+    struct Resource
+    {
+        // in the order the passes were registered, which is the order of the versions of the resource
+        std::vector<ResourceUse> uses;
+        // persistent, the reads before the first write see the previous frame
+        bool keepsContent = false;
+        // read after the frame graph, the present image
+        bool isOutput = false;
+    };
+
+    // First and last position touching a resource, -1 when nothing does
+    struct Lifetime
+    {
+        int first = -1;
+        int last = -1;
+
+        bool overlaps(const Lifetime& other) const
+        {
+            return first <= other.last && other.first <= last;
+        }
+    };
+
+    struct MemoryRequirements
+    {
+        uint64_t size;
+        uint64_t alignment;
+        uint32_t memoryTypeBits;
+    };
+
+    struct AliasingPlan
+    {
+        // per resource, its slot
+        std::vector<int> slotOf;
+        // what every slot has to satisfy, the resources of a slot are all bound at its start
+        std::vector<MemoryRequirements> slots;
+        std::vector<int> slotUsers;
+
+        uint64_t peakMemory() const
+        {
+            uint64_t total = 0;
+            for (const auto& slot : slots)
+            {
+                total += slot.size;
+            }
+            return total;
+        }
+    };
+
+    // The uses of a transient resource in version order. Its reads before the first write can only mean the content
+    // of this frame, they are moved after that write.
+    inline std::vector<ResourceUse> versionOrder(const Resource& resource)
+    {
+        auto firstWrite = std::find_if(resource.uses.begin(), resource.uses.end(), [](const ResourceUse& use) { return use.writes; });
+        if (resource.keepsContent || firstWrite == resource.uses.end() || firstWrite == resource.uses.begin())
+        {
+            return resource.uses;
+        }
+        std::vector<ResourceUse> uses;
+        uses.reserve(resource.uses.size());
+        uses.push_back(*firstWrite);
+        uses.insert(uses.end(), resource.uses.begin(), firstWrite);
+        uses.insert(uses.end(), firstWrite + 1, resource.uses.end());
+        return uses;
+    }
+
+    /*
+    *  Readers wait for the last writer, writers wait for the last writer and for the readers since. Kahn's algorithm
+    *  hands ties to the pass registered first, a graph registered in a valid order keeps it.
+    */
+    inline std::vector<int> topologicalOrder(int passCount, const std::vector<Resource>& resources)
+    {
+        std::vector<std::vector<int>> successors(passCount);
+        std::vector<int> inDegree(passCount, 0);
+        auto addEdge = [&](int from, int to) {
+            if (from != to)
+            {
+                successors[from].push_back(to);
+                inDegree[to]++;
+            }
+        };
+
+        for (const auto& resource : resources)
+        {
+            int lastWriter = -1;
+            std::vector<int> readersSinceWrite;
+            for (const auto& use : versionOrder(resource))
+            {
+                if (lastWriter >= 0)
+                {
+                    addEdge(lastWriter, use.pass);
+                }
+                if (use.writes)
+                {
+                    for (int reader : readersSinceWrite)
+                    {
+                        addEdge(reader, use.pass);
+                    }
+                    readersSinceWrite.clear();
+                    lastWriter = use.pass;
+                }
+                else if (use.reads)
+                {
+                    readersSinceWrite.push_back(use.pass);
+                }
+            }
+        }
+
+        std::priority_queue<int, std::vector<int>, std::greater<>> ready;
+        for (int pass = 0; pass < passCount; pass++)
+        {
+            if (inDegree[pass] == 0)
+            {
+                ready.push(pass);
+            }
+        }
+        std::vector<int> order;
+        order.reserve(passCount);
+        while (!ready.empty())
+        {
+            int pass = ready.top();
+            ready.pop();
+            order.push_back(pass);
+            for (int next : successors[pass])
+            {
+                if (--inDegree[next] == 0)
+                {
+                    ready.push(next);
+                }
+            }
+        }
+        if (static_cast<int>(order.size()) != passCount)
+        {
+            throw std::runtime_error("frame graph has a dependency cycle, " + std::to_string(passCount - order.size()) + " passes can't be ordered");
+        }
+        return order;
+    }
+
+    /*
+    *  Walks the order backwards. An enabled pass runs when a later running pass reads what it writes, or when it writes
+    *  a resource that outlives the frame. Passes writing no declared resource work on buffers or read back, the graph
+    *  can't see who needs that and keeps them.
+    */
+    inline std::vector<bool> livePasses(const std::vector<int>& order, const std::vector<bool>& enabled, const std::vector<Resource>& resources)
+    {
+        std::vector<std::vector<std::pair<int, ResourceUse>>> usesOfPass(enabled.size());
+        std::vector<bool> needed(resources.size());
+        int resourceCount = static_cast<int>(resources.size());
+        for (int i = 0; i < resourceCount; i++)
+        {
+            for (const auto& use : resources[i].uses)
+            {
+                usesOfPass[use.pass].emplace_back(i, use);
+            }
+            needed[i] = resources[i].keepsContent || resources[i].isOutput;
+        }
+
+        std::vector<bool> live(enabled.size(), false);
+        for (auto it = order.rbegin(); it != order.rend(); ++it)
+        {
+            int pass = *it;
+            if (!enabled[pass])
+            {
+                continue;
+            }
+            bool writesAny = false;
+            bool writesNeeded = false;
+            for (const auto& [resource, use] : usesOfPass[pass])
+            {
+                writesAny |= use.writes;
+                writesNeeded |= use.writes && needed[resource];
+            }
+            if (writesAny && !writesNeeded)
+            {
+                continue;
+            }
+            live[pass] = true;
+            // the earlier writers of what this pass overwrites are only needed by the earlier readers
+            for (const auto& [resource, use] : usesOfPass[pass])
+            {
+                if (use.overwrites && !use.reads)
+                {
+                    needed[resource] = false;
+                }
+            }
+            for (const auto& [resource, use] : usesOfPass[pass])
+            {
+                if (use.reads)
+                {
+                    needed[resource] = true;
+                }
+            }
+        }
+        return live;
+    }
+
+    inline std::vector<Lifetime> lifetimes(const std::vector<int>& order, const std::vector<Resource>& resources)
+    {
+        int passCount = static_cast<int>(order.size());
+        int resourceCount = static_cast<int>(resources.size());
+        std::vector<int> positionOf(passCount);
+        for (int position = 0; position < passCount; position++)
+        {
+            positionOf[order[position]] = position;
+        }
+        std::vector<Lifetime> result(resourceCount);
+        for (int i = 0; i < resourceCount; i++)
+        {
+            for (const auto& use : resources[i].uses)
+            {
+                int position = positionOf[use.pass];
+                result[i].first = result[i].first < 0 ? position : std::min(result[i].first, position);
+                result[i].last = std::max(result[i].last, position);
+            }
+        }
+        return result;
+    }
+
+    /*
+    *  Greedy interval packing, the largest resources pick a slot first. A resource joins the first slot whose users
+    *  all live at other times and whose memory types it accepts, otherwise it opens a slot.
+    */
+    inline AliasingPlan planAliasing(const std::vector<Lifetime>& lifetimes, const std::vector<MemoryRequirements>& requirements)
+    {
+        int resourceCount = static_cast<int>(lifetimes.size());
+        std::vector<int> bySize(resourceCount);
+        for (int i = 0; i < resourceCount; i++)
+        {
+            bySize[i] = i;
+        }
+        std::stable_sort(bySize.begin(), bySize.end(), [&](int a, int b) { return requirements[a].size > requirements[b].size; });
+
+        AliasingPlan plan;
+        plan.slotOf.assign(lifetimes.size(), -1);
+        std::vector<std::vector<int>> users;
+        for (int resource : bySize)
+        {
+            const auto& requirement = requirements[resource];
+            int slotCount = static_cast<int>(plan.slots.size());
+            int slot = 0;
+            for (; slot < slotCount; slot++)
+            {
+                if ((plan.slots[slot].memoryTypeBits & requirement.memoryTypeBits) == 0)
+                {
+                    continue;
+                }
+                bool disjoint = std::none_of(users[slot].begin(), users[slot].end(), [&](int other) { return lifetimes[other].overlaps(lifetimes[resource]); });
+                if (disjoint)
+                {
+                    break;
+                }
+            }
+            if (slot == slotCount)
+            {
+                plan.slots.push_back(requirement);
+                users.emplace_back();
+            }
+            else {
+                auto& merged = plan.slots[slot];
+                merged.size = std::max(merged.size, requirement.size);
+                merged.alignment = std::max(merged.alignment, requirement.alignment);
+                merged.memoryTypeBits &= requirement.memoryTypeBits;
+            }
+            users[slot].push_back(resource);
+            plan.slotOf[resource] = slot;
+        }
+        plan.slotUsers.reserve(users.size());
+        for (const auto& slotUsers : users)
+        {
+            plan.slotUsers.push_back(slotUsers.size());
+        }
+        return plan;
+    }
+}
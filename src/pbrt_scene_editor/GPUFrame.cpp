@@ -2,6 +2,7 @@
 #include "GPUFrame.hpp"
 #include "FrameGraph.hpp"
 #include "visitor_helper.hpp"
+#include "GlobalLogger.h"
 
 GPUFrame::GPUFrame(int threadsNum,DeviceExtended* backendDevice,FrameCoordinator* coordinator) : workThreadsNum(threadsNum), backendDevice(backendDevice), frameCoordinator(coordinator)
 {
@@ -85,7 +86,7 @@ vk::CommandBuffer GPUFrame::recordMainQueueCommands(uint32_t avaliableSwapChainI
     for (int i = 0; i < frameGraph->sortedIndices.size(); i++)
     {
         auto& pass = frameGraph->_allPasses[frameGraph->sortedIndices[i]];
-        if (!pass->is_enabled())
+        if (!pass->is_active())
         {
             pass->is_switched_to_enabled = true;
             continue;
@@ -113,9 +114,9 @@ vk::CommandBuffer GPUFrame::recordMainQueueCommands(uint32_t avaliableSwapChainI
             cmdPrimary.bindDescriptorSets(vk::PipelineBindPoint::eCompute, frameCoordinator->_frameLevelPipelineLayout, 0, _frameGlobalDescriptorSet, nullptr);
         }
 #if __APPLE__
-        pass->insertPipelineBarrier(cmdPrimary,backendDevice->getDLD());
+        currentBarrierPlan->insertPipelineBarrier(cmdPrimary, pass->passIdx, backendDevice->getDLD());
 #else
-        pass->insertPipelineBarrier(cmdPrimary);
+        currentBarrierPlan->insertPipelineBarrier(cmdPrimary, pass->passIdx);
 #endif
         vk::DebugUtilsLabelEXT passLabel{};
         passLabel.setPLabelName(pass->_name.c_str());
@@ -131,6 +132,49 @@ vk::CommandBuffer GPUFrame::recordMainQueueCommands(uint32_t avaliableSwapChainI
     return cmdPrimary;
 }
 
+std::vector<vk::CommandBuffer> GPUFrame::recordSecondaryCommands(size_t chunkCount, const vk::CommandBufferInheritanceInfo& inheritance,
+    const std::function<void(vk::CommandBuffer, size_t)>& record)
+{
+    std::vector<vk::CommandBuffer> secondaries(chunkCount);
+    auto recordChunk = [&](int allocatorIdx, size_t chunk) {
+        auto cmd = perThreadMainCommandAllocators[allocatorIdx].getOrAllocateNextSecondary();
+        vk::CommandBufferBeginInfo beginInfo{};
+        beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue);
+        beginInfo.setPInheritanceInfo(&inheritance);
+        cmd.begin(beginInfo);
+        record(cmd, chunk);
+        cmd.end();
+        secondaries[chunk] = cmd;
+    };
+
+    auto* workers = frameCoordinator->recordingWorkers.get();
+    if (workers == nullptr)
+    {
+        for (size_t chunk = 0; chunk < chunkCount; chunk++)
+        {
+            recordChunk(0, chunk);
+        }
+        return secondaries;
+    }
+
+    std::vector<std::future<void>> recorded;
+    recorded.reserve(chunkCount);
+    for (size_t chunk = 0; chunk < chunkCount; chunk++)
+    {
+        recorded.push_back(workers->enqueue([&recordChunk, chunk](int worker) { recordChunk(worker + 1, chunk); }));
+    }
+    // every chunk has to be done with the locals before an error leaves
+    for (auto& chunk : recorded)
+    {
+        chunk.wait();
+    }
+    for (auto& chunk : recorded)
+    {
+        chunk.get();
+    }
+    return secondaries;
+}
+
 void GPUFrame::copyPresentToSwapChain(vk::CommandBuffer cmd, uint32_t avaliableSwapChainImageIdx)
 {
     vk::Image swapChainImage = backendDevice->_swapchain.get_images().value()[avaliableSwapChainImageIdx];
@@ -277,7 +321,12 @@ AccessTrackedImage* GPUFrame::getBackingTrackedImage(const std::string& name) co
 
 vk::DescriptorSet GPUFrame::getManagedDescriptorSet(const std::string& identifier) const
 {
-    return descriptorSets.find(identifier)->second;
+    return getManagedDescriptorSet(frameCoordinator->getDescriptorSetHandle(identifier));
+}
+
+vk::DescriptorSet GPUFrame::getManagedDescriptorSet(DescriptorSetHandle handle) const
+{
+    return frameCoordinator->getManagedDescriptorSet(handle, frameIdx);
 }
 
 void FrameCoordinator::init(DeviceExtended* device, int num_frames_in_flight)
@@ -285,9 +334,16 @@ void FrameCoordinator::init(DeviceExtended* device, int num_frames_in_flight)
     backendDevice = device;
     inFlightframes.clear();
 
+    uint32_t recordingThreads = std::clamp(std::thread::hardware_concurrency(), 1u, maxRecordingThreads);
+    recordingWorkers.reset();
+    if (recordingThreads > 1)
+    {
+        recordingWorkers = std::make_unique<ThreadPool>(recordingThreads - 1);
+    }
+
     for (int i = 0; i < num_frames_in_flight; i++)
     {
-        auto frame = new GPUFrame(1, device,this);
+        auto frame = new GPUFrame(static_cast<int>(recordingThreads), device,this);
         frame->frameIdx = i;
         inFlightframes.push_back(frame);
     }
@@ -388,7 +444,7 @@ void FrameCoordinator::init(DeviceExtended* device, int num_frames_in_flight)
     });
 }
 
-VMAImage FrameCoordinator::createVMAImage(FrameGraphTextureDescription* textureDesc) const
+VkImageCreateInfo FrameCoordinator::getImageCreateInfo(FrameGraphTextureDescription* textureDesc) const
 {
     auto textureExtent = textureDesc->getExtent(backendDevice->_swapchain);
     VkImageCreateInfo imageInfo{};
@@ -423,7 +479,12 @@ VMAImage FrameCoordinator::createVMAImage(FrameGraphTextureDescription* textureD
     imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     //initialLayout must be VK_IMAGE_LAYOUT_UNDEFINED or VK_IMAGE_LAYOUT_PREINITIALIZED
     imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    return backendDevice->allocateVMAImage(imageInfo).value();
+    return imageInfo;
+}
+
+VMAImage FrameCoordinator::createVMAImage(FrameGraphTextureDescription* textureDesc) const
+{
+    return backendDevice->allocateVMAImage(getImageCreateInfo(textureDesc)).value();
 }
 
 vk::ImageView FrameCoordinator::createVKImageView(FrameGraphTextureDescription* textureDesc, const FrameGraphResourceAccessInfo& accessInfo, vk::Image image) const
@@ -536,25 +597,237 @@ void FrameCoordinator::createBackingImageView(FrameGraphTextureDescription* text
     }
 }
 
-vk::DescriptorSetLayout FrameCoordinator::manageSharedDescriptorSetAOT(std::string&& name, const std::vector<vk::DescriptorSetLayoutBinding>& bindings)
+void FrameCoordinator::createTransientBackingImages(std::vector<FrameGraphTextureDescription*>&& textures, std::vector<FrameGraphScheduling::Lifetime>&& lifetimes)
 {
-    //Check existing descriptorSet layout
-    for (auto& layoutRecord : managedDescriptorSetLayouts)
+    transientTextures = std::move(textures);
+    transientLifetimes = std::move(lifetimes);
+    allocateTransientBackingImages();
+}
+
+void FrameCoordinator::recreateTransientBackingImages()
+{
+    releaseTransientBackingImages();
+    allocateTransientBackingImages();
+
+    for (auto* texture : transientTextures)
+    {
+        auto image = allBackingImages[texture->name].image;
+        for (const auto& accessInfo : texture->accessList)
+        {
+            auto imageViewName = accessInfo.pass->_name + "::" + texture->name;
+            backendDevice->destroyImageView(allBackingImageViews[imageViewName]);
+            auto newImageView = createVKImageView(texture, accessInfo, image);
+            backendDevice->setObjectDebugName(newImageView, imageViewName);
+            allBackingImageViews[imageViewName] = newImageView;
+            for (auto frame : inFlightframes)
+            {
+                frame->backingImageViews[imageViewName] = newImageView;
+            }
+        }
+    }
+}
+
+bool FrameCoordinator::isTransient(const FrameGraphTextureDescription* textureDesc) const
+{
+    return std::find(transientTextures.begin(), transientTextures.end(), textureDesc) != transientTextures.end();
+}
+
+void FrameCoordinator::allocateTransientBackingImages()
+{
+    std::vector<VkImage> images;
+    std::vector<FrameGraphScheduling::MemoryRequirements> requirements;
+    images.reserve(transientTextures.size());
+    requirements.reserve(transientTextures.size());
+    for (auto* texture : transientTextures)
+    {
+        auto image = backendDevice->createUnboundImage(getImageCreateInfo(texture));
+        auto memoryRequirements = backendDevice->getImageMemoryRequirements(vk::Image(image));
+        images.push_back(image);
+        requirements.push_back({ memoryRequirements.size, memoryRequirements.alignment, memoryRequirements.memoryTypeBits });
+    }
+
+    auto plan = FrameGraphScheduling::planAliasing(transientLifetimes, requirements);
+    transientMemory.reserve(plan.slots.size());
+    for (const auto& slot : plan.slots)
     {
-        if (layoutRecord.first == bindings)
+        VkMemoryRequirements memoryRequirements{ slot.size, slot.alignment, slot.memoryTypeBits };
+        auto allocation = backendDevice->allocateVMAMemory(memoryRequirements);
+        if (!allocation.has_value())
         {
-            layoutRecord.second.emplace_back(name, vk::DescriptorSet{});
-            return layoutRecord.first._layout;
+            throw std::runtime_error("failed to allocate the memory of the frame graph transient textures");
         }
+        transientMemory.push_back(allocation.value());
     }
 
-    // Need to create new descriptorSetLayout Object
+    uint64_t unaliasedMemory = 0;
+    for (int i = 0; i < transientTextures.size(); i++)
+    {
+        auto* texture = transientTextures[i];
+        int slot = plan.slotOf[i];
+        backendDevice->bindVMAImageMemory(transientMemory[slot], images[i]);
+        backendDevice->setObjectDebugName(vk::Image(images[i]), texture->name);
+        texture->is_aliased = plan.slotUsers[slot] > 1;
+        unaliasedMemory += requirements[i].size;
+
+        allBackingImages[texture->name] = VMAImage{ images[i], transientMemory[slot] };
+        auto it = allBackingTrackedImages.find(texture->name);
+        if (it != allBackingTrackedImages.end())
+        {
+            it->second->image = images[i];
+            it->second->lastAccess = vk::AccessFlagBits2::eNone;
+            it->second->lastStage = vk::PipelineStageFlagBits2::eNone;
+            it->second->lastLayout = vk::ImageLayout::eUndefined;
+        }
+        else {
+            auto trackedImage = std::make_unique<AccessTrackedImage>(images[i], vk::AccessFlagBits2::eNone, vk::PipelineStageFlagBits2::eNone, vk::ImageLayout::eUndefined);
+            for (auto frame : inFlightframes)
+            {
+                frame->backingImages.emplace(texture->name, trackedImage.get());
+            }
+            allBackingTrackedImages.emplace(texture->name, std::move(trackedImage));
+        }
+    }
+
+    GlobalLogger::getInstance().info("frame graph transient textures : " + std::to_string(transientTextures.size()) + " textures in " +
+        std::to_string(plan.slots.size()) + " allocations, " + std::to_string(plan.peakMemory() >> 20) + " MB instead of " +
+        std::to_string(unaliasedMemory >> 20) + " MB");
+}
+
+void FrameCoordinator::releaseTransientBackingImages()
+{
+    for (auto* texture : transientTextures)
+    {
+        backendDevice->destroyImage(allBackingImages[texture->name].image);
+    }
+    for (auto allocation : transientMemory)
+    {
+        backendDevice->deAllocateMemory(allocation);
+    }
+    transientMemory.clear();
+}
+
+FrameCoordinator::ManagedDescriptorSetLayout::ManagedDescriptorSetLayout(DeviceExtended* device, const DescriptorSetLayoutExtended& layout)
+    : layout(layout), hash(layout.hash()), allocator(device, layout)
+{
+    std::vector<vk::DescriptorUpdateTemplateEntry> entries;
+    entries.reserve(layout.bindingCount);
+    bool templated = layout.bindingCount > 0;
+    for (int i = 0; i < layout.bindingCount; i++)
+    {
+        const auto& binding = layout.bindings[i];
+        switch (binding.descriptorType)
+        {
+        case vk::DescriptorType::eSampler:
+        case vk::DescriptorType::eCombinedImageSampler:
+        case vk::DescriptorType::eSampledImage:
+        case vk::DescriptorType::eStorageImage:
+        case vk::DescriptorType::eInputAttachment:
+        case vk::DescriptorType::eUniformBuffer:
+        case vk::DescriptorType::eStorageBuffer:
+        case vk::DescriptorType::eUniformBufferDynamic:
+        case vk::DescriptorType::eStorageBufferDynamic:
+            break;
+        default:
+            // texel buffers, inline uniforms and acceleration structures aren't laid out as DescriptorInfo
+            templated = false;
+        }
+        bindingOffsets.push_back(descriptorsPerSet);
+        vk::DescriptorUpdateTemplateEntry entry{};
+        entry.setDstBinding(binding.binding);
+        entry.setDstArrayElement(0);
+        entry.setDescriptorCount(binding.descriptorCount);
+        entry.setDescriptorType(binding.descriptorType);
+        entry.setOffset(descriptorsPerSet * sizeof(DescriptorInfo));
+        entry.setStride(sizeof(DescriptorInfo));
+        entries.push_back(entry);
+        descriptorsPerSet += binding.descriptorCount;
+    }
+    if (templated)
+    {
+        vk::DescriptorUpdateTemplateCreateInfo templateInfo{};
+        templateInfo.setDescriptorUpdateEntries(entries);
+        templateInfo.setTemplateType(vk::DescriptorUpdateTemplateType::eDescriptorSet);
+        templateInfo.setDescriptorSetLayout(layout._layout);
+        updateTemplate = device->createDescriptorUpdateTemplate(templateInfo);
+    }
+}
+
+int FrameCoordinator::ManagedDescriptorSetLayout::findBinding(uint32_t binding) const
+{
+    for (int i = 0; i < layout.bindingCount; i++)
+    {
+        if (layout.bindings[i].binding == binding)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+DescriptorSetHandle FrameCoordinator::manageDescriptorSetAOT(std::string&& name, const std::vector<vk::DescriptorSetLayoutBinding>& bindings, uint32_t ringSize)
+{
     vk::DescriptorSetLayoutCreateInfo layoutCreateInfo{};
     layoutCreateInfo.setBindings(bindings);
-    DescriptorSetLayoutExtended newSetLayout(backendDevice->device, layoutCreateInfo);
-    managedDescriptorSetLayouts.emplace_back(newSetLayout, std::vector<DescriptorSetRecord>{});
-    managedDescriptorSetLayouts.back().second.emplace_back(name, vk::DescriptorSet{});
-    return newSetLayout._layout;
+
+    if (auto found = managedDescriptorSetHandles.find(name); found != managedDescriptorSetHandles.end())
+    {
+        const auto& managedLayout = managedDescriptorSetLayouts[layoutIndexOf(found->second)];
+        if (found->second.ringSize != ringSize || !(managedLayout.layout == layoutCreateInfo))
+        {
+            throw std::runtime_error("DescriptorSet " + name + " is already managed with another layout");
+        }
+        return found->second;
+    }
+
+    //Check existing descriptorSet layout
+    uint32_t layoutIdx = static_cast<uint32_t>(managedDescriptorSetLayouts.size());
+    uint64_t layoutHash = DescriptorSetLayoutExtended::hash(layoutCreateInfo.pBindings, layoutCreateInfo.bindingCount);
+    auto [first, last] = managedDescriptorSetLayoutIndices.equal_range(layoutHash);
+    auto found = std::find_if(first, last, [&](const auto& indexed) {
+        return managedDescriptorSetLayouts[indexed.second].layout == layoutCreateInfo;
+    });
+    if (found != last)
+    {
+        layoutIdx = found->second;
+    }
+    else
+    {
+        // Need to create new descriptorSetLayout Object
+        DescriptorSetLayoutExtended newSetLayout(backendDevice->device, layoutCreateInfo);
+        managedDescriptorSetLayouts.emplace_back(backendDevice, newSetLayout);
+        managedDescriptorSetLayoutIndices.emplace(layoutHash, layoutIdx);
+    }
+
+    auto& managedLayout = managedDescriptorSetLayouts[layoutIdx];
+    DescriptorSetHandle handle{};
+    handle.layoutIdx = layoutIdx;
+    handle.layoutHash = managedLayout.hash;
+    handle.slot = static_cast<uint32_t>(managedLayout.sets.size());
+    handle.ringSize = ringSize;
+    for (uint32_t i = 0; i < ringSize; i++)
+    {
+        managedLayout.names.push_back(ringSize == 1 ? name : "Frame" + std::to_string(i) + "::" + name);
+        managedLayout.sets.emplace_back();
+    }
+    managedLayout.descriptors.resize(managedLayout.sets.size() * managedLayout.descriptorsPerSet, DescriptorInfo{});
+    managedLayout.written.resize(managedLayout.sets.size() * managedLayout.descriptorsPerSet, 0);
+    managedDescriptorSetHandles.emplace(std::move(name), handle);
+    return handle;
+}
+
+uint32_t FrameCoordinator::layoutIndexOf(DescriptorSetHandle handle) const
+{
+    if (handle.layoutIdx >= managedDescriptorSetLayouts.size() || managedDescriptorSetLayouts[handle.layoutIdx].hash != handle.layoutHash)
+    {
+        throw std::runtime_error("DescriptorSetHandle refers to a layout that isn't managed");
+    }
+    return handle.layoutIdx;
+}
+
+vk::DescriptorSetLayout FrameCoordinator::manageSharedDescriptorSetAOT(std::string&& name, const std::vector<vk::DescriptorSetLayoutBinding>& bindings)
+{
+    auto handle = manageDescriptorSetAOT(std::move(name), bindings, 1);
+    return managedDescriptorSetLayouts[layoutIndexOf(handle)].layout._layout;
 }
 
 vk::DescriptorSetLayout FrameCoordinator::manageSharedDescriptorSetAOT(std::string&& name, std::vector<std::tuple<vk::DescriptorType, uint32_t, vk::ShaderStageFlags>>&& bindings)
@@ -575,29 +848,8 @@ vk::DescriptorSetLayout FrameCoordinator::manageSharedDescriptorSetAOT(std::stri
 }
 
 vk::DescriptorSetLayout FrameCoordinator::manageInFlightDescriptorSetAOT(std::string&& name, const std::vector<vk::DescriptorSetLayoutBinding>& bindings) {
-    //Check existing descriptorSet layout
-    for (auto& layoutRecord : managedDescriptorSetLayouts)
-    {
-        if (layoutRecord.first == bindings)
-        {
-            for (const auto& frame : inFlightframes)
-            {
-                layoutRecord.second.emplace_back("Frame"+ std::to_string(frame->frameIdx) + "::" + name, vk::DescriptorSet{});
-            }
-            return layoutRecord.first._layout;
-        }
-    }
-
-    // Need to create new descriptorSetLayout Object
-    vk::DescriptorSetLayoutCreateInfo layoutCreateInfo{};
-    layoutCreateInfo.setBindings(bindings);
-    DescriptorSetLayoutExtended newSetLayout(backendDevice->device, layoutCreateInfo);
-    managedDescriptorSetLayouts.emplace_back(newSetLayout, std::vector<DescriptorSetRecord>{});
-    for (const auto& frame : inFlightframes)
-    {
-        managedDescriptorSetLayouts.back().second.emplace_back("Frame" + std::to_string(frame->frameIdx) + "::" + name, vk::DescriptorSet{});
-    }
-    return newSetLayout._layout;
+    auto handle = manageDescriptorSetAOT(std::move(name), bindings, static_cast<uint32_t>(inFlightframes.size()));
+    return managedDescriptorSetLayouts[layoutIndexOf(handle)].layout._layout;
 }
 
 vk::DescriptorSetLayout FrameCoordinator::manageInFlightDescriptorSetAOT(std::string&& name, std::vector<std::tuple<vk::DescriptorType, uint32_t, vk::ShaderStageFlags>>&& bindings) {
@@ -616,46 +868,32 @@ vk::DescriptorSetLayout FrameCoordinator::manageInFlightDescriptorSetAOT(std::st
     return manageInFlightDescriptorSetAOT(std::move(name), bindings2);
 }
 
-DescriptorSetRecord FrameCoordinator::findManagedDescriptorSetRecord(const std::string& name)
+DescriptorSetHandle FrameCoordinator::getDescriptorSetHandle(const std::string& name) const
 {
-    for (const auto& layoutRecord : managedDescriptorSetLayouts)
+    auto found = managedDescriptorSetHandles.find(name);
+    if (found == managedDescriptorSetHandles.end())
     {
-        for (const auto& descriptorSetRecord : layoutRecord.second)
-        {
-            if (descriptorSetRecord.first == name)
-            {
-                return descriptorSetRecord;
-            }
-        }
+        throw std::runtime_error("DescriptorSet " + name + " hasn't been managed yet");
     }
-
-    throw std::runtime_error("DescriptorSet" + name + "hasn't been managed yet");
+    return found->second;
 }
 
-void FrameCoordinator::updateDescriptorSetAOT(std::string&& name, VulkanWriteDescriptorSet write)
+void FrameCoordinator::updateDescriptorSetAOT(DescriptorSetHandle handle, uint32_t frameIdx, VulkanWriteDescriptorSet write)
 {
-    auto record = findManagedDescriptorSetRecord(name);
-    if (record.second != nullptr)
-    {
-        auto write_resolved = write;
-        write_resolved.dstSet = record.second;
-        pendingWriteDescriptorSets.emplace_back(write_resolved);
-    }
-    else {
-        pendingAllocateWriteDescriptorSets.emplace_back(name, write);
-    }
+    pendingDescriptorWrites.push_back({ layoutIndexOf(handle), handle.slotFor(frameIdx), write });
 }
 
 void FrameCoordinator::updateSharedDescriptorSetAOT(std::string&& name, VulkanWriteDescriptorSet write)
 {
-    updateDescriptorSetAOT(std::move(name),write);
+    updateDescriptorSetAOT(getDescriptorSetHandle(name), 0, write);
 }
 
 void FrameCoordinator::updateSharedDescriptorSetAOT(std::string&& name, const std::vector<VulkanWriteDescriptorSet>& writes)
 {
+    auto handle = getDescriptorSetHandle(name);
     for (auto & write : writes)
     {
-        updateSharedDescriptorSetAOT(std::move(name),write);
+        updateDescriptorSetAOT(handle, 0, write);
     }
 }
 
@@ -690,26 +928,29 @@ void FrameCoordinator::updateSharedDescriptorSetAOT(std::string&& name, uint32_t
 
 void FrameCoordinator::updateInFlightDescriptorSetAOT(std::string&& name, std::function<VulkanWriteDescriptorSet(GPUFrame*)> writeProvider)
 {
+    auto handle = getDescriptorSetHandle(name);
     for (auto frame : inFlightframes)
     {
-        updateDescriptorSetAOT("Frame" + std::to_string(frame->frameIdx) + "::" + name, writeProvider(frame));
+        updateDescriptorSetAOT(handle, frame->frameIdx, writeProvider(frame));
     }
 }
 
 void FrameCoordinator::updateInFlightDescriptorSetAOT(std::string&& name, std::function<std::vector<VulkanWriteDescriptorSet>(GPUFrame*)> writesProvider)
 {
+    auto handle = getDescriptorSetHandle(name);
     for (auto frame : inFlightframes)
     {
         auto writeSets = writesProvider(frame);
         for (auto& write : writeSets)
         {
-            updateDescriptorSetAOT("Frame" + std::to_string(frame->frameIdx) + "::" + name, write);
+            updateDescriptorSetAOT(handle, frame->frameIdx, write);
         }
     }
 }
 
 void FrameCoordinator::updateInFlightDescriptorSetAOT(std::string&& name, uint32_t dstBinding, vk::DescriptorType descriptorType, std::function<DescriptorResource(GPUFrame*)> provider)
 {
+    auto handle = getDescriptorSetHandle(name);
     for (auto frame : inFlightframes)
     {
         VulkanWriteDescriptorSet write;
@@ -737,13 +978,13 @@ void FrameCoordinator::updateInFlightDescriptorSetAOT(std::string&& name, uint32
             }
         }, resource);
 
-        updateDescriptorSetAOT("Frame" + std::to_string(frame->frameIdx) + "::" + name, write);
+        updateDescriptorSetAOT(handle, frame->frameIdx, write);
     }
 }
 
-vk::DescriptorSet FrameCoordinator::getManagedDescriptorSet(std::string&& name) const
+vk::DescriptorSet FrameCoordinator::getManagedDescriptorSet(DescriptorSetHandle handle, uint32_t frameIdx) const
 {
-    return {};
+    return managedDescriptorSetLayouts[layoutIndexOf(handle)].sets[handle.slotFor(frameIdx)];
 }
 
 void FrameCoordinator::prepareDescriptorSetsAOT()
@@ -754,88 +995,59 @@ void FrameCoordinator::prepareDescriptorSetsAOT()
 
 void FrameCoordinator::allocateDescriptorSetsAOT()
 {
-    // For now we assume each descriptorSet use a dedicated pool
-    managedDescriptorPools.reserve(managedDescriptorSetLayouts.size());
-    std::vector<vk::DescriptorPoolSize> poolSizes{};
-
-    for (auto& layoutRecord : managedDescriptorSetLayouts) {
-        //Create per layout descriptorPool
-        vk::DescriptorPoolCreateInfo poolCreateInfo{};
-        poolSizes.resize(layoutRecord.first.bindingCount);
-        
-        uint32_t layoutDescriptorSetCount = layoutRecord.second.size();
-
-        for (int i = 0; i < layoutRecord.first.bindingCount; i++) {
-            auto& binding = layoutRecord.first.bindings[i];
-            poolSizes[i].setType(binding.descriptorType);
-            poolSizes[i].setDescriptorCount(binding.descriptorCount * layoutDescriptorSetCount);
-        }
-
-        poolCreateInfo.setPPoolSizes(poolSizes.data());
-        poolCreateInfo.setPoolSizeCount(poolSizes.size());
-        poolCreateInfo.setMaxSets(10 * layoutRecord.second.size());
-        auto descriptorPool = backendDevice->createDescriptorPool(poolCreateInfo);
-        managedDescriptorPools.emplace_back(descriptorPool);
-
-        //allocate DescriptorSets
-        vk::DescriptorSetAllocateInfo allocateInfo{};
-        allocateInfo.setDescriptorPool(descriptorPool);
-        std::vector<vk::DescriptorSetLayout> layouts;
-
-        for (int i = 0; i < layoutDescriptorSetCount; i++)
-        {
-            layouts.push_back(layoutRecord.first._layout);
-        }
-
-        allocateInfo.setSetLayouts(layouts);
-        allocateInfo.setDescriptorSetCount(layouts.size());
-        auto allocatedResult = backendDevice->allocateDescriptorSets(allocateInfo);
-
-        for (int i = 0; i < layoutDescriptorSetCount; i++)
+    // only the slots managed since the last call, the pools of a layout grow with them
+    for (auto& managedLayout : managedDescriptorSetLayouts)
+    {
+        for (size_t slot = 0; slot < managedLayout.sets.size(); slot++)
         {
-            auto& setRecord = layoutRecord.second[i];
-            setRecord.second = allocatedResult[i];
-            backendDevice->setObjectDebugName(setRecord.second, setRecord.first);
-
-            auto frame_idx_pos = setRecord.first.find_first_of("::");
-            if (frame_idx_pos != std::string::npos)
+            if (managedLayout.sets[slot])
             {
-                //todo : here we assume frame idx only take up one char
-                uint32_t frame_idx = setRecord.first[frame_idx_pos-1] - '0';
-                inFlightframes[frame_idx]->descriptorSets.emplace(setRecord.first.substr(frame_idx_pos + 2), setRecord.second);
-            }
-            else {
-                for (auto frame : inFlightframes)
-                {
-                    frame->descriptorSets.emplace(setRecord.first, setRecord.second);
-                }
+                continue;
             }
+            managedLayout.sets[slot] = managedLayout.allocator.allocateSingle();
+            backendDevice->setObjectDebugName(managedLayout.sets[slot], managedLayout.names[slot]);
         }
     }
 }
 
 void FrameCoordinator::doUpdateDescriptorSetsAOT()
 {
-    for (const auto& pendingAllocateRecord : pendingAllocateWriteDescriptorSets)
+    // Templated layouts gather the writes of a set into its descriptors and update it once, the others write directly
+    std::vector<vk::WriteDescriptorSet> writes;
+    writes.reserve(pendingDescriptorWrites.size());
+    std::vector<std::pair<uint32_t, uint32_t>> dirtySlots;
+
+    for (const auto& pending : pendingDescriptorWrites)
     {
-        auto record = findManagedDescriptorSetRecord(pendingAllocateRecord.first);
-        if (record.second == nullptr)
+        auto& managedLayout = managedDescriptorSetLayouts[pending.layoutIdx];
+        auto dstSet = managedLayout.sets[pending.slot];
+        if (!dstSet)
         {
-            throw std::runtime_error("DescriptorSet " + record.first + "hasn't been allocated.");
+            throw std::runtime_error("DescriptorSet " + managedLayout.names[pending.slot] + " hasn't been allocated.");
+        }
+        const auto& pendingWrite = pending.write;
+        int bindingPos = managedLayout.findBinding(pendingWrite.dstBinding);
+        if (managedLayout.updateTemplate && bindingPos != -1)
+        {
+            auto first = pending.slot * managedLayout.descriptorsPerSet + managedLayout.bindingOffsets[bindingPos] + pendingWrite.dstArrayElement;
+            DescriptorInfo info{};
+            if (std::holds_alternative<vk::DescriptorBufferInfo>(pendingWrite.resourceInfo))
+            {
+                info.buffer = std::get<vk::DescriptorBufferInfo>(pendingWrite.resourceInfo);
+            }
+            else if (std::holds_alternative<vk::DescriptorImageInfo>(pendingWrite.resourceInfo))
+            {
+                info.image = std::get<vk::DescriptorImageInfo>(pendingWrite.resourceInfo);
+            }
+            // a write carries a single info, setting it on a vk::WriteDescriptorSet also writes a single descriptor
+            managedLayout.descriptors[first] = info;
+            managedLayout.written[first] = 1;
+            dirtySlots.emplace_back(pending.layoutIdx, pending.slot);
+            continue;
         }
-        auto write = pendingAllocateRecord.second;
-        write.dstSet = record.second;
-        pendingWriteDescriptorSets.push_back(write);
-    }
-    pendingAllocateWriteDescriptorSets.clear();
-
-    std::vector<vk::WriteDescriptorSet> writes;
 
-    for (int i = 0; i < pendingWriteDescriptorSets.size(); i++)
-    {
-        auto & pendingWrite = pendingWriteDescriptorSets[i];
         vk::WriteDescriptorSet write{};
-        write.setDstSet(pendingWrite.dstSet);
+        write.setDstSet(dstSet);
         write.setDstBinding(pendingWrite.dstBinding);
         write.setDstArrayElement(pendingWrite.dstArrayElement);
         write.setDescriptorCount(pendingWrite.descriptorCount);
@@ -855,10 +1067,58 @@ void FrameCoordinator::doUpdateDescriptorSetsAOT()
         writes.push_back(write);
     }
 
-    backendDevice->updateDescriptorSets(writes, {});
-    pendingWriteDescriptorSets.clear();
+    std::sort(dirtySlots.begin(), dirtySlots.end());
+    dirtySlots.erase(std::unique(dirtySlots.begin(), dirtySlots.end()), dirtySlots.end());
+    for (auto [layoutIdx, slot] : dirtySlots)
+    {
+        auto& managedLayout = managedDescriptorSetLayouts[layoutIdx];
+        auto first = slot * managedLayout.descriptorsPerSet;
+        auto* descriptors = managedLayout.descriptors.data() + first;
+        auto* written = managedLayout.written.data() + first;
+        if (std::all_of(written, written + managedLayout.descriptorsPerSet, [](uint8_t w) { return w != 0; }))
+        {
+            // through the pointer, the templated overload would read the pointer itself
+            backendDevice->updateDescriptorSetWithTemplate(managedLayout.sets[slot], managedLayout.updateTemplate, static_cast<const void*>(descriptors));
+            continue;
+        }
+        // a template writes every descriptor, until they all are the written ones go one by one
+        for (int i = 0; i < managedLayout.layout.bindingCount; i++)
+        {
+            const auto& binding = managedLayout.layout.bindings[i];
+            for (uint32_t element = 0; element < binding.descriptorCount; element++)
+            {
+                auto idx = managedLayout.bindingOffsets[i] + element;
+                if (written[idx] == 0)
+                {
+                    continue;
+                }
+                vk::WriteDescriptorSet write{};
+                write.setDstSet(managedLayout.sets[slot]);
+                write.setDstBinding(binding.binding);
+                write.setDstArrayElement(element);
+                write.setDescriptorCount(1);
+                write.setDescriptorType(binding.descriptorType);
+                if (binding.descriptorType == vk::DescriptorType::eUniformBuffer || binding.descriptorType == vk::DescriptorType::eStorageBuffer ||
+                    binding.descriptorType == vk::DescriptorType::eUniformBufferDynamic || binding.descriptorType == vk::DescriptorType::eStorageBufferDynamic)
+                {
+                    write.setPBufferInfo(reinterpret_cast<const vk::DescriptorBufferInfo*>(&descriptors[idx].buffer));
+                }
+                else {
+                    write.setPImageInfo(reinterpret_cast<const vk::DescriptorImageInfo*>(&descriptors[idx].image));
+                }
+                writes.push_back(write);
+            }
+        }
+    }
+
+    if (!writes.empty())
+    {
+        backendDevice->updateDescriptorSets(writes, {});
+    }
+    pendingDescriptorWrites.clear();
 }
 
+
 void FrameCoordinator::compileFrameGraphAOT()
 {
     frameGraph->compileAOT(this);
@@ -880,6 +1140,11 @@ void FrameCoordinator::update(FrameCoordinator::Event event) {
 
         for (auto texture : outOfDatedTextures)
         {
+            // the transient textures share memory, they are all recreated together below
+            if (isTransient(texture))
+            {
+                continue;
+            }
             //recreate images and imageViews
             bool used_in_flight = !texture->is_persistent && texture->allow_process_in_flight;
             if (used_in_flight)
@@ -938,6 +1203,16 @@ void FrameCoordinator::update(FrameCoordinator::Event event) {
             }
         }
 
+        // the memory plan follows the new sizes, even the textures keeping their size may have moved
+        recreateTransientBackingImages();
+        for (const auto& texture : frameGraph->textureDescriptions)
+        {
+            if (isTransient(texture.get()) && std::find(outOfDatedTextures.begin(), outOfDatedTextures.end(), texture.get()) == outOfDatedTextures.end())
+            {
+                outOfDatedTextures.push_back(texture.get());
+            }
+        }
+
         for (auto frame : inFlightframes)
         {
             frame->createPresentImage();
@@ -1049,6 +1324,9 @@ void FrameCoordinator::update(FrameCoordinator::Event event) {
         }
 
         doUpdateDescriptorSetsAOT();
+
+        // the plans hold the images they were built for
+        frameGraph->compileBarrierPlans(this);
     }
 }
 
@@ -3,6 +3,8 @@
 #include "VulkanExtension.h"
 #include "Singleton.h"
 #include "FrameGraphResourceDef.hpp"
+#include "FrameGraphScheduling.hpp"
+#include "ThreadPool.h"
 
 struct FrameGraph;
 struct GPUPass;
@@ -13,9 +15,34 @@ using PassFramebufferRecord = std::pair<GPURasterizedPass*, vk::Framebuffer>;
 using DescriptorResource = std::variant<vk::Buffer, vk::ImageView, vk::AccelerationStructureKHR>;
 using DescriptorResourceProvider = std::function<DescriptorResource(void)>;
 
-using DescriptorSetRecord = std::pair<std::string, vk::DescriptorSet>;
-using DescriptorSetRecordList = std::vector<DescriptorSetRecord>;
-using DescriptorSetLayoutRecord = std::pair<DescriptorSetLayoutExtended, DescriptorSetRecordList>;
+/*
+ * A descriptor set managed by FrameCoordinator, named by its layout and its slot among the sets of that layout.
+ * The layout is the index among the managed ones, its hash catches a handle made by another coordinator.
+ * An in flight set owns a ring of one slot per frame in flight and frame i reads slot + i, a shared set has
+ * a ring of one read by every frame.
+ */
+struct DescriptorSetHandle
+{
+    uint32_t layoutIdx = 0;
+    uint64_t layoutHash = 0;
+    uint32_t slot = 0;
+    uint32_t ringSize = 0;
+
+    explicit operator bool() const
+    {
+        return ringSize != 0;
+    }
+
+    uint32_t slotFor(uint32_t frameIdx) const
+    {
+        return ringSize == 1 ? slot : slot + frameIdx;
+    }
+
+    bool operator==(const DescriptorSetHandle& other) const
+    {
+        return layoutIdx == other.layoutIdx && layoutHash == other.layoutHash && slot == other.slot && ringSize == other.ringSize;
+    }
+};
 
 struct PassDataDescriptorSetBaseLayout {
     PassDataDescriptorSetBaseLayout() = default;
@@ -61,12 +88,14 @@ struct GPUFrame {
 
     GPUFrame& operator=(GPUFrame&& other) = default;
 
+    // the thread recording the primary command buffer, then the recording workers of FrameCoordinator
     int workThreadsNum;
 
     /* Note that allocated command buffer only means we don't need to reallocate them from pool.
      * We still need to record them every frame.
      * The reason we give each thread an allocator instead of command buffer from the same pool is that
-     * We don't know how many secondary command buffers one thread may need*/
+     * We don't know how many secondary command buffers one thread may need.
+     * Allocator 0 belongs to the thread recording the primary, recording worker i uses allocator i + 1*/
     std::vector<LinearCachedCommandAllocator> perThreadMainCommandAllocators;
 
     // Dedicate compute commands only make sense when device indeed has dedicated compute queue.
@@ -77,6 +106,13 @@ struct GPUFrame {
 
     vk::CommandBuffer recordMainQueueCommands(uint32_t avaliableSwapChainImageIdx);
 
+    /*
+     * Records chunkCount secondary command buffers on the recording workers, record is called with each one begun.
+     * Returns them in chunk order once they are all recorded, the caller executes them.
+     */
+    std::vector<vk::CommandBuffer> recordSecondaryCommands(size_t chunkCount, const vk::CommandBufferInheritanceInfo& inheritance,
+        const std::function<void(vk::CommandBuffer, size_t)>& record);
+
     void copyPresentToSwapChain(vk::CommandBuffer cmd, uint32_t avaliableSwapChainImageIdx);
 
     vk::ImageView getBackingImageView(const std::string& name) const;
@@ -119,6 +155,10 @@ struct GPUFrame {
        */
     std::vector<PassFramebufferRecord> framebuffers;
 
+    // keyed by the bits of the active passes, FrameGraph::buildBarriers points currentBarrierPlan at the one of this frame
+    std::unordered_map<uint64_t, FrameGraphBarrierPlan> barrierPlans;
+    FrameGraphBarrierPlan* currentBarrierPlan = nullptr;
+
     vk::Framebuffer getFramebufferFor(GPURasterizedPass* pass)
     {
         for (const auto& record : framebuffers)
@@ -145,7 +185,6 @@ struct GPUFrame {
 
     std::unordered_map<std::string, vk::ImageView> backingImageViews;
     std::unordered_map<std::string, AccessTrackedImage*> backingImages;
-    std::unordered_map<std::string, vk::DescriptorSet> descriptorSets;
 
     vk::ImageView presentImageView{};
     VMAImage presentVMAImage{};
@@ -153,7 +192,9 @@ struct GPUFrame {
 
     void createPresentImage();
 
+    // Prefer the handle, the name is looked up every call
     vk::DescriptorSet getManagedDescriptorSet(const std::string& identifier) const;
+    vk::DescriptorSet getManagedDescriptorSet(DescriptorSetHandle handle) const;
 };
 
 template<typename T>
@@ -175,12 +216,21 @@ struct FrameCoordinator : Singleton<FrameCoordinator>
     std::unordered_map<std::string, std::unique_ptr<AccessTrackedImage>> allBackingTrackedImages;
     std::vector<vk::Sampler> samplers;
 
+    VkImageCreateInfo getImageCreateInfo(FrameGraphTextureDescription* textureDesc) const;
     VMAImage createVMAImage(FrameGraphTextureDescription* textureDesc) const;
     vk::ImageView createVKImageView(FrameGraphTextureDescription* textureDesc, const FrameGraphResourceAccessInfo& accessInfo,vk::Image image) const;
 
     void createBackingImage(FrameGraphTextureDescription* textureDesc, bool used_in_flight);
     void createBackingImageView(FrameGraphTextureDescription* textureDesc,const FrameGraphResourceAccessInfo& accessInfo, bool used_in_flight);
 
+    /*
+     * Textures living within a frame. The ones whose lifetimes along the sorted passes don't overlap are bound to the
+     * same memory, the backing images are registered like the others and createBackingImageView only adds the views.
+     */
+    void createTransientBackingImages(std::vector<FrameGraphTextureDescription*>&& textures, std::vector<FrameGraphScheduling::Lifetime>&& lifetimes);
+    void recreateTransientBackingImages();
+    bool isTransient(const FrameGraphTextureDescription* textureDesc) const;
+
     vk::ImageView getBackingImageView(const std::string& name) const {
         return allBackingImageViews.find(name)->second;
     }
@@ -197,11 +247,50 @@ struct FrameCoordinator : Singleton<FrameCoordinator>
       so descriptorSet as out-of-date, and will allocate new one for the current frames will keep the old one till
       the previous frame is finished.
     */
-    std::vector<DescriptorSetLayoutRecord> managedDescriptorSetLayouts;
-    std::vector<vk::DescriptorPool> managedDescriptorPools;
-    std::vector<VulkanWriteDescriptorSet> pendingWriteDescriptorSets;
-    // When descriptorSet is managed but not allocated yet, writeDescriptorSet operation will be pending.
-    std::vector<std::pair<std::string, VulkanWriteDescriptorSet>> pendingAllocateWriteDescriptorSets;
+    // What an update template reads for one descriptor
+    union DescriptorInfo
+    {
+        VkDescriptorImageInfo image;
+        VkDescriptorBufferInfo buffer;
+    };
+
+    // The sets managed with one layout, indexed by ring slot
+    struct ManagedDescriptorSetLayout
+    {
+        ManagedDescriptorSetLayout(DeviceExtended* device, const DescriptorSetLayoutExtended& layout);
+
+        // position of binding in layout.bindings, -1 if the layout doesn't have it
+        int findBinding(uint32_t binding) const;
+
+        DescriptorSetLayoutExtended layout;
+        uint64_t hash;
+        LinearCachedDescriptorAllocator allocator;
+        // writes every binding of a set from its descriptors, null when the layout holds a type a template can't take
+        vk::DescriptorUpdateTemplate updateTemplate;
+        // first descriptor of each binding among the descriptorsPerSet of a slot
+        std::vector<uint32_t> bindingOffsets;
+        uint32_t descriptorsPerSet = 0;
+
+        std::vector<std::string> names;
+        std::vector<vk::DescriptorSet> sets;
+        // the descriptors last written to each slot and whether they were, the template rewrites all of them
+        std::vector<DescriptorInfo> descriptors;
+        std::vector<uint8_t> written;
+    };
+
+    // Writes are resolved against the slots once the sets are allocated
+    struct PendingDescriptorWrite
+    {
+        uint32_t layoutIdx;
+        uint32_t slot;
+        VulkanWriteDescriptorSet write;
+    };
+
+    std::vector<ManagedDescriptorSetLayout> managedDescriptorSetLayouts;
+    // layouts by hash, those sharing one are told apart with equalsTo
+    std::unordered_multimap<uint64_t, uint32_t> managedDescriptorSetLayoutIndices;
+    std::unordered_map<std::string, DescriptorSetHandle> managedDescriptorSetHandles;
+    std::vector<PendingDescriptorWrite> pendingDescriptorWrites;
 
     vk::DescriptorSetLayout getFrameGlobalDescriptorSetLayout() {
         return _frameGlobalDescriptorSetLayout;
@@ -213,10 +302,21 @@ struct FrameCoordinator : Singleton<FrameCoordinator>
     vk::DescriptorSetLayout manageInFlightDescriptorSetAOT(std::string&& name, const std::vector<vk::DescriptorSetLayoutBinding>& bindings);
     vk::DescriptorSetLayout manageInFlightDescriptorSetAOT(std::string&& name, std::vector<std::tuple<vk::DescriptorType, uint32_t, vk::ShaderStageFlags>>&& bindings);
 
-    DescriptorSetRecord findManagedDescriptorSetRecord(const std::string& name);
+    // Throws if no set was managed with the name
+    DescriptorSetHandle getDescriptorSetHandle(const std::string& name) const;
 
 private:
-    void updateDescriptorSetAOT(std::string&& name, VulkanWriteDescriptorSet);
+    DescriptorSetHandle manageDescriptorSetAOT(std::string&& name, const std::vector<vk::DescriptorSetLayoutBinding>& bindings, uint32_t ringSize);
+    uint32_t layoutIndexOf(DescriptorSetHandle handle) const;
+
+    void allocateTransientBackingImages();
+    void releaseTransientBackingImages();
+
+    std::vector<FrameGraphTextureDescription*> transientTextures;
+    std::vector<FrameGraphScheduling::Lifetime> transientLifetimes;
+    std::vector<VmaAllocation> transientMemory;
+
+    void updateDescriptorSetAOT(DescriptorSetHandle handle, uint32_t frameIdx, VulkanWriteDescriptorSet);
 public:
     void updateSharedDescriptorSetAOT(std::string&& name, VulkanWriteDescriptorSet);
     void updateSharedDescriptorSetAOT(std::string&& name, const std::vector<VulkanWriteDescriptorSet>&);
@@ -226,7 +326,7 @@ public:
     void updateInFlightDescriptorSetAOT(std::string&& name, std::function<std::vector<VulkanWriteDescriptorSet>(GPUFrame*)>);
     void updateInFlightDescriptorSetAOT(std::string&& name, uint32_t dstBinding, vk::DescriptorType descriptorType, std::function<DescriptorResource(GPUFrame*)>);
 
-    vk::DescriptorSet getManagedDescriptorSet(std::string&& name) const;
+    vk::DescriptorSet getManagedDescriptorSet(DescriptorSetHandle handle, uint32_t frameIdx) const;
 
     void prepareDescriptorSetsAOT();
     void allocateDescriptorSetsAOT();
@@ -235,6 +335,10 @@ public:
     DeviceExtended* backendDevice;
     std::vector<GPUFrame*> inFlightframes;
 
+    // Record the secondary command buffers of the passes splitting their draws, null with a single recording thread
+    std::unique_ptr<ThreadPool> recordingWorkers;
+    static constexpr uint32_t maxRecordingThreads = 8;
+
     FrameGraph* frameGraph;
 
     void compileFrameGraphAOT();
@@ -28,17 +28,47 @@ vk::PipelineLayoutCreateInfo concatLayoutCreateInfo(vk::PipelineLayoutCreateInfo
 
 void GPUPass::read(FrameGraphTextureDescription* texture)
 {
-
+    FrameGraphResourceAccessInfo accessInfo{};
+    accessInfo.pass = this;
+    accessInfo.accessType = FrameGraphResourceAccess::Read{};
+    texture->accessList.emplace_back(std::move(accessInfo));
+    this->reads.emplace_back(texture);
 }
 
 void GPUPass::write(FrameGraphTextureDescription* texture)
 {
-
+    FrameGraphResourceAccessInfo accessInfo{};
+    accessInfo.pass = this;
+    accessInfo.accessType = FrameGraphResourceAccess::Write{};
+    texture->accessList.emplace_back(std::move(accessInfo));
+    this->writes.emplace_back(texture);
 }
 
+// A storage image written in place is bound once, the write access covers the reads
 void GPUPass::readwrite(FrameGraphTextureDescription* texture)
 {
+    write(texture);
+}
+
+void GPUPass::read(FrameGraphBufferDescription* buffer)
+{
+    FrameGraphResourceAccessInfo accessInfo{};
+    accessInfo.pass = this;
+    accessInfo.accessType = FrameGraphResourceAccess::Read{};
+    buffer->accessList.emplace_back(std::move(accessInfo));
+}
+
+void GPUPass::write(FrameGraphBufferDescription* buffer)
+{
+    FrameGraphResourceAccessInfo accessInfo{};
+    accessInfo.pass = this;
+    accessInfo.accessType = FrameGraphResourceAccess::Write{};
+    buffer->accessList.emplace_back(std::move(accessInfo));
+}
 
+void GPUPass::readwrite(FrameGraphBufferDescription* buffer)
+{
+    write(buffer);
 }
 
 void GPUPass::sample(FrameGraphTextureDescription* texture, bool mipmap)
@@ -74,7 +104,7 @@ void GPURasterizedPass::renderTo(FrameGraphTextureDescription* texture, vk::Atta
     this->renderTargets.emplace_back(RenderTarget{ loadOp, vk::AttachmentStoreOp::eStore, texture });
 }
 
-void GPURasterizedPass::beginPass(vk::CommandBuffer cmdBuf, vk::Framebuffer framebuffer) {
+void GPURasterizedPass::beginPass(vk::CommandBuffer cmdBuf, vk::Framebuffer framebuffer, vk::SubpassContents contents) {
     vk::RenderPassBeginInfo beginInfo{};
     beginInfo.setRenderPass(renderPass);
     beginInfo.setFramebuffer(framebuffer);
@@ -104,7 +134,7 @@ void GPURasterizedPass::beginPass(vk::CommandBuffer cmdBuf, vk::Framebuffer fram
         clearValues.emplace_back(clearValue);
     }
     beginInfo.setClearValues(clearValues);
-    cmdBuf.beginRenderPass(beginInfo,vk::SubpassContents::eInline);
+    cmdBuf.beginRenderPass(beginInfo,contents);
 }
 
 void GPURasterizedPass::endPass(vk::CommandBuffer cmdBuf) {
@@ -178,6 +208,17 @@ void GPURasterizedPass::buildRenderPass(DeviceExtended* device) {
 
 bool GPUComputePass::fillMemBarrierInfo(FrameGraphResourceAccess::Access accessType, FrameGraphBufferDescription* buffer, vk::MemoryBarrier2& barrier)
 {
+    barrier.dstStageMask = vk::PipelineStageFlagBits2::eComputeShader;
+    if (std::holds_alternative<FrameGraphResourceAccess::Read>(accessType))
+    {
+        barrier.dstAccessMask = vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eUniformRead;
+        return true;
+    }
+    if (std::holds_alternative<FrameGraphResourceAccess::Write>(accessType))
+    {
+        barrier.dstAccessMask = vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite;
+        return true;
+    }
     return false;
 }
 
@@ -273,6 +314,20 @@ vk::Framebuffer GPURasterizedPass::buildSwapChainTouchedFrameBuffer(DeviceExtend
 
 bool GPURasterizedPass::fillMemBarrierInfo(FrameGraphResourceAccess::Access accessType, FrameGraphBufferDescription* buffer, vk::MemoryBarrier2& barrier)
 {
+    // a buffer read by a draw may be its indirect commands, its indices or vertices, or a storage buffer of any stage
+    barrier.dstStageMask = vk::PipelineStageFlagBits2::eAllGraphics;
+    if (std::holds_alternative<FrameGraphResourceAccess::Read>(accessType))
+    {
+        barrier.dstAccessMask = vk::AccessFlagBits2::eIndirectCommandRead | vk::AccessFlagBits2::eIndexRead |
+                                vk::AccessFlagBits2::eVertexAttributeRead | vk::AccessFlagBits2::eShaderStorageRead |
+                                vk::AccessFlagBits2::eUniformRead;
+        return true;
+    }
+    if (std::holds_alternative<FrameGraphResourceAccess::Write>(accessType))
+    {
+        barrier.dstAccessMask = vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite;
+        return true;
+    }
     return false;
 }
 
@@ -295,7 +350,7 @@ bool GPURasterizedPass::fillImgBarrierInfo(FrameGraphResourceAccess::Access acce
     if (std::holds_alternative<FrameGraphResourceAccess::Write>(accessType))
     {
         stageMask = vk::PipelineStageFlagBits2::eFragmentShader;
-        accessMask = vk::AccessFlagBits2::eShaderRead;
+        accessMask = vk::AccessFlagBits2::eShaderRead | vk::AccessFlagBits2::eShaderWrite;
         layout = vk::ImageLayout::eGeneral;
         return true;
     }
@@ -341,42 +396,91 @@ void GPUComputePass::record(vk::CommandBuffer cmd, GPUFrame* frame)
         {
             if (std::holds_alternative<std::string>(descriptorSet))
             {
-                vkDescriptorSets.push_back(frame->getManagedDescriptorSet(std::get<std::string>(descriptorSet).c_str()));
+                vkDescriptorSets.push_back(frame->getManagedDescriptorSet(std::get<std::string>(descriptorSet)));
+            }
+            else if (std::holds_alternative<DescriptorSetHandle>(descriptorSet))
+            {
+                vkDescriptorSets.push_back(frame->getManagedDescriptorSet(std::get<DescriptorSetHandle>(descriptorSet)));
             }
             else {
                 vkDescriptorSets.push_back(std::get<vk::DescriptorSet>(descriptorSet));
             }
         }
-        cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, computePipelines[ctx.pipelineIdx].getLayout(), ctx.firstSet, vkDescriptorSets, nullptr);
-        cmd.bindPipeline(vk::PipelineBindPoint::eCompute, computePipelines[ctx.pipelineIdx].getPipeline());
+        if (ctx.pipelineIdx != -1)
+        {
+            cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, computePipelines[ctx.pipelineIdx].getLayout(), ctx.firstSet, vkDescriptorSets, nullptr);
+            cmd.bindPipeline(vk::PipelineBindPoint::eCompute, computePipelines[ctx.pipelineIdx].getPipeline());
+        }
         ctx.action(cmd, ctx.pipelineIdx);
     }
 }
 
-void GPURasterizedPass::record(vk::CommandBuffer cmd, GPUFrame* frame)
+void GPURasterizedPass::recordActionContext(vk::CommandBuffer cmd, GPUFrame* frame, const PassActionContext& ctx)
 {
-    beginPass(cmd,frame->getFramebufferFor(this));
-    for (const auto& ctx : actionContextQueue)
+    std::vector<vk::DescriptorSet> vkDescriptorSets;
+    vkDescriptorSets.reserve(ctx.descriptorSets.size());
+    for (const auto& descriptorSet : ctx.descriptorSets)
     {
-        std::vector<vk::DescriptorSet> vkDescriptorSets;
-        vkDescriptorSets.reserve(ctx.descriptorSets.size());
-        for (const auto& descriptorSet : ctx.descriptorSets)
+        if (std::holds_alternative<std::string>(descriptorSet))
         {
-            if (std::holds_alternative<std::string>(descriptorSet))
-            {
-                vkDescriptorSets.push_back(frame->getManagedDescriptorSet(std::get<std::string>(descriptorSet).c_str()));
-            }
-            else {
-                vkDescriptorSets.push_back(std::get<vk::DescriptorSet>(descriptorSet));
-            }
+            vkDescriptorSets.push_back(frame->getManagedDescriptorSet(std::get<std::string>(descriptorSet)));
         }
-        if (ctx.pipelineIdx != -1)
+        else if (std::holds_alternative<DescriptorSetHandle>(descriptorSet))
         {
-            cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, graphicsPipelines[ctx.pipelineIdx].getLayout(), ctx.firstSet, vkDescriptorSets, nullptr);
-            cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, graphicsPipelines[ctx.pipelineIdx].getPipeline());
+            vkDescriptorSets.push_back(frame->getManagedDescriptorSet(std::get<DescriptorSetHandle>(descriptorSet)));
         }
-        ctx.action(cmd,ctx.pipelineIdx);
+        else {
+            vkDescriptorSets.push_back(std::get<vk::DescriptorSet>(descriptorSet));
+        }
+    }
+    if (ctx.pipelineIdx != -1)
+    {
+        cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, graphicsPipelines[ctx.pipelineIdx].getLayout(), ctx.firstSet, vkDescriptorSets, nullptr);
+        cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, graphicsPipelines[ctx.pipelineIdx].getPipeline());
+    }
+    ctx.action(cmd,ctx.pipelineIdx);
+}
+
+void GPURasterizedPass::recordChunked(vk::CommandBuffer cmd, GPUFrame* frame, size_t itemCount,
+                                      const std::function<void(vk::CommandBuffer, size_t, size_t)>& recordRange)
+{
+    auto framebuffer = frame->getFramebufferFor(this);
+    size_t chunkCount = 0;
+    if (recordInParallel)
+    {
+        chunkCount = std::min<size_t>(frame->workThreadsNum - 1, itemCount / minContextsPerSecondary);
     }
+    if (chunkCount < 2)
+    {
+        beginPass(cmd,framebuffer);
+        recordRange(cmd, 0, itemCount);
+        endPass(cmd);
+        return;
+    }
+
+    vk::CommandBufferInheritanceInfo inheritance{};
+    inheritance.setRenderPass(renderPass);
+    inheritance.setSubpass(0);
+    inheritance.setFramebuffer(framebuffer);
+    auto secondaries = frame->recordSecondaryCommands(chunkCount, inheritance, [frame, itemCount, chunkCount, &recordRange](vk::CommandBuffer secondary, size_t chunk) {
+        // a secondary command buffer inherits nothing but the render pass
+        secondary.setViewport(0, frame->backendDevice->_swapchain.getDefaultViewport());
+        secondary.setScissor(0, frame->backendDevice->_swapchain.getDefaultScissor());
+        secondary.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, frame->frameCoordinator->_frameLevelPipelineLayout, 0, frame->_frameGlobalDescriptorSet, nullptr);
+        recordRange(secondary, itemCount * chunk / chunkCount, itemCount * (chunk + 1) / chunkCount);
+    });
+    beginPass(cmd, framebuffer, vk::SubpassContents::eSecondaryCommandBuffers);
+    cmd.executeCommands(secondaries);
     endPass(cmd);
 }
 
+void GPURasterizedPass::record(vk::CommandBuffer cmd, GPUFrame* frame)
+{
+    recordChunked(cmd, frame, actionContextQueue.size(), [this, frame](vk::CommandBuffer cmd, size_t first, size_t last) {
+        for (size_t i = first; i < last; i++)
+        {
+            recordActionContext(cmd, frame, actionContextQueue[i]);
+        }
+    });
+}
+
@@ -25,7 +25,8 @@ enum class GPUPassType
 struct PassActionContext
 {
     uint32_t pipelineIdx;
-    std::vector < std::variant<std::string, vk::DescriptorSet>> descriptorSets;
+    // the names are looked up every record, passes recording each frame keep the handles
+    std::vector < std::variant<std::string, vk::DescriptorSet, DescriptorSetHandle>> descriptorSets;
     uint32_t firstSet;
     std::function<void(vk::CommandBuffer, uint32_t)> action;
 };
@@ -46,6 +47,9 @@ struct GPUPass
 
     virtual GPUPassType getType() const = 0;
 
+    // index in FrameGraph::_allPasses, set when the pass is handed to the frame graph
+    int passIdx = -1;
+
     std::vector<FrameGraphResourceDescriptionBase*> reads;
     std::vector<FrameGraphResourceDescriptionBase*> writes;
     std::vector<FrameGraphTextureDescription*> samples;
@@ -53,6 +57,9 @@ struct GPUPass
     vk::DescriptorSetLayout passInputDescriptorSetLayout;
     bool force_disabled = false;
     bool is_enabled() { return !force_disabled && enableCond(); }
+    // enabled but nothing running after it reads what it writes this frame, set by FrameGraph::cullPasses
+    bool is_culled = false;
+    bool is_active() { return is_enabled() && !is_culled; }
     bool is_first_enabled = true;
     bool is_switched_to_enabled = true;
     std::function<bool(void)> enableCond = [] {return true; };
@@ -88,6 +95,13 @@ struct GPUPass
 
     void readwrite(FrameGraphTextureDescription* texture);
 
+    // The pass binds the buffer itself, the declaration only orders the passes and places the barriers
+    void read(FrameGraphBufferDescription* buffer);
+
+    void write(FrameGraphBufferDescription* buffer);
+
+    void readwrite(FrameGraphBufferDescription* buffer);
+
     void sample(FrameGraphTextureDescription* texture, bool mipmap = false);
 
     virtual bool fillMemBarrierInfo(FrameGraphResourceAccess::Access accessType, FrameGraphBufferDescription* buffer,vk::MemoryBarrier2& barrier) = 0;
@@ -97,35 +111,6 @@ struct GPUPass
     std::vector<PassActionContext> actionContextQueue;
 
     void virtual record(vk::CommandBuffer cmd, GPUFrame* frame) = 0;
-
-    // We resolve the barriers for each frame on-the-fly to avoid many tricky situation
-    std::vector<vk::MemoryBarrier2> transientMemoryBarriers;
-    std::vector<vk::BufferMemoryBarrier2> transientBufferMemoryBarriers;
-    std::vector<vk::ImageMemoryBarrier2> transientImageMemoryBarriers;
-
-    void insertPipelineBarrier(vk::CommandBuffer cmd
-#if __APPLE__
-                               ,const vk::DispatchLoaderDynamic& d
-#endif
-                               )
-    {
-        if (transientMemoryBarriers.empty() && transientBufferMemoryBarriers.empty() && transientImageMemoryBarriers.empty())
-        {
-            return;
-        }
-        vk::DependencyInfo info{};
-        info.setMemoryBarriers(transientMemoryBarriers);
-        info.setBufferMemoryBarriers(transientBufferMemoryBarriers);
-        info.setImageMemoryBarriers(transientImageMemoryBarriers);
-#if __APPLE__
-        cmd.pipelineBarrier2KHR(info,d);
-#else
-        cmd.pipelineBarrier2(info);
-#endif
-        transientMemoryBarriers.clear();
-        transientBufferMemoryBarriers.clear();
-        transientImageMemoryBarriers.clear();
-    }
 };
 
 struct GPUComputePass : GPUPass
@@ -162,7 +147,7 @@ struct RenderTarget
 
 struct GPURasterizedPass : GPUPass
 {
-    void beginPass(vk::CommandBuffer cmdBuf,vk::Framebuffer framebuffer);
+    void beginPass(vk::CommandBuffer cmdBuf,vk::Framebuffer framebuffer, vk::SubpassContents contents = vk::SubpassContents::eInline);
 
     void endPass(vk::CommandBuffer cmdBuf);
 
@@ -203,12 +188,28 @@ struct GPURasterizedPass : GPUPass
 
     void renderTo(FrameGraphTextureDescription* texture, vk::AttachmentLoadOp loadOp = vk::AttachmentLoadOp::eDontCare);
 
+    /*
+     * The action contexts are split into contiguous chunks recorded on the recording workers into secondary command
+     * buffers, executed in order. Every context has to bind all it uses, they don't see the state of the one before.
+     */
+    bool recordInParallel = false;
+    static constexpr size_t minContextsPerSecondary = 8;
+
+    /*
+     * Begin the pass, record itemCount items and end it. recordRange records a contiguous range of them, in parallel
+     * into secondaries when recordInParallel allows it. A secondary starts with nothing bound but set 0.
+     */
+    void recordChunked(vk::CommandBuffer cmd, GPUFrame* frame, size_t itemCount,
+                       const std::function<void(vk::CommandBuffer, size_t, size_t)>& recordRange);
+
     bool fillMemBarrierInfo(FrameGraphResourceAccess::Access accessType, FrameGraphBufferDescription* buffer, vk::MemoryBarrier2& barrier) override;
 
     bool fillImgBarrierInfo(FrameGraphResourceAccess::Access accessType, FrameGraphTextureDescription* texture,
         vk::PipelineStageFlags2& stageMask, vk::AccessFlags2& accessMask, vk::ImageLayout& layout) override;
 
     void record(vk::CommandBuffer cmd, GPUFrame* frame) override;
+
+    void recordActionContext(vk::CommandBuffer cmd, GPUFrame* frame, const PassActionContext& ctx);
 };
 
 struct GPURayTracingPass : GPUPass
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+#include "MeshLod.hpp"
+
+/*
+*  Data shared by InstanceCullPass, HZBOcclusionPass, their shaders and the draws consuming the culled instances.
+*  The layouts must match the shader.
+*/
+namespace renderScene {
+
+    enum class CulledDrawList
+    {
+        Visible,
+        Selected,
+        Late
+    };
+
+    /*
+     * Written by instanceCull.comp, consumed by drawIndexedIndirectCount. One command per list and level of detail,
+     * its count is 0 or 1. The indices of a level start at level * instance count in the index list.
+     */
+    struct InstanceCullDrawCommands
+    {
+        static constexpr uint32_t MAX_LODS = MeshLodChain::MAX_LODS;
+
+        struct Draw
+        {
+            VkDrawIndexedIndirectCommand command;
+            uint32_t drawCount;
+        };
+
+        // drawn by GBufferPass, the instances visible in the previous frame when occlusion culling is on
+        Draw visible[MAX_LODS];
+        Draw selected[MAX_LODS];
+        // drawn by GBufferLatePass, the instances that passed the HZB test but weren't drawn by GBufferPass
+        Draw late[MAX_LODS];
+
+        // level 0 of the visible list comes first, the cluster culling reads its command as the visible instance count
+        static constexpr vk::DeviceSize drawOffset(CulledDrawList list, uint32_t lod)
+        {
+            return (static_cast<uint32_t>(list) * MAX_LODS + lod) * sizeof(Draw);
+        }
+        static constexpr vk::DeviceSize countOffset(vk::DeviceSize commandOffset) { return commandOffset + sizeof(VkDrawIndexedIndirectCommand); }
+
+        // What the culling pass resets the buffer to before the dispatch
+        static InstanceCullDrawCommands empty(const std::vector<MeshLod>& lods)
+        {
+            InstanceCullDrawCommands commands{};
+            for (uint32_t lod = 0; lod < std::min<size_t>(lods.size(), MAX_LODS); lod++)
+            {
+                for (auto* draws : { commands.visible, commands.selected, commands.late })
+                {
+                    draws[lod].command.indexCount = lods[lod].indexCount;
+                    draws[lod].command.firstIndex = lods[lod].firstIndex;
+                }
+            }
+            return commands;
+        }
+    };
+    static_assert(sizeof(InstanceCullDrawCommands) == 3 * MeshLodChain::MAX_LODS * 24, "layout must match DrawCommands in instanceCull.comp");
+
+    struct InstanceCullPushConstants
+    {
+        glm::vec4 aabbMin;
+        glm::vec4 aabbMax;
+        uint32_t instanceCount;
+        uint32_t selectedMask;
+        // non zero when the previous frame visibility and the HZB are used
+        uint32_t occlusionCulling;
+        uint32_t hzbMipCount;
+        // extent of sceneDepth, the HZB is addressed in its texels
+        glm::uvec2 depthSize;
+        // see selectInstanceLod(), a single level when the selection is off
+        uint32_t lodCount;
+        float lodScale;
+        float lodErrors[MeshLodChain::MAX_LODS];
+    };
+
+    // Per frame counters summed over all batches, read back by the CPU once the frame has finished
+    struct InstanceCullStatistics
+    {
+        uint32_t frustumCulled;
+        uint32_t occlusionCulled;
+        uint32_t drawnEarly;
+        uint32_t drawnLate;
+        // counted by the cluster culling of the instances drawn early
+        uint32_t clustersCulled;
+        uint32_t clustersDrawn;
+        // instances drawn early or late at each level of detail
+        uint32_t drawnPerLod[MeshLodChain::MAX_LODS];
+    };
+
+    /*
+     * An instance is culled when all 8 corners of its local AABB lie outside the same clip plane.
+     * Conservative, boxes crossing a frustum corner are kept. This is the reference for instanceCull.comp,
+     * both must implement the same test.
+     */
+    inline bool isInstanceVisible(const glm::mat4& viewProj, const glm::mat4& model, const glm::vec3& aabbMin, const glm::vec3& aabbMax)
+    {
+        glm::mat4 mvp = viewProj * model;
+        uint32_t outsideAll = 0x3F;
+        for (int i = 0; i < 8; i++)
+        {
+            glm::vec4 corner{ (i & 1) ? aabbMax.x : aabbMin.x, (i & 2) ? aabbMax.y : aabbMin.y, (i & 4) ? aabbMax.z : aabbMin.z, 1.0f };
+            glm::vec4 c = mvp * corner;
+            uint32_t outside = 0;
+            outside |= c.x < -c.w ? 1u : 0u;
+            outside |= c.x > c.w ? 2u : 0u;
+            outside |= c.y < -c.w ? 4u : 0u;
+            outside |= c.y > c.w ? 8u : 0u;
+            outside |= c.z < 0.0f ? 16u : 0u;
+            outside |= c.z > c.w ? 32u : 0u;
+            outsideAll &= outside;
+        }
+        return outsideAll == 0;
+    }
+
+    // Indices of the visible instances in ascending order, the GPU writes the same set in any order
+    template<class PerInstDataT>
+    std::vector<uint32_t> cullInstancesCPU(const glm::mat4& viewProj, const std::vector<PerInstDataT>& perInstanceData,
+                                           const glm::vec3& aabbMin, const glm::vec3& aabbMax)
+    {
+        std::vector<uint32_t> visible;
+        for (uint32_t i = 0; i < perInstanceData.size(); i++)
+        {
+            if (isInstanceVisible(viewProj, perInstanceData[i]._wTransform, aabbMin, aabbMax))
+                visible.push_back(i);
+        }
+        return visible;
+    }
+
+    /*
+     * The coarsest level whose error, projected at the point of the bounding sphere nearest to the eye, stays within
+     * the pixel budget. lodScale is half the viewport height times proj[1][1] over that budget, so a level fits when
+     * error * scale * lodScale <= distance. Eyes inside the sphere get level 0. This is the reference for instanceCull.comp.
+     */
+    inline uint32_t selectInstanceLod(const glm::mat4& model, const glm::vec3& eye, const glm::vec3& aabbMin, const glm::vec3& aabbMax,
+                                      const float* lodErrors, uint32_t lodCount, float lodScale)
+    {
+        glm::vec3 center = 0.5f * (aabbMin + aabbMax);
+        float radius = 0.5f * glm::length(aabbMax - aabbMin);
+        float maxScale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        float distance = glm::length(glm::vec3(model * glm::vec4(center, 1.0f)) - eye) - radius * maxScale;
+        uint32_t lod = 0;
+        for (uint32_t i = 1; i < lodCount; i++)
+        {
+            if (lodErrors[i] * maxScale * lodScale > distance)
+                break;
+            lod = i;
+        }
+        return lod;
+    }
+
+    // Level of every instance, what the culling passes would pick for the visible ones
+    template<class PerInstDataT>
+    std::vector<uint32_t> selectLodsCPU(const glm::vec3& eye, const std::vector<PerInstDataT>& perInstanceData,
+                                        const glm::vec3& aabbMin, const glm::vec3& aabbMax, const InstanceCullPushConstants& constants)
+    {
+        std::vector<uint32_t> lods(perInstanceData.size());
+        for (uint32_t i = 0; i < perInstanceData.size(); i++)
+        {
+            lods[i] = selectInstanceLod(perInstanceData[i]._wTransform, eye, aabbMin, aabbMax, constants.lodErrors, constants.lodCount, constants.lodScale);
+        }
+        return lods;
+    }
+
+    /*
+     * Depth pyramid of hzbBuild.comp. Level 0 halves sceneDepth, every level halves the previous one rounding up,
+     * so a texel of level l covers the depth texels [x << (l + 1), (x + 1) << (l + 1)). Texels keep the farthest depth.
+     */
+    struct HZBPyramid
+    {
+        static constexpr uint32_t MAX_MIPS = 16;
+
+        glm::uvec2 depthSize{};
+        std::vector<glm::uvec2> sizes;
+        std::vector<std::vector<float>> levels;
+
+        static uint32_t mipCount(glm::uvec2 depthSize)
+        {
+            uint32_t count = 1;
+            glm::uvec2 size = (depthSize + 1u) / 2u;
+            while (size.x > 1 || size.y > 1)
+            {
+                size = (size + 1u) / 2u;
+                count++;
+            }
+            return count;
+        }
+
+        float at(uint32_t level, glm::uvec2 texel) const
+        {
+            return levels[level][texel.y * sizes[level].x + texel.x];
+        }
+
+        // Reference of hzbBuild.comp, depth is row major with depthSize.x texels per row
+        static HZBPyramid build(const std::vector<float>& depth, glm::uvec2 depthSize)
+        {
+            HZBPyramid pyramid;
+            pyramid.depthSize = depthSize;
+            auto count = mipCount(depthSize);
+            glm::uvec2 srcSize = depthSize;
+            const std::vector<float>* src = &depth;
+            for (uint32_t level = 0; level < count; level++)
+            {
+                glm::uvec2 size = (srcSize + 1u) / 2u;
+                std::vector<float> texels(size.x * size.y);
+                for (uint32_t y = 0; y < size.y; y++)
+                {
+                    for (uint32_t x = 0; x < size.x; x++)
+                    {
+                        uint32_t x1 = std::min(2 * x + 1, srcSize.x - 1);
+                        uint32_t y1 = std::min(2 * y + 1, srcSize.y - 1);
+                        texels[y * size.x + x] = std::max(std::max((*src)[2 * y * srcSize.x + 2 * x], (*src)[2 * y * srcSize.x + x1]),
+                                                          std::max((*src)[y1 * srcSize.x + 2 * x], (*src)[y1 * srcSize.x + x1]));
+                    }
+                }
+                pyramid.sizes.push_back(size);
+                pyramid.levels.push_back(std::move(texels));
+                src = &pyramid.levels.back();
+                srcSize = size;
+            }
+            return pyramid;
+        }
+    };
+
+    /*
+     * Reference of the occlusion test of instanceCull.comp. The projected bounds are compared against the farthest
+     * depth of the 2x2 texels of the finest level that covers them. Boxes crossing the near plane are never occluded.
+     */
+    inline bool isInstanceOccluded(const glm::mat4& viewProj, const glm::mat4& model, const glm::vec3& aabbMin, const glm::vec3& aabbMax,
+                                   const HZBPyramid& pyramid)
+    {
+        glm::mat4 mvp = viewProj * model;
+        glm::vec2 ndcMin{ 1.0f }, ndcMax{ -1.0f };
+        float nearest = 1.0f;
+        for (int i = 0; i < 8; i++)
+        {
+            glm::vec4 corner{ (i & 1) ? aabbMax.x : aabbMin.x, (i & 2) ? aabbMax.y : aabbMin.y, (i & 4) ? aabbMax.z : aabbMin.z, 1.0f };
+            glm::vec4 c = mvp * corner;
+            if (c.w <= 1e-5f || c.z < 0.0f)
+                return false;
+            glm::vec3 ndc = glm::vec3(c) / c.w;
+            ndcMin = glm::min(ndcMin, glm::vec2(ndc));
+            ndcMax = glm::max(ndcMax, glm::vec2(ndc));
+            nearest = std::min(nearest, ndc.z);
+        }
+        glm::vec2 uvMin = glm::clamp(ndcMin * 0.5f + 0.5f, 0.0f, 1.0f);
+        glm::vec2 uvMax = glm::clamp(ndcMax * 0.5f + 0.5f, 0.0f, 1.0f);
+        glm::uvec2 texelMin = glm::min(glm::uvec2(uvMin * glm::vec2(pyramid.depthSize)), pyramid.depthSize - 1u);
+        glm::uvec2 texelMax = glm::min(glm::uvec2(uvMax * glm::vec2(pyramid.depthSize)), pyramid.depthSize - 1u);
+
+        uint32_t level = 0;
+        while (level + 1 < pyramid.levels.size() &&
+               (((texelMax.x >> (level + 1)) - (texelMin.x >> (level + 1))) > 1 || ((texelMax.y >> (level + 1)) - (texelMin.y >> (level + 1))) > 1))
+        {
+            level++;
+        }
+        glm::uvec2 lo = texelMin >> (level + 1);
+        glm::uvec2 hi = texelMax >> (level + 1);
+        float farthest = std::max(std::max(pyramid.at(level, lo), pyramid.at(level, { hi.x, lo.y })),
+                                  std::max(pyramid.at(level, { lo.x, hi.y }), pyramid.at(level, hi)));
+        return nearest > farthest;
+    }
+}
@@ -2,6 +2,7 @@
 
 #include <array>
 #include <atomic>
+#include <thread>
 
 /*
 *  Atomic int based circular queue implementation
@@ -33,6 +34,35 @@ struct LockFreeCircleQueue
 		while (!enqueue(value));
 	}
 
+	// enqueue as many of the values as currently fit, publishing them with a single tail update.
+	// return the number of values enqueued.
+	size_t enqueueBulk(const T* values, size_t count)
+	{
+		size_t currentTail = tail.load(std::memory_order_relaxed);
+		size_t currentHead = head.load(std::memory_order_acquire);
+		size_t available = (currentHead + size - currentTail - 1) % size;
+		size_t n = count < available ? count : available;
+		for (size_t i = 0; i < n; i++) {
+			buffer[(currentTail + i) % size] = values[i];
+		}
+		if (n != 0) {
+			tail.store((currentTail + n) % size, std::memory_order_release);
+		}
+		return n;
+	}
+
+	void waitAndEnqueueBulk(const T* values, size_t count)
+	{
+		while (count != 0) {
+			size_t n = enqueueBulk(values, count);
+			if (n == 0) {
+				std::this_thread::yield();
+			}
+			values += n;
+			count -= n;
+		}
+	}
+
 	bool dequeue(T* value)
 	{
 		size_t currentHead = head.load(std::memory_order_relaxed);
@@ -52,6 +82,23 @@ struct LockFreeCircleQueue
 		return val;
 	}
 
+	// dequeue up to count values, releasing their slots with a single head update.
+	// return the number of values dequeued.
+	size_t dequeueBulk(T* values, size_t count)
+	{
+		size_t currentHead = head.load(std::memory_order_relaxed);
+		size_t currentTail = tail.load(std::memory_order_acquire);
+		size_t available = (currentTail + size - currentHead) % size;
+		size_t n = count < available ? count : available;
+		for (size_t i = 0; i < n; i++) {
+			values[i] = buffer[(currentHead + i) % size];
+		}
+		if (n != 0) {
+			head.store((currentHead + n) % size, std::memory_order_release);
+		}
+		return n;
+	}
+
     // return current front but don't dequeue it.
     bool front(T* value)
     {
@@ -1,8 +1,8 @@
-#pragma once 
+#pragma once
 
 #ifdef WIN32
 #include <windows.h>
-#elif __APPLE__
+#else
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -10,144 +10,166 @@
 #endif
 
 #include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
 #include <exception>
+#include <stdexcept>
 
 #include "GlobalLogger.h"
 
+/*
+*  Read-only memory mapped file.
+*  Copies share the same mapping, which is released when the last copy is destroyed.
+*  The reference count lives inside the mapping itself, so sharing costs no extra allocation.
+*/
 struct MappedFile
 {
 	MappedFile(const std::filesystem::path& path)
 	{
-        fileSize = 0;
+		mapping = new Mapping;
 #ifdef WIN32
-		LPCWSTR fileNameLPCTSTR = path.c_str();
-		hFile = CreateFileW(fileNameLPCTSTR,GENERIC_READ | GENERIC_WRITE,0,NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
-		if (hFile == INVALID_HANDLE_VALUE) {
-			throw std::runtime_error("open failed.");
+		mapping->hFile = CreateFileW(path.c_str(),GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,
+									 FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,NULL);
+		if (mapping->hFile == INVALID_HANDLE_VALUE) {
+			release();
+			throw std::runtime_error("open failed : " + path.string());
 		}
-		fileSize = GetFileSize(hFile, NULL);
-		hMapping = CreateFileMapping(hFile,NULL,PAGE_READWRITE,0,fileSize,NULL);
-		if (hMapping == INVALID_HANDLE_VALUE) {
-            //close hFile
-			throw std::runtime_error("mapping failed.");
+		LARGE_INTEGER file_size{};
+		if (!GetFileSizeEx(mapping->hFile, &file_size)) {
+			release();
+			throw std::runtime_error("failed to query file info : " + path.string());
 		}
-		pMapped = (char*)MapViewOfFile(hMapping,FILE_MAP_ALL_ACCESS,0,0,0); //0 means the entire file
-		if (pMapped == nullptr) {
-            //close hFile
-            //close hMapping
-			throw std::runtime_error("mapping failed.");
+		mapping->size = static_cast<size_t>(file_size.QuadPart);
+		if (mapping->size != 0) {
+			//CreateFileMapping returns NULL rather than INVALID_HANDLE_VALUE on failure
+			mapping->hMapping = CreateFileMappingW(mapping->hFile,NULL,PAGE_READONLY,0,0,NULL);
+			if (mapping->hMapping == NULL) {
+				release();
+				throw std::runtime_error("mapping failed : " + path.string());
+			}
+			mapping->pMapped = (const char*)MapViewOfFile(mapping->hMapping,FILE_MAP_READ,0,0,0); //0 means the entire file
+			if (mapping->pMapped == nullptr) {
+				release();
+				throw std::runtime_error("mapping failed : " + path.string());
+			}
+		}
+#else
+		mapping->fd = open(path.c_str(), O_RDONLY);
+		if (mapping->fd == -1) {
+			release();
+			throw std::runtime_error("open failed : " + path.string());
+		}
+		struct stat file_info{};
+		if (fstat(mapping->fd, &file_info) == -1) {
+			release();
+			throw std::runtime_error("failed to query file info : " + path.string());
+		}
+		mapping->size = static_cast<size_t>(file_info.st_size);
+		if (mapping->size != 0) {
+			//mmap rejects zero length mapping, an empty file is simply left unmapped
+			void* addr = mmap(nullptr, mapping->size, PROT_READ, MAP_PRIVATE, mapping->fd, 0);
+			if (addr == MAP_FAILED) {
+				release();
+				throw std::runtime_error("mapping failed : " + path.string());
+			}
+			mapping->pMapped = (const char*)addr;
+			//scene files are consumed front to back by the tokenizer, let the kernel read ahead aggressively
+			madvise(addr, mapping->size, MADV_SEQUENTIAL);
 		}
-#elif __APPLE__
-		fd = open(path.c_str(), O_RDONLY);
-        if(fd == -1){
-            throw std::runtime_error("open failed.");
-        }
-        struct stat file_info{};
-        if(fstat(fd, & file_info) == -1){
-            close(fd);
-            throw std::runtime_error("failed to query file info.");
-        }
-        fileSize = file_info.st_size;
-        pMapped = (char*)mmap(nullptr,fileSize,PROT_READ, MAP_SHARED,fd,0);
-        if(pMapped == MAP_FAILED){
-            close(fd);
-            throw std::runtime_error("mapping failed.");
-        }
 #endif
-		ref_counter = new std::atomic<int>(0);
-        GlobalLogger::getInstance().info("opened and mapped file : " + path.string());
+		GlobalLogger::getInstance().info("opened and mapped file : " + path.string());
 	}
-	char* raw() const {
-		return pMapped;
+
+	const char* raw() const {
+		return mapping == nullptr ? nullptr : mapping->pMapped;
 	}
 
-	int size() const {
-		return fileSize;
+	size_t size() const {
+		return mapping == nullptr ? 0 : mapping->size;
 	}
 
 	~MappedFile()
 	{
-		if (ref_counter == nullptr) return;
-		if (ref_counter->load() == 0) {
-			destroy();
-		}
-		else {
-			*ref_counter -= 1;
-		}
+		release();
 	}
 
-	//Too lazy to handle self-assignment case for now...
-	MappedFile& operator=(MappedFile&&) = delete;
-	MappedFile& operator=(const MappedFile&) = delete;
-	
-	MappedFile(MappedFile&& other)
+	MappedFile(MappedFile&& other) noexcept
 	{
-		this->pMapped = other.pMapped;
-		this->ref_counter = other.ref_counter;
-		this->fileSize = other.fileSize;
+		mapping = other.mapping;
+		other.mapping = nullptr;
+	}
 
-		other.pMapped = nullptr;
-		other.ref_counter = nullptr;
-		other.fileSize = 0;
+	MappedFile(const MappedFile& other)
+	{
+		mapping = other.mapping;
+		if (mapping != nullptr)
+			mapping->refCount.fetch_add(1, std::memory_order_relaxed);
+	}
 
-#ifdef WIN32
-		this->hFile = other.hFile;
-		this->hMapping = other.hMapping;
-		
-		other.hFile = INVALID_HANDLE_VALUE;
-		other.hMapping = INVALID_HANDLE_VALUE;
-#elif __APPLE__
-        this->fd = other.fd;
-        other.fd = -1;
-#endif
+	MappedFile& operator=(MappedFile&& other) noexcept
+	{
+		if (this != &other) {
+			release();
+			mapping = other.mapping;
+			other.mapping = nullptr;
+		}
+		return *this;
 	}
 
-	MappedFile(const MappedFile& other)
+	MappedFile& operator=(const MappedFile& other)
 	{
-		this->pMapped = other.pMapped;
-		this->ref_counter = other.ref_counter;
-		this->fileSize = other.fileSize;
-#ifdef WIN32
-		this->hFile = other.hFile;
-		this->hMapping = other.hMapping;
-#elif __APPLE__
-        this->fd = other.fd;
-#endif
-		* ref_counter += 1;
+		if (mapping != other.mapping) {
+			release();
+			mapping = other.mapping;
+			if (mapping != nullptr)
+				mapping->refCount.fetch_add(1, std::memory_order_relaxed);
+		}
+		return *this;
 	}
 
 private:
-	void destroy()
+	struct Mapping
 	{
+		std::atomic<uint32_t> refCount{ 1 };
+		const char* pMapped = nullptr;
+		size_t size = 0;
 #ifdef WIN32
-		if(pMapped!=nullptr)
-			UnmapViewOfFile((LPVOID)pMapped);
-		if(hMapping != INVALID_HANDLE_VALUE)
-			CloseHandle(hMapping);
-		if(hFile != INVALID_HANDLE_VALUE)
-			CloseHandle(hFile);
-#elif __APPLE__
-        if(pMapped!= nullptr){
-            if (munmap((void*)pMapped, fileSize) == -1) {
-                perror("munmap");
-            }
-        }
-        if(fd!=-1)
-        {
-            close(fd);
-        }
+		HANDLE hFile = INVALID_HANDLE_VALUE;
+		HANDLE hMapping = NULL;
+#else
+		int fd = -1;
 #endif
-		delete ref_counter;
-	}
-
-	char* pMapped;
-	std::atomic<int>* ref_counter;
-	int fileSize;
+		~Mapping()
+		{
 #ifdef WIN32
-	HANDLE hFile;
-	HANDLE hMapping;
-#elif __APPLE__
-	int fd;
+			if (pMapped != nullptr)
+				UnmapViewOfFile((LPCVOID)pMapped);
+			if (hMapping != NULL)
+				CloseHandle(hMapping);
+			if (hFile != INVALID_HANDLE_VALUE)
+				CloseHandle(hFile);
+#else
+			if (pMapped != nullptr) {
+				if (munmap((void*)pMapped, size) == -1) {
+					perror("munmap");
+				}
+			}
+			if (fd != -1) {
+				close(fd);
+			}
 #endif
+		}
+	};
+
+	void release()
+	{
+		if (mapping == nullptr) return;
+		if (mapping->refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			delete mapping;
+		}
+		mapping = nullptr;
+	}
+
+	Mapping* mapping = nullptr;
 };
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/*
+*  Simplified levels of a mesh, built by meshoptimizer when the mesh is loaded. Every level indexes the same vertices
+*  and their indices follow each other in the index buffer of the mesh, level 0 being the mesh itself.
+*/
+struct MeshLod
+{
+    // into the index buffer of the mesh
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    // how far the level may deviate from level 0, in mesh space
+    float error;
+};
+
+struct MeshLodChain
+{
+    // InstanceCullDrawCommands has a command per level of every list
+    static constexpr uint32_t MAX_LODS = 8;
+    // smaller meshes only have level 0
+    static constexpr uint32_t MIN_TRIANGLES = 512;
+
+    // level 0 first, the errors increase with the level
+    std::vector<MeshLod> lods;
+    // indices of the levels after level 0, which keeps MeshHostObject::indices
+    std::vector<uint32_t> indices;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+/*
+*  Clusters of a mesh, built by meshoptimizer when a large mesh is loaded.
+*  The layout must match Meshlet in clusterCull.comp, clusterCull.task and clusterGBuffer.mesh.
+*/
+struct Meshlet
+{
+    // bounding sphere in mesh space, radius in w
+    glm::vec4 sphere;
+    glm::vec4 coneApex;
+    // all triangles face away from an eye for which dot(normalize(apex - eye), axis) >= cutoff, cutoff in w
+    glm::vec4 coneAxisCutoff;
+    // into MeshletData::indices, firstIndex / 3 is also the first triangle in MeshletData::triangles
+    uint32_t firstIndex;
+    // into MeshletData::vertices
+    uint32_t vertexOffset;
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+};
+static_assert(sizeof(Meshlet) == 64, "layout must match Meshlet in the cluster shaders");
+
+struct MeshletData
+{
+    // at most 64 vertices and 124 triangles per meshlet, within what every mesh shader implementation supports
+    static constexpr uint32_t MAX_VERTICES = 64;
+    static constexpr uint32_t MAX_TRIANGLES = 124;
+    // smaller meshes are drawn and culled as a whole
+    static constexpr uint32_t MIN_TRIANGLES = 8192;
+
+    std::vector<Meshlet> meshlets;
+    // mesh vertex indices of all triangles, meshlet after meshlet. Drawn by the indirect cluster draws.
+    std::vector<uint32_t> indices;
+    // meshlet local vertex to mesh vertex
+    std::vector<uint32_t> vertices;
+    // the 3 local vertex indices of a triangle packed in the low 24 bits
+    std::vector<uint32_t> triangles;
+
+    bool empty() const
+    {
+        return meshlets.empty();
+    }
+};
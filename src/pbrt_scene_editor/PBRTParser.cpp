@@ -1,14 +1,20 @@
 #include "PBRTParser.h"
 
-#include "AssetManager.hpp"
 #include <thread>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
 
-#include "scene.h"
+#include "ThreadPool.h"
 
+#include "GlobalLogger.h"
 #include "TokenParser.h"
 
 PBRTParser::ParseResult PBRTParser::parse(PBRTSceneBuilder& builder, const std::filesystem::path& path, AssetManager& assetLoader)
 {
+	parsedFiles.clear();
 	std::thread tokenizeThread([&](){
         tokenize(path);
         });
@@ -21,73 +27,40 @@ PBRTParser::ParseResult PBRTParser::parse(PBRTSceneBuilder& builder, const std::
 	return ParseResult::SUCESS;
 }
 
-#define NOT_WHITE_SPACE(c) ((c!=32 && c!= 9 && c!= 10 && c!= 11 && c!= 12 && c!=13))
-#define IS_WHITE_SPACE(c) (!NOT_WHITE_SPACE(c))
-
-void PBRTParser::nextToken(const char* text, int text_len, int* seek, int* tok_loc, int* tok_len)
+namespace
 {
-    char current_mode = 0; //0: nothing found, 1: string found, 2: comment found 3: other token found
-
+    // Tokens with null str are control markers between the scheduler's queues, only the end of
+    // stream marker is ever passed to TokenParser.
+    constexpr size_t MARKER_END_OF_FILE = 0;
+    constexpr size_t MARKER_INCLUDE = 1;
+    constexpr size_t MARKER_IMPORT = 2;
 
-    int cur_seek = *seek;
+    // MARKER_INCLUDE or MARKER_IMPORT for a directive, MARKER_END_OF_FILE for any other token
+    size_t includeDirectiveKind(const Token& t)
+    {
+        if (t.len == 7 && memcmp(t.str + t.pos, "Include", 7) == 0)
+            return MARKER_INCLUDE;
+        if (t.len == 6 && memcmp(t.str + t.pos, "Import", 6) == 0)
+            return MARKER_IMPORT;
+        return MARKER_END_OF_FILE;
+    }
 
+    // An Import'ed file must not change the graphics state of the importing file, so its tokens are
+    // stitched between these two, which the builder scopes like any attribute block.
+    constexpr char ATTRIBUTE_BEGIN[] = "AttributeBegin";
+    constexpr char ATTRIBUTE_END[] = "AttributeEnd";
+    constexpr Token IMPORT_SCOPE_BEGIN{ ATTRIBUTE_BEGIN, 0, sizeof(ATTRIBUTE_BEGIN) - 1 };
+    constexpr Token IMPORT_SCOPE_END{ ATTRIBUTE_END, 0, sizeof(ATTRIBUTE_END) - 1 };
 
-    for (; cur_seek < text_len; cur_seek++) {
-        char cur_char = text[cur_seek];
-        if (current_mode == 0) {
-            //nothing found yet
-            if (NOT_WHITE_SPACE(cur_char))
-            {
-                if (cur_char == '\"') {
-                    current_mode = 1;
-                    *tok_loc = cur_seek;
-                }
-                else if (cur_char == '#') {
-                    current_mode = 2;
-                }
-                else if (cur_char == '(' || cur_char == ')' ||
-                    cur_char == '[' || cur_char == ']' ||
-                    cur_char == '{' || cur_char == '}' ||
-                    cur_char == '<' || cur_char == '>') {
-                    *tok_loc = cur_seek;
-                    *tok_len = 1;
-                    cur_seek++;
-                    break;
-                }
-                else {
-                    current_mode = 3;
-                    *tok_loc = cur_seek;
-                }
-            }
-            continue;
-        }else if (current_mode == 1) {
-            //found string start
-            if (cur_char == '\"') {
-                cur_seek++;
-                *tok_len = cur_seek - *tok_loc;
-                break;
-            }
-            continue;
-        }else if (current_mode == 2) {
-            //found comment start
-            if (cur_char == 10 || cur_char == 13) {
-                current_mode = 0;
-            }
-            continue;
-        }else if (current_mode == 3) {
-            //found normal token start
-            if (IS_WHITE_SPACE(cur_char) || cur_char == '\"' || cur_char == '#' ||
-                cur_char == '(' || cur_char == ')' ||
-                cur_char == '[' || cur_char == ']' ||
-                cur_char == '{' || cur_char == '}' ||
-                cur_char == '<' || cur_char == '>') {
-                *tok_len = cur_seek - *tok_loc;
-                break;
-            }
-        }
+    Token makeMarker(size_t kind, size_t payload)
+    {
+        return Token{ nullptr, payload, kind };
     }
-    *seek = cur_seek;
 
+    bool isMarker(const Token& t, size_t kind)
+    {
+        return t.str == nullptr && t.len == kind;
+    }
 }
 
 void PBRTParser::tokenize(const std::filesystem::path& path)
@@ -109,52 +82,252 @@ std::string dequote1(const std::string& input) {
     }
 }
 
-void PBRTParser::tokenizeMMAP(const std::filesystem::path& path)
+/*
+*  Tokenize Include'd and Import'ed files in parallel.
+*  Every included file becomes a job. A worker claims a job, tokenizes the file into the job's own
+*  queue and replaces every nested Include/Import directive with a marker referring to a new job.
+*  The tokenizer thread stitches the queues back into PBRTParser::token_queue in directive order,
+*  following markers depth-first, so TokenParser sees exactly the token stream of a serial include.
+*  When the stitcher reaches a job no worker has claimed yet, it tokenizes the file itself, so it
+*  never waits on a job that is stuck behind others in the pool.
+*/
+struct IncludeScheduler
 {
-		std::vector<std::pair<MappedFile, int>> handleFileStack;
-		openedMappedFile.emplace_back(path);
-		handleFileStack.push_back({ openedMappedFile.back(),0 });
-		while (!handleFileStack.empty())
-		{
-			auto& f = handleFileStack.back().first;
-			int* cur_seek_ptr = &handleFileStack.back().second;
-
-			while (*cur_seek_ptr != f.size())
-			{
-				int tok_loc = 0;
-				int tok_len = 0;
-				nextToken(f.raw(), f.size(), cur_seek_ptr, &tok_loc, &tok_len);
-				if (strncmp("Include",f.raw()+tok_loc,tok_len)==0) {
-					nextToken(f.raw(), f.size(), cur_seek_ptr, &tok_loc, &tok_len);
-					if (tok_len == 0) {
-						handleFileStack.pop_back();
-						break;
-					}
-                    auto pbrtFormatPath = dequote1(std::string(f.raw() + tok_loc, tok_len));
-                    auto searchDir = path.parent_path();
-                    size_t pos = pbrtFormatPath.find('/');
-                    while (pos != std::string::npos) {
-                        searchDir.append(pbrtFormatPath.substr(0,pos));
-                        pbrtFormatPath = pbrtFormatPath.substr(pos + 1);
-                        pos = pbrtFormatPath.find('/');
-                    }
-                    searchDir.append(pbrtFormatPath);
-
-				    openedMappedFile.emplace_back(searchDir);
-					handleFileStack.push_back({ openedMappedFile.back(),0 });
-					break;
-				}
-                Token t{ f.raw(),tok_loc,tok_len };
-                /*for (int i = 0; i < t.len; i++) {
-                    printf("%c", (t.str + t.pos)[i]);
+    IncludeScheduler(PBRTParser& _parser, std::filesystem::path _searchDir)
+        : parser(_parser), searchDir(std::move(_searchDir)),
+          permits(2 * workerCount()), workers(workerCount()) {}
+
+    void run(const std::filesystem::path& root)
+    {
+        consume(addJob(root));
+    }
+
+private:
+    enum JobState
+    {
+        JOB_PENDING,
+        JOB_ON_WORKER,
+        JOB_INLINE
+    };
+
+    struct FileJob
+    {
+        explicit FileJob(std::filesystem::path _path) : path(std::move(_path)) {}
+        std::filesystem::path path;
+        std::atomic<int> state{ JOB_PENDING };
+        std::atomic<bool> ready{ false };
+        std::unique_ptr<LockFreeCircleQueue<Token>> queue;
+    };
+
+    static size_t workerCount()
+    {
+        // the tokenizer and the token parser already own a thread each
+        unsigned int hw = std::thread::hardware_concurrency();
+        return hw > 3 ? hw - 2 : 1;
+    }
+
+    static size_t queueCapacity(size_t fileSize)
+    {
+        // every token takes at least two bytes including its delimiter
+        size_t estimate = fileSize / 2 + 2;
+        return std::clamp<size_t>(estimate, 1024, 1 << 18);
+    }
+
+    FileJob& getJob(size_t idx)
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        return jobs[idx];
+    }
+
+    size_t addJob(const std::filesystem::path& path)
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        jobs.emplace_back(path);
+        return jobs.size() - 1;
+    }
+
+    size_t scheduleJob(const Token& fileNameTok)
+    {
+        auto pbrtFormatPath = dequote1(fileNameTok.to_string());
+        auto filePath = searchDir;
+        size_t pos = pbrtFormatPath.find('/');
+        while (pos != std::string::npos) {
+            filePath.append(pbrtFormatPath.substr(0,pos));
+            pbrtFormatPath = pbrtFormatPath.substr(pos + 1);
+            pos = pbrtFormatPath.find('/');
+        }
+        filePath.append(pbrtFormatPath);
+
+        size_t idx = addJob(filePath);
+        workers.enqueue([this, idx](int) { runOnWorker(idx); });
+        return idx;
+    }
+
+    void acquirePermit()
+    {
+        std::unique_lock<std::mutex> lock(permitMutex);
+        permitCV.wait(lock, [this] { return permits > 0; });
+        permits--;
+    }
+
+    void releasePermit()
+    {
+        {
+            std::lock_guard<std::mutex> lock(permitMutex);
+            permits++;
+        }
+        permitCV.notify_one();
+    }
+
+    MappedFile openFile(const std::filesystem::path& path)
+    {
+        MappedFile f(path);
+        std::lock_guard<std::mutex> lock(parser.openedMappedFileMutex);
+        parser.openedMappedFile.push_back(f);
+        parser.parsedFiles.push_back(path);
+        return f;
+    }
+
+    // Replace every Include/Import directive of the batch by a marker of a newly scheduled job.
+    // Return the number of tokens left in the batch.
+    size_t replaceIncludes(Token* batch, size_t count, size_t* seek, bool at_eof)
+    {
+        size_t kept = 0;
+        for (size_t i = 0; i < count; i++) {
+            size_t kind = includeDirectiveKind(batch[i]);
+            if (kind == MARKER_END_OF_FILE) {
+                batch[kept++] = batch[i];
+                continue;
+            }
+            if (i + 1 == count) {
+                if (at_eof) {
+                    GlobalLogger::getInstance().error("Include without file name");
+                } else {
+                    //the file name is in the next batch, start over from the directive
+                    *seek = batch[i].pos;
                 }
-                printf("\n");
-                printf("\t [offset : %d \t length : %d\n]", t.pos, t.len);*/
-				token_queue.waitAndEnqueue(t);
-			}
-		}
+                break;
+            }
+            batch[kept++] = makeMarker(kind, scheduleJob(batch[++i]));
+        }
+        return kept;
+    }
+
+    template<class Sink>
+    void tokenizeFile(const MappedFile& f, Sink&& sink)
+    {
+        std::vector<Token> batch(PBRTParser::TOKEN_BATCH_SIZE);
+        size_t seek = 0;
+        while (seek < f.size()) {
+            size_t count = PBRTParser::nextTokens(f.raw(), f.size(), &seek, batch.data(), batch.size());
+            count = replaceIncludes(batch.data(), count, &seek, count < batch.size());
+            sink(batch.data(), count);
+        }
+    }
+
+    void runOnWorker(size_t idx)
+    {
+        acquirePermit();
+        auto& job = getJob(idx);
+        int expected = JOB_PENDING;
+        if (!job.state.compare_exchange_strong(expected, JOB_ON_WORKER)) {
+            //the stitcher got there first
+            releasePermit();
+            return;
+        }
+        try {
+            auto f = openFile(job.path);
+            job.queue = std::make_unique<LockFreeCircleQueue<Token>>(queueCapacity(f.size()));
+            job.ready.store(true, std::memory_order_release);
+            tokenizeFile(f, [&job](const Token* tokens, size_t count) {
+                job.queue->waitAndEnqueueBulk(tokens, count);
+            });
+        } catch (const std::exception& e) {
+            GlobalLogger::getInstance().error(std::string("Failed to tokenize included file : ") + e.what());
+        }
+        if (!job.ready.load(std::memory_order_relaxed)) {
+            job.queue = std::make_unique<LockFreeCircleQueue<Token>>(2);
+            job.ready.store(true, std::memory_order_release);
+        }
+        job.queue->waitAndEnqueue(makeMarker(MARKER_END_OF_FILE, 0));
+    }
+
+    // Forward tokens to the token parser, descending into the included file at each marker.
+    void forward(const Token* tokens, size_t count)
+    {
+        size_t run_start = 0;
+        for (size_t i = 0; i < count; i++) {
+            bool include = isMarker(tokens[i], MARKER_INCLUDE);
+            bool import = isMarker(tokens[i], MARKER_IMPORT);
+            if (include || import) {
+                parser.token_queue.waitAndEnqueueBulk(tokens + run_start, i - run_start);
+                if (import)
+                    parser.token_queue.waitAndEnqueue(IMPORT_SCOPE_BEGIN);
+                consume(tokens[i].pos);
+                if (import)
+                    parser.token_queue.waitAndEnqueue(IMPORT_SCOPE_END);
+                run_start = i + 1;
+            }
+        }
+        parser.token_queue.waitAndEnqueueBulk(tokens + run_start, count - run_start);
+    }
+
+    void consume(size_t idx)
+    {
+        auto& job = getJob(idx);
+        int expected = JOB_PENDING;
+        if (job.state.compare_exchange_strong(expected, JOB_INLINE)) {
+            try {
+                auto f = openFile(job.path);
+                tokenizeFile(f, [this](const Token* tokens, size_t count) { forward(tokens, count); });
+            } catch (const std::exception& e) {
+                GlobalLogger::getInstance().error(std::string("Failed to tokenize file : ") + e.what());
+            }
+            return;
+        }
+
+        while (!job.ready.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+        std::vector<Token> buffer(PBRTParser::TOKEN_BATCH_SIZE);
+        bool end_of_file = false;
+        while (!end_of_file) {
+            size_t count = job.queue->dequeueBulk(buffer.data(), buffer.size());
+            if (count == 0) {
+                std::this_thread::yield();
+                continue;
+            }
+            if (isMarker(buffer[count - 1], MARKER_END_OF_FILE)) {
+                end_of_file = true;
+                count--;
+            }
+            forward(buffer.data(), count);
+        }
+        job.queue.reset();
+        releasePermit();
+    }
+
+    PBRTParser& parser;
+    std::filesystem::path searchDir;
+
+    std::mutex jobsMutex;
+    std::deque<FileJob> jobs;
+
+    std::mutex permitMutex;
+    std::condition_variable permitCV;
+    size_t permits;
 
-        token_queue.waitAndEnqueue({ nullptr,0,0 });
+    // declared last so that workers are joined before the jobs they reference are destroyed
+    ThreadPool workers;
+};
+
+void PBRTParser::tokenizeMMAP(const std::filesystem::path& path)
+{
+    {
+        IncludeScheduler scheduler(*this, path.parent_path());
+        scheduler.run(path);
+    }
+    token_queue.waitAndEnqueue({ nullptr,0,0 });
 }
 
 void PBRTParser::parseToken(PBRTSceneBuilder& builder, AssetManager& assetLoader)
@@ -7,15 +7,16 @@
 #include "MappedFile.hpp"
 
 #include <filesystem>
+#include <mutex>
 
 struct AssetManager;
 struct PBRTSceneBuilder;
 
 struct Token
 {
-	char* str;
-	int pos;
-	int len;
+	const char* str;
+	size_t pos;
+	size_t len;
 
     auto to_string() const{
         return std::string(str + pos,len);
@@ -36,11 +37,19 @@ struct PBRTParser
 
 	bool g_use_mmap = true;
 
+	// root file and every Include'd/Import'ed file read by the last parse, in no particular order
+	std::vector<std::filesystem::path> parsedFiles;
+
+	// block tokenizer, defined in PBRTTokenizer.cpp
+	static size_t nextTokens(const char* text, size_t text_len, size_t* seek, Token* out, size_t max_count);
+
 private:
+	friend struct IncludeScheduler;
+	static constexpr size_t TOKEN_BATCH_SIZE = 1024;
 	LockFreeCircleQueue<Token> token_queue{ 10000 };
-	void nextToken(const char* text, int text_len, int* seek, int* tok_loc, int* tok_len);
 	void tokenize(const std::filesystem::path& path);
 	void tokenizeMMAP(const std::filesystem::path& path);
 	void parseToken(PBRTSceneBuilder& builder, AssetManager& assetLoader);
+	std::mutex openedMappedFileMutex;
 	std::vector<MappedFile> openedMappedFile;
 };
\ No newline at end of file
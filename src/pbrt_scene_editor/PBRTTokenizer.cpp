@@ -0,0 +1,247 @@
+#include "PBRTParser.h"
+
+#include <cstring>
+#include <cstdint>
+
+// EDITOR_TOKENIZER_SCALAR forces the lookup table path, the equivalence test builds every path this way
+#if defined(__AVX2__) && !defined(EDITOR_TOKENIZER_SCALAR)
+#define TOKENIZER_AVX2
+#include <immintrin.h>
+#elif (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)) && !defined(EDITOR_TOKENIZER_SCALAR)
+#define TOKENIZER_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/*
+*  Block tokenizer.
+*  The text is processed in 64 bytes blocks. Each block is first classified into bitmasks
+*  (one bit per byte) with SIMD compares, then the tokenizer jumps from one interesting byte
+*  to the next with count-trailing-zeros instead of testing every character.
+*/
+namespace
+{
+    constexpr size_t TOKENIZER_BLOCK_SIZE = 64;
+
+    struct BlockMasks
+    {
+        uint64_t whitespace;
+        uint64_t quote;
+        uint64_t comment;
+        uint64_t newline;
+        uint64_t bracket;
+    };
+
+    inline uint64_t bitsFrom(size_t i)
+    {
+        return i >= 64 ? 0 : (~uint64_t(0) << i);
+    }
+
+    inline size_t countTrailingZeros(uint64_t mask)
+    {
+#ifdef _MSC_VER
+        unsigned long idx;
+        _BitScanForward64(&idx, mask);
+        return idx;
+#else
+        return __builtin_ctzll(mask);
+#endif
+    }
+
+#if defined(TOKENIZER_AVX2)
+    inline uint32_t classify32(__m256i v, char c)
+    {
+        return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(c)));
+    }
+
+    inline void classifyBlock(const char* block, BlockMasks& masks)
+    {
+        masks = {};
+        for (int i = 0; i < 2; i++) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(block + 32 * i));
+            // 9 ~ 13 : \t \n \v \f \r
+            __m256i ctrl = _mm256_sub_epi8(v, _mm256_set1_epi8(9));
+            uint32_t ctrl_ws = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(ctrl, _mm256_set1_epi8(4)), ctrl));
+            int shift = 32 * i;
+            masks.whitespace |= uint64_t(ctrl_ws | classify32(v, ' ')) << shift;
+            masks.quote |= uint64_t(classify32(v, '\"')) << shift;
+            masks.comment |= uint64_t(classify32(v, '#')) << shift;
+            masks.newline |= uint64_t(classify32(v, '\n') | classify32(v, '\r')) << shift;
+            masks.bracket |= uint64_t(classify32(v, '(') | classify32(v, ')') |
+                                      classify32(v, '[') | classify32(v, ']') |
+                                      classify32(v, '{') | classify32(v, '}') |
+                                      classify32(v, '<') | classify32(v, '>')) << shift;
+        }
+    }
+#elif defined(TOKENIZER_SSE2)
+    inline uint32_t classify16(__m128i v, char c)
+    {
+        return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+    }
+
+    inline void classifyBlock(const char* block, BlockMasks& masks)
+    {
+        masks = {};
+        for (int i = 0; i < 4; i++) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(block + 16 * i));
+            // 9 ~ 13 : \t \n \v \f \r
+            __m128i ctrl = _mm_sub_epi8(v, _mm_set1_epi8(9));
+            uint32_t ctrl_ws = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(ctrl, _mm_set1_epi8(4)), ctrl));
+            int shift = 16 * i;
+            masks.whitespace |= uint64_t(ctrl_ws | classify16(v, ' ')) << shift;
+            masks.quote |= uint64_t(classify16(v, '\"')) << shift;
+            masks.comment |= uint64_t(classify16(v, '#')) << shift;
+            masks.newline |= uint64_t(classify16(v, '\n') | classify16(v, '\r')) << shift;
+            masks.bracket |= uint64_t(classify16(v, '(') | classify16(v, ')') |
+                                      classify16(v, '[') | classify16(v, ']') |
+                                      classify16(v, '{') | classify16(v, '}') |
+                                      classify16(v, '<') | classify16(v, '>')) << shift;
+        }
+    }
+#else
+    enum CharClass : uint8_t
+    {
+        CHAR_WHITESPACE = 1,
+        CHAR_QUOTE = 2,
+        CHAR_COMMENT = 4,
+        CHAR_NEWLINE = 8,
+        CHAR_BRACKET = 16
+    };
+
+    struct CharClassTable
+    {
+        uint8_t classes[256]{};
+        constexpr CharClassTable()
+        {
+            for (unsigned char c : {9, 10, 11, 12, 13, 32}) classes[c] |= CHAR_WHITESPACE;
+            for (unsigned char c : {10, 13}) classes[c] |= CHAR_NEWLINE;
+            for (unsigned char c : {'(', ')', '[', ']', '{', '}', '<', '>'}) classes[c] |= CHAR_BRACKET;
+            classes[(unsigned char)'\"'] |= CHAR_QUOTE;
+            classes[(unsigned char)'#'] |= CHAR_COMMENT;
+        }
+    };
+
+    constexpr CharClassTable charClassTable{};
+
+    inline void classifyBlock(const char* block, BlockMasks& masks)
+    {
+        masks = {};
+        for (size_t i = 0; i < TOKENIZER_BLOCK_SIZE; i++) {
+            uint8_t cls = charClassTable.classes[(unsigned char)block[i]];
+            uint64_t bit = uint64_t(1) << i;
+            if (cls & CHAR_WHITESPACE) masks.whitespace |= bit;
+            if (cls & CHAR_QUOTE) masks.quote |= bit;
+            if (cls & CHAR_COMMENT) masks.comment |= bit;
+            if (cls & CHAR_NEWLINE) masks.newline |= bit;
+            if (cls & CHAR_BRACKET) masks.bracket |= bit;
+        }
+    }
+#endif
+}
+
+/*
+*  Tokenize text starting from *seek until max_count tokens are produced or the end of text is reached.
+*  Stops only at token boundaries, so *seek can always be used to resume.
+*  Return the number of tokens written to out.
+*/
+size_t PBRTParser::nextTokens(const char* text, size_t text_len, size_t* seek, Token* out, size_t max_count)
+{
+    char current_mode = 0; //0: nothing found, 1: string found, 2: comment found 3: other token found
+    size_t tok_loc = 0;
+    size_t count = 0;
+
+    size_t cur_seek = *seek;
+    BlockMasks masks{};
+    // bytes past the end of text are padded with white space, which terminates trailing tokens naturally
+    char padded[TOKENIZER_BLOCK_SIZE];
+
+    while (cur_seek < text_len)
+    {
+        size_t block_base = cur_seek - cur_seek % TOKENIZER_BLOCK_SIZE;
+        if (block_base + TOKENIZER_BLOCK_SIZE <= text_len) {
+            classifyBlock(text + block_base, masks);
+        } else {
+            memset(padded, ' ', TOKENIZER_BLOCK_SIZE);
+            memcpy(padded, text + block_base, text_len - block_base);
+            classifyBlock(padded, masks);
+        }
+
+        size_t p = cur_seek - block_base;
+        while (p < TOKENIZER_BLOCK_SIZE)
+        {
+            uint64_t ahead = bitsFrom(p);
+            if (current_mode == 0) {
+                uint64_t m = ~masks.whitespace & ahead;
+                if (m == 0) {
+                    p = TOKENIZER_BLOCK_SIZE;
+                    break;
+                }
+                p = countTrailingZeros(m);
+                uint64_t bit = uint64_t(1) << p;
+                if (masks.quote & bit) {
+                    current_mode = 1;
+                    tok_loc = block_base + p;
+                } else if (masks.comment & bit) {
+                    current_mode = 2;
+                } else if (masks.bracket & bit) {
+                    out[count++] = Token{ text, block_base + p, 1 };
+                    if (count == max_count) {
+                        *seek = block_base + p + 1;
+                        return count;
+                    }
+                } else {
+                    current_mode = 3;
+                    tok_loc = block_base + p;
+                }
+                p++;
+            } else if (current_mode == 1) {
+                //found string start, look for the closing quote
+                uint64_t m = masks.quote & ahead;
+                if (m == 0) {
+                    p = TOKENIZER_BLOCK_SIZE;
+                    break;
+                }
+                p = countTrailingZeros(m) + 1;
+                out[count++] = Token{ text, tok_loc, block_base + p - tok_loc };
+                current_mode = 0;
+                if (count == max_count) {
+                    *seek = block_base + p;
+                    return count;
+                }
+            } else if (current_mode == 2) {
+                //found comment start, skip to the end of line
+                uint64_t m = masks.newline & ahead;
+                if (m == 0) {
+                    p = TOKENIZER_BLOCK_SIZE;
+                    break;
+                }
+                p = countTrailingZeros(m) + 1;
+                current_mode = 0;
+            } else {
+                //found normal token start, look for any delimiter
+                uint64_t m = (masks.whitespace | masks.quote | masks.comment | masks.bracket) & ahead;
+                if (m == 0) {
+                    p = TOKENIZER_BLOCK_SIZE;
+                    break;
+                }
+                p = countTrailingZeros(m);
+                out[count++] = Token{ text, tok_loc, block_base + p - tok_loc };
+                current_mode = 0;
+                if (count == max_count) {
+                    *seek = block_base + p;
+                    return count;
+                }
+            }
+        }
+        cur_seek = block_base + p;
+    }
+
+    if (current_mode == 1 || current_mode == 3) {
+        //unterminated string or token at the very end of text
+        out[count++] = Token{ text, tok_loc, text_len - tok_loc };
+    }
+    *seek = text_len;
+    return count;
+}
@@ -0,0 +1,660 @@
+#include "PLYReader.hpp"
+
+#include "AssetManager.hpp"
+#include "MappedFile.hpp"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+    enum class PLYFormat
+    {
+        Ascii,
+        BinaryLittleEndian,
+        BinaryBigEndian
+    };
+
+    enum class PLYType : uint8_t
+    {
+        Int8,
+        UInt8,
+        Int16,
+        UInt16,
+        Int32,
+        UInt32,
+        Float32,
+        Float64
+    };
+
+    struct PLYProperty
+    {
+        std::string name;
+        PLYType type;
+        bool isList = false;
+        PLYType countType = PLYType::UInt8;
+    };
+
+    struct PLYElement
+    {
+        std::string name;
+        size_t count = 0;
+        std::vector<PLYProperty> properties;
+    };
+
+    struct PLYHeader
+    {
+        PLYFormat format = PLYFormat::Ascii;
+        std::vector<PLYElement> elements;
+    };
+
+    [[noreturn]] void plyError(const std::string& msg)
+    {
+        throw std::runtime_error("PLY : " + msg);
+    }
+
+    size_t typeSize(PLYType type)
+    {
+        switch (type)
+        {
+            case PLYType::Int8:
+            case PLYType::UInt8:
+                return 1;
+            case PLYType::Int16:
+            case PLYType::UInt16:
+                return 2;
+            case PLYType::Int32:
+            case PLYType::UInt32:
+            case PLYType::Float32:
+                return 4;
+            case PLYType::Float64:
+                return 8;
+        }
+        return 0;
+    }
+
+    PLYType toPLYType(std::string_view str)
+    {
+        if (str == "char" || str == "int8") return PLYType::Int8;
+        if (str == "uchar" || str == "uint8") return PLYType::UInt8;
+        if (str == "short" || str == "int16") return PLYType::Int16;
+        if (str == "ushort" || str == "uint16") return PLYType::UInt16;
+        if (str == "int" || str == "int32") return PLYType::Int32;
+        if (str == "uint" || str == "uint32") return PLYType::UInt32;
+        if (str == "float" || str == "float32") return PLYType::Float32;
+        if (str == "double" || str == "float64") return PLYType::Float64;
+        plyError("unknown property type " + std::string(str));
+    }
+
+    bool hostIsLittleEndian()
+    {
+        const uint16_t one = 1;
+        return *reinterpret_cast<const uint8_t*>(&one) == 1;
+    }
+
+    // Whole file mapped in memory.
+    struct MappedSource
+    {
+        explicit MappedSource(const std::filesystem::path& path) : file(path)
+        {
+            cur = file.raw();
+            end = cur + file.size();
+        }
+
+        const char* need(size_t n)
+        {
+            if (static_cast<size_t>(end - cur) < n)
+                plyError("unexpected end of file");
+            return cur;
+        }
+
+        void advance(size_t n) { cur += n; }
+
+        bool atEnd() { return cur == end; }
+
+        MappedFile file;
+        const char* cur;
+        const char* end;
+    };
+
+    // Gzip'd file inflated into a sliding window, only the bytes of the record being decoded need to be contiguous.
+    struct GzipSource
+    {
+        static constexpr size_t WINDOW_SIZE = 4 << 20;
+
+        explicit GzipSource(const std::filesystem::path& path) : file(path), window(WINDOW_SIZE)
+        {
+            // 16 + MAX_WBITS : expect a gzip header
+            if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK)
+                plyError("failed to initialize zlib");
+        }
+
+        ~GzipSource()
+        {
+            inflateEnd(&stream);
+        }
+
+        GzipSource(const GzipSource&) = delete;
+        GzipSource& operator=(const GzipSource&) = delete;
+
+        const char* need(size_t n)
+        {
+            while (end - begin < n)
+            {
+                if (finished)
+                    plyError("unexpected end of file");
+                refill(n);
+            }
+            return window.data() + begin;
+        }
+
+        void advance(size_t n) { begin += n; }
+
+        bool atEnd()
+        {
+            while (begin == end && !finished)
+                refill(1);
+            return begin == end;
+        }
+
+        void refill(size_t n)
+        {
+            if (begin != 0)
+            {
+                std::memmove(window.data(), window.data() + begin, end - begin);
+                end -= begin;
+                begin = 0;
+            }
+            if (window.size() < n)
+                window.resize(std::max(n, window.size() * 2));
+            if (stream.avail_in == 0)
+            {
+                // avail_in is 32 bits, feed huge files in chunks
+                size_t chunk = std::min<size_t>(file.size() - inputOffset, UINT_MAX);
+                stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(file.raw() + inputOffset));
+                stream.avail_in = static_cast<uInt>(chunk);
+                inputOffset += chunk;
+            }
+            stream.next_out = reinterpret_cast<Bytef*>(window.data() + end);
+            stream.avail_out = static_cast<uInt>(std::min<size_t>(window.size() - end, UINT_MAX));
+            auto ret = inflate(&stream, Z_NO_FLUSH);
+            end = window.size() - stream.avail_out;
+            if (ret == Z_STREAM_END)
+                finished = true;
+            else if (ret == Z_BUF_ERROR && stream.avail_in == 0 && inputOffset == file.size())
+                finished = true; // truncated stream, reported by need()
+            else if (ret != Z_OK && ret != Z_BUF_ERROR)
+                plyError(std::string("corrupted gzip stream : ") + (stream.msg != nullptr ? stream.msg : ""));
+        }
+
+        MappedFile file;
+        size_t inputOffset = 0;
+        z_stream stream{};
+        std::vector<char> window;
+        size_t begin = 0;
+        size_t end = 0;
+        bool finished = false;
+    };
+
+    template<class Source>
+    std::string_view readLine(Source& src, std::string& line)
+    {
+        line.clear();
+        while (!src.atEnd())
+        {
+            char c = *src.need(1);
+            src.advance(1);
+            if (c == '\n')
+                break;
+            if (c != '\r')
+                line.push_back(c);
+        }
+        return line;
+    }
+
+    std::vector<std::string_view> splitWords(std::string_view line)
+    {
+        std::vector<std::string_view> words;
+        size_t pos = 0;
+        while (pos < line.size())
+        {
+            while (pos < line.size() && (line[pos] == ' ' || line[pos] == '\t'))
+                pos++;
+            size_t start = pos;
+            while (pos < line.size() && line[pos] != ' ' && line[pos] != '\t')
+                pos++;
+            if (pos > start)
+                words.push_back(line.substr(start, pos - start));
+        }
+        return words;
+    }
+
+    size_t parseCount(std::string_view str)
+    {
+        size_t count = 0;
+        auto res = std::from_chars(str.data(), str.data() + str.size(), count);
+        if (res.ec != std::errc() || res.ptr != str.data() + str.size())
+            plyError("invalid element count " + std::string(str));
+        return count;
+    }
+
+    template<class Source>
+    PLYHeader readHeader(Source& src)
+    {
+        PLYHeader header;
+        std::string line;
+        if (readLine(src, line) != "ply")
+            plyError("missing magic number");
+        bool hasFormat = false;
+        while (true)
+        {
+            if (src.atEnd())
+                plyError("missing end_header");
+            auto words = splitWords(readLine(src, line));
+            if (words.empty() || words[0] == "comment" || words[0] == "obj_info")
+                continue;
+            if (words[0] == "end_header")
+                break;
+            if (words[0] == "format" && words.size() >= 2)
+            {
+                if (words[1] == "ascii") header.format = PLYFormat::Ascii;
+                else if (words[1] == "binary_little_endian") header.format = PLYFormat::BinaryLittleEndian;
+                else if (words[1] == "binary_big_endian") header.format = PLYFormat::BinaryBigEndian;
+                else plyError("unknown format " + std::string(words[1]));
+                hasFormat = true;
+            }
+            else if (words[0] == "element" && words.size() == 3)
+            {
+                auto& element = header.elements.emplace_back();
+                element.name = words[1];
+                element.count = parseCount(words[2]);
+            }
+            else if (words[0] == "property" && !header.elements.empty())
+            {
+                PLYProperty property;
+                if (words.size() == 5 && words[1] == "list")
+                {
+                    property.isList = true;
+                    property.countType = toPLYType(words[2]);
+                    property.type = toPLYType(words[3]);
+                    property.name = words[4];
+                }
+                else if (words.size() == 3)
+                {
+                    property.type = toPLYType(words[1]);
+                    property.name = words[2];
+                }
+                else
+                {
+                    plyError("invalid property declaration : " + line);
+                }
+                header.elements.back().properties.push_back(std::move(property));
+            }
+            else
+            {
+                plyError("invalid header line : " + line);
+            }
+        }
+        if (!hasFormat)
+            plyError("missing format");
+        return header;
+    }
+
+    template<class T>
+    T loadScalar(const char* p, bool swap)
+    {
+        char bytes[sizeof(T)];
+        std::memcpy(bytes, p, sizeof(T));
+        if (swap)
+            std::reverse(bytes, bytes + sizeof(T));
+        T value;
+        std::memcpy(&value, bytes, sizeof(T));
+        return value;
+    }
+
+    template<class Dst>
+    Dst loadAs(const char* p, PLYType type, bool swap)
+    {
+        switch (type)
+        {
+            case PLYType::Int8: return static_cast<Dst>(loadScalar<int8_t>(p, swap));
+            case PLYType::UInt8: return static_cast<Dst>(loadScalar<uint8_t>(p, swap));
+            case PLYType::Int16: return static_cast<Dst>(loadScalar<int16_t>(p, swap));
+            case PLYType::UInt16: return static_cast<Dst>(loadScalar<uint16_t>(p, swap));
+            case PLYType::Int32: return static_cast<Dst>(loadScalar<int32_t>(p, swap));
+            case PLYType::UInt32: return static_cast<Dst>(loadScalar<uint32_t>(p, swap));
+            case PLYType::Float32: return static_cast<Dst>(loadScalar<float>(p, swap));
+            case PLYType::Float64: return static_cast<Dst>(loadScalar<double>(p, swap));
+        }
+        return Dst{};
+    }
+
+    template<class Source>
+    struct BinaryValues
+    {
+        Source& src;
+        bool swap;
+
+        template<class Dst>
+        Dst read(PLYType type)
+        {
+            auto size = typeSize(type);
+            auto value = loadAs<Dst>(src.need(size), type, swap);
+            src.advance(size);
+            return value;
+        }
+
+        void skip(PLYType type, size_t count)
+        {
+            auto size = typeSize(type) * count;
+            src.need(size);
+            src.advance(size);
+        }
+    };
+
+    template<class Source>
+    struct AsciiValues
+    {
+        Source& src;
+
+        std::string_view nextWord()
+        {
+            while (!src.atEnd())
+            {
+                char c = *src.need(1);
+                if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+                    break;
+                src.advance(1);
+            }
+            word.clear();
+            while (!src.atEnd())
+            {
+                char c = *src.need(1);
+                if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+                    break;
+                word.push_back(c);
+                src.advance(1);
+            }
+            if (word.empty())
+                plyError("unexpected end of file");
+            return word;
+        }
+
+        template<class Dst>
+        Dst read(PLYType type)
+        {
+            nextWord();
+            if (type == PLYType::Float32 || type == PLYType::Float64)
+            {
+                char* end = nullptr;
+                double value = std::strtod(word.c_str(), &end);
+                if (end != word.c_str() + word.size())
+                    plyError("invalid number " + word);
+                return static_cast<Dst>(value);
+            }
+            long long value = 0;
+            auto res = std::from_chars(word.data(), word.data() + word.size(), value);
+            if (res.ec != std::errc() || res.ptr != word.data() + word.size())
+                plyError("invalid number " + word);
+            return static_cast<Dst>(value);
+        }
+
+        void skip(PLYType type, size_t count)
+        {
+            for (size_t i = 0; i < count; i++)
+                nextWord();
+        }
+
+        std::string word;
+    };
+
+    // Growable array that hands its storage over to MeshHostObject without a final copy.
+    template<class T>
+    struct GrowBuffer
+    {
+        std::unique_ptr<T[]> data;
+        size_t size = 0;
+        size_t capacity = 0;
+
+        void reserve(size_t n)
+        {
+            if (n <= capacity)
+                return;
+            std::unique_ptr<T[]> grown(new T[n]);
+            if (size != 0)
+                std::memcpy(grown.get(), data.get(), size * sizeof(T));
+            data = std::move(grown);
+            capacity = n;
+        }
+
+        void push(T value)
+        {
+            if (size == capacity)
+                reserve(std::max<size_t>(capacity * 2, 64));
+            data[size++] = value;
+        }
+    };
+
+    int vertexFieldOffset(const std::string& name, const MeshHostObject::AttributeLayout& layout)
+    {
+        if (name == "x") return 0;
+        if (name == "y") return 4;
+        if (name == "z") return 8;
+        if (layout.normalOffset >= 0)
+        {
+            if (name == "nx") return layout.normalOffset;
+            if (name == "ny") return layout.normalOffset + 4;
+            if (name == "nz") return layout.normalOffset + 8;
+        }
+        if (layout.uvOffset >= 0)
+        {
+            if (name == "u" || name == "s" || name == "texture_u" || name == "texture_s") return layout.uvOffset;
+            if (name == "v" || name == "t" || name == "texture_v" || name == "texture_t") return layout.uvOffset + 4;
+        }
+        return -1;
+    }
+
+    bool hasProperty(const PLYElement& element, std::initializer_list<std::string_view> names)
+    {
+        for (const auto& property : element.properties)
+        {
+            for (auto name : names)
+            {
+                if (property.name == name)
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    template<class Values>
+    void skipElement(Values& values, const PLYElement& element)
+    {
+        for (size_t i = 0; i < element.count; i++)
+        {
+            for (const auto& property : element.properties)
+            {
+                if (property.isList)
+                    values.skip(property.type, values.template read<size_t>(property.countType));
+                else
+                    values.skip(property.type, 1);
+            }
+        }
+    }
+
+    template<class Values>
+    void readVertices(Values& values, const PLYElement& element, MeshHostObject& mesh, unsigned char* base,
+                      const MeshHostObject::AttributeLayout& layout)
+    {
+        std::vector<int> offsets;
+        for (const auto& property : element.properties)
+            offsets.push_back(property.isList ? -1 : vertexFieldOffset(property.name, layout));
+
+        float* aabb = mesh.aabb;
+        for (size_t i = 0; i < element.count; i++)
+        {
+            auto* vertex = base + i * layout.VertexStride;
+            for (size_t p = 0; p < element.properties.size(); p++)
+            {
+                const auto& property = element.properties[p];
+                if (property.isList)
+                {
+                    values.skip(property.type, values.template read<size_t>(property.countType));
+                }
+                else if (offsets[p] < 0)
+                {
+                    values.skip(property.type, 1);
+                }
+                else
+                {
+                    float value = values.template read<float>(property.type);
+                    std::memcpy(vertex + offsets[p], &value, sizeof(float));
+                }
+            }
+            float position[3];
+            std::memcpy(position, vertex, sizeof(position));
+            for (int k = 0; k < 3; k++)
+            {
+                aabb[k] = std::min(aabb[k], position[k]);
+                aabb[k + 3] = std::max(aabb[k + 3], position[k]);
+            }
+        }
+    }
+
+    template<class Values>
+    void readFaces(Values& values, const PLYElement& element, MeshHostObject& mesh)
+    {
+        GrowBuffer<unsigned int> indices;
+        GrowBuffer<int> faceIndices;
+        bool hasFaceIndices = hasProperty(element, { "face_indices" });
+        indices.reserve(element.count * 3);
+        if (hasFaceIndices)
+            faceIndices.reserve(element.count);
+
+        std::vector<unsigned int> polygon;
+        for (size_t i = 0; i < element.count; i++)
+        {
+            polygon.clear();
+            int faceIndex = 0;
+            for (const auto& property : element.properties)
+            {
+                if (property.isList)
+                {
+                    auto count = values.template read<size_t>(property.countType);
+                    if (property.name != "vertex_indices" && property.name != "vertex_index")
+                    {
+                        values.skip(property.type, count);
+                        continue;
+                    }
+                    for (size_t k = 0; k < count; k++)
+                    {
+                        auto idx = values.template read<unsigned int>(property.type);
+                        if (idx >= mesh.vertex_count)
+                            plyError("face references vertex " + std::to_string(idx) + " out of " + std::to_string(mesh.vertex_count));
+                        polygon.push_back(idx);
+                    }
+                }
+                else if (property.name == "face_indices")
+                {
+                    faceIndex = values.template read<int>(property.type);
+                }
+                else
+                {
+                    values.skip(property.type, 1);
+                }
+            }
+            // triangles, quads from pbrt-v4 and any convex polygon are fanned around the first vertex
+            for (size_t k = 2; k < polygon.size(); k++)
+            {
+                indices.push(polygon[0]);
+                indices.push(polygon[k - 1]);
+                indices.push(polygon[k]);
+                if (hasFaceIndices)
+                    faceIndices.push(faceIndex);
+            }
+        }
+
+        if (indices.size > std::numeric_limits<unsigned int>::max())
+            plyError("too many faces");
+        mesh.index_count = static_cast<unsigned int>(indices.size);
+        mesh.indices = std::move(indices.data);
+        if (hasFaceIndices)
+            mesh.faceIndices = std::move(faceIndices.data);
+    }
+
+    template<class Source, class Values>
+    MeshHostObject readBody(Values& values, const PLYHeader& header)
+    {
+        MeshHostObject mesh;
+        mesh.aabb[0] = mesh.aabb[1] = mesh.aabb[2] = std::numeric_limits<float>::infinity();
+        mesh.aabb[3] = mesh.aabb[4] = mesh.aabb[5] = -std::numeric_limits<float>::infinity();
+
+        auto vertexElement = std::find_if(header.elements.begin(), header.elements.end(),
+                                          [](const PLYElement& e) { return e.name == "vertex"; });
+        if (vertexElement == header.elements.end() || !hasProperty(*vertexElement, { "x" }) ||
+            !hasProperty(*vertexElement, { "y" }) || !hasProperty(*vertexElement, { "z" }))
+            plyError("missing vertex positions");
+        if (vertexElement->count > std::numeric_limits<unsigned int>::max())
+            plyError("too many vertices");
+        mesh.vertex_count = static_cast<unsigned int>(vertexElement->count);
+
+        bool hasNormal = hasProperty(*vertexElement, { "nx" }) && hasProperty(*vertexElement, { "ny" }) && hasProperty(*vertexElement, { "nz" });
+        bool hasUV = hasProperty(*vertexElement, { "u", "s", "texture_u", "texture_s" }) &&
+                     hasProperty(*vertexElement, { "v", "t", "texture_v", "texture_t" });
+        auto layout = MeshHostObject::makeAttributeLayout(hasNormal, false, false, hasUV);
+        auto* base = mesh.allocateInterleavingAttributes(layout);
+        // attributes a file lacks are left zeroed, not uninitialized
+        std::memset(base, 0, size_t(mesh.vertex_count) * layout.VertexStride);
+
+        bool hasFaces = false;
+        for (const auto& element : header.elements)
+        {
+            if (&element == &*vertexElement)
+                readVertices(values, element, mesh, base, layout);
+            else if (element.name == "face" && !hasFaces)
+            {
+                readFaces(values, element, mesh);
+                hasFaces = true;
+            }
+            else
+                skipElement(values, element);
+        }
+        if (!hasFaces)
+            plyError("missing faces");
+        return mesh;
+    }
+
+    template<class Source>
+    MeshHostObject readPLY(Source& src)
+    {
+        auto header = readHeader(src);
+        if (header.format == PLYFormat::Ascii)
+        {
+            AsciiValues<Source> values{ src };
+            return readBody<Source>(values, header);
+        }
+        bool fileIsLittleEndian = header.format == PLYFormat::BinaryLittleEndian;
+        BinaryValues<Source> values{ src, fileIsLittleEndian != hostIsLittleEndian() };
+        return readBody<Source>(values, header);
+    }
+}
+
+MeshHostObject PLYReader::load(const std::filesystem::path& path)
+{
+    if (path.extension() == ".gz")
+    {
+        GzipSource src(path);
+        return readPLY(src);
+    }
+    MappedSource src(path);
+    return readPLY(src);
+}
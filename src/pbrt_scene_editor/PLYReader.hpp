@@ -0,0 +1,16 @@
+#pragma once
+
+#include <filesystem>
+
+struct MeshHostObject;
+
+/*
+*  PLY mesh reader.
+*  Binary files are memory mapped, .ply.gz files are inflated in a small sliding window.
+*  Vertices are decoded straight into MeshHostObject's interleaved layout and faces are triangulated
+*  into the index buffer, no per property array is built on the way.
+*/
+struct PLYReader
+{
+	static MeshHostObject load(const std::filesystem::path& path);
+};
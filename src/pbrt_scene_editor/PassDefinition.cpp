@@ -1,5 +1,205 @@
 #include "PassDefinition.h"
 #include "editorGUI.h"
+#include "PipelineCache.hpp"
+#include "GlobalLogger.h"
+#include <tuple>
+#include <array>
+
+static void memoryBarrier(vk::CommandBuffer cmd, DeviceExtended* device,
+                          vk::PipelineStageFlags2 srcStage, vk::AccessFlags2 srcAccess,
+                          vk::PipelineStageFlags2 dstStage, vk::AccessFlags2 dstAccess)
+{
+    vk::MemoryBarrier2 barrier{};
+    barrier.setSrcStageMask(srcStage);
+    barrier.setSrcAccessMask(srcAccess);
+    barrier.setDstStageMask(dstStage);
+    barrier.setDstAccessMask(dstAccess);
+    vk::DependencyInfo dependency{};
+    dependency.setMemoryBarriers(barrier);
+#if __APPLE__
+    cmd.pipelineBarrier2KHR(dependency, device->getDLD());
+#else
+    cmd.pipelineBarrier2(dependency);
+#endif
+}
+
+void InstanceCullPass::prepareAOT(FrameCoordinator* coordinator)
+{
+    passDataDescriptorLayout = coordinator->manageInFlightDescriptorSetAOT("InstanceCullPassDataDescriptorSet", { {vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+                                                                                                              {vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute } });
+
+    coordinator->updateInFlightDescriptorSetAOT("InstanceCullPassDataDescriptorSet", 0, vk::DescriptorType::eUniformBuffer, [this](GPUFrame* frame) {
+        return vk::Buffer(scene->mainView.camera.data.getBufferFor(frame->frameIdx));
+    });
+    coordinator->updateInFlightDescriptorSetAOT("InstanceCullPassDataDescriptorSet", 1, vk::DescriptorType::eStorageBuffer, [this](GPUFrame* frame) {
+        return vk::Buffer(scene->cullStatistics.getBufferFor(frame->frameIdx));
+    });
+    passDataDescriptorSet = coordinator->getDescriptorSetHandle("InstanceCullPassDataDescriptorSet");
+    statisticsWritten.assign(coordinator->inFlightframes.size(), false);
+}
+
+void InstanceCullPass::onEnable(GPUFrame* frame)
+{
+    actionContextQueue.clear();
+    if (scene == nullptr || scene->_dynamicRigidMeshBatch.empty())
+    {
+        return;
+    }
+
+    if (computePipelines.empty())
+    {
+        vk::PushConstantRange pushConstant{};
+        pushConstant.setOffset(0);
+        pushConstant.setSize(sizeof(renderScene::InstanceCullPushConstants));
+        pushConstant.setStageFlags(vk::ShaderStageFlagBits::eCompute);
+        pipelineLayout = frame->backendDevice->createPipelineLayout2({ frame->getFrameGlobalDescriptorSetLayout(),
+            passDataDescriptorLayout, scene->instanceCullSetLayout }, { pushConstant });
+        frame->backendDevice->setObjectDebugName(pipelineLayout, "InstanceCullPassPipelineLayout");
+
+        ShaderManager::ShaderMacroList macroList;
+        if (frame->backendDevice->subgroupBallotSupported)
+        {
+            macroList.emplace_back("USE_SUBGROUP_BALLOT", "1");
+        }
+        auto cs = ShaderManager::getInstance().createComputeShader(frame->backendDevice, "instanceCull.comp", macroList);
+        VulkanComputePipelineBuilder builder(frame->backendDevice->device, cs, pipelineLayout);
+        auto pipeline = builder.build();
+        frame->backendDevice->setObjectDebugName(pipeline.getPipeline(), "InstanceCullPassPipeline");
+        computePipelines.push_back(pipeline);
+    }
+
+    // the frame that used these statistics last has finished, publish them before the counting starts over
+    if (statisticsWritten[frame->frameIdx])
+    {
+        scene->lastCullStatistics = *scene->cullStatistics.operator->();
+    }
+    scene->cullStatistics = renderScene::InstanceCullStatistics{};
+    statisticsWritten[frame->frameIdx] = true;
+
+    // the counters of the frame start from zero, written by transfer before the shaders accumulate into them
+    PassActionContext resetContext{};
+    resetContext.pipelineIdx = -1;
+    resetContext.firstSet = 1;
+    resetContext.action = [this, frame](vk::CommandBuffer cmd, uint32_t pipelineIdx) {
+        for (const auto& instanceRigidDynamic : scene->_dynamicRigidMeshBatch)
+        {
+            instanceRigidDynamic.resetCulledDraws(cmd, frame->frameIdx);
+        }
+        // the visibility was written by HZBOcclusionPass of the previous frame
+        memoryBarrier(cmd, frame->backendDevice,
+            vk::PipelineStageFlagBits2::eTransfer | vk::PipelineStageFlagBits2::eComputeShader,
+            vk::AccessFlagBits2::eTransferWrite | vk::AccessFlagBits2::eShaderStorageWrite,
+            vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite);
+    };
+    actionContextQueue.push_back(resetContext);
+
+    for (int i = 0; i < scene->_dynamicRigidMeshBatch.size(); i++)
+    {
+        auto& instanceRigidDynamic = scene->_dynamicRigidMeshBatch[i];
+        PassActionContext actionContext{};
+        actionContext.pipelineIdx = 0;
+        actionContext.firstSet = 1;
+        actionContext.descriptorSets = { passDataDescriptorSet, instanceRigidDynamic.getCullDescriptorSet(frame->frameIdx) };
+        actionContext.action = [this, i, frame](vk::CommandBuffer cmd, uint32_t pipelineIdx) {
+            const auto& instanceRigidDynamic = scene->_dynamicRigidMeshBatch[i];
+            UploadScheduler::getInstance().use(instanceRigidDynamic.uploadTicket);
+            // G-buffer is as large as the swapchain
+            auto constants = instanceRigidDynamic.getCullPushConstants(scene->getLodScale(frame->backendDevice->_swapchain.extent.height));
+            constants.occlusionCulling = scene->occlusionCulling ? 1 : 0;
+            cmd.pushConstants(computePipelines[pipelineIdx].getPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(constants), &constants);
+            cmd.dispatch((constants.instanceCount + 63) / 64, 1, 1);
+        };
+        actionContextQueue.push_back(actionContext);
+    }
+    // the passes reading the draw lists declare culledDraws, the frame graph places the barriers before them
+}
+
+void ClusterCullPass::prepareAOT(FrameCoordinator* coordinator)
+{
+    passDataDescriptorLayout = coordinator->manageInFlightDescriptorSetAOT("ClusterCullPassDataDescriptorSet", { {vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute } });
+    passDataDescriptorSet = coordinator->getDescriptorSetHandle("ClusterCullPassDataDescriptorSet");
+
+    coordinator->updateInFlightDescriptorSetAOT("ClusterCullPassDataDescriptorSet", 0, vk::DescriptorType::eUniformBuffer, [this](GPUFrame* frame) {
+        return vk::Buffer(scene->mainView.camera.data.getBufferFor(frame->frameIdx));
+    });
+}
+
+void ClusterCullPass::onEnable(GPUFrame* frame)
+{
+    actionContextQueue.clear();
+    if (scene == nullptr || !scene->clusterCulling || frame->backendDevice->meshShaderSupported)
+    {
+        return;
+    }
+    std::vector<int> clusteredBatches;
+    for (int i = 0; i < scene->_dynamicRigidMeshBatch.size(); i++)
+    {
+        if (scene->_dynamicRigidMeshBatch[i].clusterCulling)
+        {
+            clusteredBatches.push_back(i);
+        }
+    }
+    if (clusteredBatches.empty())
+    {
+        return;
+    }
+
+    if (computePipelines.empty())
+    {
+        vk::PushConstantRange pushConstant{};
+        pushConstant.setOffset(0);
+        pushConstant.setSize(sizeof(renderScene::ClusterCullPushConstants));
+        pushConstant.setStageFlags(vk::ShaderStageFlagBits::eCompute);
+        pipelineLayout = frame->backendDevice->createPipelineLayout2({ frame->getFrameGlobalDescriptorSetLayout(),
+            passDataDescriptorLayout, scene->clusterSetLayout }, { pushConstant });
+        frame->backendDevice->setObjectDebugName(pipelineLayout, "ClusterCullPassPipelineLayout");
+
+        ShaderManager::ShaderMacroList macroList;
+        if (frame->backendDevice->subgroupBallotSupported)
+        {
+            macroList.emplace_back("USE_SUBGROUP_BALLOT", "1");
+        }
+        auto cs = ShaderManager::getInstance().createComputeShader(frame->backendDevice, "clusterCull.comp", macroList);
+        VulkanComputePipelineBuilder builder(frame->backendDevice->device, cs, pipelineLayout);
+        auto pipeline = builder.build();
+        frame->backendDevice->setObjectDebugName(pipeline.getPipeline(), "ClusterCullPassPipeline");
+        computePipelines.push_back(pipeline);
+    }
+
+    PassActionContext resetContext{};
+    resetContext.pipelineIdx = -1;
+    resetContext.firstSet = 1;
+    resetContext.action = [this, frame, clusteredBatches](vk::CommandBuffer cmd, uint32_t pipelineIdx) {
+        for (auto i : clusteredBatches)
+        {
+            scene->_dynamicRigidMeshBatch[i].resetClusterDraws(cmd, frame->frameIdx);
+        }
+        // the previous frame drew from the same buffers
+        memoryBarrier(cmd, frame->backendDevice,
+            vk::PipelineStageFlagBits2::eTransfer | vk::PipelineStageFlagBits2::eDrawIndirect,
+            vk::AccessFlagBits2::eTransferWrite | vk::AccessFlagBits2::eIndirectCommandRead,
+            vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite);
+    };
+    actionContextQueue.push_back(resetContext);
+
+    for (auto i : clusteredBatches)
+    {
+        const auto& instanceRigidDynamic = scene->_dynamicRigidMeshBatch[i];
+        PassActionContext actionContext{};
+        actionContext.pipelineIdx = 0;
+        actionContext.firstSet = 1;
+        actionContext.descriptorSets = { passDataDescriptorSet, instanceRigidDynamic.getClusterDescriptorSet(frame->frameIdx) };
+        actionContext.action = [this, i](vk::CommandBuffer cmd, uint32_t pipelineIdx) {
+            const auto& instanceRigidDynamic = scene->_dynamicRigidMeshBatch[i];
+            UploadScheduler::getInstance().use(instanceRigidDynamic.uploadTicket);
+            auto constants = instanceRigidDynamic.getClusterCullPushConstants(scene->clusterConeCulling);
+            cmd.pushConstants(computePipelines[pipelineIdx].getPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(constants), &constants);
+            // one row of workgroups per slot of the visible list, the rows past its count return at once
+            cmd.dispatch((constants.meshletCount + 63) / 64, static_cast<uint32_t>(instanceRigidDynamic.perInstanceData.size()), 1);
+        };
+        actionContextQueue.push_back(actionContext);
+    }
+}
 
 void SkyBoxPass::prepareAOT(FrameCoordinator* coordinator)
 {
@@ -64,14 +264,25 @@ void SSAOPass::prepareAOT(FrameCoordinator* coordinator)
 
 void GBufferPass::prepareAOT(FrameCoordinator* coordinator)
 {
-    passDataDescriptorLayout = coordinator->manageInFlightDescriptorSetAOT("GBufferPassDataDescriptorSet", { {vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eAllGraphics } });
+    // an action context per batch, each binds its own state so that a scene with many batches is recorded on the workers
+    recordInParallel = true;
+    // the task and mesh shaders of the cluster pipelines read the camera too
+    auto passDataStages = vk::ShaderStageFlags(vk::ShaderStageFlagBits::eAllGraphics);
+    if (coordinator->backendDevice->meshShaderSupported)
+    {
+        passDataStages |= vk::ShaderStageFlagBits::eTaskEXT | vk::ShaderStageFlagBits::eMeshEXT;
+    }
+    passDataDescriptorLayout = coordinator->manageInFlightDescriptorSetAOT(_name + "DataDescriptorSet", { {vk::DescriptorType::eUniformBuffer, 1, passDataStages } });
+    passDataDescriptorSet = coordinator->getDescriptorSetHandle(_name + "DataDescriptorSet");
 
-    coordinator->updateInFlightDescriptorSetAOT("GBufferPassDataDescriptorSet", 0, vk::DescriptorType::eUniformBuffer,[this](GPUFrame* frame) {
+    coordinator->updateInFlightDescriptorSetAOT(_name + "DataDescriptorSet", 0, vk::DescriptorType::eUniformBuffer,[this](GPUFrame* frame) {
         return vk::Buffer(scene->mainView.camera.data.getBufferFor(frame->frameIdx));
     });
 
+    backendDevice = coordinator->backendDevice;
+    frameGlobalDescriptorSetLayout = coordinator->getFrameGlobalDescriptorSetLayout();
     passLevelPipelineLayout = coordinator->backendDevice->createPipelineLayout2({ coordinator->getFrameGlobalDescriptorSetLayout(), passDataDescriptorLayout });
-    coordinator->backendDevice->setObjectDebugName(passLevelPipelineLayout, "GBufferPassLevelPipelineLayout");
+    coordinator->backendDevice->setObjectDebugName(passLevelPipelineLayout, _name + "LevelPipelineLayout");
 
     rasterInfo.setCullMode(vk::CullModeFlagBits::eNone);
     rasterInfo.setRasterizerDiscardEnable(vk::False);
@@ -105,65 +316,663 @@ void GBufferPass::prepareAOT(FrameCoordinator* coordinator)
     colorBlendInfo.setBlendConstants({ 1.0,1.0,1.0,1.0 });
 }
 
+int GBufferPass::getOrCreatePipeline(const renderScene::InstanceBatchRigidDynamicType& instanceRigidDynamic)
+{
+    auto macroList = getShaderMacros(instanceRigidDynamic);
+    int pipelineLayoutIdx = getOrCreatePipelineLayout(instanceRigidDynamic);
+
+    GraphicsPipelineKey key;
+    key.vsUUID = ShaderManager::queryShaderVariantUUID("simple.vert", macroList);
+    key.fsUUID = ShaderManager::queryShaderVariantUUID("simple.frag", macroList);
+    key.vertexInputStateInfo = instanceRigidDynamic.getVertexInputState();
+    key.renderPass = renderPass;
+    key.pipelineLayout = instancePipelineLayouts[pipelineLayoutIdx];
+
+    auto found = pipelineKeyMap.find(key);
+    if (found != pipelineKeyMap.end())
+    {
+        return found->second;
+    }
+    if (compilingPipelines.find(key) == compilingPipelines.end())
+    {
+        // Both shader variants compile in parallel on the shader workers, the fixed function state lives in the pass
+        auto* device = backendDevice;
+        auto vsFuture = ShaderManager::getInstance().createVertexShaderAsync(device, "simple.vert", macroList);
+        auto fsFuture = ShaderManager::getInstance().createFragmentShaderAsync(device, "simple.frag", macroList);
+        auto future = PipelineCache::getInstance().compileAsync([this, device, key, vsFuture, fsFuture]() {
+            auto* vs = vsFuture.get();
+            auto* fs = fsFuture.get();
+            VulkanGraphicsPipelineBuilder builder(device->device, vs, fs,
+                key.vertexInputStateInfo.getCreateInfo(),
+                key.renderPass,
+                key.pipelineLayout,
+                rasterInfo, depthStencilInfo, colorBlendInfo);
+            return builder.build();
+        });
+        compilingPipelines.emplace(key, std::move(future));
+    }
+    return -1;
+}
+
+int GBufferPass::getOrCreateFallbackPipeline(const renderScene::InstanceBatchRigidDynamicType& instanceRigidDynamic)
+{
+    if (fallbackPipelineIdx != -1)
+    {
+        return fallbackPipelineIdx;
+    }
+    auto* vs = ShaderManager::getInstance().createVertexShader(backendDevice, "positionOnly.vert");
+    auto* fs = ShaderManager::getInstance().createFragmentShader(backendDevice, "gBufferFallback.frag");
+    int pipelineLayoutIdx = getOrCreatePipelineLayout(instanceRigidDynamic);
+    VulkanGraphicsPipelineBuilder builder(backendDevice->device, vs, fs,
+        instanceRigidDynamic.getPosOnlyVertexInputState().getCreateInfo(), renderPass,
+        instancePipelineLayouts[pipelineLayoutIdx],
+        rasterInfo, depthStencilInfo, colorBlendInfo);
+    builder.addDynamicState(vk::DynamicState::eVertexInputBindingStride);
+    auto pipeline = builder.build();
+    backendDevice->setObjectDebugName(pipeline.getPipeline(), _name + "FallbackPipeline");
+    graphicsPipelines.push_back(pipeline);
+    fallbackPipelineIdx = graphicsPipelines.size() - 1;
+    return fallbackPipelineIdx;
+}
+
+int GBufferPass::getOrCreateClusterPipeline(const renderScene::InstanceBatchRigidDynamicType& instanceRigidDynamic)
+{
+    if (clusterPipelineLayout == VK_NULL_HANDLE)
+    {
+        vk::PushConstantRange fragmentConstants{};
+        fragmentConstants.setOffset(0);
+        fragmentConstants.setSize(2 * sizeof(glm::uvec4));
+        fragmentConstants.setStageFlags(vk::ShaderStageFlagBits::eFragment);
+        vk::PushConstantRange clusterConstants{};
+        clusterConstants.setOffset(renderScene::ClusterMeshPushConstants::offset());
+        clusterConstants.setSize(sizeof(renderScene::ClusterMeshPushConstants));
+        clusterConstants.setStageFlags(vk::ShaderStageFlagBits::eTaskEXT | vk::ShaderStageFlagBits::eMeshEXT);
+        clusterPipelineLayout = backendDevice->createPipelineLayout2({ frameGlobalDescriptorSetLayout,
+                                                                       passDataDescriptorLayout,
+                                                                       instanceRigidDynamic.getSetLayout(),
+                                                                       BindlessHeap::getInstance().getSetLayout(),
+                                                                       scene->clusterSetLayout }, { fragmentConstants, clusterConstants });
+        backendDevice->setObjectDebugName(clusterPipelineLayout, _name + "ClusterPipelineLayout");
+    }
+
+    auto macroList = getShaderMacros(instanceRigidDynamic);
+    GraphicsPipelineKey key;
+    key.vsUUID = ShaderManager::queryShaderVariantUUID("clusterGBuffer.mesh", macroList);
+    key.fsUUID = ShaderManager::queryShaderVariantUUID("simple.frag", macroList);
+    key.renderPass = renderPass;
+    key.pipelineLayout = clusterPipelineLayout;
+
+    auto found = pipelineKeyMap.find(key);
+    if (found != pipelineKeyMap.end())
+    {
+        return found->second;
+    }
+    if (compilingPipelines.find(key) == compilingPipelines.end())
+    {
+        auto* device = backendDevice;
+        auto tsFuture = ShaderManager::getInstance().createTaskShaderAsync(device, "clusterCull.task", {});
+        auto msFuture = ShaderManager::getInstance().createMeshShaderAsync(device, "clusterGBuffer.mesh", macroList);
+        auto fsFuture = ShaderManager::getInstance().createFragmentShaderAsync(device, "simple.frag", macroList);
+        auto future = PipelineCache::getInstance().compileAsync([this, device, key, tsFuture, msFuture, fsFuture]() {
+            VulkanGraphicsPipelineBuilder builder(device->device, tsFuture.get(), msFuture.get(), fsFuture.get(),
+                key.renderPass,
+                key.pipelineLayout,
+                rasterInfo, depthStencilInfo, colorBlendInfo);
+            return builder.build();
+        });
+        compilingPipelines.emplace(key, std::move(future));
+    }
+    return -1;
+}
+
+void GBufferPass::collectCompiledPipelines()
+{
+    for (auto it = compilingPipelines.begin(); it != compilingPipelines.end();)
+    {
+        if (it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            ++it;
+            continue;
+        }
+        try {
+            graphicsPipelines.push_back(it->second.get());
+            backendDevice->setObjectDebugName(graphicsPipelines.back().getPipeline(), _name + "Pipeline@" + it->first.vsUUID);
+            pipelineKeyMap.emplace(it->first, static_cast<int>(graphicsPipelines.size()) - 1);
+        } catch (std::exception& e) {
+            // keep drawing these instances with the fallback pipeline instead of retrying every frame
+            GlobalLogger::getInstance().error("Failed to build GBuffer pipeline " + it->first.vsUUID + " : " + e.what());
+            if (fallbackPipelineIdx != -1)
+            {
+                pipelineKeyMap.emplace(it->first, fallbackPipelineIdx);
+            }
+        }
+        pipelineVersion++;
+        it = compilingPipelines.erase(it);
+    }
+}
+
+void GBufferPass::warmUp()
+{
+    // the pass isn't prepared yet, pipelines are then requested by the first frame
+    if (scene == nullptr || backendDevice == nullptr) return;
+    for (const auto& instanceRigidDynamic : scene->_dynamicRigidMeshBatch)
+    {
+        getOrCreatePipeline(instanceRigidDynamic);
+        if (instanceRigidDynamic.clusterCulling && backendDevice->meshShaderSupported && drawList == renderScene::CulledDrawList::Visible)
+        {
+            getOrCreateClusterPipeline(instanceRigidDynamic);
+        }
+    }
+    if (!scene->_dynamicRigidMeshBatch.empty())
+    {
+        getOrCreateFallbackPipeline(scene->_dynamicRigidMeshBatch.front());
+    }
+}
+
 void GBufferPass::onEnable(GPUFrame* frame)
+{
+    collectCompiledPipelines();
+    frameStatistics = {};
+    currentDrawPackets = nullptr;
+    if (scene == nullptr || scene->_dynamicRigidMeshBatch.empty())
+    {
+        return;
+    }
+    if (drawPacketLists.size() <= frame->frameIdx)
+    {
+        drawPacketLists.resize(frame->frameIdx + 1);
+    }
+    auto& drawPacketList = drawPacketLists[frame->frameIdx];
+    DrawPacketListKey key{ scene->structureVersion, pipelineVersion, scene->clusterCulling };
+    if (!(drawPacketList.key == key))
+    {
+        buildDrawPackets(frame, drawPacketList.packets);
+        drawPacketList.key = key;
+        frameStatistics.rebuilds++;
+    }
+    frameStatistics.packets = static_cast<uint32_t>(drawPacketList.packets.size());
+    currentDrawPackets = &drawPacketList;
+}
+
+void GBufferPass::buildDrawPackets(const GPUFrame* frame, std::vector<GBufferDrawPacket>& packets)
+{
+    packets.clear();
+    for (uint32_t i = 0; i < scene->_dynamicRigidMeshBatch.size(); i++)
+    {
+        const auto& instanceRigidDynamic = scene->_dynamicRigidMeshBatch[i];
+        const auto& mesh = instanceRigidDynamic.mesh;
+        const auto& output = instanceRigidDynamic.cullOutputs[frame->frameIdx];
+        GBufferDrawPacket packet{};
+        packet.instanceSet = instanceRigidDynamic.getDescriptorSet();
+        packet.materialIdx = instanceRigidDynamic.materialIdx;
+        packet.batchIdx = i;
+        packet.uploadTicket.value = std::max(instanceRigidDynamic.uploadTicket.value, mesh->uploadTicket.value);
+
+        // only the early draws of level 0 are split into clusters, the late ones are few and drawn per instance
+        bool clusters = scene->clusterCulling && instanceRigidDynamic.clusterCulling && drawList == renderScene::CulledDrawList::Visible;
+        // the simplified levels are always drawn per instance
+        uint32_t firstLod = 0;
+        if (clusters && backendDevice->meshShaderSupported)
+        {
+            // drawn per instance until the pipeline is compiled, or if it failed to
+            int clusterPipelineIdx = getOrCreateClusterPipeline(instanceRigidDynamic);
+            if (clusterPipelineIdx != -1 && clusterPipelineIdx != fallbackPipelineIdx)
+            {
+                auto meshTasks = packet;
+                meshTasks.kind = GBufferDrawPacket::Kind::ClusterMeshTasks;
+                meshTasks.pipelineIdx = clusterPipelineIdx;
+                meshTasks.clusterSet = instanceRigidDynamic.getClusterDescriptorSet(frame->frameIdx);
+                meshTasks.taskGroupCountX = (mesh->meshletCount + 31) / 32;
+                meshTasks.taskGroupCountY = static_cast<uint32_t>(instanceRigidDynamic.perInstanceData.size());
+                packets.push_back(meshTasks);
+                firstLod = 1;
+            }
+            clusters = false;
+        }
+        if (firstLod >= instanceRigidDynamic.getLodCount())
+        {
+            continue;
+        }
+
+        int pipelineIdx = selectPipeline(instanceRigidDynamic);
+        packet.pipelineIdx = pipelineIdx;
+        packet.vertexBuffer = mesh->vertexBuffer.buffer;
+        packet.vertexStride = pipelineIdx == fallbackPipelineIdx ? mesh->vertexAttribute.stride : 0;
+        if (clusters)
+        {
+            // the meshlets ClusterCullPass kept, the per instance index buffer is the identity
+            auto clusterDraws = packet;
+            clusterDraws.kind = GBufferDrawPacket::Kind::Clusters;
+            clusterDraws.indexBuffer = mesh->meshletIndexBuffer.buffer;
+            clusterDraws.instanceIndexBuffer = instanceRigidDynamic.instanceDataIdicesBuffer.buffer;
+            clusterDraws.commandBuffer = output.clusterDrawBuffer.buffer;
+            clusterDraws.commandOffset = renderScene::ClusterDrawCommands::commandsOffset();
+            clusterDraws.maxDrawCount = instanceRigidDynamic.getClusterDrawCapacity();
+            packets.push_back(clusterDraws);
+            firstLod = 1;
+        }
+        packet.kind = GBufferDrawPacket::Kind::Culled;
+        packet.indexBuffer = mesh->indexBuffer.buffer;
+        packet.instanceIndexBuffer = output.indicesBufferOf(drawList);
+        packet.commandBuffer = output.drawCommandBuffer.buffer;
+        for (uint32_t lod = firstLod; lod < instanceRigidDynamic.getLodCount(); lod++)
+        {
+            packet.lod = lod;
+            packet.instanceIndexOffset = instanceRigidDynamic.getLodListOffset(lod);
+            packet.commandOffset = renderScene::InstanceCullDrawCommands::drawOffset(drawList, lod);
+            packets.push_back(packet);
+        }
+    }
+    // the materials are in the bindless heap, the packets of a pipeline only differ by their instance set and buffers
+    std::stable_sort(packets.begin(), packets.end(), [](const GBufferDrawPacket& a, const GBufferDrawPacket& b) {
+        return std::tie(a.pipelineIdx, a.instanceSet, a.vertexBuffer) < std::tie(b.pipelineIdx, b.instanceSet, b.vertexBuffer);
+    });
+}
+
+void GBufferPass::recordDrawPackets(vk::CommandBuffer cmd, const GPUFrame* frame, vk::DescriptorSet passDataSet, size_t first, size_t last)
+{
+    const auto& packets = currentDrawPackets->packets;
+    auto* device = frame->backendDevice;
+    auto loader = device->getDLD();
+    uint32_t stateChanges = 0;
+    uint32_t boundPipelineIdx = ~0u;
+    vk::PipelineLayout boundLayout = VK_NULL_HANDLE;
+    vk::DescriptorSet boundInstanceSet = VK_NULL_HANDLE;
+    vk::DescriptorSet boundClusterSet = VK_NULL_HANDLE;
+    vk::Buffer boundVertexBuffer = VK_NULL_HANDLE;
+    vk::Buffer boundIndexBuffer = VK_NULL_HANDLE;
+    vk::Buffer boundInstanceIndexBuffer = VK_NULL_HANDLE;
+    vk::DeviceSize boundInstanceIndexOffset = 0;
+    for (size_t i = first; i < last; i++)
+    {
+        const auto& packet = packets[i];
+        UploadScheduler::getInstance().use(packet.uploadTicket);
+        const auto& pipeline = graphicsPipelines[packet.pipelineIdx];
+        if (packet.pipelineIdx != boundPipelineIdx)
+        {
+            cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.getPipeline());
+            boundPipelineIdx = packet.pipelineIdx;
+            // the strides of the fallback pipeline are dynamic, its vertex buffers are bound with them
+            boundVertexBuffer = VK_NULL_HANDLE;
+            boundInstanceIndexBuffer = VK_NULL_HANDLE;
+            stateChanges++;
+        }
+        auto layout = pipeline.getLayout();
+        if (layout != boundLayout)
+        {
+            // the layouts differ by their push constants, switching disturbs every set but the frame level one.
+            // The bindless heap holds the materials of the whole scene and is bound along with the pass data.
+            cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 1, passDataSet, nullptr);
+            cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 3, BindlessHeap::getInstance().getDescriptorSet(), nullptr);
+            boundLayout = layout;
+            boundInstanceSet = VK_NULL_HANDLE;
+            boundClusterSet = VK_NULL_HANDLE;
+            stateChanges++;
+        }
+        if (packet.instanceSet != boundInstanceSet)
+        {
+            cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 2, packet.instanceSet, nullptr);
+            boundInstanceSet = packet.instanceSet;
+            stateChanges++;
+        }
+        // the level reaches the fragment shader with the mesh index, see getMeshIdx(), the material follows it
+        std::array<glm::uvec4, 2> fragmentConstants{ getMeshIdx(static_cast<int>(packet.batchIdx), packet.lod),
+                                                     glm::uvec4(packet.materialIdx, 0, 0, 0) };
+        cmd.pushConstants(layout, vk::ShaderStageFlagBits::eFragment, 0, sizeof(fragmentConstants), fragmentConstants.data());
+
+        if (packet.kind == GBufferDrawPacket::Kind::ClusterMeshTasks)
+        {
+            if (packet.clusterSet != boundClusterSet)
+            {
+                cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 4, packet.clusterSet, nullptr);
+                boundClusterSet = packet.clusterSet;
+                stateChanges++;
+            }
+            // cone culling is switched from the editor without building the packets again
+            auto constants = scene->_dynamicRigidMeshBatch[packet.batchIdx].getClusterMeshPushConstants(scene->clusterConeCulling);
+            cmd.pushConstants(layout, vk::ShaderStageFlagBits::eTaskEXT | vk::ShaderStageFlagBits::eMeshEXT,
+                              renderScene::ClusterMeshPushConstants::offset(), sizeof(constants), &constants);
+            cmd.drawMeshTasksEXT(packet.taskGroupCountX, packet.taskGroupCountY, 1, loader);
+            continue;
+        }
+
+        if (packet.vertexBuffer != boundVertexBuffer)
+        {
+            if (packet.vertexStride != 0)
+            {
+                cmd.bindVertexBuffers2EXT(0, { packet.vertexBuffer }, { 0 }, nullptr, { packet.vertexStride }, loader);
+            }
+            else {
+                cmd.bindVertexBuffers(0, { packet.vertexBuffer }, { 0 });
+            }
+            boundVertexBuffer = packet.vertexBuffer;
+            stateChanges++;
+        }
+        if (packet.indexBuffer != boundIndexBuffer)
+        {
+            cmd.bindIndexBuffer(packet.indexBuffer, 0, vk::IndexType::eUint32);
+            boundIndexBuffer = packet.indexBuffer;
+            stateChanges++;
+        }
+        if (packet.instanceIndexBuffer != boundInstanceIndexBuffer || packet.instanceIndexOffset != boundInstanceIndexOffset)
+        {
+            if (packet.vertexStride != 0)
+            {
+                cmd.bindVertexBuffers2EXT(1, { packet.instanceIndexBuffer }, { packet.instanceIndexOffset }, nullptr, { sizeof(uint32_t) }, loader);
+            }
+            else {
+                cmd.bindVertexBuffers(1, { packet.instanceIndexBuffer }, { packet.instanceIndexOffset });
+            }
+            boundInstanceIndexBuffer = packet.instanceIndexBuffer;
+            boundInstanceIndexOffset = packet.instanceIndexOffset;
+            stateChanges++;
+        }
+
+        if (packet.kind == GBufferDrawPacket::Kind::Clusters)
+        {
+            cmd.drawIndexedIndirectCountKHR(packet.commandBuffer, packet.commandOffset, packet.commandBuffer, renderScene::ClusterDrawCommands::countOffset(),
+                                            packet.maxDrawCount, sizeof(VkDrawIndexedIndirectCommand), loader);
+        }
+        else {
+            renderScene::InstanceBatchRigidDynamicType::drawIndirect(cmd, device, packet.commandBuffer, packet.commandOffset);
+        }
+    }
+    recordedStateChanges.fetch_add(stateChanges, std::memory_order_relaxed);
+}
+
+void GBufferPass::record(vk::CommandBuffer cmd, GPUFrame* frame)
+{
+    size_t packetCount = currentDrawPackets != nullptr ? currentDrawPackets->packets.size() : 0;
+    auto passDataSet = frame->getManagedDescriptorSet(passDataDescriptorSet);
+    recordChunked(cmd, frame, packetCount, [this, frame, passDataSet](vk::CommandBuffer cmd, size_t first, size_t last) {
+        recordDrawPackets(cmd, frame, passDataSet, first, last);
+    });
+    frameStatistics.stateChanges = recordedStateChanges.exchange(0);
+    statistics = frameStatistics;
+}
+
+void HZBOcclusionPass::prepareAOT(FrameCoordinator* coordinator)
+{
+    backendDevice = coordinator->backendDevice;
+
+    passDataDescriptorLayout = coordinator->manageInFlightDescriptorSetAOT("HZBOcclusionPassDataDescriptorSet", { {vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+                                                                                                              {vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute } });
+    coordinator->updateInFlightDescriptorSetAOT("HZBOcclusionPassDataDescriptorSet", 0, vk::DescriptorType::eUniformBuffer, [this](GPUFrame* frame) {
+        return vk::Buffer(scene->mainView.camera.data.getBufferFor(frame->frameIdx));
+    });
+    coordinator->updateInFlightDescriptorSetAOT("HZBOcclusionPassDataDescriptorSet", 1, vk::DescriptorType::eStorageBuffer, [this](GPUFrame* frame) {
+        return vk::Buffer(scene->cullStatistics.getBufferFor(frame->frameIdx));
+    });
+
+    // the levels written by the build, its workgroup counter and the whole chain read by the test
+    std::vector<vk::DescriptorSetLayoutBinding> bindings(3);
+    bindings[0].setBinding(0);
+    bindings[0].setDescriptorType(vk::DescriptorType::eStorageImage);
+    bindings[0].setDescriptorCount(renderScene::HZBPyramid::MAX_MIPS);
+    bindings[0].setStageFlags(vk::ShaderStageFlagBits::eCompute);
+    bindings[1].setBinding(1);
+    bindings[1].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+    bindings[1].setDescriptorCount(1);
+    bindings[1].setStageFlags(vk::ShaderStageFlagBits::eCompute);
+    bindings[2].setBinding(2);
+    bindings[2].setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+    bindings[2].setDescriptorCount(1);
+    bindings[2].setStageFlags(vk::ShaderStageFlagBits::eCompute);
+    pyramidDescriptorLayout = backendDevice->createDescriptorSetLayout2(bindings);
+
+    std::vector<vk::DescriptorPoolSize> poolSizes(3);
+    poolSizes[0].setType(vk::DescriptorType::eStorageImage);
+    poolSizes[0].setDescriptorCount(renderScene::HZBPyramid::MAX_MIPS);
+    poolSizes[1].setType(vk::DescriptorType::eStorageBuffer);
+    poolSizes[1].setDescriptorCount(1);
+    poolSizes[2].setType(vk::DescriptorType::eCombinedImageSampler);
+    poolSizes[2].setDescriptorCount(1);
+    vk::DescriptorPoolCreateInfo poolCreateInfo{};
+    poolCreateInfo.setPoolSizes(poolSizes);
+    poolCreateInfo.setMaxSets(1);
+    pyramidDescriptorPool = backendDevice->createDescriptorPool(poolCreateInfo);
+    pyramidDescriptorSet = backendDevice->allocateSingleDescriptorSet(pyramidDescriptorPool, pyramidDescriptorLayout);
+    backendDevice->setObjectDebugName(pyramidDescriptorSet, "HZBOcclusionPassPyramidDescriptorSet");
+
+    // texels are fetched, never filtered
+    vk::SamplerCreateInfo samplerInfo{};
+    samplerInfo.setAddressModeU(vk::SamplerAddressMode::eClampToEdge);
+    samplerInfo.setAddressModeV(vk::SamplerAddressMode::eClampToEdge);
+    samplerInfo.setAddressModeW(vk::SamplerAddressMode::eClampToEdge);
+    samplerInfo.setMagFilter(vk::Filter::eNearest);
+    samplerInfo.setMinFilter(vk::Filter::eNearest);
+    samplerInfo.setMipmapMode(vk::SamplerMipmapMode::eNearest);
+    samplerInfo.setMinLod(0);
+    samplerInfo.setMaxLod(VK_LOD_CLAMP_NONE);
+    pyramidSampler = backendDevice->createSampler(samplerInfo);
+
+    auto bufferRes = backendDevice->allocateBuffer(sizeof(uint32_t), (VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT), VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+    if (!bufferRes.has_value())
+    {
+        throw std::runtime_error("Failed to allocate HZB workgroup counter buffer");
+    }
+    finishedGroupsBuffer = bufferRes.value();
+    uint32_t zero = 0;
+    finishedGroupsTicket = UploadScheduler::getInstance().uploadBuffer(&zero, sizeof(zero), finishedGroupsBuffer.buffer);
+    backendDevice->updateDescriptorSetStorageBuffer(pyramidDescriptorSet, 1, finishedGroupsBuffer.buffer);
+
+    createPyramid();
+    backendDevice->_swapchain.registerRecreateCallback([this](SwapchainExtended*) {
+        createPyramid();
+    });
+}
+
+void HZBOcclusionPass::createPyramid()
+{
+    // sceneDepth is as large as the swapchain
+    auto extent = backendDevice->_swapchain.extent;
+    depthSize = { extent.width, extent.height };
+    mipCount = std::min(renderScene::HZBPyramid::mipCount(depthSize), renderScene::HZBPyramid::MAX_MIPS);
+
+    for (auto view : pyramidLevelViews)
+    {
+        backendDevice->destroyImageView(view);
+    }
+    pyramidLevelViews.clear();
+    if (pyramidView)
+    {
+        backendDevice->destroyImageView(pyramidView);
+    }
+    if (pyramid.image != VK_NULL_HANDLE)
+    {
+        backendDevice->deAllocateImage(pyramid.image, pyramid.allocation);
+    }
+
+    // levels of the pyramid round up while the ones of an image round down, a power of two level 0 holds both
+    auto powerOfTwo = [](uint32_t size) {
+        uint32_t result = 1;
+        while (result < size) result *= 2;
+        return result;
+    };
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = VK_FORMAT_R32_SFLOAT;
+    imageInfo.extent = VkExtent3D{ powerOfTwo((depthSize.x + 1) / 2), powerOfTwo((depthSize.y + 1) / 2), 1 };
+    imageInfo.mipLevels = mipCount;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    auto imageRes = backendDevice->allocateVMAImage(imageInfo);
+    if (!imageRes.has_value())
+    {
+        throw std::runtime_error("Failed to allocate HZB image");
+    }
+    pyramid = imageRes.value();
+    backendDevice->setObjectDebugName(vk::Image(pyramid.image), "HZBOcclusionPassPyramid");
+
+    vk::ImageViewCreateInfo imageViewInfo{};
+    imageViewInfo.setImage(pyramid.image);
+    imageViewInfo.setViewType(vk::ImageViewType::e2D);
+    imageViewInfo.setFormat(vk::Format::eR32Sfloat);
+    vk::ImageSubresourceRange subresourceRange{};
+    subresourceRange.setAspectMask(vk::ImageAspectFlagBits::eColor);
+    subresourceRange.setBaseArrayLayer(0);
+    subresourceRange.setLayerCount(1);
+    subresourceRange.setLevelCount(1);
+    for (uint32_t level = 0; level < mipCount; level++)
+    {
+        subresourceRange.setBaseMipLevel(level);
+        imageViewInfo.setSubresourceRange(subresourceRange);
+        pyramidLevelViews.push_back(backendDevice->createImageView(imageViewInfo));
+    }
+    subresourceRange.setBaseMipLevel(0);
+    subresourceRange.setLevelCount(mipCount);
+    imageViewInfo.setSubresourceRange(subresourceRange);
+    pyramidView = backendDevice->createImageView(imageViewInfo);
+
+    // the pyramid stays in the general layout, the array is padded with the top level so every element is valid
+    std::vector<vk::DescriptorImageInfo> levelInfos(renderScene::HZBPyramid::MAX_MIPS);
+    for (uint32_t i = 0; i < levelInfos.size(); i++)
+    {
+        levelInfos[i].setImageView(pyramidLevelViews[std::min(i, mipCount - 1)]);
+        levelInfos[i].setImageLayout(vk::ImageLayout::eGeneral);
+    }
+    vk::DescriptorImageInfo pyramidInfo{};
+    pyramidInfo.setImageView(pyramidView);
+    pyramidInfo.setImageLayout(vk::ImageLayout::eGeneral);
+    pyramidInfo.setSampler(pyramidSampler);
+
+    std::array<vk::WriteDescriptorSet, 2> writes{};
+    writes[0].setDstSet(pyramidDescriptorSet);
+    writes[0].setDstBinding(0);
+    writes[0].setDescriptorType(vk::DescriptorType::eStorageImage);
+    writes[0].setImageInfo(levelInfos);
+    writes[1].setDstSet(pyramidDescriptorSet);
+    writes[1].setDstBinding(2);
+    writes[1].setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+    writes[1].setImageInfo(pyramidInfo);
+    backendDevice->updateDescriptorSets(writes, nullptr);
+
+    pyramidInitialized = false;
+}
+
+void HZBOcclusionPass::onEnable(GPUFrame* frame)
 {
     actionContextQueue.clear();
-    currentInstanceDescriptorSetIdx = -1;
-    if (scene != nullptr && !scene->_dynamicRigidMeshBatch.empty())
+    if (scene == nullptr || scene->_dynamicRigidMeshBatch.empty())
     {
-        auto view = scene->mainView.camera.data->view;
-        auto proj = scene->mainView.camera.data->proj;
-        auto vp = proj * view;
+        return;
+    }
 
-        int visibleCount = 0;
+    if (computePipelines.empty())
+    {
+        vk::PushConstantRange pushConstant{};
+        pushConstant.setOffset(0);
+        pushConstant.setSize(sizeof(renderScene::InstanceCullPushConstants));
+        pushConstant.setStageFlags(vk::ShaderStageFlagBits::eCompute);
+        pipelineLayout = frame->backendDevice->createPipelineLayout2({ frame->getFrameGlobalDescriptorSetLayout(),
+            passInputDescriptorSetLayout, pyramidDescriptorLayout, passDataDescriptorLayout, scene->instanceCullSetLayout }, { pushConstant });
+        frame->backendDevice->setObjectDebugName(pipelineLayout, "HZBOcclusionPassPipelineLayout");
 
-        for (int i = 0; i < scene->_dynamicRigidMeshBatch.size(); i++)
+        auto buildShader = ShaderManager::getInstance().createComputeShader(frame->backendDevice, "hzbBuild.comp");
+        VulkanComputePipelineBuilder buildBuilder(frame->backendDevice->device, buildShader, pipelineLayout);
+        auto buildPipeline = buildBuilder.build();
+        frame->backendDevice->setObjectDebugName(buildPipeline.getPipeline(), "HZBOcclusionPassBuildPipeline");
+        computePipelines.push_back(buildPipeline);
+
+        ShaderManager::ShaderMacroList macroList{ {"LATE_PHASE", "1"} };
+        if (frame->backendDevice->subgroupBallotSupported)
         {
-            auto& instanceRigidDynamic = scene->_dynamicRigidMeshBatch[i];
-            // renderState = vertex input state + pipeline layout + shader + pipeline
-            // todo : Here is a big problem. The performance is unpredictable.
-            PassActionContext actionContext{};
-            actionContext.firstSet = 1;
-            actionContext.descriptorSets.push_back("GBufferPassDataDescriptorSet");
-            bindRenderState(actionContext, frame, instanceRigidDynamic);
-            actionContext.action = [this,i,instanceRigidDynamic](vk::CommandBuffer cmd, uint32_t pipelineIdx) {
-                glm::uvec4 meshIdx;
-                meshIdx.x = i;
-                meshIdx.y = scene->_dynamicRigidMeshBatch.size();
-                cmd.pushConstants(graphicsPipelines[pipelineIdx].getPipelineLayout(), vk::ShaderStageFlagBits::eFragment, 0, sizeof(glm::uvec4), &meshIdx);
-                //mesh instance know how to bind the geometry buffer, how to draw
-                instanceRigidDynamic.drawAll(cmd);
-                //instanceRigidDynamic.drawOne(cmdBuf);
-               /* visibleCount += instanceRigidDynamic.drawCulled(cmdBuf,[&](auto meshHandle, const auto & perInstanceData) -> bool {
-                    auto aabb = scene->aabbs[meshHandle.idx];
-                    glm::vec3 corners[8]{};
-                    corners[0] = {aabb.minX, -aabb.minY, aabb.minZ};
-                    corners[1] = {aabb.maxX, -aabb.minY, aabb.minZ};
-                    corners[2] = {aabb.minX, -aabb.maxY, aabb.minZ};
-                    corners[3] = {aabb.minX, -aabb.minY, aabb.maxZ};
-                    corners[4] = {aabb.maxX, -aabb.maxY, aabb.minZ};
-                    corners[5] = {aabb.maxX, -aabb.minY, aabb.maxZ};
-                    corners[6] = {aabb.minX, -aabb.maxY, aabb.maxZ};
-                    corners[7] = {aabb.maxX, -aabb.maxY, aabb.maxZ};
-
-                    for(int i = 0; i < 8; i ++)
-                    {
-                        auto clip_space_corner = vp * glm::vec4(corners[i],1.0);
-                        auto x = clip_space_corner.x;
-                        auto y = clip_space_corner.y;
-                        auto z = clip_space_corner.z;
-                        auto w = clip_space_corner.w;
-
-                        if((x >= -w) && (x <= w) && (y>=-w) && (y<=w) && (z >= 0) && (z <= w))
-                            return true;
-                    }
-
-                    return false;
-                });*/
-            };
-            actionContextQueue.push_back(actionContext);
+            macroList.emplace_back("USE_SUBGROUP_BALLOT", "1");
         }
+        auto cullShader = ShaderManager::getInstance().createComputeShader(frame->backendDevice, "instanceCull.comp", macroList);
+        VulkanComputePipelineBuilder cullBuilder(frame->backendDevice->device, cullShader, pipelineLayout);
+        auto cullPipeline = cullBuilder.build();
+        frame->backendDevice->setObjectDebugName(cullPipeline.getPipeline(), "HZBOcclusionPassCullPipeline");
+        computePipelines.push_back(cullPipeline);
     }
+
+    // the previous frame still tests against the pyramid and InstanceCullPass of this one reads the visibility
+    PassActionContext acquireContext{};
+    acquireContext.pipelineIdx = -1;
+    acquireContext.firstSet = 1;
+    acquireContext.action = [this, frame](vk::CommandBuffer cmd, uint32_t pipelineIdx) {
+        UploadScheduler::getInstance().use(finishedGroupsTicket);
+        vk::ImageMemoryBarrier2 imb{};
+        imb.setImage(pyramid.image);
+        imb.setSubresourceRange({ vk::ImageAspectFlagBits::eColor, 0, mipCount, 0, 1 });
+        imb.setSrcQueueFamilyIndex(vk::QueueFamilyIgnored);
+        imb.setDstQueueFamilyIndex(vk::QueueFamilyIgnored);
+        imb.setSrcStageMask(vk::PipelineStageFlagBits2::eComputeShader);
+        imb.setSrcAccessMask(vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite | vk::AccessFlagBits2::eShaderSampledRead);
+        imb.setDstStageMask(vk::PipelineStageFlagBits2::eComputeShader);
+        imb.setDstAccessMask(vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite);
+        imb.setOldLayout(pyramidInitialized ? vk::ImageLayout::eGeneral : vk::ImageLayout::eUndefined);
+        imb.setNewLayout(vk::ImageLayout::eGeneral);
+        pyramidInitialized = true;
+        vk::MemoryBarrier2 barrier{};
+        barrier.setSrcStageMask(vk::PipelineStageFlagBits2::eComputeShader);
+        barrier.setSrcAccessMask(vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite);
+        barrier.setDstStageMask(vk::PipelineStageFlagBits2::eComputeShader);
+        barrier.setDstAccessMask(vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite);
+        vk::DependencyInfo dependency{};
+        dependency.setMemoryBarriers(barrier);
+        dependency.setImageMemoryBarriers(imb);
+#if __APPLE__
+        cmd.pipelineBarrier2KHR(dependency, frame->backendDevice->getDLD());
+#else
+        cmd.pipelineBarrier2(dependency);
+#endif
+    };
+    actionContextQueue.push_back(acquireContext);
+
+    // every workgroup reduces 64x64 texels of sceneDepth
+    glm::uvec2 groups = (depthSize + 63u) / 64u;
+    PassActionContext buildContext{};
+    buildContext.pipelineIdx = 0;
+    buildContext.firstSet = 1;
+    buildContext.descriptorSets = { "HZBOcclusionPassInputDescriptorSet", pyramidDescriptorSet };
+    buildContext.action = [this, groups](vk::CommandBuffer cmd, uint32_t pipelineIdx) {
+        struct {
+            glm::uvec2 depthSize;
+            uint32_t mipCount;
+            uint32_t groupCount;
+        } constants{ depthSize, mipCount, groups.x * groups.y };
+        cmd.pushConstants(computePipelines[pipelineIdx].getPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(constants), &constants);
+        cmd.dispatch(groups.x, groups.y, 1);
+    };
+    actionContextQueue.push_back(buildContext);
+
+    PassActionContext builtContext{};
+    builtContext.pipelineIdx = -1;
+    builtContext.firstSet = 1;
+    builtContext.action = [frame](vk::CommandBuffer cmd, uint32_t pipelineIdx) {
+        memoryBarrier(cmd, frame->backendDevice,
+            vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageWrite,
+            vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderSampledRead);
+    };
+    actionContextQueue.push_back(builtContext);
+
+    for (int i = 0; i < scene->_dynamicRigidMeshBatch.size(); i++)
+    {
+        auto& instanceRigidDynamic = scene->_dynamicRigidMeshBatch[i];
+        PassActionContext actionContext{};
+        actionContext.pipelineIdx = 1;
+        actionContext.firstSet = 1;
+        actionContext.descriptorSets = { "HZBOcclusionPassInputDescriptorSet", pyramidDescriptorSet,
+                                         "HZBOcclusionPassDataDescriptorSet", instanceRigidDynamic.getCullDescriptorSet(frame->frameIdx) };
+        actionContext.action = [this, i](vk::CommandBuffer cmd, uint32_t pipelineIdx) {
+            const auto& instanceRigidDynamic = scene->_dynamicRigidMeshBatch[i];
+            // the same selection as the early phase, sceneDepth is as large as the G-buffer
+            auto constants = instanceRigidDynamic.getCullPushConstants(scene->getLodScale(depthSize.y));
+            constants.occlusionCulling = 1;
+            constants.hzbMipCount = mipCount;
+            constants.depthSize = depthSize;
+            cmd.pushConstants(computePipelines[pipelineIdx].getPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(constants), &constants);
+            cmd.dispatch((constants.instanceCount + 63) / 64, 1, 1);
+        };
+        actionContextQueue.push_back(actionContext);
+    }
+    // GBufferLatePass and WireFramePass draw the late lists, they declare culledDraws
 }
 
 void DeferredLightingPass::prepareAOT(FrameCoordinator* coordinator)
@@ -243,7 +1052,9 @@ void CopyPass::prepareAOT(FrameCoordinator* coordinator)
 
 void SelectedMaskPass::prepareAOT(FrameCoordinator* coordinator)
 {
+    recordInParallel = true;
     passDataDescriptorLayout = coordinator->manageInFlightDescriptorSetAOT("SelectedMaskPassDataDescriptorSet", { {vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eAllGraphics } });
+    passDataDescriptorSet = coordinator->getDescriptorSetHandle("SelectedMaskPassDataDescriptorSet");
 
     coordinator->updateInFlightDescriptorSetAOT("SelectedMaskPassDataDescriptorSet", 0, vk::DescriptorType::eUniformBuffer,[this](GPUFrame* frame) {
         return vk::Buffer(scene->mainView.camera.data.getBufferFor(frame->frameIdx));
@@ -270,23 +1081,23 @@ void SelectedMaskPass::onEnable(GPUFrame* frame)
             frame->backendDevice->setObjectDebugName(pipeline.getPipeline(), "SelectedMaskPassPipeline");
             graphicsPipelines.push_back(pipeline);
         }
-        if (instanceRigidDynamic.updateCurrentMask(1, frame->backendDevice) > 0)
-        {
-            PassActionContext actionContext{};
-            actionContext.pipelineIdx = 0;
-            actionContext.firstSet = 1;
-            actionContext.descriptorSets = { "SelectedMaskPassDataDescriptorSet" , instanceRigidDynamic.getDescriptorSet() };
-            actionContext.action = [instanceRigidDynamic, frame](vk::CommandBuffer cmd, uint32_t pipelineIdx){
-                instanceRigidDynamic.drawAllPosOnlyMasked(cmd, frame->backendDevice->getDLD());
-            };
-            actionContextQueue.push_back(actionContext);
-        }
+        // the selected instances were compacted by InstanceCullPass, a batch without any selected draws nothing
+        PassActionContext actionContext{};
+        actionContext.pipelineIdx = 0;
+        actionContext.firstSet = 1;
+        actionContext.descriptorSets = { passDataDescriptorSet, instanceRigidDynamic.getDescriptorSet() };
+        actionContext.action = [this, i, frame](vk::CommandBuffer cmd, uint32_t pipelineIdx){
+            scene->_dynamicRigidMeshBatch[i].drawCulledPosOnly(cmd, frame, renderScene::CulledDrawList::Selected);
+        };
+        actionContextQueue.push_back(actionContext);
     }
 }
 
 void WireFramePass::prepareAOT(FrameCoordinator* coordinator)
 {
+    recordInParallel = true;
     passDataDescriptorLayout = coordinator->manageInFlightDescriptorSetAOT("WireFramePassDataDescriptorSet", { {vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eAllGraphics } });
+    passDataDescriptorSet = coordinator->getDescriptorSetHandle("WireFramePassDataDescriptorSet");
 
     coordinator->updateInFlightDescriptorSetAOT("WireFramePassDataDescriptorSet", 0, vk::DescriptorType::eUniformBuffer,[this](GPUFrame* frame) {
         return vk::Buffer(scene->mainView.camera.data.getBufferFor(frame->frameIdx));
@@ -333,9 +1144,11 @@ void WireFramePass::onEnable(GPUFrame* frame)
         PassActionContext actionContext{};
         actionContext.pipelineIdx = 0;
         actionContext.firstSet = 1;
-        actionContext.descriptorSets = { "WireFramePassDataDescriptorSet" , instanceRigidDynamic.getDescriptorSet() };
-        actionContext.action = [instanceRigidDynamic, frame](vk::CommandBuffer cmd, uint32_t pipelineIdx) {
-            instanceRigidDynamic.drawAllPosOnly(cmd, frame->backendDevice->getDLD());
+        actionContext.descriptorSets = { passDataDescriptorSet, instanceRigidDynamic.getDescriptorSet() };
+        actionContext.action = [this, i, frame](vk::CommandBuffer cmd, uint32_t pipelineIdx) {
+            // what GBufferPass and GBufferLatePass drew, the late list is empty without occlusion culling
+            scene->_dynamicRigidMeshBatch[i].drawCulledPosOnly(cmd, frame, renderScene::CulledDrawList::Visible);
+            scene->_dynamicRigidMeshBatch[i].drawCulledPosOnly(cmd, frame, renderScene::CulledDrawList::Late);
          };
         actionContextQueue.push_back(actionContext);
     }
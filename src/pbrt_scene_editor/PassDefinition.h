@@ -7,7 +7,10 @@
 
 #include "GPUPass.h"
 #include "GPUFrame.hpp"
+#include "BindlessHeap.hpp"
 #include <map>
+#include <atomic>
+#include <future>
 #include "ShaderManager.h"
 
 #define RASTERIZEDPASS_DEF_BEGIN(name) struct name : GPURasterizedPass { name() : GPURasterizedPass(#name){};
@@ -39,6 +42,39 @@ namespace FullScreenQuadDrawer
     }
 };
 
+/*
+ * Frustum culls the instances of every InstanceBatchRigidDynamic on the GPU.
+ * The visible and the visible selected instances of a batch are compacted into index lists, together with
+ * their indexed indirect draws, which GBufferPass, SelectedMaskPass and WireFramePass draw later in the frame.
+ * With occlusion culling on, only the instances visible in the previous frame are kept for GBufferPass.
+ */
+COMPUTEPASS_DEF_BEGIN(InstanceCullPass)
+    vk::PipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    vk::DescriptorSetLayout passDataDescriptorLayout;
+    DescriptorSetHandle passDataDescriptorSet;
+    renderScene::RenderScene* scene{};
+    // whether the statistics buffer of a frame has been counted into yet
+    std::vector<bool> statisticsWritten;
+
+    void prepareAOT(FrameCoordinator*) override;
+    void onEnable(GPUFrame* frame) override;
+COMPUTEPASS_DEF_END(InstanceCullPass)
+
+/*
+ * Tests the meshlets of the instances InstanceCullPass kept for GBufferPass and writes an indexed indirect draw
+ * per visible meshlet, for the batches drawn per cluster (see ClusterCulling.hpp). Only records anything without
+ * mesh shaders, with them the task shader of GBufferPass runs the same test.
+ */
+COMPUTEPASS_DEF_BEGIN(ClusterCullPass)
+    vk::PipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    vk::DescriptorSetLayout passDataDescriptorLayout;
+    DescriptorSetHandle passDataDescriptorSet;
+    renderScene::RenderScene* scene{};
+
+    void prepareAOT(FrameCoordinator*) override;
+    void onEnable(GPUFrame* frame) override;
+COMPUTEPASS_DEF_END(ClusterCullPass)
+
 RASTERIZEDPASS_DEF_BEGIN(SkyBoxPass)
     void prepareAOT(FrameCoordinator*) override;
     renderScene::RenderScene* scene{};
@@ -53,6 +89,57 @@ RASTERIZEDPASS_DEF_BEGIN(SSAOPass)
     renderScene::RenderScene* scene{};
 RASTERIZEDPASS_DEF_END(SSAOPass)
 
+/*
+ * One draw of GBufferPass with all it binds. The packets of a frame are built again only when the batches of the
+ * scene, the pipelines or the cluster culling switch change, and recorded sorted by pipeline, material then mesh.
+ */
+struct GBufferDrawPacket
+{
+    enum class Kind : uint8_t
+    {
+        // the instances of a level the culling passes kept
+        Culled,
+        // the meshlets ClusterCullPass kept, counted on the GPU
+        Clusters,
+        // task workgroups testing the meshlets of every slot of the visible list
+        ClusterMeshTasks
+    };
+
+    uint32_t pipelineIdx;
+    // set 2, the instance data of the batch
+    vk::DescriptorSet instanceSet;
+    // set 4, only for ClusterMeshTasks
+    vk::DescriptorSet clusterSet;
+    // the record of the batch in BindlessHeap, set 3
+    uint32_t materialIdx;
+    vk::Buffer vertexBuffer;
+    vk::Buffer indexBuffer;
+    // the fallback pipeline takes the strides dynamically, 0 for the others
+    vk::DeviceSize vertexStride;
+    vk::Buffer instanceIndexBuffer;
+    vk::DeviceSize instanceIndexOffset;
+    vk::Buffer commandBuffer;
+    vk::DeviceSize commandOffset;
+    // Clusters : the capacity of the commands. ClusterMeshTasks : the workgroups along x and y
+    uint32_t maxDrawCount;
+    uint32_t taskGroupCountX;
+    uint32_t taskGroupCountY;
+    uint32_t batchIdx;
+    uint32_t lod;
+    // covers the buffers of both the batch and its mesh
+    UploadTicket uploadTicket;
+    Kind kind;
+};
+
+struct DrawPacketStatistics
+{
+    uint32_t packets = 0;
+    // times the packets were built during the frame, 0 while the scene and the pipelines stay the same
+    uint32_t rebuilds = 0;
+    // pipeline, descriptor set, vertex and index buffer bindings recorded
+    uint32_t stateChanges = 0;
+};
+
 RASTERIZEDPASS_DEF_BEGIN(GBufferPass)
     vk::PipelineLayout passLevelPipelineLayout;
     vk::PipelineRasterizationStateCreateInfo rasterInfo{};
@@ -60,48 +147,59 @@ RASTERIZEDPASS_DEF_BEGIN(GBufferPass)
     vk::PipelineColorBlendAttachmentState attachmentStates[8];
     vk::PipelineColorBlendStateCreateInfo colorBlendInfo{};
     vk::DescriptorSetLayout passDataDescriptorLayout;
+    DescriptorSetHandle passDataDescriptorSet;
+    vk::DescriptorSetLayout frameGlobalDescriptorSetLayout;
+    DeviceExtended* backendDevice = nullptr;
 
     void prepareAOT(FrameCoordinator*) override;
     void onEnable(GPUFrame* frame) override;
+    void record(vk::CommandBuffer cmd, GPUFrame* frame) override;
+
+    // Start compiling the pipelines of every instance batch of the scene, call once the scene is loaded.
+    void warmUp();
 
     using InstanceUUIDMap = std::unordered_map<renderScene::InstanceUUID,int,renderScene::InstanceUUIDHash>;
     InstanceUUIDMap pipelineLayoutMap;
     InstanceUUIDMap pipelineMap;
     InstanceUUIDMap instanceDescriptorSetMap;
-    int currentInstanceDescriptorSetIdx = -1;
     std::vector<vk::PipelineLayout> instancePipelineLayouts;
     std::vector<vk::DescriptorSet> instanceDescriptorSets;
 
+    using PipelineKeyMap = std::unordered_map<GraphicsPipelineKey,int,GraphicsPipelineKeyHash>;
+    using CompilingPipelineMap = std::unordered_map<GraphicsPipelineKey,std::shared_future<VulkanGraphicsPipeline>,GraphicsPipelineKeyHash>;
+    PipelineKeyMap pipelineKeyMap;
+    CompilingPipelineMap compilingPipelines;
+    // Position only pipeline drawing the instances whose pipeline is still compiling
+    int fallbackPipelineIdx = -1;
+    // task and mesh shading of the batches drawn per cluster, created with the first of their pipelines
+    vk::PipelineLayout clusterPipelineLayout = VK_NULL_HANDLE;
+
     vk::DescriptorSetLayout getPerInstanceDescriptorSetLayout()
     {
         return {};
     }
 
-    int getOrCreatePipelineLayout(const GPUFrame* frame,const renderScene::InstanceBatchRigidDynamicType & instanceRigidDynamic)
+    int getOrCreatePipelineLayout(const renderScene::InstanceBatchRigidDynamicType & instanceRigidDynamic)
     {
         if(instancePipelineLayouts.empty())
         {
             vk::PushConstantRange pushConstant{};
             pushConstant.setOffset(0);
-            pushConstant.setSize(sizeof(glm::uvec4));
+            // the mesh index and the material index
+            pushConstant.setSize(2 * sizeof(glm::uvec4));
             pushConstant.setStageFlags(vk::ShaderStageFlagBits::eFragment);
 
-            auto pipelineLayout = frame->backendDevice->createPipelineLayout2({frame->getFrameGlobalDescriptorSetLayout(),
+            auto pipelineLayout = backendDevice->createPipelineLayout2({frameGlobalDescriptorSetLayout,
                                                          passDataDescriptorLayout,
-                                                         instanceRigidDynamic.getSetLayout()},{pushConstant});
+                                                         instanceRigidDynamic.getSetLayout(),
+                                                         BindlessHeap::getInstance().getSetLayout()},{pushConstant});
             instancePipelineLayouts.push_back(pipelineLayout);
         }
         return 0;
     }
 
-    int getOrCreatePipeline(const GPUFrame* frame,const renderScene::InstanceBatchRigidDynamicType & instanceRigidDynamic)
+    static ShaderManager::ShaderMacroList getShaderMacros(const renderScene::InstanceBatchRigidDynamicType & instanceRigidDynamic)
     {
-        // 1. Is there any existing compatible pipeline?
-        // shaders(variant),
-        // vertex input, pipelineLayout could be retrieved through shaders reflection
-        // renderPass is determined by pass itself
-        // We ‘build and cache' pipeline, according to its identifier
-        auto vertexInputState = instanceRigidDynamic.getVertexInputState();
         ShaderManager::ShaderMacroList macroList;
         auto vertexAttr = instanceRigidDynamic.mesh->vertexAttribute;
         if(vertexAttr.normalOffset != -1)
@@ -116,73 +214,146 @@ RASTERIZEDPASS_DEF_BEGIN(GBufferPass)
         {
             macroList.emplace_back("HAS_VERTEX_UV","1");
         }
-
-        auto vsUUID = ShaderManager::queryShaderVariantUUID("simple.vert",macroList);
-        auto fsUUID = ShaderManager::queryShaderVariantUUID("simple.frag",macroList);
-
-        int idx = -1;
-        bool samePipelineLayout = true; //todo
-        for(int i = 0; i< graphicsPipelines.size();i++)
+        if(vertexAttr.quantized)
         {
-            if(graphicsPipelines[i].compatibleWith(vertexInputState) &&
-               graphicsPipelines[i].compatibleWithVertexShader(vsUUID) &&
-               graphicsPipelines[i].compatibleWithFragmentShader(fsUUID) &&
-               samePipelineLayout)
-            {
-                pipelineMap.emplace(instanceRigidDynamic.getUUID(),i);
-                idx = i;
-                break;
-            }
+            macroList.emplace_back("QUANTIZED_VERTEX_ATTRIBUTES","1");
         }
-        if(idx == -1)
+        return macroList;
+    }
+
+    /*
+     * Pipelines are identified by shader variants(derived from the vertex attributes),
+     * vertex input, pipeline layout and the render pass of the pass itself.
+     * A missing pipeline is compiled on the compile thread, -1 is returned until it's ready.
+     */
+    int getOrCreatePipeline(const renderScene::InstanceBatchRigidDynamicType & instanceRigidDynamic);
+
+    int getOrCreateFallbackPipeline(const renderScene::InstanceBatchRigidDynamicType & instanceRigidDynamic);
+
+    /*
+     * Task and mesh shader pipeline drawing the meshlets of a batch, only with mesh shaders. Same as getOrCreatePipeline,
+     * -1 while it compiles. The fallback pipeline is returned when it failed to build, the batch is then drawn per instance.
+     */
+    int getOrCreateClusterPipeline(const renderScene::InstanceBatchRigidDynamicType & instanceRigidDynamic);
+
+    // Move the pipelines finished by the compile thread into graphicsPipelines
+    void collectCompiledPipelines();
+    // bumped by collectCompiledPipelines, the packets drawn with the fallback pipeline switch to the compiled ones
+    uint64_t pipelineVersion = 0;
+
+    // What the packets of a frame were built from
+    struct DrawPacketListKey
+    {
+        uint64_t sceneVersion = ~0ull;
+        uint64_t pipelineVersion = 0;
+        bool clusterCulling = false;
+
+        bool operator==(const DrawPacketListKey& other) const
         {
-            // Need to create new pipeline
-            auto* vs = ShaderManager::getInstance().createVertexShader(frame->backendDevice,"simple.vert",macroList);
-            auto* fs = ShaderManager::getInstance().createFragmentShader(frame->backendDevice,"simple.frag",macroList);
-            int pipelineLayoutIdx = getOrCreatePipelineLayout(frame,instanceRigidDynamic);
-            VulkanGraphicsPipelineBuilder builder(frame->backendDevice->device,vs,fs,
-                vertexInputState.getCreateInfo(),
-                renderPass,
-                instancePipelineLayouts[pipelineLayoutIdx],
-                rasterInfo,depthStencilInfo,colorBlendInfo);
-            auto pipeline = builder.build();
-            graphicsPipelines.push_back(pipeline);
-            idx = graphicsPipelines.size() - 1;
+            return sceneVersion == other.sceneVersion && pipelineVersion == other.pipelineVersion && clusterCulling == other.clusterCulling;
         }
-        return idx;
-    }
+    };
+
+    struct DrawPacketList
+    {
+        DrawPacketListKey key;
+        std::vector<GBufferDrawPacket> packets;
+    };
+    // per frame in flight, like the culling outputs the packets point to
+    std::vector<DrawPacketList> drawPacketLists;
+    const DrawPacketList* currentDrawPackets = nullptr;
+
+    void buildDrawPackets(const GPUFrame* frame, std::vector<GBufferDrawPacket>& packets);
+
+    // Bind only what differs from the packet before, nothing is assumed bound at first but set 0
+    void recordDrawPackets(vk::CommandBuffer cmd, const GPUFrame* frame, vk::DescriptorSet passDataSet, size_t first, size_t last);
+
+    // of the latest frame recorded
+    DrawPacketStatistics statistics{};
+    DrawPacketStatistics frameStatistics{};
+    // added up by the recording workers
+    std::atomic<uint32_t> recordedStateChanges{ 0 };
 
     int allocateDescriptorSet(const GPUFrame* frame, const renderScene::InstanceBatchRigidDynamicType& instanceRigidDynamic)
     {
         return 0;
     }
 
-    void bindRenderState(PassActionContext& actionCtx, const GPUFrame* frame, const renderScene::InstanceBatchRigidDynamicType & instanceRigidDynamic)
+    // The pipeline of the batch, the fallback one while it compiles
+    int selectPipeline(const renderScene::InstanceBatchRigidDynamicType & instanceRigidDynamic)
     {
         auto instUUID = instanceRigidDynamic.getUUID();
         auto pipelineIdx = pipelineMap.find(instUUID);
         if(pipelineIdx!=pipelineMap.end())
         {
-            actionCtx.pipelineIdx = pipelineIdx->second;
-        }else{
-            actionCtx.pipelineIdx = getOrCreatePipeline(frame,instanceRigidDynamic);
+            return pipelineIdx->second;
         }
-        /*auto descriptorSetIdx = instanceDescriptorSetMap.find(instUUID);
-        if (descriptorSetIdx != instanceDescriptorSetMap.end())
+        int idx = getOrCreatePipeline(instanceRigidDynamic);
+        if(idx != -1)
         {
-            bindCurrentInstanceDescriptorSet(cmdBuf, descriptorSetIdx->second);
+            pipelineMap.emplace(instUUID,idx);
+            return idx;
         }
-        else {
-            auto idx = allocateDescriptorSet(frame, instanceRigidDynamic);
-            bindCurrentInstanceDescriptorSet(cmdBuf, idx);
-        }*/
-        actionCtx.descriptorSets.push_back(instanceRigidDynamic.getDescriptorSet());
+        return getOrCreateFallbackPipeline(instanceRigidDynamic);
+    }
+
+    // Fragment push constant : batch index, batch count, level of detail and whether the flat target shows the level
+    glm::uvec4 getMeshIdx(int batchIdx, uint32_t lod) const
+    {
+        return { static_cast<uint32_t>(batchIdx), static_cast<uint32_t>(scene->_dynamicRigidMeshBatch.size()), lod, scene->lodShading ? 1u : 0u };
     }
 
     renderScene::RenderScene* scene{};
     std::vector<std::pair<int,int>> pipelinesMap;
+    // which instances InstanceCullPass or HZBOcclusionPass kept for this pass
+    renderScene::CulledDrawList drawList = renderScene::CulledDrawList::Visible;
 RASTERIZEDPASS_DEF_END(GBufferPass)
 
+/*
+ * Second half of the two phase occlusion culling. Draws the instances HZBOcclusionPass found visible
+ * but GBufferPass didn't draw on top of the G-buffer, the targets have to be loaded.
+ */
+struct GBufferLatePass : GBufferPass
+{
+    GBufferLatePass()
+    {
+        _name = "GBufferLatePass";
+        drawList = renderScene::CulledDrawList::Late;
+    }
+};
+
+/*
+ * Builds the depth pyramid (HZB) from the sceneDepth GBufferPass left in a single dispatch, then tests every
+ * instance in the frustum against it. The instances that are visible but weren't drawn by GBufferPass go to
+ * GBufferLatePass, the visibility of all instances is kept for InstanceCullPass of the next frame.
+ */
+COMPUTEPASS_DEF_BEGIN(HZBOcclusionPass)
+    vk::PipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    vk::DescriptorSetLayout passDataDescriptorLayout;
+    vk::DescriptorSetLayout pyramidDescriptorLayout;
+    vk::DescriptorPool pyramidDescriptorPool;
+    vk::DescriptorSet pyramidDescriptorSet;
+    vk::Sampler pyramidSampler;
+    VMAImage pyramid{};
+    // one view per level for the build, the whole chain for the test
+    std::vector<vk::ImageView> pyramidLevelViews;
+    vk::ImageView pyramidView;
+    bool pyramidInitialized = false;
+    // the last workgroup of the build is the one that brings this back to 0
+    VMABuffer finishedGroupsBuffer{};
+    UploadTicket finishedGroupsTicket{};
+    glm::uvec2 depthSize{};
+    uint32_t mipCount = 0;
+    DeviceExtended* backendDevice = nullptr;
+    renderScene::RenderScene* scene{};
+
+    void prepareAOT(FrameCoordinator*) override;
+    void onEnable(GPUFrame* frame) override;
+
+    // (Re)create the pyramid for the extent of sceneDepth, no frame may be executing
+    void createPyramid();
+COMPUTEPASS_DEF_END(HZBOcclusionPass)
+
 RASTERIZEDPASS_DEF_BEGIN(DeferredLightingPass)
     void prepareAOT(FrameCoordinator*) override;
 RASTERIZEDPASS_DEF_END(DefereredLightingPass)
@@ -202,6 +373,7 @@ RASTERIZEDPASS_DEF_BEGIN(SelectedMaskPass)
     renderScene::RenderScene* scene{};
     vk::PipelineLayout pipelineLayout = VK_NULL_HANDLE;
     vk::DescriptorSetLayout passDataDescriptorLayout;
+    DescriptorSetHandle passDataDescriptorSet;
 
     void prepareAOT(FrameCoordinator*) override;
     void onEnable(GPUFrame* frame) override;
@@ -215,6 +387,7 @@ RASTERIZEDPASS_DEF_BEGIN(WireFramePass)
     renderScene::RenderScene* scene{};
     vk::PipelineLayout pipelineLayout = VK_NULL_HANDLE;
     vk::DescriptorSetLayout passDataDescriptorLayout;
+    DescriptorSetHandle passDataDescriptorSet;
     void prepareAOT(FrameCoordinator*) override;
     void onEnable(GPUFrame* frame) override;
 RASTERIZEDPASS_DEF_END(WireFramePass)
@@ -0,0 +1,103 @@
+#include "PipelineCache.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "GlobalLogger.h"
+
+void PipelineCache::init(DeviceExtended* device)
+{
+    backendDevice = device;
+
+    std::vector<char> initialData;
+    auto path = cacheFilePath();
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (file.is_open())
+    {
+        initialData.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(initialData.data(), static_cast<std::streamsize>(initialData.size()));
+        if (!file || !isCompatible(initialData))
+        {
+            GlobalLogger::getInstance().warn("ignoring stale pipeline cache : " + path.string());
+            initialData.clear();
+        }
+    }
+
+    vk::PipelineCacheCreateInfo createInfo{};
+    createInfo.setInitialDataSize(initialData.size());
+    createInfo.setPInitialData(initialData.empty() ? nullptr : initialData.data());
+    cache = backendDevice->createPipelineCache(createInfo);
+
+    compileThread = std::make_unique<ThreadPool>(1);
+}
+
+void PipelineCache::destroy()
+{
+    if (backendDevice == nullptr) return;
+    // the pool drains its queue before joining
+    compileThread.reset();
+    save();
+    backendDevice->destroyPipelineCache(cache);
+    cache = VK_NULL_HANDLE;
+    backendDevice = nullptr;
+}
+
+void PipelineCache::save()
+{
+    if (!cache) return;
+    auto data = backendDevice->getPipelineCacheData(cache);
+    if (data.empty()) return;
+
+    auto path = cacheFilePath();
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+
+    // write aside and rename, a truncated cache would be rejected on load anyway but would throw away the old one
+    auto tmpPath = path;
+    tmpPath += ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!out || !out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size())))
+        {
+            GlobalLogger::getInstance().warn("failed to write pipeline cache : " + tmpPath.string());
+            return;
+        }
+    }
+    std::filesystem::rename(tmpPath, path, ec);
+    if (ec)
+    {
+        GlobalLogger::getInstance().warn("failed to write pipeline cache : " + path.string());
+        std::filesystem::remove(tmpPath, ec);
+    }
+}
+
+std::filesystem::path PipelineCache::cacheFilePath() const
+{
+    const auto& props = backendDevice->physical_device.properties;
+    std::ostringstream name;
+    name << "pipeline_cache_" << std::hex << props.vendorID << "_" << props.deviceID << "_";
+    for (auto byte : props.pipelineCacheUUID)
+    {
+        name << std::setw(2) << std::setfill('0') << static_cast<uint32_t>(byte);
+    }
+    name << ".bin";
+
+    std::filesystem::path searchDir = EDITOR_PROJECT_SOURCE_DIR;
+    return searchDir / "res" / "shaders" / "compiled" / name.str();
+}
+
+bool PipelineCache::isCompatible(const std::vector<char>& data) const
+{
+    VkPipelineCacheHeaderVersionOne header{};
+    if (data.size() < sizeof(header)) return false;
+    memcpy(&header, data.data(), sizeof(header));
+
+    const auto& props = backendDevice->physical_device.properties;
+    return header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+        header.vendorID == props.vendorID &&
+        header.deviceID == props.deviceID &&
+        memcmp(header.pipelineCacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
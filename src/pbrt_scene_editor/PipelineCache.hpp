@@ -0,0 +1,52 @@
+#pragma once
+
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "VulkanExtension.h"
+#include "ThreadPool.h"
+#include "Singleton.h"
+
+/*
+ * Owns the VkPipelineCache every pipeline is created with, and a thread compiling pipelines in the background.
+ *
+ * The cache is loaded from res/shaders/compiled at startup and written back at shutdown. The file name carries the
+ * vendor, device and pipelineCacheUUID of the driver and the header is checked again on load, so a driver update
+ * starts from an empty cache instead of handing incompatible data to the driver.
+ */
+struct PipelineCache : Singleton<PipelineCache>
+{
+    void init(DeviceExtended* device);
+
+    // Waits for pending compilations, then saves and destroys the cache
+    void destroy();
+
+    void save();
+
+    // VK_NULL_HANDLE before init(), pipelines are then built without cache
+    vk::PipelineCache getHandle() const
+    {
+        return cache;
+    }
+
+    /*
+     * Run build() on the compile thread. Everything build() reads must stay alive and unchanged
+     * until the returned future is ready.
+     */
+    template<class F>
+    auto compileAsync(F&& build) -> std::shared_future<std::invoke_result_t<F>>
+    {
+        return compileThread->enqueue([build = std::forward<F>(build)](int) { return build(); }).share();
+    }
+
+private:
+    std::filesystem::path cacheFilePath() const;
+    bool isCompatible(const std::vector<char>& data) const;
+
+    DeviceExtended* backendDevice = nullptr;
+    vk::PipelineCache cache = VK_NULL_HANDLE;
+    std::unique_ptr<ThreadPool> compileThread;
+};
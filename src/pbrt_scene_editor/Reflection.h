@@ -5,8 +5,156 @@
 #ifndef PBRTEDITOR_REFLECTION_H
 #define PBRTEDITOR_REFLECTION_H
 
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <variant>
+#include <vector>
+#include <memory>
 #include "Inspector.hpp"
+#include "GlobalLogger.h"
+
+struct PBRTParam;
+
+template<class T, class = void>
+struct HasType : std::false_type {};
+
+template<class T>
+struct HasType<T, std::void_t<decltype(T::Type())>> : std::true_type {};
+
+/*
+ * Maps the parameter names of one class to the setters of its fields, filled once per class by the PARSE_FOR list.
+ * build() searches a seed under which every name gets its own slot, a parameter then costs one hash and one compare.
+ */
+template<class T>
+struct PBRTParamTable
+{
+    using Setter = void (*)(T&, const PBRTParam&);
+
+    template<class F>
+    explicit PBRTParamTable(F&& bindAll)
+    {
+        bindAll(*this);
+        build();
+    }
+
+    // A name bound twice keeps the last setter, derived classes bind after their base
+    void bind(std::string_view name, Setter setter)
+    {
+        for (auto& entry : entries)
+        {
+            if (entry.name == name)
+            {
+                entry.setter = setter;
+                return;
+            }
+        }
+        entries.push_back({name, setter, true});
+    }
+
+    // Known parameter consumed outside of parse(), accepted without warning
+    void ignore(std::string_view name)
+    {
+        bind(name, nullptr);
+    }
+
+    template<class Param>
+    void apply(T& object, const std::vector<Param>& para_lists) const
+    {
+        for (const auto& param : para_lists)
+        {
+            const auto& slot = slots[hash(param.name, seed) & (slots.size() - 1)];
+            if (slot.used && slot.name == param.name)
+            {
+                if (slot.setter) slot.setter(object, param);
+            }
+            else
+            {
+                warnUnknown(param.name);
+            }
+        }
+    }
+
+private:
+    struct Slot
+    {
+        std::string_view name;
+        Setter setter = nullptr;
+        bool used = false;
+    };
+
+    void build()
+    {
+        size_t capacity = 1;
+        while (capacity < entries.size() * 2) capacity <<= 1;
+        for (;; capacity <<= 1)
+        {
+            for (uint32_t s = 0; s < 64; s++)
+            {
+                if (tryBuild(capacity, s)) return;
+            }
+        }
+    }
+
+    static uint32_t hash(std::string_view name, uint32_t seed)
+    {
+        uint32_t h = 2166136261u ^ (seed * 0x9E3779B9u);
+        for (char c : name)
+        {
+            h ^= static_cast<uint8_t>(c);
+            h *= 16777619u;
+        }
+        return h ^ (h >> 15);
+    }
+
+    bool tryBuild(size_t capacity, uint32_t s)
+    {
+        std::vector<Slot> candidate(capacity);
+        for (const auto& entry : entries)
+        {
+            auto& slot = candidate[hash(entry.name, s) & (capacity - 1)];
+            if (slot.used) return false;
+            slot = entry;
+        }
+        slots = std::move(candidate);
+        seed = s;
+        return true;
+    }
+
+    static std::string typeName()
+    {
+        if constexpr (HasType<T>::value)
+        {
+            return T::Type();
+        }
+        else
+        {
+            return "option";
+        }
+    }
+
+    // Reported once per name, a scene may repeat the same parameter on every shape
+    void warnUnknown(std::string_view name) const
+    {
+        std::lock_guard<std::mutex> lock(warnedMutex);
+        if (warned.emplace(name).second)
+        {
+            GlobalLogger::getInstance().warn("Unknown parameter \"" + std::string(name) + "\" of " + typeName() + " is ignored");
+        }
+    }
+
+    std::vector<Slot> entries;
+    std::vector<Slot> slots;
+    uint32_t seed = 0;
+    mutable std::mutex warnedMutex;
+    mutable std::unordered_set<std::string> warned;
+};
 
 #define NARGS(...) NARGS_(__VA_ARGS__, 15,14,13,12,11,10,9,8,7,6,5, 4, 3, 2, 1, 0)
 #define NARGS_(_15,_14,_13,_12,_11,_10,_9,_8,_7,_6, _5, _4, _3, _2, _1, N, ...) N
@@ -55,10 +203,11 @@
 
 #define DEF_BASECLASS_END };
 
-#define PARSE_SECTION_BEGIN_IN_BASE void parseBase(const std::vector<PBRTParam> & para_lists)\
+#define PARSE_SECTION_BEGIN_IN_BASE template<class Self> \
+                                    static void bindBaseParams(PBRTParamTable<Self> & table) \
                                         {
 
-#define PARSE_SECTION_END_IN_BASE };
+#define PARSE_SECTION_END_IN_BASE }
 
 #define DEF_SUBCLASS_BEGIN(base,sub) \
                                      \
@@ -69,64 +218,66 @@
 
 #define DEF_SUBCLASS_END };
 
+// The table of a class is built on its first parse(), the fields are then set in a single pass over the parameters
 #define PARSE_SECTION_BEGIN void parse(const std::vector<PBRTParam> & para_lists)\
-        {
+        {                                                                  \
+            using Self = std::remove_pointer_t<decltype(this)>;            \
+            static const PBRTParamTable<Self> paramTable([](PBRTParamTable<Self> & table) {
 
-#define PARSE_SECTION_END }
+#define PARSE_SECTION_END });                                      \
+            paramTable.apply(*this, para_lists);                   \
+        }
 
 #define PARSE_SECTION_BEGIN_IN_DERIVED void parse(const std::vector<PBRTParam> & para_lists) override \
-        {
+        {                                                                  \
+            using Self = std::remove_pointer_t<decltype(this)>;            \
+            static const PBRTParamTable<Self> paramTable([](PBRTParamTable<Self> & table) {
 
 #define PARSE_SECTION_CONTINUE_IN_DERIVED PARSE_SECTION_BEGIN_IN_DERIVED \
-                                            this->parseBase(para_lists);
-
-#define PARSE_SECTION_END_IN_DERIVED }
-
-#define PARSE_FOR(name) for(auto & param : para_lists){ \
-                                if(param.first == #name) { \
-                                    if(std::holds_alternative<decltype(name)>(param.second)){\
-                                        name = std::get<decltype(name)>(param.second); \
-                                    } break;}                   \
-                                }
-
-#define PARSE_FOR_ARR(type,N,name)      int ele_count_for_##name = 0; \
-                                        for(auto & param : para_lists){ \
-                                            if(param.first == #name) { \
-                                                name[ele_count_for_##name] = std::get<type>(param.second); \
-                                                ele_count_for_##name++; \
-                                                if(ele_count_for_##name == N)       \
-                                                {  break;                          }                          \
-                                            }                         \
-                                        }
-
-//https://stackoverflow.com/questions/61046705/casting-a-variant-to-super-set-variant-or-a-subset-variant
-template <class... Args>
-struct variant_cast_proxy
+                                            Self::bindBaseParams(table);
+
+#define PARSE_SECTION_END_IN_DERIVED PARSE_SECTION_END
+
+#define PARSE_FOR(field) table.bind(#field, [](Self & self, const PBRTParam & param){ \
+                                if(param.holds<decltype(self.field)>()){\
+                                    self.field = param.get<decltype(self.field)>(); \
+                                } });
+
+#define PARSE_FOR_ARR(type,N,field) table.bind(#field, [](Self & self, const PBRTParam & param){ \
+                                        if(param.holds<type>()) { \
+                                            for(size_t i = 0; i < N && i < param.size(); i++) { \
+                                                self.field[i] = param.get<type>(i); \
+                                            } \
+                                        } });
+
+#define PARSE_FOR_VECTOR(field) table.bind(#field, [](Self & self, const PBRTParam & param){ \
+                                    if(param.holds<typename decltype(self.field)::value_type>()) { \
+                                        param.getAll(self.field); \
+                                    } });
+
+#define PARSE_IGNORE(field) table.ignore(#field);
+
+/*
+ * Assign the parameter to the first alternative of the variant it holds.
+ * A float parameter is also accepted by alternatives constructible from float, e.g. constant spectrum.
+ */
+template <class Param, class... Ts>
+bool assignVariant(std::variant<Ts...>& v, const Param& param)
 {
-    std::variant<Args...> v;
-    template <class... ToArgs>
-    operator std::variant<ToArgs...>() const
+    bool assigned = ((param.template holds<Ts>() ? (v = param.template get<Ts>(), true) : false) || ...);
+    if constexpr (std::is_constructible_v<std::variant<Ts...>, float>)
     {
-        return std::visit(
-                [](auto&& arg) -> std::variant<ToArgs...> {
-                    if constexpr (std::is_convertible_v<decltype(arg), std::variant<ToArgs...>>)
-                        return arg;
-                    else
-                        throw std::runtime_error("bad variant cast");
-                },v);
+        if (!assigned && param.template holds<float>())
+        {
+            v = param.template get<float>();
+            assigned = true;
+        }
     }
-};
-
-template <class... Args>
-auto variant_cast(const std::variant<Args...>& v) -> variant_cast_proxy<Args...>
-{
-    return { v };
+    return assigned;
 }
 
-#define PARSE_FOR_VARIANT(name) for(auto & param : para_lists){ \
-                                    if(param.first == #name) { \
-                                        name = variant_cast(param.second);\
-                                        break;} }
+#define PARSE_FOR_VARIANT(field) table.bind(#field, [](Self & self, const PBRTParam & param){ \
+                                    assignVariant(self.field, param); });
 
 static bool compareUpper(const std::string & str1,const std::string & str2)
 {
@@ -140,29 +291,41 @@ static bool compareUpper(const std::string & str1,const std::string & str2)
                       });
 }
 
+static std::string toUpper(std::string_view str)
+{
+    std::string upper(str);
+    std::transform(upper.begin(), upper.end(), upper.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+    return upper;
+}
+
 template<typename Base, class ... Derived>
 struct GenericCreator
 {
 private:
+        using Factory = std::unique_ptr<Base> (*)();
+
         template<class T>
-        static std::unique_ptr<Base> makeHelper(const std::string& type_str){
-            if (compareUpper(T::Type(),type_str))
-                return std::make_unique<T>();
-            else
-                return nullptr;
+        static std::unique_ptr<Base> makeOne(){
+            return std::make_unique<T>();
         };
 
-        template<class T, class U,class ... Args>
-        static std::unique_ptr<Base> makeHelper(const std::string& type_str){
-            if(compareUpper(T::Type(),type_str))
-                return std::make_unique<T>();
-            else
-                return makeHelper<U,Args...>(type_str);
+        // Upper-cased type name to factory, built on first use
+        static const std::unordered_map<std::string, Factory>& registry(){
+            static const std::unordered_map<std::string, Factory> table = []{
+                std::unordered_map<std::string, Factory> t;
+                t.reserve(sizeof...(Derived));
+                (t.emplace(toUpper(Derived::Type()), &makeOne<Derived>), ...);
+                return t;
+            }();
+            return table;
         };
 
 public:
         static std::unique_ptr<Base> make(const std::string& type_str){
-            return makeHelper<Derived ... >(type_str);
+            const auto& table = registry();
+            auto it = table.find(toUpper(type_str));
+            return it == table.end() ? nullptr : it->second();
         };
 };
 
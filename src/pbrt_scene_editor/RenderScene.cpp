@@ -12,6 +12,7 @@ namespace renderScene
     {
         {
             mainView.camera.data = FrameCoordinator::getInstance().allocateInFlightObservedBufferMapped<MainCameraData>(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+            cullStatistics = FrameCoordinator::getInstance().allocateInFlightObservedBufferMapped<InstanceCullStatistics>(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
 
             Window::registerMouseDragCallback([this](int button, double deltaX, double deltaY){
                 if(button == GLFW_MOUSE_BUTTON_RIGHT)
@@ -69,7 +70,8 @@ namespace renderScene
                         {
                             if (binding.second.first == selectedDynamicRigidMeshID.x && binding.second.second == selectedDynamicRigidMeshID.y)
                             {
-                                binding.first->toggle_select();
+                                if (auto* node = m_sceneGraph->node(binding.first))
+                                    node->toggle_select();
                             }
                         }
                     }
@@ -81,9 +83,11 @@ namespace renderScene
 
     void RenderScene::handleNodeShapes(SceneGraphNode* node, const glm::mat4& instanceBaseTransform, AssetManager& assetManager)
     {
-        for (int i = 0; i < node->shapes.size(); i++)
+        auto shapes = node->shapes();
+        auto materials = node->materials();
+        for (int i = 0; i < shapes.size(); i++)
         {
-            auto* shape = node->shapes[i];
+            auto* shape = shapes[i];
             std::string shape_uuid;
             PLYMeshShape* plyMeshPtr = nullptr;
             if (shape->getType() == "PLYMesh")
@@ -96,19 +100,16 @@ namespace renderScene
                 throw std::runtime_error("Only support ply mesh for now");
             }
 
+            auto meshSymbol = intern(shape_uuid);
             MeshRigidHandle meshHandle;
-
-            for (const auto& mesh : meshes)
+            if (auto* mesh = meshes.find(meshSymbol))
             {
-                if (mesh.first == shape_uuid)
-                {
-                    meshHandle = mesh.second;
-                }
+                meshHandle = *mesh;
             }
-
-            if (!meshHandle)
+            else
             {
                 meshHandle = assetManager.getOrLoadPLYMeshDevice(shape_uuid);
+                meshes.emplace(meshSymbol, meshHandle);
                 AABB aabb{};
                 aabb.minX = meshHandle.hostObject->aabb[0]; aabb.minY = meshHandle.hostObject->aabb[1];
                 aabb.minZ = meshHandle.hostObject->aabb[2]; aabb.maxX = meshHandle.hostObject->aabb[3];
@@ -116,101 +117,146 @@ namespace renderScene
                 aabbs.emplace_back(aabb);
             }
 
-            Material* mat = node->materials[i];;
+            Material* mat = materials[i];
 
             // For now we assume the instance with same mesh also share same material.
-            bool foundInstance = false;
-            for (int instIdx = 0; instIdx < _dynamicRigidMeshBatch.size(); instIdx++)
+            if (auto* batchIdx = meshBatchLookup.find(meshSymbol))
             {
+                auto instIdx = *batchIdx;
                 auto& inst = _dynamicRigidMeshBatch[instIdx];
-                if (inst.mesh == meshHandle)
-                {
-                    assert(mat->name == inst.materialName);
-                    foundInstance = true;
-                    inst.perInstanceData.push_back({ node->_finalTransform * instanceBaseTransform });
-                    inst.mask.push_back(0);
-                    auto instDataIdx = inst.perInstanceData.size() - 1;
-                    _sceneGraphNodeDynamicRigidMeshBatchBindingTable.emplace_back(node, std::make_pair(instIdx, instDataIdx));
-                    break;
-                }
+                assert(mat->name == inst.materialName);
+                inst.perInstanceData.push_back({ node->finalTransform() * instanceBaseTransform });
+                inst.mask.push_back(0);
+                auto instDataIdx = inst.perInstanceData.size() - 1;
+                _sceneGraphNodeDynamicRigidMeshBatchBindingTable.emplace_back(node->handle, std::make_pair(instIdx, instDataIdx));
             }
-
-            if (!foundInstance)
+            else
             {
                 // need to create new instance batch
                 InstanceBatchRigidDynamic<PerInstanceData> meshInstanceRigidDynamic(meshHandle);
-                meshInstanceRigidDynamic.perInstanceData.push_back({ node->_finalTransform * instanceBaseTransform });
+                meshInstanceRigidDynamic.perInstanceData.push_back({ node->finalTransform() * instanceBaseTransform });
                 meshInstanceRigidDynamic.materialName = mat->name;
                 meshInstanceRigidDynamic.mask.push_back(0);
-                if (mat->getType() == "CoatedDiffuse")
-                {
-                    auto* coatedDiffuse = static_cast<CoatedDiffuseMaterial*>(mat);
-                    std::visit(overloaded{
-                        [](auto arg) {},
-                        [&](const texture& arg) {
-                            for (auto tex : m_sceneGraph->namedTextures)
-                            {
-                                if (tex->name == arg.name && tex->getType() == "ImageMap")
-                                {
-                                    ImageMapTexture* imageMap = static_cast<ImageMapTexture*>(tex);
-                                    meshInstanceRigidDynamic.texture = assetManager.getOrLoadImgDevice(imageMap->filename,
-                                    imageMap->encoding,
-                                    imageMap->wrap,
-                                    imageMap->maxanisotropy);
-                                    return;
-                                }
-                            }
-                        },
-                        [&](const rgb& arg) {
-                            //create 1x1 texture
-                            meshInstanceRigidDynamic.texture = assetManager.create1x1ImgDevice(mat->name + ".reflectance",arg.r,arg.g,arg.b,1.0);
-                        },
-                        [](const spectrum& arg) {
+                auto material = getOrCreateBindlessMaterial(mat, assetManager);
+                meshInstanceRigidDynamic.materialIdx = material.index;
+                meshInstanceRigidDynamic.texture = material.texture;
 
-                        }
-                        }, coatedDiffuse->reflectance);
-                }
+                _dynamicRigidMeshBatch.push_back(meshInstanceRigidDynamic);
+                auto instIdx = _dynamicRigidMeshBatch.size() - 1;
+                meshBatchLookup.emplace(meshSymbol, static_cast<uint32_t>(instIdx));
+                _sceneGraphNodeDynamicRigidMeshBatchBindingTable.emplace_back(node->handle, std::make_pair(instIdx, 0));
+            }
+        }
+    }
 
-                if (mat->getType() == "Diffuse")
-                {
-                    auto* diffuse = static_cast<DiffuseMaterial*>(mat);
-                    std::visit(overloaded{
-                        [](auto arg) {},
-                        [&](const texture& arg) {
-                            for (auto tex : m_sceneGraph->namedTextures)
-                            {
-                                if (tex->name == arg.name && tex->getType() == "ImageMap")
-                                {
-                                    ImageMapTexture* imageMap = static_cast<ImageMapTexture*>(tex);
-                                    meshInstanceRigidDynamic.texture = assetManager.getOrLoadImgDevice(imageMap->filename,
-                                    imageMap->encoding,
-                                    imageMap->wrap,
-                                    imageMap->maxanisotropy);
-                                    return;
-                                }
-                            }
-                        },
-                        [&](const rgb& arg) {
-                            meshInstanceRigidDynamic.texture = assetManager.create1x1ImgDevice(mat->name + ".reflectance",arg.r,arg.g,arg.b,1.0);
-                        },
-                        [](const spectrum& arg) {
+    RenderScene::BindlessMaterial RenderScene::getOrCreateBindlessMaterial(Material* mat, AssetManager& assetManager)
+    {
+        auto materialSymbol = intern(mat->name);
+        if (auto* found = bindlessMaterials.find(materialSymbol))
+        {
+            return *found;
+        }
 
-                        }
-                        }, diffuse->reflectance);
+        auto& heap = BindlessHeap::getInstance();
+        BindlessMaterial material{};
+        BindlessMaterialRecord record{};
+        // Only what the rasterizer shades with is packed. Image maps are sampled, the other textures and the
+        // sampled or named spectra keep the default grey.
+        auto packColor = overloaded{
+            [](const auto& arg) {},
+            [&](const texture& arg) {
+                auto* tex = m_sceneGraph->findNamedTexture(arg.name);
+                if (tex == nullptr || tex->getType() != "ImageMap")
+                {
+                    return;
+                }
+                ImageMapTexture* imageMap = static_cast<ImageMapTexture*>(tex);
+                material.texture = assetManager.getOrLoadImgDevice(imageMap->filename,
+                    imageMap->encoding,
+                    imageMap->wrap,
+                    imageMap->maxanisotropy);
+                auto textureSymbol = intern(imageMap->filename);
+                if (auto* textureIdx = bindlessTextures.find(textureSymbol))
+                {
+                    record.reflectanceTexture = *textureIdx;
+                }
+                else
+                {
+                    record.reflectanceTexture = heap.addTexture(material.texture->imageView, material.texture->sampler);
+                    bindlessTextures.emplace(textureSymbol, record.reflectanceTexture);
+                }
+            },
+            [&](const rgb& arg) {
+                record.reflectance = glm::vec4(arg.r, arg.g, arg.b, 1.0f);
+            },
+            [&](const spectrum& arg) {
+                if (arg.samples.empty() && arg.named.empty())
+                {
+                    record.reflectance = glm::vec4(glm::vec3(arg.constant), 1.0f);
                 }
-
-                _dynamicRigidMeshBatch.push_back(meshInstanceRigidDynamic);
-                auto instIdx = _dynamicRigidMeshBatch.size() - 1;
-                _sceneGraphNodeDynamicRigidMeshBatchBindingTable.emplace_back(node, std::make_pair(instIdx, 0));
             }
+        };
+        auto packFloat = [](const auto& value, float& dst) {
+            std::visit(overloaded{
+                [](const auto& arg) {},
+                [&](float arg) { dst = arg; }
+                }, value);
+        };
+
+        auto type = mat->getType();
+        if (type == "CoatedDiffuse")
+        {
+            auto* coatedDiffuse = static_cast<CoatedDiffuseMaterial*>(mat);
+            record.type = BindlessMaterialType::CoatedDiffuse;
+            std::visit(packColor, coatedDiffuse->reflectance);
+            packFloat(coatedDiffuse->roughness, record.roughness);
+        }
+        else if (type == "CoatedConductor")
+        {
+            auto* coatedConductor = static_cast<CoatedConductorMaterial*>(mat);
+            record.type = BindlessMaterialType::CoatedConductor;
+            packColor(coatedConductor->reflectance);
+        }
+        else if (type == "Conductor")
+        {
+            auto* conductor = static_cast<ConductorMaterial*>(mat);
+            record.type = BindlessMaterialType::Conductor;
+            std::visit(packColor, conductor->reflectance);
+        }
+        else if (type == "Dielectric")
+        {
+            auto* dielectric = static_cast<DielectricMaterial*>(mat);
+            record.type = BindlessMaterialType::Dielectric;
+            packFloat(dielectric->eta, record.eta);
         }
+        else if (type == "Diffuse")
+        {
+            auto* diffuse = static_cast<DiffuseMaterial*>(mat);
+            record.type = BindlessMaterialType::Diffuse;
+            std::visit(packColor, diffuse->reflectance);
+        }
+        else if (type == "DiffuseTransmission")
+        {
+            auto* diffuseTransmission = static_cast<DiffuseTransmissionMaterial*>(mat);
+            record.type = BindlessMaterialType::DiffuseTransmission;
+            std::visit(packColor, diffuseTransmission->reflectance);
+        }
+        else if (type == "Mix")
+        {
+            record.type = BindlessMaterialType::Mix;
+        }
+
+        material.index = heap.addMaterial(record);
+        bindlessMaterials.emplace(materialSymbol, material);
+        return material;
     }
 
     void RenderScene::handleNodeLights(SceneGraphNode* node, const glm::mat4& instanceBaseTransform, AssetManager& assetManager)
     {
-        for (int i = 0; i < node->lights.size(); i++)
+        auto lights = node->lights();
+        for (int i = 0; i < lights.size(); i++)
         {
-            auto * light = node->lights[i];
+            auto * light = lights[i];
             if (light->getType() == "Infinite")
             {
                 auto * infiniteLight = static_cast<InfiniteLight*>(light);
@@ -226,38 +272,137 @@ namespace renderScene
         binding1.setDescriptorType(vk::DescriptorType::eStorageBuffer);
         binding1.setDescriptorCount(1);
 
-        vk::DescriptorSetLayoutBinding materialAlbedoBinding{};
-        materialAlbedoBinding.setBinding(1);
-        materialAlbedoBinding.setStageFlags(vk::ShaderStageFlagBits::eAllGraphics);
-        materialAlbedoBinding.setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
-        materialAlbedoBinding.setDescriptorCount(1);
+        // how the vertex shaders, and the mesh shader of the cluster path, decode the positions of the mesh
+        vk::DescriptorSetLayoutBinding dequantizationBinding{};
+        dequantizationBinding.setBinding(2);
+        dequantizationBinding.setStageFlags(vk::ShaderStageFlagBits::eAllGraphics);
+        if (backendDevice->meshShaderSupported)
+        {
+            dequantizationBinding.setStageFlags(vk::ShaderStageFlagBits::eAllGraphics | vk::ShaderStageFlagBits::eMeshEXT);
+        }
+        dequantizationBinding.setDescriptorType(vk::DescriptorType::eStorageBuffer);
+        dequantizationBinding.setDescriptorCount(1);
 
-        perInstanceDataSetLayout = backendDevice->createDescriptorSetLayout2({ binding1,materialAlbedoBinding });
+        // binding 1 was the reflectance map, the materials are in BindlessHeap now
+        perInstanceDataSetLayout = backendDevice->createDescriptorSetLayout2({ binding1,dequantizationBinding });
 
         vk::DescriptorPoolCreateInfo poolCreateInfo{};
-        std::array<vk::DescriptorPoolSize, 2> poolSize{};
+        std::array<vk::DescriptorPoolSize, 1> poolSize{};
         poolSize[0].setType(vk::DescriptorType::eStorageBuffer);
-        poolSize[0].setDescriptorCount(_dynamicRigidMeshBatch.size());
-        poolSize[1].setType(vk::DescriptorType::eCombinedImageSampler);
-        poolSize[1].setDescriptorCount(_dynamicRigidMeshBatch.size());
+        poolSize[0].setDescriptorCount(2 * _dynamicRigidMeshBatch.size());
         poolCreateInfo.setPoolSizes(poolSize);
         poolCreateInfo.setMaxSets(_dynamicRigidMeshBatch.size());
         perInstanceDataDescriptorPool = backendDevice->createDescriptorPool(poolCreateInfo);
 
+        // instance data, masks, visible, selected indices, draw commands, late indices and visibility, read and written by instanceCull.comp
+        std::vector<vk::DescriptorSetLayoutBinding> cullBindings(7);
+        for (uint32_t binding = 0; binding < cullBindings.size(); binding++)
+        {
+            cullBindings[binding].setBinding(binding);
+            cullBindings[binding].setStageFlags(vk::ShaderStageFlagBits::eCompute);
+            cullBindings[binding].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+            cullBindings[binding].setDescriptorCount(1);
+        }
+        instanceCullSetLayout = backendDevice->createDescriptorSetLayout2(cullBindings);
+
+        auto framesInFlight = static_cast<uint32_t>(FrameCoordinator::getInstance().inFlightframes.size());
+        vk::DescriptorPoolSize cullPoolSize{};
+        cullPoolSize.setType(vk::DescriptorType::eStorageBuffer);
+        cullPoolSize.setDescriptorCount(cullBindings.size() * framesInFlight * _dynamicRigidMeshBatch.size());
+        vk::DescriptorPoolCreateInfo cullPoolCreateInfo{};
+        cullPoolCreateInfo.setPoolSizes(cullPoolSize);
+        cullPoolCreateInfo.setMaxSets(framesInFlight * _dynamicRigidMeshBatch.size());
+        instanceCullDescriptorPool = backendDevice->createDescriptorPool(cullPoolCreateInfo);
+
+        // instance data, meshlets, instance draw commands, visible indices, cluster draws, meshlet vertices and triangles,
+        // vertex buffer and statistics, read by clusterCull.comp or by the task and mesh shaders of GBufferPass
+        auto clusterStages = vk::ShaderStageFlags(vk::ShaderStageFlagBits::eCompute);
+        if (backendDevice->meshShaderSupported)
+        {
+            clusterStages |= vk::ShaderStageFlagBits::eTaskEXT | vk::ShaderStageFlagBits::eMeshEXT;
+        }
+        std::vector<vk::DescriptorSetLayoutBinding> clusterBindings(9);
+        for (uint32_t binding = 0; binding < clusterBindings.size(); binding++)
+        {
+            clusterBindings[binding].setBinding(binding);
+            clusterBindings[binding].setStageFlags(clusterStages);
+            clusterBindings[binding].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+            clusterBindings[binding].setDescriptorCount(1);
+        }
+        clusterSetLayout = backendDevice->createDescriptorSetLayout2(clusterBindings);
+
+        for (auto& dynamicInstance : _dynamicRigidMeshBatch)
+        {
+            dynamicInstance.prepare(backendDevice.get(), framesInFlight);
+        }
+
+        auto clusteredBatches = static_cast<uint32_t>(std::count_if(_dynamicRigidMeshBatch.begin(), _dynamicRigidMeshBatch.end(),
+                                                                    [](const auto& batch) { return batch.clusterCulling; }));
+        if (clusteredBatches > 0)
+        {
+            vk::DescriptorPoolSize clusterPoolSize{};
+            clusterPoolSize.setType(vk::DescriptorType::eStorageBuffer);
+            clusterPoolSize.setDescriptorCount(clusterBindings.size() * framesInFlight * clusteredBatches);
+            vk::DescriptorPoolCreateInfo clusterPoolCreateInfo{};
+            clusterPoolCreateInfo.setPoolSizes(clusterPoolSize);
+            clusterPoolCreateInfo.setMaxSets(framesInFlight * clusteredBatches);
+            clusterDescriptorPool = backendDevice->createDescriptorPool(clusterPoolCreateInfo);
+        }
+
         for (auto& dynamicInstance : _dynamicRigidMeshBatch)
         {
-            dynamicInstance.prepare(backendDevice.get());
+            for (auto& output : dynamicInstance.cullOutputs)
+            {
+                output.descriptorSet = backendDevice->allocateSingleDescriptorSet(instanceCullDescriptorPool, instanceCullSetLayout);
+                backendDevice->updateDescriptorSetStorageBuffer(output.descriptorSet, 0, dynamicInstance.perInstDataBuffer.buffer);
+                backendDevice->updateDescriptorSetStorageBuffer(output.descriptorSet, 1, dynamicInstance.maskBuffer.buffer);
+                backendDevice->updateDescriptorSetStorageBuffer(output.descriptorSet, 2, output.visibleIndicesBuffer.buffer);
+                backendDevice->updateDescriptorSetStorageBuffer(output.descriptorSet, 3, output.selectedIndicesBuffer.buffer);
+                backendDevice->updateDescriptorSetStorageBuffer(output.descriptorSet, 4, output.drawCommandBuffer.buffer);
+                backendDevice->updateDescriptorSetStorageBuffer(output.descriptorSet, 5, output.lateIndicesBuffer.buffer);
+                backendDevice->updateDescriptorSetStorageBuffer(output.descriptorSet, 6, dynamicInstance.visibilityBuffer.buffer);
+            }
+            if (dynamicInstance.clusterCulling)
+            {
+                const auto& mesh = dynamicInstance.mesh;
+                for (uint32_t frameIdx = 0; frameIdx < framesInFlight; frameIdx++)
+                {
+                    auto& output = dynamicInstance.cullOutputs[frameIdx];
+                    output.clusterDescriptorSet = backendDevice->allocateSingleDescriptorSet(clusterDescriptorPool, clusterSetLayout);
+                    backendDevice->updateDescriptorSetStorageBuffer(output.clusterDescriptorSet, 0, dynamicInstance.perInstDataBuffer.buffer);
+                    backendDevice->updateDescriptorSetStorageBuffer(output.clusterDescriptorSet, 1, mesh->meshletBuffer.buffer);
+                    backendDevice->updateDescriptorSetStorageBuffer(output.clusterDescriptorSet, 2, output.drawCommandBuffer.buffer);
+                    backendDevice->updateDescriptorSetStorageBuffer(output.clusterDescriptorSet, 3, output.visibleIndicesBuffer.buffer);
+                    // only the indirect path writes draws, only the mesh shading path reads the vertices itself
+                    if (output.clusterDrawBuffer.buffer != VK_NULL_HANDLE)
+                    {
+                        backendDevice->updateDescriptorSetStorageBuffer(output.clusterDescriptorSet, 4, output.clusterDrawBuffer.buffer);
+                    }
+                    else
+                    {
+                        backendDevice->updateDescriptorSetStorageBuffer(output.clusterDescriptorSet, 5, mesh->meshletVertexBuffer.buffer);
+                        backendDevice->updateDescriptorSetStorageBuffer(output.clusterDescriptorSet, 6, mesh->meshletTriangleBuffer.buffer);
+                        backendDevice->updateDescriptorSetStorageBuffer(output.clusterDescriptorSet, 7, mesh->vertexBuffer.buffer);
+                    }
+                    backendDevice->updateDescriptorSetStorageBuffer(output.clusterDescriptorSet, 8, vk::Buffer(cullStatistics.getBufferFor(frameIdx)));
+                }
+                // the cluster sets read the meshlet buffers without binding the mesh
+                dynamicInstance.uploadTicket.value = std::max(dynamicInstance.uploadTicket.value, mesh->uploadTicket.value);
+            }
             auto descriptorSet = backendDevice->allocateSingleDescriptorSet(perInstanceDataDescriptorPool, perInstanceDataSetLayout);
 
             backendDevice->updateDescriptorSetStorageBuffer(descriptorSet, 0, dynamicInstance.perInstDataBuffer.buffer);
+            backendDevice->updateDescriptorSetStorageBuffer(descriptorSet, 2, dynamicInstance.mesh->dequantizationBuffer.buffer);
+            // the texture is sampled through the bindless heap
             if (dynamicInstance.texture)
             {
-                backendDevice->updateDescriptorSetCombinedImageSampler(descriptorSet, 1, dynamicInstance.texture->imageView, dynamicInstance.texture->sampler);
+                dynamicInstance.uploadTicket.value = std::max(dynamicInstance.uploadTicket.value, dynamicInstance.texture->uploadTicket.value);
             }
 
             dynamicInstance.perInstDataDescriptorLayout = perInstanceDataSetLayout;
             dynamicInstance.perInstDataDescriptorSet = descriptorSet;
         }
+        structureVersion++;
     }
 
     void RenderScene::buildFrom(SceneGraph * sceneGraph, AssetManager &assetManager)
@@ -293,9 +438,9 @@ namespace renderScene
         static auto nodeFocusOn = [this](SceneGraphNode* node)->void
         {
             glm::vec3 target;
-            target.x = node->_finalTransform[3].x;
-            target.y = node->_finalTransform[3].y;
-            target.z = node->_finalTransform[3].z;
+            target.x = node->finalTransform()[3].x;
+            target.y = node->finalTransform()[3].y;
+            target.z = node->finalTransform()[3].z;
             glm::vec3 eye = mainView.camera.stagingData.position;
             mainView.camera.front = target - eye;
             mainView.camera.stagingData.view = glm::lookAt(eye, target, { 0,1,0 });
@@ -307,14 +452,16 @@ namespace renderScene
         };
 
         std::vector<SceneGraphNode *> stack;
-        stack.push_back(m_sceneGraph->root);
+        if(auto * root = m_sceneGraph->node(m_sceneGraph->root))
+            stack.push_back(root);
 
         while(!stack.empty())
         {
             auto * node = stack.back();
             stack.pop_back();
-            for(auto * child : node->children)
+            for(auto childHandle : node->children())
             {
+                auto * child = m_sceneGraph->node(childHandle);
                 if(child->is_instance)
                 {
                     std::vector<SceneGraphNode *> stack2;
@@ -324,11 +471,11 @@ namespace renderScene
                     {
                         auto * node2 = stack2.back();
                         stack2.pop_back();
-                        for(auto * child2 : node2->children)
+                        for(auto child2 : node2->children())
                         {
-                            stack2.push_back(child2);
+                            stack2.push_back(m_sceneGraph->node(child2));
                         }
-                        handleNode(node2,node->_finalTransform);
+                        handleNode(node2,node->finalTransform());
                     }
                 }
                 else {
@@ -365,59 +512,82 @@ namespace renderScene
         
         prepareGPUResource();
 
-        m_sceneGraph->nodeSelectSignal += [this](SceneGraphNode* node)
+        // sorted by node, so that the bindings of a node are found by binary search
+        std::stable_sort(_sceneGraphNodeDynamicRigidMeshBatchBindingTable.begin(), _sceneGraphNodeDynamicRigidMeshBatchBindingTable.end(),
+                         [](const auto& a, const auto& b) { return a.first.value < b.first.value; });
+
+        m_sceneGraph->nodeSelectSignal += [this](SceneGraphNodeHandle node)
             {
-                for (const auto binding : _sceneGraphNodeDynamicRigidMeshBatchBindingTable)
+                auto [first, last] = bindingsOf(node);
+                for (auto it = first; it != last; ++it)
                 {
-                    if (binding.first == node)
-                    {
-                        auto instIdx = binding.second.first;
-                        auto instDataIdx = binding.second.second;
-                        _dynamicRigidMeshBatch[instIdx].mask[instDataIdx] = 1;
-                        return;
-                    }
+                    auto& inst = _dynamicRigidMeshBatch[it->second.first];
+                    UploadScheduler::getInstance().use(inst.uploadTicket);
+                    uploadRequests.emplace_back(inst.setMask(it->second.second, 1));
                 }
             };
 
-        m_sceneGraph->nodeUnSelectSignal += [this](SceneGraphNode* node)
+        m_sceneGraph->nodeUnSelectSignal += [this](SceneGraphNodeHandle node)
             {
-                for (const auto binding : _sceneGraphNodeDynamicRigidMeshBatchBindingTable)
+                auto [first, last] = bindingsOf(node);
+                for (auto it = first; it != last; ++it)
                 {
-                    if (binding.first == node)
-                    {
-                        auto instIdx = binding.second.first;
-                        auto instDataIdx = binding.second.second;
-                        _dynamicRigidMeshBatch[instIdx].mask[instDataIdx] = 0;
-                        return;
-                    }
+                    auto& inst = _dynamicRigidMeshBatch[it->second.first];
+                    UploadScheduler::getInstance().use(inst.uploadTicket);
+                    uploadRequests.emplace_back(inst.setMask(it->second.second, 0));
                 }
             };
 
-        m_sceneGraph->nodeFinalTransformChangeSignal += [this](SceneGraphNode* node){
-            for (const auto binding : _sceneGraphNodeDynamicRigidMeshBatchBindingTable)
+        m_sceneGraph->nodeFinalTransformChangeSignal += [this](const std::vector<SceneGraphNodeHandle>& changed){
+            std::vector<std::vector<uint32_t>> changedInstances(_dynamicRigidMeshBatch.size());
+            for (auto handle : changed)
             {
-                if (binding.first == node)
+                auto* node = m_sceneGraph->node(handle);
+                if (node == nullptr)
+                    continue;
+                auto [first, last] = bindingsOf(handle);
+                for (auto it = first; it != last; ++it)
                 {
-                    auto instIdx = binding.second.first;
-                    auto instDataIdx = binding.second.second;
-                    auto& inst = _dynamicRigidMeshBatch[instIdx];
-                    auto& instData = inst.perInstanceData[instDataIdx];
-                    instData._wTransform = node->_finalTransform;
+                    auto instIdx = it->second.first;
+                    auto instDataIdx = it->second.second;
+                    _dynamicRigidMeshBatch[instIdx].perInstanceData[instDataIdx]._wTransform = node->finalTransform();
+                    changedInstances[instIdx].push_back(instDataIdx);
+                }
+            }
+
+            // one copy per run of adjacent instances, instead of one per instance
+            for (size_t instIdx = 0; instIdx < changedInstances.size(); instIdx++)
+            {
+                auto& indices = changedInstances[instIdx];
+                if (indices.empty())
+                    continue;
+                std::sort(indices.begin(), indices.end());
+                indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+                auto& inst = _dynamicRigidMeshBatch[instIdx];
+                // the staged copy runs on the graphics queue, the buffer must be acquired from the transfer queue by then
+                UploadScheduler::getInstance().use(inst.uploadTicket);
+                for (size_t begin = 0, end = 0; begin < indices.size(); begin = end)
+                {
+                    end = begin + 1;
+                    while (end < indices.size() && indices[end] == indices[end - 1] + 1)
+                        end++;
                     DeviceExtended::BufferCopy copy{};
-                    copy.data = &instData._wTransform;
+                    copy.data = &inst.perInstanceData[indices[begin]];
                     copy.dst = inst.perInstDataBuffer.buffer;
-                    copy.size = sizeof(instData._wTransform);
-                    copy.dstOffset = sizeof(instData._wTransform) * instDataIdx;
+                    copy.size = static_cast<uint32_t>(sizeof(PerInstanceData) * (end - begin));
+                    copy.dstOffset = static_cast<uint32_t>(sizeof(PerInstanceData) * indices[begin]);
                     uploadRequests.emplace_back(copy);
-                    return;
                 }
             }
         };
     }
 
     void RenderScene::update() {
+       // edited transforms reach the instance data through nodeFinalTransformChangeSignal
+       if (m_sceneGraph != nullptr)
+           m_sceneGraph->updateTransforms();
        mainView.camera.data = mainView.camera.stagingData;
-       backendDevice->oneTimeUploadSync(uploadRequests);
+       UploadScheduler::getInstance().stageGraphicsCopies(uploadRequests);
        uploadRequests.clear();
     }
 }
@@ -5,6 +5,7 @@
 #ifndef PBRTEDITOR_RENDERSCENE_H
 #define PBRTEDITOR_RENDERSCENE_H
 
+#include <algorithm>
 #include <vulkan/vulkan.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "sceneGraphEditor.hpp"
@@ -13,6 +14,9 @@
 #include "window.h"
 #include <glm/gtc/matrix_transform.hpp>
 #include "GPUFrame.hpp"
+#include "InstanceCulling.hpp"
+#include "ClusterCulling.hpp"
+#include "BindlessHeap.hpp"
 
 namespace renderScene {
 
@@ -99,9 +103,12 @@ namespace renderScene {
                     pipelineVertexInputStateInfo(initPipelineVertexInputInfo(handle))
         {
             _uuid.high = mesh->_uuid;
+            const auto* aabb = handle.hostObject->aabb;
+            aabbMin = { aabb[0], aabb[1], aabb[2], 1.0f };
+            aabbMax = { aabb[3], aabb[4], aabb[5], 1.0f };
         }
 
-        void prepare(DeviceExtended * device)
+        void prepare(DeviceExtended * device, uint32_t framesInFlight)
         {
             auto instanceDataBufferSize = sizeof(PerInstDataT) * perInstanceData.size();
             auto bufferRes = device->allocateBuffer(instanceDataBufferSize, 
@@ -114,7 +121,8 @@ namespace renderScene {
             }
 
             perInstDataBuffer = bufferRes.value();
-            device->oneTimeUploadSync(perInstanceData.data(), instanceDataBufferSize, perInstDataBuffer.buffer);
+            auto& uploads = UploadScheduler::getInstance();
+            uploadTicket = uploads.uploadBuffer(perInstanceData.data(), instanceDataBufferSize, perInstDataBuffer.buffer);
 
             for (int i = 0; i < perInstanceData.size(); i++)
             {
@@ -131,18 +139,100 @@ namespace renderScene {
             }
 
             instanceDataIdicesBuffer = bufferRes.value();
-            device->oneTimeUploadSync(instanceDataIdices.data(), sizeof(uint32_t) * perInstanceData.size(), instanceDataIdicesBuffer.buffer);
+            auto indicesTicket = uploads.uploadBuffer(instanceDataIdices.data(), sizeof(uint32_t) * perInstanceData.size(), instanceDataIdicesBuffer.buffer);
+            uploadTicket.value = std::max(uploadTicket.value, indicesTicket.value);
 
-            bufferRes = device->allocateBuffer(sizeof(uint32_t) * perInstanceData.size(),
-                (VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT),
+            bufferRes = device->allocateBuffer(sizeof(uint32_t) * mask.size(),
+                (VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT),
                 VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
 
             if (!bufferRes.has_value())
             {
-                throw std::runtime_error("Failed to allocate instance mask indies buffer");
+                throw std::runtime_error("Failed to allocate instance mask buffer");
+            }
+
+            maskBuffer = bufferRes.value();
+            auto maskTicket = uploads.uploadBuffer(mask.data(), sizeof(uint32_t) * mask.size(), maskBuffer.buffer);
+            uploadTicket.value = std::max(uploadTicket.value, maskTicket.value);
+
+            // read by the early and written by the late culling phase, every instance starts out as not visible
+            bufferRes = device->allocateBuffer(sizeof(uint32_t) * perInstanceData.size(),
+                (VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT),
+                VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+            if (!bufferRes.has_value())
+            {
+                throw std::runtime_error("Failed to allocate instance visibility buffer");
+            }
+            visibilityBuffer = bufferRes.value();
+            std::vector<uint32_t> notVisible(perInstanceData.size(), 0);
+            auto visibilityTicket = uploads.uploadBuffer(notVisible.data(), sizeof(uint32_t) * notVisible.size(), visibilityBuffer.buffer);
+            uploadTicket.value = std::max(uploadTicket.value, visibilityTicket.value);
+
+            lodCount = static_cast<uint32_t>(std::clamp<size_t>(mesh->lods.size(), 1, InstanceCullDrawCommands::MAX_LODS));
+
+            // written by the culling pass every frame, one set per frame in flight so a frame never overwrites what an older one still draws
+            // every list has a region per level of detail, see getLodListOffset()
+            auto listSize = sizeof(uint32_t) * perInstanceData.size() * lodCount;
+            cullOutputs.resize(framesInFlight);
+            for (auto& output : cullOutputs)
+            {
+                bufferRes = device->allocateBuffer(listSize,
+                    (VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT),
+                    VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+                if (!bufferRes.has_value())
+                {
+                    throw std::runtime_error("Failed to allocate visible instance indices buffer");
+                }
+                output.visibleIndicesBuffer = bufferRes.value();
+
+                bufferRes = device->allocateBuffer(listSize,
+                    (VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT),
+                    VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+                if (!bufferRes.has_value())
+                {
+                    throw std::runtime_error("Failed to allocate selected instance indices buffer");
+                }
+                output.selectedIndicesBuffer = bufferRes.value();
+
+                bufferRes = device->allocateBuffer(listSize,
+                    (VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT),
+                    VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+                if (!bufferRes.has_value())
+                {
+                    throw std::runtime_error("Failed to allocate late instance indices buffer");
+                }
+                output.lateIndicesBuffer = bufferRes.value();
+
+                bufferRes = device->allocateBuffer(sizeof(InstanceCullDrawCommands),
+                    (VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT),
+                    VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+                if (!bufferRes.has_value())
+                {
+                    throw std::runtime_error("Failed to allocate culled draw command buffer");
+                }
+                output.drawCommandBuffer = bufferRes.value();
             }
 
-            instanceMaskedIdicesBuffer = bufferRes.value();
+            // the indirect path needs a count and the instance in firstInstance, the mesh shading path none of them
+            auto instanceCount = static_cast<uint32_t>(perInstanceData.size());
+            bool clusterPathSupported = device->meshShaderSupported ||
+                                        (device->drawIndirectCountSupported && device->drawIndirectFirstInstanceSupported);
+            clusterCulling = mesh->meshletCount > 0 && clusterPathSupported && instanceCount <= 65535 &&
+                             uint64_t(instanceCount) * mesh->meshletCount <= MAX_CLUSTER_DRAWS;
+            if (clusterCulling && !device->meshShaderSupported)
+            {
+                for (auto& output : cullOutputs)
+                {
+                    bufferRes = device->allocateBuffer(ClusterDrawCommands::size(getClusterDrawCapacity()),
+                        (VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT),
+                        VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+                    if (!bufferRes.has_value())
+                    {
+                        throw std::runtime_error("Failed to allocate cluster draw command buffer");
+                    }
+                    output.clusterDrawBuffer = bufferRes.value();
+                }
+            }
         }
 
         VkBuffer getInstanceDataBuffer() const
@@ -161,6 +251,7 @@ namespace renderScene {
         }
 
         void drawAll(vk::CommandBuffer cmd) const{
+            UploadScheduler::getInstance().use(uploadTicket);
             mesh->bind(cmd);
             //bind per instance data
             cmd.bindVertexBuffers(1, { instanceDataIdicesBuffer.buffer }, {0});
@@ -168,6 +259,7 @@ namespace renderScene {
         }
 
         void drawAllPosOnly(vk::CommandBuffer cmd,vk::DispatchLoaderDynamic loader) const {
+            UploadScheduler::getInstance().use(uploadTicket);
             mesh->bindPosOnly(cmd,loader);
 
             //bind per instance data
@@ -175,95 +267,164 @@ namespace renderScene {
             cmd.drawIndexed(mesh->indexCount, perInstanceData.size(), 0, 0, 0);
         }
 
-        uint32_t updateCurrentMask(uint32_t _mask,DeviceExtended* device)
+        void drawOne(vk::CommandBuffer cmd) const{
+            UploadScheduler::getInstance().use(uploadTicket);
+            mesh->bind(cmd);
+            //todo bind per instance data
+            cmd.drawIndexed(mesh->indexCount, 1, 0, 0, 0);
+        }
+
+        // Zero the instance counts of the frame, recorded before the culling dispatch
+        void resetCulledDraws(vk::CommandBuffer cmd, uint32_t frameIdx) const
         {
-            std::vector<uint32_t> collectMaskedIndices;
-            for (int i = 0; i < mask.size(); i++)
-            {
-                if (mask[i] == _mask)
-                {
-                    collectMaskedIndices.push_back(i);
-                }
-            }
-            if (collectMaskedIndices.empty())
-            {
-                collectedMaskedCache.clear();
-                return 0;
-            }
+            auto commands = InstanceCullDrawCommands::empty(mesh->lods);
+            cmd.updateBuffer(cullOutputs[frameIdx].drawCommandBuffer.buffer, 0, sizeof(commands), &commands);
+        }
 
-            if (collectMaskedIndices.size() > collectedMaskedCache.size())
+        // lodScale as in selectInstanceLod(), every instance keeps level 0 without one
+        InstanceCullPushConstants getCullPushConstants(float lodScale) const
+        {
+            InstanceCullPushConstants constants{};
+            constants.aabbMin = aabbMin;
+            constants.aabbMax = aabbMax;
+            constants.instanceCount = static_cast<uint32_t>(perInstanceData.size());
+            constants.selectedMask = 1;
+            constants.lodCount = lodScale > 0.0f ? lodCount : 1;
+            constants.lodScale = lodScale;
+            for (uint32_t lod = 0; lod < lodCount; lod++)
             {
-                collectedMaskedCache = collectMaskedIndices;
-                device->oneTimeUploadSync(collectedMaskedCache.data(), sizeof(uint32_t) * collectedMaskedCache.size(), instanceMaskedIdicesBuffer.buffer);
-                return collectedMaskedCache.size();
+                constants.lodErrors[lod] = mesh->lods[lod].error;
             }
+            return constants;
+        }
 
-            bool consistence = true;
-            for (int i = 0; i < collectMaskedIndices.size(); i++)
+        uint32_t getLodCount() const
+        {
+            return lodCount;
+        }
+
+        // The region of a level in the index lists, bound as the instance rate vertex buffer so that firstInstance stays 0
+        vk::DeviceSize getLodListOffset(uint32_t lod) const
+        {
+            return sizeof(uint32_t) * perInstanceData.size() * lod;
+        }
+
+        vk::DescriptorSet getCullDescriptorSet(uint32_t frameIdx) const
+        {
+            return cullOutputs[frameIdx].descriptorSet;
+        }
+
+        /*
+         * Draw the instances the culling passes of the frame kept in list, level after level from firstLod.
+         * beforeLod runs before the draw of each level. The instance counts never reach the CPU.
+         */
+        void drawCulled(vk::CommandBuffer cmd, const GPUFrame* frame, CulledDrawList list, uint32_t firstLod = 0,
+                        const std::function<void(uint32_t)>& beforeLod = {}) const
+        {
+            if (firstLod >= lodCount) return;
+            UploadScheduler::getInstance().use(uploadTicket);
+            const auto& output = cullOutputs[frame->frameIdx];
+            mesh->bind(cmd);
+            for (uint32_t lod = firstLod; lod < lodCount; lod++)
             {
-                if (collectMaskedIndices[i] != collectedMaskedCache[i])
-                {
-                    consistence = false;
-                    break;
-                }
+                if (beforeLod) beforeLod(lod);
+                cmd.bindVertexBuffers(1, { output.indicesBufferOf(list) }, { getLodListOffset(lod) });
+                drawIndirect(cmd, frame->backendDevice, output.drawCommandBuffer.buffer, InstanceCullDrawCommands::drawOffset(list, lod));
             }
+        }
 
-            if (consistence)
+        void drawCulledPosOnly(vk::CommandBuffer cmd, const GPUFrame* frame, CulledDrawList list, uint32_t firstLod = 0,
+                               const std::function<void(uint32_t)>& beforeLod = {}) const
+        {
+            if (firstLod >= lodCount) return;
+            UploadScheduler::getInstance().use(uploadTicket);
+            const auto& output = cullOutputs[frame->frameIdx];
+            auto loader = frame->backendDevice->getDLD();
+            mesh->bindPosOnly(cmd, loader);
+            for (uint32_t lod = firstLod; lod < lodCount; lod++)
             {
-                collectedMaskedCache.resize(collectMaskedIndices.size());
-                return collectedMaskedCache.size();
+                if (beforeLod) beforeLod(lod);
+                cmd.bindVertexBuffers2EXT(1, { output.indicesBufferOf(list) }, { getLodListOffset(lod) }, nullptr, { sizeof(uint32_t) }, loader);
+                drawIndirect(cmd, frame->backendDevice, output.drawCommandBuffer.buffer, InstanceCullDrawCommands::drawOffset(list, lod));
             }
+        }
 
-            collectedMaskedCache = collectMaskedIndices;
-            device->oneTimeUploadSync(collectedMaskedCache.data(), sizeof(uint32_t) * collectedMaskedCache.size(), instanceMaskedIdicesBuffer.buffer);
-            return collectedMaskedCache.size();
+        // Every visible instance may keep all of its meshlets
+        uint32_t getClusterDrawCapacity() const
+        {
+            return static_cast<uint32_t>(perInstanceData.size()) * mesh->meshletCount;
         }
 
-        void drawAllPosOnlyMasked(vk::CommandBuffer cmd,vk::DispatchLoaderDynamic loader) const {
-            if (collectedMaskedCache.empty()) return;
+        // Zero the cluster draw count of the frame, recorded before the cluster culling dispatch
+        void resetClusterDraws(vk::CommandBuffer cmd, uint32_t frameIdx) const
+        {
+            cmd.fillBuffer(cullOutputs[frameIdx].clusterDrawBuffer.buffer, ClusterDrawCommands::countOffset(), sizeof(uint32_t), 0);
+        }
 
-            mesh->bindPosOnly(cmd,loader);
-           
-            //bind per instance data
-            cmd.bindVertexBuffers2EXT(1, { instanceMaskedIdicesBuffer.buffer }, { 0 }, nullptr, { sizeof(uint32_t) },loader);
-            cmd.drawIndexed(mesh->indexCount, collectedMaskedCache.size(), 0, 0, 0);
+        ClusterCullPushConstants getClusterCullPushConstants(bool coneCulling) const
+        {
+            ClusterCullPushConstants constants{};
+            constants.meshletCount = mesh->meshletCount;
+            constants.drawCapacity = getClusterDrawCapacity();
+            constants.coneCulling = coneCulling ? 1 : 0;
+            return constants;
         }
 
-        void drawOne(vk::CommandBuffer cmd) const{
-            mesh->bind(cmd);
-            //todo bind per instance data
-            cmd.drawIndexed(mesh->indexCount, 1, 0, 0, 0);
+        ClusterMeshPushConstants getClusterMeshPushConstants(bool coneCulling) const
+        {
+            const auto& attribute = mesh->vertexAttribute;
+            auto inWords = [](int offset) { return offset == -1 ? -1 : offset / static_cast<int>(sizeof(uint32_t)); };
+            ClusterMeshPushConstants constants{};
+            constants.meshletCount = mesh->meshletCount;
+            constants.coneCulling = coneCulling ? 1 : 0;
+            constants.vertexStride = attribute.stride / sizeof(uint32_t);
+            constants.normalOffset = inWords(attribute.normalOffset);
+            constants.tangentOffset = inWords(attribute.tangentOffset);
+            constants.biTangentOffset = inWords(attribute.biTangentOffset);
+            constants.uvOffset = inWords(attribute.uvOffset);
+            return constants;
         }
 
-        uint32_t drawCulled( vk::CommandBuffer cmd, const std::function<bool(MeshRigidHandle meshHandle, const PerInstDataT &)> & cull) const{
-            uint32_t visibleInstanceCount = 0;
-            for(int i = 0; i < perInstanceData.size(); i ++)
-            {
-                if(cull(mesh,perInstanceData[i]))
-                {
-                    visibleInstanceCount++;
-                }
-            }
+        vk::DescriptorSet getClusterDescriptorSet(uint32_t frameIdx) const
+        {
+            return cullOutputs[frameIdx].clusterDescriptorSet;
+        }
 
-            if(visibleInstanceCount > 0)
-            {
-                mesh->bind(cmd);
-                //todo bind per instance data
-                cmd.drawIndexed(mesh->indexCount, visibleInstanceCount, 0, 0, 0);
-            }
+        // Draw the meshlets ClusterCullPass kept at level 0, the per instance index buffer is the identity so firstInstance is the instance
+        void drawClusters(vk::CommandBuffer cmd, const GPUFrame* frame) const
+        {
+            UploadScheduler::getInstance().use(uploadTicket);
+            mesh->bindClusters(cmd);
+            cmd.bindVertexBuffers(1, { instanceDataIdicesBuffer.buffer }, { 0 });
+            drawClusterCommands(cmd, frame);
+        }
 
-            return visibleInstanceCount;
+        void drawClustersPosOnly(vk::CommandBuffer cmd, const GPUFrame* frame) const
+        {
+            UploadScheduler::getInstance().use(uploadTicket);
+            auto loader = frame->backendDevice->getDLD();
+            mesh->bindClustersPosOnly(cmd, loader);
+            cmd.bindVertexBuffers2EXT(1, { instanceDataIdicesBuffer.buffer }, { 0 }, nullptr, { sizeof(uint32_t) }, loader);
+            drawClusterCommands(cmd, frame);
         }
 
-        /*
-         * Update visibility is a heavy and stateful operation.
-         * When calling update visibility, instance data buffer will be reorder
-         * to put all the invisible instances to the end of array. and update the
-         * GPU buffer
-         */
-        void updateVisibility()
+        // One task workgroup per 32 meshlets of every slot of the visible list, the slots past its count emit nothing
+        void drawClusterMeshTasks(vk::CommandBuffer cmd, const GPUFrame* frame) const
+        {
+            UploadScheduler::getInstance().use(uploadTicket);
+            cmd.drawMeshTasksEXT((mesh->meshletCount + 31) / 32, static_cast<uint32_t>(perInstanceData.size()), 1, frame->backendDevice->getDLD());
+        }
+
+        // The masks are read by the culling pass, edits reach the GPU through the staged copies of the render scene
+        DeviceExtended::BufferCopy setMask(uint32_t instDataIdx, uint32_t value)
         {
-            //todo
+            mask[instDataIdx] = value;
+            DeviceExtended::BufferCopy copy{};
+            copy.data = &mask[instDataIdx];
+            copy.dst = maskBuffer.buffer;
+            copy.size = sizeof(uint32_t);
+            copy.dstOffset = static_cast<uint32_t>(sizeof(uint32_t) * instDataIdx);
+            return copy;
         }
 
         auto getVertexInputState() const
@@ -282,7 +443,7 @@ namespace renderScene {
             perVertexPosAttributeDesc.setBinding(0);
             perVertexPosAttributeDesc.setBinding(0);
             perVertexPosAttributeDesc.setOffset(0);
-            perVertexPosAttributeDesc.setFormat(vk::Format::eR32G32B32Sfloat);
+            perVertexPosAttributeDesc.setFormat(MeshRigidDevice::positionFormat());
 
             vk::VertexInputBindingDescription perInstanceBindingDesc{};
             perInstanceBindingDesc.setInputRate(vk::VertexInputRate::eInstance);
@@ -303,6 +464,26 @@ namespace renderScene {
             return VulkanPipelineVertexInputStateInfo(vertexInputStateCreateInfo);
         }
 
+        void drawClusterCommands(vk::CommandBuffer cmd, const GPUFrame* frame) const
+        {
+            auto commands = cullOutputs[frame->frameIdx].clusterDrawBuffer.buffer;
+            cmd.drawIndexedIndirectCountKHR(commands, ClusterDrawCommands::commandsOffset(), commands, ClusterDrawCommands::countOffset(),
+                                            getClusterDrawCapacity(), sizeof(VkDrawIndexedIndirectCommand), frame->backendDevice->getDLD());
+        }
+
+        static void drawIndirect(vk::CommandBuffer cmd, DeviceExtended* device, vk::Buffer commands, vk::DeviceSize offset)
+        {
+            if (device->drawIndirectCountSupported)
+            {
+                cmd.drawIndexedIndirectCountKHR(commands, offset, commands, InstanceCullDrawCommands::countOffset(offset),
+                                                1, sizeof(VkDrawIndexedIndirectCommand), device->getDLD());
+            }
+            else {
+                // an instance count of 0 draws nothing, the count only saves the GPU from reading the command
+                cmd.drawIndexedIndirect(commands, offset, 1, sizeof(VkDrawIndexedIndirectCommand));
+            }
+        }
+
         inline InstanceUUID getUUID() const
         {
             return _uuid;
@@ -312,8 +493,6 @@ namespace renderScene {
         std::vector<uint32_t> instanceDataIdices;
         std::vector<uint32_t> mask;
 
-        std::vector<uint32_t> collectedMaskedCache;
-
         int perInstanceBindingIdx;
         MeshRigidHandle mesh;
         TextureDeviceHandle texture;
@@ -325,9 +504,47 @@ namespace renderScene {
         // Short answer : for better support on culling.
         //https://app.diagrams.net/#G1ei8XsclhGNg_qMR_J7LBKmGRjSSXyShI#%7B%22pageId%22%3A%22sedBS7P0nTr2XQddadu8%22%7D
         VMABuffer instanceDataIdicesBuffer{};
-        VMABuffer instanceMaskedIdicesBuffer{};
+        VMABuffer maskBuffer{};
+        VMABuffer visibilityBuffer{};
+
+        struct CullOutput
+        {
+            VMABuffer visibleIndicesBuffer{};
+            VMABuffer selectedIndicesBuffer{};
+            VMABuffer lateIndicesBuffer{};
+            VMABuffer drawCommandBuffer{};
+            vk::DescriptorSet descriptorSet;
+            // only for batches drawn per cluster, the buffer only without mesh shaders
+            VMABuffer clusterDrawBuffer{};
+            vk::DescriptorSet clusterDescriptorSet;
+
+            vk::Buffer indicesBufferOf(CulledDrawList list) const
+            {
+                switch (list)
+                {
+                case CulledDrawList::Selected:
+                    return selectedIndicesBuffer.buffer;
+                case CulledDrawList::Late:
+                    return lateIndicesBuffer.buffer;
+                default:
+                    return visibleIndicesBuffer.buffer;
+                }
+            }
+        };
+        std::vector<CullOutput> cullOutputs;
+        // local bounds of the mesh, tested against the frustum for every instance
+        glm::vec4 aabbMin{};
+        glm::vec4 aabbMax{};
+        // the visible instances are culled and drawn per meshlet, decided by prepare(). Only level 0 is split into meshlets.
+        bool clusterCulling = false;
+        // levels of detail of the mesh the culling passes choose from, set by prepare()
+        uint32_t lodCount = 1;
+        // Covers the instance buffers and the texture of the material
+        UploadTicket uploadTicket{};
         InstanceUUID _uuid;
         std::string materialName;
+        // the record of the material in BindlessHeap, its texture is kept in texture
+        uint32_t materialIdx = BindlessHeap::INVALID_INDEX;
     };
 
     //struct DrawDataBindless
@@ -481,9 +698,12 @@ namespace renderScene {
 
     using InstanceBatchRigidDynamicType = InstanceBatchRigidDynamic<PerInstanceData>;
     struct RenderScene {
-        std::vector<std::pair<std::string,MeshRigidHandle>> meshes{}; //use file path as uuid
+        SymbolMap<MeshRigidHandle> meshes{}; //use file path as uuid
+        SymbolMap<uint32_t> meshBatchLookup{}; //index into _dynamicRigidMeshBatch, keyed like meshes
         std::vector<InstanceBatchRigidStatic<PerInstanceData>> _staticRigidMeshBatch{};
         std::vector<InstanceBatchRigidDynamicType> _dynamicRigidMeshBatch{};
+        // bumped when the batches or their buffers and descriptor sets are created again, not by instance data edits
+        uint64_t structureVersion = 0;
         std::vector<MeshDeformable> _deformableMeshes{};
 
         std::vector<InstanceData> instances;
@@ -498,8 +718,16 @@ namespace renderScene {
         std::vector<AABB> aabbs{};
         RenderView mainView;
 
-        SceneGraph* m_sceneGraph;
-        std::vector<std::pair<SceneGraphNode*, std::pair<int, int>>> _sceneGraphNodeDynamicRigidMeshBatchBindingTable;
+        SceneGraph* m_sceneGraph = nullptr;
+        std::vector<std::pair<SceneGraphNodeHandle, std::pair<int, int>>> _sceneGraphNodeDynamicRigidMeshBatchBindingTable;
+
+        // range of the binding table that belongs to node
+        auto bindingsOf(SceneGraphNodeHandle node) const
+        {
+            return std::equal_range(_sceneGraphNodeDynamicRigidMeshBatchBindingTable.begin(), _sceneGraphNodeDynamicRigidMeshBatchBindingTable.end(),
+                                    std::make_pair(node, std::pair<int, int>{}),
+                                    [](const auto& a, const auto& b) { return a.first.value < b.first.value; });
+        }
 
         glm::uvec4 selectedDynamicRigidMeshID;
 
@@ -516,9 +744,46 @@ namespace renderScene {
          */
         vk::DescriptorSetLayout perInstanceDataSetLayout;
         vk::DescriptorPool perInstanceDataDescriptorPool;
+        // storage buffers of the culling pass, see InstanceBatchRigidDynamic::cullOutputs
+        vk::DescriptorSetLayout instanceCullSetLayout;
+        vk::DescriptorPool instanceCullDescriptorPool;
+        // summed by the culling shaders of a frame, lastCullStatistics holds the latest frame read back
+        InFlightObservedBufferMapped<InstanceCullStatistics> cullStatistics;
+        InstanceCullStatistics lastCullStatistics{};
+        // set from the editor, the HZB passes only run when it's on
+        bool occlusionCulling = true;
+        // storage buffers of the cluster culling, see InstanceBatchRigidDynamic::clusterCulling
+        vk::DescriptorSetLayout clusterSetLayout;
+        vk::DescriptorPool clusterDescriptorPool;
+        // set from the editor. Cone culling drops back facing meshlets, which GBufferPass would otherwise rasterize.
+        bool clusterCulling = true;
+        bool clusterConeCulling = false;
+        // set from the editor, the culling passes pick the level of detail of each instance when it's on
+        bool lodSelection = true;
+        // how many pixels the simplification of a level may move its surface by
+        float lodPixelError = 1.0f;
+        // set from the editor, the G-buffer passes write the colour of the level of an instance to the flat target
+        bool lodShading = false;
+
+        // lodScale of selectInstanceLod() for the main camera, 0 turns the selection off
+        float getLodScale(uint32_t viewportHeight) const
+        {
+            if (!lodSelection || lodPixelError <= 0.0f) return 0.0f;
+            return 0.5f * static_cast<float>(viewportHeight) * std::abs(mainView.camera.stagingData.proj[1][1]) / lodPixelError;
+        }
         vk::DescriptorSetLayout materialLayout;
         vk::DescriptorPool materialDescriptorPool;
 
+        // a material of the scene packed into the bindless heap, shared by every batch using it
+        struct BindlessMaterial
+        {
+            uint32_t index = BindlessHeap::INVALID_INDEX;
+            TextureDeviceHandle texture;
+        };
+        SymbolMap<BindlessMaterial> bindlessMaterials{}; //keyed by material name
+        SymbolMap<uint32_t> bindlessTextures{}; //heap index of the image maps, keyed by file name
+        BindlessMaterial getOrCreateBindlessMaterial(Material* mat, AssetManager& assetManager);
+
         std::vector<DeviceExtended::BufferCopy> uploadRequests;
 
         explicit RenderScene(const std::shared_ptr<DeviceExtended>& device);
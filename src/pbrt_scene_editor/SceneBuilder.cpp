@@ -5,6 +5,7 @@
 #include "SceneBuilder.hpp"
 #include "scene.h"
 #include "sceneGraphEditor.hpp"
+#include "SceneCache.hpp"
 #include <cassert>
 #include <glm/gtc/type_ptr.hpp>
 #include <unordered_map>
@@ -27,60 +28,111 @@ struct HashCounter
 
 static HashCounter NameCounter;
 
+SceneGraphNode* PBRTSceneBuilder::currentNode() const {
+    return _openDepth == 0 ? nullptr : sceneGraph->node(_openNodes[_openDepth - 1].handle);
+}
+
+PBRTSceneBuilder::OpenNode& PBRTSceneBuilder::currentOpenNode() {
+    assert(_openDepth > 0);
+    return _openNodes[_openDepth - 1];
+}
+
+void PBRTSceneBuilder::openNode(SceneGraphNodeHandle handle) {
+    if(_openDepth == _openNodes.size())
+        _openNodes.emplace_back();
+    auto& open = _openNodes[_openDepth++];
+    open.handle = handle;
+    open.children.clear();
+    open.shapes.clear();
+    open.materials.clear();
+    open.lights.clear();
+    open.areaLights.clear();
+}
+
+void PBRTSceneBuilder::closeNode(bool commit) {
+    auto& open = currentOpenNode();
+    _openDepth--;
+    if(!commit)
+        return;
+    auto* node = sceneGraph->node(open.handle);
+    node->childRange = appendToPool(sceneGraph->childPool, open.children);
+    node->shapeRange = appendToPool(sceneGraph->shapePool, open.shapes);
+    node->materialRange = appendToPool(sceneGraph->materialPool, open.materials);
+    node->lightRange = appendToPool(sceneGraph->lightPool, open.lights);
+    node->areaLightRange = appendToPool(sceneGraph->areaLightPool, open.areaLights);
+}
+
+void PBRTSceneBuilder::finish() {
+    while(_openDepth > 0)
+        closeNode();
+    sceneGraph->buildTransformHierarchy();
+}
+
 void PBRTSceneBuilder::AttributeBegin() {
-    auto* newAttributeNode = new SceneGraphNode;
-    newAttributeNode->graph = sceneGraph;
+    auto* parent = currentNode();
+    assert(parent != nullptr);
+    auto handle = sceneGraph->createNode();
+    auto* newAttributeNode = sceneGraph->node(handle);
     newAttributeNode->is_empty = true;
-    newAttributeNode->parent = _currentVisitNode;
-    newAttributeNode->is_instance = _currentVisitNode->is_instance;
-    newAttributeNode->_finalTransform = _currentVisitNode->_finalTransform;
-    _currentVisitNode = newAttributeNode;
+    newAttributeNode->parent = parent->handle;
+    newAttributeNode->is_instance = parent->is_instance;
+    newAttributeNode->finalTransform() = parent->finalTransform();
+    openNode(handle);
 }
 
 void PBRTSceneBuilder::AttributeEnd() {
+    assert(_openDepth > 1);
+    auto& open = currentOpenNode();
+    auto& parentOpen = _openNodes[_openDepth - 2];
+    auto* node = sceneGraph->node(open.handle);
 
-    if(_currentVisitNode->children.size() > 1)
+    if(open.children.size() > 1)
     {
         //group node, just for group multiple node together, keep.
-        _currentVisitNode->is_empty = false;
+        node->is_empty = false;
     }
 
-    if(_currentVisitNode->children.size() == 1 && _currentVisitNode->is_empty)
+    if(open.children.size() == 1 && node->is_empty)
     {
         //meaningless node. should be raked.
-        _currentVisitNode->parent->children.push_back(_currentVisitNode->children[0]);
+        auto child = open.children[0];
+        parentOpen.children.push_back(child);
+        // an object instance keeps the parent it was defined under
+        auto* childNode = sceneGraph->node(child);
+        if(childNode->parent == open.handle)
+            childNode->parent = parentOpen.handle;
     }
 
-    if(!_currentVisitNode->is_empty)
+    if(!node->is_empty)
     {
-        if(_currentVisitNode->name.empty()){
-            _currentVisitNode->name += " <node-" + std::to_string(NameCounter["node"]++) + ">";
+        if(node->name.empty()){
+            node->name += " <node-" + std::to_string(NameCounter["node"]++) + ">";
         }
-        _currentVisitNode->parent->children.push_back(_currentVisitNode);
-        _currentVisitNode = _currentVisitNode->parent;
+        parentOpen.children.push_back(open.handle);
+        closeNode();
         return;
     }
 
-    auto* tmp =  _currentVisitNode;
-    _currentVisitNode = _currentVisitNode->parent;
-    delete tmp;
+    auto handle = open.handle;
+    closeNode(false);
+    sceneGraph->destroyNode(handle);
 }
 
 void PBRTSceneBuilder::WorldBegin() {
     NameCounter = HashCounter();
-    auto* worldRootNode = new SceneGraphNode;
-    worldRootNode->graph = sceneGraph;
+    Identity();
+    assert(_openDepth == 0);
+    auto handle = sceneGraph->createNode();
+    auto* worldRootNode = sceneGraph->node(handle);
     worldRootNode->name = "world_root";
     worldRootNode->is_empty = false;
-    Identity();
-    assert(_currentVisitNode == nullptr);
-    _currentVisitNode = worldRootNode;
-    sceneGraph->root = _currentVisitNode;
+    openNode(handle);
+    sceneGraph->root = handle;
 }
 
 void PBRTSceneBuilder::WorldEnd() {
-    //do nothing
-    assert(_currentVisitNode->parent== nullptr);
+    assert(_openDepth == 1);
+    closeNode();
 }
 
 void PBRTSceneBuilder::ActiveTransformAll(){}
@@ -90,13 +142,13 @@ void PBRTSceneBuilder::ActiveTransformEndTIme(){}
 void PBRTSceneBuilder::ActiveTransformTime(){}
 
 void PBRTSceneBuilder::ConcatTransform(const float* m){
-    if(_currentVisitNode!= nullptr)
+    if(auto* node = currentNode())
     {
-        _currentVisitNode->is_empty = false;
+        node->is_empty = false;
         //todo glm stores in column-wise
         auto concatMat = glm::make_mat4x4(m);
-        _currentVisitNode->_finalTransform = concatMat * _currentVisitNode->_finalTransform;
-        _currentVisitNode->_selfTransform = concatMat * _currentVisitNode->_finalTransform;
+        node->finalTransform() = concatMat * node->finalTransform();
+        node->selfTransform() = concatMat * node->finalTransform();
     }
 }
 
@@ -113,11 +165,11 @@ void PBRTSceneBuilder::ColorSpace(){
 }
 
 void PBRTSceneBuilder::Identity(){
-    if(_currentVisitNode!= nullptr)
+    if(auto* node = currentNode())
     {
-        _currentVisitNode->is_empty = false;
-        _currentVisitNode->_finalTransform = glm::identity<glm::mat4x4>();
-        _currentVisitNode->is_transform_detached = true;
+        node->is_empty = false;
+        node->finalTransform() = glm::identity<glm::mat4x4>();
+        node->is_transform_detached = true;
     }
 }
 
@@ -128,60 +180,50 @@ void PBRTSceneBuilder::LookAt(const float* lookAt){
 }
 
 void PBRTSceneBuilder::AddNamedMaterial(Material * material){
-    for(const auto & mat : sceneGraph->namedMaterials)
+    if(!sceneGraph->addNamedMaterial(material))
     {
-        if(mat->name == material->name)
-        {
-            throw std::runtime_error("Material " + material->name + " has been defined.");
-        }
+        throw std::runtime_error("Material " + material->name + " has been defined.");
     }
-    sceneGraph->namedMaterials.push_back(material);
 }
 
 void PBRTSceneBuilder::NamedMaterial(const std::string & name) {
-    if(_currentVisitNode!= nullptr)
+    if(currentNode() != nullptr)
     {
-        for(const auto & mat : sceneGraph->namedMaterials)
+        auto* mat = sceneGraph->findNamedMaterial(name);
+        if(mat == nullptr)
         {
-            if(mat->name == name)
-            {
-                _currentVisitNode->materials.push_back(mat);
-                return;
-            }
+            throw std::runtime_error("Couldn't find material " + name);
         }
-        throw std::runtime_error("Couldn't find material " + name);
+        currentOpenNode().materials.push_back(mat);
     }
 }
 
 void PBRTSceneBuilder::ObjectBegin(const std::string & instanceName){
-    auto* newNode = new SceneGraphNode;
-    newNode->graph = sceneGraph;
+    auto* parent = currentNode();
+    auto handle = sceneGraph->createNode();
+    auto* newNode = sceneGraph->node(handle);
     newNode->is_empty = true;
     newNode->name = instanceName;
     newNode->is_instance = true;
-    newNode->parent = _currentVisitNode;
-    sceneGraph->_objInstances.push_back(newNode);
-    _currentVisitNode = newNode;
+    newNode->parent = parent != nullptr ? parent->handle : SceneGraphNodeHandle{};
+    sceneGraph->addObjectInstance(handle);
+    openNode(handle);
 }
 
 void PBRTSceneBuilder::ObjectEnd() {
-    _currentVisitNode = _currentVisitNode->parent;
+    closeNode();
 }
 
 void PBRTSceneBuilder::ObjectInstance(const std::string & instanceName){
-    if(_currentVisitNode!= nullptr)
+    if(currentNode() != nullptr)
     {
-        for(const auto obj : sceneGraph->_objInstances)
+        if(auto obj = sceneGraph->findObjectInstance(instanceName))
         {
-            if(obj->name == instanceName)
-            {
-                /*
-                 * It's a little tricky here because when use instance, the transform actually
-                 * means the transform in "instance space".
-                 * */
-                _currentVisitNode->children.push_back(obj);
-                return;
-            }
+            /*
+             * It's a little tricky here because when use instance, the transform actually
+             * means the transform in "instance space".
+             * */
+            currentOpenNode().children.push_back(obj);
         }
     }
 }
@@ -191,56 +233,56 @@ void PBRTSceneBuilder::Option(){
 }
 
 void PBRTSceneBuilder::ReverseOrientation(){
-    if(_currentVisitNode!= nullptr)
+    if(auto* node = currentNode())
     {
-        _currentVisitNode->is_empty = false;
+        node->is_empty = false;
     }
 }
 
 void PBRTSceneBuilder::Rotate(const float * v){
-    if(_currentVisitNode!= nullptr)
+    if(auto* node = currentNode())
     {
-        _currentVisitNode->is_empty = false;
+        node->is_empty = false;
         float v0 = v[0]; float v1 = v[1]; float v2 = v[2]; float v3 = v[3];
-        _currentVisitNode->_finalTransform = glm::rotate(_currentVisitNode->_finalTransform,
+        node->finalTransform() = glm::rotate(node->finalTransform(),
                                                          glm::radians(v0),
                                                          {v1,v2,v3});
-        _currentVisitNode->_selfTransform = glm::rotate(_currentVisitNode->_selfTransform,
+        node->selfTransform() = glm::rotate(node->selfTransform(),
                                                          glm::radians(v0),
                                                          {v1,v2,v3});
     }
 }
 
 void PBRTSceneBuilder::Scale(const float* s){
-    if(_currentVisitNode!= nullptr)
+    if(auto* node = currentNode())
     {
-        _currentVisitNode->is_empty = false;
+        node->is_empty = false;
         float s0 = s[0]; float s1= s[1]; float s2= s[2];
-        _currentVisitNode->_finalTransform = glm::scale(_currentVisitNode->_finalTransform,
+        node->finalTransform() = glm::scale(node->finalTransform(),
                                                         {s0,s1,s2});
-        _currentVisitNode->_selfTransform= glm::scale(_currentVisitNode->_selfTransform,
+        node->selfTransform()= glm::scale(node->selfTransform(),
                                                         {s0,s1,s2});
     }
 
 }
 
 void PBRTSceneBuilder::Transform(const float* m){
-    if(_currentVisitNode!= nullptr)
+    if(auto* node = currentNode())
     {
-        _currentVisitNode->is_empty = false;
-        _currentVisitNode->_selfTransform = glm::make_mat4x4(m);
-        _currentVisitNode->_finalTransform = _currentVisitNode->_selfTransform;
-        _currentVisitNode->is_transform_detached = true;
+        node->is_empty = false;
+        node->selfTransform() = glm::make_mat4x4(m);
+        node->finalTransform() = node->selfTransform();
+        node->is_transform_detached = true;
     }
 }
 
 void PBRTSceneBuilder::Translate(const float* t){
-    if(_currentVisitNode!= nullptr)
+    if(auto* node = currentNode())
     {
-        _currentVisitNode->is_empty = false;
+        node->is_empty = false;
         float t0 = t[0]; float t1 = t[1]; float t2 = t[2];
-        _currentVisitNode->_finalTransform = glm::translate(_currentVisitNode->_finalTransform, {t0, t1, t2});
-        _currentVisitNode->_selfTransform = glm::translate(_currentVisitNode->_selfTransform, {t0, t1, t2});
+        node->finalTransform() = glm::translate(node->finalTransform(), {t0, t1, t2});
+        node->selfTransform() = glm::translate(node->selfTransform(), {t0, t1, t2});
     }
 }
 
@@ -249,49 +291,44 @@ void PBRTSceneBuilder::TransformTimes(){
 }
 
 void PBRTSceneBuilder::AddLightSource(Light * light) {
-    if(_currentVisitNode!= nullptr)
+    if(auto* node = currentNode())
     {
-        _currentVisitNode->is_empty = false;
-        //_currentVisitNode->name += " LightSource";
-        _currentVisitNode->lights.push_back(light);
+        node->is_empty = false;
+        //node->name += " LightSource";
+        currentOpenNode().lights.push_back(light);
     }
 }
 
 void PBRTSceneBuilder::AddShape(Shape* shape) {
-    if(_currentVisitNode!= nullptr)
+    if(auto* node = currentNode())
     {
-        _currentVisitNode->is_empty = false;
-        //_currentVisitNode->name += " Shape";
-        _currentVisitNode->shapes.push_back(shape);
+        node->is_empty = false;
+        //node->name += " Shape";
+        currentOpenNode().shapes.push_back(shape);
     }
 }
 
 void PBRTSceneBuilder::AddTexture(Texture * texture) {
-    sceneGraph->namedTextures.push_back(texture);
+    sceneGraph->addNamedTexture(texture);
 }
 
 Texture* PBRTSceneBuilder::GetTexture(const std::string &name) {
-    for(auto * tex : sceneGraph->namedTextures)
-    {
-        if(tex->name == name)
-            return tex;
-    }
-    return nullptr;
+    return sceneGraph->findNamedTexture(name);
 }
 
 void PBRTSceneBuilder::AddMaterial(Material * material) {
-    if(_currentVisitNode != nullptr)
+    if(currentNode() != nullptr)
     {
-        _currentVisitNode->materials.push_back(material);
+        currentOpenNode().materials.push_back(material);
     }
 }
 
 void PBRTSceneBuilder::AddAreaLight(AreaLight * areaLight) {
-    if(_currentVisitNode!= nullptr)
+    if(auto* node = currentNode())
     {
-        _currentVisitNode->is_empty = false;
-        //_currentVisitNode->name += " AreaLight";
-        _currentVisitNode->areaLights.push_back(areaLight);
+        node->is_empty = false;
+        //node->name += " AreaLight";
+        currentOpenNode().areaLights.push_back(areaLight);
     }
 }
 
@@ -301,4 +338,10 @@ void PBRTSceneBuilder::SetFilm(Film* film) {
 
 void PBRTSceneBuilder::SetCamera(Camera* cam) {
     sceneGraph->globalRenderSetting.camera.camera = cam;
-}
\ No newline at end of file
+}
+
+void PBRTSceneBuilder::RecordParams(const void* object, const std::vector<PBRTParam>& params) {
+    if(!recordParams)
+        return;
+    SceneCache::serializeParams(params, recordedParams[object]);
+}
@@ -6,11 +6,14 @@
 #define PBRTEDITOR_SCENEBUILDER_HPP
 
 #include "Inspector.hpp"
+#include "ChunkedArena.hpp"
 #include <iostream>
 #include <vector>
+#include <unordered_map>
 
 struct SceneGraphNode;
 struct SceneGraph;
+using SceneGraphNodeHandle = ArenaHandle<SceneGraphNode>;
 
 struct Film;
 struct Camera;
@@ -21,6 +24,7 @@ struct Material;
 struct Texture;
 
 struct RenderScene;
+struct PBRTParam;
 
 struct PBRTSceneBuilder
 {
@@ -60,8 +64,41 @@ struct PBRTSceneBuilder
     void WorldBegin();
     void WorldEnd();
 
-    SceneGraphNode* _currentVisitNode = nullptr;
+    // keep the parameter list an object was created from, so that SceneCache can rebuild it
+    void RecordParams(const void* object, const std::vector<PBRTParam>& params);
+    bool recordParams = true;
+    std::unordered_map<const void*, std::vector<char>> recordedParams;
+
+    // Close the nodes left open, pbrt-v4 files end without WorldEnd, and sort the transform hierarchy
+    void finish();
+
     SceneGraph* sceneGraph;
+
+private:
+    /*
+     * Node between its Begin and End directive. Children and attachments are collected here and
+     * appended to the pools of the graph as contiguous ranges once the node is closed.
+     * Entries above the current depth are kept so their vectors are reused by the next node.
+     */
+    struct OpenNode
+    {
+        SceneGraphNodeHandle handle;
+        std::vector<SceneGraphNodeHandle> children;
+        std::vector<Shape*> shapes;
+        std::vector<Material*> materials;
+        std::vector<Light*> lights;
+        std::vector<AreaLight*> areaLights;
+    };
+
+    // nullptr outside of the world block
+    SceneGraphNode* currentNode() const;
+    OpenNode& currentOpenNode();
+    void openNode(SceneGraphNodeHandle handle);
+    // Pops the current node, its collected data is moved into the graph unless it is discarded
+    void closeNode(bool commit = true);
+
+    std::vector<OpenNode> _openNodes;
+    size_t _openDepth = 0;
 };
 
 #endif //PBRTEDITOR_SCENEBUILDER_HPP
@@ -0,0 +1,687 @@
+#include "SceneCache.hpp"
+
+#include "scene.h"
+#include "sceneGraphEditor.hpp"
+#include "SceneBuilder.hpp"
+#include "AssetManager.hpp"
+#include "MappedFile.hpp"
+#include "GlobalLogger.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+
+/*
+*  Layout, all values in host byte order:
+*
+*  header    : magic, version, file count, content hash
+*  files     : path of every scene file
+*  objects   : category, name, texture type and the serialized parameter list of every scene object
+*  nodes     : name, parent, flags, transforms, children and attached objects as indices
+*  graph     : root node, named materials, named textures, object instances, camera and film
+*
+*  Parameter values are 4 bytes aligned from the start of the file, so ints and floats are read in place.
+*/
+namespace
+{
+    constexpr char CACHE_MAGIC[8] = { 'P','B','R','T','S','C','N','\0' };
+    constexpr int32_t NO_INDEX = -1;
+
+    enum class ObjectCategory : uint8_t
+    {
+        Camera,
+        Film,
+        Shape,
+        Material,
+        Texture,
+        Light,
+        AreaLight
+    };
+
+    enum class ParamStorage : uint8_t
+    {
+        None,
+        Ints,
+        Floats,
+        Strings
+    };
+
+    enum NodeFlags : uint8_t
+    {
+        NODE_EMPTY = 1 << 0,
+        NODE_TRANSFORM_DETACHED = 1 << 1,
+        NODE_INSTANCE = 1 << 2
+    };
+
+    struct BinaryWriter
+    {
+        std::vector<char>& data;
+
+        template<class T>
+        void write(const T& value)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            writeBytes(&value, sizeof(T));
+        }
+
+        void writeBytes(const void* bytes, size_t size)
+        {
+            auto* p = static_cast<const char*>(bytes);
+            data.insert(data.end(), p, p + size);
+        }
+
+        void writeString(std::string_view str)
+        {
+            write(static_cast<uint32_t>(str.size()));
+            writeBytes(str.data(), str.size());
+        }
+
+        void writeIndices(const std::vector<int32_t>& indices)
+        {
+            write(static_cast<uint32_t>(indices.size()));
+            writeBytes(indices.data(), indices.size() * sizeof(int32_t));
+        }
+
+        void align(size_t alignment)
+        {
+            data.resize((data.size() + alignment - 1) / alignment * alignment, 0);
+        }
+    };
+
+    struct BinaryReader
+    {
+        const char* begin;
+        const char* cur;
+        const char* end;
+
+        const char* readBytes(size_t size)
+        {
+            if (size > static_cast<size_t>(end - cur))
+                throw std::runtime_error("scene cache is truncated");
+            auto* p = cur;
+            cur += size;
+            return p;
+        }
+
+        template<class T>
+        T read()
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            T value;
+            std::memcpy(&value, readBytes(sizeof(T)), sizeof(T));
+            return value;
+        }
+
+        std::string_view readString()
+        {
+            auto size = read<uint32_t>();
+            return { readBytes(size), size };
+        }
+
+        std::vector<int32_t> readIndices()
+        {
+            auto count = read<uint32_t>();
+            std::vector<int32_t> indices(count);
+            auto* bytes = readBytes(count * sizeof(int32_t));
+            if (count != 0)
+                std::memcpy(indices.data(), bytes, count * sizeof(int32_t));
+            return indices;
+        }
+
+        void align(size_t alignment)
+        {
+            size_t offset = cur - begin;
+            readBytes((offset + alignment - 1) / alignment * alignment - offset);
+        }
+    };
+
+    uint64_t mix64(uint64_t x)
+    {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ull;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebull;
+        x ^= x >> 31;
+        return x;
+    }
+
+    // four independent lanes over 32 bytes stripes, so hashing runs at memory speed rather than multiply latency
+    uint64_t hashBytes(const char* data, size_t size, uint64_t seed)
+    {
+        constexpr uint64_t prime = 0x9E3779B97F4A7C15ull;
+        uint64_t lanes[4] = { seed, seed ^ prime, seed + prime, ~seed };
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32)
+        {
+            for (int l = 0; l < 4; l++)
+            {
+                uint64_t w;
+                std::memcpy(&w, data + i + l * 8, 8);
+                lanes[l] = (lanes[l] ^ mix64(w)) * prime;
+            }
+        }
+        uint64_t h = mix64(size) ^ lanes[0];
+        for (int l = 1; l < 4; l++)
+            h = (h ^ mix64(lanes[l])) * prime;
+        for (; i < size; i++)
+            h = (h ^ static_cast<unsigned char>(data[i])) * prime;
+        return mix64(h);
+    }
+
+    using LoadedObject = std::variant<std::unique_ptr<Camera>, std::unique_ptr<Film>, std::unique_ptr<Shape>,
+                                      std::unique_ptr<Material>, std::unique_ptr<Texture>, std::unique_ptr<Light>,
+                                      std::unique_ptr<AreaLight>>;
+
+    template<class Creator>
+    auto makeObject(const std::string& type)
+    {
+        auto object = Creator::make(type);
+        if (object == nullptr)
+            throw std::runtime_error("unknown type in scene cache : " + type);
+        return object;
+    }
+
+    // rebuild the PBRTParam views of a serialized parameter list, ints and floats point into the mapped cache
+    void readParams(BinaryReader& reader, PBRTParamArena& arena, std::vector<PBRTParam>& params)
+    {
+        arena.clear();
+        params.clear();
+        std::vector<std::pair<size_t, size_t>> stringRanges;
+        auto count = reader.read<uint32_t>();
+        for (uint32_t i = 0; i < count; i++)
+        {
+            PBRTParam param;
+            param.name = reader.readString();
+            auto type = reader.read<uint8_t>();
+            if (type > static_cast<uint8_t>(PBRTParamType::Texture))
+                throw std::runtime_error("scene cache is corrupted");
+            param.type = static_cast<PBRTParamType>(type);
+            auto storage = static_cast<ParamStorage>(reader.read<uint8_t>());
+            param.count = static_cast<size_t>(reader.read<uint64_t>());
+            reader.align(4);
+            switch (storage)
+            {
+                case ParamStorage::None:
+                    break;
+                case ParamStorage::Ints:
+                    param.ints = reinterpret_cast<const int*>(reader.readBytes(param.count * sizeof(int)));
+                    break;
+                case ParamStorage::Floats:
+                    param.floats = reinterpret_cast<const float*>(reader.readBytes(param.count * sizeof(float)));
+                    break;
+                case ParamStorage::Strings:
+                    stringRanges.emplace_back(params.size(), arena.strings.size());
+                    for (size_t s = 0; s < param.count; s++)
+                        arena.strings.push_back(reader.readString());
+                    break;
+                default:
+                    throw std::runtime_error("scene cache is corrupted");
+            }
+            params.push_back(param);
+        }
+        // the string storage is stable only once every value has been read
+        for (const auto& [paramIdx, stringIdx] : stringRanges)
+            params[paramIdx].strings = arena.strings.data() + stringIdx;
+    }
+
+    const PBRTParam* findParam(const std::vector<PBRTParam>& params, std::string_view name)
+    {
+        for (const auto& param : params)
+        {
+            if (param.name == name && param.holds<std::string>())
+                return &param;
+        }
+        return nullptr;
+    }
+
+    // issue the same asset loads as the directive handlers of TokenParser
+    void requestAssets(const LoadedObject& object, const std::vector<PBRTParam>& params, AssetManager& assetLoader)
+    {
+        if (auto* shape = std::get_if<std::unique_ptr<Shape>>(&object))
+        {
+            auto type = (*shape)->getType();
+            if (compareUpper(type, "plymesh") || compareUpper(type, "loopsubdiv"))
+            {
+                if (auto* filename = findParam(params, "filename"))
+                    assetLoader.getOrLoadMeshAsync(filename->get<std::string>());
+            }
+        }
+        else if (std::holds_alternative<std::unique_ptr<Material>>(object))
+        {
+            if (auto* normalmap = findParam(params, "normalmap"))
+                assetLoader.getOrLoadImgAsync(normalmap->get<std::string>());
+        }
+        else if (auto* texture = std::get_if<std::unique_ptr<Texture>>(&object))
+        {
+            if (auto* imageMap = dynamic_cast<ImageMapTexture*>(texture->get()))
+                assetLoader.getOrLoadImgAsync(imageMap->filename);
+        }
+    }
+
+    template<class T>
+    T* objectAt(std::vector<LoadedObject>& objects, int32_t idx)
+    {
+        if (idx == NO_INDEX)
+            return nullptr;
+        if (idx < 0 || static_cast<size_t>(idx) >= objects.size())
+            throw std::runtime_error("scene cache is corrupted");
+        return std::get<std::unique_ptr<T>>(objects[idx]).get();
+    }
+
+    SceneGraphNodeHandle nodeAt(const std::vector<SceneGraphNodeHandle>& nodes, int32_t idx)
+    {
+        if (idx == NO_INDEX)
+            return {};
+        if (idx < 0 || static_cast<size_t>(idx) >= nodes.size())
+            throw std::runtime_error("scene cache is corrupted");
+        return nodes[idx];
+    }
+}
+
+std::filesystem::path SceneCache::cachePathFor(const std::filesystem::path& scenePath)
+{
+    auto path = scenePath;
+    path += ".editorcache";
+    return path;
+}
+
+uint64_t SceneCache::hashFiles(std::vector<std::filesystem::path> files)
+{
+    // included files are reported in completion order, sort them so the hash is stable
+    std::sort(files.begin(), files.end());
+    files.erase(std::unique(files.begin(), files.end()), files.end());
+    uint64_t hash = VERSION;
+    for (const auto& path : files)
+    {
+        auto pathStr = path.generic_string();
+        hash = hashBytes(pathStr.data(), pathStr.size(), hash);
+        MappedFile file(path);
+        hash = hashBytes(file.raw(), file.size(), hash);
+    }
+    return hash;
+}
+
+void SceneCache::serializeParams(const std::vector<PBRTParam>& params, std::vector<char>& out)
+{
+    BinaryWriter writer{ out };
+    writer.write(static_cast<uint32_t>(params.size()));
+    for (const auto& param : params)
+    {
+        writer.writeString(param.name);
+        writer.write(static_cast<uint8_t>(param.type));
+        auto storage = param.ints != nullptr ? ParamStorage::Ints
+                     : param.floats != nullptr ? ParamStorage::Floats
+                     : param.strings != nullptr ? ParamStorage::Strings
+                     : ParamStorage::None;
+        writer.write(static_cast<uint8_t>(storage));
+        writer.write(static_cast<uint64_t>(storage == ParamStorage::None ? 0 : param.count));
+        writer.align(4);
+        switch (storage)
+        {
+            case ParamStorage::Ints:
+                writer.writeBytes(param.ints, param.count * sizeof(int));
+                break;
+            case ParamStorage::Floats:
+                writer.writeBytes(param.floats, param.count * sizeof(float));
+                break;
+            case ParamStorage::Strings:
+                for (size_t i = 0; i < param.count; i++)
+                    writer.writeString(param.strings[i]);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+bool SceneCache::save(const std::filesystem::path& cachePath, const std::vector<std::filesystem::path>& sceneFiles,
+                      const SceneGraph& graph, const PBRTSceneBuilder& builder)
+{
+    std::unordered_map<const void*, int32_t> objectIndices;
+    std::vector<std::pair<ObjectCategory, const void*>> objects;
+    bool complete = true;
+
+    auto addObject = [&](ObjectCategory category, const void* object) -> int32_t {
+        if (object == nullptr)
+            return NO_INDEX;
+        auto [it, inserted] = objectIndices.emplace(object, static_cast<int32_t>(objects.size()));
+        if (inserted)
+        {
+            objects.emplace_back(category, object);
+            complete &= builder.recordedParams.count(object) != 0;
+        }
+        return it->second;
+    };
+
+    std::unordered_map<SceneGraphNodeHandle, int32_t, ArenaHandleHash<SceneGraphNode>> nodeIndices;
+    std::vector<const SceneGraphNode*> nodes;
+    std::vector<const SceneGraphNode*> stack;
+
+    auto addNode = [&](SceneGraphNodeHandle handle) -> int32_t {
+        const auto* node = graph.node(handle);
+        if (node == nullptr)
+            return NO_INDEX;
+        auto [it, inserted] = nodeIndices.emplace(handle, static_cast<int32_t>(nodes.size()));
+        if (inserted)
+        {
+            nodes.push_back(node);
+            stack.push_back(node);
+        }
+        return it->second;
+    };
+
+    auto collect = [&](SceneGraphNodeHandle start) {
+        addNode(start);
+        while (!stack.empty())
+        {
+            auto* node = stack.back();
+            stack.pop_back();
+            // instanced subtrees are shared, each node is stored once
+            for (auto child : node->children())
+                addNode(child);
+        }
+    };
+
+    collect(graph.root);
+    for (auto instance : graph._objInstances)
+        collect(instance);
+
+    std::vector<std::vector<int32_t>> nodeObjects(nodes.size() * 4);
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        for (auto* shape : nodes[i]->shapes())
+            nodeObjects[i * 4 + 0].push_back(addObject(ObjectCategory::Shape, shape));
+        for (auto* material : nodes[i]->materials())
+            nodeObjects[i * 4 + 1].push_back(addObject(ObjectCategory::Material, material));
+        for (auto* light : nodes[i]->lights())
+            nodeObjects[i * 4 + 2].push_back(addObject(ObjectCategory::Light, light));
+        for (auto* areaLight : nodes[i]->areaLights())
+            nodeObjects[i * 4 + 3].push_back(addObject(ObjectCategory::AreaLight, areaLight));
+    }
+    std::vector<int32_t> namedMaterials, namedTextures, objInstances;
+    for (auto* material : graph.namedMaterials)
+        namedMaterials.push_back(addObject(ObjectCategory::Material, material));
+    for (auto* texture : graph.namedTextures)
+        namedTextures.push_back(addObject(ObjectCategory::Texture, texture));
+    for (auto instance : graph._objInstances)
+        objInstances.push_back(nodeIndices.at(instance));
+    int32_t camera = addObject(ObjectCategory::Camera, graph.globalRenderSetting.camera.camera);
+    int32_t film = addObject(ObjectCategory::Film, graph.globalRenderSetting.film.get());
+
+    if (!complete)
+    {
+        GlobalLogger::getInstance().warn("scene cache not written, the scene holds objects the parser did not create");
+        return false;
+    }
+
+    std::vector<char> data;
+    BinaryWriter writer{ data };
+    try
+    {
+        writer.writeBytes(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        writer.write(VERSION);
+        writer.write(static_cast<uint32_t>(sceneFiles.size()));
+        writer.write(hashFiles(sceneFiles));
+        for (const auto& path : sceneFiles)
+            writer.writeString(path.generic_string());
+    }
+    catch (const std::exception& e)
+    {
+        GlobalLogger::getInstance().warn(std::string("scene cache not written : ") + e.what());
+        return false;
+    }
+
+    writer.write(static_cast<uint32_t>(objects.size()));
+    for (const auto& [category, object] : objects)
+    {
+        writer.write(category);
+        std::string_view name, type;
+        if (category == ObjectCategory::Material)
+            name = static_cast<const Material*>(object)->name;
+        else if (category == ObjectCategory::Texture)
+        {
+            name = static_cast<const Texture*>(object)->name;
+            type = static_cast<const Texture*>(object)->type;
+        }
+        writer.writeString(name);
+        writer.writeString(type);
+        // getType is virtual, so the class name is taken from the object itself
+        switch (category)
+        {
+            case ObjectCategory::Camera: writer.writeString(static_cast<const Camera*>(object)->getType()); break;
+            case ObjectCategory::Film: writer.writeString(static_cast<const Film*>(object)->getType()); break;
+            case ObjectCategory::Shape: writer.writeString(static_cast<const Shape*>(object)->getType()); break;
+            case ObjectCategory::Material: writer.writeString(static_cast<const Material*>(object)->getType()); break;
+            case ObjectCategory::Texture: writer.writeString(static_cast<const Texture*>(object)->getType()); break;
+            case ObjectCategory::Light: writer.writeString(static_cast<const Light*>(object)->getType()); break;
+            case ObjectCategory::AreaLight: writer.writeString(static_cast<const AreaLight*>(object)->getType()); break;
+        }
+        const auto& params = builder.recordedParams.at(object);
+        writer.write(static_cast<uint64_t>(params.size()));
+        writer.align(4);
+        writer.writeBytes(params.data(), params.size());
+    }
+
+    writer.write(static_cast<uint32_t>(nodes.size()));
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        const auto* node = nodes[i];
+        writer.writeString(node->name);
+        auto parent = nodeIndices.find(node->parent);
+        writer.write(parent == nodeIndices.end() ? NO_INDEX : parent->second);
+        uint8_t flags = (node->is_empty ? NODE_EMPTY : 0) |
+                        (node->is_transform_detached ? NODE_TRANSFORM_DETACHED : 0) |
+                        (node->is_instance ? NODE_INSTANCE : 0);
+        writer.write(flags);
+        writer.write(node->selfTransform());
+        writer.write(node->finalTransform());
+        std::vector<int32_t> children;
+        for (auto child : node->children())
+            children.push_back(nodeIndices.at(child));
+        writer.writeIndices(children);
+        for (int k = 0; k < 4; k++)
+            writer.writeIndices(nodeObjects[i * 4 + k]);
+    }
+
+    writer.write(nodeIndices.count(graph.root) ? nodeIndices.at(graph.root) : NO_INDEX);
+    writer.writeIndices(namedMaterials);
+    writer.writeIndices(namedTextures);
+    writer.writeIndices(objInstances);
+    writer.write(camera);
+    writer.write(graph.globalRenderSetting.camera.eye);
+    writer.write(graph.globalRenderSetting.camera.look);
+    writer.write(graph.globalRenderSetting.camera.up);
+    writer.write(film);
+
+    // write aside and rename, so a crash never leaves a truncated cache behind
+    auto tmpPath = cachePath;
+    tmpPath += ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!out || !out.write(data.data(), static_cast<std::streamsize>(data.size())))
+        {
+            GlobalLogger::getInstance().warn("failed to write scene cache : " + tmpPath.string());
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmpPath, cachePath, ec);
+    if (ec)
+    {
+        GlobalLogger::getInstance().warn("failed to write scene cache : " + cachePath.string());
+        std::filesystem::remove(tmpPath, ec);
+        return false;
+    }
+    GlobalLogger::getInstance().info("scene cache written : " + cachePath.string());
+    return true;
+}
+
+SceneGraph* SceneCache::load(const std::filesystem::path& cachePath, AssetManager& assetLoader)
+{
+    std::error_code ec;
+    if (!std::filesystem::is_regular_file(cachePath, ec))
+        return nullptr;
+
+    try
+    {
+        MappedFile file(cachePath);
+        BinaryReader reader{ file.raw(), file.raw(), file.raw() + file.size() };
+
+        if (std::memcmp(reader.readBytes(sizeof(CACHE_MAGIC)), CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0)
+            throw std::runtime_error("not a scene cache");
+        if (reader.read<uint32_t>() != VERSION)
+        {
+            GlobalLogger::getInstance().info("scene cache version changed, reparsing");
+            return nullptr;
+        }
+        auto fileCount = reader.read<uint32_t>();
+        auto contentHash = reader.read<uint64_t>();
+        std::vector<std::filesystem::path> sceneFiles;
+        for (uint32_t i = 0; i < fileCount; i++)
+        {
+            auto path = reader.readString();
+            auto& added = sceneFiles.emplace_back(std::string(path));
+            if (!std::filesystem::is_regular_file(added, ec))
+            {
+                GlobalLogger::getInstance().info("scene cache is stale, reparsing");
+                return nullptr;
+            }
+        }
+        if (hashFiles(sceneFiles) != contentHash)
+        {
+            GlobalLogger::getInstance().info("scene cache is stale, reparsing");
+            return nullptr;
+        }
+
+        PBRTParamArena arena;
+        std::vector<PBRTParam> params;
+        std::vector<LoadedObject> objects(reader.read<uint32_t>());
+        for (auto& object : objects)
+        {
+            auto category = static_cast<ObjectCategory>(reader.read<uint8_t>());
+            std::string name(reader.readString());
+            std::string textureType(reader.readString());
+            std::string type(reader.readString());
+            auto paramsSize = reader.read<uint64_t>();
+            reader.align(4);
+            auto* paramsBegin = reader.readBytes(paramsSize);
+            BinaryReader paramReader{ paramsBegin, paramsBegin, paramsBegin + paramsSize };
+            readParams(paramReader, arena, params);
+
+            // same order as the directive handlers: names are assigned before parse
+            switch (category)
+            {
+                case ObjectCategory::Camera:
+                    object = makeObject<CameraCreator>(type);
+                    std::get<std::unique_ptr<Camera>>(object)->parse(params);
+                    break;
+                case ObjectCategory::Film:
+                    object = makeObject<FilmCreator>(type);
+                    std::get<std::unique_ptr<Film>>(object)->parse(params);
+                    break;
+                case ObjectCategory::Shape:
+                    object = makeObject<ShapeCreator>(type);
+                    std::get<std::unique_ptr<Shape>>(object)->parse(params);
+                    break;
+                case ObjectCategory::Material: {
+                    auto material = makeObject<MaterialCreator>(type);
+                    material->name = name;
+                    material->parse(params);
+                    object = std::move(material);
+                    break;
+                }
+                case ObjectCategory::Texture: {
+                    auto texture = makeObject<TextureCreator>(type);
+                    texture->name = name;
+                    texture->type = textureType;
+                    texture->parse(params);
+                    object = std::move(texture);
+                    break;
+                }
+                case ObjectCategory::Light:
+                    object = makeObject<LightCreator>(type);
+                    std::get<std::unique_ptr<Light>>(object)->parse(params);
+                    break;
+                case ObjectCategory::AreaLight:
+                    object = makeObject<AreaLightCreator>(type);
+                    std::get<std::unique_ptr<AreaLight>>(object)->parse(params);
+                    break;
+                default:
+                    throw std::runtime_error("scene cache is corrupted");
+            }
+            requestAssets(object, params, assetLoader);
+        }
+
+        auto graph = std::make_unique<SceneGraph>();
+        std::vector<SceneGraphNodeHandle> nodes(reader.read<uint32_t>());
+        for (auto& handle : nodes)
+            handle = graph->createNode();
+        std::vector<SceneGraphNodeHandle> children;
+        std::vector<Shape*> shapes;
+        std::vector<Material*> materials;
+        std::vector<Light*> lights;
+        std::vector<AreaLight*> areaLights;
+        for (auto handle : nodes)
+        {
+            auto* node = graph->node(handle);
+            node->name = reader.readString();
+            node->parent = nodeAt(nodes, reader.read<int32_t>());
+            auto flags = reader.read<uint8_t>();
+            node->is_empty = flags & NODE_EMPTY;
+            node->is_transform_detached = flags & NODE_TRANSFORM_DETACHED;
+            node->is_instance = flags & NODE_INSTANCE;
+            node->selfTransform() = reader.read<glm::mat4>();
+            node->finalTransform() = reader.read<glm::mat4>();
+            children.clear();
+            shapes.clear();
+            materials.clear();
+            lights.clear();
+            areaLights.clear();
+            for (auto idx : reader.readIndices())
+                children.push_back(nodeAt(nodes, idx));
+            for (auto idx : reader.readIndices())
+                shapes.push_back(objectAt<Shape>(objects, idx));
+            for (auto idx : reader.readIndices())
+                materials.push_back(objectAt<Material>(objects, idx));
+            for (auto idx : reader.readIndices())
+                lights.push_back(objectAt<Light>(objects, idx));
+            for (auto idx : reader.readIndices())
+                areaLights.push_back(objectAt<AreaLight>(objects, idx));
+            node->childRange = appendToPool(graph->childPool, children);
+            node->shapeRange = appendToPool(graph->shapePool, shapes);
+            node->materialRange = appendToPool(graph->materialPool, materials);
+            node->lightRange = appendToPool(graph->lightPool, lights);
+            node->areaLightRange = appendToPool(graph->areaLightPool, areaLights);
+        }
+
+        graph->buildTransformHierarchy();
+        graph->root = nodeAt(nodes, reader.read<int32_t>());
+        for (auto idx : reader.readIndices())
+            graph->addNamedMaterial(objectAt<Material>(objects, idx));
+        for (auto idx : reader.readIndices())
+            graph->addNamedTexture(objectAt<Texture>(objects, idx));
+        for (auto idx : reader.readIndices())
+            graph->addObjectInstance(nodeAt(nodes, idx));
+        graph->globalRenderSetting.camera.camera = objectAt<Camera>(objects, reader.read<int32_t>());
+        graph->globalRenderSetting.camera.eye = reader.read<glm::vec3>();
+        graph->globalRenderSetting.camera.look = reader.read<glm::vec3>();
+        graph->globalRenderSetting.camera.up = reader.read<glm::vec3>();
+        graph->globalRenderSetting.film.reset(objectAt<Film>(objects, reader.read<int32_t>()));
+
+        // the graph owns everything from here on
+        for (auto& object : objects)
+            std::visit([](auto& p) { p.release(); }, object);
+
+        GlobalLogger::getInstance().info("loaded scene from cache : " + cachePath.string());
+        return graph.release();
+    }
+    catch (const std::exception& e)
+    {
+        GlobalLogger::getInstance().warn("failed to load scene cache " + cachePath.string() + " : " + e.what());
+        return nullptr;
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef PBRTEDITOR_SCENECACHE_HPP
+#define PBRTEDITOR_SCENECACHE_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+struct SceneGraph;
+struct PBRTSceneBuilder;
+struct PBRTParam;
+struct AssetManager;
+
+/*
+*  Binary cache of a parsed scene, written next to the scene file.
+*  The cache is keyed by a content hash of the root file and every file it includes, editing any of them
+*  invalidates it. The node hierarchy is stored as is, while the typed scene objects are stored as the
+*  parameter lists they were created from and rebuilt through the same Creator/parse path as the parser.
+*  Parameter values are not copied on load, the PBRTParam views point straight into the mapped cache.
+*/
+struct SceneCache
+{
+	// bump whenever the layout below or the parsed fields of scene.h change
+	static constexpr uint32_t VERSION = 1;
+
+	static std::filesystem::path cachePathFor(const std::filesystem::path& scenePath);
+
+	// returns nullptr when the cache is missing, stale or unreadable
+	static SceneGraph* load(const std::filesystem::path& cachePath, AssetManager& assetLoader);
+
+	static bool save(const std::filesystem::path& cachePath, const std::vector<std::filesystem::path>& sceneFiles,
+					 const SceneGraph& graph, const PBRTSceneBuilder& builder);
+
+	// append the serialized form of a parameter list to out, see PBRTSceneBuilder::RecordParams
+	static void serializeParams(const std::vector<PBRTParam>& params, std::vector<char>& out);
+
+	static uint64_t hashFiles(std::vector<std::filesystem::path> files);
+};
+
+#endif //PBRTEDITOR_SCENECACHE_HPP
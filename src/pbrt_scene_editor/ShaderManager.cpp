@@ -3,58 +3,176 @@
 //
 #include "ShaderManager.h"
 
+#include <cstring>
 #include <iostream>
 #include <filesystem>
+#include <iterator>
+#include <iomanip>
+#include <sstream>
 
-VertexShader *ShaderManager::createVertexShader(DeviceExtended *backendDev, const std::string &shaderName,
-                                                const ShaderManager::ShaderMacroList &macro_defs)
+#include "GlobalLogger.h"
+
+namespace
 {
-    auto spv_data = getOrCreateSPIRVVariant(shaderName,macro_defs);
-    auto spv_data_size_in_bytes = spv_data.size() * sizeof(decltype(spv_data)::value_type);
-    //reflection
-    // Generate reflection data for a shader
-    SpvReflectShaderModule module;
-    auto result = spvReflectCreateShaderModule(spv_data_size_in_bytes, spv_data.data(), &module);
-    assert(result == SPV_REFLECT_RESULT_SUCCESS);
-    // Enumerate and extract shader's input variables
-    uint32_t var_count = 0;
-    result = spvReflectEnumerateInputVariables(&module, &var_count, NULL);
-    assert(result == SPV_REFLECT_RESULT_SUCCESS);
-    auto** input_vars =
-            (SpvReflectInterfaceVariable**)malloc(var_count * sizeof(SpvReflectInterfaceVariable*));
-    result = spvReflectEnumerateInputVariables(&module, &var_count, input_vars);
-    assert(result == SPV_REFLECT_RESULT_SUCCESS);
-
-    std::vector<VertexShaderReflectedInputAttribute> inputs;
-
-    for(int i = 0 ; i < var_count ; i ++)
-    {
-        vk::VertexInputRate inputRate = vk::VertexInputRate::eVertex;
-        if(strncmp(input_vars[i]->name, "inVertex", strlen("inVertex")) == 0)
-        {
-            inputRate = vk::VertexInputRate::eVertex;
-        }else if(strncmp(input_vars[i]->name, "inInst", strlen("inInst")) == 0)
+    namespace fs = std::filesystem;
+
+    // bump when the compile options change, so stale SPIR-V isn't picked up
+    constexpr uint64_t SPIRV_CACHE_VERSION = 2;
+
+    fs::path shaderSourceDir()
+    {
+        fs::path searchDir = EDITOR_PROJECT_SOURCE_DIR;
+        return searchDir / "res" / "shaders";
+    }
+
+    uint64_t hashBytes(const void* data, size_t size, uint64_t seed)
+    {
+        // FNV-1a, shader sources are a few KB
+        uint64_t hash = seed ^ 14695981039346656037ull;
+        auto* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++)
         {
-            inputRate = vk::VertexInputRate::eInstance;
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
         }
+        return hash;
+    }
 
-        std::string name = input_vars[i]->name;
-        auto format = static_cast<vk::Format>(input_vars[i]->format);
-        VertexShaderReflectedInputAttribute attribute(inputRate,input_vars[i]->location,format,name);
-        inputs.push_back(attribute);
+    uint64_t hashString(const std::string& str, uint64_t seed)
+    {
+        // the length keeps ("ab","c") and ("a","bc") apart
+        uint64_t length = str.size();
+        return hashBytes(str.data(), str.size(), hashBytes(&length, sizeof(length), seed));
     }
-    // Destroy the reflection data when no longer required.
-    spvReflectDestroyShaderModule(&module);
 
-    vk::ShaderModuleCreateInfo shaderCreateInfo{};
-    shaderCreateInfo.setPCode(spv_data.data());
-    shaderCreateInfo.setCodeSize(spv_data_size_in_bytes);
-    auto shaderCreateRes = backendDev->createShaderModule(shaderCreateInfo);
+    shaderc_shader_kind shaderKindOf(const std::string& fileName)
+    {
+        auto extension = fs::path(fileName).extension().string();
+        if (extension == ".vert") return shaderc_glsl_vertex_shader;
+        if (extension == ".frag") return shaderc_glsl_fragment_shader;
+        if (extension == ".comp") return shaderc_glsl_compute_shader;
+        if (extension == ".task") return shaderc_glsl_task_shader;
+        if (extension == ".mesh") return shaderc_glsl_mesh_shader;
+        return shaderc_glsl_infer_from_source;
+    }
+
+    /*
+     * Resolve #include relative to the including file first, then to res/shaders,
+     * so both "built_in/camera.glsl" and "shadingCommon.glsl" from materials/ work.
+     */
+    struct ShaderIncluder : shaderc::CompileOptions::IncluderInterface
+    {
+        struct Included
+        {
+            std::string name;
+            std::string content;
+        };
+
+        shaderc_include_result* GetInclude(const char* requested_source, shaderc_include_type type,
+                                           const char* requesting_source, size_t include_depth) override
+        {
+            auto* included = new Included;
+            std::vector<fs::path> candidates;
+            if (type == shaderc_include_type_relative)
+            {
+                candidates.push_back(fs::path(requesting_source).parent_path() / requested_source);
+            }
+            candidates.push_back(shaderSourceDir() / requested_source);
+
+            for (const auto& candidate : candidates)
+            {
+                std::ifstream file(candidate, std::ios::binary);
+                if (!file.is_open()) continue;
+                included->name = candidate.lexically_normal().make_preferred().string();
+                included->content.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+                break;
+            }
+            // an empty name reports the content as error message
+            if (included->name.empty())
+            {
+                included->content = std::string("Cannot find include file ") + requested_source;
+            }
+
+            auto* result = new shaderc_include_result{};
+            result->source_name = included->name.data();
+            result->source_name_length = included->name.size();
+            result->content = included->content.data();
+            result->content_length = included->content.size();
+            result->user_data = included;
+            return result;
+        }
+
+        void ReleaseInclude(shaderc_include_result* data) override
+        {
+            delete static_cast<Included*>(data->user_data);
+            delete data;
+        }
+    };
+}
+
+std::shared_future<VertexShader*> ShaderManager::createVertexShaderAsync(DeviceExtended* backendDev, const std::string& shaderName,
+                                                                         const ShaderManager::ShaderMacroList& macro_defs)
+{
+    auto uuid = queryShaderVariantUUID(shaderName,macro_defs);
+    return getOrCreateVariant(vertexShaderRequests, vertexShaders, uuid, [this,backendDev,shaderName,macro_defs,uuid] {
+        auto spv_data = getOrCreateSPIRVVariant(shaderName,macro_defs);
+        auto reflection = reflect(spv_data, vk::ShaderStageFlagBits::eVertex);
+        return VertexShader{uuid, getOrCreateModule(backendDev,spv_data), reflection.inputs,
+                            std::move(reflection.descriptorBindings), std::move(reflection.pushConstantRanges)};
+    });
+}
 
-    VertexShader vertexShader{queryShaderVariantUUID(shaderName,macro_defs),shaderCreateRes,inputs};
-    cachedVertexShaders.push_back(vertexShader);
+std::shared_future<FragmentShader*> ShaderManager::createFragmentShaderAsync(DeviceExtended* backendDev, const std::string& shaderName,
+                                                                             const ShaderManager::ShaderMacroList& macro_defs)
+{
+    auto uuid = queryShaderVariantUUID(shaderName,macro_defs);
+    return getOrCreateVariant(fragmentShaderRequests, fragmentShaders, uuid, [this,backendDev,shaderName,macro_defs,uuid] {
+        auto spv_data = getOrCreateSPIRVVariant(shaderName,macro_defs);
+        auto reflection = reflect(spv_data, vk::ShaderStageFlagBits::eFragment);
+        return FragmentShader{uuid, getOrCreateModule(backendDev,spv_data),
+                              std::move(reflection.descriptorBindings), std::move(reflection.pushConstantRanges)};
+    });
+}
 
-    return &cachedVertexShaders.back();
+std::shared_future<ComputeShader*> ShaderManager::createComputeShaderAsync(DeviceExtended* backendDev, const std::string& shaderName,
+                                                                           const ShaderManager::ShaderMacroList& macro_defs)
+{
+    auto uuid = queryShaderVariantUUID(shaderName,macro_defs);
+    return getOrCreateVariant(computeShaderRequests, computeShaders, uuid, [this,backendDev,shaderName,macro_defs,uuid] {
+        auto spv_data = getOrCreateSPIRVVariant(shaderName,macro_defs);
+        auto reflection = reflect(spv_data, vk::ShaderStageFlagBits::eCompute);
+        return ComputeShader{uuid, getOrCreateModule(backendDev,spv_data),
+                             std::move(reflection.descriptorBindings), std::move(reflection.pushConstantRanges)};
+    });
+}
+
+std::shared_future<TaskShader*> ShaderManager::createTaskShaderAsync(DeviceExtended* backendDev, const std::string& shaderName,
+                                                                     const ShaderManager::ShaderMacroList& macro_defs)
+{
+    auto uuid = queryShaderVariantUUID(shaderName,macro_defs);
+    return getOrCreateVariant(taskShaderRequests, taskShaders, uuid, [this,backendDev,shaderName,macro_defs,uuid] {
+        auto spv_data = getOrCreateSPIRVVariant(shaderName,macro_defs);
+        auto reflection = reflect(spv_data, vk::ShaderStageFlagBits::eTaskEXT);
+        return TaskShader{uuid, getOrCreateModule(backendDev,spv_data),
+                          std::move(reflection.descriptorBindings), std::move(reflection.pushConstantRanges)};
+    });
+}
+
+std::shared_future<MeshShader*> ShaderManager::createMeshShaderAsync(DeviceExtended* backendDev, const std::string& shaderName,
+                                                                     const ShaderManager::ShaderMacroList& macro_defs)
+{
+    auto uuid = queryShaderVariantUUID(shaderName,macro_defs);
+    return getOrCreateVariant(meshShaderRequests, meshShaders, uuid, [this,backendDev,shaderName,macro_defs,uuid] {
+        auto spv_data = getOrCreateSPIRVVariant(shaderName,macro_defs);
+        auto reflection = reflect(spv_data, vk::ShaderStageFlagBits::eMeshEXT);
+        return MeshShader{uuid, getOrCreateModule(backendDev,spv_data),
+                          std::move(reflection.descriptorBindings), std::move(reflection.pushConstantRanges)};
+    });
+}
+
+VertexShader *ShaderManager::createVertexShader(DeviceExtended *backendDev, const std::string &shaderName,
+                                                const ShaderManager::ShaderMacroList &macro_defs)
+{
+    return createVertexShaderAsync(backendDev,shaderName,macro_defs).get();
 }
 
 VertexShader *ShaderManager::createVertexShader(DeviceExtended *backendDev, const std::string &name)
@@ -64,18 +182,7 @@ VertexShader *ShaderManager::createVertexShader(DeviceExtended *backendDev, cons
 
 FragmentShader *ShaderManager::createFragmentShader(DeviceExtended *backendDev, const std::string &shaderName,
                                                     const std::vector<ShaderMacro> &macro_defs) {
-    auto spv_data = getOrCreateSPIRVVariant(shaderName,macro_defs);
-    auto spv_data_size_in_bytes = spv_data.size() * sizeof(decltype(spv_data)::value_type);
-    //todo reflection
-    vk::ShaderModuleCreateInfo shaderCreateInfo{};
-    shaderCreateInfo.setPCode(spv_data.data());
-    shaderCreateInfo.setCodeSize(spv_data_size_in_bytes);
-    auto shaderCreateRes = backendDev->createShaderModule(shaderCreateInfo);
-
-    FragmentShader fragmentShader{queryShaderVariantUUID(shaderName,macro_defs),shaderCreateRes};
-    cachedFragmentShader.push_back(fragmentShader);
-
-    return &cachedFragmentShader.back();
+    return createFragmentShaderAsync(backendDev,shaderName,macro_defs).get();
 }
 
 FragmentShader *ShaderManager::createFragmentShader(DeviceExtended *backendDev, const std::string &name) {
@@ -85,83 +192,205 @@ FragmentShader *ShaderManager::createFragmentShader(DeviceExtended *backendDev,
 ComputeShader* ShaderManager::createComputeShader(DeviceExtended* backendDev, const std::string& shaderName,
     const std::vector<ShaderMacro>& macro_defs)
 {
-    auto spv_data = getOrCreateSPIRVVariant(shaderName, macro_defs);
-    auto spv_data_size_in_bytes = spv_data.size() * sizeof(decltype(spv_data)::value_type);
+    return createComputeShaderAsync(backendDev, shaderName, macro_defs).get();
+}
+
+ComputeShader* ShaderManager::createComputeShader(DeviceExtended* backendDev, const std::string& name)
+{
+    return createComputeShader(backendDev, name, {});
+}
+
+void ShaderManager::releaseShaders(DeviceExtended* backendDev)
+{
+    modules.forEach([backendDev](uint64_t, vk::ShaderModule module) {
+        backendDev->destroyShaderModule(module);
+    });
+    modules.clear();
+    vertexShaderRequests.clear();
+    fragmentShaderRequests.clear();
+    computeShaderRequests.clear();
+    taskShaderRequests.clear();
+    meshShaderRequests.clear();
+    vertexShaders.clear();
+    fragmentShaders.clear();
+    computeShaders.clear();
+    taskShaders.clear();
+    meshShaders.clear();
+}
+
+vk::ShaderModule ShaderManager::getOrCreateModule(DeviceExtended* backendDev, const std::vector<uint32_t>& spirv)
+{
+    auto spv_data_size_in_bytes = spirv.size() * sizeof(uint32_t);
+    auto hash = hashBytes(spirv.data(), spv_data_size_in_bytes, 0);
+    if (auto* module = modules.find(hash))
+    {
+        return *module;
+    }
+
     vk::ShaderModuleCreateInfo shaderCreateInfo{};
-    shaderCreateInfo.setPCode(spv_data.data());
+    shaderCreateInfo.setPCode(spirv.data());
     shaderCreateInfo.setCodeSize(spv_data_size_in_bytes);
-    auto shaderCreateRes = backendDev->createShaderModule(shaderCreateInfo);
+    auto module = backendDev->createShaderModule(shaderCreateInfo);
 
-    ComputeShader computeShader{ queryShaderVariantUUID(shaderName,macro_defs),shaderCreateRes };
-    cachedComputeShader.push_back(computeShader);
-
-    return &cachedComputeShader.back();
+    auto [stored, inserted] = modules.emplace(hash, module);
+    if (!inserted)
+    {
+        // another variant with the same code got there first
+        backendDev->destroyShaderModule(module);
+    }
+    return *stored;
 }
 
-ComputeShader* ShaderManager::createComputeShader(DeviceExtended* backendDev, const std::string& name)
+ShaderManager::Reflection ShaderManager::reflect(const std::vector<uint32_t>& spirv, vk::ShaderStageFlagBits stage)
 {
-    return createComputeShader(backendDev, name, {});
+    Reflection reflection;
+
+    SpvReflectShaderModule module;
+    auto result = spvReflectCreateShaderModule(spirv.size() * sizeof(uint32_t), spirv.data(), &module);
+    if (result != SPV_REFLECT_RESULT_SUCCESS)
+    {
+        throw std::runtime_error("Failed to reflect shader.");
+    }
+
+    uint32_t count = 0;
+    spvReflectEnumerateDescriptorBindings(&module, &count, nullptr);
+    std::vector<SpvReflectDescriptorBinding*> bindings(count);
+    spvReflectEnumerateDescriptorBindings(&module, &count, bindings.data());
+    for (auto* binding : bindings)
+    {
+        reflection.descriptorBindings.push_back({ binding->set, binding->binding,
+                                                  static_cast<vk::DescriptorType>(binding->descriptor_type),
+                                                  binding->count, binding->name ? binding->name : "" });
+    }
+
+    count = 0;
+    spvReflectEnumeratePushConstantBlocks(&module, &count, nullptr);
+    std::vector<SpvReflectBlockVariable*> blocks(count);
+    spvReflectEnumeratePushConstantBlocks(&module, &count, blocks.data());
+    for (auto* block : blocks)
+    {
+        vk::PushConstantRange range{};
+        range.setStageFlags(stage);
+        range.setOffset(block->offset);
+        range.setSize(block->size);
+        reflection.pushConstantRanges.push_back(range);
+    }
+
+    if (stage == vk::ShaderStageFlagBits::eVertex)
+    {
+        count = 0;
+        spvReflectEnumerateInputVariables(&module, &count, nullptr);
+        std::vector<SpvReflectInterfaceVariable*> input_vars(count);
+        spvReflectEnumerateInputVariables(&module, &count, input_vars.data());
+        for (auto* var : input_vars)
+        {
+            if (var->decoration_flags & SPV_REFLECT_DECORATION_BUILT_IN) continue;
+
+            vk::VertexInputRate inputRate = vk::VertexInputRate::eVertex;
+            if(strncmp(var->name, "inVertex", strlen("inVertex")) == 0)
+            {
+                inputRate = vk::VertexInputRate::eVertex;
+            }else if(strncmp(var->name, "inInst", strlen("inInst")) == 0)
+            {
+                inputRate = vk::VertexInputRate::eInstance;
+            }
+
+            std::string name = var->name;
+            auto format = static_cast<vk::Format>(var->format);
+            reflection.inputs.emplace_back(inputRate, var->location, format, name);
+        }
+    }
+
+    // Destroy the reflection data when no longer required.
+    spvReflectDestroyShaderModule(&module);
+    return reflection;
 }
 
 std::vector<uint32_t>
 ShaderManager::getOrCreateSPIRVVariant(const std::string &fileName, const std::vector<ShaderMacro> &macro_defs)
 {
-    //preprocess and compile to spir-v
-    std::filesystem::path searchDir = EDITOR_PROJECT_SOURCE_DIR;
-    auto shader_src_abs_dir = searchDir /"res" / "shaders";
+    auto shader_src_abs_dir = shaderSourceDir();
     auto shader_compiled_abs_dir = shader_src_abs_dir / "compiled";
-    auto shader_src_abs_path = shader_src_abs_dir /fileName;
-    auto shader_compiled_abs_path = shader_compiled_abs_dir/fileName;
-    auto shader_src_abs_dir_c_str = shader_src_abs_dir.string();
-    auto shader_compiled_abs_dir_c_str = shader_compiled_abs_dir.string();
-    auto shader_src_abs_path_c_str = shader_src_abs_path.string();
-    auto shader_compiled_abs_path_c_str = shader_compiled_abs_path.string();
-
-    auto lwt = std::filesystem::last_write_time(shader_src_abs_path);
-    auto timestamp = std::chrono::duration_cast<std::chrono::seconds>(lwt.time_since_epoch()).count();
-
-    std::string timestampSuffix = "@"+std::to_string(timestamp);
-//    std::string variantSuffix = "@DEFAULT";
-//    if(!macro_defs.empty())
-//    {
-//        variantSuffix = "@";
-//        for(const auto &def : macro_defs)
-//        {
-//            variantSuffix+=(def.first+def.second);
-//        }
-//    }
-    auto shaderVariantUUID = queryShaderVariantUUID(fileName,macro_defs);
-    // If time stamp match and variant match, we directly load the spv file.
-    auto expectedFileName = (shader_compiled_abs_dir / shaderVariantUUID).make_preferred().string() + timestampSuffix + ".spv";
-    try {
-        return loadFileBinary<uint32_t>(expectedFileName);
-    }catch (...){
-
-    }
-    // else we delete old compiled file. Compile update to date one.
-    // We don't use delete command because it is not cross-platforms
-
-    std::cout.flush();
-    std::string command = "glslangValidator -V ";
-    if(!macro_defs.empty())
-    {
-        for(const auto &def : macro_defs)
-        {
-            command += " -D" + def.first + "=" + def.second + " ";
+    auto shader_src_abs_path_c_str = (shader_src_abs_dir / fileName).make_preferred().string();
+
+    std::ifstream srcFile(shader_src_abs_path_c_str, std::ios::binary);
+    if (!srcFile.is_open())
+    {
+        throw std::runtime_error("Failed to open shader " + shader_src_abs_path_c_str);
+    }
+    std::string source((std::istreambuf_iterator<char>(srcFile)), std::istreambuf_iterator<char>());
+
+    shaderc::CompileOptions options;
+    for(const auto &def : macro_defs)
+    {
+        options.AddMacroDefinition(def.first, def.second);
+    }
+    options.SetIncluder(std::make_unique<ShaderIncluder>());
+    auto kind = shaderKindOf(fileName);
+    // The device is at least Vulkan 1.2, so is the SPIR-V: the subgroup variants need 1.3, SPV_EXT_mesh_shader 1.4.
+    // tests/CMakeLists.txt compiles the shaders with glslc for the same target.
+    options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_2);
+
+    auto preprocessed = compiler.PreprocessGlsl(source, kind, shader_src_abs_path_c_str.c_str(), options);
+    if (preprocessed.GetCompilationStatus() != shaderc_compilation_status_success)
+    {
+        GlobalLogger::getInstance().error(preprocessed.GetErrorMessage());
+        throw std::runtime_error("Failed to preprocess shader " + fileName);
+    }
+
+    // The preprocessed source already has the includes inlined and the macros expanded,
+    // the macro set is hashed as well since a definition may not show up in the output.
+    std::string preprocessedSource(preprocessed.cbegin(), preprocessed.cend());
+    uint64_t hash = hashString(preprocessedSource, SPIRV_CACHE_VERSION);
+    for(const auto &def : macro_defs)
+    {
+        hash = hashString(def.first, hash);
+        hash = hashString(def.second, hash);
+    }
+    hash = hashBytes(&kind, sizeof(kind), hash);
+
+    std::ostringstream hashStr;
+    hashStr << std::hex << std::setw(16) << std::setfill('0') << hash;
+    auto expectedFileName = (shader_compiled_abs_dir / (fileName + "@" + hashStr.str() + ".spv")).make_preferred();
+
+    std::error_code ec;
+    if (fs::is_regular_file(expectedFileName, ec))
+    {
+        try {
+            auto spirv = loadFileBinary<uint32_t>(expectedFileName.string());
+            if (!spirv.empty())
+            {
+                return spirv;
+            }
+        }catch (...){
+
         }
     }
-    command += " -o ";
-    command += expectedFileName;
-    command += " ";
-    command += shader_src_abs_path_c_str;
 
-    if(std::system(command.c_str())!=0)
+    auto compiled = compiler.CompileGlslToSpv(source, kind, shader_src_abs_path_c_str.c_str(), options);
+    if (compiled.GetCompilationStatus() != shaderc_compilation_status_success)
     {
-        std::cerr << "Failed to run command.\n";
-        throw std::runtime_error("Failed to run command.");
+        GlobalLogger::getInstance().error(compiled.GetErrorMessage());
+        throw std::runtime_error("Failed to compile shader " + fileName);
     }
+    std::vector<uint32_t> spirv(compiled.cbegin(), compiled.cend());
 
-    //load spir-v binary(Ideally we should cache loaded binary content)
-    return loadFileBinary<uint32_t>(expectedFileName);
+    // write aside and rename, another variant may be loading the same file
+    fs::create_directories(expectedFileName.parent_path(), ec);
+    auto tmpPath = expectedFileName;
+    tmpPath += ".tmp" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!out || !out.write(reinterpret_cast<const char*>(spirv.data()), static_cast<std::streamsize>(spirv.size() * sizeof(uint32_t))))
+        {
+            GlobalLogger::getInstance().warn("failed to write shader cache : " + tmpPath.string());
+            return spirv;
+        }
+    }
+    fs::rename(tmpPath, expectedFileName, ec);
+    if (ec)
+    {
+        fs::remove(tmpPath, ec);
+    }
+    return spirv;
 }
-
@@ -5,23 +5,41 @@
 #ifndef PBRTEDITOR_SHADERMANAGER_H
 #define PBRTEDITOR_SHADERMANAGER_H
 
+#include <algorithm>
+#include <future>
+#include <thread>
 #include <utility>
 #include <vector>
 #include <vulkan/vulkan.hpp>
 
 #include <fstream>
-#include <chrono>
 #include <cstdlib>
+#include <shaderc/shaderc.hpp>
 #include "Singleton.h"
 #include "VulkanExtension.h"
+#include "ConcurrentHashMap.hpp"
+#include "ThreadPool.h"
 #include "spirv_reflect.h"
 
+struct ShaderReflectedDescriptorBinding
+{
+    uint32_t set;
+    uint32_t binding;
+    vk::DescriptorType type;
+    uint32_t count;
+    std::string name;
+};
+
 struct Shader
 {
     const std::string _uuid;
     const vk::ShaderModule _module;
     const vk::ShaderStageFlagBits _stageFlagBits;
 
+    // Reflected from the SPIR-V of every stage
+    const std::vector<ShaderReflectedDescriptorBinding> reflectedDescriptorBindings;
+    const std::vector<vk::PushConstantRange> reflectedPushConstantRanges;
+
     vk::DescriptorSetLayout shaderCustomSetLayout;
     vk::DescriptorSetLayoutCreateInfo shaderCustomSetLayoutInfo;
 
@@ -30,7 +48,11 @@ struct Shader
         return info;
     }
 
-    Shader(std::string uuid, vk::ShaderModule module, vk::ShaderStageFlagBits stageFlagBits): _uuid(std::move(uuid)),_module(module), _stageFlagBits(stageFlagBits)
+    Shader(std::string uuid, vk::ShaderModule module, vk::ShaderStageFlagBits stageFlagBits,
+           std::vector<ShaderReflectedDescriptorBinding> descriptorBindings = {},
+           std::vector<vk::PushConstantRange> pushConstantRanges = {})
+           : _uuid(std::move(uuid)),_module(module), _stageFlagBits(stageFlagBits),
+             reflectedDescriptorBindings(std::move(descriptorBindings)), reflectedPushConstantRanges(std::move(pushConstantRanges))
     {
         info.setModule(_module);
         info.setStage(_stageFlagBits);
@@ -56,8 +78,10 @@ struct VertexShaderReflectedInputAttribute
 
 struct VertexShader : Shader
 {
-    VertexShader(std::string uuid,vk::ShaderModule module, const std::vector<VertexShaderReflectedInputAttribute>& reflectedInput)
-                : Shader(uuid,module,vk::ShaderStageFlagBits::eVertex), reflectedInputLayout(reflectedInput)
+    VertexShader(std::string uuid,vk::ShaderModule module, const std::vector<VertexShaderReflectedInputAttribute>& reflectedInput,
+                 std::vector<ShaderReflectedDescriptorBinding> descriptorBindings = {},
+                 std::vector<vk::PushConstantRange> pushConstantRanges = {})
+                : Shader(uuid,module,vk::ShaderStageFlagBits::eVertex,std::move(descriptorBindings),std::move(pushConstantRanges)), reflectedInputLayout(reflectedInput)
     {
 
     }
@@ -72,7 +96,10 @@ struct VertexShader : Shader
 
 struct FragmentShader : Shader
 {
-    FragmentShader(std::string uuid,vk::ShaderModule module) : Shader(uuid,module,vk::ShaderStageFlagBits::eFragment)
+    FragmentShader(std::string uuid,vk::ShaderModule module,
+                   std::vector<ShaderReflectedDescriptorBinding> descriptorBindings = {},
+                   std::vector<vk::PushConstantRange> pushConstantRanges = {})
+                   : Shader(uuid,module,vk::ShaderStageFlagBits::eFragment,std::move(descriptorBindings),std::move(pushConstantRanges))
     {
 
     }
@@ -80,7 +107,32 @@ struct FragmentShader : Shader
 
 struct ComputeShader : Shader
 {
-    ComputeShader(std::string uuid,vk::ShaderModule module) : Shader(uuid,module,vk::ShaderStageFlagBits::eCompute)
+    ComputeShader(std::string uuid,vk::ShaderModule module,
+                  std::vector<ShaderReflectedDescriptorBinding> descriptorBindings = {},
+                  std::vector<vk::PushConstantRange> pushConstantRanges = {})
+                  : Shader(uuid,module,vk::ShaderStageFlagBits::eCompute,std::move(descriptorBindings),std::move(pushConstantRanges))
+    {
+
+    }
+};
+
+struct TaskShader : Shader
+{
+    TaskShader(std::string uuid,vk::ShaderModule module,
+               std::vector<ShaderReflectedDescriptorBinding> descriptorBindings = {},
+               std::vector<vk::PushConstantRange> pushConstantRanges = {})
+               : Shader(uuid,module,vk::ShaderStageFlagBits::eTaskEXT,std::move(descriptorBindings),std::move(pushConstantRanges))
+    {
+
+    }
+};
+
+struct MeshShader : Shader
+{
+    MeshShader(std::string uuid,vk::ShaderModule module,
+               std::vector<ShaderReflectedDescriptorBinding> descriptorBindings = {},
+               std::vector<vk::PushConstantRange> pushConstantRanges = {})
+               : Shader(uuid,module,vk::ShaderStageFlagBits::eMeshEXT,std::move(descriptorBindings),std::move(pushConstantRanges))
     {
 
     }
@@ -115,6 +167,22 @@ public:
         return shaderName + variantSuffix;
     }
 
+    /*
+     * Variants are compiled in process on the worker threads, each variant is compiled and
+     * turned into a VkShaderModule once, the returned shaders live as long as the manager.
+     * The synchronous versions block until the variant is ready.
+     */
+    std::shared_future<VertexShader*> createVertexShaderAsync(DeviceExtended* backendDev, const std::string& name, const ShaderMacroList & macro_defs);
+
+    std::shared_future<FragmentShader*> createFragmentShaderAsync(DeviceExtended* backendDev, const std::string& name, const ShaderMacroList & macro_defs);
+
+    std::shared_future<ComputeShader*> createComputeShaderAsync(DeviceExtended* backendDev, const std::string& name, const ShaderMacroList & macro_defs);
+
+    // Task and mesh shaders need VK_EXT_mesh_shader
+    std::shared_future<TaskShader*> createTaskShaderAsync(DeviceExtended* backendDev, const std::string& name, const ShaderMacroList & macro_defs);
+
+    std::shared_future<MeshShader*> createMeshShaderAsync(DeviceExtended* backendDev, const std::string& name, const ShaderMacroList & macro_defs);
+
     VertexShader* createVertexShader(DeviceExtended* backendDev, const std::string& fileName, const ShaderMacroList & macro_defs);
 
     VertexShader* createVertexShader(DeviceExtended* backendDev, const std::string& name);
@@ -127,6 +195,12 @@ public:
 
     ComputeShader* createComputeShader(DeviceExtended* backendDev, const std::string& name);
 
+    /*
+     * Destroys the modules and forgets every variant, for a device about to be destroyed. No variant may be compiling
+     * and no pipeline may use the shaders any more, the next request compiles them again (from the SPIR-V cache).
+     */
+    void releaseShaders(DeviceExtended* backendDev);
+
 private:
     template<typename T>
     std::vector<T> loadFileBinary(const std::string& fileName)
@@ -145,11 +219,61 @@ private:
         file.close();
         return data;
     }
+
+    /*
+     * The compiled SPIR-V is cached under res/shaders/compiled, named after a hash of the preprocessed source
+     * (so every #include'd file counts) and of the macro set. Editing any of them leads to a new file.
+     */
     std::vector<uint32_t> getOrCreateSPIRVVariant(const std::string& fileName, const std::vector<ShaderMacro> & macro_defs);
 
-    std::vector<VertexShader> cachedVertexShaders;
-    std::vector<FragmentShader> cachedFragmentShader;
-    std::vector<ComputeShader> cachedComputeShader;
+    // Modules are shared by the variants compiling to the same SPIR-V
+    vk::ShaderModule getOrCreateModule(DeviceExtended* backendDev, const std::vector<uint32_t>& spirv);
+
+    struct Reflection
+    {
+        std::vector<ShaderReflectedDescriptorBinding> descriptorBindings;
+        std::vector<vk::PushConstantRange> pushConstantRanges;
+        std::vector<VertexShaderReflectedInputAttribute> inputs;
+    };
+
+    static Reflection reflect(const std::vector<uint32_t>& spirv, vk::ShaderStageFlagBits stage);
+
+    template<class T, class Make>
+    std::shared_future<T*> getOrCreateVariant(ConcurrentHashMap<std::string,std::shared_future<T*>>& requests,
+                                              ConcurrentHashMap<std::string,T>& shaders,
+                                              const std::string& uuid, Make&& make)
+    {
+        return *requests.findOrEmplace(uuid,[&]{
+            return workerPool.enqueue([&shaders,uuid,make](int) -> T* {
+                return shaders.emplace(uuid,make()).first;
+            }).share();
+        }).first;
+    }
+
+    shaderc::Compiler compiler;
+
+    // variant uuid -> shader. Values never move, pipelines keep pointers to them.
+    ConcurrentHashMap<std::string,std::shared_future<VertexShader*>> vertexShaderRequests;
+    ConcurrentHashMap<std::string,std::shared_future<FragmentShader*>> fragmentShaderRequests;
+    ConcurrentHashMap<std::string,std::shared_future<ComputeShader*>> computeShaderRequests;
+    ConcurrentHashMap<std::string,std::shared_future<TaskShader*>> taskShaderRequests;
+    ConcurrentHashMap<std::string,std::shared_future<MeshShader*>> meshShaderRequests;
+    ConcurrentHashMap<std::string,VertexShader> vertexShaders;
+    ConcurrentHashMap<std::string,FragmentShader> fragmentShaders;
+    ConcurrentHashMap<std::string,ComputeShader> computeShaders;
+    ConcurrentHashMap<std::string,TaskShader> taskShaders;
+    ConcurrentHashMap<std::string,MeshShader> meshShaders;
+
+    // SPIR-V hash -> module
+    ConcurrentHashMap<uint64_t,vk::ShaderModule> modules;
+
+    static size_t workerCount()
+    {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    //declared last, so that workers are joined before the maps they fill are destroyed
+    ThreadPool workerPool{ workerCount() };
 };
 
 #endif //PBRTEDITOR_SHADERMANAGER_H
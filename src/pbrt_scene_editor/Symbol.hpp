@@ -0,0 +1,182 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Singleton.h"
+
+/*
+*  Interned string, two symbols are equal exactly when their strings are.
+*  Ids are dense and start at 0, so they can index tables directly.
+*/
+struct Symbol
+{
+	static constexpr uint32_t INVALID = ~0u;
+
+	uint32_t id = INVALID;
+
+	explicit operator bool() const { return id != INVALID; }
+	bool operator==(const Symbol& other) const { return id == other.id; }
+	bool operator!=(const Symbol& other) const { return id != other.id; }
+};
+
+/*
+*  Process wide string interning shared by the parser, the scene builder, the scene graph and the asset manager.
+*  Interned strings are never freed and never move, str() stays valid for the lifetime of the program.
+*/
+class SymbolTable : public Singleton<SymbolTable>
+{
+public:
+	Symbol intern(std::string_view str)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = index.find(str);
+		if (it != index.end())
+			return { it->second };
+		auto id = static_cast<uint32_t>(strings.size());
+		const auto& stored = strings.emplace_back(str);
+		index.emplace(stored, id);
+		return { id };
+	}
+
+	// Invalid symbol when str was never interned, lookups of unknown names don't grow the table
+	Symbol find(std::string_view str) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = index.find(str);
+		return it == index.end() ? Symbol{} : Symbol{ it->second };
+	}
+
+	const std::string& str(Symbol symbol) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return strings[symbol.id];
+	}
+
+	size_t size() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return strings.size();
+	}
+
+private:
+	mutable std::mutex mutex;
+	// deque so that the views held by index stay valid while it grows
+	std::deque<std::string> strings;
+	std::unordered_map<std::string_view, uint32_t> index;
+};
+
+inline Symbol intern(std::string_view str)
+{
+	return SymbolTable::getInstance().intern(str);
+}
+
+/*
+*  Open addressing map keyed by Symbol, linear probing over a power of two table kept at most half full.
+*  Keys and values live inline in one array, a lookup is a multiply, a shift and usually a single probe.
+*  Not thread safe. Values move when the table grows, pointers from find() are valid until the next emplace().
+*/
+template<class Value>
+class SymbolMap
+{
+public:
+	Value* find(Symbol key)
+	{
+		if (!key || slots.empty())
+			return nullptr;
+		for (auto i = home(key);; i = (i + 1) & mask())
+		{
+			if (slots[i].key == key)
+				return &slots[i].value;
+			if (!slots[i].key)
+				return nullptr;
+		}
+	}
+
+	const Value* find(Symbol key) const
+	{
+		return const_cast<SymbolMap*>(this)->find(key);
+	}
+
+	// Insert value unless key is present. Returns the stored value and whether it was inserted.
+	template<class V>
+	std::pair<Value*, bool> emplace(Symbol key, V&& value)
+	{
+		if (!key)
+			throw std::runtime_error("invalid symbol used as a key");
+		if ((count + 1) * 2 > slots.size())
+			grow();
+		for (auto i = home(key);; i = (i + 1) & mask())
+		{
+			if (slots[i].key == key)
+				return { &slots[i].value, false };
+			if (!slots[i].key)
+			{
+				slots[i].key = key;
+				slots[i].value = std::forward<V>(value);
+				count++;
+				return { &slots[i].value, true };
+			}
+		}
+	}
+
+	size_t size() const
+	{
+		return count;
+	}
+
+	void clear()
+	{
+		slots.clear();
+		shift = 64;
+		count = 0;
+	}
+
+private:
+	struct Slot
+	{
+		Symbol key;
+		Value value{};
+	};
+
+	size_t mask() const
+	{
+		return slots.size() - 1;
+	}
+
+	// fibonacci hashing, ids are sequential so the multiply spreads neighbours over the table
+	size_t home(Symbol key) const
+	{
+		return static_cast<size_t>((key.id * 0x9E3779B97F4A7C15ull) >> shift);
+	}
+
+	void grow()
+	{
+		std::vector<Slot> old = std::move(slots);
+		size_t capacity = old.empty() ? 16 : old.size() * 2;
+		slots = std::vector<Slot>(capacity);
+		shift = 64;
+		for (size_t c = capacity; c > 1; c >>= 1)
+			shift--;
+		for (auto& slot : old)
+		{
+			if (!slot.key)
+				continue;
+			auto i = home(slot.key);
+			while (slots[i].key)
+				i = (i + 1) & mask();
+			slots[i] = std::move(slot);
+		}
+	}
+
+	std::vector<Slot> slots;
+	uint32_t shift = 64;
+	size_t count = 0;
+};
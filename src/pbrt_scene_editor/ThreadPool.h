@@ -6,38 +6,128 @@
 #define PBRTEDITOR_THREADPOOL_H
 #include <iostream>
 #include <vector>
-#include <queue>
+#include <deque>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <memory>
 #include <condition_variable>
 #include <functional>
 #include <future>
 
+/*
+ * Chase-Lev work stealing deque, after "Correct and Efficient Work-Stealing for Weak Memory Models" (Le et al. 2013).
+ * Only the owner pushes and takes at the bottom, any thread may steal from the top.
+ * Arrays outgrown by push are kept alive until the deque is destroyed, since a thief may still be reading them.
+ */
+template<class T>
+class WorkStealingDeque {
+public:
+    explicit WorkStealingDeque(size_t capacity = 256) {
+        buffers.emplace_back(std::make_unique<Buffer>(capacity));
+        buffer.store(buffers.back().get(), std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // owner only
+    void push(T* item) {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        Buffer* a = buffer.load(std::memory_order_relaxed);
+        if (b - t > static_cast<int64_t>(a->capacity) - 1) {
+            a = grow(a, t, b);
+        }
+        a->put(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // owner only, newest item first
+    T* take() {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        Buffer* a = buffer.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+        T* item = nullptr;
+        if (t <= b) {
+            item = a->get(b);
+            if (t == b) {
+                // last item, race against thieves
+                if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                    item = nullptr;
+                }
+                bottom.store(b + 1, std::memory_order_relaxed);
+            }
+        } else {
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // any thread, oldest item first. Returns nullptr when empty or when another thread won the race.
+    T* steal() {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t < b) {
+            Buffer* a = buffer.load(std::memory_order_acquire);
+            T* item = a->get(t);
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return nullptr;
+            }
+            return item;
+        }
+        return nullptr;
+    }
+
+private:
+    struct Buffer {
+        explicit Buffer(size_t capacity) : capacity(capacity), mask(capacity - 1), items(new std::atomic<T*>[capacity]) {}
+
+        T* get(int64_t i) const { return items[i & mask].load(std::memory_order_relaxed); }
+        void put(int64_t i, T* item) { items[i & mask].store(item, std::memory_order_relaxed); }
+
+        size_t capacity; // power of two
+        size_t mask;
+        std::unique_ptr<std::atomic<T*>[]> items;
+    };
+
+    Buffer* grow(Buffer* a, int64_t t, int64_t b) {
+        buffers.emplace_back(std::make_unique<Buffer>(a->capacity * 2));
+        Buffer* grown = buffers.back().get();
+        for (int64_t i = t; i < b; ++i) {
+            grown->put(i, a->get(i));
+        }
+        buffer.store(grown, std::memory_order_release);
+        return grown;
+    }
+
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    std::atomic<Buffer*> buffer{nullptr};
+    std::vector<std::unique_ptr<Buffer>> buffers; // owner only
+};
+
+/*
+ * Work stealing thread pool.
+ * Every worker owns a deque, a task enqueued by a worker goes to its own deque, so nested tasks stay on the
+ * thread that spawned them. Tasks from other threads go through a shared injection queue.
+ * An idle worker takes from its own deque, then the injection queue, then steals from the others.
+ */
 class ThreadPool {
 public:
     explicit ThreadPool(size_t numThreads) : running(true) {
+        if (numThreads == 0) {
+            numThreads = 1;
+        }
         for (size_t i = 0; i < numThreads; ++i) {
-            workers.emplace_back(
-                    [this, i] {
-                        for (;;) {
-                            std::function<void(int)> task;
-
-                            {
-                                std::unique_lock<std::mutex> lock(this->queue_mutex);
-                                this->condition.wait(lock,
-                                                     [this] { return !this->running || !this->tasks.empty(); });
-
-                                if (!this->running && this->tasks.empty()) {
-                                    return;
-                                }
-
-                                task = std::move(this->tasks.front());
-                                this->tasks.pop();
-                            }
-                            task(i);
-                        }
-                    }
-            );
+            deques.emplace_back(std::make_unique<WorkStealingDeque<Task>>());
+        }
+        for (size_t i = 0; i < numThreads; ++i) {
+            workers.emplace_back([this, i] { workerLoop(static_cast<int>(i)); });
         }
     }
 
@@ -50,36 +140,110 @@ public:
         );
 
         std::future<return_type> res = task->get_future();
-        {
-            std::unique_lock<std::mutex> lock(queue_mutex);
+        auto* item = new Task([task](int id) { (*task)(id); });
 
+        // count the task before publishing it, a worker may take it and decrement right after the push
+        pending.fetch_add(1, std::memory_order_release);
+        if (currentPool == this) {
+            deques[currentWorker]->push(item);
+        } else {
+            std::unique_lock<std::mutex> lock(injectionMutex);
             if (!running) {
+                pending.fetch_sub(1, std::memory_order_relaxed);
+                delete item;
                 throw std::runtime_error("enqueue on stopped ThreadPool");
             }
-
-            tasks.emplace([task](int id) { (*task)(id); });
+            injection.push_back(item);
+        }
+        {
+            // pairs with the predicate check of sleeping workers, so the notification can't be lost
+            std::lock_guard<std::mutex> lock(sleepMutex);
         }
-        condition.notify_one();
+        wakeCondition.notify_one();
         return res;
     }
 
+    size_t size() const {
+        return workers.size();
+    }
+
+    // tasks enqueued and not yet taken by a worker
+    size_t pendingCount() const {
+        return pending.load(std::memory_order_acquire);
+    }
+
     ~ThreadPool() {
         {
-            std::unique_lock<std::mutex> lock(queue_mutex);
+            std::lock_guard<std::mutex> lock(injectionMutex);
             running = false;
         }
-        condition.notify_all();
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wakeCondition.notify_all();
         for (std::thread &worker : workers) {
             worker.join();
         }
     }
 
 private:
-    std::vector<std::thread> workers;
-    std::queue<std::function<void(int)>> tasks;
-    std::mutex queue_mutex;
-    std::condition_variable condition;
+    using Task = std::function<void(int)>;
+
+    Task* findTask(int id) {
+        if (Task* task = deques[id]->take()) {
+            return task;
+        }
+        {
+            std::lock_guard<std::mutex> lock(injectionMutex);
+            if (!injection.empty()) {
+                Task* task = injection.front();
+                injection.pop_front();
+                return task;
+            }
+        }
+        size_t count = deques.size();
+        for (size_t k = 1; k < count; ++k) {
+            if (Task* task = deques[(id + k) % count]->steal()) {
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    void workerLoop(int id) {
+        currentPool = this;
+        currentWorker = id;
+        for (;;) {
+            if (Task* task = findTask(id)) {
+                pending.fetch_sub(1, std::memory_order_acq_rel);
+                std::unique_ptr<Task> owned(task);
+                (*owned)(id);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            // a pending task that isn't found yet is being pushed or was just taken by another worker, retry
+            wakeCondition.wait(lock, [this] { return stopping || pending.load(std::memory_order_acquire) > 0; });
+            if (stopping && pending.load(std::memory_order_acquire) == 0) {
+                return;
+            }
+        }
+    }
+
+    inline static thread_local ThreadPool* currentPool = nullptr;
+    inline static thread_local int currentWorker = -1;
+
+    std::vector<std::unique_ptr<WorkStealingDeque<Task>>> deques;
+    std::deque<Task*> injection;
+    std::mutex injectionMutex;
     bool running;
+
+    std::atomic<size_t> pending{0};
+    std::mutex sleepMutex;
+    std::condition_variable wakeCondition;
+    bool stopping = false;
+
+    std::vector<std::thread> workers;
 };
 
 #endif //PBRTEDITOR_THREADPOOL_H
@@ -40,182 +40,208 @@ std::string dequote(const std::string& input) {
     }
 }
 
-PBRTType StringTo(const std::string& type_str,const char* str,char** end)
+std::string_view dequoteView(std::string_view input)
 {
-    if(type_str == "integer")
-    {
-        return (int)std::strtol(str,end,10);
-    }else if(type_str == "float")
-    {
-        return std::strtof(str,end);
-    }else if(type_str == "point2")
-    {
-        return point2{};
-    }else if(type_str == "vector2")
-    {
-        return vector2{};
-    }else if(type_str == "point3")
-    {
-        return point3{};
-    }else if(type_str == "vector3")
-    {
-        return vector3{};
-    }else if(type_str == "normal3")
-    {
-        return normal3{};
-    }else if(type_str == "spectrum")
-    {
-        return spectrum{};
-    }else if(type_str == "rgb")
-    {
-        return rgb{};
-    }else if(type_str == "blackbody")
-    {
-        return blackbody{};
-    }else if(type_str == "bool")
-    {
-        if(strncmp(str,"true",4) == 0){
-            return true;
-        }else if(strncmp(str,"false",5) == 0){
-                return false;
-        }
-    }else if(type_str == "texture" || type_str == "normal")
-    {
-        return "no implemented yet";
-    }else{
-        throw std::runtime_error("Nonsupported type");
+    if (input.length() >= 2 && (input.front() == '\'' || input.front() == '"') &&
+        (input.back() == '\'' || input.back() == '"')) {
+        return input.substr(1, input.length() - 2);
     }
+    return input;
 }
 
-PBRTType stringToSingle(const std::string& type_str,const char* str,char** end)
+static bool toParamType(std::string_view type_str, PBRTParamType* type)
 {
-    if(type_str == "integer")
-    {
-        return (int)std::strtol(str,end,10);
-    }else if(type_str == "float")
-    {
-        return std::strtof(str,end);
-    }else if(type_str == "point2")
-    {
-        return point2{};
-    }else if(type_str == "vector2")
-    {
-        return vector2{};
-    }else if(type_str == "point3")
-    {
-        return point3{};
-    }else if(type_str == "vector3")
-    {
-        return vector3{};
-    }else if(type_str == "normal3")
-    {
-        return normal3{};
-    }else if(type_str == "spectrum")
-    {
-        return spectrum{};
-    }else if(type_str == "rgb")
-    {
-        rgb res{};
-        char * start = const_cast<char *>(str);
-        res.r = std::strtof(start,end);
-        start = *end + 1; // skip comma
-        res.g = std::strtof(start,end);
-        start = *end + 1;
-        res.b = std::strtof(start,end);
-        return res;
-    }else if(type_str == "blackbody")
-    {
-        return blackbody{};
-    }else if(type_str == "bool")
+    static const std::unordered_map<std::string_view, PBRTParamType> types = {
+            {"integer", PBRTParamType::Integer},
+            {"float", PBRTParamType::Float},
+            {"point2", PBRTParamType::Point2},
+            {"vector2", PBRTParamType::Vector2},
+            {"point3", PBRTParamType::Point3},
+            {"vector3", PBRTParamType::Vector3},
+            {"normal3", PBRTParamType::Normal3},
+            {"spectrum", PBRTParamType::Spectrum},
+            {"rgb", PBRTParamType::Rgb},
+            {"blackbody", PBRTParamType::Blackbody},
+            {"bool", PBRTParamType::Bool},
+            {"string", PBRTParamType::String},
+            {"texture", PBRTParamType::Texture},
+            //aliases accepted by pbrt-v4
+            {"point", PBRTParamType::Point3},
+            {"vector", PBRTParamType::Vector3},
+            {"normal", PBRTParamType::Normal3},
+            {"color", PBRTParamType::Rgb},
+    };
+    auto it = types.find(type_str);
+    if (it == types.end())
+        return false;
+    *type = it->second;
+    return true;
+}
+
+static void paramSyntaxError(const std::string& msg)
+{
+    GlobalLogger::getInstance().error(msg);
+    throw std::runtime_error(msg);
+}
+
+// Split a declaration like "float fov" into its type and name.
+static void parseParamDeclaration(const Token& tok, PBRTParamType* type, std::string_view* name)
+{
+    std::string_view decl{tok.str + tok.pos, tok.len};
+    if (decl.length() < 2 || decl.front() != '\"' || decl.back() != '\"')
+        paramSyntaxError("Expected quoted parameter declaration but get " + tok.to_string());
+    decl = decl.substr(1, decl.length() - 2);
+
+    auto is_space = [](char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; };
+    size_t type_begin = 0;
+    while (type_begin < decl.size() && is_space(decl[type_begin])) type_begin++;
+    size_t type_end = type_begin;
+    while (type_end < decl.size() && !is_space(decl[type_end])) type_end++;
+    size_t name_begin = type_end;
+    while (name_begin < decl.size() && is_space(decl[name_begin])) name_begin++;
+    size_t name_end = name_begin;
+    while (name_end < decl.size() && !is_space(decl[name_end])) name_end++;
+
+    if (name_begin == name_end)
+        paramSyntaxError("Parameter declaration without name " + tok.to_string());
+    if (!toParamType(decl.substr(type_begin, type_end - type_begin), type))
+        paramSyntaxError("Nonsupported type " + std::string(decl.substr(type_begin, type_end - type_begin)));
+    *name = decl.substr(name_begin, name_end - name_begin);
+}
+
+enum class ParamStorage
+{
+    Ints,
+    Floats,
+    Strings
+};
+
+static void appendParamValue(PBRTParamArena& arena, PBRTParamType type, ParamStorage storage, const Token& tok)
+{
+    const char* first = tok.str + tok.pos;
+    const char* last = first + tok.len;
+    switch (storage)
     {
-        if(strncmp(str,"true",4) == 0){
-            return true;
-        }else if(strncmp(str,"false",5) == 0){
-            return false;
+        case ParamStorage::Ints:
+        {
+            int value = 0;
+            if (type == PBRTParamType::Bool) {
+                auto str = dequoteView({first, tok.len});
+                if (str == "true") value = 1;
+                else if (str != "false") paramSyntaxError("Expected bool value but get " + tok.to_string());
+            } else if (!parseInt(first, last, &value)) {
+                paramSyntaxError("Expected integer value but get " + tok.to_string());
+            }
+            arena.ints.push_back(value);
+            break;
         }
-    }else if(type_str == "texture")
-    {
-        assert(str[0] == '\"');
-        int i = 0;
-        for( ;str[1 + i] != '\"';i++)
+        case ParamStorage::Floats:
         {
-
+            float value = 0;
+            if (!parseFloat(first, last, &value))
+                paramSyntaxError("Expected float value but get " + tok.to_string());
+            arena.floats.push_back(value);
+            break;
+        }
+        case ParamStorage::Strings:
+        {
+            if (tok.len < 2 || *first != '\"')
+                paramSyntaxError("Expected string value but get " + tok.to_string());
+            arena.strings.push_back(dequoteView({first, tok.len}));
+            break;
         }
-        return texture{std::string(str + 1,i)};
-    }
-    else if(type_str == "normal")
-    {
-        return "no implemented yet";
-    }else{
-        throw std::runtime_error("Nonsupported type");
     }
-    return PBRTType();
 }
 
-/*std::vector<PBRTType> StringToList(const std::string type_str, const char* str,char** end)
+static ParamStorage storageOf(PBRTParamType type, const Token& firstValue)
 {
+    switch (type)
+    {
+        case PBRTParamType::Integer:
+        case PBRTParamType::Bool:
+            return ParamStorage::Ints;
+        case PBRTParamType::String:
+        case PBRTParamType::Texture:
+            return ParamStorage::Strings;
+        case PBRTParamType::Spectrum:
+            //either a named spectrum/file or (wavelength, value) pairs
+            return firstValue.len > 0 && firstValue.str[firstValue.pos] == '\"' ? ParamStorage::Strings : ParamStorage::Floats;
+        default:
+            return ParamStorage::Floats;
+    }
+}
 
-}*/
+PBRTParamArena TokenParser::paramArena;
+std::vector<PBRTParam> TokenParser::paramList;
 
-void extractParam(const std::pair<std::string,std::string> & str_pair,std::vector<PBRTParam> & res)
+const std::vector<PBRTParam>& TokenParser::extractParaLists(LockFreeCircleQueue<Token>& tokenQueue)
 {
-    std::string name_str;
-    std::string type_str;
-
-    auto it = str_pair.first.begin() + 1; //skip quote
+    static std::vector<std::pair<ParamStorage, size_t>> paramOffsets;
+    paramArena.clear();
+    paramList.clear();
+    paramOffsets.clear();
 
-    for(;it<str_pair.first.end();it++)
+    while (true)
     {
-        if(*it == ' ')
+        Token decl = tokenQueue.waitAndFront();
+        if (decl.str == nullptr || isDirective(decl))
             break;
-        type_str.push_back(*it);
-    }
+        tokenQueue.waitAndDequeue();
 
-    it++; // skip white space
-    assert(type_str == "integer" || type_str == "float" || type_str == "point2" || type_str == "vector2"
-            || type_str == "point3" || type_str == "vector3" || type_str == "normal3"
-            ||type_str == "spectrum" || type_str == "rgb" || type_str == "blackbody"
-            || type_str == "bool" || type_str == "string" || type_str == "texture" || type_str == "normal");
+        PBRTParam param{};
+        parseParamDeclaration(decl, &param.type, &param.name);
 
-    for(;it<str_pair.first.end();it++)
-    {
-        if(*it == '\"')
-            break;
-        name_str.push_back(*it);
-    }
+        Token tok = tokenQueue.waitAndDequeue();
+        if (tok.str == nullptr || isDirective(tok))
+            paramSyntaxError("Can't find parameter data");
 
-    auto str_ptr = str_pair.second.c_str();
-    if(str_ptr[0] != '['){
-        if(type_str == "string")
-            res.emplace_back(name_str, dequote(str_pair.second));
-        else{
-            char* end_ptr;
-            res.emplace_back(name_str,stringToSingle(type_str, &str_ptr[0],&end_ptr));
+        bool is_array = tok.len == 1 && tok.str[tok.pos] == '[';
+        if (is_array) {
+            tok = tokenQueue.waitAndDequeue();
         }
-    }else{
-        if(type_str == "string") {
-            int i = 0;
-            for (; i < str_pair.second.length(); i++) {
-                if (str_ptr[2 + i] == '\"')
-                    break;
+
+        auto storage = storageOf(param.type, tok);
+        size_t offset = storage == ParamStorage::Ints ? paramArena.ints.size() :
+                        storage == ParamStorage::Floats ? paramArena.floats.size() : paramArena.strings.size();
+
+        if (is_array) {
+            //Directives never appear inside brackets, so only the closing bracket needs to be checked here.
+            //Anything else that isn't a value of the declared type is reported by appendParamValue.
+            while (!(tok.len == 1 && tok.str != nullptr && tok.str[tok.pos] == ']'))
+            {
+                if (tok.str == nullptr)
+                    paramSyntaxError("InComplete Parameter vector");
+                appendParamValue(paramArena, param.type, storage, tok);
+                param.count++;
+                tok = tokenQueue.waitAndDequeue();
             }
-            res.emplace_back(name_str, std::string(str_ptr + 2, i));
-        }
-        else{
-            char* end_ptr;
-            res.emplace_back(name_str,stringToSingle(type_str, &str_ptr[1],&end_ptr));
+        } else {
+            appendParamValue(paramArena, param.type, storage, tok);
+            param.count = 1;
         }
+
+        if (storage == ParamStorage::Floats && param.count % PBRTParam::componentCount(param.type) != 0)
+            paramSyntaxError("Number of values of " + std::string(param.name) + " isn't a multiple of its type's component count");
+        if (storage == ParamStorage::Floats && param.type == PBRTParamType::Spectrum && param.count % 2 != 0)
+            paramSyntaxError("Spectrum " + std::string(param.name) + " has a wavelength without a value");
+
+        paramList.push_back(param);
+        paramOffsets.emplace_back(storage, offset);
     }
-}
 
-std::vector<PBRTParam> convertToPBRTParamLists(const std::vector<std::pair<std::string, std::string>>& para_list)
-{
-    std::vector<PBRTParam> res;
-    for(auto & para : para_list){
-        //GlobalLogger::getInstance().info(para.first + para.second);
-        extractParam(para,res);
+    //arena arrays don't grow any more, resolve the values of each parameter
+    for (size_t i = 0; i < paramList.size(); i++)
+    {
+        auto [storage, offset] = paramOffsets[i];
+        switch (storage)
+        {
+            case ParamStorage::Ints: paramList[i].ints = paramArena.ints.data() + offset; break;
+            case ParamStorage::Floats: paramList[i].floats = paramArena.floats.data() + offset; break;
+            case ParamStorage::Strings: paramList[i].strings = paramArena.strings.data() + offset; break;
+        }
     }
-    return res;
+
+    return paramList;
 }
 
 DIRECTIVE_HANDLER_DEF(AttributeBegin)
@@ -232,8 +258,7 @@ DIRECTIVE_HANDLER_DEF_END
 DIRECTIVE_HANDLER_DEF(Attribute)
     //todo basicParamListEntrypoint(&ParserTarget::Attribute, tok->loc);
     assert(false);
-    auto para_list = TokenParser::extractParaLists(tokenQueue);
-    convertToPBRTParamLists(para_list);
+    TokenParser::extractParaLists(tokenQueue);
 DIRECTIVE_HANDLER_DEF_END
 
 /*  indicates whether subsequent directives that modify the CTM
@@ -264,9 +289,9 @@ DIRECTIVE_HANDLER_DEF(AreaLightSource)
     //todo basicParamListEntrypoint(&ParserTarget::AreaLightSource, tok->loc);
     auto next = tokenQueue.waitAndDequeue();
     auto areaLight = AreaLightCreator::make(next.to_string());
-    auto para_list = TokenParser::extractParaLists(tokenQueue);
-    auto para_list2 = convertToPBRTParamLists(para_list);
-    areaLight->parse(para_list2);
+    const auto& para_list = TokenParser::extractParaLists(tokenQueue);
+    areaLight->parse(para_list);
+    builder.RecordParams(areaLight.get(), para_list);
     builder.AddAreaLight(areaLight.release());
 DIRECTIVE_HANDLER_DEF_END
 
@@ -274,8 +299,7 @@ DIRECTIVE_HANDLER_DEF(Accelerator)
     //todo basicParamListEntrypoint(&ParserTarget::Accelerator, tok->loc);
     auto next = tokenQueue.waitAndDequeue();
     auto accelerator = AggregateCreator::make(next.to_string());
-    auto para_list = TokenParser::extractParaLists(tokenQueue);
-    convertToPBRTParamLists(para_list);
+    TokenParser::extractParaLists(tokenQueue);
 DIRECTIVE_HANDLER_DEF_END
 
 DIRECTIVE_HANDLER_DEF(ConcatTransform)
@@ -315,28 +339,27 @@ DIRECTIVE_HANDLER_DEF_END
 DIRECTIVE_HANDLER_DEF(Camera)
     //todo basicParamListEntrypoint(&ParserTarget::Camera, tok->loc);
     auto next = tokenQueue.waitAndDequeue();
-    auto para_str_list = TokenParser::extractParaLists(tokenQueue);
-    auto para_list = convertToPBRTParamLists(para_str_list);
+    const auto& para_list = TokenParser::extractParaLists(tokenQueue);
     auto cam =  CameraCreator::make(dequote(next.to_string()));
     cam->parse(para_list);
+    builder.RecordParams(cam.get(), para_list);
     builder.SetCamera(cam.release());
 DIRECTIVE_HANDLER_DEF_END
 
 DIRECTIVE_HANDLER_DEF(Film)
     //todo basicParamListEntrypoint(&ParserTarget::Film, tok->loc);
     auto next = tokenQueue.waitAndDequeue();
-    auto para_str_list = TokenParser::extractParaLists(tokenQueue);
-    auto para_list = convertToPBRTParamLists(para_str_list);
+    const auto& para_list = TokenParser::extractParaLists(tokenQueue);
     auto film = FilmCreator::make(dequote(next.to_string()));
     film->parse(para_list);
+    builder.RecordParams(film.get(), para_list);
     builder.SetFilm(film.release());
 DIRECTIVE_HANDLER_DEF_END
 
 DIRECTIVE_HANDLER_DEF(Integrator)
     //todo basicParamListEntrypoint(&ParserTarget::Integrator, tok->loc);
     auto next = tokenQueue.waitAndDequeue();
-    auto para_list = TokenParser::extractParaLists(tokenQueue);
-    convertToPBRTParamLists(para_list);
+    TokenParser::extractParaLists(tokenQueue);
 DIRECTIVE_HANDLER_DEF_END
 
 DIRECTIVE_HANDLER_DEF(Include)
@@ -344,7 +367,8 @@ DIRECTIVE_HANDLER_DEF(Include)
 DIRECTIVE_HANDLER_DEF_END
 
 DIRECTIVE_HANDLER_DEF(Import)
-    GlobalLogger::getInstance().error("Import isn't implemented yet");
+    //do nothing. Import is tokenized in parallel and stitched in place like Include,
+    //wrapped in AttributeBegin/AttributeEnd so the imported file keeps its graphics state to itself
 DIRECTIVE_HANDLER_DEF_END
 
 DIRECTIVE_HANDLER_DEF(Identity)
@@ -353,10 +377,10 @@ DIRECTIVE_HANDLER_DEF_END
 
 DIRECTIVE_HANDLER_DEF(LightSource)
     auto next = tokenQueue.waitAndDequeue();
-    auto para_list = TokenParser::extractParaLists(tokenQueue);
-    auto para_list2 = convertToPBRTParamLists(para_list);
+    const auto& para_list = TokenParser::extractParaLists(tokenQueue);
     auto light =  LightCreator::make(dequote(next.to_string()));
-    light->parse(para_list2);
+    light->parse(para_list);
+    builder.RecordParams(light.get(), para_list);
     builder.AddLightSource(light.release());
 DIRECTIVE_HANDLER_DEF_END
 
@@ -373,21 +397,21 @@ DIRECTIVE_HANDLER_DEF(MakeNamedMaterial)
     //todo basicParamListEntrypoint(&ParserTarget::MakeNamedMaterial, tok->loc);
     auto name_tok = tokenQueue.waitAndDequeue();
     auto name = dequote(name_tok.to_string());
-    auto para_list = TokenParser::extractParaLists(tokenQueue);
-    auto materialParamList = convertToPBRTParamLists(para_list);
+    const auto& materialParamList = TokenParser::extractParaLists(tokenQueue);
     for(int i = 0; i < materialParamList.size(); i ++)
     {
-        if(materialParamList[i].first == "type")
+        if(materialParamList[i].name == "type" && materialParamList[i].holds<std::string>())
         {
-            auto type_str = std::get<std::string>(materialParamList[i].second);
+            auto type_str = materialParamList[i].get<std::string>();
             auto material = MaterialCreator::make(type_str);
             material->name = name;
             material->parse(materialParamList);
+            builder.RecordParams(material.get(), materialParamList);
             for(const auto & param : materialParamList)
             {
-                if(param.first == "normalmap" && std::holds_alternative<std::string>(param.second))
+                if(param.name == "normalmap" && param.holds<std::string>())
                 {
-                    auto normalMapFileName = std::get<std::string>(param.second);
+                    auto normalMapFileName = param.get<std::string>();
                     assetLoader.getOrLoadImgAsync(normalMapFileName);
                 }
             }
@@ -409,14 +433,13 @@ DIRECTIVE_HANDLER_DEF_END
 DIRECTIVE_HANDLER_DEF(Material)
     auto class_tok = tokenQueue.waitAndDequeue();
     auto class_str = dequote(class_tok.to_string());
-    auto para_list = TokenParser::extractParaLists(tokenQueue);
-    auto materialParamList = convertToPBRTParamLists(para_list);
+    const auto& materialParamList = TokenParser::extractParaLists(tokenQueue);
     auto material = MaterialCreator::make(class_str);
     for(const auto & param : materialParamList)
     {
-        if(param.first == "normalmap" && std::holds_alternative<std::string>(param.second))
+        if(param.name == "normalmap" && param.holds<std::string>())
         {
-            auto fileName = std::get<std::string>(param.second);
+            auto fileName = param.get<std::string>();
             assetLoader.getOrLoadImgAsync(fileName);
         }
     }
@@ -427,6 +450,7 @@ DIRECTIVE_HANDLER_DEF(Material)
     }
     std::cout << "\n";*/
     material->parse(materialParamList);
+    builder.RecordParams(material.get(), materialParamList);
     builder.AddMaterial(material.release());
 DIRECTIVE_HANDLER_DEF_END
 
@@ -464,8 +488,7 @@ DIRECTIVE_HANDLER_DEF_END
 DIRECTIVE_HANDLER_DEF(PixelFilter)
     //todo basicParamListEntrypoint(&ParserTarget::PixelFilter, tok->loc);
     auto next = tokenQueue.waitAndDequeue();
-    auto para_list = TokenParser::extractParaLists(tokenQueue);
-    convertToPBRTParamLists(para_list);
+    TokenParser::extractParaLists(tokenQueue);
 DIRECTIVE_HANDLER_DEF_END
 
 DIRECTIVE_HANDLER_DEF(ReverseOrientation)
@@ -485,15 +508,14 @@ DIRECTIVE_HANDLER_DEF_END
 DIRECTIVE_HANDLER_DEF(Shape)
     auto class_tok = tokenQueue.waitAndDequeue();
     auto class_str = dequote(class_tok.to_string());
-    auto para_list = TokenParser::extractParaLists(tokenQueue);
-    auto shapeParamList = convertToPBRTParamLists(para_list);
+    const auto& shapeParamList = TokenParser::extractParaLists(tokenQueue);
     if(class_str == "plymesh" || class_str == "loopsubdiv")
     {
         for (const auto& para : shapeParamList)
         {
-            if (para.first == "filename") {
-                assert(!std::get<std::string>(para.second).empty());
-                assetLoader.getOrLoadMeshAsync(std::get<std::string>(para.second));
+            if (para.name == "filename" && para.holds<std::string>()) {
+                assert(!para.get<std::string>().empty());
+                assetLoader.getOrLoadMeshAsync(para.get<std::string>());
                 break;
             }
         }
@@ -501,14 +523,14 @@ DIRECTIVE_HANDLER_DEF(Shape)
 
     auto shape = ShapeCreator::make(class_str);
     shape->parse(shapeParamList);
+    builder.RecordParams(shape.get(), shapeParamList);
     builder.AddShape(shape.release());
 DIRECTIVE_HANDLER_DEF_END
 
 DIRECTIVE_HANDLER_DEF(Sampler)
     //todo basicParamListEntrypoint(&ParserTarget::Sampler, tok->loc);
     auto next = tokenQueue.waitAndDequeue();
-    auto para_list = TokenParser::extractParaLists(tokenQueue);
-    convertToPBRTParamLists(para_list);
+    TokenParser::extractParaLists(tokenQueue);
 DIRECTIVE_HANDLER_DEF_END
 
 DIRECTIVE_HANDLER_DEF(Scale)
@@ -571,8 +593,7 @@ DIRECTIVE_HANDLER_DEF(Texture)
     auto nameTok = tokenQueue.waitAndDequeue();
     auto typeTok = tokenQueue.waitAndDequeue();
     auto classTok = tokenQueue.waitAndDequeue();
-    auto para_list = TokenParser::extractParaLists(tokenQueue);
-    auto textureParamList = convertToPBRTParamLists(para_list);
+    const auto& textureParamList = TokenParser::extractParaLists(tokenQueue);
     auto class_str = dequote(classTok.to_string());
     assert(class_str == "imagemap" || class_str == "scale");
     auto texture = TextureCreator::make(class_str);
@@ -580,6 +601,7 @@ DIRECTIVE_HANDLER_DEF(Texture)
     texture->type = dequote(typeTok.to_string());
     assert(texture->type == "spectrum" || texture->type == "float");
     texture->parse(textureParamList);
+    builder.RecordParams(texture.get(), textureParamList);
     if(class_str == "imagemap"){
         auto * tex = dynamic_cast<ImageMapTexture*>(texture.get());
         assert(tex!= nullptr);
@@ -4,29 +4,62 @@
 #pragma once
 
 #include "LockFreeCircleQueue.hpp"
+#include "PBRTParser.h"
 #include "unordered_map"
 #include "string_view"
 #include <cstdlib>
+#include <cstring>
+#include <charconv>
+#include <vector>
 
 struct PBRTSceneBuilder;
 struct AssetManager;
-struct Token;
+struct PBRTParam;
+struct PBRTParamArena;
 
 namespace pbrt
 {
     using Float = float;
 }
 
-template<typename T>
-static T tokenToFloat(const Token& t)
+// Parse a float from [first, last), the text doesn't need to be null-terminated.
+inline bool parseFloat(const char* first, const char* last, float* value)
 {
+    if (first != last && *first == '+')
+        first++;
+#ifdef __cpp_lib_to_chars
+    auto res = std::from_chars(first, last, *value);
+    return res.ec == std::errc() && res.ptr == last;
+#else
+    char buffer[64];
+    size_t len = last - first;
+    if (len == 0 || len >= sizeof(buffer))
+        return false;
+    memcpy(buffer, first, len);
+    buffer[len] = 0;
     char* end;
+    *value = std::strtof(buffer, &end);
+    return end == buffer + len;
+#endif
+}
+
+inline bool parseInt(const char* first, const char* last, int* value)
+{
+    if (first != last && *first == '+')
+        first++;
+    auto res = std::from_chars(first, last, *value);
+    return res.ec == std::errc() && res.ptr == last;
+}
+
+template<typename T>
+inline T tokenToFloat(const Token& t)
+{
     if constexpr (std::is_same_v<T,float>)
     {
-        return std::strtof(t.str+t.pos,&end);
-    }else if (std::is_same_v<T,double>)
-    {
-        return std::strtod(t.str+t.pos,&end);
+        float value = 0;
+        if (!parseFloat(t.str + t.pos, t.str + t.pos + t.len, &value))
+            throw std::runtime_error("expected float but get " + t.to_string());
+        return value;
     }else{
         throw std::runtime_error("unsupported float type");
     }
@@ -55,40 +88,9 @@ struct TokenParser
         printf("Done.\n");
     }
 
-    static std::vector<std::pair<std::string,std::string>> extractParaLists( LockFreeCircleQueue<Token>& tokenQueue)
-    {
-        std::vector<std::pair<std::string,std::string>> lists;
-
-        while(!isDirective(tokenQueue.waitAndFront())){
-            auto tok = tokenQueue.waitAndDequeue();
-            auto para_typ_and_name = tok.to_string();
-            tok = tokenQueue.waitAndDequeue();
-            if(isDirective(tok)){
-                GlobalLogger::getInstance().error("Can't find parameter data");
-                throw std::runtime_error("Can't find parameter data");
-            }else{
-                auto tok_str = tok.to_string();
-                if(tok_str == "["){
-                    while(tok.to_string() != "]")
-                    {
-                        tok = tokenQueue.waitAndDequeue();
-                        if(isDirective(tok) || tok.str == nullptr){
-                            //sytnax wrong
-                            GlobalLogger::getInstance().error("InComplete Parameter vector");
-                            throw std::runtime_error("InComplete Parameter vector");
-                        }
-                        tok_str += tok.to_string();
-                        tok_str += ',';
-                    }
-                    lists.emplace_back(para_typ_and_name,tok_str);
-                }else{
-                    lists.emplace_back(para_typ_and_name,tok_str);
-                }
-            }
-        }
-
-        return lists;
-    }
+    // Parse the parameter list following a directive.
+    // The returned list and the values it references are only valid until the next call.
+    static const std::vector<PBRTParam>& extractParaLists(LockFreeCircleQueue<Token>& tokenQueue);
 
 private:
     static bool isDirective(const Token & t)
@@ -99,4 +101,7 @@ private:
     }
 
     static std::unordered_map<std::string_view,DirectiveHandler> handlers;
+
+    static PBRTParamArena paramArena;
+    static std::vector<PBRTParam> paramList;
 };
\ No newline at end of file
@@ -0,0 +1,153 @@
+#include "TransformHierarchy.hpp"
+
+#include <algorithm>
+#include <future>
+#include <thread>
+
+#include "sceneGraphEditor.hpp"
+#include "ThreadPool.h"
+
+namespace
+{
+    // levels smaller than this are swept on the calling thread, splitting them costs more than it saves
+    constexpr uint32_t PARALLEL_LEVEL_SIZE = 16 * 1024;
+
+    ThreadPool& sweepPool()
+    {
+        // the calling thread sweeps a share of every level too
+        static ThreadPool pool{ std::max(1u, std::thread::hardware_concurrency()) - 1 };
+        return pool;
+    }
+}
+
+uint32_t TransformHierarchy::add(SceneGraphNodeHandle handle)
+{
+    auto index = static_cast<uint32_t>(selfTransforms.size());
+    selfTransforms.emplace_back(1.0f);
+    finalTransforms.emplace_back(1.0f);
+    parent.push_back(NO_PARENT);
+    dirty.push_back(0);
+    node.push_back(handle);
+    return index;
+}
+
+void TransformHierarchy::rebuild(const ChunkedArena<SceneGraphNode>& nodes)
+{
+    // depth of every live node through its parent chain, memoized by slot
+    std::vector<SceneGraphNode*> live;
+    live.reserve(nodes.size());
+    nodes.forEach([&](SceneGraphNodeHandle, SceneGraphNode& n) { live.push_back(&n); });
+
+    std::vector<int32_t> depth(node.size(), -1);
+    std::vector<SceneGraphNode*> chain;
+    uint32_t maxDepth = 0;
+    for (auto* start : live)
+    {
+        auto* current = start;
+        while (depth[current->transformIndex] < 0)
+        {
+            chain.push_back(current);
+            auto* parentNode = current->parentNode();
+            if (parentNode == nullptr)
+                break;
+            current = parentNode;
+        }
+        int32_t d = depth[current->transformIndex] < 0 ? -1 : depth[current->transformIndex];
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+        {
+            depth[(*it)->transformIndex] = ++d;
+        }
+        chain.clear();
+        maxDepth = std::max(maxDepth, static_cast<uint32_t>(depth[start->transformIndex]));
+    }
+
+    // counting sort by depth
+    levelBegin.assign(live.empty() ? 1 : maxDepth + 2, 0);
+    for (auto* n : live)
+        levelBegin[depth[n->transformIndex] + 1]++;
+    for (size_t l = 1; l < levelBegin.size(); l++)
+        levelBegin[l] += levelBegin[l - 1];
+
+    std::vector<uint32_t> cursor(levelBegin.begin(), levelBegin.end() - 1);
+    std::vector<glm::mat4> sortedSelf(live.size()), sortedFinal(live.size());
+    std::vector<SceneGraphNodeHandle> sortedNode(live.size());
+    for (auto* n : live)
+    {
+        auto to = cursor[depth[n->transformIndex]]++;
+        sortedSelf[to] = selfTransforms[n->transformIndex];
+        sortedFinal[to] = finalTransforms[n->transformIndex];
+        sortedNode[to] = n->handle;
+        n->transformIndex = to;
+    }
+
+    parent.assign(live.size(), NO_PARENT);
+    for (auto* n : live)
+    {
+        auto* parentNode = n->parentNode();
+        if (parentNode != nullptr && !n->is_transform_detached)
+            parent[n->transformIndex] = static_cast<int32_t>(parentNode->transformIndex);
+    }
+
+    selfTransforms = std::move(sortedSelf);
+    finalTransforms = std::move(sortedFinal);
+    node = std::move(sortedNode);
+    dirty.assign(live.size(), 0);
+    firstDirty = NONE;
+    changed.clear();
+}
+
+void TransformHierarchy::sweepRange(uint32_t begin, uint32_t end)
+{
+    for (uint32_t i = begin; i < end; i++)
+    {
+        auto p = parent[i];
+        if (p != NO_PARENT && dirty[p])
+            dirty[i] = 1;
+        if (dirty[i])
+            finalTransforms[i] = p != NO_PARENT ? selfTransforms[i] * finalTransforms[p] : selfTransforms[i];
+    }
+}
+
+const std::vector<SceneGraphNodeHandle>& TransformHierarchy::update()
+{
+    changed.clear();
+    if (firstDirty == NONE)
+        return changed;
+
+    auto& pool = sweepPool();
+    std::vector<std::future<void>> pending;
+    for (size_t l = 0; l + 1 < levelBegin.size(); l++)
+    {
+        uint32_t begin = std::max(levelBegin[l], firstDirty);
+        uint32_t end = levelBegin[l + 1];
+        if (end <= begin)
+            continue;
+        if (end - begin < PARALLEL_LEVEL_SIZE)
+        {
+            sweepRange(begin, end);
+            continue;
+        }
+        // a level only reads the one above it, its nodes are independent of each other
+        auto parts = static_cast<uint32_t>(pool.size() + 1);
+        uint32_t step = (end - begin + parts - 1) / parts;
+        for (uint32_t first = begin + step; first < end; first += step)
+        {
+            pending.push_back(pool.enqueue([this, first, last = std::min(end, first + step)](int) { sweepRange(first, last); }));
+        }
+        sweepRange(begin, std::min(end, begin + step));
+        for (auto& part : pending)
+            part.get();
+        pending.clear();
+    }
+
+    for (uint32_t i = firstDirty; i < dirty.size(); i++)
+    {
+        if (dirty[i])
+        {
+            changed.push_back(node[i]);
+            dirty[i] = 0;
+        }
+    }
+    firstDirty = NONE;
+    return changed;
+}
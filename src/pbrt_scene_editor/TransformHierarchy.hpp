@@ -0,0 +1,65 @@
+#ifndef PBRTEDITOR_TRANSFORMHIERARCHY_HPP
+#define PBRTEDITOR_TRANSFORMHIERARCHY_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ChunkedArena.hpp"
+
+struct SceneGraphNode;
+using SceneGraphNodeHandle = ArenaHandle<SceneGraphNode>;
+
+/*
+*  Self and final transforms of every node of a SceneGraph, stored as parallel arrays.
+*
+*  After rebuild() the arrays are sorted by depth, so a parent always comes before its children and the nodes
+*  of one level are contiguous. Editing a self transform only sets a dirty bit. update() then recomputes the
+*  final transforms of the dirty subtrees in one sweep, level by level, splitting large levels across threads.
+*  The sweep starts at the first dirty slot, so edits deep in the hierarchy skip the levels above them.
+*  The nodes whose final transform changed are returned together, instead of one notification per node.
+*/
+struct TransformHierarchy
+{
+    static constexpr int32_t NO_PARENT = -1;
+
+    std::vector<glm::mat4> selfTransforms;
+    std::vector<glm::mat4> finalTransforms;
+    // NO_PARENT for roots and for nodes whose transform is detached from their parent
+    std::vector<int32_t> parent;
+    std::vector<uint8_t> dirty;
+    std::vector<SceneGraphNodeHandle> node;
+    // level l spans [levelBegin[l], levelBegin[l + 1])
+    std::vector<uint32_t> levelBegin;
+
+    // Append a slot for a node that is not sorted in yet, rebuild() orders it
+    uint32_t add(SceneGraphNodeHandle handle);
+
+    // Sort the slots of the live nodes of nodes by depth and drop the slots of destroyed ones
+    void rebuild(const ChunkedArena<SceneGraphNode>& nodes);
+
+    void markDirty(uint32_t index)
+    {
+        dirty[index] = 1;
+        firstDirty = std::min(firstDirty, index);
+    }
+
+    // Recompute the dirty final transforms, returns the nodes they belong to, valid until the next update()
+    const std::vector<SceneGraphNodeHandle>& update();
+
+    size_t size() const
+    {
+        return selfTransforms.size();
+    }
+
+private:
+    void sweepRange(uint32_t begin, uint32_t end);
+
+    // slots before the first dirty one can't be affected, the sweep starts there. NONE when nothing is dirty.
+    static constexpr uint32_t NONE = ~0u;
+    uint32_t firstDirty = NONE;
+    std::vector<SceneGraphNodeHandle> changed;
+};
+
+#endif //PBRTEDITOR_TRANSFORMHIERARCHY_HPP
@@ -0,0 +1,632 @@
+#include "UploadScheduler.hpp"
+
+#include <cstring>
+#include <limits>
+
+static constexpr vk::DeviceSize stagingAlignment = 16; // covers texel size and the 4 bytes copyBufferToImage requires
+
+void UploadScheduler::init(DeviceExtended* device, vk::DeviceSize ringSize)
+{
+    backendDevice = device;
+
+    graphicsFamily = device->get_queue_index(vkb::QueueType::graphics).value();
+    if (device->physical_device.has_dedicated_transfer_queue())
+    {
+        transferFamily = device->get_dedicated_queue_index(vkb::QueueType::transfer).value();
+        transferQueue = device->get_dedicated_queue(vkb::QueueType::transfer).value();
+    }else{
+        //doesn't have dedicated transfer queue. Just use main queue
+        transferFamily = graphicsFamily;
+        transferQueue = device->get_queue(vkb::QueueType::graphics).value();
+    }
+
+    vk::SemaphoreTypeCreateInfo timelineInfo{};
+    timelineInfo.setSemaphoreType(vk::SemaphoreType::eTimeline);
+    timelineInfo.setInitialValue(0);
+    vk::SemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.setPNext(&timelineInfo);
+    transferTimeline = backendDevice->createSemaphore(semaphoreInfo);
+    graphicsTimeline = backendDevice->createSemaphore(semaphoreInfo);
+    backendDevice->setObjectDebugName(transferTimeline, "UploadTransferTimeline");
+    backendDevice->setObjectDebugName(graphicsTimeline, "UploadGraphicsTimeline");
+
+    vk::CommandPoolCreateInfo poolInfo{};
+    poolInfo.setFlags(vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer);
+    poolInfo.setQueueFamilyIndex(transferFamily);
+    transferPool = backendDevice->createCommandPool(poolInfo);
+    poolInfo.setQueueFamilyIndex(graphicsFamily);
+    graphicsPool = backendDevice->createCommandPool(poolInfo);
+
+    VkBufferCreateInfo bufferCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    bufferCreateInfo.size = ringSize;
+    bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+    VmaAllocationCreateInfo allocCreateInfo = {};
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+    allocCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+    VmaAllocationInfo allocationInfo;
+    if (vmaCreateBuffer(backendDevice->_globalVMAAllocator, &bufferCreateInfo, &allocCreateInfo,
+                        &ringBuffer, &ringAllocation, &allocationInfo) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to allocate upload staging ring");
+    }
+    backendDevice->setObjectDebugName(vk::Buffer(ringBuffer), "UploadStagingRing");
+    ringMapped = static_cast<char*>(allocationInfo.pMappedData);
+    ringCapacity = ringSize;
+    ringHead = ringTail = 0;
+}
+
+void UploadScheduler::destroy()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (backendDevice == nullptr) return;
+
+    if (openTransferCmd)
+    {
+        openTransferCmd.end();
+        openTransferCmd = nullptr;
+    }
+    for (auto& staging : dedicatedStagings)
+    {
+        backendDevice->deAllocateBuffer(staging.buffer, staging.allocation);
+    }
+    dedicatedStagings.clear();
+    backendDevice->deAllocateBuffer(ringBuffer, ringAllocation);
+    ringBuffer = VK_NULL_HANDLE;
+    ringRegions.clear();
+    pendingAcquires.clear();
+    graphicsCopies.clear();
+    transferCommands.clear();
+    graphicsCommands.clear();
+
+    backendDevice->destroyCommandPool(transferPool);
+    backendDevice->destroyCommandPool(graphicsPool);
+    backendDevice->destroySemaphore(transferTimeline);
+    backendDevice->destroySemaphore(graphicsTimeline);
+    backendDevice = nullptr;
+}
+
+UploadTicket UploadScheduler::uploadBuffer(const void* data, vk::DeviceSize size, vk::Buffer dst, vk::DeviceSize dstOffset)
+{
+    if (size == 0) return {};
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto staging = allocateStaging(size, false);
+    memcpy(staging.mapped, data, size);
+    vmaFlushAllocation(backendDevice->_globalVMAAllocator, staging.allocation, staging.offset, size);
+
+    // may flush the previous batch, so it comes after the allocation
+    auto cmd = transferCommand();
+    uint64_t value = transferSubmitted + 1;
+
+    vk::BufferCopy region{};
+    region.setSrcOffset(staging.offset);
+    region.setDstOffset(dstOffset);
+    region.setSize(size);
+    cmd.copyBuffer(staging.buffer, dst, region);
+
+    if (needOwnershipTransfer())
+    {
+        vk::BufferMemoryBarrier2 release{};
+        release.setSrcStageMask(vk::PipelineStageFlagBits2::eTransfer);
+        release.setSrcAccessMask(vk::AccessFlagBits2::eTransferWrite);
+        release.setSrcQueueFamilyIndex(transferFamily);
+        release.setDstQueueFamilyIndex(graphicsFamily);
+        release.setBuffer(dst);
+        release.setOffset(0);
+        release.setSize(vk::WholeSize);
+
+        vk::DependencyInfo dependency{};
+        dependency.setBufferMemoryBarriers(release);
+        pipelineBarrier(cmd, dependency);
+
+        PendingAcquire acquire{};
+        acquire.value = value;
+        acquire.buffer = dst;
+        pendingAcquires.push_back(acquire);
+    }
+    // With a single queue family the timeline wait alone orders the copy before the first use.
+
+    return UploadTicket{value};
+}
+
+UploadTicket UploadScheduler::uploadImage(const void* data, vk::Image dst, uint32_t channels, const VkImageCreateInfo& imgInfo)
+{
+    vk::DeviceSize size = static_cast<vk::DeviceSize>(imgInfo.extent.width) * imgInfo.extent.height * channels;
+    if (size == 0) return {};
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto staging = allocateStaging(size, false);
+    memcpy(staging.mapped, data, size);
+    vmaFlushAllocation(backendDevice->_globalVMAAllocator, staging.allocation, staging.offset, size);
+
+    auto cmd = transferCommand();
+    uint64_t value = transferSubmitted + 1;
+
+    vk::ImageSubresourceRange subresourceRange{};
+    subresourceRange.setAspectMask(vk::ImageAspectFlagBits::eColor);
+    subresourceRange.setBaseMipLevel(0);
+    subresourceRange.setLevelCount(imgInfo.mipLevels);
+    subresourceRange.setBaseArrayLayer(0);
+    subresourceRange.setLayerCount(1);
+
+    vk::ImageMemoryBarrier2 barrier{}; // Undefined -> TransferDstOptimal for all mipmap levels
+    barrier.setSrcStageMask(vk::PipelineStageFlagBits2::eNone);
+    barrier.setSrcAccessMask(vk::AccessFlagBits2::eNone);
+    barrier.setDstStageMask(vk::PipelineStageFlagBits2::eTransfer);
+    barrier.setDstAccessMask(vk::AccessFlagBits2::eTransferWrite);
+    barrier.setOldLayout(vk::ImageLayout::eUndefined);
+    barrier.setNewLayout(vk::ImageLayout::eTransferDstOptimal);
+    barrier.setSrcQueueFamilyIndex(vk::QueueFamilyIgnored);
+    barrier.setDstQueueFamilyIndex(vk::QueueFamilyIgnored);
+    barrier.setImage(dst);
+    barrier.setSubresourceRange(subresourceRange);
+    vk::DependencyInfo dependency{};
+    dependency.setImageMemoryBarriers(barrier);
+    pipelineBarrier(cmd, dependency);
+
+    vk::ImageSubresourceLayers subresourceLayers;
+    subresourceLayers.setAspectMask(subresourceRange.aspectMask);
+    subresourceLayers.setMipLevel(0);
+    subresourceLayers.setLayerCount(1);
+    subresourceLayers.setBaseArrayLayer(0);
+
+    vk::BufferImageCopy region{};
+    region.setImageSubresource(subresourceLayers);
+    region.setBufferImageHeight(0);
+    region.setBufferOffset(staging.offset);
+    region.setBufferRowLength(0);
+    region.setImageOffset({0,0,0});
+    region.setImageExtent(imgInfo.extent);
+    cmd.copyBufferToImage(staging.buffer, dst, vk::ImageLayout::eTransferDstOptimal, region);
+
+    // Mipmaps are blitted on the graphics queue, dedicated transfer queues can't blit. Level 0 stays in TransferDstOptimal for that.
+    bool genMipmap = imgInfo.mipLevels > 1;
+    if (needOwnershipTransfer() || !genMipmap)
+    {
+        vk::ImageMemoryBarrier2 release{}; // TransferDstOptimal -> ShaderReadOnlyOptimal, the acquire side repeats the same transition
+        release.setSrcStageMask(vk::PipelineStageFlagBits2::eTransfer);
+        release.setSrcAccessMask(vk::AccessFlagBits2::eTransferWrite);
+        release.setDstStageMask(vk::PipelineStageFlagBits2::eNone);
+        release.setDstAccessMask(vk::AccessFlagBits2::eNone);
+        release.setOldLayout(vk::ImageLayout::eTransferDstOptimal);
+        release.setNewLayout(genMipmap ? vk::ImageLayout::eTransferDstOptimal : vk::ImageLayout::eShaderReadOnlyOptimal);
+        release.setSrcQueueFamilyIndex(needOwnershipTransfer() ? transferFamily : vk::QueueFamilyIgnored);
+        release.setDstQueueFamilyIndex(needOwnershipTransfer() ? graphicsFamily : vk::QueueFamilyIgnored);
+        release.setImage(dst);
+        release.setSubresourceRange(subresourceRange);
+        dependency.setImageMemoryBarriers(release);
+        pipelineBarrier(cmd, dependency);
+    }
+
+    if (needOwnershipTransfer() || genMipmap)
+    {
+        PendingAcquire acquire{};
+        acquire.value = value;
+        acquire.image = dst;
+        acquire.imgInfo = imgInfo;
+        pendingAcquires.push_back(acquire);
+    }
+
+    return UploadTicket{value};
+}
+
+void UploadScheduler::stageGraphicsCopy(const void* data, vk::DeviceSize size, vk::Buffer dst, vk::DeviceSize dstOffset)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stageGraphicsCopyLocked(data, size, dst, dstOffset);
+}
+
+void UploadScheduler::stageGraphicsCopies(const std::vector<DeviceExtended::BufferCopy>& copies)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& copy : copies)
+    {
+        stageGraphicsCopyLocked(copy.data, copy.size, copy.dst, copy.dstOffset);
+    }
+}
+
+void UploadScheduler::stageGraphicsCopyLocked(const void* data, vk::DeviceSize size, vk::Buffer dst, vk::DeviceSize dstOffset)
+{
+    if (size == 0) return;
+
+    auto staging = allocateStaging(size, true);
+    memcpy(staging.mapped, data, size);
+    vmaFlushAllocation(backendDevice->_globalVMAAllocator, staging.allocation, staging.offset, size);
+
+    GraphicsCopy copy{};
+    copy.src = staging.buffer;
+    copy.dst = dst;
+    copy.region.setSrcOffset(staging.offset);
+    copy.region.setDstOffset(dstOffset);
+    copy.region.setSize(size);
+    graphicsCopies.push_back(copy);
+}
+
+void UploadScheduler::flush()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    flushLocked();
+}
+
+bool UploadScheduler::isComplete(UploadTicket ticket)
+{
+    return counterValue(transferTimeline) >= ticket.value;
+}
+
+void UploadScheduler::wait(UploadTicket ticket)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (ticket.value > transferSubmitted)
+        {
+            flushLocked();
+        }
+    }
+    waitTimeline(transferTimeline, ticket.value);
+}
+
+UploadScheduler::GraphicsSubmit UploadScheduler::prepareGraphicsSubmit()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    flushLocked();
+    collect();
+
+    GraphicsSubmit submit;
+    submit.transferTimeline = transferTimeline;
+    submit.graphicsTimeline = graphicsTimeline;
+    submit.graphicsSignalValue = graphicsSubmitted + 1;
+
+    uint64_t acquireUpTo = requiredValue > acquiredValue.load(std::memory_order_relaxed) ? requiredValue : 0;
+    bool hasAcquire = acquireUpTo != 0 && !pendingAcquires.empty() && pendingAcquires.front().value <= acquireUpTo;
+
+    if (hasAcquire || !graphicsCopies.empty())
+    {
+        auto cmd = acquireCommand(graphicsPool, graphicsCommands, graphicsTimeline);
+        vk::CommandBufferBeginInfo beginInfo{};
+        beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+        cmd.begin(beginInfo);
+
+        // Tickets are ordered, waiting on one completes every batch before it, acquire them all.
+        while (acquireUpTo != 0 && !pendingAcquires.empty() && pendingAcquires.front().value <= acquireUpTo)
+        {
+            recordAcquire(cmd, pendingAcquires.front());
+            pendingAcquires.pop_front();
+        }
+
+        if (!graphicsCopies.empty())
+        {
+            // The destinations may still be read by frames in flight
+            vk::MemoryBarrier2 before{};
+            before.setSrcStageMask(vk::PipelineStageFlagBits2::eAllCommands);
+            before.setSrcAccessMask(vk::AccessFlagBits2::eMemoryWrite);
+            before.setDstStageMask(vk::PipelineStageFlagBits2::eTransfer);
+            before.setDstAccessMask(vk::AccessFlagBits2::eTransferWrite);
+            vk::DependencyInfo dependency{};
+            dependency.setMemoryBarriers(before);
+            pipelineBarrier(cmd, dependency);
+
+            for (const auto& copy : graphicsCopies)
+            {
+                cmd.copyBuffer(copy.src, copy.dst, copy.region);
+            }
+            graphicsCopies.clear();
+
+            vk::MemoryBarrier2 after{};
+            after.setSrcStageMask(vk::PipelineStageFlagBits2::eTransfer);
+            after.setSrcAccessMask(vk::AccessFlagBits2::eTransferWrite);
+            after.setDstStageMask(vk::PipelineStageFlagBits2::eAllCommands);
+            after.setDstAccessMask(vk::AccessFlagBits2::eMemoryRead);
+            dependency.setMemoryBarriers(after);
+            pipelineBarrier(cmd, dependency);
+        }
+
+        cmd.end();
+        graphicsCommands.push_back({cmd, submit.graphicsSignalValue});
+        submit.cmd = cmd;
+    }
+
+    if (acquireUpTo != 0)
+    {
+        submit.transferWaitValue = acquireUpTo;
+        acquiredValue.store(acquireUpTo, std::memory_order_release);
+    }
+
+    graphicsSubmitted = submit.graphicsSignalValue;
+    return submit;
+}
+
+UploadScheduler::StagingAllocation UploadScheduler::allocateStaging(vk::DeviceSize size, bool graphics)
+{
+    // Larger uploads would keep the ring busy for too long, they get a buffer of their own.
+    if (size <= ringCapacity / 2)
+    {
+        for (;;)
+        {
+            uint64_t offset = (ringHead + stagingAlignment - 1) & ~(stagingAlignment - 1);
+            if (offset % ringCapacity + size > ringCapacity)
+            {
+                // don't straddle the end of the buffer, the skipped bytes are freed along with this allocation
+                offset += ringCapacity - offset % ringCapacity;
+            }
+            if (offset + size - ringTail <= ringCapacity)
+            {
+                ringHead = offset + size;
+                vk::Semaphore semaphore = graphics ? graphicsTimeline : transferTimeline;
+                uint64_t value = graphics ? graphicsSubmitted + 1 : transferSubmitted + 1;
+                if (!ringRegions.empty() && ringRegions.back().semaphore == semaphore && ringRegions.back().value == value)
+                {
+                    ringRegions.back().end = ringHead;
+                }else{
+                    ringRegions.push_back({ringHead, semaphore, value});
+                }
+                StagingAllocation allocation{};
+                allocation.buffer = ringBuffer;
+                allocation.allocation = ringAllocation;
+                allocation.offset = offset % ringCapacity;
+                allocation.mapped = ringMapped + allocation.offset;
+                return allocation;
+            }
+            if (!retireStaging(graphics))
+            {
+                break;
+            }
+        }
+    }
+
+    VkBufferCreateInfo bufferCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    bufferCreateInfo.size = size;
+    bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+    VmaAllocationCreateInfo allocCreateInfo = {};
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+    allocCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+    DedicatedStaging dedicated{};
+    VmaAllocationInfo allocationInfo;
+    if (vmaCreateBuffer(backendDevice->_globalVMAAllocator, &bufferCreateInfo, &allocCreateInfo,
+                        &dedicated.buffer, &dedicated.allocation, &allocationInfo) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to allocate staging buffer of " + std::to_string(size) + " bytes");
+    }
+    dedicated.semaphore = graphics ? graphicsTimeline : transferTimeline;
+    dedicated.value = graphics ? graphicsSubmitted + 1 : transferSubmitted + 1;
+    dedicatedStagings.push_back(dedicated);
+
+    StagingAllocation allocation{};
+    allocation.buffer = dedicated.buffer;
+    allocation.allocation = dedicated.allocation;
+    allocation.offset = 0;
+    allocation.mapped = static_cast<char*>(allocationInfo.pMappedData);
+    return allocation;
+}
+
+bool UploadScheduler::retireStaging(bool graphics)
+{
+    if (ringRegions.empty()) return false;
+
+    auto front = ringRegions.front();
+    if (counterValue(front.semaphore) < front.value)
+    {
+        if (front.semaphore == transferTimeline && front.value > transferSubmitted)
+        {
+            // the ring is full of the batch being recorded
+            flushLocked();
+        }
+        else if (front.semaphore == graphicsTimeline && front.value > graphicsSubmitted)
+        {
+            // copies for the coming frame, can't be waited on before the frame is submitted
+            return false;
+        }
+        waitTimeline(front.semaphore, front.value);
+    }
+    ringTail = front.end;
+    ringRegions.pop_front();
+    return true;
+}
+
+void UploadScheduler::collect()
+{
+    uint64_t transferDone = counterValue(transferTimeline);
+    uint64_t graphicsDone = counterValue(graphicsTimeline);
+    auto isDone = [&](vk::Semaphore semaphore, uint64_t value) {
+        return value <= (semaphore == transferTimeline ? transferDone : graphicsDone);
+    };
+
+    while (!ringRegions.empty() && isDone(ringRegions.front().semaphore, ringRegions.front().value))
+    {
+        ringTail = ringRegions.front().end;
+        ringRegions.pop_front();
+    }
+
+    auto it = std::remove_if(dedicatedStagings.begin(), dedicatedStagings.end(), [&](const DedicatedStaging& staging) {
+        if (!isDone(staging.semaphore, staging.value)) return false;
+        backendDevice->deAllocateBuffer(staging.buffer, staging.allocation);
+        return true;
+    });
+    dedicatedStagings.erase(it, dedicatedStagings.end());
+}
+
+vk::CommandBuffer UploadScheduler::transferCommand()
+{
+    if (!openTransferCmd)
+    {
+        openTransferCmd = acquireCommand(transferPool, transferCommands, transferTimeline);
+        vk::CommandBufferBeginInfo beginInfo{};
+        beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+        openTransferCmd.begin(beginInfo);
+    }
+    return openTransferCmd;
+}
+
+vk::CommandBuffer UploadScheduler::acquireCommand(vk::CommandPool pool, std::deque<RecycledCommand>& recycled, vk::Semaphore semaphore)
+{
+    if (!recycled.empty() && counterValue(semaphore) >= recycled.front().value)
+    {
+        auto cmd = recycled.front().cmd;
+        recycled.pop_front();
+        cmd.reset();
+        return cmd;
+    }
+
+    vk::CommandBufferAllocateInfo allocInfo{};
+    allocInfo.setCommandPool(pool);
+    allocInfo.setCommandBufferCount(1);
+    allocInfo.setLevel(vk::CommandBufferLevel::ePrimary);
+    return backendDevice->allocateCommandBuffers(allocInfo).front();
+}
+
+void UploadScheduler::flushLocked()
+{
+    if (!openTransferCmd) return;
+
+    openTransferCmd.end();
+    uint64_t value = transferSubmitted + 1;
+
+    vk::TimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.setSignalSemaphoreValues(value);
+    vk::SubmitInfo submitInfo{};
+    submitInfo.setCommandBuffers(openTransferCmd);
+    submitInfo.setSignalSemaphores(transferTimeline);
+    submitInfo.setPNext(&timelineInfo);
+    transferQueue.submit(submitInfo);
+
+    transferCommands.push_back({openTransferCmd, value});
+    openTransferCmd = nullptr;
+    transferSubmitted = value;
+}
+
+void UploadScheduler::waitTimeline(vk::Semaphore semaphore, uint64_t value)
+{
+    vk::SemaphoreWaitInfo waitInfo{};
+    waitInfo.setSemaphores(semaphore);
+    waitInfo.setValues(value);
+    if (backendDevice->waitSemaphores(waitInfo, std::numeric_limits<uint64_t>::max()) != vk::Result::eSuccess)
+    {
+        throw std::runtime_error("Failed to wait for uploads");
+    }
+}
+
+uint64_t UploadScheduler::counterValue(vk::Semaphore semaphore) const
+{
+    return backendDevice->getSemaphoreCounterValue(semaphore);
+}
+
+void UploadScheduler::recordAcquire(vk::CommandBuffer cmd, const PendingAcquire& acquire)
+{
+    vk::DependencyInfo dependency{};
+    if (acquire.buffer)
+    {
+        vk::BufferMemoryBarrier2 barrier{};
+        barrier.setSrcStageMask(vk::PipelineStageFlagBits2::eNone);
+        barrier.setSrcAccessMask(vk::AccessFlagBits2::eNone);
+        barrier.setDstStageMask(vk::PipelineStageFlagBits2::eAllCommands);
+        barrier.setDstAccessMask(vk::AccessFlagBits2::eMemoryRead | vk::AccessFlagBits2::eTransferWrite);
+        barrier.setSrcQueueFamilyIndex(transferFamily);
+        barrier.setDstQueueFamilyIndex(graphicsFamily);
+        barrier.setBuffer(acquire.buffer);
+        barrier.setOffset(0);
+        barrier.setSize(vk::WholeSize);
+        dependency.setBufferMemoryBarriers(barrier);
+        pipelineBarrier(cmd, dependency);
+        return;
+    }
+
+    bool genMipmap = acquire.imgInfo.mipLevels > 1;
+    if (needOwnershipTransfer())
+    {
+        vk::ImageMemoryBarrier2 barrier{};
+        barrier.setSrcStageMask(vk::PipelineStageFlagBits2::eNone);
+        barrier.setSrcAccessMask(vk::AccessFlagBits2::eNone);
+        if (genMipmap)
+        {
+            barrier.setDstStageMask(vk::PipelineStageFlagBits2::eTransfer);
+            barrier.setDstAccessMask(vk::AccessFlagBits2::eTransferRead | vk::AccessFlagBits2::eTransferWrite);
+        }else{
+            barrier.setDstStageMask(vk::PipelineStageFlagBits2::eAllCommands);
+            barrier.setDstAccessMask(vk::AccessFlagBits2::eShaderRead);
+        }
+        barrier.setOldLayout(vk::ImageLayout::eTransferDstOptimal);
+        barrier.setNewLayout(genMipmap ? vk::ImageLayout::eTransferDstOptimal : vk::ImageLayout::eShaderReadOnlyOptimal);
+        barrier.setSrcQueueFamilyIndex(transferFamily);
+        barrier.setDstQueueFamilyIndex(graphicsFamily);
+        barrier.setImage(acquire.image);
+        barrier.subresourceRange.setAspectMask(vk::ImageAspectFlagBits::eColor);
+        barrier.subresourceRange.setBaseMipLevel(0);
+        barrier.subresourceRange.setLevelCount(acquire.imgInfo.mipLevels);
+        barrier.subresourceRange.setBaseArrayLayer(0);
+        barrier.subresourceRange.setLayerCount(1);
+        dependency.setImageMemoryBarriers(barrier);
+        pipelineBarrier(cmd, dependency);
+    }
+
+    if (genMipmap)
+    {
+        recordMipChain(cmd, acquire.image, acquire.imgInfo);
+    }
+}
+
+void UploadScheduler::recordMipChain(vk::CommandBuffer cmd, vk::Image image, const VkImageCreateInfo& imgInfo)
+{
+    vk::ImageMemoryBarrier interBarrier{};
+    interBarrier.setImage(image);
+    interBarrier.setSrcQueueFamilyIndex(vk::QueueFamilyIgnored);
+    interBarrier.setDstQueueFamilyIndex(vk::QueueFamilyIgnored);
+    interBarrier.subresourceRange.setAspectMask(vk::ImageAspectFlagBits::eColor);
+    interBarrier.subresourceRange.setBaseArrayLayer(0);
+    interBarrier.subresourceRange.setLayerCount(1);
+    interBarrier.subresourceRange.setLevelCount(1);
+
+    int32_t mipWidth = imgInfo.extent.width;
+    int32_t mipHeight = imgInfo.extent.height;
+    for (uint32_t level = 1; level < imgInfo.mipLevels; level++)
+    {
+        interBarrier.subresourceRange.setBaseMipLevel(level - 1); // Transfer level i - 1 TransferDstOptimal -> TransferSrcOptimal
+        interBarrier.setOldLayout(vk::ImageLayout::eTransferDstOptimal);
+        interBarrier.setNewLayout(vk::ImageLayout::eTransferSrcOptimal);
+        interBarrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite);
+        interBarrier.setDstAccessMask(vk::AccessFlagBits::eTransferRead);
+
+        vk::ImageBlit blitRegion{};
+        blitRegion.setSrcOffsets({ vk::Offset3D{0,0,0},vk::Offset3D{mipWidth,mipHeight,1} });
+        blitRegion.srcSubresource.setMipLevel(level - 1);
+        blitRegion.srcSubresource.setAspectMask(vk::ImageAspectFlagBits::eColor);
+        blitRegion.srcSubresource.setBaseArrayLayer(0);
+        blitRegion.srcSubresource.setLayerCount(1);
+        blitRegion.setDstOffsets({ vk::Offset3D{0,0,0},vk::Offset3D{mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1,1} });
+        blitRegion.dstSubresource.setMipLevel(level);
+        blitRegion.dstSubresource.setAspectMask(vk::ImageAspectFlagBits::eColor);
+        blitRegion.dstSubresource.setBaseArrayLayer(0);
+        blitRegion.dstSubresource.setLayerCount(1);
+        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, {}, 0, {}, interBarrier);
+        cmd.blitImage(image, vk::ImageLayout::eTransferSrcOptimal, image, vk::ImageLayout::eTransferDstOptimal, blitRegion, vk::Filter::eLinear);
+
+        //Transfer level i - 1 TransferSrcOptimal -> ShaderReadOnlyOptimal
+        interBarrier.setOldLayout(vk::ImageLayout::eTransferSrcOptimal);
+        interBarrier.setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+        interBarrier.setSrcAccessMask(vk::AccessFlagBits::eTransferRead);
+        interBarrier.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, {}, 0, {}, interBarrier);
+
+        if (mipWidth > 1) mipWidth /= 2;
+        if (mipHeight > 1) mipHeight /= 2;
+    }
+
+    //Transfer the last level TransferDstOptimal -> ShaderReadOnlyOptimal
+    interBarrier.subresourceRange.baseMipLevel = imgInfo.mipLevels - 1;
+    interBarrier.setOldLayout(vk::ImageLayout::eTransferDstOptimal);
+    interBarrier.setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+    interBarrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite);
+    interBarrier.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, {}, 0, {}, interBarrier);
+}
+
+void UploadScheduler::pipelineBarrier(vk::CommandBuffer cmd, const vk::DependencyInfo& info)
+{
+#if __APPLE__
+    cmd.pipelineBarrier2KHR(info, backendDevice->getDLD());
+#else
+    cmd.pipelineBarrier2(info);
+#endif
+}
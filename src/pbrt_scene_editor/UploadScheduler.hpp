@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "VulkanExtension.h"
+#include "Singleton.h"
+
+/*
+ * Point on the transfer timeline after which an upload has landed. value 0 means there is nothing to wait for.
+ */
+struct UploadTicket
+{
+    uint64_t value = 0;
+
+    explicit operator bool() const {
+        return value != 0;
+    }
+};
+
+/*
+ * Batches GPU uploads instead of submitting and waiting once per resource.
+ *
+ * Data is copied into a persistent, persistently mapped staging ring. New resources are filled on the dedicated
+ * transfer queue (if the device has one) and released to the graphics queue family, every transfer submission
+ * signals one value of a timeline semaphore and the uploads recorded in it share that value as their ticket.
+ * The graphics queue only waits on a ticket once a resource of it is used (see use()), the queue family
+ * acquire barriers and the mipmap generation are recorded then into a command buffer submitted ahead of the frame.
+ *
+ * Writes into buffers the graphics queue already reads (per frame instance data, ...) are staged the same way but
+ * copied on the graphics queue right before the frame, so no ownership has to move back and forth.
+ *
+ * Staging memory is recycled by checking the timeline semaphores, the CPU only blocks when the ring is full.
+ */
+struct UploadScheduler : Singleton<UploadScheduler>
+{
+    void init(DeviceExtended* device, vk::DeviceSize ringSize = 64 * 1024 * 1024);
+
+    // Device must be idle
+    void destroy();
+
+    // Fill a resource the graphics queue hasn't used yet. data can be freed right after the call.
+    UploadTicket uploadBuffer(const void* data, vk::DeviceSize size, vk::Buffer dst, vk::DeviceSize dstOffset = 0);
+    UploadTicket uploadImage(const void* data, vk::Image dst, uint32_t channels, const VkImageCreateInfo& imgInfo);
+
+    // Update buffers in use by the graphics queue, the copies are executed before the next frame.
+    void stageGraphicsCopy(const void* data, vk::DeviceSize size, vk::Buffer dst, vk::DeviceSize dstOffset = 0);
+    void stageGraphicsCopies(const std::vector<DeviceExtended::BufferCopy>& copies);
+
+    // The next graphics submission reads a resource of ticket.
+    void use(UploadTicket ticket)
+    {
+        if (ticket.value <= acquiredValue.load(std::memory_order_acquire)) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        requiredValue = std::max(requiredValue, ticket.value);
+    }
+
+    // Submit the transfer commands recorded so far.
+    void flush();
+
+    bool isComplete(UploadTicket ticket);
+
+    // Block the calling thread until the upload of ticket has been executed.
+    void wait(UploadTicket ticket);
+
+    struct GraphicsSubmit
+    {
+        // Acquire barriers, mipmap generation and staged copies. Null when there's nothing to do.
+        vk::CommandBuffer cmd{};
+        // Wait on transferTimeline only if transferWaitValue != 0.
+        vk::Semaphore transferTimeline{};
+        uint64_t transferWaitValue = 0;
+        // Must be signaled by the frame submission so the staging memory it used can be recycled.
+        vk::Semaphore graphicsTimeline{};
+        uint64_t graphicsSignalValue = 0;
+    };
+
+    // Call once per graphics queue submission, right before submitting.
+    GraphicsSubmit prepareGraphicsSubmit();
+
+private:
+    struct StagingAllocation
+    {
+        vk::Buffer buffer;
+        VmaAllocation allocation;
+        vk::DeviceSize offset = 0;
+        char* mapped = nullptr;
+    };
+
+    struct StagingRegion
+    {
+        uint64_t end;
+        vk::Semaphore semaphore;
+        uint64_t value;
+    };
+
+    struct DedicatedStaging
+    {
+        VkBuffer buffer;
+        VmaAllocation allocation;
+        vk::Semaphore semaphore;
+        uint64_t value;
+    };
+
+    // Ownership of a resource released by the transfer queue, waiting to be acquired on the graphics queue.
+    struct PendingAcquire
+    {
+        uint64_t value;
+        vk::Buffer buffer{};
+        vk::Image image{};
+        VkImageCreateInfo imgInfo{};
+    };
+
+    struct GraphicsCopy
+    {
+        vk::Buffer src;
+        vk::Buffer dst;
+        vk::BufferCopy region;
+    };
+
+    struct RecycledCommand
+    {
+        vk::CommandBuffer cmd;
+        uint64_t value;
+    };
+
+    StagingAllocation allocateStaging(vk::DeviceSize size, bool graphics);
+    bool retireStaging(bool graphics);
+    void collect();
+
+    vk::CommandBuffer transferCommand();
+    vk::CommandBuffer acquireCommand(vk::CommandPool pool, std::deque<RecycledCommand>& recycled, vk::Semaphore semaphore);
+    void flushLocked();
+    void waitTimeline(vk::Semaphore semaphore, uint64_t value);
+    uint64_t counterValue(vk::Semaphore semaphore) const;
+
+    void stageGraphicsCopyLocked(const void* data, vk::DeviceSize size, vk::Buffer dst, vk::DeviceSize dstOffset);
+
+    void recordAcquire(vk::CommandBuffer cmd, const PendingAcquire& acquire);
+    void recordMipChain(vk::CommandBuffer cmd, vk::Image image, const VkImageCreateInfo& imgInfo);
+    void pipelineBarrier(vk::CommandBuffer cmd, const vk::DependencyInfo& info);
+
+    bool needOwnershipTransfer() const {
+        return transferFamily != graphicsFamily;
+    }
+
+    DeviceExtended* backendDevice = nullptr;
+    std::mutex mutex;
+
+    uint32_t graphicsFamily = 0;
+    uint32_t transferFamily = 0;
+    vk::Queue transferQueue;
+
+    vk::Semaphore transferTimeline;
+    vk::Semaphore graphicsTimeline;
+    uint64_t transferSubmitted = 0;
+    uint64_t graphicsSubmitted = 0;
+
+    vk::CommandPool transferPool;
+    vk::CommandPool graphicsPool;
+    std::deque<RecycledCommand> transferCommands;
+    std::deque<RecycledCommand> graphicsCommands;
+    vk::CommandBuffer openTransferCmd{};
+
+    // Staging ring. head and tail grow monotonically, the position in the buffer is taken modulo capacity.
+    VkBuffer ringBuffer = VK_NULL_HANDLE;
+    VmaAllocation ringAllocation = VK_NULL_HANDLE;
+    char* ringMapped = nullptr;
+    vk::DeviceSize ringCapacity = 0;
+    uint64_t ringHead = 0;
+    uint64_t ringTail = 0;
+    std::deque<StagingRegion> ringRegions;
+    std::vector<DedicatedStaging> dedicatedStagings;
+
+    std::deque<PendingAcquire> pendingAcquires;
+    std::vector<GraphicsCopy> graphicsCopies;
+    uint64_t requiredValue = 0;
+    std::atomic<uint64_t> acquiredValue{0};
+};
@@ -4,6 +4,7 @@
 
 #include "VulkanExtension.h"
 #include "ShaderManager.h"
+#include "PipelineCache.hpp"
 
 void SwapchainExtended::registerRecreateCallback(std::function<void(SwapchainExtended *)> callback) {
     recreateCallbacks.push_back(callback);
@@ -114,6 +115,20 @@ DeviceExtended::DeviceExtended(vkb::Device device, vk::Instance instance): vkb::
     allocatorCreateInfo.pVulkanFunctions = &vulkanFunctions;
 
     vmaCreateAllocator(&allocatorCreateInfo, &_globalVMAAllocator);
+
+    drawIndirectCountSupported = device.physical_device.is_extension_present(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    auto properties = vk::PhysicalDevice(device.physical_device.physical_device).getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceSubgroupProperties>();
+    const auto& subgroup = properties.get<vk::PhysicalDeviceSubgroupProperties>();
+    subgroupBallotSupported = (subgroup.supportedStages & vk::ShaderStageFlagBits::eCompute) &&
+                              (subgroup.supportedOperations & vk::SubgroupFeatureFlagBits::eBallot);
+    // the features carried by the physical device are the enabled ones
+    drawIndirectFirstInstanceSupported = device.physical_device.features.drawIndirectFirstInstance;
+    if (device.physical_device.is_extension_present(VK_EXT_MESH_SHADER_EXTENSION_NAME))
+    {
+        auto features = vk::PhysicalDevice(device.physical_device.physical_device).getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceMeshShaderFeaturesEXT>();
+        const auto& meshShader = features.get<vk::PhysicalDeviceMeshShaderFeaturesEXT>();
+        meshShaderSupported = meshShader.taskShader && meshShader.meshShader;
+    }
 }
 
 std::optional<VMAImage> DeviceExtended::allocateVMAImage(VkImageCreateInfo imageInfo) {
@@ -132,6 +147,31 @@ std::optional<VMAImage> DeviceExtended::allocateVMAImage(VkImageCreateInfo image
     return {};
 }
 
+std::optional<VmaAllocation> DeviceExtended::allocateVMAMemory(const VkMemoryRequirements& requirements)
+{
+    VmaAllocation allocation{};
+    VmaAllocationCreateInfo allocCreateInfo = {};
+    // VMA_MEMORY_USAGE_AUTO needs to know the resource, the requirements say enough here
+    allocCreateInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    allocCreateInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+    if(vmaAllocateMemory(_globalVMAAllocator,&requirements,&allocCreateInfo,&allocation,nullptr) == VK_SUCCESS)
+    {
+        return allocation;
+    }
+
+    return {};
+}
+
+VkImage DeviceExtended::createUnboundImage(const VkImageCreateInfo& imageInfo)
+{
+    VkImage image = VK_NULL_HANDLE;
+    if(vkCreateImage(device,&imageInfo,nullptr,&image) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create image");
+    }
+    return image;
+}
+
 std::optional<VMAImage>
 DeviceExtended::allocateVMAImageForColorAttachment(VkFormat format, uint32_t width, uint32_t height,
                                                    bool sampled_need) {
@@ -188,309 +228,6 @@ std::optional<VMAImage> DeviceExtended::allocateVMAImageForAttachment(VkImageCre
     return {};
 }
 
-void DeviceExtended::oneTimeUploadSync(void* data, int size,VkBuffer dst)
-{
-    if (size == 0) return;
-
-    auto blockNeededNum = (size + stagingBlockSize - 1) / stagingBlockSize;
-
-    if (stagingBlocks.size()< blockNeededNum)
-    {
-        auto newBlocksNum = blockNeededNum - stagingBlocks.size();
-        for (int i = 0; i < newBlocksNum; i++)
-        {
-            VkBufferCreateInfo bufferCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
-            bufferCreateInfo.size = stagingBlockSize;
-            bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-
-            VmaAllocationCreateInfo allocCreateInfo = {};
-            allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
-            allocCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
-
-            StagingBufferBlock newBlock;
-            auto result = vmaCreateBuffer(_globalVMAAllocator, &bufferCreateInfo, &allocCreateInfo,
-                &newBlock.buffer,
-                &newBlock.allocation,
-                &newBlock.allocationInfo);
-
-            assert(result == VK_SUCCESS);
-            VkMemoryPropertyFlags memPropFlags;
-            vmaGetAllocationMemoryProperties(_globalVMAAllocator, newBlock.allocation, &memPropFlags);
-            assert(memPropFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-            stagingBlocks.emplace_back(newBlock);
-        }
-    }
-
-
-    auto transfer_cmd = this->allocateOnceTransferCommand();
-    vk::CommandBufferBeginInfo beginInfo{};
-    transfer_cmd.begin(beginInfo);
-    for (int i = 0; i < blockNeededNum; i++)
-    {
-        auto copySize = std::min(size - i * stagingBlockSize, stagingBlockSize);
-        memcpy(stagingBlocks[i].allocationInfo.pMappedData, (char*)data + i * stagingBlockSize, copySize);
-        vk::BufferCopy copyRegion{};
-        copyRegion.size = copySize;
-        copyRegion.srcOffset = 0;
-        copyRegion.dstOffset = i * stagingBlockSize;
-        transfer_cmd.copyBuffer(stagingBlocks[i].buffer, dst, copyRegion);
-    }
-    transfer_cmd.end();
-    auto wait = submitOnceTransferCommand(transfer_cmd);
-    wait();
-}
-
-void DeviceExtended::oneTimeUploadSync(const std::vector<BufferCopy>& copies)
-{
-    uint32_t totalSize = 0;
-    for(const auto & copy : copies)
-    {
-        totalSize += copy.size;
-    }
-    if(totalSize == 0) return;
-
-    auto blockNeededNum = (totalSize + stagingBlockSize - 1) / stagingBlockSize;
-
-    if (stagingBlocks.size()< blockNeededNum)
-    {
-        auto newBlocksNum = blockNeededNum - stagingBlocks.size();
-        for (int i = 0; i < newBlocksNum; i++)
-        {
-            VkBufferCreateInfo bufferCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
-            bufferCreateInfo.size = stagingBlockSize;
-            bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-
-            VmaAllocationCreateInfo allocCreateInfo = {};
-            allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
-            allocCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
-
-            StagingBufferBlock newBlock;
-            auto result = vmaCreateBuffer(_globalVMAAllocator, &bufferCreateInfo, &allocCreateInfo,
-                                          &newBlock.buffer,
-                                          &newBlock.allocation,
-                                          &newBlock.allocationInfo);
-
-            assert(result == VK_SUCCESS);
-            VkMemoryPropertyFlags memPropFlags;
-            vmaGetAllocationMemoryProperties(_globalVMAAllocator, newBlock.allocation, &memPropFlags);
-            assert(memPropFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-            stagingBlocks.emplace_back(newBlock);
-        }
-    }
-
-    auto transfer_cmd = this->allocateOnceTransferCommand();
-    vk::CommandBufferBeginInfo beginInfo{};
-    transfer_cmd.begin(beginInfo);
-    int currentCopyBlockIdx = 0;
-    int currentCopyBlockOffset = 0;
-
-    for(const auto & copy : copies)
-    {
-        char * currentSrcPtr = static_cast<char *>(copy.data);
-        auto currentDstOffset = copy.dstOffset;
-        auto currentSrcRemain = copy.size;
-        while(currentSrcRemain > 0)
-        {
-            auto currentCopySize = std::min(currentSrcRemain,stagingBlockSize - currentCopyBlockOffset);
-            char * dst = static_cast<char*>(stagingBlocks[currentCopyBlockIdx].allocationInfo.pMappedData) + currentCopyBlockOffset;
-            memcpy(dst, currentSrcPtr, currentCopySize);
-            vk::BufferCopy copyRegion{};
-            copyRegion.size = currentCopySize;
-            copyRegion.srcOffset = currentCopyBlockOffset;
-            copyRegion.dstOffset = currentDstOffset;
-            transfer_cmd.copyBuffer(stagingBlocks[currentCopyBlockIdx].buffer,copy.dst, copyRegion);
-
-            currentSrcPtr += currentCopySize;
-            currentSrcRemain -= currentCopySize;
-            currentDstOffset += currentCopySize;
-            currentCopyBlockOffset += currentCopySize;
-            assert(currentCopyBlockOffset <= stagingBlockSize);
-            if(currentCopyBlockOffset == stagingBlockSize)
-            {
-                currentCopyBlockIdx ++;
-                currentCopyBlockOffset = 0;
-            }
-        }
-    }
-    transfer_cmd.end();
-    auto wait = submitOnceTransferCommand(transfer_cmd);
-    wait();
-}
-
-void DeviceExtended::oneTimeUploadSync(void* data, VkImage dst, uint32_t channels, VkImageCreateInfo imgInfo) {
-    auto size = imgInfo.extent.width * imgInfo.extent.height * channels;
-    if (size == 0) return;
-
-    if(imageStagingBuffer.buffer == VK_NULL_HANDLE)
-    {
-        VkBufferCreateInfo bufferCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
-        bufferCreateInfo.size = imageStagingBufferSize;
-        bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-
-        VmaAllocationCreateInfo allocCreateInfo = {};
-        allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
-        allocCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
-
-        auto result = vmaCreateBuffer(_globalVMAAllocator, &bufferCreateInfo, &allocCreateInfo,
-                                      &imageStagingBuffer.buffer,
-                                      &imageStagingBuffer.allocation,
-                                      &imageStagingBuffer.allocationInfo);
-
-        assert(result == VK_SUCCESS);
-        VkMemoryPropertyFlags memPropFlags;
-        vmaGetAllocationMemoryProperties(_globalVMAAllocator, imageStagingBuffer.allocation, &memPropFlags);
-        assert(memPropFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-    }
-
-    /*
-     * Different from copying between buffers, it's trickier to copy multiple buffer blocks into one image.
-     * So we just enlarge the buffer once it's no longer able to contain the whole data
-     */
-
-    if(size > imageStagingBufferSize)
-    {
-        deAllocateBuffer(imageStagingBuffer.buffer,imageStagingBuffer.allocation);
-
-        VkBufferCreateInfo bufferCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
-        bufferCreateInfo.size = size;
-        bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-
-        VmaAllocationCreateInfo allocCreateInfo = {};
-        allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
-        allocCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
-
-        auto result = vmaCreateBuffer(_globalVMAAllocator, &bufferCreateInfo, &allocCreateInfo,
-                                      &imageStagingBuffer.buffer,
-                                      &imageStagingBuffer.allocation,
-                                      &imageStagingBuffer.allocationInfo);
-
-        assert(result == VK_SUCCESS);
-        VkMemoryPropertyFlags memPropFlags;
-        vmaGetAllocationMemoryProperties(_globalVMAAllocator, imageStagingBuffer.allocation, &memPropFlags);
-        assert(memPropFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-        imageStagingBufferSize = size;
-    }
-
-    memcpy(imageStagingBuffer.allocationInfo.pMappedData, data, size);
-
-    vk::ImageSubresourceRange subresourceRange{};
-    subresourceRange.setAspectMask(vk::ImageAspectFlagBits::eColor);
-    subresourceRange.setBaseMipLevel(0);
-    subresourceRange.setLevelCount(imgInfo.mipLevels);
-    subresourceRange.setBaseArrayLayer(0);
-    subresourceRange.setLayerCount(1);
-
-    auto transfer_cmd = this->allocateOnceTransferCommand();
-    vk::CommandBufferBeginInfo beginInfo{};
-    transfer_cmd.begin(beginInfo);
-    vk::ImageMemoryBarrier barrier; // Undefined -> TransferDstOptimal for all mipmap levels
-    barrier.setSrcAccessMask(vk::AccessFlagBits::eNone);
-    barrier.setDstAccessMask(vk::AccessFlagBits::eTransferWrite);
-    barrier.setOldLayout(vk::ImageLayout::eUndefined);
-    barrier.setNewLayout(vk::ImageLayout::eTransferDstOptimal);
-    barrier.setSrcQueueFamilyIndex(vk::QueueFamilyIgnored);
-    barrier.setDstQueueFamilyIndex(vk::QueueFamilyIgnored);
-    barrier.setImage(dst);
-    barrier.setSubresourceRange(subresourceRange);
-    transfer_cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,vk::PipelineStageFlagBits::eTransfer,{},0,{},barrier);
-
-    vk::ImageSubresourceLayers subresourceLayers;
-    subresourceLayers.setAspectMask(subresourceRange.aspectMask);
-    subresourceLayers.setMipLevel(0);
-    subresourceLayers.setLayerCount(1);
-    subresourceLayers.setBaseArrayLayer(0);
-
-    vk::BufferImageCopy region{};
-    region.setImageSubresource(subresourceLayers);
-    region.setBufferImageHeight(0);
-    region.setBufferOffset(0);
-    region.setBufferRowLength(0);
-    region.setImageOffset({0,0,0});
-    region.setImageExtent(imgInfo.extent);
-
-    transfer_cmd.copyBufferToImage(imageStagingBuffer.buffer,dst,vk::ImageLayout::eTransferDstOptimal,region);
-
-    vk::ImageMemoryBarrier barrier2; // TransferDstOptimal -> ShaderReadOnlyOptimal
-    barrier2.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite);
-    barrier2.setDstAccessMask(vk::AccessFlagBits::eNone);
-    barrier2.setOldLayout(vk::ImageLayout::eTransferDstOptimal);
-    barrier2.setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
-    barrier2.setSrcQueueFamilyIndex(vk::QueueFamilyIgnored);
-    barrier2.setDstQueueFamilyIndex(vk::QueueFamilyIgnored);
-    barrier2.setImage(dst);
-    barrier2.setSubresourceRange(subresourceRange);
-    transfer_cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eNone, {}, 0, {}, barrier2);
-
-    transfer_cmd.end();
-    auto wait = submitOnceTransferCommand(transfer_cmd);
-    wait();
-
-    if (imgInfo.mipLevels <= 1)
-    {
-        return;
-    }
-    
-    auto blit_cmd = this->allocateOnceGraphicsCommand();
-    blit_cmd.begin(beginInfo);
-
-    vk::ImageMemoryBarrier interBarrier{};
-    interBarrier.setImage(dst);
-    interBarrier.setSrcQueueFamilyIndex(vk::QueueFamilyIgnored);
-    interBarrier.setDstQueueFamilyIndex(vk::QueueFamilyIgnored);
-    interBarrier.subresourceRange.setAspectMask(vk::ImageAspectFlagBits::eColor);
-    interBarrier.subresourceRange.setBaseArrayLayer(0);
-    interBarrier.subresourceRange.setLayerCount(1);
-    interBarrier.subresourceRange.setLevelCount(1);
-
-    int32_t mipWidth = imgInfo.extent.width;
-    int32_t mipHeight = imgInfo.extent.height;
-    for (uint32_t level = 1; level < imgInfo.mipLevels; level++)
-    {
-        interBarrier.subresourceRange.setBaseMipLevel(level - 1); // Transfer level i - 1 TransferDstOptimal -> TransferSrcOptimal
-        interBarrier.setOldLayout(vk::ImageLayout::eTransferDstOptimal);
-        interBarrier.setNewLayout(vk::ImageLayout::eTransferSrcOptimal);
-        interBarrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite);
-        interBarrier.setDstAccessMask(vk::AccessFlagBits::eTransferRead);
-
-        vk::ImageBlit blitRegion{};
-        blitRegion.setSrcOffsets({ vk::Offset3D{0,0,0},vk::Offset3D{mipWidth,mipHeight,1} });
-        blitRegion.srcSubresource.setMipLevel(level - 1);
-        blitRegion.srcSubresource.setAspectMask(vk::ImageAspectFlagBits::eColor);
-        blitRegion.srcSubresource.setBaseArrayLayer(0);
-        blitRegion.srcSubresource.setLayerCount(1);
-        blitRegion.setDstOffsets({ vk::Offset3D{0,0,0},vk::Offset3D{mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1,1} });
-        blitRegion.dstSubresource.setMipLevel(level);
-        blitRegion.dstSubresource.setAspectMask(vk::ImageAspectFlagBits::eColor);
-        blitRegion.dstSubresource.setBaseArrayLayer(0);
-        blitRegion.dstSubresource.setLayerCount(1);
-        blit_cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, {}, 0, {}, interBarrier);
-        blit_cmd.blitImage(dst, vk::ImageLayout::eTransferSrcOptimal, dst, vk::ImageLayout::eTransferDstOptimal, blitRegion, vk::Filter::eLinear);
-
-        //Transfer level i - 1 TransferSrcOptimal -> ShaderReadOnlyOptimal
-        interBarrier.setOldLayout(vk::ImageLayout::eTransferSrcOptimal);
-        interBarrier.setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
-        interBarrier.setSrcAccessMask(vk::AccessFlagBits::eTransferRead);
-        interBarrier.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
-        blit_cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, {}, 0, {}, interBarrier);
-
-        if (mipWidth > 1) mipWidth /= 2;
-        if (mipHeight > 1) mipHeight /= 2;
-    }
-
-    //Transfer the last level TransferDstOptimal -> ShaderReadOnlyOptimal
-    interBarrier.subresourceRange.baseMipLevel = imgInfo.mipLevels - 1;
-    interBarrier.setOldLayout(vk::ImageLayout::eTransferDstOptimal);
-    interBarrier.setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
-    interBarrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite);
-    interBarrier.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
-
-    blit_cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, {}, 0, {}, interBarrier);
-    blit_cmd.end();
-    auto wait2 = submitOnceGraphicsCommand(blit_cmd);
-    wait2();
-    return;
-}
-
 void DeviceExtended::updateDescriptorSetUniformBuffer(vk::DescriptorSet dstSet, uint32_t dstBinding, vk::Buffer buffer,
                                                       vk::DeviceSize range, vk::DeviceSize offset) {
     vk::WriteDescriptorSet write;
@@ -601,13 +338,28 @@ VulkanGraphicsPipeline VulkanGraphicsPipelineBuilder::build() const {
     assert(_renderPass!=VK_NULL_HANDLE);
 
     vk::GraphicsPipelineCreateInfo createInfo{};
-    std::array<vk::PipelineShaderStageCreateInfo,2> stages{_vs->getStageCreateInfo(),_fs->getStageCreateInfo()};
+    std::vector<vk::PipelineShaderStageCreateInfo> stages;
+    if(_ms != nullptr)
+    {
+        if(_ts != nullptr)
+        {
+            stages.push_back(_ts->getStageCreateInfo());
+        }
+        stages.push_back(_ms->getStageCreateInfo());
+    }else{
+        stages.push_back(_vs->getStageCreateInfo());
+    }
+    stages.push_back(_fs->getStageCreateInfo());
     createInfo.setStages(stages);
     createInfo.setRenderPass(_renderPass);
     createInfo.setLayout(_pipelineLayout);
     auto vis = _vertexInputInfo.getCreateInfo();
-    createInfo.setPVertexInputState(&vis);
-    createInfo.setPInputAssemblyState(&_InputAssemblyStateInfo);
+    // mesh shaders fetch their own vertices
+    if(_ms == nullptr)
+    {
+        createInfo.setPVertexInputState(&vis);
+        createInfo.setPInputAssemblyState(&_InputAssemblyStateInfo);
+    }
     createInfo.setPColorBlendState(&_ColorBlendStateInfo);
     createInfo.setPDepthStencilState(&_DepthStencilStateInfo);
     createInfo.setPRasterizationState(&_RasterizationStateInfo);
@@ -615,7 +367,7 @@ VulkanGraphicsPipeline VulkanGraphicsPipelineBuilder::build() const {
     createInfo.setPViewportState(&_ViewportStateInfo);
     createInfo.setPDynamicState(&_DynamicStateInfo);
 
-    auto newPipeline = _device.createGraphicsPipeline(VK_NULL_HANDLE,createInfo);
+    auto newPipeline = _device.createGraphicsPipeline(PipelineCache::getInstance().getHandle(),createInfo);
     if(newPipeline.result != vk::Result::eSuccess)
     {
         throw std::runtime_error("Failed to create pipeline");
@@ -654,7 +406,7 @@ VulkanComputePipeline VulkanComputePipelineBuilder::build() const {
     createInfo.setStage(_cs->getStageCreateInfo());
     createInfo.setLayout(_pipelineLayout);
   
-    auto newPipeline = _device.createComputePipeline(VK_NULL_HANDLE, createInfo);
+    auto newPipeline = _device.createComputePipeline(PipelineCache::getInstance().getHandle(), createInfo);
     if (newPipeline.result != vk::Result::eSuccess)
     {
         throw std::runtime_error("Failed to create pipeline");
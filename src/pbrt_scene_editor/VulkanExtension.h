@@ -10,6 +10,7 @@
 #include <optional>
 #include <iostream>
 #include <variant>
+#include <algorithm>
 
 struct SwapchainExtended : vkb::Swapchain
 {
@@ -123,6 +124,29 @@ struct DeviceExtended : vkb::Device, vk::Device
         vmaDestroyImage(_globalVMAAllocator,image,allocation);
     }
 
+    /*
+     * Memory several images get bound to, images living at different times of a frame can share it.
+     * Such images are destroyed with destroyImage, the memory with deAllocateMemory once they are all gone.
+     */
+    std::optional<VmaAllocation> allocateVMAMemory(const VkMemoryRequirements& requirements);
+
+    VkImage createUnboundImage(const VkImageCreateInfo& imageInfo);
+
+    void bindVMAImageMemory(VmaAllocation allocation, VkImage image)
+    {
+        vmaBindImageMemory(_globalVMAAllocator,allocation,image);
+    }
+
+    void destroyImage(VkImage image)
+    {
+        vkDestroyImage(device,image,nullptr);
+    }
+
+    void deAllocateMemory(VmaAllocation allocation)
+    {
+        vmaFreeMemory(_globalVMAAllocator,allocation);
+    }
+
     void setSwapchain(vkb::Swapchain swapchain) {
         _swapchain = swapchain;
     }
@@ -172,21 +196,13 @@ struct DeviceExtended : vkb::Device, vk::Device
         };
     }
 
-    /*
-     * Upload one-time resource (vertex(index) buffer, texture buffer), in blocking way.
-     * Not thread-safe! (staging buffer is not thread-safe).
-     * */
-    void oneTimeUploadSync(void* data, int size,VkBuffer dst);
-
+    // Uploads go through UploadScheduler
     struct BufferCopy{
         void * data;
         uint32_t size;
         uint32_t dstOffset;
         VkBuffer dst;
     };
-    void oneTimeUploadSync(const std::vector<BufferCopy>&);
-
-    void oneTimeUploadSync(void* data, VkImage dst, uint32_t channels,VkImageCreateInfo imgInfo);
 
     template<class ObjectT>
     auto setObjectDebugName(ObjectT object,const char* name) const
@@ -259,7 +275,7 @@ struct DeviceExtended : vkb::Device, vk::Device
 
     void updateDescriptorSetStorageBuffer(vk::DescriptorSet dstSet, uint32_t dstBinding, vk::Buffer buffer)
     {
-        updateDescriptorSetStorageBuffer(dstSet, 0, buffer, vk::WholeSize, 0);
+        updateDescriptorSetStorageBuffer(dstSet, dstBinding, buffer, vk::WholeSize, 0);
     }
 
     void updateDescriptorSetCombinedImageSampler(vk::DescriptorSet dstSet, uint32_t dstBinding,vk::ImageView imgView,vk::Sampler sampler);
@@ -415,21 +431,12 @@ struct DeviceExtended : vkb::Device, vk::Device
     SwapchainExtended _swapchain;
     VmaAllocator _globalVMAAllocator;
 
-    struct StagingBufferBlock
-    {
-        VkBuffer buffer = VK_NULL_HANDLE;
-        VmaAllocation allocation;
-        VmaAllocationInfo allocationInfo;
-    };
-    uint32_t stagingBlockSize = 4 * 1024 * 1024; // 4MB
-    //std::tuple<VkBuffer,VmaAllocation,VmaAllocationInfo> stagingBuffer{};
-    //VMABuffer stagingBuffer{};
-    //VmaAllocationInfo stagingBufferAllocationInfo{};
-    std::vector<StagingBufferBlock> stagingBlocks;
-
-    uint32_t imageStagingBufferSize = 4096 * 4096 * 4;
-    StagingBufferBlock imageStagingBuffer;
-    
+    // Optional capabilities, queried once when the device is created
+    bool drawIndirectCountSupported = false;
+    bool drawIndirectFirstInstanceSupported = false;
+    bool subgroupBallotSupported = false;
+    bool meshShaderSupported = false;
+
 private:
     vk::CommandPool onceGraphicsCommandPool = VK_NULL_HANDLE;
     vk::CommandPool onceTransferCommandPool = VK_NULL_HANDLE;
@@ -510,7 +517,7 @@ struct LinearCachedCommandAllocator {
     {
         if(_current_secondary_idx < allocatedSecondaryCommandBuffers.size())
         {
-            return allocatedSecondaryCommandBuffers[_current_primary_idx++];
+            return allocatedSecondaryCommandBuffers[_current_secondary_idx++];
         }
 
         auto cmdBuf = _pool.allocateCommandBuffer(vk::CommandBufferLevel::eSecondary);
@@ -590,22 +597,154 @@ struct DescriptorSetLayoutExtended
         return equalsTo(info.pBindings,info.bindingCount);
     }
 
+    // FNV-1a over what equalsTo compares, equal layouts hash the same. Different ones may too, check with equalsTo
+    static uint64_t hash(const vk::DescriptorSetLayoutBinding * pBindings, int count)
+    {
+        uint64_t h = 14695981039346656037ull;
+        auto mix = [&h](uint64_t value) {
+            h ^= value;
+            h *= 1099511628211ull;
+        };
+        for(int i = 0; i < count; i++)
+        {
+            mix(pBindings[i].binding);
+            mix(static_cast<uint64_t>(pBindings[i].descriptorType));
+            mix(pBindings[i].descriptorCount);
+            mix(static_cast<uint64_t>(static_cast<VkShaderStageFlags>(pBindings[i].stageFlags)));
+        }
+        return h;
+    }
+
+    uint64_t hash() const
+    {
+        return hash(bindings.get(), bindingCount);
+    }
+
+    // descriptors of a single set, one entry per type
+    std::vector<vk::DescriptorPoolSize> getPoolSizes() const
+    {
+        std::vector<vk::DescriptorPoolSize> poolSizes;
+        for(int i = 0; i < bindingCount; i++)
+        {
+            auto found = std::find_if(poolSizes.begin(), poolSizes.end(), [&](const vk::DescriptorPoolSize& size) {
+                return size.type == bindings[i].descriptorType;
+            });
+            if(found == poolSizes.end())
+            {
+                poolSizes.emplace_back(bindings[i].descriptorType, bindings[i].descriptorCount);
+            }
+            else {
+                found->descriptorCount += bindings[i].descriptorCount;
+            }
+        }
+        return poolSizes;
+    }
+
     vk::Device _device;
     vk::DescriptorSetLayout _layout = VK_NULL_HANDLE;
     std::shared_ptr<vk::DescriptorSetLayoutBinding[]> bindings;
     int bindingCount = 0;
 };
 
+/*
+ * Allocates the sets of one layout from a chain of pools sized from the descriptor counts of the layout.
+ * When the last pool runs out another one twice as large is appended, so a scene never exhausts it.
+ * Sets aren't freed one by one, reset() recycles all of them once none of them is in use.
+ */
 struct LinearCachedDescriptorAllocator
 {
+    LinearCachedDescriptorAllocator() = default;
+
+    LinearCachedDescriptorAllocator(DeviceExtended* device, const DescriptorSetLayoutExtended& layout, uint32_t initialSetsPerPool = 8)
+        : backendDevice(device), setLayout(layout._layout), setPoolSizes(layout.getPoolSizes()), nextPoolSets(std::max(initialSetsPerPool, 1u))
+    {
+
+    }
+
     vk::DescriptorSet allocateSingle()
     {
-        return vk::DescriptorSet{};
+        while(true)
+        {
+            if(currentPool == pools.size())
+            {
+                createPool();
+            }
+            vk::DescriptorSetAllocateInfo allocateInfo{};
+            allocateInfo.setDescriptorPool(pools[currentPool]);
+            allocateInfo.setSetLayouts(setLayout);
+            try
+            {
+                auto sets = backendDevice->allocateDescriptorSets(allocateInfo);
+                return sets[0];
+            }
+            catch(const vk::OutOfPoolMemoryError&)
+            {
+            }
+            catch(const vk::FragmentedPoolError&)
+            {
+            }
+            currentPool++;
+        }
     }
 
+    std::vector<vk::DescriptorSet> allocate(uint32_t count)
+    {
+        std::vector<vk::DescriptorSet> sets;
+        sets.reserve(count);
+        for(uint32_t i = 0; i < count; i++)
+        {
+            sets.push_back(allocateSingle());
+        }
+        return sets;
+    }
+
+    void reset()
+    {
+        for(auto pool : pools)
+        {
+            backendDevice->resetDescriptorPool(pool);
+        }
+        currentPool = 0;
+    }
+
+    void destroy()
+    {
+        for(auto pool : pools)
+        {
+            backendDevice->destroyDescriptorPool(pool);
+        }
+        pools.clear();
+        currentPool = 0;
+    }
+
+    uint32_t getPoolCount() const
+    {
+        return static_cast<uint32_t>(pools.size());
+    }
+
+    DeviceExtended* backendDevice = nullptr;
     vk::DescriptorSetLayout setLayout;
+    // the descriptors of one set
+    std::vector<vk::DescriptorPoolSize> setPoolSizes;
     std::vector<vk::DescriptorPool> pools;
-    DeviceExtended* backendDevice;
+
+private:
+    void createPool()
+    {
+        auto poolSizes = setPoolSizes;
+        for(auto& poolSize : poolSizes)
+        {
+            poolSize.descriptorCount *= nextPoolSets;
+        }
+        vk::DescriptorPoolCreateInfo poolCreateInfo{};
+        poolCreateInfo.setPoolSizes(poolSizes);
+        poolCreateInfo.setMaxSets(nextPoolSets);
+        pools.push_back(backendDevice->createDescriptorPool(poolCreateInfo));
+        nextPoolSets *= 2;
+    }
+
+    uint32_t nextPoolSets = 8;
+    uint32_t currentPool = 0;
 };
 
 using VulkanDescriptorResourceInfo = std::variant<vk::DescriptorImageInfo, vk::DescriptorBufferInfo, vk::WriteDescriptorSetAccelerationStructureKHR>;
@@ -755,6 +894,8 @@ struct VulkanPipelineVertexInputStateInfo
 struct VertexShader;
 struct FragmentShader;
 struct ComputeShader;
+struct TaskShader;
+struct MeshShader;
 
 #define VK_GRAPHICS_PIPELINE_STATE_DEF_GETTER(state)    private: vk::Pipeline##state##StateCreateInfo _##state##StateInfo{}; \
                                                         public: auto get##state##Info() const{ \
@@ -860,6 +1001,52 @@ private:
     vk::PipelineColorBlendAttachmentState defaultAttachmentState{};
 };
 
+/*
+ * What tells the graphics pipelines of one pass apart: shader variants, vertex input, render pass and layout.
+ * Fixed function state belongs to the pass, so it isn't part of the key.
+ */
+struct GraphicsPipelineKey
+{
+    std::string vsUUID;
+    std::string fsUUID;
+    VulkanPipelineVertexInputStateInfo vertexInputStateInfo;
+    vk::RenderPass renderPass = VK_NULL_HANDLE;
+    vk::PipelineLayout pipelineLayout = VK_NULL_HANDLE;
+
+    bool operator==(const GraphicsPipelineKey& other) const
+    {
+        return vsUUID == other.vsUUID && fsUUID == other.fsUUID &&
+               vertexInputStateInfo == other.vertexInputStateInfo &&
+               renderPass == other.renderPass && pipelineLayout == other.pipelineLayout;
+    }
+};
+
+struct GraphicsPipelineKeyHash
+{
+    size_t operator()(const GraphicsPipelineKey& key) const
+    {
+        // FNV-1a over the shader names and the used part of the vertex input arrays
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&hash](const void* data, size_t size) {
+            auto* bytes = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < size; i++)
+            {
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+            }
+        };
+        const auto& vertexInput = key.vertexInputStateInfo;
+        mix(key.vsUUID.data(), key.vsUUID.size());
+        mix(key.fsUUID.data(), key.fsUUID.size());
+        mix(vertexInput.bindings, vertexInput.bindingCount * sizeof(vk::VertexInputBindingDescription));
+        mix(vertexInput.attributes, vertexInput.attributeCount * sizeof(vk::VertexInputAttributeDescription));
+        VkRenderPass renderPass = key.renderPass;
+        VkPipelineLayout pipelineLayout = key.pipelineLayout;
+        mix(&renderPass, sizeof(renderPass));
+        mix(&pipelineLayout, sizeof(pipelineLayout));
+        return static_cast<size_t>(hash);
+    }
+};
+
 /*
  * The reason I use a pipeline builder is that I want to
  * keep the immutability of PSO. In other word, the setters are
@@ -926,6 +1113,24 @@ struct VulkanGraphicsPipelineBuilder
         (setStateInfo(std::move(args)), ...);
     }
 
+    /*
+     * Mesh shading pipeline, there is no vertex input nor input assembly. The task shader is optional.
+     */
+    template<typename... Args>
+    VulkanGraphicsPipelineBuilder(vk::Device device,
+                                  TaskShader* ts,
+                                  MeshShader* ms,
+                                  FragmentShader* fs,
+                                  vk::RenderPass renderPass,
+                                  vk::PipelineLayout pipelineLayout,
+                                  Args... args)
+                                  : VulkanGraphicsPipelineBuilder(device,static_cast<VertexShader*>(nullptr),fs,vk::PipelineVertexInputStateCreateInfo{},renderPass,pipelineLayout)
+    {
+        _ts = ts;
+        _ms = ms;
+        (setStateInfo(std::move(args)), ...);
+    }
+
     /*
      *  Make sure you have set all desired state before calling build
      */
@@ -949,6 +1154,8 @@ private:
     vk::Device _device;
     VertexShader* _vs;
     FragmentShader* _fs;
+    TaskShader* _ts = nullptr;
+    MeshShader* _ms = nullptr;
     VulkanPipelineVertexInputStateInfo _vertexInputInfo;
     vk::RenderPass _renderPass;
     vk::PipelineLayout _pipelineLayout;
@@ -18,6 +18,7 @@
 
 #include "FrameGraph.hpp"
 #include "PassDefinition.h"
+#include "PipelineCache.hpp"
 
 #include <iostream>
 #include <algorithm>
@@ -60,7 +61,7 @@ void EditorGUI::renderInit(vk::RenderPass guiPass)
 	init_info.PhysicalDevice = backendDevice->physical_device;
 	init_info.Device = backendDevice->device;
 	init_info.Queue = backendDevice->get_queue(vkb::QueueType::graphics).value();
-	init_info.PipelineCache = VK_NULL_HANDLE;
+	init_info.PipelineCache = PipelineCache::getInstance().getHandle();
 	init_info.DescriptorPool = descriptorPool;
 	init_info.MinImageCount = NUM_MIN_SWAPCHAIN_IMAGE;
 	init_info.ImageCount = NUM_MIN_SWAPCHAIN_IMAGE;
@@ -245,6 +246,11 @@ void EditorGUI::showMenuShading()
 	if (ImGui::BeginMenu("Effects")) // <-- Append!
 	{
 		ImGui::Checkbox("WireFrame", &viewer->enableWireFrame);
+		ImGui::Checkbox("Occlusion Culling", &viewer->enableOcclusionCulling);
+		ImGui::Checkbox("Cluster Culling", &viewer->enableClusterCulling);
+		ImGui::Checkbox("Cluster Back Face Culling", &viewer->enableClusterConeCulling);
+		ImGui::Checkbox("LOD Selection", &viewer->enableLodSelection);
+		ImGui::SliderFloat("LOD Pixel Error", &viewer->lodPixelError, 0.25f, 16.0f);
 		static bool enableAO;
 		if (ImGui::BeginMenu("AO"))
 		{
@@ -257,6 +263,29 @@ void EditorGUI::showMenuShading()
 
 		ImGui::EndMenu();
 	}
+	if (ImGui::BeginMenu("Culling Statistics"))
+	{
+		const auto& statistics = viewer->getCullStatistics();
+		ImGui::Text("Frustum culled : %u", statistics.frustumCulled);
+		ImGui::Text("Occlusion culled : %u", statistics.occlusionCulled);
+		ImGui::Text("Drawn early : %u", statistics.drawnEarly);
+		ImGui::Text("Drawn late : %u", statistics.drawnLate);
+		ImGui::Text("Clusters culled : %u", statistics.clustersCulled);
+		ImGui::Text("Clusters drawn : %u", statistics.clustersDrawn);
+		for (uint32_t lod = 0; lod < renderScene::InstanceCullDrawCommands::MAX_LODS; lod++)
+		{
+			ImGui::Text("Drawn at LOD %u : %u", lod, statistics.drawnPerLod[lod]);
+		}
+		ImGui::EndMenu();
+	}
+	if (ImGui::BeginMenu("Draw Packet Statistics"))
+	{
+		auto statistics = viewer->getDrawPacketStatistics();
+		ImGui::Text("Packets : %u", statistics.packets);
+		ImGui::Text("Rebuilds this frame : %u", statistics.rebuilds);
+		ImGui::Text("State changes this frame : %u", statistics.stateChanges);
+		ImGui::EndMenu();
+	}
 	static int e = 4;
 	ImGui::RadioButton("Flat", &e, 0);
 	ImGui::RadioButton("MeshID", &e, 1);
@@ -264,7 +293,8 @@ void EditorGUI::showMenuShading()
 	ImGui::RadioButton("World Normal", &e, 3);
 	ImGui::RadioButton("UV", &e, 4);
 	ImGui::RadioButton("Albedo", &e, 5);
-	ImGui::RadioButton("Final", &e, 6);
+	ImGui::RadioButton("LOD", &e, 6);
+	ImGui::RadioButton("Final", &e, 7);
 
 	switch (e)
 	{
@@ -287,6 +317,9 @@ void EditorGUI::showMenuShading()
 		viewer->currenShadingMode = SceneViewer::ShadingMode::ALBEDO;
 		break;
 	case 6:
+		viewer->currenShadingMode = SceneViewer::ShadingMode::LOD;
+		break;
+	case 7:
 		viewer->currenShadingMode = SceneViewer::ShadingMode::FINAL;
 		break;
 	default:
@@ -5,6 +5,8 @@
 #include <vulkan/vulkan.hpp>
 #include <iostream>
 #include <memory>
+#include <array>
+#include <vector>
 
 #include "window.h"
 #include "editorGUI.h"
@@ -15,6 +17,9 @@ static char const * EngineName = "";
 
 #include "VulkanExtension.h"
 #include "ShaderManager.h"
+#include "UploadScheduler.hpp"
+#include "PipelineCache.hpp"
+#include "BindlessHeap.hpp"
 
 std::shared_ptr<DeviceExtended> device;
 
@@ -54,14 +59,40 @@ void drawFrame()
 
     auto frameGraph_command = frame->recordMainQueueCommands(imageIdx);
 
-    vk::CommandBuffer commandBuffers[] = { frameGraph_command };
+    // Uploads go first: queue family acquires for the resources used by this frame and staged buffer updates.
+    // The transfer timeline is only waited on when the frame uses a resource that is still in flight.
+    auto uploads = UploadScheduler::getInstance().prepareGraphicsSubmit();
+
+    std::vector<vk::CommandBuffer> commandBuffers;
+    if (uploads.cmd)
+    {
+        commandBuffers.push_back(uploads.cmd);
+    }
+    commandBuffers.push_back(frameGraph_command);
+
+    std::vector<vk::Semaphore> waitSemaphores{ frame->imageAvailableSemaphore };
+    std::vector<vk::PipelineStageFlags> waitStages{ vk::PipelineStageFlagBits::eColorAttachmentOutput };
+    std::vector<uint64_t> waitValues{ 0 };
+    if (uploads.transferWaitValue != 0)
+    {
+        waitSemaphores.push_back(uploads.transferTimeline);
+        waitStages.push_back(vk::PipelineStageFlagBits::eAllCommands);
+        waitValues.push_back(uploads.transferWaitValue);
+    }
+    std::array<vk::Semaphore, 2> signalSemaphores{ frame->renderFinishSemaphore, uploads.graphicsTimeline };
+    std::array<uint64_t, 2> signalValues{ 0, uploads.graphicsSignalValue };
+
+    // values of binary semaphores are ignored
+    vk::TimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.setWaitSemaphoreValues(waitValues);
+    timelineInfo.setSignalSemaphoreValues(signalValues);
 
     vk::SubmitInfo submitInfo{};
-    submitInfo.setWaitSemaphores(frame->imageAvailableSemaphore);
-    vk::PipelineStageFlags waitStages[] = { vk::PipelineStageFlagBits::eColorAttachmentOutput };
+    submitInfo.setWaitSemaphores(waitSemaphores);
     submitInfo.setWaitDstStageMask(waitStages);
     submitInfo.setCommandBuffers(commandBuffers);
-    submitInfo.setSignalSemaphores(frame->renderFinishSemaphore);
+    submitInfo.setSignalSemaphores(signalSemaphores);
+    submitInfo.setPNext(&timelineInfo);
 
     // All submitted commands in a submitInfo won't start execution until corresponding wait semaphores have been signaled.
     // Once all submitted commands in a submitInfo complete, corresponding signalSemaphores will be signaled.
@@ -134,6 +165,12 @@ int main( int /*argc*/, char ** /*argv*/ )
             .set_minimum_instance_version(1,3)
             .enable_extension(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME)
             .enable_extension(VK_EXT_DEBUG_UTILS_EXTENSION_NAME)
+#if EDITOR_SYNC_VALIDATION
+            // the hazards between the passes are reported through the debug messenger
+            .request_validation_layers()
+            .use_default_debug_messenger()
+            .add_validation_feature_enable(VK_VALIDATION_FEATURE_ENABLE_SYNCHRONIZATION_VALIDATION_EXT)
+#endif
             //.request_validation_layers()
             //.use_default_debug_messenger()
             .build();
@@ -159,6 +196,9 @@ int main( int /*argc*/, char ** /*argv*/ )
         descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
         descriptorIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
         descriptorIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+        // the texture array of BindlessHeap gets new textures while earlier frames still read it
+        descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        descriptorIndexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
 
         VkPhysicalDeviceExtendedDynamicStateFeaturesEXT extendedDynamicStateFeatures{};
         extendedDynamicStateFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
@@ -168,15 +208,25 @@ int main( int /*argc*/, char ** /*argv*/ )
         synchronization2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
         synchronization2Features.synchronization2 = true;
 
+        VkPhysicalDeviceTimelineSemaphoreFeatures timelineSemaphoreFeatures{};
+        timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+        timelineSemaphoreFeatures.timelineSemaphore = VK_TRUE;
+
+        // hzbBuild.comp writes the level of its storage image array selected by a loop counter
+        VkPhysicalDeviceFeatures requiredFeatures{};
+        requiredFeatures.shaderStorageImageArrayDynamicIndexing = VK_TRUE;
+
         auto phy_dev = phyDevSelector
             .set_surface(surface)
             .set_minimum_version(1, 2)
+            .set_required_features(requiredFeatures)
             .prefer_gpu_device_type(vkb::PreferredDeviceType::discrete)
             .add_required_extensions(required_device_extension)
             .add_required_extension_features(deviceAddressFeaturesKhr)
             .add_required_extension_features(descriptorIndexingFeatures)
             .add_required_extension_features(extendedDynamicStateFeatures)
             .add_required_extension_features(synchronization2Features)
+            .add_required_extension_features(timelineSemaphoreFeatures)
             .select();
 
             if(!phy_dev)
@@ -184,8 +234,35 @@ int main( int /*argc*/, char ** /*argv*/ )
                 throw std::runtime_error("Failed to find suitable physicalDevice. Reason: " + phy_dev.error().message());
             }
 
+        // optional, culled instances are drawn with plain indirect draws without it
+        phy_dev.value().enable_extension_if_present(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+
+        // optional, the indirect cluster draws address their instance with firstInstance
+        VkPhysicalDeviceFeatures supportedFeatures{};
+        vkGetPhysicalDeviceFeatures(phy_dev.value().physical_device, &supportedFeatures);
+        phy_dev.value().features.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+
+        // optional, meshlets are culled by a task shader and drawn by a mesh shader with it
+        VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures{};
+        meshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+        if (phy_dev.value().enable_extension_if_present(VK_EXT_MESH_SHADER_EXTENSION_NAME))
+        {
+            VkPhysicalDeviceFeatures2 features2{};
+            features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            features2.pNext = &meshShaderFeatures;
+            vkGetPhysicalDeviceFeatures2(phy_dev.value().physical_device, &features2);
+            // only the task and mesh stages are used
+            meshShaderFeatures.pNext = nullptr;
+            meshShaderFeatures.multiviewMeshShader = VK_FALSE;
+            meshShaderFeatures.primitiveFragmentShadingRateMeshShader = VK_FALSE;
+            meshShaderFeatures.meshShaderQueries = VK_FALSE;
+        }
 
         vkb::DeviceBuilder deviceBuilder{ phy_dev.value() };
+        if (meshShaderFeatures.taskShader && meshShaderFeatures.meshShader)
+        {
+            deviceBuilder.add_pNext(&meshShaderFeatures);
+        }
         auto device_optional = deviceBuilder.build();
 
         if (!device_optional)
@@ -214,6 +291,9 @@ int main( int /*argc*/, char ** /*argv*/ )
     }
 
     FrameCoordinator::getInstance().init(device.get(), FRAME_IN_FLIGHT);
+    UploadScheduler::getInstance().init(device.get());
+    BindlessHeap::getInstance().init(device.get(), FRAME_IN_FLIGHT);
+    PipelineCache::getInstance().init(device.get());
 
     viewer.init(device);
     editorGUI.init(window.getRawWindowHandle(), device);
@@ -226,6 +306,7 @@ int main( int /*argc*/, char ** /*argv*/ )
     //main loop
     while (!window.shouldClose()) {
         FrameCoordinator::getInstance().waitForCurrentFrame();
+        BindlessHeap::getInstance().beginFrame();
         window.pollEvents();
         double current_time = glfwGetTime();
         delta_time = current_time - last_time;
@@ -236,5 +317,8 @@ int main( int /*argc*/, char ** /*argv*/ )
     }
     
     device->waitIdle();
+    PipelineCache::getInstance().destroy();
+    BindlessHeap::getInstance().destroy();
+    UploadScheduler::getInstance().destroy();
     return 0;
 }
\ No newline at end of file
@@ -6,7 +6,10 @@
 #define PBRTEDITOR_SCENE_H
 
 #include <string>
+#include <string_view>
 #include <variant>
+#include <vector>
+#include <limits>
 
 #include "Reflection.h"
 
@@ -39,21 +42,160 @@ struct normal3{
 };
 struct spectrum{
     spectrum(){};
-    spectrum(float f){};
+    spectrum(float f) : constant(f){};
+    float constant = 0;
+    std::vector<float> samples; // interleaved (wavelength, value) pairs of a piecewise linear spectrum
+    std::string named; // named spectrum or spd file name
 };
 struct rgb{
     float r;
     float g;
     float b;
 };
-struct blackbody{};
+struct blackbody{
+    float temperature = 6500;
+};
 struct texture{
     std::string name;
 };
 
-using PBRTType = std::variant<int,float,point2,vector2,point3,vector3,normal3,spectrum,rgb,blackbody,bool,std::string,texture>;
+enum class PBRTParamType
+{
+    Integer,
+    Float,
+    Point2,
+    Vector2,
+    Point3,
+    Vector3,
+    Normal3,
+    Spectrum,
+    Rgb,
+    Blackbody,
+    Bool,
+    String,
+    Texture
+};
+
+/*
+ * Contiguous storage of all parameter values of one directive.
+ * Strings aren't copied, they view the mapped scene file.
+ */
+struct PBRTParamArena
+{
+    std::vector<int> ints; // integer and bool values
+    std::vector<float> floats; // float, point, vector, normal, rgb, blackbody and spectrum samples
+    std::vector<std::string_view> strings; // string, texture and named spectrum values
+
+    void clear()
+    {
+        ints.clear();
+        floats.clear();
+        strings.clear();
+    }
+};
 
-using PBRTParam = std::pair<std::string,PBRTType>;
+/*
+ * A typed parameter, e.g. "point3 P" [ 0 0 0  1 0 0 ].
+ * It references the values held by the directive's PBRTParamArena, so it must not outlive the directive handling.
+ */
+struct PBRTParam
+{
+    std::string_view name;
+    PBRTParamType type;
+    const int* ints = nullptr;
+    const float* floats = nullptr;
+    const std::string_view* strings = nullptr;
+    size_t count = 0; // number of scalar values
+
+    static size_t componentCount(PBRTParamType type)
+    {
+        switch (type)
+        {
+            case PBRTParamType::Point2:
+            case PBRTParamType::Vector2:
+                return 2;
+            case PBRTParamType::Point3:
+            case PBRTParamType::Vector3:
+            case PBRTParamType::Normal3:
+            case PBRTParamType::Rgb:
+                return 3;
+            default:
+                return 1;
+        }
+    }
+
+    // number of values of the declared type, a spectrum always counts as a single value
+    size_t size() const
+    {
+        if (type == PBRTParamType::Spectrum)
+            return count == 0 ? 0 : 1;
+        return count / componentCount(type);
+    }
+
+    template<class T>
+    bool holds() const
+    {
+        if (count == 0)
+            return false;
+        if constexpr (std::is_same_v<T,int>) return type == PBRTParamType::Integer;
+        else if constexpr (std::is_same_v<T,float>) return type == PBRTParamType::Float;
+        else if constexpr (std::is_same_v<T,point2>) return type == PBRTParamType::Point2;
+        else if constexpr (std::is_same_v<T,vector2>) return type == PBRTParamType::Vector2;
+        else if constexpr (std::is_same_v<T,point3>) return type == PBRTParamType::Point3;
+        else if constexpr (std::is_same_v<T,vector3>) return type == PBRTParamType::Vector3;
+        else if constexpr (std::is_same_v<T,normal3>) return type == PBRTParamType::Normal3;
+        else if constexpr (std::is_same_v<T,spectrum>) return type == PBRTParamType::Spectrum;
+        else if constexpr (std::is_same_v<T,rgb>) return type == PBRTParamType::Rgb;
+        else if constexpr (std::is_same_v<T,blackbody>) return type == PBRTParamType::Blackbody;
+        else if constexpr (std::is_same_v<T,bool>) return type == PBRTParamType::Bool;
+        else if constexpr (std::is_same_v<T,std::string>) return type == PBRTParamType::String;
+        else if constexpr (std::is_same_v<T,texture>) return type == PBRTParamType::Texture;
+        else return false;
+    }
+
+    // i-th value of the declared type, caller should check holds<T>() first
+    template<class T>
+    T get(size_t i = 0) const
+    {
+        if constexpr (std::is_same_v<T,int>) return ints[i];
+        else if constexpr (std::is_same_v<T,bool>) return ints[i] != 0;
+        else if constexpr (std::is_same_v<T,float>) return floats[i];
+        else if constexpr (std::is_same_v<T,point2>) return point2{floats[2 * i], floats[2 * i + 1]};
+        else if constexpr (std::is_same_v<T,vector2>) return vector2{floats[2 * i], floats[2 * i + 1]};
+        else if constexpr (std::is_same_v<T,point3>) return point3{floats[3 * i], floats[3 * i + 1], floats[3 * i + 2]};
+        else if constexpr (std::is_same_v<T,vector3>) return vector3{floats[3 * i], floats[3 * i + 1], floats[3 * i + 2]};
+        else if constexpr (std::is_same_v<T,normal3>) return normal3{floats[3 * i], floats[3 * i + 1], floats[3 * i + 2]};
+        else if constexpr (std::is_same_v<T,rgb>) return rgb{floats[3 * i], floats[3 * i + 1], floats[3 * i + 2]};
+        else if constexpr (std::is_same_v<T,blackbody>) return blackbody{floats[i]};
+        else if constexpr (std::is_same_v<T,std::string>) return std::string(strings[i]);
+        else if constexpr (std::is_same_v<T,texture>) return texture{std::string(strings[i])};
+        else if constexpr (std::is_same_v<T,spectrum>) {
+            spectrum s;
+            if (strings != nullptr)
+                s.named = std::string(strings[0]);
+            else if (count == 1)
+                s.constant = floats[0];
+            else
+                s.samples.assign(floats, floats + count);
+            return s;
+        }
+        else static_assert(std::is_same_v<T,int>, "not a pbrt parameter type");
+    }
+
+    template<class T>
+    void getAll(std::vector<T>& values) const
+    {
+        if constexpr (std::is_same_v<T,int>) {
+            values.assign(ints, ints + count);
+        } else if constexpr (std::is_same_v<T,float>) {
+            values.assign(floats, floats + count);
+        } else {
+            values.resize(size());
+            for (size_t i = 0; i < values.size(); i++)
+                values[i] = get<T>(i);
+        }
+    }
+};
 
 struct GeneralOption : Inspectable
 {
@@ -538,10 +680,20 @@ DEF_SUBCLASS_BEGIN(Shape,Sphere)
 DEF_SUBCLASS_END
 
 DEF_SUBCLASS_BEGIN(Shape,TriangleMesh)
-    void parse(const std::vector<PBRTParam> & para_lists) override
-    {
-
-    }
+    std::vector<int> indices;
+    std::vector<point3> P;
+    std::vector<normal3> N;
+    std::vector<vector3> S;
+    std::vector<point2> uv;
+    std::vector<int> faceIndices;
+    PARSE_SECTION_CONTINUE_IN_DERIVED
+        PARSE_FOR_VECTOR(indices)
+        PARSE_FOR_VECTOR(P)
+        PARSE_FOR_VECTOR(N)
+        PARSE_FOR_VECTOR(S)
+        PARSE_FOR_VECTOR(uv)
+        PARSE_FOR_VECTOR(faceIndices)
+    PARSE_SECTION_END_IN_DERIVED
 DEF_SUBCLASS_END
 
 DEF_SUBCLASS_BEGIN(Shape,PLYMesh)
@@ -626,7 +778,8 @@ DEF_BASECLASS_BEGIN(Material)
     std::string name;
     PARSE_SECTION_BEGIN_IN_BASE
         PARSE_FOR(name);
-    PARSE_SECTION_END
+        PARSE_IGNORE(type) // read by MakeNamedMaterial to pick the subclass
+    PARSE_SECTION_END_IN_BASE
     void show() override
     {
         WATCH_FIELD(name);
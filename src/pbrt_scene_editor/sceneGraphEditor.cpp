@@ -12,6 +12,7 @@
 
 #include "scene.h"
 #include "SceneBuilder.hpp"
+#include "SceneCache.hpp"
 
 void rightClickMenu(const bool* selections, int count)
 {
@@ -77,8 +78,8 @@ void rightClickMenu2(bool selected){
 void SceneGraphNode::visit(const SceneGraphVisitor& visitor)
 {
     visitor(this);
-    for (auto* child : children) {
-        child->visit(visitor);
+    for (auto child : children()) {
+        graph->node(child)->visit(visitor);
     }
 }
 
@@ -86,8 +87,8 @@ void SceneGraphNode::visit(const SceneGraphPreVisitor& pre_visitor, const SceneG
 {
     auto pair = pre_visitor(this);
     if (pair.first) {
-        for (auto* child : children) {
-            child->visit(pre_visitor, post_visitor);
+        for (auto child : children()) {
+            graph->node(child)->visit(pre_visitor, post_visitor);
         }
     }
     if (pair.second)
@@ -119,71 +120,71 @@ void SceneGlobalRenderSetting::show()
 void SceneGraphNode::show()
 {
     float translate[3];
-    translate[0] = _selfTransform[3].x;
-    translate[1] = _selfTransform[3].y;
-    translate[2] = _selfTransform[3].z;
+    translate[0] = selfTransform()[3].x;
+    translate[1] = selfTransform()[3].y;
+    translate[2] = selfTransform()[3].z;
 
     if (WATCH_FILED_FlOAT3(translate,-10.0,10.0))
     {
-        _selfTransform[3].x = translate[0];
-        _selfTransform[3].y = translate[1];
-        _selfTransform[3].z = translate[2];
+        selfTransform()[3].x = translate[0];
+        selfTransform()[3].y = translate[1];
+        selfTransform()[3].z = translate[2];
         //printf("%s change translate to [%f, %f, %f]\n", this->name.c_str(),x0,x1,x2);
-        graph->nodeSelfTranslateChangeSignal(this);
+        graph->nodeSelfTranslateChangeSignal(handle);
         updateSelfTransform();
     }
 
     float rotation[3];
-    glm::extractEulerAngleXYZ(_selfTransform, rotation[0], rotation[1], rotation[2]);
+    glm::extractEulerAngleXYZ(selfTransform(), rotation[0], rotation[1], rotation[2]);
     if (WATCH_FILED_FlOAT3(rotation, -10.0, 10.0))
     {
 
     }
     float scale[3];
-    scale[0] = _selfTransform[0][0];
-    scale[1] = _selfTransform[1][1];
-    scale[2] = _selfTransform[2][2];
+    scale[0] = selfTransform()[0][0];
+    scale[1] = selfTransform()[1][1];
+    scale[2] = selfTransform()[2][2];
     if (WATCH_FILED_FlOAT3(scale, -10.0, 10.0))
     {
-        _selfTransform[0][0] = scale[0];
-        _selfTransform[1][1] = scale[1];
-        _selfTransform[2][2] = scale[2];
+        selfTransform()[0][0] = scale[0];
+        selfTransform()[1][1] = scale[1];
+        selfTransform()[2][2] = scale[2];
         //printf("%s change scale to [%f, %f, %f]\n", this->name.c_str(),x0,x1,x2);
-        graph->nodeSelfScaleChangeSignal(this);
+        graph->nodeSelfScaleChangeSignal(handle);
         updateSelfTransform();
     }
         
-    if (!shapes.empty())
+    if (!shapes().empty())
     {
         ImGui::Separator();
-        for (auto shape : shapes)
+        for (auto shape : shapes())
         {
             shape->show();
         }
     }
 
-    if (!materials.empty())
+    if (!materials().empty())
     {
         ImGui::Separator();
-        for (auto material : materials)
+        for (auto material : materials())
         {
             material->show();
         }
     }
 
-    if (!lights.empty())
+    if (!lights().empty())
     {
         ImGui::Separator();
-        for (auto light : lights)
+        for (auto light : lights())
         {
             light->show();
         }
     }
 
-    if (!areaLights.empty())
+    if (!areaLights().empty())
     {
         ImGui::Separator();
-        for (auto areaLight : areaLights)
+        for (auto areaLight : areaLights())
         {
             areaLight->show();
         }
@@ -192,36 +193,25 @@ void SceneGraphNode::show()
 
 void SceneGraphNode::updateSelfTransform()
 {
-    graph->selfTransformChange(this);
+    graph->selfTransformChange(handle);
     updateFinalTransform();
 }
 
 void SceneGraphNode::updateFinalTransform()
 {
-    if (parent != nullptr && !is_transform_detached)
-    {
-        _finalTransform = _selfTransform * parent->_finalTransform;
-    }
-    else {
-        _finalTransform = _selfTransform;
-    }
-    graph->finalTransformChange(this);
-    for (auto& child : children)
-    {
-        child->updateFinalTransform();
-    }
+    graph->transforms.markDirty(transformIndex);
 }
 
 void SceneGraphNode::select()
 {
     m_is_selected = true;
-    graph->selectNode(this);
+    graph->selectNode(handle);
 }
 
 void SceneGraphNode::unselect()
 {
     m_is_selected = false;
-    graph->unSelectNode(this);
+    graph->unSelectNode(handle);
 }
 
 void SceneGraphEditor::constructFrame()
@@ -252,7 +242,7 @@ void SceneGraphEditor::constructFrame()
 
    static auto singleSelectionPreVisitor = [&](SceneGraphNode* node)
    {
-       if(!node->children.empty()){
+       if(!node->children().empty()){
            int nodeFlags = ImGuiTreeNodeFlags_OpenOnArrow;
            if(node->is_selected())
            {
@@ -304,13 +294,16 @@ void SceneGraphEditor::constructFrame()
            currentInspectingNodes.push_back(node);
        }
 
-       return std::make_pair(!node->children.empty(), false);
+       return std::make_pair(!node->children().empty(), false);
    };
 
    static auto collectSelectedPostVisitor = [](SceneGraphNode* node)->void {};
 
-    _sceneGraph->root->visit(singleSelectionPreVisitor,singleSelectionPostVisitor);
-    _sceneGraph->root->visit(collectSelectedPreVisitor, collectSelectedPostVisitor);
+    if (auto* root = _sceneGraph->node(_sceneGraph->root))
+    {
+        root->visit(singleSelectionPreVisitor,singleSelectionPostVisitor);
+        root->visit(collectSelectedPreVisitor, collectSelectedPostVisitor);
+    }
 
     if (!currentInspectingNodes.empty())
     {
@@ -327,9 +320,17 @@ void SceneGraphEditor::init()
 
 SceneGraph* SceneGraphEditor::parsePBRTSceneFile(const std::filesystem::path & path, AssetManager& assetManager)
 {
-    PBRTSceneBuilder builder{};
     assetManager.setWorkDir(path.parent_path());
+    auto cachePath = SceneCache::cachePathFor(path);
+    if(auto* cached = SceneCache::load(cachePath, assetManager))
+    {
+        _sceneGraph.reset(cached);
+        return cached;
+    }
+    PBRTSceneBuilder builder{};
     auto res = _parser.parse(builder,path,assetManager);
+    builder.finish();
+    SceneCache::save(cachePath, _parser.parsedFiles, *builder.sceneGraph, builder);
     // do something to current scene
     _sceneGraph.reset(builder.sceneGraph);
     return builder.sceneGraph;
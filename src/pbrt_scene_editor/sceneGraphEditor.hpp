@@ -10,6 +10,9 @@
 #include <glm/gtx/euler_angles.hpp>
 #include "scene.h"
 #include "rocket.hpp"
+#include "ChunkedArena.hpp"
+#include "TransformHierarchy.hpp"
+#include "Symbol.hpp"
 
 struct AssetManager;
 struct PBRTScene;
@@ -17,6 +20,8 @@ struct SceneGraph;
 
 struct SceneGraphNode;
 
+using SceneGraphNodeHandle = ArenaHandle<SceneGraphNode>;
+
 using SceneGraphVisitor = std::function<void(SceneGraphNode*)>;
 
 using SceneGraphPreVisitor = std::function<std::pair<bool,bool>(SceneGraphNode*)>;
@@ -67,60 +72,54 @@ using SceneGraphPostVisitorPayloaded = std::function<void(SceneGraphNode*,Payloa
 //    }
 //};
 
+/*
+ * Nodes live in the chunked arena of their SceneGraph and refer to each other by handle.
+ * Children and attachments are ranges into pools shared by the whole graph, the builder fills
+ * them in one piece when the node is closed.
+ */
 struct SceneGraphNode : Inspectable
 {
     SceneGraph* graph = nullptr;
+    SceneGraphNodeHandle handle;
     std::string name;
-    std::vector<SceneGraphNode*> children;
-    SceneGraphNode* parent = nullptr;
+    SceneGraphNodeHandle parent;
 
-    std::vector<Shape*> shapes;
-    std::vector<Material*> materials;
-    std::vector<Light*> lights;
-    std::vector<AreaLight*> areaLights;
+    PoolRange childRange;
+    PoolRange shapeRange;
+    PoolRange materialRange;
+    PoolRange lightRange;
+    PoolRange areaLightRange;
 
     bool is_empty = true;
     bool is_transform_detached = false;//transform not be affected by its parent
     bool m_is_selected = false;
     bool is_instance = false;
 
-    glm::mat4 _selfTransform;
-    glm::mat4 _finalTransform;
+    // slot in the TransformHierarchy of the graph
+    uint32_t transformIndex = 0;
 
-    SceneGraphNode()
-    {
-        _selfTransform = glm::identity<glm::mat4>();
-        _finalTransform = _selfTransform;
-    }
+    // Writing the self transform directly must be followed by updateSelfTransform()
+    glm::mat4& selfTransform() const;
+    glm::mat4& finalTransform() const;
+
+    PoolSpan<const SceneGraphNodeHandle> children() const;
+    PoolSpan<Shape* const> shapes() const;
+    PoolSpan<Material* const> materials() const;
+    PoolSpan<Light* const> lights() const;
+    PoolSpan<AreaLight* const> areaLights() const;
+
+    SceneGraphNode* parentNode() const;
 
     void visit(const SceneGraphVisitor& visitor);
 
     void visit(const SceneGraphPreVisitor& pre_visitor, const SceneGraphPostVisitor& post_visitor);
 
     template<class Payload>
-    void visitPayload(SceneGraphVisitorPayloaded<Payload>& visitor){
-        auto* payload = new Payload;
-        visitor(this,payload);
-        delete payload;
-        for(auto* child : children){
-            child->visit(visitor);
-        }
-    }
+    void visitPayload(SceneGraphVisitorPayloaded<Payload>& visitor);
 
     template<class Payload>
     void visitPayload(const SceneGraphPreVisitorPayloaded<Payload>& pre_visitor,
-               const SceneGraphPostVisitorPayloaded<Payload>& post_visitor){
-        auto* payload = new Payload;
-        auto pair =  pre_visitor(this,payload);
-        if(pair.first){
-            for(auto* child : children){
-                child->visit(pre_visitor,post_visitor);
-            }
-        }
-        if(pair.second)
-            post_visitor(this,payload);
-        delete payload;
-    }
+               const SceneGraphPostVisitorPayloaded<Payload>& post_visitor);
 
 //    void modify(int new_val){
 //        intermediate_val = new_val;
@@ -161,6 +160,7 @@ struct SceneGraphNode : Inspectable
 
     void updateSelfTransform();
 
+    // The final transforms of the subtree are recomputed by the next SceneGraph::updateTransforms()
     void updateFinalTransform();
 
     std::string InspectedName() override
@@ -195,77 +195,230 @@ struct SceneGlobalRenderSetting : Inspectable
 
 struct SceneGraph
 {
-    SceneGraphNode * root;
+    SceneGraphNodeHandle root;
+    // in definition order, add them through addNamedMaterial()/addNamedTexture()/addObjectInstance() so the lookups see them
     std::vector<Material*> namedMaterials;
     std::vector<Texture*> namedTextures;
     //todo : note, when initiation node modify the data, a deep copy is preferred.
-    std::vector<SceneGraphNode*> _objInstances;
+    std::vector<SceneGraphNodeHandle> _objInstances;
     SceneGlobalRenderSetting globalRenderSetting;
 
-    rocket::signal<void(SceneGraphNode*)> nodeSelectSignal;
-    rocket::signal<void(SceneGraphNode*)> nodeUnSelectSignal;
+    // destroying the graph frees the nodes chunk by chunk
+    ChunkedArena<SceneGraphNode> nodes;
+    std::vector<SceneGraphNodeHandle> childPool;
+    std::vector<Shape*> shapePool;
+    std::vector<Material*> materialPool;
+    std::vector<Light*> lightPool;
+    std::vector<AreaLight*> areaLightPool;
+
+    SymbolMap<Material*> namedMaterialLookup;
+    SymbolMap<Texture*> namedTextureLookup;
+    SymbolMap<SceneGraphNodeHandle> namedObjInstanceLookup;
+
+    rocket::signal<void(SceneGraphNodeHandle)> nodeSelectSignal;
+    rocket::signal<void(SceneGraphNodeHandle)> nodeUnSelectSignal;
+
+    rocket::signal<void(SceneGraphNodeHandle)> nodeSelfTranslateChangeSignal;
+    rocket::signal<void(SceneGraphNodeHandle)> nodeSelfRotationChangeSignal;
+    rocket::signal<void(SceneGraphNodeHandle)> nodeSelfScaleChangeSignal;
+    rocket::signal<void(SceneGraphNodeHandle)> nodeSelfTransformChangeSignal;
+
+    rocket::signal<void(SceneGraphNodeHandle)> nodeFinalTranslateChangeSignal;
+    rocket::signal<void(SceneGraphNodeHandle)> nodeFinalRotationChangeSignal;
+    rocket::signal<void(SceneGraphNodeHandle)> nodeFinalScaleChangeSignal;
+    // nodes whose final transform changed in one updateTransforms()
+    rocket::thread_safe_signal<void(const std::vector<SceneGraphNodeHandle>&)> nodeFinalTransformChangeSignal;
+
+    TransformHierarchy transforms;
+
+    // false when a material with the same name is already defined
+    bool addNamedMaterial(Material* material)
+    {
+        if (!namedMaterialLookup.emplace(intern(material->name), material).second)
+            return false;
+        namedMaterials.push_back(material);
+        return true;
+    }
+
+    Material* findNamedMaterial(std::string_view name) const
+    {
+        auto* material = namedMaterialLookup.find(SymbolTable::getInstance().find(name));
+        return material != nullptr ? *material : nullptr;
+    }
+
+    // the first texture defined under a name is the one lookups return
+    void addNamedTexture(Texture* texture)
+    {
+        namedTextureLookup.emplace(intern(texture->name), texture);
+        namedTextures.push_back(texture);
+    }
+
+    Texture* findNamedTexture(std::string_view name) const
+    {
+        auto* texture = namedTextureLookup.find(SymbolTable::getInstance().find(name));
+        return texture != nullptr ? *texture : nullptr;
+    }
+
+    // instances are looked up by the name of their node, the first definition of a name wins
+    void addObjectInstance(SceneGraphNodeHandle handle)
+    {
+        namedObjInstanceLookup.emplace(intern(node(handle)->name), handle);
+        _objInstances.push_back(handle);
+    }
+
+    SceneGraphNodeHandle findObjectInstance(std::string_view name) const
+    {
+        auto* handle = namedObjInstanceLookup.find(SymbolTable::getInstance().find(name));
+        return handle != nullptr ? *handle : SceneGraphNodeHandle{};
+    }
+
+    SceneGraphNodeHandle createNode()
+    {
+        auto handle = nodes.create();
+        auto* node = nodes.get(handle);
+        node->graph = this;
+        node->handle = handle;
+        node->transformIndex = transforms.add(handle);
+        return handle;
+    }
 
-    rocket::signal<void(SceneGraphNode*)> nodeSelfTranslateChangeSignal;
-    rocket::signal<void(SceneGraphNode*)> nodeSelfRotationChangeSignal;
-    rocket::signal<void(SceneGraphNode*)> nodeSelfScaleChangeSignal;
-    rocket::signal<void(SceneGraphNode*)> nodeSelfTransformChangeSignal;
+    // Sort the transforms once the nodes are created, before the first updateTransforms()
+    void buildTransformHierarchy()
+    {
+        transforms.rebuild(nodes);
+    }
 
-    rocket::signal<void(SceneGraphNode*)> nodeFinalTranslateChangeSignal;
-    rocket::signal<void(SceneGraphNode*)> nodeFinalRotationChangeSignal;
-    rocket::signal<void(SceneGraphNode*)> nodeFinalScaleChangeSignal;
-    rocket::thread_safe_signal<void(SceneGraphNode*)> nodeFinalTransformChangeSignal;
+    // Called once per frame, recomputes the edited transforms and notifies nodeFinalTransformChangeSignal
+    void updateTransforms()
+    {
+        const auto& changed = transforms.update();
+        if (!changed.empty())
+            nodeFinalTransformChangeSignal(changed);
+    }
+
+    void destroyNode(SceneGraphNodeHandle handle)
+    {
+        nodes.destroy(handle);
+    }
 
-    void selectNode(SceneGraphNode* node)
+    // nullptr once the node is destroyed
+    SceneGraphNode* node(SceneGraphNodeHandle handle) const
+    {
+        return nodes.get(handle);
+    }
+
+    void selectNode(SceneGraphNodeHandle node)
     {
         nodeSelectSignal(node);
     }
 
-    void unSelectNode(SceneGraphNode* node)
+    void unSelectNode(SceneGraphNodeHandle node)
     {
         nodeUnSelectSignal(node);
     }
 
-    void selfTranslateChange(SceneGraphNode* node)
+    void selfTranslateChange(SceneGraphNodeHandle node)
     {
         nodeSelfTranslateChangeSignal(node);
     }
 
-    void selfRotationChange(SceneGraphNode* node)
+    void selfRotationChange(SceneGraphNodeHandle node)
     {
         nodeSelfRotationChangeSignal(node);
     }
 
-    void selfScaleChange(SceneGraphNode* node)
+    void selfScaleChange(SceneGraphNodeHandle node)
     {
         nodeSelfScaleChangeSignal(node);
     }
 
-    void finalTranslateChange(SceneGraphNode* node)
+    void finalTranslateChange(SceneGraphNodeHandle node)
     {
         nodeFinalTranslateChangeSignal(node);
     }
 
-    void finalRotationChange(SceneGraphNode* node)
+    void finalRotationChange(SceneGraphNodeHandle node)
     {
         nodeFinalRotationChangeSignal(node);
     }
 
-    void finalScaleChange(SceneGraphNode* node)
+    void finalScaleChange(SceneGraphNodeHandle node)
     {
         nodeFinalScaleChangeSignal(node);
     }
 
-    void selfTransformChange(SceneGraphNode* node)
+    void selfTransformChange(SceneGraphNodeHandle node)
     {
         nodeSelfTransformChangeSignal(node);
     }
 
-    void finalTransformChange(SceneGraphNode* node)
-    {
-        nodeFinalTransformChangeSignal(node);
-    }
 };
 
+inline PoolSpan<const SceneGraphNodeHandle> SceneGraphNode::children() const
+{
+    return spanOf<const SceneGraphNodeHandle>(graph->childPool, childRange);
+}
+
+inline PoolSpan<Shape* const> SceneGraphNode::shapes() const
+{
+    return spanOf<Shape* const>(graph->shapePool, shapeRange);
+}
+
+inline PoolSpan<Material* const> SceneGraphNode::materials() const
+{
+    return spanOf<Material* const>(graph->materialPool, materialRange);
+}
+
+inline PoolSpan<Light* const> SceneGraphNode::lights() const
+{
+    return spanOf<Light* const>(graph->lightPool, lightRange);
+}
+
+inline PoolSpan<AreaLight* const> SceneGraphNode::areaLights() const
+{
+    return spanOf<AreaLight* const>(graph->areaLightPool, areaLightRange);
+}
+
+inline SceneGraphNode* SceneGraphNode::parentNode() const
+{
+    return graph->node(parent);
+}
+
+inline glm::mat4& SceneGraphNode::selfTransform() const
+{
+    return graph->transforms.selfTransforms[transformIndex];
+}
+
+inline glm::mat4& SceneGraphNode::finalTransform() const
+{
+    return graph->transforms.finalTransforms[transformIndex];
+}
+
+template<class Payload>
+void SceneGraphNode::visitPayload(SceneGraphVisitorPayloaded<Payload>& visitor){
+    auto* payload = new Payload;
+    visitor(this,payload);
+    delete payload;
+    for(auto child : children()){
+        graph->node(child)->visitPayload(visitor);
+    }
+}
+
+template<class Payload>
+void SceneGraphNode::visitPayload(const SceneGraphPreVisitorPayloaded<Payload>& pre_visitor,
+           const SceneGraphPostVisitorPayloaded<Payload>& post_visitor){
+    auto* payload = new Payload;
+    auto pair =  pre_visitor(this,payload);
+    if(pair.first){
+        for(auto child : children()){
+            graph->node(child)->visitPayload(pre_visitor,post_visitor);
+        }
+    }
+    if(pair.second)
+        post_visitor(this,payload);
+    delete payload;
+}
+
 struct SceneGraphEditor : EditorComponentGUI
 {
 	
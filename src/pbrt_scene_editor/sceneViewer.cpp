@@ -19,10 +19,18 @@ void SceneViewer::constructFrame()
 void SceneViewer::constructFrameGraphAOT(FrameGraph* frameGraph)
 {
     //https://app.diagrams.net/#G1oZrtZ4mJJVukgjC-h3H29EIItxIKzXKd#%7B%22pageId%22%3A%223b_IgyTFIOp2U2cZway7%22%7D
+    auto instanceCullPass = std::make_unique<InstanceCullPass>();
+    instanceCullPass->scene = this->_renderScene;
+    auto clusterCullPass = std::make_unique<ClusterCullPass>();
+    clusterCullPass->scene = this->_renderScene;
     auto skyBoxPass = std::make_unique<SkyBoxPass>();
     skyBoxPass->scene = this->_renderScene;
     auto gBufferPass = std::make_unique<GBufferPass>();
     gBufferPass->scene = this->_renderScene;
+    auto hzbOcclusionPass = std::make_unique<HZBOcclusionPass>();
+    hzbOcclusionPass->scene = this->_renderScene;
+    auto gBufferLatePass = std::make_unique<GBufferLatePass>();
+    gBufferLatePass->scene = this->_renderScene;
     auto selectedMaskPass = std::make_unique<SelectedMaskPass>();
     auto objectPickPass = std::make_unique<ObjectPickPass>();
     objectPickPass->scene = this->_renderScene;
@@ -39,8 +47,22 @@ void SceneViewer::constructFrameGraphAOT(FrameGraph* frameGraph)
     auto scene_selected = frameGraph->createOrGetBoolVariable("scene_selected", true);
     auto shading_mode = frameGraph->createOrGetSwitchVariable("shading_mode", "Albedo");
     auto enable_wireframe = frameGraph->createOrGetBoolVariable("enable_wireframe", false);
+    auto enable_occlusion_culling = frameGraph->createOrGetBoolVariable("enable_occlusion_culling", true);
+
+    // the draw lists of the dynamic batches, the passes bind them themselves
+    auto culledDraws = frameGraph->createOrGetBuffer("culledDraws");
+    auto clusterDraws = frameGraph->createOrGetBuffer("clusterDraws");
+
+    // every pass drawing the dynamic instances reads what this one kept, it has to come first
+    instanceCullPass->write(culledDraws);
+    frameGraph->executeWhen(scene_selected, std::move(instanceCullPass));
+    // splits the visible instances of the large meshes into clusters, GBufferPass draws what it kept
+    clusterCullPass->read(culledDraws);
+    clusterCullPass->write(clusterDraws);
+    frameGraph->executeWhen(scene_selected, std::move(clusterCullPass));
 
     auto selectedMask = frameGraph->createOrGetTexture("selectedMask", vk::Format::eR8G8B8A8Srgb);
+    selectedMaskPass->read(culledDraws);
     selectedMaskPass->renderTo(selectedMask, vk::AttachmentLoadOp::eClear);
     frameGraph->executeWhen(scene_selected, std::move(selectedMaskPass));
 
@@ -58,6 +80,8 @@ void SceneViewer::constructFrameGraphAOT(FrameGraph* frameGraph)
     auto encodeMeshID = frameGraph->createOrGetTexture("encodeMeshID", vk::Format::eR8G8B8A8Unorm);
     auto encodeInstanceID = frameGraph->createOrGetTexture("encodeInstanceID", vk::Format::eR8G8B8A8Unorm);
 
+    gBufferPass->read(culledDraws);
+    gBufferPass->read(clusterDraws);
     gBufferPass->renderTo(sceneDepth, vk::AttachmentLoadOp::eClear);
     gBufferPass->renderTo(flat, vk::AttachmentLoadOp::eClear);
     gBufferPass->renderTo(meshID, vk::AttachmentLoadOp::eClear);
@@ -69,6 +93,24 @@ void SceneViewer::constructFrameGraphAOT(FrameGraph* frameGraph)
     gBufferPass->renderTo(encodeInstanceID, vk::AttachmentLoadOp::eClear);
     frameGraph->executeWhen(scene_selected, std::move(gBufferPass));
 
+    // two phase occlusion culling, the instances the depth of GBufferPass doesn't hide are drawn on top of it
+    hzbOcclusionPass->sample(sceneDepth);
+    // writes the late lists
+    hzbOcclusionPass->readwrite(culledDraws);
+    frameGraph->executeWhen(scene_selected & enable_occlusion_culling, std::move(hzbOcclusionPass));
+
+    gBufferLatePass->read(culledDraws);
+    gBufferLatePass->renderTo(sceneDepth, vk::AttachmentLoadOp::eLoad);
+    gBufferLatePass->renderTo(flat, vk::AttachmentLoadOp::eLoad);
+    gBufferLatePass->renderTo(meshID, vk::AttachmentLoadOp::eLoad);
+    gBufferLatePass->renderTo(wPosition, vk::AttachmentLoadOp::eLoad);
+    gBufferLatePass->renderTo(wNormal, vk::AttachmentLoadOp::eLoad);
+    gBufferLatePass->renderTo(UV, vk::AttachmentLoadOp::eLoad);
+    gBufferLatePass->renderTo(albedoColor, vk::AttachmentLoadOp::eLoad);
+    gBufferLatePass->renderTo(encodeMeshID, vk::AttachmentLoadOp::eLoad);
+    gBufferLatePass->renderTo(encodeInstanceID, vk::AttachmentLoadOp::eLoad);
+    frameGraph->executeWhen(scene_selected & enable_occlusion_culling, std::move(gBufferLatePass));
+
     /*auto ssaoMap = frameGraph.createTexture("ssaoMap", vk::Format::eR8G8B8A8Unorm,PassTextureExtent::SwapchainRelative(1.0,1.0));
     ssaoPass->sample(sceneDepth);
     ssaoPass->sample(wPosition);
@@ -99,6 +141,7 @@ void SceneViewer::constructFrameGraphAOT(FrameGraph* frameGraph)
     copyPass->renderTo(frameGraph->getPresentTexture(), vk::AttachmentLoadOp::eClear);
     frameGraph->executeWhen(scene_selected & (!shading_mode.is("Final")), std::move(copyPass));
 
+    wireFramePass->read(culledDraws);
     wireFramePass->renderTo(sceneDepth, vk::AttachmentLoadOp::eLoad);
     wireFramePass->renderTo(frameGraph->getPresentTexture(), vk::AttachmentLoadOp::eLoad);
     frameGraph->executeWhen(scene_selected & enable_wireframe, std::move(wireFramePass));
@@ -108,8 +151,23 @@ void SceneViewer::constructFrameGraphAOT(FrameGraph* frameGraph)
     frameGraph->executeWhen(scene_selected, std::move(outlinePass));
 }
 
+#if EDITOR_SYNC_VALIDATION
+void SceneViewer::cycleValidatedModes()
+{
+    constexpr uint32_t framesPerMode = 60;
+    constexpr uint32_t shadingModeCount = static_cast<uint32_t>(ShadingMode::FINAL) + 1;
+    uint32_t mode = validatedFrames++ / framesPerMode;
+    currenShadingMode = static_cast<ShadingMode>(mode % shadingModeCount);
+    enableWireFrame = (mode / shadingModeCount) % 2 == 1;
+    enableOcclusionCulling = (mode / shadingModeCount / 2) % 2 == 0;
+}
+#endif
+
 void SceneViewer::update(FrameGraph* frameGraph)
 {
+#if EDITOR_SYNC_VALIDATION
+    cycleValidatedModes();
+#endif
     auto* copyPass = dynamic_cast<CopyPass*>(frameGraph->getPass("CopyPass"));
     switch (currenShadingMode)
     {
@@ -137,6 +195,10 @@ void SceneViewer::update(FrameGraph* frameGraph)
             frameGraph->setSwitchVariable("shading_mode", "Albedo");
             copyPass->currentTexIdx.x = 5;
             break;
+        case SceneViewer::ShadingMode::LOD:
+            frameGraph->setSwitchVariable("shading_mode", "LOD");
+            copyPass->currentTexIdx.x = 0;
+            break;
         case SceneViewer::ShadingMode::FINAL:
             frameGraph->setSwitchVariable("shading_mode", "Final");
             break;
@@ -144,6 +206,13 @@ void SceneViewer::update(FrameGraph* frameGraph)
             break;
     }
     frameGraph->setBoolVariable("enable_wireframe", enableWireFrame);
+    frameGraph->setBoolVariable("enable_occlusion_culling", enableOcclusionCulling);
+    _renderScene->occlusionCulling = enableOcclusionCulling;
+    _renderScene->clusterCulling = enableClusterCulling;
+    _renderScene->clusterConeCulling = enableClusterConeCulling;
+    _renderScene->lodSelection = enableLodSelection;
+    _renderScene->lodPixelError = lodPixelError;
+    _renderScene->lodShading = currenShadingMode == SceneViewer::ShadingMode::LOD;
     _renderScene->update();
 }
 
@@ -156,6 +225,34 @@ void SceneViewer::setCurrentSceneGraph(SceneGraph *graph,AssetManager& assetMana
 {
     //construct render scene (ECS)
     _renderScene->buildFrom(graph,assetManager);
+    // start compiling the pipelines of the new scene before its first frame
+    for (const auto* passName : { "GBufferPass", "GBufferLatePass" })
+    {
+        if (auto* gBufferPass = dynamic_cast<GBufferPass*>(FrameCoordinator::getInstance().frameGraph->getPass(passName)))
+        {
+            gBufferPass->warmUp();
+        }
+    }
+}
+
+const renderScene::InstanceCullStatistics& SceneViewer::getCullStatistics() const
+{
+    return _renderScene->lastCullStatistics;
+}
+
+DrawPacketStatistics SceneViewer::getDrawPacketStatistics() const
+{
+    DrawPacketStatistics total{};
+    for (const auto* passName : { "GBufferPass", "GBufferLatePass" })
+    {
+        if (auto* gBufferPass = dynamic_cast<GBufferPass*>(FrameCoordinator::getInstance().frameGraph->getPass(passName)))
+        {
+            total.packets += gBufferPass->statistics.packets;
+            total.rebuilds += gBufferPass->statistics.rebuilds;
+            total.stateChanges += gBufferPass->statistics.stateChanges;
+        }
+    }
+    return total;
 }
 
 SceneViewer::~SceneViewer() = default;
@@ -8,6 +8,7 @@
 
 struct DeviceExtended;
 struct SceneGraphNode;
+struct DrawPacketStatistics;
 
 struct SceneViewerCamera
 {
@@ -21,6 +22,10 @@ struct SceneViewer
 	void init(std::shared_ptr<DeviceExtended> device);
     void setCurrentSceneGraph(SceneGraph* sceneGraph,AssetManager& assetManager);
     void update(FrameGraph* frameGraph);
+    // Counters of the latest frame the GPU has finished
+    const renderScene::InstanceCullStatistics& getCullStatistics() const;
+    // Draw packets of both G-buffer passes, for the latest frame they recorded
+    DrawPacketStatistics getDrawPacketStatistics() const;
 
 	~SceneViewer();
 
@@ -38,13 +43,26 @@ struct SceneViewer
         NORMAL,
         UV,
         ALBEDO,
+        // the flat target coloured by the level of detail of every instance
+        LOD,
         FINAL
     };
 
     ShadingMode currenShadingMode = ShadingMode::ALBEDO;
     bool enableWireFrame = false;
+    bool enableOcclusionCulling = true;
+    bool enableClusterCulling = true;
+    bool enableClusterConeCulling = false;
+    bool enableLodSelection = true;
+    float lodPixelError = 1.0f;
 
 private:
+#if EDITOR_SYNC_VALIDATION
+    // the synchronization validation run goes through every shading mode, with and without wireframe and occlusion culling
+    void cycleValidatedModes();
+    uint32_t validatedFrames = 0;
+#endif
+
 	std::shared_ptr<DeviceExtended> backendDevice;
     RenderingMode _renderingMode;
     renderScene::RenderScene* _renderScene;
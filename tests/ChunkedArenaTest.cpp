@@ -0,0 +1,169 @@
+#include "TestCommon.hpp"
+
+#include "ChunkedArena.hpp"
+
+#include <set>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    struct Counted
+    {
+        explicit Counted(int value) : value(value) { live()++; }
+        ~Counted() { live()--; }
+        Counted(const Counted&) = delete;
+        Counted& operator=(const Counted&) = delete;
+
+        static int& live()
+        {
+            static int count = 0;
+            return count;
+        }
+
+        int value;
+    };
+
+    struct ThrowingOnNegative
+    {
+        explicit ThrowingOnNegative(int value) : value(value)
+        {
+            if (value < 0)
+                throw std::runtime_error("negative");
+        }
+
+        int value;
+    };
+}
+
+TEST_CASE(handlesResolveToTheirObjects)
+{
+    ChunkedArena<std::string, 4> arena;
+    std::vector<ArenaHandle<std::string>> handles;
+    // several chunks of 16
+    for (int i = 0; i < 100; i++)
+        handles.push_back(arena.create(std::to_string(i)));
+    CHECK(arena.size() == 100);
+    std::string* first = arena.get(handles[0]);
+    for (int i = 0; i < 100; i++)
+    {
+        REQUIRE(arena.get(handles[i]) != nullptr);
+        CHECK(*arena.get(handles[i]) == std::to_string(i));
+    }
+    // objects never move while the arena grows
+    CHECK(arena.get(handles[0]) == first);
+    CHECK(arena.get(ArenaHandle<std::string>()) == nullptr);
+    CHECK(arena.get(ArenaHandle<std::string>(1000, 0)) == nullptr);
+}
+
+TEST_CASE(staleHandleIsRejectedAfterReuse)
+{
+    ChunkedArena<Counted, 4> arena;
+    auto a = arena.create(1);
+    auto b = arena.create(2);
+    arena.destroy(a);
+    CHECK(arena.get(a) == nullptr);
+    CHECK(Counted::live() == 1);
+
+    // the freed slot is reused with the next generation
+    auto c = arena.create(3);
+    CHECK(c.index() == a.index());
+    CHECK(c.generation() == static_cast<uint8_t>(a.generation() + 1));
+    CHECK(arena.get(a) == nullptr);
+    REQUIRE(arena.get(c) != nullptr);
+    CHECK(arena.get(c)->value == 3);
+    CHECK(arena.get(b)->value == 2);
+
+    // destroying through a stale handle leaves the new object alone
+    arena.destroy(a);
+    CHECK(arena.get(c) != nullptr);
+    CHECK(arena.size() == 2);
+
+    arena.clear();
+    CHECK(Counted::live() == 0);
+    CHECK(arena.size() == 0);
+}
+
+TEST_CASE(slotIsRetiredBeforeItsGenerationWraps)
+{
+    ChunkedArena<Counted, 4> arena;
+    auto first = arena.create(0);
+    uint32_t slot = first.index();
+
+    std::vector<ArenaHandle<Counted>> history{ first };
+    auto current = first;
+    for (int reuse = 1; reuse < 256; reuse++)
+    {
+        arena.destroy(current);
+        current = arena.create(reuse);
+        REQUIRE(current.index() == slot);
+        CHECK(current.generation() == reuse);
+        history.push_back(current);
+    }
+
+    // generation 255 is the last one the slot hands out, the next object lands elsewhere
+    arena.destroy(current);
+    auto next = arena.create(256);
+    CHECK(next.index() != slot);
+    for (auto& stale : history)
+        CHECK(arena.get(stale) == nullptr);
+    CHECK(arena.get(next)->value == 256);
+
+    // a handle with the wrapped generation of the retired slot doesn't resolve either
+    CHECK(arena.get(ArenaHandle<Counted>(slot, 0)) == nullptr);
+    CHECK(arena.size() == 1);
+    arena.clear();
+    CHECK(Counted::live() == 0);
+}
+
+TEST_CASE(forEachVisitsLiveObjectsOnly)
+{
+    ChunkedArena<int, 4> arena;
+    std::vector<ArenaHandle<int>> handles;
+    for (int i = 0; i < 50; i++)
+        handles.push_back(arena.create(i));
+    for (int i = 0; i < 50; i += 3)
+        arena.destroy(handles[i]);
+
+    std::set<int> seen;
+    bool handlesMatch = true;
+    arena.forEach([&](ArenaHandle<int> handle, const int& value) {
+        seen.insert(value);
+        handlesMatch &= arena.get(handle) == &value;
+    });
+    CHECK(handlesMatch);
+    CHECK(seen.size() == arena.size());
+    for (int i = 0; i < 50; i++)
+        CHECK(seen.count(i) == (i % 3 == 0 ? 0u : 1u));
+}
+
+TEST_CASE(throwingConstructorKeepsTheSlot)
+{
+    ChunkedArena<ThrowingOnNegative, 2> arena;
+    auto a = arena.create(1);
+    auto b = arena.create(2);
+    arena.destroy(a);
+
+    // on a freed slot, which the next object still gets
+    CHECK_THROWS(arena.create(-1));
+    auto c = arena.create(3);
+    CHECK(c.index() == a.index());
+    CHECK(arena.size() == 2);
+
+    // on a fresh slot, here the first of a new chunk of 4
+    arena.create(4);
+    arena.create(5);
+    CHECK_THROWS(arena.create(-2));
+    CHECK(arena.size() == 4);
+    auto d = arena.create(6);
+    CHECK(d.index() == 4);
+    REQUIRE(arena.get(d) != nullptr);
+    CHECK(arena.get(d)->value == 6);
+    CHECK(arena.get(b)->value == 2);
+
+    int visited = 0;
+    arena.forEach([&](ArenaHandle<ThrowingOnNegative>, const ThrowingOnNegative&) { visited++; });
+    CHECK(visited == 5);
+}
+
+TEST_MAIN()
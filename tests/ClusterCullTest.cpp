@@ -0,0 +1,292 @@
+#include "TestCommon.hpp"
+#include "ComputeDispatch.hpp"
+
+#include "ClusterCulling.hpp"
+#include "InstanceCulling.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cstddef>
+#include <random>
+#include <set>
+
+/*
+*  clusterCull.comp run on a headless device against its CPU references: the indirect draws it writes must be the
+*  (instance, meshlet) pairs cullClustersCPU() keeps for the visible list. Clusters within a hair of a clip plane or of
+*  their cone cutoff may go either way on the GPU, they aren't compared.
+*/
+using namespace renderScene;
+
+namespace
+{
+    // BCAMERA_BLOCK_LAYOUT of built_in/camera.glsl
+    struct CameraBlock
+    {
+        glm::vec4 position;
+        glm::vec4 target;
+        glm::mat4 view;
+        glm::mat4 proj;
+    };
+
+    // clusterCull.comp only reads the transform of the per instance data
+    struct InstanceData
+    {
+        glm::mat4 _wTransform;
+    };
+
+    // the meshlets are told apart in the draws by their first index
+    constexpr uint32_t INDICES_PER_MESHLET = MeshletData::MAX_TRIANGLES * 3;
+
+    struct Scene
+    {
+        CameraBlock camera{};
+        std::vector<InstanceData> instances;
+        std::vector<uint32_t> visible;
+        std::vector<Meshlet> meshlets;
+
+        glm::mat4 viewProj() const { return camera.proj * camera.view; }
+        glm::vec3 eye() const { return glm::vec3(camera.position); }
+        uint32_t pairCount() const { return static_cast<uint32_t>(visible.size() * meshlets.size()); }
+    };
+
+    /*
+    *  Instances around and in front of the camera, a third of them left out of the visible list, some stretched
+    *  (no cone test) and some mirrored (flipped cones). Meshlets are spread over a unit mesh with random cones, a few
+    *  of them with the cutoff of 1 meshoptimizer writes for clusters that can't be cone culled.
+    */
+    Scene randomScene(uint32_t instanceCount, uint32_t meshletCount, uint32_t seed)
+    {
+        Scene scene;
+        glm::vec3 eye{ 0.0f, 2.0f, 10.0f };
+        scene.camera.position = glm::vec4(eye, 1.0f);
+        scene.camera.target = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        scene.camera.view = glm::lookAt(eye, glm::vec3(scene.camera.target), glm::vec3(0.0f, 1.0f, 0.0f));
+        scene.camera.proj = glm::perspectiveRH_ZO(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 150.0f);
+
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> position(-30.0f, 30.0f), angle(0.0f, 6.2831853f), scale(0.5f, 4.0f), unit(-1.0f, 1.0f);
+        auto randomAxis = [&] { return glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(0.0f, 0.01f, 0.0f)); };
+        for (uint32_t i = 0; i < instanceCount; i++)
+        {
+            float s = scale(rng);
+            glm::vec3 scales = i % 5 == 0 ? glm::vec3(s, 2.0f * s, s) : glm::vec3(s);
+            if (i % 7 == 0)
+                scales.x = -scales.x;
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(position(rng), position(rng) * 0.25f, position(rng) - 10.0f));
+            model = glm::scale(glm::rotate(model, angle(rng), randomAxis()), scales);
+            scene.instances.push_back({ model });
+            if (rng() % 3 != 0)
+                scene.visible.push_back(i);
+        }
+        std::shuffle(scene.visible.begin(), scene.visible.end(), rng);
+
+        std::uniform_real_distribution<float> radius(0.05f, 0.6f), cutoff(-0.6f, 0.95f);
+        for (uint32_t i = 0; i < meshletCount; i++)
+        {
+            Meshlet meshlet{};
+            glm::vec3 center{ unit(rng), unit(rng), unit(rng) };
+            meshlet.sphere = glm::vec4(center, radius(rng));
+            meshlet.coneApex = glm::vec4(center + 0.2f * randomAxis(), 0.0f);
+            meshlet.coneAxisCutoff = glm::vec4(randomAxis(), i % 6 == 0 ? 1.0f : cutoff(rng));
+            meshlet.firstIndex = i * INDICES_PER_MESHLET;
+            meshlet.vertexOffset = i * MeshletData::MAX_VERTICES;
+            meshlet.vertexCount = MeshletData::MAX_VERTICES;
+            meshlet.triangleCount = 1 + i % MeshletData::MAX_TRIANGLES;
+            scene.meshlets.push_back(meshlet);
+        }
+        return scene;
+    }
+
+    bool isClearlyKeptOrCulled(const Scene& scene, uint32_t instance, const Meshlet& meshlet, bool coneCulling)
+    {
+        auto planes = frustumPlanes(scene.viewProj());
+        const auto& model = scene.instances[instance]._wTransform;
+        Meshlet tight = meshlet, loose = meshlet;
+        tight.sphere.w *= 0.99f;
+        loose.sphere.w *= 1.01f;
+        // the cutoff of 1 turns the cone test off, it's left alone
+        if (meshlet.coneAxisCutoff.w < 1.0f)
+        {
+            tight.coneAxisCutoff.w -= 0.001f;
+            loose.coneAxisCutoff.w += 0.001f;
+        }
+        return isClusterVisible(planes, model, scene.eye(), tight, coneCulling) ==
+               isClusterVisible(planes, model, scene.eye(), loose, coneCulling);
+    }
+
+    struct ClusterDraws
+    {
+        uint32_t drawCount = 0;
+        std::vector<VkDrawIndexedIndirectCommand> commands;
+        InstanceCullStatistics statistics{};
+    };
+
+    // commands past the capacity are left as they were, the buffer is filled with this beforehand
+    constexpr uint32_t UNWRITTEN = 0xDEADBEEFu;
+
+    ClusterDraws runClusterCull(DeviceExtended* device, const Scene& scene, uint32_t drawCapacity, bool coneCulling,
+                                const ShaderManager::ShaderMacroList& macros)
+    {
+        editor_test::ComputeDispatch cull(device, "clusterCull.comp", macros);
+        uint32_t instanceCount = static_cast<uint32_t>(scene.instances.size());
+        uint32_t meshletCount = static_cast<uint32_t>(scene.meshlets.size());
+        // room past the capacity to see that nothing is written there
+        uint32_t commandSlots = drawCapacity + 64;
+
+        editor_test::HostBuffer frameGlobal(device, 32, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+        editor_test::HostBuffer camera(device, sizeof(CameraBlock), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+        editor_test::HostBuffer instances(device, instanceCount * sizeof(glm::mat4));
+        editor_test::HostBuffer meshlets(device, meshletCount * sizeof(Meshlet));
+        editor_test::HostBuffer instanceDraws(device, 2 * sizeof(uint32_t));
+        editor_test::HostBuffer visible(device, std::max<size_t>(scene.visible.size(), 1) * sizeof(uint32_t));
+        editor_test::HostBuffer draws(device, ClusterDrawCommands::size(commandSlots));
+        editor_test::HostBuffer statistics(device, sizeof(InstanceCullStatistics));
+        camera.write(&scene.camera, sizeof(CameraBlock));
+        instances.write(scene.instances);
+        meshlets.write(scene.meshlets);
+        uint32_t visibleCommand[2] = { 3, static_cast<uint32_t>(scene.visible.size()) };
+        instanceDraws.write(visibleCommand, sizeof(visibleCommand));
+        if (!scene.visible.empty())
+            visible.write(scene.visible);
+        std::vector<uint32_t> unwritten(ClusterDrawCommands::size(commandSlots) / sizeof(uint32_t), UNWRITTEN);
+        // the count is reset like ClusterCullPass does
+        unwritten[0] = 0;
+        draws.write(unwritten);
+
+        cull.bind(0, 0, frameGlobal);
+        cull.bind(1, 0, camera);
+        vk::Buffer batch[] = { instances, meshlets, instanceDraws, visible, draws };
+        for (uint32_t binding = 0; binding < 5; binding++)
+            cull.bind(2, binding, batch[binding]);
+        cull.bind(2, 8, statistics);
+
+        ClusterCullPushConstants constants{};
+        constants.meshletCount = meshletCount;
+        constants.drawCapacity = drawCapacity;
+        constants.coneCulling = coneCulling ? 1 : 0;
+        // the shader declares the block without the padding
+        editor_test::submitAndWait(device, [&](vk::CommandBuffer cmd) {
+            // one row per instance of the batch like ClusterCullPass, the rows past the visible list return
+            cull.record(cmd, (meshletCount + 63) / 64, instanceCount, &constants, offsetof(ClusterCullPushConstants, padding));
+        });
+
+        ClusterDraws result;
+        result.drawCount = *draws.read<uint32_t>();
+        auto* commands = reinterpret_cast<const VkDrawIndexedIndirectCommand*>(draws.read<uint8_t>() + ClusterDrawCommands::commandsOffset());
+        result.commands.assign(commands, commands + commandSlots);
+        result.statistics = *statistics.read<InstanceCullStatistics>();
+        return result;
+    }
+
+    std::vector<ShaderManager::ShaderMacroList> clusterCullVariants(DeviceExtended* device)
+    {
+        std::vector<ShaderManager::ShaderMacroList> variants{ {} };
+        if (device->subgroupBallotSupported)
+            variants.push_back({ { "USE_SUBGROUP_BALLOT", "1" } });
+        return variants;
+    }
+
+    void checkAgainstReference(const Scene& scene, const ClusterDraws& gpu, bool coneCulling)
+    {
+        uint32_t meshletCount = static_cast<uint32_t>(scene.meshlets.size());
+        std::set<std::pair<uint32_t, uint32_t>> drawn;
+        bool malformed = gpu.drawCount > scene.pairCount();
+        for (uint32_t i = 0; i < std::min(gpu.drawCount, scene.pairCount()); i++)
+        {
+            const auto& command = gpu.commands[i];
+            uint32_t meshlet = command.firstIndex / INDICES_PER_MESHLET;
+            if (command.firstIndex % INDICES_PER_MESHLET != 0 || meshlet >= meshletCount || command.firstInstance >= scene.instances.size() ||
+                command.indexCount != scene.meshlets[meshlet].triangleCount * 3 || command.instanceCount != 1 || command.vertexOffset != 0 ||
+                !drawn.emplace(command.firstInstance, meshlet).second)
+            {
+                malformed = true;
+            }
+        }
+        CHECK(!malformed);
+
+        auto reference = cullClustersCPU(scene.viewProj(), scene.eye(), scene.instances, scene.visible, scene.meshlets, coneCulling);
+        std::set<std::pair<uint32_t, uint32_t>> kept(reference.begin(), reference.end());
+        int compared = 0, mismatches = 0;
+        for (auto instance : scene.visible)
+        {
+            for (uint32_t m = 0; m < meshletCount; m++)
+            {
+                if (!isClearlyKeptOrCulled(scene, instance, scene.meshlets[m], coneCulling))
+                    continue;
+                compared++;
+                mismatches += kept.count({ instance, m }) != drawn.count({ instance, m }) ? 1 : 0;
+            }
+        }
+        // pairs of instances off the visible list are never drawn
+        for (auto [instance, meshlet] : drawn)
+            mismatches += std::find(scene.visible.begin(), scene.visible.end(), instance) == scene.visible.end() ? 1 : 0;
+
+        std::printf("%u pairs, %zu kept by the reference, %u drawn, %d compared\n", scene.pairCount(), reference.size(), gpu.drawCount, compared);
+        CHECK(compared > static_cast<int>(scene.pairCount()) * 9 / 10);
+        CHECK(mismatches == 0);
+        // the scene must exercise both outcomes
+        CHECK(!reference.empty() && reference.size() < scene.pairCount());
+
+        CHECK(gpu.statistics.clustersDrawn == gpu.drawCount);
+        CHECK(gpu.statistics.clustersDrawn + gpu.statistics.clustersCulled == scene.pairCount());
+        int drawnDifference = static_cast<int>(gpu.drawCount) - static_cast<int>(reference.size());
+        CHECK(std::abs(drawnDifference) <= static_cast<int>(scene.pairCount()) - compared);
+    }
+}
+
+TEST_CASE(clusterCullMatchesCullClustersCPU)
+{
+    editor_test::HeadlessDevice device;
+    for (const auto& macros : clusterCullVariants(device.device.get()))
+    {
+        std::printf("variant %s\n", ShaderManager::queryShaderVariantUUID("clusterCull.comp", macros).c_str());
+        // neither meshlet count is a multiple of the 64 wide groups
+        for (uint32_t meshletCount : { 37u, 150u })
+        {
+            auto scene = randomScene(300, meshletCount, meshletCount);
+            for (bool coneCulling : { false, true })
+            {
+                auto gpu = runClusterCull(device.device.get(), scene, scene.pairCount(), coneCulling, macros);
+                checkAgainstReference(scene, gpu, coneCulling);
+            }
+        }
+    }
+}
+
+// the count keeps every kept cluster but only the commands within the capacity are written
+TEST_CASE(clusterCullStopsWritingAtTheCapacity)
+{
+    editor_test::HeadlessDevice device;
+    for (const auto& macros : clusterCullVariants(device.device.get()))
+    {
+        auto scene = randomScene(100, 90, 5);
+        auto reference = cullClustersCPU(scene.viewProj(), scene.eye(), scene.instances, scene.visible, scene.meshlets, false);
+        REQUIRE(reference.size() > 200);
+        uint32_t capacity = 100;
+        auto gpu = runClusterCull(device.device.get(), scene, capacity, false, macros);
+        CHECK(gpu.drawCount > capacity);
+        int unwrittenWithin = 0, writtenPast = 0;
+        for (uint32_t i = 0; i < gpu.commands.size(); i++)
+        {
+            bool written = gpu.commands[i].instanceCount != UNWRITTEN;
+            unwrittenWithin += i < capacity && !written ? 1 : 0;
+            writtenPast += i >= capacity && written ? 1 : 0;
+        }
+        CHECK(unwrittenWithin == 0);
+        CHECK(writtenPast == 0);
+    }
+}
+
+// an empty visible list draws nothing and counts nothing
+TEST_CASE(clusterCullSkipsRowsPastTheVisibleList)
+{
+    editor_test::HeadlessDevice device;
+    auto scene = randomScene(50, 40, 9);
+    scene.visible.clear();
+    auto gpu = runClusterCull(device.device.get(), scene, 64, true, {});
+    CHECK(gpu.drawCount == 0);
+    CHECK(gpu.statistics.clustersDrawn == 0);
+    CHECK(gpu.statistics.clustersCulled == 0);
+}
+
+TEST_MAIN()
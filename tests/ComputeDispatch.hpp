@@ -0,0 +1,303 @@
+#pragma once
+
+#include "HeadlessDevice.hpp"
+
+#include "ShaderManager.h"
+
+#include <glm/glm.hpp>
+
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace editor_test
+{
+    // Host visible buffer the tests fill before a dispatch and read back after it
+    struct HostBuffer
+    {
+        HostBuffer(DeviceExtended* device, size_t size, VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+            : device(device), size(size)
+        {
+            VkBufferCreateInfo bufferInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+            bufferInfo.size = size;
+            bufferInfo.usage = usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+            VmaAllocationCreateInfo allocInfo = {};
+            allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+            allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+            VmaAllocationInfo allocationInfo;
+            if (vmaCreateBuffer(device->_globalVMAAllocator, &bufferInfo, &allocInfo, &buffer, &allocation, &allocationInfo) != VK_SUCCESS)
+                throw std::runtime_error("Failed to allocate host buffer");
+            mapped = static_cast<char*>(allocationInfo.pMappedData);
+            memset(mapped, 0, size);
+            vmaFlushAllocation(device->_globalVMAAllocator, allocation, 0, VK_WHOLE_SIZE);
+        }
+
+        ~HostBuffer()
+        {
+            device->deAllocateBuffer(buffer, allocation);
+        }
+
+        HostBuffer(const HostBuffer&) = delete;
+        HostBuffer& operator=(const HostBuffer&) = delete;
+
+        void write(const void* data, size_t bytes, size_t offset = 0)
+        {
+            memcpy(mapped + offset, data, bytes);
+            vmaFlushAllocation(device->_globalVMAAllocator, allocation, offset, bytes);
+        }
+
+        template<class T>
+        void write(const std::vector<T>& values)
+        {
+            write(values.data(), values.size() * sizeof(T));
+        }
+
+        template<class T>
+        const T* read()
+        {
+            vmaInvalidateAllocation(device->_globalVMAAllocator, allocation, 0, VK_WHOLE_SIZE);
+            return reinterpret_cast<const T*>(mapped);
+        }
+
+        operator vk::Buffer() const { return buffer; }
+
+        DeviceExtended* device;
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VmaAllocation allocation = VK_NULL_HANDLE;
+        char* mapped = nullptr;
+        size_t size;
+    };
+
+    // Records into a one time command buffer of the graphics queue, submits it and waits until it has finished
+    template<class RecordFn>
+    void submitAndWait(DeviceExtended* device, RecordFn&& record)
+    {
+        auto cmd = device->allocateOnceGraphicsCommand();
+        cmd.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+        record(cmd);
+        // whatever the shaders wrote is read back on the host
+        vk::MemoryBarrier toHost{ vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead };
+        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eHost, {}, toHost, {}, {});
+        cmd.end();
+        device->submitOnceGraphicsCommand(cmd)();
+    }
+
+    // Makes every earlier write of the command buffer visible to every later read and write
+    inline void fullBarrier(vk::CommandBuffer cmd)
+    {
+        vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite,
+                                   vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferRead |
+                                   vk::AccessFlagBits::eTransferWrite };
+        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eAllCommands, {}, barrier, {}, {});
+    }
+
+    /*
+    *  R32_SFLOAT image kept in the general layout, so it can be copied, sampled and stored to without transitions.
+    *  Has a view per level and one of the whole chain.
+    */
+    struct FloatImage
+    {
+        FloatImage(DeviceExtended* device, glm::uvec2 extent, uint32_t mipCount, VkImageUsageFlags usage)
+            : device(device), mipCount(mipCount)
+        {
+            VkImageCreateInfo imageInfo{};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.format = VK_FORMAT_R32_SFLOAT;
+            imageInfo.extent = VkExtent3D{ extent.x, extent.y, 1 };
+            imageInfo.mipLevels = mipCount;
+            imageInfo.arrayLayers = 1;
+            imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.usage = usage | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            auto imageRes = device->allocateVMAImage(imageInfo);
+            if (!imageRes.has_value())
+                throw std::runtime_error("Failed to allocate test image");
+            image = imageRes.value();
+
+            vk::ImageViewCreateInfo viewInfo{};
+            viewInfo.setImage(image.image);
+            viewInfo.setViewType(vk::ImageViewType::e2D);
+            viewInfo.setFormat(vk::Format::eR32Sfloat);
+            for (uint32_t level = 0; level < mipCount; level++)
+            {
+                viewInfo.setSubresourceRange({ vk::ImageAspectFlagBits::eColor, level, 1, 0, 1 });
+                levelViews.push_back(device->createImageView(viewInfo));
+            }
+            viewInfo.setSubresourceRange({ vk::ImageAspectFlagBits::eColor, 0, mipCount, 0, 1 });
+            view = device->createImageView(viewInfo);
+
+            submitAndWait(device, [&](vk::CommandBuffer cmd) {
+                vk::ImageMemoryBarrier toGeneral{};
+                toGeneral.setImage(image.image);
+                toGeneral.setSubresourceRange({ vk::ImageAspectFlagBits::eColor, 0, mipCount, 0, 1 });
+                toGeneral.setOldLayout(vk::ImageLayout::eUndefined);
+                toGeneral.setNewLayout(vk::ImageLayout::eGeneral);
+                toGeneral.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+                toGeneral.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+                toGeneral.setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite);
+                cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eAllCommands, {}, {}, {}, toGeneral);
+            });
+        }
+
+        ~FloatImage()
+        {
+            device->destroyImageView(view);
+            for (auto levelView : levelViews)
+                device->destroyImageView(levelView);
+            device->deAllocateImage(image.image, image.allocation);
+        }
+
+        FloatImage(const FloatImage&) = delete;
+        FloatImage& operator=(const FloatImage&) = delete;
+
+        // level texels from / to buffer, tightly packed rows of extent.x floats
+        void copyFrom(vk::CommandBuffer cmd, vk::Buffer buffer, uint32_t level, glm::uvec2 extent) const
+        {
+            cmd.copyBufferToImage(buffer, image.image, vk::ImageLayout::eGeneral, region(level, extent));
+        }
+
+        void copyTo(vk::CommandBuffer cmd, vk::Buffer buffer, uint32_t level, glm::uvec2 extent) const
+        {
+            cmd.copyImageToBuffer(image.image, vk::ImageLayout::eGeneral, buffer, region(level, extent));
+        }
+
+        DeviceExtended* device;
+        uint32_t mipCount;
+        VMAImage image{};
+        std::vector<vk::ImageView> levelViews;
+        vk::ImageView view;
+
+    private:
+        static vk::BufferImageCopy region(uint32_t level, glm::uvec2 extent)
+        {
+            return vk::BufferImageCopy{ 0, 0, 0, { vk::ImageAspectFlagBits::eColor, level, 0, 1 }, { 0, 0, 0 }, { extent.x, extent.y, 1 } };
+        }
+    };
+
+    /*
+    *  A compute shader of res/shaders compiled by ShaderManager, the way the passes get it, with its descriptor set
+    *  and pipeline layouts built from the reflection. Resources are bound by the set and binding the shader declares,
+    *  bindings the compiler dropped as unused are ignored.
+    */
+    struct ComputeDispatch
+    {
+        ComputeDispatch(DeviceExtended* device, const std::string& name, const ShaderManager::ShaderMacroList& macros = {})
+            : device(device)
+        {
+            shader = ShaderManager::getInstance().createComputeShader(device, name, macros);
+
+            std::map<uint32_t, std::vector<vk::DescriptorSetLayoutBinding>> setBindings;
+            std::map<vk::DescriptorType, uint32_t> descriptorCounts;
+            for (const auto& binding : shader->reflectedDescriptorBindings)
+            {
+                setBindings[binding.set].emplace_back(binding.binding, binding.type, binding.count, vk::ShaderStageFlagBits::eCompute);
+                descriptorCounts[binding.type] += binding.count;
+            }
+            // sets between the declared ones stay empty
+            uint32_t setCount = setBindings.empty() ? 0 : setBindings.rbegin()->first + 1;
+            for (uint32_t set = 0; set < setCount; set++)
+                setLayouts.push_back(device->createDescriptorSetLayout2(setBindings[set]));
+
+            if (setCount > 0)
+            {
+                std::vector<vk::DescriptorPoolSize> poolSizes;
+                for (auto [type, count] : descriptorCounts)
+                    poolSizes.emplace_back(type, count);
+                vk::DescriptorPoolCreateInfo poolInfo{};
+                poolInfo.setPoolSizes(poolSizes);
+                poolInfo.setMaxSets(setCount);
+                descriptorPool = device->createDescriptorPool(poolInfo);
+
+                vk::DescriptorSetAllocateInfo allocateInfo{};
+                allocateInfo.setDescriptorPool(descriptorPool);
+                allocateInfo.setSetLayouts(setLayouts);
+                sets = device->allocateDescriptorSets(allocateInfo);
+            }
+
+            vk::PipelineLayoutCreateInfo layoutInfo{};
+            layoutInfo.setSetLayouts(setLayouts);
+            layoutInfo.setPushConstantRanges(shader->reflectedPushConstantRanges);
+            pipelineLayout = device->createPipelineLayout(layoutInfo);
+            pipeline = VulkanComputePipelineBuilder(device->device, shader, pipelineLayout).build().getPipeline();
+        }
+
+        ~ComputeDispatch()
+        {
+            device->destroyPipeline(pipeline);
+            device->destroyPipelineLayout(pipelineLayout);
+            if (descriptorPool)
+                device->destroyDescriptorPool(descriptorPool);
+            for (auto layout : setLayouts)
+                device->destroyDescriptorSetLayout(layout);
+        }
+
+        ComputeDispatch(const ComputeDispatch&) = delete;
+        ComputeDispatch& operator=(const ComputeDispatch&) = delete;
+
+        void bind(uint32_t set, uint32_t binding, vk::Buffer buffer)
+        {
+            auto* reflected = find(set, binding);
+            if (reflected == nullptr)
+                return;
+            vk::DescriptorBufferInfo bufferInfo{ buffer, 0, VK_WHOLE_SIZE };
+            vk::WriteDescriptorSet write{ sets[set], binding, 0, 1, reflected->type, nullptr, &bufferInfo };
+            device->updateDescriptorSets(write, {});
+        }
+
+        void bind(uint32_t set, uint32_t binding, vk::ImageView view, vk::ImageLayout layout, vk::Sampler sampler = {})
+        {
+            bind(set, binding, std::vector<vk::DescriptorImageInfo>{ { sampler, view, layout } });
+        }
+
+        // the first elements of an image array
+        void bind(uint32_t set, uint32_t binding, const std::vector<vk::DescriptorImageInfo>& images)
+        {
+            auto* reflected = find(set, binding);
+            if (reflected == nullptr)
+                return;
+            vk::WriteDescriptorSet write{ sets[set], binding, 0, static_cast<uint32_t>(images.size()), reflected->type, images.data() };
+            device->updateDescriptorSets(write, {});
+        }
+
+        void record(vk::CommandBuffer cmd, uint32_t groupsX, uint32_t groupsY, const void* constants = nullptr, uint32_t constantsSize = 0) const
+        {
+            cmd.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+            if (!sets.empty())
+                cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, sets, {});
+            if (constantsSize > 0)
+                cmd.pushConstants(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, constantsSize, constants);
+            cmd.dispatch(groupsX, groupsY, 1);
+        }
+
+        template<class PushConstantsT>
+        void run(uint32_t groupsX, uint32_t groupsY, const PushConstantsT& constants) const
+        {
+            submitAndWait(device, [&](vk::CommandBuffer cmd) { record(cmd, groupsX, groupsY, &constants, sizeof(constants)); });
+        }
+
+        DeviceExtended* device;
+        ComputeShader* shader = nullptr;
+        std::vector<vk::DescriptorSetLayout> setLayouts;
+        vk::DescriptorPool descriptorPool;
+        std::vector<vk::DescriptorSet> sets;
+        vk::PipelineLayout pipelineLayout;
+        vk::Pipeline pipeline;
+
+    private:
+        const ShaderReflectedDescriptorBinding* find(uint32_t set, uint32_t binding) const
+        {
+            for (const auto& reflected : shader->reflectedDescriptorBindings)
+            {
+                if (reflected.set == set && reflected.binding == binding)
+                    return &reflected;
+            }
+            return nullptr;
+        }
+    };
+}
@@ -0,0 +1,145 @@
+#include "TestCommon.hpp"
+#include "ComputeDispatch.hpp"
+
+#include <array>
+#include <cstdio>
+#include <set>
+
+/*
+*  LinearCachedDescriptorAllocator through frames of churn: sets allocated until the pools run out, the chain growing,
+*  reset() handing the same pools out again. Implementations may serve sets past maxSets instead of failing with
+*  VK_ERROR_OUT_OF_POOL_MEMORY (lavapipe can), so the pool count is checked against the doubling bound, exact only
+*  where the driver keeps to the limits.
+*/
+namespace
+{
+    // the pools a chain starting at initial sets per pool and doubling needs for count sets
+    uint32_t poolsFor(uint32_t count, uint32_t initial)
+    {
+        uint32_t pools = 0;
+        for (uint32_t capacity = 0, next = initial; capacity < count; next *= 2)
+        {
+            capacity += next;
+            pools++;
+        }
+        return pools;
+    }
+
+    struct TestLayout
+    {
+        explicit TestLayout(DeviceExtended* device) : device(device), layout(device->device, createInfo())
+        {
+        }
+
+        ~TestLayout()
+        {
+            // DescriptorSetLayoutExtended leaves its layout alive
+            device->destroyDescriptorSetLayout(layout._layout);
+        }
+
+        static vk::DescriptorSetLayoutCreateInfo createInfo()
+        {
+            static const std::array<vk::DescriptorSetLayoutBinding, 2> bindings{
+                vk::DescriptorSetLayoutBinding{ 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+                vk::DescriptorSetLayoutBinding{ 1, vk::DescriptorType::eStorageBuffer, 2, vk::ShaderStageFlagBits::eCompute },
+            };
+            vk::DescriptorSetLayoutCreateInfo info{};
+            info.setBindings(bindings);
+            return info;
+        }
+
+        DeviceExtended* device;
+        DescriptorSetLayoutExtended layout;
+    };
+
+    // every descriptor of the set, so the layer checks the set is usable
+    void writeSet(DeviceExtended* device, vk::DescriptorSet set, const editor_test::HostBuffer& buffer)
+    {
+        std::array<vk::DescriptorBufferInfo, 3> infos{
+            // 256 is the largest offset alignment an implementation may ask for
+            vk::DescriptorBufferInfo{ buffer, 0, 64 },
+            vk::DescriptorBufferInfo{ buffer, 256, 64 },
+            vk::DescriptorBufferInfo{ buffer, 512, 64 },
+        };
+        std::array<vk::WriteDescriptorSet, 2> writes{
+            vk::WriteDescriptorSet{ set, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &infos[0] },
+            vk::WriteDescriptorSet{ set, 1, 0, 2, vk::DescriptorType::eStorageBuffer, nullptr, &infos[1] },
+        };
+        device->updateDescriptorSets(writes, nullptr);
+    }
+}
+
+TEST_CASE(poolChainGrowsWhenTheLastPoolRunsOut)
+{
+    editor_test::HeadlessDevice device;
+    TestLayout layout(device.device.get());
+    editor_test::HostBuffer buffer(device.device.get(), 768, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+    LinearCachedDescriptorAllocator allocator(device.device.get(), layout.layout, 4);
+    CHECK(allocator.getPoolCount() == 0);
+
+    std::set<vk::DescriptorSet> distinct;
+    bool keepsToLimits = true;
+    for (uint32_t count = 1; count <= 100; count++)
+    {
+        auto set = allocator.allocateSingle();
+        writeSet(device.device.get(), set, buffer);
+        distinct.insert(set);
+        // pools of 4, 8, 16, 32 and 64 sets
+        CHECK(allocator.getPoolCount() >= 1);
+        CHECK(allocator.getPoolCount() <= poolsFor(count, 4));
+        keepsToLimits = keepsToLimits && allocator.getPoolCount() == poolsFor(count, 4);
+    }
+    CHECK(distinct.size() == 100);
+    if (keepsToLimits)
+        CHECK(allocator.getPoolCount() == 5);
+    else
+        std::printf("the driver serves sets past maxSets, the chain grew to %u pools\n", allocator.getPoolCount());
+
+    allocator.destroy();
+    CHECK(allocator.getPoolCount() == 0);
+}
+
+TEST_CASE(resetRecyclesThePoolsAcrossFrames)
+{
+    editor_test::HeadlessDevice device;
+    TestLayout layout(device.device.get());
+    editor_test::HostBuffer buffer(device.device.get(), 768, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+    LinearCachedDescriptorAllocator allocator(device.device.get(), layout.layout, 8);
+    // the busiest frame sizes the chain
+    for (auto set : allocator.allocate(120))
+        writeSet(device.device.get(), set, buffer);
+    uint32_t pools = allocator.getPoolCount();
+    CHECK(pools >= 1 && pools <= poolsFor(120, 8));
+
+    // frames needing up to as many sets reuse it, whatever their order
+    for (uint32_t frame = 0; frame < 200; frame++)
+    {
+        allocator.reset();
+        uint32_t count = 1 + (frame * 37) % 120;
+        auto sets = allocator.allocate(count);
+        for (auto set : sets)
+            writeSet(device.device.get(), set, buffer);
+        CHECK(std::set<vk::DescriptorSet>(sets.begin(), sets.end()).size() == count);
+        CHECK(allocator.getPoolCount() == pools);
+    }
+
+    // a busier frame appends to the chain and the next ones keep it
+    allocator.reset();
+    allocator.allocate(240);
+    uint32_t grown = allocator.getPoolCount();
+    CHECK(grown >= pools);
+    if (pools == poolsFor(120, 8))
+        CHECK(grown == poolsFor(240, 8));
+    for (uint32_t frame = 0; frame < 10; frame++)
+    {
+        allocator.reset();
+        allocator.allocate(100);
+        CHECK(allocator.getPoolCount() == grown);
+    }
+
+    allocator.destroy();
+}
+
+TEST_MAIN()
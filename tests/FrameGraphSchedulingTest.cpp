@@ -0,0 +1,174 @@
+#include "TestCommon.hpp"
+
+#include "FrameGraphScheduling.hpp"
+
+/*
+*  The graph work of FrameGraph::compileAOT on hand built graphs. Uses are described the way compileAOT derives
+*  them from the accesses of the passes and sorted by pass like it does.
+*/
+using namespace FrameGraphScheduling;
+
+namespace
+{
+    ResourceUse read(int pass) { return { pass, true, false, false }; }
+    // Init, or a render target cleared or loaded with don't care
+    ResourceUse overwrite(int pass) { return { pass, false, true, true }; }
+    // a render target loaded with eLoad
+    ResourceUse load(int pass) { return { pass, true, true, false }; }
+
+    Resource transient(std::vector<ResourceUse> uses)
+    {
+        Resource resource;
+        resource.uses = std::move(uses);
+        return resource;
+    }
+
+    Resource output(std::vector<ResourceUse> uses)
+    {
+        auto resource = transient(std::move(uses));
+        resource.isOutput = true;
+        return resource;
+    }
+
+    std::vector<bool> allEnabled(int passCount)
+    {
+        return std::vector<bool>(passCount, true);
+    }
+}
+
+// root writes A, left and right read it and write B and C, the final pass reads both into the output
+TEST_CASE(diamondRunsEveryPassAfterWhatItReads)
+{
+    // registered in order, the order is kept
+    std::vector<Resource> resources{
+        transient({ overwrite(0), read(1), read(2) }),
+        transient({ overwrite(1), read(3) }),
+        transient({ overwrite(2), read(3) }),
+        output({ overwrite(3) }),
+    };
+    CHECK((topologicalOrder(4, resources) == std::vector<int>{ 0, 1, 2, 3 }));
+
+    // registered as final, left, root, right: A is read by left before the root writes it
+    std::vector<Resource> scrambled{
+        transient({ read(1), overwrite(2), read(3) }),
+        transient({ read(0), overwrite(1) }),
+        transient({ read(0), overwrite(3) }),
+        output({ overwrite(0) }),
+    };
+    CHECK((topologicalOrder(4, scrambled) == std::vector<int>{ 2, 1, 3, 0 }));
+}
+
+TEST_CASE(dependencyCycleThrows)
+{
+    // each pass reads what the other writes this frame
+    std::vector<Resource> resources{
+        transient({ overwrite(0), read(1) }),
+        transient({ read(0), overwrite(1) }),
+    };
+    CHECK_THROWS(topologicalOrder(2, resources));
+
+    // a persistent resource read before its write sees the previous frame, that isn't a cycle
+    resources[1].keepsContent = true;
+    CHECK((topologicalOrder(2, resources) == std::vector<int>{ 0, 1 }));
+}
+
+TEST_CASE(passesWhoseOutputNobodyReadsAreCulled)
+{
+    // 0 writes A for 1, 1 writes B nobody reads, 2 writes the output, 3 writes no declared resource
+    std::vector<Resource> resources{
+        transient({ overwrite(0), read(1) }),
+        transient({ overwrite(1) }),
+        output({ overwrite(2) }),
+    };
+    std::vector<int> order{ 0, 1, 2, 3 };
+    CHECK((livePasses(order, allEnabled(4), resources) == std::vector<bool>{ false, false, true, true }));
+
+    // once B outlives the frame both run
+    resources[1].keepsContent = true;
+    CHECK((livePasses(order, allEnabled(4), resources) == std::vector<bool>{ true, true, true, true }));
+
+    // a disabled pass doesn't run whatever it writes, nor keeps its writers
+    std::vector<bool> enabled{ true, false, true, true };
+    CHECK((livePasses(order, enabled, resources) == std::vector<bool>{ false, false, true, true }));
+}
+
+TEST_CASE(loadedRenderTargetKeepsTheEarlierWriter)
+{
+    std::vector<int> order{ 0, 1 };
+    // the second pass draws over what the first one drew
+    std::vector<Resource> loaded{ output({ overwrite(0), load(1) }) };
+    CHECK((topologicalOrder(2, loaded) == order));
+    CHECK((livePasses(order, allEnabled(2), loaded) == std::vector<bool>{ true, true }));
+
+    // cleared, the first pass is wasted
+    std::vector<Resource> cleared{ output({ overwrite(0), overwrite(1) }) };
+    CHECK((livePasses(order, allEnabled(2), cleared) == std::vector<bool>{ false, true }));
+
+    // a pass reading in between keeps it too
+    std::vector<Resource> readBetween{ output({ overwrite(0), read(1), overwrite(2) }) };
+    CHECK((livePasses({ 0, 1, 2 }, allEnabled(3), readBetween) == std::vector<bool>{ true, true, true }));
+}
+
+TEST_CASE(disjointLifetimesShareASlot)
+{
+    // A lives in passes 0-1, B in 2-3, C in 1-2 overlaps both
+    std::vector<Resource> resources{
+        transient({ overwrite(0), read(1) }),
+        transient({ overwrite(2), read(3) }),
+        transient({ overwrite(1), read(2) }),
+    };
+    auto order = topologicalOrder(4, resources);
+    auto spans = lifetimes(order, resources);
+    CHECK(spans[0].first == 0 && spans[0].last == 1);
+    CHECK(spans[1].first == 2 && spans[1].last == 3);
+    CHECK(!spans[0].overlaps(spans[1]));
+    CHECK(spans[2].overlaps(spans[0]) && spans[2].overlaps(spans[1]));
+
+    std::vector<MemoryRequirements> requirements{ { 100, 256, 0x3 }, { 80, 1024, 0x6 }, { 50, 256, 0x3 } };
+    auto plan = planAliasing(spans, requirements);
+    CHECK(plan.slotOf[0] == plan.slotOf[1]);
+    CHECK(plan.slotOf[2] != plan.slotOf[0]);
+    REQUIRE(plan.slots.size() == 2);
+    // the shared slot fits both: the larger size, the stricter alignment, the memory types both accept
+    const auto& shared = plan.slots[plan.slotOf[0]];
+    CHECK(shared.size == 100);
+    CHECK(shared.alignment == 1024);
+    CHECK(shared.memoryTypeBits == 0x2);
+    CHECK(plan.slotUsers[plan.slotOf[0]] == 2);
+    CHECK(plan.slotUsers[plan.slotOf[2]] == 1);
+
+    // no memory type in common, no sharing
+    requirements[1].memoryTypeBits = 0x4;
+    auto apart = planAliasing(spans, requirements);
+    CHECK(apart.slots.size() == 3);
+    CHECK(apart.slotOf[0] != apart.slotOf[1]);
+}
+
+TEST_CASE(peakMemoryIsTheSumOfTheSlots)
+{
+    CHECK(AliasingPlan{}.peakMemory() == 0);
+
+    // a chain of passes, each reading what the previous one wrote: only neighbours overlap
+    std::vector<Resource> resources;
+    std::vector<MemoryRequirements> requirements;
+    for (int i = 0; i < 6; i++)
+    {
+        resources.push_back(transient({ overwrite(i), read(i + 1) }));
+        requirements.push_back({ uint64_t(1000 - i * 100), 256, 0x1 });
+    }
+    resources.push_back(output({ overwrite(6) }));
+    requirements.push_back({ 10, 256, 0x1 });
+
+    auto order = topologicalOrder(7, resources);
+    auto plan = planAliasing(lifetimes(order, resources), requirements);
+    // every other resource shares: 1000 with 800 with 600 (and the output), 900 with 700 with 500
+    CHECK(plan.slots.size() == 2);
+    CHECK(plan.peakMemory() == 1000 + 900);
+
+    uint64_t unaliased = 0;
+    for (const auto& requirement : requirements)
+        unaliased += requirement.size;
+    CHECK(plan.peakMemory() < unaliased);
+}
+
+TEST_MAIN()
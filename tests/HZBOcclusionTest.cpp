@@ -0,0 +1,374 @@
+#include "TestCommon.hpp"
+#include "ComputeDispatch.hpp"
+
+#include "InstanceCulling.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <iterator>
+#include <memory>
+#include <random>
+
+/*
+*  hzbBuild.comp and the late phase of instanceCull.comp on a headless device. The pyramid must equal HZBPyramid::build()
+*  of the same depth buffer texel for texel, and the late phase must drop exactly the instances isInstanceOccluded()
+*  finds behind a scene of known occluders: a wall and a pillar in front of an empty background.
+*/
+using namespace renderScene;
+
+namespace
+{
+    // BCAMERA_BLOCK_LAYOUT of built_in/camera.glsl
+    struct CameraBlock
+    {
+        glm::vec4 position;
+        glm::vec4 target;
+        glm::mat4 view;
+        glm::mat4 proj;
+    };
+
+    // instanceCull.comp only reads the transform of the per instance data
+    struct InstanceData
+    {
+        glm::mat4 _wTransform;
+    };
+
+    // the pyramid image as HZBOcclusionPass::createPyramid() allocates it, a power of two level 0 holds the rounded up levels
+    uint32_t powerOfTwo(uint32_t size)
+    {
+        uint32_t result = 1;
+        while (result < size)
+            result *= 2;
+        return result;
+    }
+
+    // sceneDepth, the pyramid and the workgroup counter of one HZBOcclusionPass
+    struct DepthPyramid
+    {
+        DepthPyramid(DeviceExtended* device, glm::uvec2 depthSize)
+            : device(device), depthSize(depthSize),
+              mipCount(std::min(HZBPyramid::mipCount(depthSize), HZBPyramid::MAX_MIPS)),
+              depth(device, depthSize, 1, VK_IMAGE_USAGE_SAMPLED_BIT),
+              pyramid(device, { powerOfTwo((depthSize.x + 1) / 2), powerOfTwo((depthSize.y + 1) / 2) }, mipCount,
+                      VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT),
+              finishedGroups(device, sizeof(uint32_t)),
+              frameGlobal(device, 32, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT),
+              build(device, "hzbBuild.comp")
+        {
+            // texels are fetched, never filtered
+            vk::SamplerCreateInfo samplerInfo{};
+            samplerInfo.setAddressModeU(vk::SamplerAddressMode::eClampToEdge);
+            samplerInfo.setAddressModeV(vk::SamplerAddressMode::eClampToEdge);
+            samplerInfo.setAddressModeW(vk::SamplerAddressMode::eClampToEdge);
+            samplerInfo.setMagFilter(vk::Filter::eNearest);
+            samplerInfo.setMinFilter(vk::Filter::eNearest);
+            samplerInfo.setMipmapMode(vk::SamplerMipmapMode::eNearest);
+            samplerInfo.setMaxLod(VK_LOD_CLAMP_NONE);
+            sampler = device->createSampler(samplerInfo);
+
+            build.bind(0, 0, frameGlobal);
+            build.bind(1, 0, depth.view, vk::ImageLayout::eGeneral, sampler);
+            // padded with the top level like the pass does, every element is valid
+            std::vector<vk::DescriptorImageInfo> levels(HZBPyramid::MAX_MIPS);
+            for (uint32_t i = 0; i < levels.size(); i++)
+                levels[i] = vk::DescriptorImageInfo{ {}, pyramid.levelViews[std::min(i, mipCount - 1)], vk::ImageLayout::eGeneral };
+            build.bind(2, 0, levels);
+            build.bind(2, 1, finishedGroups);
+        }
+
+        ~DepthPyramid()
+        {
+            device->destroySampler(sampler);
+        }
+
+        // Uploads depthTexels as sceneDepth, builds the pyramid and reads all of its levels back
+        HZBPyramid buildOnGPU(const std::vector<float>& depthTexels)
+        {
+            HZBPyramid result;
+            result.depthSize = depthSize;
+            std::vector<std::unique_ptr<editor_test::HostBuffer>> readbacks;
+            glm::uvec2 size = depthSize;
+            for (uint32_t level = 0; level < mipCount; level++)
+            {
+                size = (size + 1u) / 2u;
+                result.sizes.push_back(size);
+                readbacks.push_back(std::make_unique<editor_test::HostBuffer>(device, size_t(size.x) * size.y * sizeof(float)));
+            }
+
+            editor_test::HostBuffer upload(device, depthTexels.size() * sizeof(float));
+            upload.write(depthTexels);
+            // every workgroup reduces 64x64 texels of sceneDepth
+            glm::uvec2 groups = (depthSize + 63u) / 64u;
+            struct
+            {
+                glm::uvec2 depthSize;
+                uint32_t mipCount;
+                uint32_t groupCount;
+            } constants{ depthSize, mipCount, groups.x * groups.y };
+
+            editor_test::submitAndWait(device, [&](vk::CommandBuffer cmd) {
+                depth.copyFrom(cmd, upload, 0, depthSize);
+                editor_test::fullBarrier(cmd);
+                build.record(cmd, groups.x, groups.y, &constants, sizeof(constants));
+                editor_test::fullBarrier(cmd);
+                for (uint32_t level = 0; level < mipCount; level++)
+                    pyramid.copyTo(cmd, *readbacks[level], level, result.sizes[level]);
+            });
+            for (uint32_t level = 0; level < mipCount; level++)
+            {
+                auto* texels = readbacks[level]->read<float>();
+                result.levels.emplace_back(texels, texels + size_t(result.sizes[level].x) * result.sizes[level].y);
+            }
+            return result;
+        }
+
+        DeviceExtended* device;
+        glm::uvec2 depthSize;
+        uint32_t mipCount;
+        editor_test::FloatImage depth;
+        editor_test::FloatImage pyramid;
+        editor_test::HostBuffer finishedGroups;
+        editor_test::HostBuffer frameGlobal;
+        editor_test::ComputeDispatch build;
+        vk::Sampler sampler;
+    };
+
+    int mismatchedTexels(const HZBPyramid& gpu, const HZBPyramid& reference)
+    {
+        if (gpu.levels.size() != reference.levels.size())
+            return -1;
+        int mismatches = 0;
+        for (size_t level = 0; level < reference.levels.size(); level++)
+        {
+            for (size_t i = 0; i < reference.levels[level].size(); i++)
+                mismatches += gpu.levels[level][i] != reference.levels[level][i] ? 1 : 0;
+        }
+        return mismatches;
+    }
+
+    std::vector<float> randomDepth(glm::uvec2 size, uint32_t seed)
+    {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> value(0.0f, 1.0f);
+        std::vector<float> depth(size_t(size.x) * size.y);
+        for (auto& texel : depth)
+            texel = value(rng);
+        return depth;
+    }
+
+    // View space rectangle facing the camera at z = -distance
+    struct Occluder
+    {
+        float distance;
+        glm::vec2 min;
+        glm::vec2 max;
+    };
+
+    // What the G-buffer would hold for the occluders in front of an empty background, texel (0, 0) at ndc (-1, -1)
+    std::vector<float> renderDepth(const glm::mat4& proj, glm::uvec2 size, const std::vector<Occluder>& occluders)
+    {
+        glm::mat4 invProj = glm::inverse(proj);
+        std::vector<float> depth(size_t(size.x) * size.y, 1.0f);
+        for (uint32_t y = 0; y < size.y; y++)
+        {
+            for (uint32_t x = 0; x < size.x; x++)
+            {
+                glm::vec2 ndc = (glm::vec2(x, y) + 0.5f) / glm::vec2(size) * 2.0f - 1.0f;
+                for (const auto& occluder : occluders)
+                {
+                    glm::vec4 clip = proj * glm::vec4(0.0f, 0.0f, -occluder.distance, 1.0f);
+                    float z = clip.z / clip.w;
+                    glm::vec4 p = invProj * glm::vec4(ndc, z, 1.0f);
+                    glm::vec2 onPlane = glm::vec2(p) / p.w;
+                    if (glm::all(glm::greaterThanEqual(onPlane, occluder.min)) && glm::all(glm::lessThanEqual(onPlane, occluder.max)))
+                        depth[y * size.x + x] = std::min(depth[y * size.x + x], z);
+                }
+            }
+        }
+        return depth;
+    }
+}
+
+TEST_CASE(pyramidMatchesHZBPyramidBuild)
+{
+    editor_test::HeadlessDevice device;
+    // a single workgroup, several with a ragged edge, a single texel and a sliver that takes 10 levels past the tiles
+    for (glm::uvec2 size : { glm::uvec2(64, 64), glm::uvec2(300, 200), glm::uvec2(1, 1), glm::uvec2(1000, 7) })
+    {
+        DepthPyramid pyramid(device.device.get(), size);
+        // twice, the last workgroup of the first build must have reset the counter for the second one
+        for (uint32_t seed : { 1u, 2u })
+        {
+            auto depth = randomDepth(size, seed * size.x);
+            auto gpu = pyramid.buildOnGPU(depth);
+            auto mismatches = mismatchedTexels(gpu, HZBPyramid::build(depth, size));
+            std::printf("%ux%u depth, %u levels, %d mismatched texels\n", size.x, size.y, pyramid.mipCount, mismatches);
+            CHECK(mismatches == 0);
+            CHECK(*pyramid.finishedGroups.read<uint32_t>() == 0);
+        }
+    }
+}
+
+/*
+*  A wall covering the left half of the view at 10 units and a pillar at 20 units. Boxes behind them must be dropped
+*  by the late phase, the ones in front, beside them, straddling the edge of the wall or crossing the near plane kept.
+*/
+TEST_CASE(latePhaseDropsInstancesBehindKnownOccluders)
+{
+    editor_test::HeadlessDevice device;
+    DeviceExtended* dev = device.device.get();
+    constexpr glm::uvec2 DEPTH_SIZE{ 320, 180 };
+
+    CameraBlock camera{};
+    camera.position = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    camera.target = glm::vec4(0.0f, 0.0f, -1.0f, 1.0f);
+    camera.view = glm::mat4(1.0f);
+    camera.proj = glm::perspectiveRH_ZO(glm::radians(60.0f), float(DEPTH_SIZE.x) / float(DEPTH_SIZE.y), 0.5f, 100.0f);
+    glm::mat4 viewProj = camera.proj * camera.view;
+
+    std::vector<Occluder> occluders{ { 10.0f, { -30.0f, -30.0f }, { 1.0f, 30.0f } },
+                                     { 20.0f, { 3.0f, -30.0f }, { 7.0f, 30.0f } } };
+    auto depth = renderDepth(camera.proj, DEPTH_SIZE, occluders);
+
+    DepthPyramid pyramid(dev, DEPTH_SIZE);
+    auto gpuPyramid = pyramid.buildOnGPU(depth);
+    auto reference = HZBPyramid::build(depth, DEPTH_SIZE);
+    CHECK(mismatchedTexels(gpuPyramid, reference) == 0);
+
+    glm::vec3 aabbMin{ -0.5f }, aabbMax{ 0.5f };
+    struct Known
+    {
+        const char* name;
+        glm::vec3 position;
+        bool visible;
+    };
+    const Known known[] = {
+        { "behind the wall", { -10.0f, 0.0f, -30.0f }, false },
+        { "behind the pillar", { 10.0f, 0.0f, -40.0f }, false },
+        { "in front of the wall", { -3.0f, 0.0f, -6.0f }, true },
+        { "beside the occluders", { 20.0f, 0.0f, -30.0f }, true },
+        { "across the wall edge", { 3.0f, 0.0f, -30.0f }, true },
+        { "across the near plane", { 0.0f, 0.0f, -0.4f }, true },
+        { "behind the camera", { 0.0f, 0.0f, 10.0f }, false },
+    };
+    std::vector<InstanceData> instances;
+    for (const auto& k : known)
+        instances.push_back({ glm::translate(glm::mat4(1.0f), k.position) });
+    // random boxes all over the view, compared against the reference
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> x(-40.0f, 40.0f), y(-10.0f, 10.0f), z(-90.0f, -2.0f), angle(0.0f, 6.2831853f), scale(0.3f, 2.0f);
+    for (int i = 0; i < 3000; i++)
+    {
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(x(rng), y(rng), z(rng)));
+        model = glm::scale(glm::rotate(model, angle(rng), glm::vec3(0.0f, 1.0f, 0.0f)), glm::vec3(scale(rng)));
+        instances.push_back({ model });
+    }
+    uint32_t n = static_cast<uint32_t>(instances.size());
+
+    // expectations and whether the instance is far enough from any decision boundary to be compared
+    std::vector<bool> expectVisible(n), comparable(n);
+    for (uint32_t i = 0; i < n; i++)
+    {
+        const auto& model = instances[i]._wTransform;
+        auto visibleAt = [&](float s) {
+            return isInstanceVisible(viewProj, model, s * aabbMin, s * aabbMax) && !isInstanceOccluded(viewProj, model, s * aabbMin, s * aabbMax, reference);
+        };
+        expectVisible[i] = visibleAt(1.0f);
+        comparable[i] = visibleAt(0.97f) == expectVisible[i] && visibleAt(1.03f) == expectVisible[i];
+    }
+    for (uint32_t i = 0; i < std::size(known); i++)
+    {
+        // the scene is laid out so that the reference agrees with the known answers, with a margin
+        CHECK(comparable[i]);
+        CHECK(expectVisible[i] == known[i].visible);
+    }
+
+    InstanceCullPushConstants constants{};
+    constants.aabbMin = glm::vec4(aabbMin, 0.0f);
+    constants.aabbMax = glm::vec4(aabbMax, 0.0f);
+    constants.instanceCount = n;
+    constants.occlusionCulling = 1;
+    constants.hzbMipCount = pyramid.mipCount;
+    constants.depthSize = DEPTH_SIZE;
+    constants.lodCount = 1;
+
+    ShaderManager::ShaderMacroList macros{ { "LATE_PHASE", "1" } };
+    if (dev->subgroupBallotSupported)
+        macros.emplace_back("USE_SUBGROUP_BALLOT", "1");
+    editor_test::ComputeDispatch cull(dev, "instanceCull.comp", macros);
+    size_t listBytes = size_t(MeshLodChain::MAX_LODS) * n * sizeof(uint32_t);
+    editor_test::HostBuffer cameraBuffer(dev, sizeof(CameraBlock), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+    editor_test::HostBuffer statistics(dev, sizeof(InstanceCullStatistics));
+    editor_test::HostBuffer instanceBuffer(dev, n * sizeof(glm::mat4));
+    editor_test::HostBuffer masks(dev, n * sizeof(uint32_t));
+    editor_test::HostBuffer visible(dev, listBytes);
+    editor_test::HostBuffer selected(dev, listBytes);
+    editor_test::HostBuffer draws(dev, sizeof(InstanceCullDrawCommands));
+    editor_test::HostBuffer late(dev, listBytes);
+    editor_test::HostBuffer visibility(dev, n * sizeof(uint32_t));
+    cameraBuffer.write(&camera, sizeof(camera));
+    instanceBuffer.write(instances);
+
+    cull.bind(0, 0, pyramid.frameGlobal);
+    cull.bind(2, 2, pyramid.pyramid.view, vk::ImageLayout::eGeneral, pyramid.sampler);
+    cull.bind(3, 0, cameraBuffer);
+    cull.bind(3, 1, statistics);
+    vk::Buffer batch[] = { instanceBuffer, masks, visible, selected, draws, late, visibility };
+    for (uint32_t binding = 0; binding < 7; binding++)
+        cull.bind(4, binding, batch[binding]);
+
+    // first frame, nothing was visible before: every visible instance is drawn late
+    cull.run((n + 63) / 64, 1, constants);
+    auto* commands = draws.read<InstanceCullDrawCommands>();
+    uint32_t lateCount = commands->late[0].command.instanceCount;
+    CHECK(lateCount <= n);
+    std::vector<int> listedLate(n, 0);
+    auto* lateIndices = late.read<uint32_t>();
+    for (uint32_t i = 0; i < std::min(lateCount, n); i++)
+    {
+        if (lateIndices[i] < n)
+            listedLate[lateIndices[i]]++;
+    }
+    auto* visibleNow = visibility.read<uint32_t>();
+
+    int compared = 0, listMismatches = 0, visibilityMismatches = 0, duplicates = 0, expectedOccluded = 0;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        duplicates += listedLate[i] > 1 ? 1 : 0;
+        if (!comparable[i])
+            continue;
+        compared++;
+        listMismatches += (listedLate[i] > 0) != expectVisible[i] ? 1 : 0;
+        visibilityMismatches += (visibleNow[i] != 0) != expectVisible[i] ? 1 : 0;
+        bool inFrustum = isInstanceVisible(viewProj, instances[i]._wTransform, aabbMin, aabbMax);
+        expectedOccluded += inFrustum && !expectVisible[i] ? 1 : 0;
+    }
+    for (uint32_t i = 0; i < std::size(known); i++)
+    {
+        if ((listedLate[i] > 0) != known[i].visible)
+            std::printf("instance %s is %s\n", known[i].name, listedLate[i] > 0 ? "drawn" : "culled");
+    }
+    std::printf("%u instances, %d compared, %d of them occluded\n", n, compared, expectedOccluded);
+    CHECK(compared > static_cast<int>(n) * 9 / 10);
+    CHECK(expectedOccluded > 100);
+    CHECK(duplicates == 0);
+    CHECK(listMismatches == 0);
+    CHECK(visibilityMismatches == 0);
+    CHECK(commands->late[0].drawCount == (lateCount > 0 ? 1u : 0u));
+
+    auto counters = *statistics.read<InstanceCullStatistics>();
+    CHECK(counters.drawnLate == lateCount);
+    CHECK(counters.drawnPerLod[0] == lateCount);
+    CHECK(std::abs(static_cast<int>(counters.occlusionCulled) - expectedOccluded) <= static_cast<int>(n) - compared);
+
+    // second frame from the same view, everything visible was drawn early already
+    std::vector<uint32_t> zeros(sizeof(InstanceCullDrawCommands) / sizeof(uint32_t), 0);
+    draws.write(zeros);
+    statistics.write(std::vector<uint32_t>(sizeof(InstanceCullStatistics) / sizeof(uint32_t), 0));
+    cull.run((n + 63) / 64, 1, constants);
+    CHECK(draws.read<InstanceCullDrawCommands>()->late[0].command.instanceCount == 0);
+    CHECK(statistics.read<InstanceCullStatistics>()->drawnLate == 0);
+    CHECK(statistics.read<InstanceCullStatistics>()->occlusionCulled == counters.occlusionCulled);
+}
+
+TEST_MAIN()
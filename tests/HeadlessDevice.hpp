@@ -0,0 +1,140 @@
+#pragma once
+
+#include "TestCommon.hpp"
+
+#include "ShaderManager.h"
+#include "VulkanExtension.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+
+namespace editor_test
+{
+    /*
+    *  Vulkan 1.3 instance and device without a window or surface, created on whatever driver is installed
+    *  (lavapipe in CI). The calling case is skipped when there is none.
+    *  The device enables the features every editor component assumes: timeline semaphores, synchronization2,
+    *  buffer device address, descriptor indexing and dynamically indexed storage image arrays.
+    *  When the Khronos validation layer is installed it runs with synchronization validation, every error it reports
+    *  fails the case. EDITOR_TEST_REQUIRE_VALIDATION=1 turns a missing layer into a failure, CI sets it.
+    */
+    struct HeadlessDevice
+    {
+        HeadlessDevice()
+        {
+            auto system = vkb::SystemInfo::get_system_info();
+            if (!system)
+                TEST_SKIP("no Vulkan loader: " + system.error().message());
+            validated = system.value().validation_layers_available;
+            if (!validated && isValidationRequired())
+                throw std::runtime_error("EDITOR_TEST_REQUIRE_VALIDATION is set but the validation layer is not installed");
+
+            vkb::InstanceBuilder builder;
+            builder.set_app_name("pbrt editor test")
+                .require_api_version(1, 3)
+                .set_headless(true)
+                // the editor names its objects through debug utils
+                .enable_extension(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+            if (validated)
+            {
+                builder.enable_validation_layers()
+                    .add_validation_feature_enable(VK_VALIDATION_FEATURE_ENABLE_SYNCHRONIZATION_VALIDATION_EXT)
+                    .set_debug_callback(onValidationMessage)
+                    .set_debug_callback_user_data_pointer(this)
+                    .set_debug_messenger_severity(VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT)
+                    .set_debug_messenger_type(VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT);
+            }
+            auto inst = builder.build();
+            if (!inst)
+                TEST_SKIP("no Vulkan instance: " + inst.error().message());
+            instance = inst.value();
+
+            VkPhysicalDeviceFeatures features{};
+            features.shaderStorageImageArrayDynamicIndexing = VK_TRUE;
+
+            VkPhysicalDeviceVulkan12Features features12{};
+            features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+            features12.timelineSemaphore = VK_TRUE;
+            features12.bufferDeviceAddress = VK_TRUE;
+            features12.descriptorIndexing = VK_TRUE;
+            features12.runtimeDescriptorArray = VK_TRUE;
+            features12.descriptorBindingPartiallyBound = VK_TRUE;
+
+            VkPhysicalDeviceVulkan13Features features13{};
+            features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+            features13.synchronization2 = VK_TRUE;
+
+            auto phy = vkb::PhysicalDeviceSelector(instance)
+                .set_minimum_version(1, 3)
+                .set_required_features(features)
+                .set_required_features_12(features12)
+                .set_required_features_13(features13)
+                .select();
+            if (!phy)
+            {
+                vkb::destroy_instance(instance);
+                TEST_SKIP("no suitable Vulkan device: " + phy.error().message());
+            }
+
+            auto dev = vkb::DeviceBuilder(phy.value()).build();
+            if (!dev)
+            {
+                vkb::destroy_instance(instance);
+                TEST_SKIP("failed to create Vulkan device: " + dev.error().message());
+            }
+            vkbDevice = dev.value();
+            device = std::make_unique<DeviceExtended>(vkbDevice, instance.instance);
+        }
+
+        ~HeadlessDevice()
+        {
+            device->waitIdle();
+            // the shader manager outlives the device, the next case compiles its shaders for a new one
+            ShaderManager::getInstance().releaseShaders(device.get());
+            device.reset();
+            vkb::destroy_device(vkbDevice);
+            vkb::destroy_instance(instance);
+            // objects left alive are reported while the device and the instance are destroyed
+            CHECK(validationErrors == 0);
+        }
+
+        HeadlessDevice(const HeadlessDevice&) = delete;
+        HeadlessDevice& operator=(const HeadlessDevice&) = delete;
+
+        DeviceExtended* operator->() const { return device.get(); }
+
+        // for the cases provoking errors on purpose, the count starts over
+        int takeValidationErrors()
+        {
+            return validationErrors.exchange(0);
+        }
+
+        static bool isValidationRequired()
+        {
+            const char* required = std::getenv("EDITOR_TEST_REQUIRE_VALIDATION");
+            return required != nullptr && *required != '\0' && std::string(required) != "0";
+        }
+
+        vkb::Instance instance;
+        vkb::Device vkbDevice;
+        std::unique_ptr<DeviceExtended> device;
+        // the layer is loaded, with synchronization validation
+        bool validated = false;
+
+    private:
+        static VKAPI_ATTR VkBool32 VKAPI_CALL onValidationMessage(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT,
+                                                                  const VkDebugUtilsMessengerCallbackDataEXT* data, void* user)
+        {
+            bool error = (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) != 0;
+            std::fprintf(stderr, "validation %s: %s\n", error ? "error" : "warning", data->pMessage);
+            if (error)
+                static_cast<HeadlessDevice*>(user)->validationErrors++;
+            return VK_FALSE;
+        }
+
+        // the layer calls back from whichever thread made the call
+        std::atomic<int> validationErrors{ 0 };
+    };
+}
@@ -0,0 +1,99 @@
+#include "TestCommon.hpp"
+
+#include "PBRTParser.h"
+#include "TokenParser.h"
+
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+*  Runs PBRTParser's tokenize and stitch stage with a recording TokenParser in place of the real one
+*  (TokenParser.cpp is not linked), so the token stream the builder would see can be checked without
+*  a scene builder or an asset manager.
+*/
+struct PBRTSceneBuilder {};
+struct AssetManager {};
+
+namespace
+{
+    std::vector<std::string> recorded;
+
+    void record(Token& token, PBRTSceneBuilder&, LockFreeCircleQueue<Token>&, AssetManager&)
+    {
+        recorded.push_back(token.to_string());
+    }
+
+    void writeFile(const std::filesystem::path& path, const std::string& content)
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << content;
+    }
+
+    std::vector<std::string> parse(const std::filesystem::path& root)
+    {
+        recorded.clear();
+        PBRTParser parser;
+        PBRTSceneBuilder builder;
+        AssetManager assets;
+        parser.parse(builder, root, assets);
+        return recorded;
+    }
+}
+
+std::unordered_map<std::string_view, DirectiveHandler> TokenParser::handlers;
+
+TokenParser::TokenParser()
+{
+    for (const char* name : { "WorldBegin", "AttributeBegin", "AttributeEnd", "Translate", "Material",
+                              "ReverseOrientation", "Shape" })
+        handlers[name] = record;
+}
+
+TEST_CASE(includeIsSplicedInPlace)
+{
+    editor_test::TempDirectory dir;
+    writeFile(dir / "main.pbrt", "WorldBegin\nInclude \"inc.pbrt\"\nShape \"sphere\"\n");
+    writeFile(dir / "inc.pbrt", "Translate 1 0 0\nMaterial \"diffuse\"\n");
+    std::vector<std::string> expected{ "WorldBegin", "Translate", "Material", "Shape" };
+    CHECK(parse(dir / "main.pbrt") == expected);
+}
+
+TEST_CASE(importIsScopedByAnAttributeBlock)
+{
+    editor_test::TempDirectory dir;
+    writeFile(dir / "main.pbrt", "WorldBegin\nImport \"imp.pbrt\"\nShape \"sphere\"\n");
+    writeFile(dir / "imp.pbrt", "ReverseOrientation\nTranslate 1 0 0\nInclude \"nested.pbrt\"\n");
+    writeFile(dir / "nested.pbrt", "Material \"diffuse\"\nShape \"sphere\"\n");
+    std::vector<std::string> expected{ "WorldBegin", "AttributeBegin", "ReverseOrientation", "Translate",
+                                       "Material", "Shape", "AttributeEnd", "Shape" };
+    CHECK(parse(dir / "main.pbrt") == expected);
+}
+
+TEST_CASE(manyImportsKeepDirectiveOrder)
+{
+    // enough files for the pool to tokenize some of them ahead of the stitcher
+    editor_test::TempDirectory dir;
+    std::string main = "WorldBegin\n";
+    std::vector<std::string> expected{ "WorldBegin" };
+    for (int i = 0; i < 64; i++) {
+        auto name = "part" + std::to_string(i) + ".pbrt";
+        main += (i % 2 ? "Include \"" : "Import \"") + name + "\"\n";
+        std::string body;
+        if (i % 2 == 0)
+            expected.push_back("AttributeBegin");
+        for (int j = 0; j <= i % 5; j++) {
+            body += "Translate " + std::to_string(i) + " 0 0\nShape \"sphere\"\n";
+            expected.push_back("Translate");
+            expected.push_back("Shape");
+        }
+        if (i % 2 == 0)
+            expected.push_back("AttributeEnd");
+        writeFile(dir / name, body);
+    }
+    writeFile(dir / "main.pbrt", main);
+    CHECK(parse(dir / "main.pbrt") == expected);
+}
+
+TEST_MAIN()
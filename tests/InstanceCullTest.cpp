@@ -0,0 +1,254 @@
+#include "TestCommon.hpp"
+#include "ComputeDispatch.hpp"
+
+#include "InstanceCulling.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <random>
+
+/*
+*  The early phase of instanceCull.comp run on a headless device against its CPU references: the visible and selected
+*  lists must hold the instances cullInstancesCPU() keeps, each at the level selectInstanceLod() picks.
+*  Instances within a hair of a clip plane or of a level switch may go either way on the GPU, they aren't compared.
+*/
+using namespace renderScene;
+
+namespace
+{
+    // BCAMERA_BLOCK_LAYOUT of built_in/camera.glsl
+    struct CameraBlock
+    {
+        glm::vec4 position;
+        glm::vec4 target;
+        glm::mat4 view;
+        glm::mat4 proj;
+    };
+
+    // instanceCull.comp only reads the transform of the per instance data
+    struct InstanceData
+    {
+        glm::mat4 _wTransform;
+    };
+
+    struct Scene
+    {
+        CameraBlock camera{};
+        std::vector<InstanceData> instances;
+        std::vector<uint32_t> masks;
+        std::vector<uint32_t> lastVisibility;
+        glm::vec3 aabbMin{ -1.0f, -0.5f, -1.0f };
+        glm::vec3 aabbMax{ 1.0f, 1.5f, 1.0f };
+        InstanceCullPushConstants constants{};
+
+        glm::mat4 viewProj() const { return camera.proj * camera.view; }
+        uint32_t count() const { return static_cast<uint32_t>(instances.size()); }
+    };
+
+    // Instances scattered all around the camera, rotated and scaled, a quarter of them selected
+    Scene randomScene(uint32_t count, uint32_t seed)
+    {
+        Scene scene;
+        glm::vec3 eye{ 0.0f, 2.0f, 10.0f };
+        scene.camera.position = glm::vec4(eye, 1.0f);
+        scene.camera.target = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        scene.camera.view = glm::lookAt(eye, glm::vec3(scene.camera.target), glm::vec3(0.0f, 1.0f, 0.0f));
+        scene.camera.proj = glm::perspectiveRH_ZO(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 150.0f);
+
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> position(-80.0f, 80.0f), angle(0.0f, 6.2831853f), scale(0.2f, 3.0f), unit(-1.0f, 1.0f);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            glm::vec3 axis = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(0.0f, 0.01f, 0.0f));
+            float s = scale(rng);
+            // every 8th one is stretched along an axis
+            glm::vec3 scales = i % 8 == 0 ? glm::vec3(s, 2.0f * s, s) : glm::vec3(s);
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(position(rng), position(rng) * 0.25f, position(rng)));
+            model = glm::scale(glm::rotate(model, angle(rng), axis), scales);
+            scene.instances.push_back({ model });
+            scene.masks.push_back(rng() % 4);
+            scene.lastVisibility.push_back(rng() % 2);
+        }
+
+        auto& constants = scene.constants;
+        constants.aabbMin = glm::vec4(scene.aabbMin, 0.0f);
+        constants.aabbMax = glm::vec4(scene.aabbMax, 0.0f);
+        constants.instanceCount = count;
+        constants.selectedMask = 1;
+        constants.hzbMipCount = 1;
+        constants.depthSize = { 1, 1 };
+        constants.lodCount = 4;
+        // 1080 pixels high, a pixel of error
+        constants.lodScale = 540.0f * scene.camera.proj[1][1];
+        const float errors[] = { 0.0f, 0.005f, 0.02f, 0.08f };
+        std::copy(std::begin(errors), std::end(errors), constants.lodErrors);
+        return scene;
+    }
+
+    bool isClearlyInOrOut(const Scene& scene, const glm::mat4& model)
+    {
+        glm::vec3 center = 0.5f * (scene.aabbMin + scene.aabbMax);
+        glm::vec3 half = 0.5f * (scene.aabbMax - scene.aabbMin);
+        return isInstanceVisible(scene.viewProj(), model, center - 0.99f * half, center + 0.99f * half) ==
+               isInstanceVisible(scene.viewProj(), model, center - 1.01f * half, center + 1.01f * half);
+    }
+
+    bool isClearlyAtItsLevel(const Scene& scene, const glm::mat4& model)
+    {
+        const auto& c = scene.constants;
+        glm::vec3 eye{ scene.camera.position };
+        return selectInstanceLod(model, eye, scene.aabbMin, scene.aabbMax, c.lodErrors, c.lodCount, c.lodScale * 0.999f) ==
+               selectInstanceLod(model, eye, scene.aabbMin, scene.aabbMax, c.lodErrors, c.lodCount, c.lodScale * 1.001f);
+    }
+
+    constexpr uint32_t NOT_LISTED = ~0u;
+
+    struct CulledLists
+    {
+        // level each instance is listed at, NOT_LISTED for the culled ones
+        std::vector<uint32_t> visibleLod;
+        std::vector<uint32_t> selectedLod;
+        // an instance listed twice, a count above the instance count or a draw count out of step with its list
+        bool malformed = false;
+        InstanceCullStatistics statistics{};
+    };
+
+    CulledLists runEarlyPhase(DeviceExtended* device, const Scene& scene, const ShaderManager::ShaderMacroList& macros)
+    {
+        editor_test::ComputeDispatch cull(device, "instanceCull.comp", macros);
+        uint32_t n = scene.count();
+        size_t listBytes = size_t(MeshLodChain::MAX_LODS) * n * sizeof(uint32_t);
+
+        editor_test::HostBuffer frameGlobal(device, 32, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+        editor_test::HostBuffer camera(device, sizeof(CameraBlock), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+        editor_test::HostBuffer statistics(device, sizeof(InstanceCullStatistics));
+        editor_test::HostBuffer instances(device, n * sizeof(glm::mat4));
+        editor_test::HostBuffer masks(device, n * sizeof(uint32_t));
+        editor_test::HostBuffer visible(device, listBytes);
+        editor_test::HostBuffer selected(device, listBytes);
+        editor_test::HostBuffer draws(device, sizeof(InstanceCullDrawCommands));
+        editor_test::HostBuffer late(device, listBytes);
+        editor_test::HostBuffer visibility(device, n * sizeof(uint32_t));
+        camera.write(&scene.camera, sizeof(CameraBlock));
+        instances.write(scene.instances);
+        masks.write(scene.masks);
+        visibility.write(scene.lastVisibility);
+
+        cull.bind(0, 0, frameGlobal);
+        cull.bind(1, 0, camera);
+        cull.bind(1, 1, statistics);
+        vk::Buffer batch[] = { instances, masks, visible, selected, draws, late, visibility };
+        for (uint32_t binding = 0; binding < 7; binding++)
+            cull.bind(2, binding, batch[binding]);
+        cull.run((n + 63) / 64, 1, scene.constants);
+
+        CulledLists result;
+        result.visibleLod.assign(n, NOT_LISTED);
+        result.selectedLod.assign(n, NOT_LISTED);
+        auto* commands = draws.read<InstanceCullDrawCommands>();
+        auto collect = [&](const InstanceCullDrawCommands::Draw* listDraws, editor_test::HostBuffer& list, std::vector<uint32_t>& lodOf) {
+            auto* indices = list.read<uint32_t>();
+            for (uint32_t l = 0; l < scene.constants.lodCount; l++)
+            {
+                uint32_t count = listDraws[l].command.instanceCount;
+                result.malformed |= count > n || listDraws[l].drawCount != (count > 0 ? 1u : 0u);
+                for (uint32_t i = 0; i < std::min(count, n); i++)
+                {
+                    uint32_t index = indices[l * n + i];
+                    if (index >= n || lodOf[index] != NOT_LISTED)
+                        result.malformed = true;
+                    else
+                        lodOf[index] = l;
+                }
+            }
+        };
+        collect(commands->visible, visible, result.visibleLod);
+        collect(commands->selected, selected, result.selectedLod);
+        result.statistics = *statistics.read<InstanceCullStatistics>();
+        return result;
+    }
+
+    // Every variant the device can run, the passes pick the ballot one when the device supports it
+    std::vector<ShaderManager::ShaderMacroList> earlyVariants(DeviceExtended* device)
+    {
+        std::vector<ShaderManager::ShaderMacroList> variants{ {} };
+        if (device->subgroupBallotSupported)
+            variants.push_back({ { "USE_SUBGROUP_BALLOT", "1" } });
+        return variants;
+    }
+
+    void checkAgainstReference(const Scene& scene, const CulledLists& gpu, bool occlusionCulling)
+    {
+        CHECK(!gpu.malformed);
+        auto reference = cullInstancesCPU(scene.viewProj(), scene.instances, scene.aabbMin, scene.aabbMax);
+        auto lods = selectLodsCPU(glm::vec3(scene.camera.position), scene.instances, scene.aabbMin, scene.aabbMax, scene.constants);
+        std::vector<bool> inFrustum(scene.count(), false);
+        for (auto index : reference)
+            inFrustum[index] = true;
+
+        int compared = 0, visibleMismatches = 0, selectedMismatches = 0, lodMismatches = 0;
+        uint32_t listed = 0, culled = 0;
+        for (uint32_t i = 0; i < scene.count(); i++)
+        {
+            listed += gpu.visibleLod[i] != NOT_LISTED ? 1 : 0;
+            culled += inFrustum[i] ? 0 : 1;
+            if (!isClearlyInOrOut(scene, scene.instances[i]._wTransform))
+                continue;
+            compared++;
+            bool expectVisible = inFrustum[i] && (!occlusionCulling || scene.lastVisibility[i] != 0);
+            bool expectSelected = inFrustum[i] && scene.masks[i] == scene.constants.selectedMask;
+            visibleMismatches += expectVisible != (gpu.visibleLod[i] != NOT_LISTED) ? 1 : 0;
+            selectedMismatches += expectSelected != (gpu.selectedLod[i] != NOT_LISTED) ? 1 : 0;
+            if (isClearlyAtItsLevel(scene, scene.instances[i]._wTransform))
+            {
+                lodMismatches += expectVisible && gpu.visibleLod[i] != NOT_LISTED && gpu.visibleLod[i] != lods[i] ? 1 : 0;
+                lodMismatches += expectSelected && gpu.selectedLod[i] != NOT_LISTED && gpu.selectedLod[i] != lods[i] ? 1 : 0;
+            }
+        }
+        std::printf("%u instances, %zu in the frustum, %d compared\n", scene.count(), reference.size(), compared);
+        CHECK(compared > static_cast<int>(scene.count()) * 9 / 10);
+        CHECK(visibleMismatches == 0);
+        CHECK(selectedMismatches == 0);
+        CHECK(lodMismatches == 0);
+
+        // the counters agree with the lists
+        CHECK(gpu.statistics.drawnEarly == listed);
+        uint32_t perLod = 0;
+        for (uint32_t l = 0; l < MeshLodChain::MAX_LODS; l++)
+            perLod += gpu.statistics.drawnPerLod[l];
+        CHECK(perLod == listed);
+        CHECK(gpu.statistics.drawnLate == 0);
+        // only instances within the margins may be counted differently
+        int culledDifference = static_cast<int>(gpu.statistics.frustumCulled) - static_cast<int>(culled);
+        CHECK(std::abs(culledDifference) <= static_cast<int>(scene.count()) - compared);
+    }
+}
+
+TEST_CASE(earlyPhaseMatchesCullInstancesCPU)
+{
+    editor_test::HeadlessDevice device;
+    for (const auto& macros : earlyVariants(device.device.get()))
+    {
+        std::printf("variant %s\n", ShaderManager::queryShaderVariantUUID("instanceCull.comp", macros).c_str());
+        // neither count is a multiple of the 64 wide groups
+        for (uint32_t count : { 37u, 5000u })
+        {
+            auto scene = randomScene(count, count);
+            checkAgainstReference(scene, runEarlyPhase(device.device.get(), scene, macros), false);
+        }
+    }
+}
+
+// with occlusion culling on, the early phase only draws what the late phase saw last frame, the outline everything in the frustum
+TEST_CASE(earlyPhaseKeepsLastFrameVisibility)
+{
+    editor_test::HeadlessDevice device;
+    for (const auto& macros : earlyVariants(device.device.get()))
+    {
+        auto scene = randomScene(3000, 11);
+        scene.constants.occlusionCulling = 1;
+        checkAgainstReference(scene, runEarlyPhase(device.device.get(), scene, macros), true);
+    }
+}
+
+TEST_MAIN()
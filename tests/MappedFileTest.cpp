@@ -0,0 +1,184 @@
+#include "TestCommon.hpp"
+
+#include "MappedFile.hpp"
+#include "PBRTParser.h"
+#include "TokenParser.h"
+
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/*
+*  The parser case runs PBRTParser with a TokenParser whose handlers keep the tokens they are given (TokenParser.cpp is
+*  not linked), the tokens point into the mapped files.
+*/
+struct PBRTSceneBuilder {};
+struct AssetManager {};
+
+namespace
+{
+    void writeFile(const std::filesystem::path& path, const std::string& content)
+    {
+        std::ofstream out(path, std::ios::binary);
+        out.write(content.data(), (std::streamsize)content.size());
+    }
+
+    // the arguments of every Translate so far, read back by each Shape
+    std::vector<Token> translateArguments;
+    std::vector<std::vector<std::string>> readAtShape;
+
+    void keepTranslate(Token&, PBRTSceneBuilder&, LockFreeCircleQueue<Token>& queue, AssetManager&)
+    {
+        for (int i = 0; i < 3; i++)
+            translateArguments.push_back(queue.waitAndDequeue());
+    }
+
+    void readTranslates(Token&, PBRTSceneBuilder&, LockFreeCircleQueue<Token>&, AssetManager&)
+    {
+        std::vector<std::string> values;
+        for (const auto& token : translateArguments)
+            values.push_back(token.to_string());
+        readAtShape.push_back(std::move(values));
+    }
+}
+
+std::unordered_map<std::string_view, DirectiveHandler> TokenParser::handlers;
+
+TokenParser::TokenParser()
+{
+    handlers["Translate"] = keepTranslate;
+    handlers["Shape"] = readTranslates;
+}
+
+TEST_CASE(mapsWholeFile)
+{
+    editor_test::TempDirectory dir;
+    writeFile(dir / "scene.pbrt", "WorldBegin\nAttributeBegin\n");
+    MappedFile f(dir / "scene.pbrt");
+    REQUIRE(f.size() == 26);
+    CHECK(memcmp(f.raw(), "WorldBegin\nAttributeBegin\n", 26) == 0);
+}
+
+TEST_CASE(emptyFileIsLeftUnmapped)
+{
+    editor_test::TempDirectory dir;
+    writeFile(dir / "empty.pbrt", "");
+    MappedFile f(dir / "empty.pbrt");
+    CHECK(f.size() == 0);
+    CHECK(f.raw() == nullptr);
+    MappedFile copy = f;
+    CHECK(copy.size() == 0);
+}
+
+TEST_CASE(missingFileThrows)
+{
+    editor_test::TempDirectory dir;
+    CHECK_THROWS(MappedFile(dir / "missing.pbrt"));
+}
+
+TEST_CASE(copiesShareTheMappingUntilTheLastOneDies)
+{
+    editor_test::TempDirectory dir;
+    writeFile(dir / "a.pbrt", "Shape \"sphere\"");
+    const char* raw = nullptr;
+    MappedFile* outlived = nullptr;
+    {
+        MappedFile f(dir / "a.pbrt");
+        raw = f.raw();
+        outlived = new MappedFile(f);
+        MappedFile assigned(dir / "a.pbrt");
+        assigned = f;
+        CHECK(assigned.raw() == raw);
+        assigned = assigned;
+        CHECK(assigned.raw() == raw);
+        CHECK(outlived->raw() == raw);
+    }
+    // the original and the assigned copy are gone, the mapping must still be readable
+    REQUIRE(outlived->size() == 14);
+    CHECK(memcmp(outlived->raw(), "Shape \"sphere\"", 14) == 0);
+    delete outlived;
+}
+
+TEST_CASE(moveLeavesSourceEmpty)
+{
+    editor_test::TempDirectory dir;
+    writeFile(dir / "a.pbrt", "Camera");
+    MappedFile f(dir / "a.pbrt");
+    const char* raw = f.raw();
+
+    MappedFile moved(std::move(f));
+    CHECK(moved.raw() == raw);
+    CHECK(f.raw() == nullptr);
+    CHECK(f.size() == 0);
+
+    MappedFile target(dir / "a.pbrt");
+    target = std::move(moved);
+    CHECK(target.raw() == raw);
+    CHECK(moved.raw() == nullptr);
+    REQUIRE(target.size() == 6);
+    CHECK(memcmp(target.raw(), "Camera", 6) == 0);
+
+    // assigning into a moved-from file revives it
+    f = target;
+    CHECK(f.raw() == raw);
+}
+
+TEST_CASE(sparseFileLargerThan4GB)
+{
+#ifdef WIN32
+    TEST_SKIP("sparse file creation is only implemented with ftruncate");
+#else
+    if (sizeof(size_t) < 8)
+        TEST_SKIP("32-bit address space");
+    editor_test::TempDirectory dir;
+    auto path = dir / "huge.pbrt";
+    const off_t size = (off_t(5) << 30) + 3;
+    int fd = open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    REQUIRE(fd != -1);
+    bool sized = ftruncate(fd, size) == 0;
+    const char last = 'Z';
+    bool written = sized && pwrite(fd, &last, 1, size - 1) == 1;
+    close(fd);
+    if (!written)
+        TEST_SKIP("file system does not support 5 GB sparse files");
+
+    MappedFile f(path);
+    CHECK(f.size() == size_t(size));
+    REQUIRE(f.raw() != nullptr);
+    CHECK(f.raw()[0] == '\0');
+    CHECK(f.raw()[(size_t(1) << 32) + 1] == '\0');
+    CHECK(f.raw()[f.size() - 1] == 'Z');
+#endif
+}
+
+TEST_CASE(includedMappingsLiveUntilParsingEnds)
+{
+    // main includes a.pbrt, which includes b.pbrt, each one is done with before the last Shape of main
+    editor_test::TempDirectory dir;
+    writeFile(dir / "main.pbrt", "WorldBegin\nInclude \"a.pbrt\"\nShape \"sphere\"\n");
+    writeFile(dir / "a.pbrt", "Translate 1 2 3\nInclude \"b.pbrt\"\nShape \"sphere\"\n");
+    writeFile(dir / "b.pbrt", "Translate 4.5 -6 7e2\n");
+    translateArguments.clear();
+    readAtShape.clear();
+
+    PBRTParser parser;
+    PBRTSceneBuilder builder;
+    AssetManager assets;
+    CHECK(parser.parse(builder, dir / "main.pbrt", assets) == PBRTParser::ParseResult::SUCESS);
+
+    std::vector<std::string> arguments{ "1", "2", "3", "4.5", "-6", "7e2" };
+    REQUIRE(readAtShape.size() == 2);
+    // read from the mappings of a.pbrt and b.pbrt after both files were tokenized
+    CHECK(readAtShape[0] == arguments);
+    CHECK(readAtShape[1] == arguments);
+    CHECK(parser.parsedFiles.size() == 3);
+}
+
+TEST_MAIN()
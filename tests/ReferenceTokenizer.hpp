@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+
+#include "PBRTParser.h"
+
+/*
+*  The char-by-char tokenizer PBRTParser used before the block tokenizer, kept verbatim as the
+*  reference for the equivalence test and the baseline of parser_bench.
+*/
+namespace reference
+{
+#define NOT_WHITE_SPACE(c) ((c!=32 && c!= 9 && c!= 10 && c!= 11 && c!= 12 && c!=13))
+#define IS_WHITE_SPACE(c) (!NOT_WHITE_SPACE(c))
+
+    inline void nextToken(const char* text, int text_len, int* seek, int* tok_loc, int* tok_len)
+    {
+        char current_mode = 0; //0: nothing found, 1: string found, 2: comment found 3: other token found
+
+        int cur_seek = *seek;
+
+        for (; cur_seek < text_len; cur_seek++) {
+            char cur_char = text[cur_seek];
+            if (current_mode == 0) {
+                //nothing found yet
+                if (NOT_WHITE_SPACE(cur_char))
+                {
+                    if (cur_char == '\"') {
+                        current_mode = 1;
+                        *tok_loc = cur_seek;
+                    }
+                    else if (cur_char == '#') {
+                        current_mode = 2;
+                    }
+                    else if (cur_char == '(' || cur_char == ')' ||
+                        cur_char == '[' || cur_char == ']' ||
+                        cur_char == '{' || cur_char == '}' ||
+                        cur_char == '<' || cur_char == '>') {
+                        *tok_loc = cur_seek;
+                        *tok_len = 1;
+                        cur_seek++;
+                        break;
+                    }
+                    else {
+                        current_mode = 3;
+                        *tok_loc = cur_seek;
+                    }
+                }
+                continue;
+            }else if (current_mode == 1) {
+                //found string start
+                if (cur_char == '\"') {
+                    cur_seek++;
+                    *tok_len = cur_seek - *tok_loc;
+                    break;
+                }
+                continue;
+            }else if (current_mode == 2) {
+                //found comment start
+                if (cur_char == 10 || cur_char == 13) {
+                    current_mode = 0;
+                }
+                continue;
+            }else if (current_mode == 3) {
+                //found normal token start
+                if (IS_WHITE_SPACE(cur_char) || cur_char == '\"' || cur_char == '#' ||
+                    cur_char == '(' || cur_char == ')' ||
+                    cur_char == '[' || cur_char == ']' ||
+                    cur_char == '{' || cur_char == '}' ||
+                    cur_char == '<' || cur_char == '>') {
+                    *tok_len = cur_seek - *tok_loc;
+                    break;
+                }
+            }
+        }
+        *seek = cur_seek;
+    }
+
+#undef IS_WHITE_SPACE
+#undef NOT_WHITE_SPACE
+
+    // every token of text, a call returning tok_len 0 is how the old loop saw "no token"
+    inline std::vector<Token> tokenize(const char* text, int text_len)
+    {
+        std::vector<Token> tokens;
+        int seek = 0;
+        while (seek < text_len) {
+            int tok_loc = 0;
+            int tok_len = 0;
+            nextToken(text, text_len, &seek, &tok_loc, &tok_len);
+            if (tok_len != 0)
+                tokens.push_back(Token{ text, size_t(tok_loc), size_t(tok_len) });
+        }
+        return tokens;
+    }
+}
@@ -0,0 +1,268 @@
+#include "TestCommon.hpp"
+
+#include "PBRTParser.h"
+#include "SceneBuilder.hpp"
+#include "SceneCache.hpp"
+#include "sceneGraphEditor.hpp"
+#include "AssetManager.hpp"
+#include "scene.h"
+
+#include <cstring>
+#include <fstream>
+#include <memory>
+
+/*
+*  Parse a small scene the way SceneGraphEditor::parsePBRTSceneFile does, write its cache, load the
+*  cache back and compare both graphs node by node and object by object.
+*  The scene has no meshes or images on disk, so the AssetManager never needs a device.
+*/
+namespace
+{
+    const char* MAIN_SCENE = R"(# scene cache round trip
+LookAt 0 0 5  0 0 0  0 1 0
+Camera "perspective" "float fov" [ 45 ]
+Film "rgb" "integer xresolution" [ 320 ] "integer yresolution" [ 240 ] "string filename" [ "out.exr" ]
+WorldBegin
+LightSource "point" "rgb I" [ 1 1 1 ]
+Texture "checks" "spectrum" "scale"
+MakeNamedMaterial "red" "string type" [ "diffuse" ] "rgb reflectance" [ 0.8 0.1 0.1 ]
+AttributeBegin
+  Translate 1 2 3
+  NamedMaterial "red"
+  Shape "sphere" "float radius" [ 2 ]
+AttributeEnd
+AttributeBegin
+  Rotate 30 0 1 0
+  Material "diffuse" "rgb reflectance" [ 0.2 0.3 0.4 ]
+  Shape "trianglemesh" "point3 P" [ 0 0 0  1 0 0  0 1 0  1 1 0 ] "integer indices" [ 0 1 2  2 1 3 ]
+  AttributeBegin
+    Scale 2 2 2
+    Shape "disk"
+  AttributeEnd
+AttributeEnd
+ObjectBegin "tree"
+  Shape "sphere"
+ObjectEnd
+AttributeBegin
+  Translate 5 0 0
+  ObjectInstance "tree"
+AttributeEnd
+Include "more.pbrt"
+)";
+
+    const char* INCLUDED_SCENE = R"(AttributeBegin
+  Translate -1 0 0
+  Shape "cylinder"
+AttributeEnd
+)";
+
+    void writeFile(const std::filesystem::path& path, const std::string& content)
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out << content;
+    }
+
+    void writeScene(const editor_test::TempDirectory& dir)
+    {
+        writeFile(dir / "main.pbrt", MAIN_SCENE);
+        writeFile(dir / "more.pbrt", INCLUDED_SCENE);
+    }
+
+    // parse, then write the cache next to the scene like the editor does
+    std::unique_ptr<SceneGraph> parseAndSave(const std::filesystem::path& path, AssetManager& assets)
+    {
+        assets.setWorkDir(path.parent_path());
+        PBRTParser parser;
+        PBRTSceneBuilder builder;
+        parser.parse(builder, path, assets);
+        builder.finish();
+        std::unique_ptr<SceneGraph> graph(builder.sceneGraph);
+        REQUIRE(SceneCache::save(SceneCache::cachePathFor(path), parser.parsedFiles, *graph, builder));
+        return graph;
+    }
+
+    std::unique_ptr<SceneGraph> load(const std::filesystem::path& path, AssetManager& assets)
+    {
+        return std::unique_ptr<SceneGraph>(SceneCache::load(SceneCache::cachePathFor(path), assets));
+    }
+
+    bool sameRgb(const rgb& a, const rgb& b)
+    {
+        return a.r == b.r && a.g == b.g && a.b == b.b;
+    }
+
+    void compareShapes(Shape* a, Shape* b)
+    {
+        REQUIRE(a->getType() == b->getType());
+        CHECK(a->alpha_constant == b->alpha_constant);
+        CHECK(a->alpha_tex == b->alpha_tex);
+        auto* meshA = dynamic_cast<TriangleMeshShape*>(a);
+        auto* meshB = dynamic_cast<TriangleMeshShape*>(b);
+        CHECK((meshA == nullptr) == (meshB == nullptr));
+        if (meshA == nullptr || meshB == nullptr)
+            return;
+        CHECK(meshA->indices == meshB->indices);
+        REQUIRE(meshA->P.size() == meshB->P.size());
+        for (size_t i = 0; i < meshA->P.size(); i++)
+            CHECK(std::memcmp(&meshA->P[i], &meshB->P[i], sizeof(point3)) == 0);
+    }
+
+    void compareMaterials(Material* a, Material* b)
+    {
+        REQUIRE((a == nullptr) == (b == nullptr));
+        if (a == nullptr)
+            return;
+        REQUIRE(a->getType() == b->getType());
+        CHECK(a->name == b->name);
+        auto* diffuseA = dynamic_cast<DiffuseMaterial*>(a);
+        auto* diffuseB = dynamic_cast<DiffuseMaterial*>(b);
+        if (diffuseA == nullptr || diffuseB == nullptr)
+            return;
+        REQUIRE(diffuseA->reflectance.index() == diffuseB->reflectance.index());
+        if (auto* colorA = std::get_if<rgb>(&diffuseA->reflectance))
+            CHECK(sameRgb(*colorA, std::get<rgb>(diffuseB->reflectance)));
+    }
+
+    void compareNodes(const SceneGraph& ga, SceneGraphNodeHandle ha, const SceneGraph& gb, SceneGraphNodeHandle hb)
+    {
+        auto* a = ga.node(ha);
+        auto* b = gb.node(hb);
+        REQUIRE(a != nullptr && b != nullptr);
+        CHECK(a->name == b->name);
+        CHECK(a->is_empty == b->is_empty);
+        CHECK(a->is_instance == b->is_instance);
+        CHECK(a->is_transform_detached == b->is_transform_detached);
+        CHECK(a->selfTransform() == b->selfTransform());
+        CHECK(a->finalTransform() == b->finalTransform());
+        CHECK((ga.node(a->parent) == nullptr) == (gb.node(b->parent) == nullptr));
+
+        auto shapesA = a->shapes();
+        auto shapesB = b->shapes();
+        REQUIRE(shapesA.size() == shapesB.size());
+        for (size_t i = 0; i < shapesA.size(); i++)
+            compareShapes(shapesA[i], shapesB[i]);
+
+        auto materialsA = a->materials();
+        auto materialsB = b->materials();
+        REQUIRE(materialsA.size() == materialsB.size());
+        for (size_t i = 0; i < materialsA.size(); i++)
+            compareMaterials(materialsA[i], materialsB[i]);
+
+        auto lightsA = a->lights();
+        auto lightsB = b->lights();
+        REQUIRE(lightsA.size() == lightsB.size());
+        for (size_t i = 0; i < lightsA.size(); i++)
+            CHECK(lightsA[i]->getType() == lightsB[i]->getType());
+        CHECK(a->areaLights().size() == b->areaLights().size());
+
+        auto childrenA = a->children();
+        auto childrenB = b->children();
+        REQUIRE(childrenA.size() == childrenB.size());
+        for (size_t i = 0; i < childrenA.size(); i++)
+            compareNodes(ga, childrenA[i], gb, childrenB[i]);
+    }
+
+    void compareGraphs(const SceneGraph& a, const SceneGraph& b)
+    {
+        compareNodes(a, a.root, b, b.root);
+
+        REQUIRE(a.namedMaterials.size() == b.namedMaterials.size());
+        for (size_t i = 0; i < a.namedMaterials.size(); i++)
+            compareMaterials(a.namedMaterials[i], b.namedMaterials[i]);
+        CHECK(b.findNamedMaterial("red") != nullptr);
+
+        REQUIRE(a.namedTextures.size() == b.namedTextures.size());
+        for (size_t i = 0; i < a.namedTextures.size(); i++) {
+            CHECK(a.namedTextures[i]->name == b.namedTextures[i]->name);
+            CHECK(a.namedTextures[i]->type == b.namedTextures[i]->type);
+            CHECK(a.namedTextures[i]->getType() == b.namedTextures[i]->getType());
+        }
+
+        REQUIRE(a._objInstances.size() == b._objInstances.size());
+        for (size_t i = 0; i < a._objInstances.size(); i++)
+            compareNodes(a, a._objInstances[i], b, b._objInstances[i]);
+
+        const auto& camA = a.globalRenderSetting.camera;
+        const auto& camB = b.globalRenderSetting.camera;
+        CHECK(camA.eye == camB.eye);
+        CHECK(camA.look == camB.look);
+        CHECK(camA.up == camB.up);
+        REQUIRE(camA.camera != nullptr && camB.camera != nullptr);
+        CHECK(camA.camera->getType() == camB.camera->getType());
+        auto* perspectiveA = dynamic_cast<PerspectiveCamera*>(camA.camera);
+        auto* perspectiveB = dynamic_cast<PerspectiveCamera*>(camB.camera);
+        REQUIRE(perspectiveA != nullptr && perspectiveB != nullptr);
+        CHECK(perspectiveA->fov == perspectiveB->fov);
+
+        auto* filmA = a.globalRenderSetting.film.get();
+        auto* filmB = b.globalRenderSetting.film.get();
+        REQUIRE(filmA != nullptr && filmB != nullptr);
+        CHECK(filmA->xresolution == filmB->xresolution);
+        CHECK(filmA->yresolution == filmB->yresolution);
+        CHECK(filmA->filename == filmB->filename);
+    }
+}
+
+TEST_CASE(cachedGraphMatchesParsedGraph)
+{
+    editor_test::TempDirectory dir;
+    writeScene(dir);
+    AssetManager assets;
+    auto parsed = parseAndSave(dir / "main.pbrt", assets);
+    auto cached = load(dir / "main.pbrt", assets);
+    REQUIRE(cached != nullptr);
+    compareGraphs(*parsed, *cached);
+
+    // sanity check of the scene itself, so an empty parse can't pass the comparison
+    CHECK(parsed->namedMaterials.size() == 1);
+    CHECK(parsed->_objInstances.size() == 1);
+    REQUIRE(parsed->globalRenderSetting.film != nullptr);
+    CHECK(parsed->globalRenderSetting.film->filename == "out.exr");
+    CHECK(!parsed->node(parsed->root)->children().empty());
+}
+
+TEST_CASE(versionChangeRejectsCache)
+{
+    editor_test::TempDirectory dir;
+    writeScene(dir);
+    AssetManager assets;
+    parseAndSave(dir / "main.pbrt", assets);
+
+    // the version follows the 8 bytes magic
+    auto cachePath = SceneCache::cachePathFor(dir / "main.pbrt");
+    std::fstream cache(cachePath, std::ios::binary | std::ios::in | std::ios::out);
+    cache.seekp(8);
+    uint32_t otherVersion = SceneCache::VERSION + 1;
+    cache.write(reinterpret_cast<const char*>(&otherVersion), sizeof(otherVersion));
+    cache.close();
+
+    CHECK(load(dir / "main.pbrt", assets) == nullptr);
+}
+
+TEST_CASE(editedRootFileRejectsCache)
+{
+    editor_test::TempDirectory dir;
+    writeScene(dir);
+    AssetManager assets;
+    parseAndSave(dir / "main.pbrt", assets);
+    REQUIRE(load(dir / "main.pbrt", assets) != nullptr);
+
+    writeFile(dir / "main.pbrt", std::string(MAIN_SCENE) + "# edited\n");
+    CHECK(load(dir / "main.pbrt", assets) == nullptr);
+}
+
+TEST_CASE(editedIncludedFileRejectsCache)
+{
+    editor_test::TempDirectory dir;
+    writeScene(dir);
+    AssetManager assets;
+    parseAndSave(dir / "main.pbrt", assets);
+
+    writeFile(dir / "more.pbrt", std::string(INCLUDED_SCENE) + "Shape \"sphere\"\n");
+    CHECK(load(dir / "main.pbrt", assets) == nullptr);
+
+    std::filesystem::remove(dir / "more.pbrt");
+    CHECK(load(dir / "main.pbrt", assets) == nullptr);
+}
+
+TEST_MAIN()
@@ -0,0 +1,166 @@
+#include "TestCommon.hpp"
+
+#include "Symbol.hpp"
+
+#include <string>
+#include <thread>
+
+namespace
+{
+    // home slot of id in a table of 16, the size SymbolMap starts at
+    size_t homeIn16(uint32_t id)
+    {
+        return static_cast<size_t>((id * 0x9E3779B97F4A7C15ull) >> 60);
+    }
+
+    // count ids from start on, all of them starting their probe at slot
+    std::vector<Symbol> idsWithHome(size_t slot, size_t count, uint32_t start)
+    {
+        std::vector<Symbol> ids;
+        for (uint32_t id = start; ids.size() < count; id++)
+        {
+            if (homeIn16(id) == slot)
+                ids.push_back(Symbol{ id });
+        }
+        return ids;
+    }
+}
+
+TEST_CASE(internReturnsOneSymbolPerString)
+{
+    auto& table = SymbolTable::getInstance();
+    auto a = intern("symbol_test_a");
+    auto b = intern("symbol_test_b");
+    CHECK(a != b);
+    CHECK(intern("symbol_test_a") == a);
+    CHECK(intern(std::string("symbol_test_") + "b") == b);
+    CHECK(table.str(a) == "symbol_test_a");
+
+    // lookups of unknown names don't grow the table
+    size_t before = table.size();
+    CHECK(!table.find("symbol_test_never_interned"));
+    CHECK(table.size() == before);
+    CHECK(table.find("symbol_test_b") == b);
+}
+
+TEST_CASE(internedStringsStayPutWhileTheTableGrows)
+{
+    auto& table = SymbolTable::getInstance();
+    auto first = intern("symbol_test_stable");
+    const std::string* stored = &table.str(first);
+    for (int i = 0; i < 50000; i++)
+        intern("symbol_test_grow_" + std::to_string(i));
+    CHECK(&table.str(first) == stored);
+    CHECK(*stored == "symbol_test_stable");
+}
+
+TEST_CASE(concurrentInterningAgrees)
+{
+    constexpr int THREADS = 8;
+    constexpr int NAMES = 2000;
+    std::vector<std::vector<Symbol>> seen(THREADS);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++)
+    {
+        threads.emplace_back([&, t] {
+            // every thread walks the names in a different order
+            for (int i = 0; i < NAMES; i++)
+            {
+                int name = (i * (2 * t + 1)) % NAMES;
+                seen[t].push_back(intern("symbol_test_concurrent_" + std::to_string(name)));
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    int disagreements = 0;
+    for (int t = 0; t < THREADS; t++)
+    {
+        for (int i = 0; i < NAMES; i++)
+        {
+            int name = (i * (2 * t + 1)) % NAMES;
+            if (seen[t][i] != SymbolTable::getInstance().find("symbol_test_concurrent_" + std::to_string(name)))
+                disagreements++;
+        }
+    }
+    CHECK(disagreements == 0);
+}
+
+TEST_CASE(mapKeepsTheFirstValueOfAKey)
+{
+    SymbolMap<int> map;
+    auto key = intern("symbol_test_key");
+    CHECK(map.find(key) == nullptr);
+    CHECK(map.emplace(key, 1).second);
+    auto [value, inserted] = map.emplace(key, 2);
+    CHECK(!inserted);
+    CHECK(*value == 1);
+    CHECK(map.size() == 1);
+    CHECK(map.find(Symbol{}) == nullptr);
+    CHECK_THROWS(map.emplace(Symbol{}, 3));
+
+    map.clear();
+    CHECK(map.size() == 0);
+    CHECK(map.find(key) == nullptr);
+    CHECK(map.emplace(key, 4).second);
+    CHECK(*map.find(key) == 4);
+}
+
+// keys sharing a home slot probe past each other, including around the end of the table
+TEST_CASE(collidingKeysProbeLinearly)
+{
+    SymbolMap<uint32_t> map;
+    auto last = idsWithHome(15, 5, 0);
+    auto first = idsWithHome(0, 2, 0);
+    for (auto key : last)
+        CHECK(map.emplace(key, key.id).second);
+    // slot 15 and then 0..3 are taken, the keys whose home is 0 land after them
+    for (auto key : first)
+        CHECK(map.emplace(key, key.id).second);
+    CHECK(map.size() == 7);
+
+    for (auto key : last)
+        CHECK(map.find(key) != nullptr && *map.find(key) == key.id);
+    for (auto key : first)
+        CHECK(map.find(key) != nullptr && *map.find(key) == key.id);
+
+    // a missing key with the same home walks the whole cluster before giving up
+    auto missing = idsWithHome(15, 1, last.back().id + 1).front();
+    CHECK(map.find(missing) == nullptr);
+    auto missingFirst = idsWithHome(0, 1, first.back().id + 1).front();
+    CHECK(map.find(missingFirst) == nullptr);
+}
+
+TEST_CASE(mapGrowsAndKeepsEveryKey)
+{
+    SymbolMap<uint32_t> map;
+    std::vector<Symbol> keys;
+    for (int i = 0; i < 100000; i++)
+        keys.push_back(intern("symbol_test_map_" + std::to_string(i)));
+
+    bool insertedAll = true;
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        insertedAll &= map.emplace(keys[i], static_cast<uint32_t>(i)).second;
+        // a few earlier keys are looked up after every resize boundary
+        if ((i & (i + 1)) == 0)
+        {
+            for (size_t j = 0; j <= i; j += i / 8 + 1)
+                CHECK(map.find(keys[j]) != nullptr && *map.find(keys[j]) == j);
+        }
+    }
+    CHECK(insertedAll);
+    CHECK(map.size() == keys.size());
+
+    int wrong = 0;
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        auto* value = map.find(keys[i]);
+        wrong += value == nullptr || *value != i ? 1 : 0;
+    }
+    CHECK(wrong == 0);
+    CHECK(map.find(intern("symbol_test_map_not_inserted")) == nullptr);
+}
+
+TEST_MAIN()
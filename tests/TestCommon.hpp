@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+*  Minimal test harness shared by every test executable.
+*  TEST_CASE registers a function, CHECK records a failure and keeps going, REQUIRE stops the case.
+*  A case calling TEST_SKIP is reported as skipped, an executable whose cases were all skipped exits
+*  with 77 so ctest reports it as skipped rather than passed (SKIP_RETURN_CODE).
+*/
+namespace editor_test
+{
+    struct TestCase
+    {
+        const char* name;
+        void (*fn)();
+    };
+
+    struct Skip
+    {
+        std::string reason;
+    };
+
+    struct Abort {};
+
+    inline std::vector<TestCase>& registry()
+    {
+        static std::vector<TestCase> cases;
+        return cases;
+    }
+
+    inline int& failures()
+    {
+        static int count = 0;
+        return count;
+    }
+
+    struct Registrar
+    {
+        Registrar(const char* name, void (*fn)())
+        {
+            registry().push_back({ name, fn });
+        }
+    };
+
+    inline void fail(const char* file, int line, const std::string& what)
+    {
+        failures()++;
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what.c_str());
+    }
+
+    // fresh directory under the system temp dir, removed with everything in it on destruction
+    struct TempDirectory
+    {
+        TempDirectory()
+        {
+            std::random_device rd;
+            path = std::filesystem::temp_directory_path() / ("pbrt_editor_test_" + std::to_string(rd()) + std::to_string(rd()));
+            std::filesystem::create_directories(path);
+        }
+        ~TempDirectory()
+        {
+            std::error_code ec;
+            std::filesystem::remove_all(path, ec);
+        }
+        TempDirectory(const TempDirectory&) = delete;
+        TempDirectory& operator=(const TempDirectory&) = delete;
+
+        std::filesystem::path operator/(const std::string& name) const { return path / name; }
+
+        std::filesystem::path path;
+    };
+
+    inline int runAll()
+    {
+        size_t skipped = 0;
+        for (auto& test : registry()) {
+            int before = failures();
+            try {
+                test.fn();
+            } catch (const Skip& skip) {
+                skipped++;
+                std::printf("[ SKIP ] %s : %s\n", test.name, skip.reason.c_str());
+                continue;
+            } catch (const Abort&) {
+            } catch (const std::exception& e) {
+                fail(test.name, 0, std::string("unexpected exception: ") + e.what());
+            }
+            std::printf("[ %s ] %s\n", failures() == before ? " OK " : "FAIL", test.name);
+        }
+        if (failures() != 0)
+            return 1;
+        return !registry().empty() && skipped == registry().size() ? 77 : 0;
+    }
+}
+
+#define TEST_CASE(name) \
+    static void name(); \
+    static editor_test::Registrar name##_registrar(#name, name); \
+    static void name()
+
+#define CHECK(cond) \
+    do { if (!(cond)) editor_test::fail(__FILE__, __LINE__, #cond); } while (0)
+
+#define REQUIRE(cond) \
+    do { if (!(cond)) { editor_test::fail(__FILE__, __LINE__, #cond); throw editor_test::Abort{}; } } while (0)
+
+#define CHECK_THROWS(expr) \
+    do { \
+        bool thrown_ = false; \
+        try { expr; } catch (...) { thrown_ = true; } \
+        if (!thrown_) editor_test::fail(__FILE__, __LINE__, "expected exception from " #expr); \
+    } while (0)
+
+#define TEST_SKIP(reason) throw editor_test::Skip{ reason }
+
+#define TEST_MAIN() \
+    int main() { return editor_test::runAll(); }
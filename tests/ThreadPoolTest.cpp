@@ -0,0 +1,111 @@
+#include "TestCommon.hpp"
+
+#include "ThreadPool.h"
+#include "ConcurrentHashMap.hpp"
+
+#include <array>
+#include <limits>
+#include <string>
+
+namespace
+{
+    // the counter wrapped past zero if it ever reads larger than anything that could be queued
+    constexpr size_t MAX_SANE_PENDING = std::numeric_limits<size_t>::max() / 2;
+}
+
+// Same scheme as AssetManager::getOrLoadMeshAsync: the first request of a path enqueues the import under
+// the shard lock, every later request shares its future.
+TEST_CASE(concurrentLoadsImportEachPathOnce)
+{
+    constexpr int PATHS = 512;
+    constexpr int CALLERS = 16;
+    constexpr int LOADS_PER_CALLER = 4000;
+
+    ThreadPool pool(8);
+    ConcurrentHashMap<std::string, std::shared_future<int>> requests;
+    std::array<std::atomic<int>, PATHS> imports{};
+    std::atomic<bool> wrapped{ false };
+    std::atomic<bool> mismatched{ false };
+
+    std::vector<std::thread> callers;
+    for (int c = 0; c < CALLERS; ++c)
+    {
+        callers.emplace_back([&, c] {
+            std::minstd_rand rng(c + 1);
+            for (int i = 0; i < LOADS_PER_CALLER; ++i)
+            {
+                int path = static_cast<int>(rng() % PATHS);
+                auto name = "meshes/mesh_" + std::to_string(path) + ".ply";
+                auto future = *requests.findOrEmplace(name, [&] {
+                    return pool.enqueue([&imports, path](int) {
+                        imports[path].fetch_add(1, std::memory_order_relaxed);
+                        return path;
+                    }).share();
+                }).first;
+                if (pool.pendingCount() > MAX_SANE_PENDING)
+                    wrapped = true;
+                if (i % 64 == 0 && future.get() != path)
+                    mismatched = true;
+            }
+        });
+    }
+    for (auto& t : callers)
+        t.join();
+
+    CHECK(requests.size() == PATHS);
+    for (int p = 0; p < PATHS; ++p)
+    {
+        auto* future = requests.find("meshes/mesh_" + std::to_string(p) + ".ply");
+        REQUIRE(future != nullptr);
+        CHECK(future->get() == p);
+        CHECK(imports[p].load() == 1);
+    }
+    CHECK(!wrapped);
+    CHECK(!mismatched);
+    CHECK(pool.pendingCount() == 0);
+}
+
+// Tasks enqueued by workers go to their own deque, where the owner may take them back immediately.
+TEST_CASE(nestedEnqueueNeverWrapsPendingCount)
+{
+    constexpr int ROOTS = 2000;
+    constexpr int CHILDREN = 8;
+
+    ThreadPool pool(4);
+    std::atomic<int> ran{ 0 };
+    std::atomic<bool> wrapped{ false };
+    std::atomic<bool> done{ false };
+
+    std::thread watcher([&] {
+        while (!done)
+        {
+            if (pool.pendingCount() > MAX_SANE_PENDING)
+                wrapped = true;
+        }
+    });
+
+    std::vector<std::future<void>> roots;
+    for (int r = 0; r < ROOTS; ++r)
+    {
+        roots.push_back(pool.enqueue([&](int) {
+            std::vector<std::future<void>> children;
+            for (int k = 0; k < CHILDREN; ++k)
+                children.push_back(pool.enqueue([&](int) { ran.fetch_add(1, std::memory_order_relaxed); }));
+            // leave the children to whoever takes or steals them, the roots only check the counter
+            if (pool.pendingCount() > MAX_SANE_PENDING)
+                wrapped = true;
+        }));
+    }
+    for (auto& f : roots)
+        f.get();
+    // children may still be queued, spin until they all ran
+    while (ran.load() != ROOTS * CHILDREN)
+        std::this_thread::yield();
+    done = true;
+    watcher.join();
+
+    CHECK(!wrapped);
+    CHECK(pool.pendingCount() == 0);
+}
+
+TEST_MAIN()
@@ -0,0 +1,158 @@
+#include "TestCommon.hpp"
+
+#include "ReferenceTokenizer.hpp"
+
+#include <random>
+#include <string>
+
+/*
+*  Built once per tokenizer path (see CMakeLists.txt). The block tokenizer must produce exactly the
+*  tokens of the old char-by-char tokenizer, except for the deliberate change at the end of text:
+*  a token or string cut by the end of file used to be dropped and is now emitted.
+*/
+namespace
+{
+    const char* pathName()
+    {
+#if defined(EDITOR_TOKENIZER_SCALAR)
+        return "scalar";
+#elif defined(__AVX2__)
+        return "avx2";
+#else
+        return "sse2";
+#endif
+    }
+
+    void requirePathSupported()
+    {
+#if defined(__AVX2__) && !defined(EDITOR_TOKENIZER_SCALAR) && (defined(__GNUC__) || defined(__clang__))
+        if (!__builtin_cpu_supports("avx2"))
+            TEST_SKIP("cpu without avx2");
+#endif
+    }
+
+    std::vector<Token> tokenizeInBatches(const std::string& text, std::mt19937& rng)
+    {
+        std::vector<Token> tokens;
+        Token batch[16];
+        std::uniform_int_distribution<size_t> batchSize(1, 16);
+        size_t seek = 0;
+        while (seek < text.size()) {
+            size_t before = seek;
+            size_t count = PBRTParser::nextTokens(text.data(), text.size(), &seek, batch, batchSize(rng));
+            REQUIRE(seek > before || count != 0);
+            tokens.insert(tokens.end(), batch, batch + count);
+        }
+        return tokens;
+    }
+
+    bool isDelimiter(char c)
+    {
+        return c == ' ' || (c >= 9 && c <= 13) || c == '\"' || c == '#' ||
+               c == '(' || c == ')' || c == '[' || c == ']' ||
+               c == '{' || c == '}' || c == '<' || c == '>';
+    }
+
+    void compare(const std::string& text, std::mt19937& rng)
+    {
+        auto expected = reference::tokenize(text.data(), (int)text.size());
+        auto actual = tokenizeInBatches(text, rng);
+
+        size_t common = expected.size();
+        if (actual.size() == expected.size() + 1) {
+            // only allowed for a token running into the end of text
+            const Token& last = actual.back();
+            size_t previousEnd = expected.empty() ? 0 : expected.back().pos + expected.back().len;
+            bool trailing = last.pos >= previousEnd && last.pos + last.len == text.size() &&
+                            (text[last.pos] == '\"' || !isDelimiter(text[last.pos]));
+            if (!trailing)
+                editor_test::fail(__FILE__, __LINE__, "extra token is not the unterminated trailing token");
+        } else if (actual.size() != expected.size()) {
+            editor_test::fail(__FILE__, __LINE__, "token count " + std::to_string(actual.size()) +
+                                                  " != " + std::to_string(expected.size()));
+            return;
+        }
+        for (size_t i = 0; i < common; i++) {
+            if (actual[i].pos != expected[i].pos || actual[i].len != expected[i].len) {
+                editor_test::fail(__FILE__, __LINE__, "token " + std::to_string(i) + " differs : \"" +
+                                  actual[i].to_string() + "\" vs \"" + expected[i].to_string() + "\"");
+                return;
+            }
+        }
+    }
+
+    // biased towards the bytes the tokenizer cares about so every state transition is hit often
+    std::string randomText(std::mt19937& rng, size_t length)
+    {
+        static const char interesting[] = " \t\n\v\f\r\"#()[]{}<>";
+        std::uniform_int_distribution<int> kind(0, 9);
+        std::uniform_int_distribution<int> special(0, sizeof(interesting) - 2);
+        std::uniform_int_distribution<int> letter('a', 'z');
+        std::uniform_int_distribution<int> anyByte(0, 255);
+        std::string text(length, ' ');
+        for (auto& c : text) {
+            int k = kind(rng);
+            if (k < 4) c = interesting[special(rng)];
+            else if (k < 9) c = (char)letter(rng);
+            else c = (char)anyByte(rng);
+        }
+        return text;
+    }
+}
+
+TEST_CASE(randomTextMatchesReference)
+{
+    requirePathSupported();
+    std::printf("tokenizer path : %s\n", pathName());
+    std::mt19937 rng(20240117);
+    std::uniform_int_distribution<size_t> length(0, 700);
+    for (int i = 0; i < 20000; i++) {
+        compare(randomText(rng, length(rng)), rng);
+        if (editor_test::failures() != 0)
+            return;
+    }
+}
+
+TEST_CASE(blockBoundariesMatchReference)
+{
+    requirePathSupported();
+    std::mt19937 rng(7);
+    // tokens, strings and comments straddling the 64 byte blocks in every alignment
+    const std::string pieces[] = { "Shape", "\"trianglemesh\"", "# comment\n", "[ 1 2 3 ]", "\"a b\"", "\r\n" };
+    for (size_t pad = 0; pad < 130; pad++) {
+        for (auto& piece : pieces) {
+            std::string text(pad, ' ');
+            text += piece;
+            text += " Attribute \"string name\" [ \"x\" ]";
+            compare(text, rng);
+            compare(text.substr(0, text.size() - 1), rng);
+        }
+    }
+}
+
+TEST_CASE(trailingTokenIsEmitted)
+{
+    requirePathSupported();
+    const std::string texts[] = { "WorldBegin", "Shape \"sph", std::string(64, ' ') + "end" };
+    const char* lastTokens[] = { "WorldBegin", "\"sph", "end" };
+    for (int i = 0; i < 3; i++) {
+        Token out[4];
+        size_t seek = 0;
+        size_t count = PBRTParser::nextTokens(texts[i].data(), texts[i].size(), &seek, out, 4);
+        REQUIRE(count != 0);
+        CHECK(out[count - 1].to_string() == lastTokens[i]);
+        CHECK(seek == texts[i].size());
+    }
+}
+
+TEST_CASE(commentOnlyTextHasNoTokens)
+{
+    requirePathSupported();
+    std::string text = "# only a comment [ \"x\" ]";
+    Token out[4];
+    size_t seek = 0;
+    CHECK(PBRTParser::nextTokens(text.data(), text.size(), &seek, out, 4) == 0);
+    CHECK(seek == text.size());
+}
+
+TEST_MAIN()
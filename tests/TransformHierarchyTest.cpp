@@ -0,0 +1,186 @@
+#include "TestCommon.hpp"
+
+#include "sceneGraphEditor.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <set>
+
+/*
+*  Editing self transforms of a SceneGraph and checking what TransformHierarchy::update() recomputes:
+*  exactly the edited subtrees, to the same matrices a recursive walk from the root produces.
+*/
+namespace
+{
+    SceneGraphNodeHandle addChild(SceneGraph& graph, SceneGraphNodeHandle parent)
+    {
+        auto handle = graph.createNode();
+        graph.node(handle)->parent = parent;
+        return handle;
+    }
+
+    // final transform of every live node computed through its parent chain, the way update() composes them
+    glm::mat4 expectedFinal(const SceneGraph& graph, const SceneGraphNode* node)
+    {
+        auto* parent = node->parentNode();
+        if (parent == nullptr || node->is_transform_detached)
+            return node->selfTransform();
+        return node->selfTransform() * expectedFinal(graph, parent);
+    }
+
+    int mismatchedFinals(SceneGraph& graph)
+    {
+        int mismatches = 0;
+        graph.nodes.forEach([&](SceneGraphNodeHandle, SceneGraphNode& node) {
+            glm::mat4 expected = expectedFinal(graph, &node);
+            for (int c = 0; c < 4; c++)
+            {
+                if (glm::any(glm::greaterThan(glm::abs(node.finalTransform()[c] - expected[c]), glm::vec4(1e-5f))))
+                {
+                    mismatches++;
+                    break;
+                }
+            }
+        });
+        return mismatches;
+    }
+
+    std::set<uint32_t> asSet(const std::vector<SceneGraphNodeHandle>& handles)
+    {
+        std::set<uint32_t> values;
+        for (auto handle : handles)
+            values.insert(handle.value);
+        return values;
+    }
+
+    void move(SceneGraph& graph, SceneGraphNodeHandle handle, glm::vec3 offset)
+    {
+        auto* node = graph.node(handle);
+        node->selfTransform() = glm::translate(node->selfTransform(), offset);
+        node->updateFinalTransform();
+    }
+}
+
+TEST_CASE(editMarksOnlyItsSubtree)
+{
+    SceneGraph graph;
+    graph.root = graph.createNode();
+    auto a = addChild(graph, graph.root);
+    auto a1 = addChild(graph, a);
+    auto a2 = addChild(graph, a);
+    auto a1x = addChild(graph, a1);
+    auto b = addChild(graph, graph.root);
+    auto b1 = addChild(graph, b);
+    graph.buildTransformHierarchy();
+
+    // the depth sort puts parents first
+    CHECK(graph.transforms.levelBegin.size() == 5);
+    CHECK(graph.node(graph.root)->transformIndex == 0);
+    CHECK(graph.node(a1x)->transformIndex == graph.transforms.size() - 1);
+
+    CHECK(graph.transforms.update().empty());
+
+    move(graph, a, { 1, 0, 0 });
+    std::vector<std::vector<SceneGraphNodeHandle>> notified;
+    graph.nodeFinalTransformChangeSignal.connect([&](const std::vector<SceneGraphNodeHandle>& changed) {
+        notified.push_back(changed);
+    });
+    graph.updateTransforms();
+    REQUIRE(notified.size() == 1);
+    CHECK(asSet(notified[0]) == asSet({ a, a1, a2, a1x }));
+    CHECK(mismatchedFinals(graph) == 0);
+    CHECK(graph.node(a1x)->finalTransform()[3][0] == 1.0f);
+    CHECK(graph.node(b1)->finalTransform() == glm::mat4(1.0f));
+
+    // nothing edited since, no notification
+    graph.updateTransforms();
+    CHECK(notified.size() == 1);
+
+    // two edits in one frame, one of them inside the other's subtree, every node reported once
+    move(graph, a1, { 0, 2, 0 });
+    move(graph, a, { 0, 0, 3 });
+    move(graph, b1, { 4, 0, 0 });
+    auto changed = graph.transforms.update();
+    CHECK(changed.size() == 5);
+    CHECK(asSet(changed) == asSet({ a, a1, a2, a1x, b1 }));
+    CHECK(mismatchedFinals(graph) == 0);
+}
+
+TEST_CASE(detachedNodeIgnoresParentEdits)
+{
+    SceneGraph graph;
+    graph.root = graph.createNode();
+    auto attached = addChild(graph, graph.root);
+    auto detached = addChild(graph, graph.root);
+    auto underDetached = addChild(graph, detached);
+    graph.node(detached)->is_transform_detached = true;
+    graph.buildTransformHierarchy();
+
+    move(graph, graph.root, { 5, 0, 0 });
+    auto changed = asSet(graph.transforms.update());
+    CHECK(changed == asSet({ graph.root, attached }));
+    CHECK(graph.node(underDetached)->finalTransform()[3][0] == 0.0f);
+
+    move(graph, detached, { 1, 0, 0 });
+    changed = asSet(graph.transforms.update());
+    CHECK(changed == asSet({ detached, underDetached }));
+    CHECK(mismatchedFinals(graph) == 0);
+}
+
+TEST_CASE(rebuildDropsDestroyedNodesAndKeepsTransforms)
+{
+    SceneGraph graph;
+    graph.root = graph.createNode();
+    auto keep = addChild(graph, graph.root);
+    auto drop = addChild(graph, graph.root);
+    graph.buildTransformHierarchy();
+    move(graph, keep, { 0, 7, 0 });
+    graph.transforms.update();
+
+    graph.destroyNode(drop);
+    auto late = addChild(graph, keep);
+    graph.buildTransformHierarchy();
+    CHECK(graph.transforms.size() == 3);
+    CHECK(graph.node(keep)->finalTransform()[3][1] == 7.0f);
+
+    // the node added later picks up its parent's transform on its first update
+    graph.node(late)->updateFinalTransform();
+    graph.transforms.update();
+    CHECK(graph.node(late)->finalTransform()[3][1] == 7.0f);
+    CHECK(mismatchedFinals(graph) == 0);
+}
+
+// levels above 16k nodes are split across the sweep pool
+TEST_CASE(wideLevelsSweptInParallelMatchTheReference)
+{
+    constexpr int WIDTH = 40000;
+    SceneGraph graph;
+    graph.root = graph.createNode();
+    std::vector<SceneGraphNodeHandle> middle, leaves;
+    for (int i = 0; i < WIDTH; i++)
+    {
+        middle.push_back(addChild(graph, graph.root));
+        leaves.push_back(addChild(graph, middle.back()));
+    }
+    graph.buildTransformHierarchy();
+
+    std::minstd_rand rng(3);
+    std::set<uint32_t> expected;
+    for (int i = 0; i < 500; i++)
+    {
+        int k = static_cast<int>(rng() % WIDTH);
+        move(graph, middle[k], { float(k), 1, 0 });
+        expected.insert(middle[k].value);
+        expected.insert(leaves[k].value);
+    }
+    CHECK(asSet(graph.transforms.update()) == expected);
+    CHECK(mismatchedFinals(graph) == 0);
+
+    // moving the root dirties every node
+    move(graph, graph.root, { 0, 0, 1 });
+    CHECK(graph.transforms.update().size() == 2 * WIDTH + 1);
+    CHECK(mismatchedFinals(graph) == 0);
+}
+
+TEST_MAIN()
@@ -0,0 +1,191 @@
+#include "TestCommon.hpp"
+#include "HeadlessDevice.hpp"
+
+#include "UploadScheduler.hpp"
+
+#include <cstring>
+
+namespace
+{
+    // Host visible destination, so the test can read back what the transfer queue wrote
+    struct ReadbackBuffer
+    {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VmaAllocation allocation = VK_NULL_HANDLE;
+        const char* mapped = nullptr;
+        size_t size = 0;
+    };
+
+    ReadbackBuffer createReadbackBuffer(DeviceExtended* device, size_t size, VkBufferUsageFlags usage)
+    {
+        VkBufferCreateInfo bufferInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+        bufferInfo.size = size;
+        bufferInfo.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+        VmaAllocationCreateInfo allocInfo = {};
+        allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+        allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+        ReadbackBuffer result;
+        VmaAllocationInfo allocationInfo;
+        if (vmaCreateBuffer(device->_globalVMAAllocator, &bufferInfo, &allocInfo, &result.buffer, &result.allocation, &allocationInfo) != VK_SUCCESS)
+            throw std::runtime_error("Failed to allocate readback buffer");
+        result.mapped = static_cast<const char*>(allocationInfo.pMappedData);
+        result.size = size;
+        return result;
+    }
+
+    bool contentMatches(DeviceExtended* device, const ReadbackBuffer& dst, const std::vector<char>& expected)
+    {
+        vmaInvalidateAllocation(device->_globalVMAAllocator, dst.allocation, 0, VK_WHOLE_SIZE);
+        return memcmp(dst.mapped, expected.data(), expected.size()) == 0;
+    }
+
+    std::vector<char> randomBytes(std::minstd_rand& rng, size_t size)
+    {
+        std::vector<char> bytes(size);
+        for (auto& b : bytes)
+            b = static_cast<char>(rng());
+        return bytes;
+    }
+
+    // Stand-in for the frame submission: waits on the upload timeline if asked to and signals the graphics one
+    void submitFrame(DeviceExtended* device, const UploadScheduler::GraphicsSubmit& uploads)
+    {
+        vk::Queue graphicsQueue = device->get_queue(vkb::QueueType::graphics).value();
+        vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eAllCommands;
+        uint64_t waitValue = uploads.transferWaitValue;
+
+        vk::TimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.setSignalSemaphoreValues(uploads.graphicsSignalValue);
+        vk::SubmitInfo submitInfo{};
+        if (uploads.cmd)
+            submitInfo.setCommandBuffers(uploads.cmd);
+        if (uploads.transferWaitValue != 0)
+        {
+            timelineInfo.setWaitSemaphoreValues(waitValue);
+            submitInfo.setWaitSemaphores(uploads.transferTimeline);
+            submitInfo.setWaitDstStageMask(waitStage);
+        }
+        submitInfo.setSignalSemaphores(uploads.graphicsTimeline);
+        submitInfo.setPNext(&timelineInfo);
+        graphicsQueue.submit(submitInfo);
+    }
+}
+
+/*
+*  10k meshes go through a 4 MB ring: the scheduler must batch them into a handful of transfer submissions,
+*  recycling the ring as batches retire, where the old oneTimeUploadSync submitted and waited idle twice per mesh.
+*/
+TEST_CASE(tenThousandMeshUploadsShareFewBatches)
+{
+    constexpr int MESHES = 10000;
+    constexpr vk::DeviceSize RING_SIZE = 4 * 1024 * 1024;
+
+    editor_test::HeadlessDevice device;
+    auto& scheduler = UploadScheduler::getInstance();
+    scheduler.init(device.device.get(), RING_SIZE);
+
+    std::minstd_rand rng(7);
+    std::vector<ReadbackBuffer> buffers;
+    std::vector<std::vector<char>> contents;
+    std::vector<UploadTicket> tickets;
+    for (int i = 0; i < MESHES; ++i)
+    {
+        // positions and normals of 32 to 256 vertices, then a 32 bit index list
+        size_t vertexBytes = (32 + rng() % 225) * 24;
+        size_t indexBytes = (96 + rng() % 700) * 4;
+        contents.push_back(randomBytes(rng, vertexBytes));
+        buffers.push_back(createReadbackBuffer(device.device.get(), vertexBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT));
+        tickets.push_back(scheduler.uploadBuffer(contents.back().data(), vertexBytes, buffers.back().buffer));
+        contents.push_back(randomBytes(rng, indexBytes));
+        buffers.push_back(createReadbackBuffer(device.device.get(), indexBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT));
+        tickets.push_back(scheduler.uploadBuffer(contents.back().data(), indexBytes, buffers.back().buffer));
+    }
+    // larger than half the ring, staged in a dedicated buffer
+    contents.push_back(randomBytes(rng, 3 * 1024 * 1024));
+    buffers.push_back(createReadbackBuffer(device.device.get(), contents.back().size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT));
+    tickets.push_back(scheduler.uploadBuffer(contents.back().data(), contents.back().size(), buffers.back().buffer));
+
+    bool ordered = true;
+    for (size_t i = 1; i < tickets.size(); ++i)
+        ordered &= tickets[i].value >= tickets[i - 1].value;
+    CHECK(ordered);
+    CHECK(tickets.front().value >= 1);
+    // ~30 MB of data through a 4 MB ring is at least 8 batches, one per upload would be 20001
+    uint64_t batches = tickets.back().value;
+    std::printf("%d meshes uploaded in %llu transfer submissions\n", MESHES, (unsigned long long)batches);
+    CHECK(batches >= 8);
+    CHECK(batches <= MESHES / 100);
+
+    // the loading threads never wait, the first use of a ticket makes the frame wait on the GPU instead
+    scheduler.use(tickets.back());
+    auto uploads = scheduler.prepareGraphicsSubmit();
+    CHECK(uploads.transferWaitValue == tickets.back().value);
+    submitFrame(device.device.get(), uploads);
+
+    scheduler.wait(tickets.back());
+    CHECK(scheduler.isComplete(tickets.back()));
+    int mismatches = 0;
+    for (size_t i = 0; i < buffers.size(); ++i)
+        mismatches += contentMatches(device.device.get(), buffers[i], contents[i]) ? 0 : 1;
+    CHECK(mismatches == 0);
+
+    device->waitIdle();
+    scheduler.destroy();
+    for (auto& b : buffers)
+        device->deAllocateBuffer(b.buffer, b.allocation);
+}
+
+// A frame that reads nothing new neither waits on the transfer timeline nor records acquires
+TEST_CASE(framesWaitOnlyForTicketsTheyUse)
+{
+    editor_test::HeadlessDevice device;
+    auto& scheduler = UploadScheduler::getInstance();
+    scheduler.init(device.device.get(), 1024 * 1024);
+
+    std::vector<char> data(4096, 'x');
+    auto first = createReadbackBuffer(device.device.get(), data.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    auto second = createReadbackBuffer(device.device.get(), data.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+    auto firstTicket = scheduler.uploadBuffer(data.data(), data.size(), first.buffer);
+    scheduler.flush();
+    auto secondTicket = scheduler.uploadBuffer(data.data(), data.size(), second.buffer);
+    CHECK(secondTicket.value == firstTicket.value + 1);
+
+    auto idle = scheduler.prepareGraphicsSubmit();
+    CHECK(idle.transferWaitValue == 0);
+    CHECK(!idle.cmd);
+    submitFrame(device.device.get(), idle);
+
+    scheduler.use(firstTicket);
+    auto reading = scheduler.prepareGraphicsSubmit();
+    CHECK(reading.transferWaitValue == firstTicket.value);
+    submitFrame(device.device.get(), reading);
+
+    // already acquired, using it again costs nothing
+    scheduler.use(firstTicket);
+    auto again = scheduler.prepareGraphicsSubmit();
+    CHECK(again.transferWaitValue == 0);
+    submitFrame(device.device.get(), again);
+
+    // staged per frame writes are copied on the graphics queue
+    std::vector<char> update(256, 'y');
+    scheduler.stageGraphicsCopy(update.data(), update.size(), first.buffer, 128);
+    auto copying = scheduler.prepareGraphicsSubmit();
+    CHECK(copying.cmd);
+    submitFrame(device.device.get(), copying);
+
+    device->waitIdle();
+    std::vector<char> expected = data;
+    std::copy(update.begin(), update.end(), expected.begin() + 128);
+    CHECK(contentMatches(device.device.get(), first, expected));
+    scheduler.wait(secondTicket);
+    CHECK(contentMatches(device.device.get(), second, data));
+
+    scheduler.destroy();
+    device->deAllocateBuffer(first.buffer, first.allocation);
+    device->deAllocateBuffer(second.buffer, second.allocation);
+}
+
+TEST_MAIN()
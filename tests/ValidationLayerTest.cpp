@@ -0,0 +1,44 @@
+#include "TestCommon.hpp"
+#include "ComputeDispatch.hpp"
+
+/*
+*  Every Vulkan test runs on a HeadlessDevice, which fails the case on any error of the synchronization validation
+*  layer. These cases make sure that errors do reach it: a hazard recorded on purpose must be counted.
+*/
+namespace
+{
+    void requireValidation(const editor_test::HeadlessDevice& device)
+    {
+        if (!device.validated)
+            TEST_SKIP("the validation layer is not installed");
+    }
+}
+
+TEST_CASE(unsynchronizedWritesAreReported)
+{
+    editor_test::HeadlessDevice device;
+    requireValidation(device);
+    editor_test::HostBuffer buffer(device.device.get(), 256);
+    editor_test::submitAndWait(device.device.get(), [&](vk::CommandBuffer cmd) {
+        cmd.fillBuffer(buffer, 0, VK_WHOLE_SIZE, 1u);
+        // write after write without a barrier
+        cmd.fillBuffer(buffer, 0, VK_WHOLE_SIZE, 2u);
+    });
+    CHECK(device.takeValidationErrors() > 0);
+}
+
+TEST_CASE(barrierBetweenWritesIsClean)
+{
+    editor_test::HeadlessDevice device;
+    requireValidation(device);
+    editor_test::HostBuffer buffer(device.device.get(), 256);
+    editor_test::submitAndWait(device.device.get(), [&](vk::CommandBuffer cmd) {
+        cmd.fillBuffer(buffer, 0, VK_WHOLE_SIZE, 1u);
+        editor_test::fullBarrier(cmd);
+        cmd.fillBuffer(buffer, 0, VK_WHOLE_SIZE, 2u);
+    });
+    CHECK(device.takeValidationErrors() == 0);
+    CHECK(buffer.read<uint32_t>()[63] == 2u);
+}
+
+TEST_MAIN()
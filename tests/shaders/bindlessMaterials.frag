@@ -0,0 +1,44 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Not used by the editor: includes every material of res/shaders/materials together so that the shader tests
+// compile them against built_in/bindless.glsl the way a G-buffer shader fetching its material by index would.
+
+#include "materials/coatedDiffuse.glsl"
+#include "materials/coatedConductor.glsl"
+
+layout(location = 0) in vec2 inFragUV;
+
+layout(location = 0) out vec4 outFragAlbedo;
+
+USE_BINDLESS_HEAP(3);
+
+layout(push_constant) uniform constants
+{
+    uvec4 ID;
+    uvec4 material;
+} pushConstant;
+
+void main()
+{
+    uint materialIdx = pushConstant.material.x;
+    if (materialIdx == INVALID_BINDLESS_INDEX)
+    {
+        outFragAlbedo = vec4(1.0, 0.0, 1.0, 1.0);
+        return;
+    }
+    uint type = BINDLESS_MATERIAL(materialIdx).type;
+    if (type == MATERIAL_TYPE_COATED_DIFFUSE)
+    {
+        outFragAlbedo = evaluateCoatedDiffuse(getCoatedDiffuseData(materialIdx, inFragUV));
+    }
+    else if (type == MATERIAL_TYPE_COATED_CONDUCTOR)
+    {
+        outFragAlbedo = evaluateCoatedConductor(getCoatedConductorData(materialIdx, inFragUV));
+    }
+    else
+    {
+        outFragAlbedo = BINDLESS_REFLECTANCE(BINDLESS_MATERIAL(materialIdx), inFragUV);
+    }
+}